@@ -0,0 +1,454 @@
+/*
+ * @file checksum.c
+ * @brief CRC, hash and digest kernels
+ *
+ * Author: A.R. Ansari <ansarirahim1@gmail.com>
+ * Date: 2026-10-18
+ *
+ * - CRC32/CRC32C: slicing-by-8, 8 KB of tables each, built in DRAM at
+ *   startup (flash-resident tables would stall on cache misses)
+ * - CRC32C on the Linux target: SSE4.2 crc32 instruction, or the ARMv8 CRC
+ *   extension, picked at startup
+ * - XXH32: four independent lanes, SSE4.1 on the Linux target
+ * - SHA-256: mbedTLS, backed by the SHA accelerator on ESP targets
+ */
+
+#include "checksum.h"
+#include <stdbool.h>
+#include <string.h>
+#include "sdkconfig.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "checksum.c assumes a little-endian target"
+#endif
+
+#if CONFIG_IDF_TARGET_LINUX && (defined(__x86_64__) || defined(__i386__))
+#define CHECKSUM_HOST_X86   1
+#include <immintrin.h>
+#elif CONFIG_IDF_TARGET_LINUX && defined(__ARM_FEATURE_CRC32)
+#define CHECKSUM_HOST_ARM   1
+#include <arm_acle.h>
+#endif
+
+#define CRC32_POLY      0xEDB88320u     /**< IEEE 802.3, reflected */
+#define CRC32C_POLY     0x82F63B78u     /**< Castagnoli, reflected */
+
+#define XXH_P1          2654435761u
+#define XXH_P2          2246822519u
+#define XXH_P3          3266489917u
+#define XXH_P4          668265263u
+#define XXH_P5          374761393u
+
+static uint32_t s_crc32_table[8][256];
+static uint32_t s_crc32c_table[8][256];
+static uint8_t s_crc32c_inv[256];       /**< Index of the CRC32C entry with a given top byte */
+
+#if CHECKSUM_HOST_X86
+static bool s_host_sse42;
+static bool s_host_sse41;
+#endif
+
+static inline uint32_t rotl32(uint32_t v, int r)
+{
+    return (v << r) | (v >> (32 - r));
+}
+
+static inline uint32_t load32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// ----------------------------------------------------------------------------
+// CRC
+// ----------------------------------------------------------------------------
+
+static void crc_table_build(uint32_t table[8][256], uint32_t poly)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (poly & (0 - (c & 1)));
+        }
+        table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            const uint32_t prev = table[t - 1][i];
+            table[t][i] = (prev >> 8) ^ table[0][prev & 0xFF];
+        }
+    }
+}
+
+/**
+ * Build the tables before app_main(), so the kernels never race on a lazy
+ * init and stay branch-free.
+ */
+__attribute__((constructor)) static void checksum_tables_init(void)
+{
+    crc_table_build(s_crc32_table, CRC32_POLY);
+    crc_table_build(s_crc32c_table, CRC32C_POLY);
+    for (uint32_t i = 0; i < 256; i++) {
+        s_crc32c_inv[s_crc32c_table[0][i] >> 24] = (uint8_t)i;
+    }
+#if CHECKSUM_HOST_X86
+    __builtin_cpu_init();
+    s_host_sse42 = __builtin_cpu_supports("sse4.2");
+    s_host_sse41 = __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+/**
+ * Slicing-by-8 on the inverted CRC state: one 8-byte step is eight
+ * independent table lookups instead of a serial chain of eight.
+ */
+static uint32_t crc_slice8(const uint32_t table[8][256], uint32_t crc, const uint8_t *p, size_t n)
+{
+    while (n > 0 && ((uintptr_t)p & 3) != 0) {
+        crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        n--;
+    }
+    while (n >= 8) {
+        const uint32_t a = load32(p) ^ crc;
+        const uint32_t b = load32(p + 4);
+        crc = table[7][a & 0xFF] ^ table[6][(a >> 8) & 0xFF] ^
+              table[5][(a >> 16) & 0xFF] ^ table[4][a >> 24] ^
+              table[3][b & 0xFF] ^ table[2][(b >> 8) & 0xFF] ^
+              table[1][(b >> 16) & 0xFF] ^ table[0][b >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n-- > 0) {
+        crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if CHECKSUM_HOST_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t n)
+{
+    while (n > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        n--;
+    }
+#if defined(__x86_64__)
+    uint64_t c64 = crc;
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c64 = _mm_crc32_u64(c64, v);
+        p += 8;
+        n -= 8;
+    }
+    crc = (uint32_t)c64;
+#endif
+    while (n >= 4) {
+        crc = _mm_crc32_u32(crc, load32(p));
+        p += 4;
+        n -= 4;
+    }
+    while (n-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#elif CHECKSUM_HOST_ARM
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *p, size_t n)
+{
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+        p += 8;
+        n -= 8;
+    }
+    while (n-- > 0) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+uint32_t checksum_crc32(uint32_t crc, const void *data, size_t len)
+{
+    return ~crc_slice8(s_crc32_table, ~crc, data, len);
+}
+
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t len)
+{
+#if CHECKSUM_HOST_X86
+    if (s_host_sse42) {
+        return ~crc32c_sse42(~crc, data, len);
+    }
+#elif CHECKSUM_HOST_ARM
+    return ~crc32c_armv8(~crc, data, len);
+#endif
+    return ~crc_slice8(s_crc32c_table, ~crc, data, len);
+}
+
+/*
+ * CRC is linear: for equal lengths the syndrome is the raw CRC (no init, no
+ * final XOR) of the error pattern. A flip of bit b in byte j is table[1 << b]
+ * followed by len - 1 - j zero bytes, so zero-byte steps are undone from the
+ * syndrome until a single-bit pattern shows up.
+ */
+int32_t checksum_crc32c_locate_bit(uint32_t syndrome, size_t len)
+{
+    uint32_t v = syndrome;
+
+    for (size_t zeros = 0; zeros < len; zeros++) {
+        for (int b = 0; b < 8; b++) {
+            if (v == s_crc32c_table[0][1u << b]) {
+                return (int32_t)((len - 1 - zeros) * 8 + b);
+            }
+        }
+        // Undo v = table[c & 0xFF] ^ (c >> 8)
+        const uint8_t idx = s_crc32c_inv[v >> 24];
+        v = ((v ^ s_crc32c_table[0][idx]) << 8) | idx;
+    }
+    return -1;
+}
+
+// ----------------------------------------------------------------------------
+// XXH32
+// ----------------------------------------------------------------------------
+
+static inline uint32_t xxh32_round(uint32_t acc, uint32_t in)
+{
+    acc += in * XXH_P2;
+    acc = rotl32(acc, 13);
+    return acc * XXH_P1;
+}
+
+static void xxh32_stripes_scalar(uint32_t v[4], const uint8_t *p, size_t stripes)
+{
+    uint32_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+
+    while (stripes-- > 0) {
+        v1 = xxh32_round(v1, load32(p));
+        v2 = xxh32_round(v2, load32(p + 4));
+        v3 = xxh32_round(v3, load32(p + 8));
+        v4 = xxh32_round(v4, load32(p + 12));
+        p += 16;
+    }
+    v[0] = v1;
+    v[1] = v2;
+    v[2] = v3;
+    v[3] = v4;
+}
+
+#if CHECKSUM_HOST_X86
+__attribute__((target("sse4.1")))
+static void xxh32_stripes_sse41(uint32_t v[4], const uint8_t *p, size_t stripes)
+{
+    const __m128i p1 = _mm_set1_epi32((int)XXH_P1);
+    const __m128i p2 = _mm_set1_epi32((int)XXH_P2);
+    __m128i acc = _mm_loadu_si128((const __m128i *)v);
+
+    while (stripes-- > 0) {
+        acc = _mm_add_epi32(acc, _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)p), p2));
+        acc = _mm_or_si128(_mm_slli_epi32(acc, 13), _mm_srli_epi32(acc, 19));
+        acc = _mm_mullo_epi32(acc, p1);
+        p += 16;
+    }
+    _mm_storeu_si128((__m128i *)v, acc);
+}
+#endif
+
+static inline void xxh32_stripes(uint32_t v[4], const uint8_t *p, size_t stripes)
+{
+#if CHECKSUM_HOST_X86
+    if (s_host_sse41) {
+        xxh32_stripes_sse41(v, p, stripes);
+        return;
+    }
+#endif
+    xxh32_stripes_scalar(v, p, stripes);
+}
+
+static inline void xxh32_lanes_init(uint32_t v[4], uint32_t seed)
+{
+    v[0] = seed + XXH_P1 + XXH_P2;
+    v[1] = seed + XXH_P2;
+    v[2] = seed;
+    v[3] = seed - XXH_P1;
+}
+
+static uint32_t xxh32_finish(const uint32_t v[4], bool large, uint32_t seed, uint64_t total,
+                             const uint8_t *p, size_t n)
+{
+    uint32_t h;
+
+    if (large) {
+        h = rotl32(v[0], 1) + rotl32(v[1], 7) + rotl32(v[2], 12) + rotl32(v[3], 18);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += (uint32_t)total;
+    while (n >= 4) {
+        h += load32(p) * XXH_P3;
+        h = rotl32(h, 17) * XXH_P4;
+        p += 4;
+        n -= 4;
+    }
+    while (n-- > 0) {
+        h += *p++ * XXH_P5;
+        h = rotl32(h, 11) * XXH_P1;
+    }
+    h ^= h >> 15;
+    h *= XXH_P2;
+    h ^= h >> 13;
+    h *= XXH_P3;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t checksum_xxh32(const void *data, size_t len, uint32_t seed)
+{
+    const uint8_t *p = data;
+    uint32_t v[4];
+
+    xxh32_lanes_init(v, seed);
+    const size_t stripes = len / 16;
+    xxh32_stripes(v, p, stripes);
+    return xxh32_finish(v, len >= 16, seed, len, p + stripes * 16, len % 16);
+}
+
+// ----------------------------------------------------------------------------
+// SHA-256
+// ----------------------------------------------------------------------------
+
+esp_err_t checksum_sha256(const void *data, size_t len, uint8_t digest[32])
+{
+    return mbedtls_sha256(data, len, digest, 0) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+// ----------------------------------------------------------------------------
+// Streaming API
+// ----------------------------------------------------------------------------
+
+static inline void store_be32(uint8_t *out, uint32_t v)
+{
+    out[0] = (uint8_t)(v >> 24);
+    out[1] = (uint8_t)(v >> 16);
+    out[2] = (uint8_t)(v >> 8);
+    out[3] = (uint8_t)v;
+}
+
+size_t checksum_digest_size(checksum_algo_t algo)
+{
+    switch (algo) {
+    case CHECKSUM_CRC32:
+    case CHECKSUM_CRC32C:
+    case CHECKSUM_XXH32:
+        return 4;
+    case CHECKSUM_SHA256:
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+esp_err_t checksum_init(checksum_ctx_t *ctx, checksum_algo_t algo)
+{
+    if (ctx == NULL || checksum_digest_size(algo) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->algo = algo;
+    switch (algo) {
+    case CHECKSUM_XXH32:
+        xxh32_lanes_init(ctx->xxh32.v, 0);
+        break;
+    case CHECKSUM_SHA256:
+        mbedtls_sha256_init(&ctx->sha256);
+        if (mbedtls_sha256_starts(&ctx->sha256, 0) != 0) {
+            mbedtls_sha256_free(&ctx->sha256);
+            return ESP_FAIL;
+        }
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
+
+static void xxh32_update(checksum_ctx_t *ctx, const uint8_t *p, size_t len)
+{
+    ctx->xxh32.total += len;
+    if (ctx->xxh32.buf_len > 0) {
+        const size_t fill = 16 - ctx->xxh32.buf_len;
+        if (len < fill) {
+            memcpy(ctx->xxh32.buf + ctx->xxh32.buf_len, p, len);
+            ctx->xxh32.buf_len += (uint8_t)len;
+            return;
+        }
+        memcpy(ctx->xxh32.buf + ctx->xxh32.buf_len, p, fill);
+        xxh32_stripes(ctx->xxh32.v, ctx->xxh32.buf, 1);
+        ctx->xxh32.buf_len = 0;
+        p += fill;
+        len -= fill;
+    }
+    const size_t stripes = len / 16;
+    xxh32_stripes(ctx->xxh32.v, p, stripes);
+    p += stripes * 16;
+    len %= 16;
+    memcpy(ctx->xxh32.buf, p, len);
+    ctx->xxh32.buf_len = (uint8_t)len;
+}
+
+esp_err_t checksum_update(checksum_ctx_t *ctx, const void *data, size_t len)
+{
+    if (ctx == NULL || (data == NULL && len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    switch (ctx->algo) {
+    case CHECKSUM_CRC32:
+        ctx->crc = checksum_crc32(ctx->crc, data, len);
+        break;
+    case CHECKSUM_CRC32C:
+        ctx->crc = checksum_crc32c(ctx->crc, data, len);
+        break;
+    case CHECKSUM_XXH32:
+        xxh32_update(ctx, data, len);
+        break;
+    case CHECKSUM_SHA256:
+        if (mbedtls_sha256_update(&ctx->sha256, data, len) != 0) {
+            return ESP_FAIL;
+        }
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t checksum_final(checksum_ctx_t *ctx, uint8_t *digest)
+{
+    if (ctx == NULL || digest == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_OK;
+    switch (ctx->algo) {
+    case CHECKSUM_CRC32:
+    case CHECKSUM_CRC32C:
+        store_be32(digest, ctx->crc);
+        break;
+    case CHECKSUM_XXH32:
+        store_be32(digest, xxh32_finish(ctx->xxh32.v, ctx->xxh32.total >= 16, ctx->xxh32.seed,
+                                        ctx->xxh32.total, ctx->xxh32.buf, ctx->xxh32.buf_len));
+        break;
+    case CHECKSUM_SHA256:
+        if (mbedtls_sha256_finish(&ctx->sha256, digest) != 0) {
+            ret = ESP_FAIL;
+        }
+        mbedtls_sha256_free(&ctx->sha256);
+        break;
+    default:
+        ret = ESP_ERR_INVALID_ARG;
+        break;
+    }
+    return ret;
+}
@@ -0,0 +1,176 @@
+/**
+ * @file checksum.h
+ * @brief CRC, hash and digest kernels shared by storage, sync and transfer code
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ *
+ * @section description Description
+ * - CRC32 (IEEE 802.3, zlib compatible) and CRC32C (Castagnoli), slicing-by-8
+ * - XXH32, a fast non-cryptographic hash for content addressing and dedup
+ * - SHA-256 through mbedTLS, which uses the SHA accelerator on ESP targets
+ * - One streaming API over all of them
+ *
+ * On the Linux target, CRC32C uses the SSE4.2 / ARMv8 CRC instructions and
+ * XXH32 uses SSE4.1 when the host CPU has them.
+ *
+ * @section usage Usage
+ * @code
+ * checksum_ctx_t ctx;
+ * uint8_t digest[CHECKSUM_MAX_DIGEST_SIZE];
+ *
+ * checksum_init(&ctx, CHECKSUM_SHA256);
+ * while ((len = read_chunk(buf, sizeof(buf))) > 0) {
+ *     checksum_update(&ctx, buf, len);
+ * }
+ * checksum_final(&ctx, digest);
+ * @endcode
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "mbedtls/sha256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Largest digest produced by checksum_final() */
+#define CHECKSUM_MAX_DIGEST_SIZE    32
+
+/**
+ * @brief Checksum algorithms
+ */
+typedef enum {
+    CHECKSUM_CRC32,     /**< CRC32, 4 byte digest */
+    CHECKSUM_CRC32C,    /**< CRC32C, 4 byte digest */
+    CHECKSUM_XXH32,     /**< XXH32 with seed 0, 4 byte digest */
+    CHECKSUM_SHA256,    /**< SHA-256, 32 byte digest */
+} checksum_algo_t;
+
+/**
+ * @brief Streaming checksum state
+ *
+ * Fields are private. A context started with checksum_init() must be
+ * finished with checksum_final().
+ */
+typedef struct {
+    checksum_algo_t algo;
+    union {
+        uint32_t crc;
+        struct {
+            uint32_t v[4];              /**< Lane accumulators */
+            uint64_t total;             /**< Bytes hashed */
+            uint32_t seed;
+            uint8_t buf[16];            /**< Partial stripe */
+            uint8_t buf_len;
+        } xxh32;
+        mbedtls_sha256_context sha256;
+    };
+} checksum_ctx_t;
+
+/**
+ * @brief Update a CRC32 (IEEE 802.3, reflected, same as zlib crc32())
+ *
+ * @param crc  0 to start, or the result of a previous call to continue
+ * @param data Data
+ * @param len  Length of data in bytes
+ * @return Updated CRC
+ */
+uint32_t checksum_crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Update a CRC32C (Castagnoli, reflected, as used by iSCSI and ext4)
+ *
+ * @param crc  0 to start, or the result of a previous call to continue
+ * @param data Data
+ * @param len  Length of data in bytes
+ * @return Updated CRC
+ */
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Locate a single flipped bit from a CRC32C syndrome
+ *
+ * The syndrome is the CRC32C of the received buffer XOR the expected CRC32C.
+ * For buffers of the same length it only depends on the error pattern, so a
+ * single-bit error can be located and flipped back. Runs in O(len), meant
+ * for the error path.
+ *
+ * @param syndrome Computed CRC XOR expected CRC, non-zero
+ * @param len      Length of the buffer in bytes
+ * @return Bit position (byte * 8 + bit, LSB first), or -1 if the syndrome is
+ *         not a single-bit error within len bytes
+ */
+int32_t checksum_crc32c_locate_bit(uint32_t syndrome, size_t len);
+
+/**
+ * @brief Compute XXH32 of a buffer
+ *
+ * @param data Data
+ * @param len  Length of data in bytes
+ * @param seed Hash seed
+ * @return Hash, matches the reference XXH32()
+ */
+uint32_t checksum_xxh32(const void *data, size_t len, uint32_t seed);
+
+/**
+ * @brief Compute SHA-256 of a buffer
+ *
+ * @param data   Data
+ * @param len    Length of data in bytes
+ * @param digest Output, 32 bytes
+ * @return ESP_OK, or ESP_FAIL if mbedTLS failed
+ */
+esp_err_t checksum_sha256(const void *data, size_t len, uint8_t digest[32]);
+
+/**
+ * @brief Get the digest size of an algorithm
+ *
+ * @param algo Algorithm
+ * @return Digest size in bytes, 0 for an unknown algorithm
+ */
+size_t checksum_digest_size(checksum_algo_t algo);
+
+/**
+ * @brief Start a streaming checksum
+ *
+ * @param ctx  Context
+ * @param algo Algorithm
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a NULL context or unknown
+ *         algorithm, ESP_FAIL if mbedTLS failed
+ */
+esp_err_t checksum_init(checksum_ctx_t *ctx, checksum_algo_t algo);
+
+/**
+ * @brief Add data to a streaming checksum
+ *
+ * @param ctx  Context started with checksum_init()
+ * @param data Data
+ * @param len  Length of data in bytes
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a NULL argument, ESP_FAIL if
+ *         mbedTLS failed
+ */
+esp_err_t checksum_update(checksum_ctx_t *ctx, const void *data, size_t len);
+
+/**
+ * @brief Finish a streaming checksum and release the context
+ *
+ * 32-bit results are stored big-endian, the usual printed form.
+ *
+ * @param ctx    Context started with checksum_init()
+ * @param digest Output, checksum_digest_size() bytes
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a NULL argument, ESP_FAIL if
+ *         mbedTLS failed
+ */
+esp_err_t checksum_final(checksum_ctx_t *ctx, uint8_t *digest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CHECKSUM_H
@@ -0,0 +1,26 @@
+/*
+ * @file test_app_main.c
+ * @brief Unity runner for the checksum component
+ *
+ * Author: A.R. Ansari <ansarirahim1@gmail.com>
+ * Date: 2026-10-18
+ *
+ * Runs on the ESP32-S3 and on the Linux target:
+ *   idf.py --preview set-target linux && idf.py build monitor
+ */
+
+#include "unity.h"
+#include "unity_test_runner.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void app_main(void)
+{
+    unity_run_menu();
+}
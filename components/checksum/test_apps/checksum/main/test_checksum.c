@@ -0,0 +1,148 @@
+/**
+ * @file test_checksum.c
+ * @brief Unit Tests for the Checksum Component
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ *
+ * @section test_cases Test Cases
+ * - Reference vectors for CRC32, CRC32C, XXH32 and SHA-256
+ * - CRC chaining across calls
+ * - Streaming API matches one-shot results for random splits and alignments
+ * - CRC32C single-bit error location
+ * - Invalid arguments
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "unity.h"
+#include "sdkconfig.h"
+#include "checksum.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_rom_crc.h"
+#endif
+
+#define TEST_BUF_SIZE   8192
+
+static uint8_t s_buf[TEST_BUF_SIZE + 8];
+
+static void fill_random(uint8_t *buf, size_t len, unsigned seed) {
+    srand(seed);
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)rand();
+    }
+}
+
+static void one_shot(checksum_algo_t algo, const uint8_t *data, size_t len, uint8_t *digest) {
+    uint32_t v = 0;
+    switch (algo) {
+    case CHECKSUM_CRC32:
+        v = checksum_crc32(0, data, len);
+        break;
+    case CHECKSUM_CRC32C:
+        v = checksum_crc32c(0, data, len);
+        break;
+    case CHECKSUM_XXH32:
+        v = checksum_xxh32(data, len, 0);
+        break;
+    case CHECKSUM_SHA256:
+        TEST_ASSERT_EQUAL(ESP_OK, checksum_sha256(data, len, digest));
+        return;
+    }
+    digest[0] = (uint8_t)(v >> 24);
+    digest[1] = (uint8_t)(v >> 16);
+    digest[2] = (uint8_t)(v >> 8);
+    digest[3] = (uint8_t)v;
+}
+
+TEST_CASE("Checksum: reference vectors", "[checksum][ci]") {
+    static const uint8_t sha_abc[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+    };
+    const char *spam = "Nobody inspects the spammish repetition";
+    uint8_t digest[32];
+
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, checksum_crc32(0, "123456789", 9));
+    TEST_ASSERT_EQUAL_HEX32(0xE3069283, checksum_crc32c(0, "123456789", 9));
+    TEST_ASSERT_EQUAL_HEX32(0x02CC5D05, checksum_xxh32("", 0, 0));
+    TEST_ASSERT_EQUAL_HEX32(0x32D153FF, checksum_xxh32("abc", 3, 0));
+    TEST_ASSERT_EQUAL_HEX32(0xE2293B2F, checksum_xxh32(spam, strlen(spam), 0));
+    TEST_ASSERT_EQUAL(ESP_OK, checksum_sha256("abc", 3, digest));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(sha_abc, digest, sizeof(sha_abc));
+}
+
+TEST_CASE("Checksum: CRC32 matches ROM CRC and chains", "[checksum][ci]") {
+    fill_random(s_buf, TEST_BUF_SIZE, 1);
+    const uint32_t whole = checksum_crc32(0, s_buf, TEST_BUF_SIZE);
+#if !CONFIG_IDF_TARGET_LINUX
+    TEST_ASSERT_EQUAL_HEX32(esp_rom_crc32_le(0, s_buf, TEST_BUF_SIZE), whole);
+#endif
+    for (size_t split = 0; split <= TEST_BUF_SIZE; split += 1021) {
+        TEST_ASSERT_EQUAL_HEX32(whole, checksum_crc32(checksum_crc32(0, s_buf, split), s_buf + split, TEST_BUF_SIZE - split));
+    }
+    const uint32_t whole_c = checksum_crc32c(0, s_buf, TEST_BUF_SIZE);
+    TEST_ASSERT_EQUAL_HEX32(whole_c, checksum_crc32c(checksum_crc32c(0, s_buf, 777), s_buf + 777, TEST_BUF_SIZE - 777));
+}
+
+TEST_CASE("Checksum: streaming matches one-shot", "[checksum][ci]") {
+    fill_random(s_buf, sizeof(s_buf), 2);
+    srand(3);
+    for (int iter = 0; iter < 200; iter++) {
+        const size_t len = rand() % TEST_BUF_SIZE;
+        const uint8_t *data = s_buf + rand() % 8;   // Unaligned starts
+
+        for (checksum_algo_t algo = CHECKSUM_CRC32; algo <= CHECKSUM_SHA256; algo++) {
+            uint8_t expected[CHECKSUM_MAX_DIGEST_SIZE];
+            uint8_t digest[CHECKSUM_MAX_DIGEST_SIZE];
+            checksum_ctx_t ctx;
+
+            one_shot(algo, data, len, expected);
+            TEST_ASSERT_EQUAL(ESP_OK, checksum_init(&ctx, algo));
+            for (size_t pos = 0; pos < len;) {
+                size_t chunk = rand() % 64;
+                chunk = chunk > len - pos ? len - pos : chunk;
+                TEST_ASSERT_EQUAL(ESP_OK, checksum_update(&ctx, data + pos, chunk));
+                pos += chunk;
+            }
+            TEST_ASSERT_EQUAL(ESP_OK, checksum_final(&ctx, digest));
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, digest, checksum_digest_size(algo));
+        }
+    }
+}
+
+TEST_CASE("Checksum: CRC32C locates single-bit errors", "[checksum][ci]") {
+    const size_t len = 4096;
+    fill_random(s_buf, len, 4);
+    const uint32_t good = checksum_crc32c(0, s_buf, len);
+
+    srand(5);
+    for (int iter = 0; iter < 50; iter++) {
+        const int32_t bit = rand() % (int32_t)(len * 8);
+        s_buf[bit / 8] ^= 1u << (bit % 8);
+        const uint32_t syndrome = good ^ checksum_crc32c(0, s_buf, len);
+        TEST_ASSERT_EQUAL_INT32(bit, checksum_crc32c_locate_bit(syndrome, len));
+        s_buf[bit / 8] ^= 1u << (bit % 8);
+    }
+
+    // Two flipped bits are not reported as one
+    s_buf[10] ^= 0x01;
+    s_buf[3000] ^= 0x80;
+    const int32_t bit = checksum_crc32c_locate_bit(good ^ checksum_crc32c(0, s_buf, len), len);
+    TEST_ASSERT_TRUE(bit != 10 * 8 && bit != 3000 * 8 + 7);
+}
+
+TEST_CASE("Checksum: invalid arguments", "[checksum][ci]") {
+    checksum_ctx_t ctx;
+    uint8_t digest[CHECKSUM_MAX_DIGEST_SIZE];
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, checksum_init(NULL, CHECKSUM_CRC32));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, checksum_init(&ctx, (checksum_algo_t)42));
+    TEST_ASSERT_EQUAL(0, checksum_digest_size((checksum_algo_t)42));
+    TEST_ASSERT_EQUAL(ESP_OK, checksum_init(&ctx, CHECKSUM_CRC32));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, checksum_update(&ctx, NULL, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, checksum_update(&ctx, NULL, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, checksum_final(&ctx, NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, checksum_final(&ctx, digest));
+}
@@ -0,0 +1,124 @@
+/**
+ * @file test_checksum_bench.c
+ * @brief Checksum kernel microbenchmarks
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ *
+ * Reports bytes per CPU cycle for every kernel over a range of buffer sizes.
+ * Cycles come from the CCOUNT register on the target and the TSC on x86
+ * Linux hosts. Not part of the 'ci' group, run from the Unity menu:
+ *   [bench]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "unity.h"
+#include "sdkconfig.h"
+#include "checksum.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#else
+#include "esp_cpu.h"
+#include "esp_rom_crc.h"
+#endif
+
+#define BENCH_MAX_SIZE      32768
+#define BENCH_MIN_BYTES     (1024 * 1024)   /**< Bytes hashed per measurement */
+
+typedef uint32_t (*bench_fn_t)(const uint8_t *data, size_t len);
+
+static uint8_t s_bench_buf[BENCH_MAX_SIZE];
+
+static inline uint64_t bench_cycles(void) {
+#if CONFIG_IDF_TARGET_LINUX
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;     // No portable cycle counter, nanoseconds instead
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+static uint32_t bench_crc32(const uint8_t *data, size_t len) {
+    return checksum_crc32(0, data, len);
+}
+
+static uint32_t bench_crc32c(const uint8_t *data, size_t len) {
+    return checksum_crc32c(0, data, len);
+}
+
+static uint32_t bench_xxh32(const uint8_t *data, size_t len) {
+    return checksum_xxh32(data, len, 0);
+}
+
+static uint32_t bench_sha256(const uint8_t *data, size_t len) {
+    uint8_t digest[32];
+    checksum_sha256(data, len, digest);
+    return digest[0];
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static uint32_t bench_rom_crc32(const uint8_t *data, size_t len) {
+    return esp_rom_crc32_le(0, data, len);
+}
+#endif
+
+static double bench_run(bench_fn_t fn, size_t size) {
+    const int reps = BENCH_MIN_BYTES / size;
+    volatile uint32_t sink = fn(s_bench_buf, size);     // Warm caches
+
+    // CCOUNT is 32 bits, short runs keep it from wrapping
+    uint64_t best = UINT64_MAX;
+    for (int run = 0; run < 3; run++) {
+        const uint64_t start = bench_cycles();
+        for (int i = 0; i < reps; i++) {
+            sink += fn(s_bench_buf, size);
+        }
+        const uint64_t cycles = (uint32_t)(bench_cycles() - start);
+        best = cycles < best ? cycles : best;
+    }
+    (void)sink;
+    return (double)reps * size / (double)best;
+}
+
+TEST_CASE("Checksum: throughput (bytes/cycle)", "[checksum][bench]") {
+    static const struct {
+        const char *name;
+        bench_fn_t fn;
+    } kernels[] = {
+        { "crc32", bench_crc32 },
+        { "crc32c", bench_crc32c },
+        { "xxh32", bench_xxh32 },
+        { "sha256", bench_sha256 },
+#if !CONFIG_IDF_TARGET_LINUX
+        { "rom_crc32", bench_rom_crc32 },
+#endif
+    };
+    static const size_t sizes[] = { 64, 512, 4096, BENCH_MAX_SIZE };
+
+    for (size_t i = 0; i < sizeof(s_bench_buf); i++) {
+        s_bench_buf[i] = (uint8_t)rand();
+    }
+    printf("%-10s", "bytes");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        printf("%10u", (unsigned)sizes[s]);
+    }
+    printf("\n");
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        printf("%-10s", kernels[k].name);
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            const double bpc = bench_run(kernels[k].fn, sizes[s]);
+            TEST_ASSERT_TRUE(bpc > 0);
+            printf("%10.3f", bpc);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,11 @@
+# SPDX-License-Identifier: Apache-2.0
+
+import pytest
+from pytest_embedded_idf.dut import IdfDut
+
+
+@pytest.mark.esp32s3
+@pytest.mark.linux
+@pytest.mark.host_test
+def test_checksum(dut: IdfDut) -> None:
+    dut.run_all_single_board_cases(group=['ci'])
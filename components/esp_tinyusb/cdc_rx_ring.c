@@ -0,0 +1,70 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include "cdc_rx_ring.h"
+
+bool cdc_rx_ring_init(cdc_rx_ring_t *ring, size_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return false;
+    }
+    ring->buf = malloc(size);
+    if (ring->buf == NULL) {
+        return false;
+    }
+    ring->size = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return true;
+}
+
+void cdc_rx_ring_free(cdc_rx_ring_t *ring)
+{
+    free(ring->buf);
+    ring->buf = NULL;
+    ring->size = 0;
+}
+
+size_t cdc_rx_ring_used(const cdc_rx_ring_t *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire) -
+           atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+size_t cdc_rx_ring_write_span(cdc_rx_ring_t *ring, uint8_t **span)
+{
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    // Acquire: the consumer is done with the bytes it released
+    const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    const size_t pos = head & (ring->size - 1);
+    const size_t free_total = ring->size - (head - tail);
+    const size_t to_end = ring->size - pos;
+    *span = ring->buf + pos;
+    return (free_total < to_end) ? free_total : to_end;
+}
+
+void cdc_rx_ring_commit(cdc_rx_ring_t *ring, size_t size)
+{
+    // Release: the written bytes are visible before the new head
+    atomic_fetch_add_explicit(&ring->head, size, memory_order_release);
+}
+
+size_t cdc_rx_ring_peek(cdc_rx_ring_t *ring, const uint8_t **span)
+{
+    const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    const size_t pos = tail & (ring->size - 1);
+    const size_t used = head - tail;
+    const size_t to_end = ring->size - pos;
+    *span = ring->buf + pos;
+    return (used < to_end) ? used : to_end;
+}
+
+void cdc_rx_ring_consume(cdc_rx_ring_t *ring, size_t size)
+{
+    atomic_fetch_add_explicit(&ring->tail, size, memory_order_release);
+}
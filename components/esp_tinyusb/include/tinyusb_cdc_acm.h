@@ -91,6 +91,7 @@ typedef struct {
     tusb_cdcacm_callback_t callback_rx_wanted_char; /*!< Pointer to the function with the `tusb_cdcacm_callback_t` type that will be handled as a callback */
     tusb_cdcacm_callback_t callback_line_state_changed; /*!< Pointer to the function with the `tusb_cdcacm_callback_t` type that will be handled as a callback */
     tusb_cdcacm_callback_t callback_line_coding_changed; /*!< Pointer to the function with the `tusb_cdcacm_callback_t` type that will be handled as a callback */
+    size_t rx_span_buf_size; /*!< Size of the RX span buffer in bytes, a power of two. 0: none, received data stays in the TinyUSB FIFO. See `tinyusb_cdcacm_rx_peek` */
 } tinyusb_config_cdcacm_t;
 
 /************************************************************************/
@@ -184,6 +185,34 @@ esp_err_t tinyusb_cdcacm_write_flush(tinyusb_cdcacm_itf_t itf, uint32_t timeout_
  */
 esp_err_t tinyusb_cdcacm_read(tinyusb_cdcacm_itf_t itf, uint8_t *out_buf, size_t out_buf_sz, size_t *rx_data_size);
 
+/**
+ * @brief Get received data in place
+ *
+ * With an RX span buffer (`rx_span_buf_size`), received data is moved out of the TinyUSB FIFO on every packet, and
+ * can be parsed where it lies instead of being copied by `tinyusb_cdcacm_read`. The TinyUSB FIFO then only has to
+ * hold one packet, CONFIG_TINYUSB_CDC_RX_BUFSIZE can be as small as CONFIG_TINYUSB_CDC_EP_BUFSIZE.
+ *
+ * Data that wraps around the end of the buffer comes in two spans: peek again after consuming the first one. The
+ * span stays valid until it is consumed. Call from one task at a time; not for a port used by the VFS driver.
+ *
+ * @param[in] itf   Index of CDC interface
+ * @param[out] data Start of the received data
+ * @param[out] size Bytes at data, 0 if nothing was received
+ * @return esp_err_t ESP_OK, ESP_ERR_INVALID_STATE, or ESP_ERR_NOT_SUPPORTED without an RX span buffer
+ */
+esp_err_t tinyusb_cdcacm_rx_peek(tinyusb_cdcacm_itf_t itf, const uint8_t **data, size_t *size);
+
+/**
+ * @brief Release received data
+ *
+ * Frees the first bytes of the data returned by `tinyusb_cdcacm_rx_peek` for new data.
+ *
+ * @param[in] itf  Index of CDC interface
+ * @param[in] size Bytes to release, at most the size returned by the last peek
+ * @return esp_err_t ESP_OK, ESP_ERR_INVALID_STATE, ESP_ERR_INVALID_ARG, or ESP_ERR_NOT_SUPPORTED without an RX span buffer
+ */
+esp_err_t tinyusb_cdcacm_rx_consume(tinyusb_cdcacm_itf_t itf, size_t size);
+
 /**
  * @brief Check if the CDC interface is initialized
  *
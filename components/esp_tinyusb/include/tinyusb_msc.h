@@ -100,9 +100,16 @@ typedef struct {
 #if (SOC_SDMMC_HOST_SUPPORTED)
         sdmmc_card_t *card;                 /*!< Pointer to the SD/MMC card structure. */
 #endif // SOC_SDMMC_HOST_SUPPORTED
+        struct {
+            size_t size;                                /*!< Size of the RAM disk in bytes, a multiple of 512. */
+            const esp_partition_t *snapshot_partition;  /*!< Partition for snapshots, NULL if not used. */
+        } ramdisk;                          /*!< RAM disk configuration. */
+        const esp_partition_t *partition;   /*!< Raw data partition for log-structured SPI Flash storage. */
     } medium;                               /*!< Storage medium configuration.
                                              *   - For SPI Flash, this is a wear leveling handle.
                                              *   - For SD/MMC, this is a pointer to the sdmmc_card_t structure.
+                                             *   - For RAM disk, this is the disk size and the optional snapshot partition.
+                                             *   - For log-structured SPI Flash, this is the partition, not used by wear levelling.
                                              */
     tinyusb_msc_fatfs_config_t fat_fs;      /*!< FAT filesystem configuration. */
     tinyusb_msc_mount_point_t mount_point;  /*!< Specifies who initially owns access to the storage:
@@ -113,8 +120,58 @@ typedef struct {
                                              *  This affects whether the filesystem is mounted for local use or exposed over USB on startup.
                                              *  Default value is TINYUSB_MSC_STORAGE_MOUNT_USB.
                                              */
+    const uint8_t *crypt_key;               /*!< AES-256-XTS key for SPI Flash and SD/MMC storage, 64 bytes.
+                                             *   - If NULL, the storage is not encrypted.
+                                             *   - Requires CONFIG_TINYUSB_MSC_CRYPT_ENABLED. The key is copied.
+                                             */
 } tinyusb_msc_storage_config_t;
 
+/**
+ * @brief Integrity checking counters of SPI Flash storage
+ */
+typedef struct {
+    uint32_t checked;                       /*!< Sectors checked against their CRC, on reads and by the scrub task */
+    uint32_t corrected;                     /*!< Sectors that didn't match and were recovered by a re-read or a single-bit correction */
+    uint32_t uncorrectable;                 /*!< Sectors that didn't match and couldn't be recovered */
+    uint32_t scrub_passes;                  /*!< Completed passes of the scrub task over the whole medium */
+} tinyusb_msc_integrity_stats_t;
+
+/**
+ * @brief Erase statistics of SPI Flash storage
+ *
+ * Blocks are flash erase blocks of the wear-levelled volume, as seen by the storage. Wear levelling spreads
+ * them over the physical flash.
+ */
+typedef struct {
+    uint32_t erase_blocks;                  /*!< Erase blocks of the volume */
+    uint32_t erase_total;                   /*!< Erases since the storage was created */
+    uint32_t erase_count_min;               /*!< Lowest erase count of a block */
+    uint32_t erase_count_max;               /*!< Highest erase count of a block */
+    uint32_t partial_erases;                /*!< Erases of partially written blocks, each one copies the rest of the block */
+    uint32_t hot_blocks;                    /*!< Blocks currently classified hot */
+    uint32_t metadata_blocks;               /*!< Blocks holding the boot sector, FATs and root directory, always hot */
+    uint32_t coalesced_writes;              /*!< Writes combined with a pending write of the same hot block, saving an erase each */
+    uint32_t max_write_us;                  /*!< Longest storage write, in microseconds */
+} tinyusb_msc_wear_stats_t;
+
+/**
+ * @brief Statistics of log-structured SPI Flash storage
+ *
+ * Write amplification is `flash_bytes / host_bytes`.
+ */
+typedef struct {
+    uint64_t host_bytes;                    /*!< Bytes written to the storage, by the host or the application */
+    uint64_t flash_bytes;                   /*!< Bytes programmed to flash: data, garbage collection copies, summaries and checkpoints */
+    uint32_t erase_total;                   /*!< 4 KB flash blocks erased */
+    uint32_t gc_runs;                       /*!< Segments reclaimed by garbage collection */
+    uint32_t gc_copied;                     /*!< Live sectors copied by garbage collection */
+    uint32_t checkpoints;                   /*!< Checkpoints of the sector map written */
+    uint32_t segments;                      /*!< Segments of the partition, 32 KB each */
+    uint32_t free_segments;                 /*!< Erased segments */
+    uint32_t erase_count_min;               /*!< Lowest erase count of a segment */
+    uint32_t erase_count_max;               /*!< Highest erase count of a segment */
+} tinyusb_msc_ftl_stats_t;
+
 typedef struct {
     union {
         struct {
@@ -199,6 +256,61 @@ esp_err_t tinyusb_msc_new_storage_spiflash(const tinyusb_msc_storage_config_t *c
 esp_err_t tinyusb_msc_new_storage_sdmmc(const tinyusb_msc_storage_config_t *config, tinyusb_msc_storage_handle_t *handle);
 #endif // SOC_SDMMC_HOST_SUPPORTED
 
+/**
+ * @brief Initialize TinyUSB MSC with RAM disk storage
+ *
+ * This function initializes the TinyUSB MSC storage interface with a RAM disk as the storage medium.
+ * The disk is allocated in PSRAM if available, otherwise in internal heap, and has 512-byte sectors.
+ * It suits scratch transfers: files dropped by the host and consumed by the application cost no flash
+ * erase time or wear.
+ *
+ * If a snapshot partition is configured and holds a valid snapshot of the same size, the disk is loaded
+ * from it. Otherwise the disk is formatted, unless `fat_fs.do_not_format` is set.
+ *
+ * @note Only one RAM disk storage can exist at a time.
+ *
+ * @param[in] config Pointer to the configuration structure for TinyUSB MSC storage with RAM disk
+ * @param[out] handle Pointer to the storage handle
+ *
+ * @return
+ *    - ESP_OK: Initialization successful
+ *    - ESP_ERR_INVALID_ARG: Invalid input argument
+ *    - ESP_ERR_INVALID_STATE: RAM disk storage already exists
+ *    - ESP_ERR_NO_MEM: Not enough memory to initialize storage
+ *    - ESP_FAIL: Failed to map storage to LUN or mount storage
+ */
+esp_err_t tinyusb_msc_new_storage_ramdisk(const tinyusb_msc_storage_config_t *config, tinyusb_msc_storage_handle_t *handle);
+
+/**
+ * @brief Initialize TinyUSB MSC with log-structured SPI Flash storage
+ *
+ * An alternative to wear levelling for SPI Flash storage: sectors are written out of place to the next
+ * free flash page and located through a map in RAM, so a sector write costs no erase. Erases happen in
+ * garbage collection, which reclaims 32 KB segments of overwritten sectors. Sectors are 512 bytes,
+ * the reported capacity is smaller than the partition by the space kept for garbage collection
+ * (CONFIG_TINYUSB_MSC_FTL_OVERPROVISION) and the map checkpoints. The map takes 2 bytes of RAM per sector,
+ * in PSRAM if available.
+ *
+ * Writes are durable when they return, a power loss leaves each sector with its old or its new contents.
+ * The partition must not be used by wear levelling, it is formatted on first use. The storage is encrypted
+ * if `crypt_key` is set.
+ *
+ * @note Only one log-structured storage can exist at a time.
+ *
+ * @param[in] config Pointer to the configuration structure for TinyUSB MSC storage with a partition in `medium.partition`
+ * @param[out] handle Pointer to the storage handle
+ *
+ * @return
+ *    - ESP_OK: Initialization successful
+ *    - ESP_ERR_INVALID_ARG: Invalid input argument
+ *    - ESP_ERR_INVALID_STATE: Log-structured storage already exists
+ *    - ESP_ERR_INVALID_SIZE: Partition is too small or too large
+ *    - ESP_ERR_NO_MEM: Not enough memory to initialize storage
+ *    - ESP_ERR_NOT_SUPPORTED: CONFIG_TINYUSB_MSC_FTL_ENABLED is disabled
+ *    - ESP_FAIL: Failed to map storage to LUN or mount storage
+ */
+esp_err_t tinyusb_msc_new_storage_ftl(const tinyusb_msc_storage_config_t *config, tinyusb_msc_storage_handle_t *handle);
+
 /**
  * @brief Delete TinyUSB MSC Storage
  *
@@ -279,6 +391,43 @@ esp_err_t tinyusb_msc_config_storage_fat_fs(tinyusb_msc_storage_handle_t handle,
 esp_err_t tinyusb_msc_set_storage_mount_point(tinyusb_msc_storage_handle_t handle,
                                               tinyusb_msc_mount_point_t mount_point);
 
+/**
+ * @brief Set the capacity reported to the USB host
+ *
+ * Limits the number of sectors exposed over USB, e.g. to the size of a FAT volume that has been
+ * grown in place. When the value changes, the next TEST UNIT READY from the host fails with
+ * UNIT ATTENTION / CAPACITY DATA HAS CHANGED (ASC 0x2A, ASCQ 0x09), so the host re-reads the
+ * capacity without being re-plugged.
+ *
+ * @param[in] handle Storage handle, obtained during storage creation.
+ * @param[in] sector_count Number of sectors to expose, 0 for the full size of the storage medium.
+ *
+ * @return
+ *   - ESP_OK: Capacity set successfully
+ *   - ESP_ERR_INVALID_ARG: sector_count exceeds the size of the storage medium
+ *   - ESP_ERR_INVALID_STATE: Driver is not installed or storage wasn't created
+ */
+esp_err_t tinyusb_msc_set_storage_capacity(tinyusb_msc_storage_handle_t handle, uint32_t sector_count);
+
+/**
+ * @brief Save the contents of a RAM disk storage to its snapshot partition
+ *
+ * The snapshot is loaded when the RAM disk storage is created again, e.g. after a reboot.
+ * USB access to the storage is blocked while the snapshot is taken.
+ *
+ * @note If the storage is mounted to the application, close all files before taking the snapshot.
+ *
+ * @param[in] handle Storage handle, obtained from tinyusb_msc_new_storage_ramdisk().
+ *
+ * @return
+ *   - ESP_OK: Snapshot saved
+ *   - ESP_ERR_INVALID_ARG: handle is NULL
+ *   - ESP_ERR_NOT_SUPPORTED: Storage is not a RAM disk
+ *   - ESP_ERR_INVALID_STATE: Driver is not installed or no snapshot partition was configured
+ *   - ESP_ERR_INVALID_SIZE: Snapshot partition is too small
+ */
+esp_err_t tinyusb_msc_snapshot_storage(tinyusb_msc_storage_handle_t handle);
+
 // ------------------------------------ Getters ------------------------------------
 
 /**
@@ -321,6 +470,67 @@ esp_err_t tinyusb_msc_get_storage_sector_size(tinyusb_msc_storage_handle_t handl
 esp_err_t tinyusb_msc_get_storage_mount_point(tinyusb_msc_storage_handle_t handle,
                                               tinyusb_msc_mount_point_t *mount_point);
 
+/**
+ * @brief Get the FatFs drive of the filesystem mounted to the application
+ *
+ * The drive is valid while the storage is mounted to the application, until the next
+ * TINYUSB_MSC_EVENT_MOUNT_START event. It can be used with FatFs calls taking a drive path, like f_getfree("0:").
+ *
+ * @param[in] handle Storage handle, obtained during storage creation.
+ * @param[out] pdrv Pointer to store the FatFs physical drive number.
+ *
+ * @return
+ *    - ESP_OK: Drive retrieved successfully
+ *    - ESP_ERR_INVALID_ARG: Invalid input argument, pdrv pointer is NULL
+ *    - ESP_ERR_INVALID_STATE: MSC driver is not installed, storage is not initialized or not mounted to the application
+ */
+esp_err_t tinyusb_msc_get_storage_drive(tinyusb_msc_storage_handle_t handle, uint8_t *pdrv);
+
+/**
+ * @brief Get integrity checking counters of SPI Flash storage
+ *
+ * @param[in] handle Storage handle, obtained from tinyusb_msc_new_storage_spiflash().
+ * @param[out] stats Pointer to store the counters since the storage was created.
+ *
+ * @return
+ *    - ESP_OK: Counters retrieved successfully
+ *    - ESP_ERR_INVALID_ARG: Invalid input argument, stats pointer is NULL
+ *    - ESP_ERR_INVALID_STATE: MSC driver is not installed or storage is not initialized
+ *    - ESP_ERR_NOT_SUPPORTED: Storage is not SPI Flash or CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED is disabled
+ */
+esp_err_t tinyusb_msc_get_storage_integrity_stats(tinyusb_msc_storage_handle_t handle,
+                                                  tinyusb_msc_integrity_stats_t *stats);
+
+/**
+ * @brief Get erase statistics of SPI Flash storage
+ *
+ * @param[in] handle Storage handle, obtained from tinyusb_msc_new_storage_spiflash().
+ * @param[out] stats Pointer to store the statistics since the storage was created.
+ *
+ * @return
+ *    - ESP_OK: Statistics retrieved successfully
+ *    - ESP_ERR_INVALID_ARG: Invalid input argument, stats pointer is NULL
+ *    - ESP_ERR_INVALID_STATE: MSC driver is not installed or storage is not initialized
+ *    - ESP_ERR_NOT_SUPPORTED: Storage is not SPI Flash or CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS is disabled
+ */
+esp_err_t tinyusb_msc_get_storage_wear_stats(tinyusb_msc_storage_handle_t handle,
+                                             tinyusb_msc_wear_stats_t *stats);
+
+/**
+ * @brief Get statistics of log-structured SPI Flash storage
+ *
+ * @param[in] handle Storage handle, obtained from tinyusb_msc_new_storage_ftl().
+ * @param[out] stats Pointer to store the statistics since the storage was created.
+ *
+ * @return
+ *    - ESP_OK: Statistics retrieved successfully
+ *    - ESP_ERR_INVALID_ARG: Invalid input argument, stats pointer is NULL
+ *    - ESP_ERR_INVALID_STATE: MSC driver is not installed or storage is not initialized
+ *    - ESP_ERR_NOT_SUPPORTED: Storage is not log-structured SPI Flash storage
+ */
+esp_err_t tinyusb_msc_get_storage_ftl_stats(tinyusb_msc_storage_handle_t handle,
+                                            tinyusb_msc_ftl_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -72,6 +72,17 @@ esp_err_t tinyusb_cdc_deinit(int itf);
  * @return esp_tusb_cdc_t* pointer to the interface or (NULL) on error
  */
 esp_tusb_cdc_t *tinyusb_cdc_get_intf(int itf_num);
+
+/**
+ * @brief Set the function woken when a CDC-ACM interface received data or sent a transfer
+ *
+ * For drivers on top of CDC-ACM, like VFS, that wait for data without taking the user callbacks.
+ * Called from the TinyUSB task, before the user RX callback.
+ * @param itf - number of a CDC object
+ * @param notify - function to call, NULL to remove it
+ * @return esp_err_t ESP_OK or ESP_ERR_INVALID_STATE if the interface is not initialized
+ */
+esp_err_t tinyusb_cdcacm_set_notify(int itf, void (*notify)(int itf));
 /*********************************************************************** Functions*/
 
 #ifdef __cplusplus
@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Single-producer, single-consumer byte ring
+ *
+ * The producer fills the free space in place and commits it, the consumer reads the used space in place and
+ * consumes it. Neither side copies, and neither side takes a lock: head is only written by the producer, tail only
+ * by the consumer.
+ */
+typedef struct {
+    uint8_t *buf;               /*!< Storage */
+    size_t size;                /*!< Size of the storage, a power of two */
+    atomic_size_t head;         /*!< Bytes committed since init, free-running */
+    atomic_size_t tail;         /*!< Bytes consumed since init, free-running */
+} cdc_rx_ring_t;
+
+/**
+ * @brief Allocate the ring storage
+ *
+ * @param[out] ring Ring
+ * @param[in] size Size in bytes, a power of two
+ *
+ * @return true on success, false if the size is not a power of two or out of memory
+ */
+bool cdc_rx_ring_init(cdc_rx_ring_t *ring, size_t size);
+
+/**
+ * @brief Free the ring storage
+ *
+ * @param[in] ring Ring
+ */
+void cdc_rx_ring_free(cdc_rx_ring_t *ring);
+
+/**
+ * @brief Bytes in the ring
+ *
+ * @param[in] ring Ring
+ *
+ * @return Bytes committed and not yet consumed
+ */
+size_t cdc_rx_ring_used(const cdc_rx_ring_t *ring);
+
+/**
+ * @brief Producer: contiguous free space
+ *
+ * @param[in] ring Ring
+ * @param[out] span Start of the free space
+ *
+ * @return Bytes that can be written at span, up to the end of the storage
+ */
+size_t cdc_rx_ring_write_span(cdc_rx_ring_t *ring, uint8_t **span);
+
+/**
+ * @brief Producer: make written bytes visible to the consumer
+ *
+ * @param[in] ring Ring
+ * @param[in] size Bytes written at the last write span, not more than its size
+ */
+void cdc_rx_ring_commit(cdc_rx_ring_t *ring, size_t size);
+
+/**
+ * @brief Consumer: contiguous data
+ *
+ * Data that wraps around the end of the storage comes in two spans, the second one after the first is consumed.
+ *
+ * @param[in] ring Ring
+ * @param[out] span Start of the data
+ *
+ * @return Bytes readable at span, 0 if the ring is empty
+ */
+size_t cdc_rx_ring_peek(cdc_rx_ring_t *ring, const uint8_t **span);
+
+/**
+ * @brief Consumer: release read bytes to the producer
+ *
+ * @param[in] ring Ring
+ * @param[in] size Bytes to release, not more than cdc_rx_ring_used()
+ */
+void cdc_rx_ring_consume(cdc_rx_ring_t *ring, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
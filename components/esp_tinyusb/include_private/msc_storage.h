@@ -25,6 +25,8 @@ extern "C" {
 typedef enum {
     STORAGE_MEDIUM_TYPE_SPIFLASH = 0, /*!< Storage type is SPI flash with wear leveling. */
     STORAGE_MEDIUM_TYPE_SDMMC,        /*!< Storage type is SDMMC card. */
+    STORAGE_MEDIUM_TYPE_RAMDISK,      /*!< Storage type is RAM disk in PSRAM or heap. */
+    STORAGE_MEDIUM_TYPE_FTL,          /*!< Storage type is log-structured SPI flash on a raw partition. */
 } storage_medium_type_t;
 
 /**
@@ -38,6 +40,16 @@ typedef struct {
     uint32_t sector_size;                       /*!< Size of a single sector in bytes. */
 } storage_info_t;
 
+/**
+ * @brief Buffer of a vectored transfer
+ *
+ * The buffers of a vectored transfer hold consecutive sectors, each buffer a whole number of sectors.
+ */
+typedef struct {
+    void *base;                                 /*!< Start of the buffer. */
+    size_t size;                                /*!< Size of the buffer in bytes. */
+} storage_iovec_t;
+
 /**
  * @brief Storage medium structure
  *
@@ -50,10 +62,110 @@ typedef struct {
     esp_err_t (*unmount)(void);                                                            /*!< Storage unmount function pointer. */
     esp_err_t (*read)(uint32_t lba, uint32_t offset, size_t size, void *dest);       /*!< Storage read function pointer. */
     esp_err_t (*write)(uint32_t lba, uint32_t offset, size_t size, const void *src); /*!< Storage write function pointer. */
+    esp_err_t (*readv)(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt);     /*!< Vectored read of consecutive sectors, NULL to read each buffer separately. */
+    esp_err_t (*writev)(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt);    /*!< Vectored write of consecutive sectors, NULL to write each buffer separately. */
+    esp_err_t (*sync)(void);                                                         /*!< Write back the data the medium holds in RAM, NULL if it holds none. */
     esp_err_t (*get_info)(storage_info_t *info);                                     /*!< Storage get information function pointer */
     void (*close)(void);                                                                        /*!< Storage close function pointer. */
 } storage_medium_t;
 
+/**
+ * @brief Count the leading buffers of a vectored transfer that follow each other in memory
+ *
+ * Media use this to turn a vectored transfer into as few single transfers as possible.
+ *
+ * @param[in] iov Buffers of the transfer
+ * @param[in] iovcnt Number of buffers, at least one
+ * @param[out] size Total size of the adjacent buffers in bytes
+ *
+ * @return Number of adjacent buffers, at least one
+ */
+static inline size_t storage_iov_run(const storage_iovec_t *iov, size_t iovcnt, size_t *size)
+{
+    size_t n = 1;
+    *size = iov[0].size;
+    while (n < iovcnt && (const uint8_t *)iov[0].base + *size == (const uint8_t *)iov[n].base) {
+        *size += iov[n].size;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Read consecutive sectors into several buffers
+ *
+ * Uses the vectored read of the medium. Media without one, including the decorators, get one read per run of
+ * adjacent buffers: a batch of chunks in one buffer is a single read.
+ *
+ * @param[in] medium Storage medium
+ * @param[in] sector_size Sector size of the medium
+ * @param[in] lba First sector
+ * @param[in] iov Buffers of the transfer
+ * @param[in] iovcnt Number of buffers
+ *
+ * @return ESP_OK, or the error of the failed read
+ */
+static inline esp_err_t storage_medium_readv(const storage_medium_t *medium, uint32_t sector_size, uint32_t lba,
+                                             const storage_iovec_t *iov, size_t iovcnt)
+{
+    if (medium->readv != NULL) {
+        return medium->readv(lba, iov, iovcnt);
+    }
+    while (iovcnt > 0) {
+        size_t size;
+        const size_t n = storage_iov_run(iov, iovcnt, &size);
+        const esp_err_t ret = medium->read(lba, 0, size, iov[0].base);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        lba += size / sector_size;
+        iov += n;
+        iovcnt -= n;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Write consecutive sectors from several buffers
+ *
+ * Same as storage_medium_readv(), for writes.
+ *
+ * @return ESP_OK, or the error of the failed write
+ */
+static inline esp_err_t storage_medium_writev(const storage_medium_t *medium, uint32_t sector_size, uint32_t lba,
+                                              const storage_iovec_t *iov, size_t iovcnt)
+{
+    if (medium->writev != NULL) {
+        return medium->writev(lba, iov, iovcnt);
+    }
+    while (iovcnt > 0) {
+        size_t size;
+        const size_t n = storage_iov_run(iov, iovcnt, &size);
+        const esp_err_t ret = medium->write(lba, 0, size, iov[0].base);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        lba += size / sector_size;
+        iov += n;
+        iovcnt -= n;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Write back the data a medium holds in RAM
+ *
+ * Decorators sync their own state, then the medium they wrap.
+ *
+ * @param[in] medium Storage medium
+ *
+ * @return ESP_OK, also for media without a sync, or the error of the failed write
+ */
+static inline esp_err_t storage_medium_sync(const storage_medium_t *medium)
+{
+    return (medium->sync != NULL) ? medium->sync() : ESP_OK;
+}
+
 /**
  * @brief Mount the storage to the application
  *
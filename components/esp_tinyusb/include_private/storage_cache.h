@@ -0,0 +1,41 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string.h>
+#include "stdint.h"
+#include "esp_err.h"
+#include "msc_storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Wrap a storage medium with a two-tier sector cache
+ *
+ * The returned medium forwards every call to the backing medium and keeps recently used sectors
+ * in a small hot tier in internal DMA-capable RAM and a larger cold tier in PSRAM. Sectors evicted
+ * from the hot tier are demoted to the cold tier; cold hits are promoted back. Writes go through
+ * to the backing medium. The cache is dropped whenever the medium is mounted to or unmounted from
+ * the application, as the application accesses the medium through FatFs diskio directly.
+ *
+ * Closing the returned medium closes the backing medium and frees the cache.
+ *
+ * @param[in] backing Medium to be cached
+ * @param[out] medium Pointer to the cached storage API
+ *
+ * @return
+ *    - ESP_OK: Cached medium returned successfully.
+ *    - ESP_ERR_INVALID_ARG: backing or medium is NULL.
+ *    - ESP_ERR_NO_MEM: No free cache slot or not enough memory for the hot tier.
+ */
+esp_err_t storage_cache_open_medium(const storage_medium_t *backing, const storage_medium_t **medium);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,53 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string.h>
+#include "stdint.h"
+#include "esp_err.h"
+#include "msc_storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Open a compressed storage medium on top of a backing medium
+ *
+ * Logical sectors are grouped, each group is LZ-compressed and stored in as many backing sectors
+ * as it needs, found through an indirection map. The logical capacity is larger than the backing
+ * medium (thin provisioning): writes fail with ESP_ERR_NO_MEM once the backing medium is full.
+ * All-zero groups take no space. Groups are unmapped on FatFs TRIM, and groups whose clusters are
+ * all free in the FAT are unmapped when the medium is opened or mounted to the application, as USB
+ * hosts don't trim.
+ *
+ * The map is kept in two copies at the start of the backing medium and committed alternately, data
+ * sectors are never overwritten in place, so a power loss rolls back to the last committed map.
+ * The group being written is kept in RAM until another group is written or the medium is mounted,
+ * unmounted or closed, unless the medium is nearly full: then it is written through so a group that
+ * doesn't fit fails the write that modified it.
+ *
+ * The medium registers its own FatFs diskio driver when mounted to the application, the backing
+ * medium is only accessed through its read and write functions.
+ *
+ * @note A backing medium without a valid map is presented as blank.
+ *
+ * @param[in] backing Medium to store the compressed data on
+ * @param[out] medium Pointer to the compressed storage API
+ *
+ * @return
+ *    - ESP_OK: Storage API returned successfully.
+ *    - ESP_ERR_INVALID_ARG: backing or medium is NULL.
+ *    - ESP_ERR_INVALID_STATE: A compressed medium is already open.
+ *    - ESP_ERR_INVALID_SIZE: Backing medium is too small or has an unsupported sector size.
+ *    - ESP_ERR_NO_MEM: Not enough memory for the map or the group buffers.
+ */
+esp_err_t storage_compress_open_medium(const storage_medium_t *backing, const storage_medium_t **medium);
+
+#ifdef __cplusplus
+}
+#endif
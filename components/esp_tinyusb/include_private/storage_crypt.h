@@ -0,0 +1,48 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string.h>
+#include "stdint.h"
+#include "esp_err.h"
+#include "msc_storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STORAGE_CRYPT_KEY_SIZE  64  /*!< AES-256-XTS key: data key followed by tweak key */
+
+/**
+ * @brief Wrap a storage medium with AES-XTS sector encryption
+ *
+ * Every sector is encrypted as one XTS data unit, with its LBA as the tweak, so the medium keeps
+ * its size and sectors can be accessed at random. AES runs through mbedTLS, which uses the AES
+ * peripheral when hardware acceleration is enabled and the software implementation otherwise.
+ *
+ * With CONFIG_TINYUSB_MSC_CRYPT_PIPELINE, multi-sector transfers are split in chunks and a worker
+ * task encrypts or decrypts one chunk while the calling task reads or writes the previous one.
+ *
+ * The medium registers its own FatFs diskio driver when mounted to the application, the backing
+ * medium is only accessed through its read and write functions. Closing the returned medium closes
+ * the backing medium.
+ *
+ * @param[in] backing Medium to store the encrypted data on
+ * @param[in] key AES-256-XTS key, STORAGE_CRYPT_KEY_SIZE bytes. It is copied.
+ * @param[out] medium Pointer to the encrypted storage API
+ *
+ * @return
+ *    - ESP_OK: Storage API returned successfully.
+ *    - ESP_ERR_INVALID_ARG: backing, key or medium is NULL, or the key was rejected.
+ *    - ESP_ERR_INVALID_SIZE: Sector size is not a multiple of the AES block size.
+ *    - ESP_ERR_NO_MEM: No free slot, or not enough memory for the buffers or the worker task.
+ */
+esp_err_t storage_crypt_open_medium(const storage_medium_t *backing, const uint8_t *key, const storage_medium_t **medium);
+
+#ifdef __cplusplus
+}
+#endif
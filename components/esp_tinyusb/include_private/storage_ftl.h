@@ -0,0 +1,66 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string.h>
+#include "stdint.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "msc_storage.h"
+#include "tinyusb_msc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STORAGE_FTL_SECTOR_SIZE     512     /*!< Sector size of the log-structured medium, one flash page pair */
+
+/**
+ * @brief Open a log-structured storage medium on a raw data partition
+ *
+ * Sectors are never rewritten in place: every write goes to the next free page of the open segment,
+ * followed by a summary entry naming the logical sector, and a RAM map points each logical sector
+ * at its latest page. Segments whose pages were overwritten are reclaimed by garbage collection,
+ * greedy or cost-benefit depending on CONFIG_TINYUSB_MSC_FTL_GC_POLICY, which copies the live pages
+ * and erases the segment. A part of the partition is kept free for this, see
+ * CONFIG_TINYUSB_MSC_FTL_OVERPROVISION.
+ *
+ * A write is durable when it returns. The map is checkpointed to one of two slots at the start of the
+ * partition every CONFIG_TINYUSB_MSC_FTL_CHECKPOINT_INTERVAL segments, on unmount and on close; opening
+ * loads the newest valid checkpoint and replays the summaries written after it. A power loss at any
+ * point leaves every sector with either its old or its new contents.
+ *
+ * The medium registers its own FatFs diskio driver when mounted to the application. Data written by
+ * wear levelling or any other user of the partition is not recognised, the partition is used as erased.
+ *
+ * @param[in] partition Data partition holding the medium, at least 256 KB
+ * @param[out] medium Pointer to the storage API
+ *
+ * @return
+ *    - ESP_OK: Storage API returned successfully.
+ *    - ESP_ERR_INVALID_ARG: partition or medium is NULL.
+ *    - ESP_ERR_INVALID_STATE: A log-structured medium is already open.
+ *    - ESP_ERR_INVALID_SIZE: Partition is too small, or too large for the 16-bit map.
+ *    - ESP_ERR_NO_MEM: Not enough memory for the map.
+ *    - Other: Flash read or erase error.
+ */
+esp_err_t storage_ftl_open_medium(const esp_partition_t *partition, const storage_medium_t **medium);
+
+/**
+ * @brief Get the statistics of the log-structured medium
+ *
+ * @param[out] stats Statistics since the medium was opened, erase counts since the partition was erased
+ *
+ * @return
+ *    - ESP_OK: Statistics returned successfully.
+ *    - ESP_ERR_INVALID_STATE: No log-structured medium is open.
+ */
+esp_err_t storage_ftl_get_stats(tinyusb_msc_ftl_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
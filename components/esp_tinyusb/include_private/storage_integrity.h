@@ -0,0 +1,60 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string.h>
+#include "stdint.h"
+#include "esp_err.h"
+#include "msc_storage.h"
+#include "tinyusb_msc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Open a storage medium that checks a CRC32C of every sector of the backing medium
+ *
+ * The CRC table is kept in RAM and stored in the last sectors of the backing medium, which are
+ * hidden from the returned medium. It is written back on sync, mount, unmount and close, and by
+ * the scrub task once writes have been idle for a while. After an unclean shutdown the table is
+ * rebuilt from the medium contents.
+ *
+ * A sector that doesn't match its CRC is re-read; a single flipped bit is located from the CRC
+ * syndrome, corrected and written back. Other errors fail the read with ESP_ERR_INVALID_CRC.
+ * With CONFIG_TINYUSB_MSC_INTEGRITY_SCRUB_RATE, a task checks the whole medium in the background.
+ *
+ * The medium registers its own FatFs diskio driver when mounted to the application, the backing
+ * medium is only accessed through its read and write functions. Closing the returned medium closes
+ * the backing medium.
+ *
+ * @param[in] backing Medium to check
+ * @param[out] medium Pointer to the checked storage API
+ *
+ * @return
+ *    - ESP_OK: Storage API returned successfully.
+ *    - ESP_ERR_INVALID_ARG: backing or medium is NULL.
+ *    - ESP_ERR_INVALID_STATE: A checked medium is already open.
+ *    - ESP_ERR_INVALID_SIZE: Backing medium is too small or has an unsupported sector size.
+ *    - ESP_ERR_NO_MEM: Not enough memory for the table, the buffers or the scrub task.
+ */
+esp_err_t storage_integrity_open_medium(const storage_medium_t *backing, const storage_medium_t **medium);
+
+/**
+ * @brief Get the error counters of the checked medium
+ *
+ * @param[out] stats Counters since the medium was opened
+ *
+ * @return
+ *    - ESP_OK: Counters returned successfully.
+ *    - ESP_ERR_INVALID_STATE: No checked medium is open.
+ */
+esp_err_t storage_integrity_get_stats(tinyusb_msc_integrity_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
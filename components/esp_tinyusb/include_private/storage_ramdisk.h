@@ -0,0 +1,56 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string.h>
+#include "stdint.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "msc_storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STORAGE_RAMDISK_SECTOR_SIZE     512     /*!< Sector size of the RAM disk, no erase block to match */
+
+/**
+ * @brief Open the storage medium for a RAM disk
+ *
+ * Allocates the disk in PSRAM if available, otherwise in internal heap. The disk is zero-filled,
+ * unless a valid snapshot is found in the snapshot partition, in which case the snapshot is loaded.
+ *
+ * @param[in] size Size of the disk in bytes, a multiple of STORAGE_RAMDISK_SECTOR_SIZE
+ * @param[in] snapshot_partition Partition used for snapshots, may be NULL
+ * @param[out] medium Pointer to the storage API
+ * @param[out] restored Set to true if the disk was loaded from a snapshot, may be NULL
+ *
+ * @return
+ *    - ESP_OK: Storage API returned successfully.
+ *    - ESP_ERR_INVALID_ARG: Invalid size or medium is NULL.
+ *    - ESP_ERR_INVALID_STATE: RAM disk is already open.
+ *    - ESP_ERR_NO_MEM: Not enough memory for the disk.
+ */
+esp_err_t storage_ramdisk_open_medium(size_t size, const esp_partition_t *snapshot_partition,
+                                      const storage_medium_t **medium, bool *restored);
+
+/**
+ * @brief Save the RAM disk contents to the snapshot partition
+ *
+ * The caller must make sure the disk is not written while the snapshot is taken.
+ *
+ * @return
+ *    - ESP_OK: Snapshot saved.
+ *    - ESP_ERR_INVALID_STATE: RAM disk is not open or no snapshot partition was configured.
+ *    - ESP_ERR_INVALID_SIZE: Snapshot partition is too small for the disk.
+ *    - Other: Flash erase or write error.
+ */
+esp_err_t storage_ramdisk_snapshot(void);
+
+#ifdef __cplusplus
+}
+#endif
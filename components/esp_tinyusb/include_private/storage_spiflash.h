@@ -10,6 +10,7 @@
 #include "stdint.h"
 #include "esp_err.h"
 #include "msc_storage.h"
+#include "tinyusb_msc.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,9 +27,23 @@ extern "C" {
  * @return
  *    - ESP_OK: Storage API returned successfully.
  *    - ESP_ERR_INVALID_ARG: Invalid argument, ctx or storage_api is NULL.
+ *    - ESP_ERR_NO_MEM: Not enough memory for the wear counters or hot lines (CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS).
  */
 esp_err_t storage_spiflash_open_medium(wl_handle_t wl_handle, const storage_medium_t **medium);
 
+/**
+ * @brief Get the erase statistics of the SPI Flash medium
+ *
+ * @param[out] stats Statistics since the medium was opened
+ *
+ * @return
+ *    - ESP_OK: Statistics returned successfully.
+ *    - ESP_ERR_INVALID_ARG: stats is NULL.
+ *    - ESP_ERR_INVALID_STATE: The medium is not open.
+ *    - ESP_ERR_NOT_SUPPORTED: CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS is disabled.
+ */
+esp_err_t storage_spiflash_get_wear_stats(tinyusb_msc_wear_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,69 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Receiver of translated data
+ *
+ * @param[in] ctx Context given to the translation
+ * @param[in] data Translated data
+ * @param[in] size Size of the data, never more than the space left
+ */
+typedef void (*vfs_tusb_eol_sink_t)(void *ctx, const char *data, size_t size);
+
+/**
+ * @brief Find the first occurrence of a character
+ *
+ * Compares a word at a time, the CDC line ending translation spends most of its time here.
+ *
+ * @param[in] p Start of the data
+ * @param[in] end End of the data
+ * @param[in] c Character to find
+ *
+ * @return Pointer to the character, end if not found
+ */
+const char *vfs_tusb_eol_find(const char *p, const char *end, char c);
+
+/**
+ * @brief Translate newlines of data to transmit
+ *
+ * The data between newlines goes to the sink in contiguous runs, each newline is replaced with the line ending.
+ * With an LF line ending the data goes to the sink in one run.
+ *
+ * @param[in] src Data to transmit
+ * @param[in] size Size of the data
+ * @param[in] eol Line ending for '\n': "\r\n", "\r" or "\n"
+ * @param[in] space Bytes the sink accepts in total
+ * @param[in] sink Receiver of the translated data
+ * @param[in] ctx Context for the sink
+ *
+ * @return Bytes of src translated. A newline is translated only if its whole line ending fits in the space.
+ */
+size_t vfs_tusb_eol_tx(const char *src, size_t size, const char *eol, size_t space, vfs_tusb_eol_sink_t sink, void *ctx);
+
+/**
+ * @brief Translate line endings of received data to newlines, in place
+ *
+ * A "\r" at the end of the data is kept, with a CRLF line ending the caller decides if the next byte completes it.
+ *
+ * @param[inout] buf Received data
+ * @param[in] size Size of the data
+ * @param[in] eol Line ending translated to '\n': "\r\n", "\r" or "\n"
+ *
+ * @return Size of the translated data, never more than size and never 0 for a non-empty buffer
+ */
+size_t vfs_tusb_eol_rx(char *buf, size_t size, const char *eol);
+
+#ifdef __cplusplus
+}
+#endif
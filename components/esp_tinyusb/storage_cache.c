@@ -0,0 +1,554 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#include "msc_storage.h"
+#include "storage_cache.h"
+
+static const char *TAG = "storage_cache";
+
+#define CACHE_SLOTS_MAX         2                                               /*!< One cache per LUN */
+#define CACHE_LINE_NONE         (-1)
+#define CACHE_LINES_MAX         INT16_MAX
+#define CACHE_HOT_SIZE          (CONFIG_TINYUSB_MSC_CACHE_HOT_SIZE_KB * 1024)
+#if CONFIG_SPIRAM
+#define CACHE_COLD_SIZE         (CONFIG_TINYUSB_MSC_CACHE_COLD_SIZE_KB * 1024)
+#else
+#define CACHE_COLD_SIZE         0
+#endif // CONFIG_SPIRAM
+
+/**
+ * @brief Cached sector descriptor
+ *
+ * Lines [0, hot.count) own a buffer in the hot tier, lines [hot.count, hot.count + cold.count) own a buffer
+ * in the cold tier. A sector never lives in both tiers at once.
+ */
+typedef struct {
+    uint32_t lba;               /*!< Sector held by the line, valid only if `valid` is set */
+    int16_t prev;               /*!< Previous line in the tier LRU list (towards MRU) */
+    int16_t next;               /*!< Next line in the tier LRU list (towards LRU) */
+    int16_t hash_next;          /*!< Next line in the same hash bucket */
+    bool valid;                 /*!< Line holds a copy of `lba` */
+} cache_line_t;
+
+/**
+ * @brief Cache tier
+ */
+typedef struct {
+    uint8_t *pool;              /*!< Sector buffers of the tier */
+    int16_t first;              /*!< Index of the first line of the tier */
+    int16_t count;              /*!< Number of lines in the tier */
+    int16_t mru;                /*!< Most recently used line */
+    int16_t lru;                /*!< Least recently used line, next victim */
+} cache_tier_t;
+
+/**
+ * @brief Cache instance, wraps one backing medium
+ */
+typedef struct {
+    storage_medium_t medium;            /*!< Storage API exposed to the MSC driver */
+    const storage_medium_t *backing;    /*!< Cached medium */
+    uint32_t sector_size;               /*!< Sector size of the backing medium */
+    cache_tier_t hot;                   /*!< Internal DMA-capable RAM tier */
+    cache_tier_t cold;                  /*!< PSRAM tier */
+    cache_line_t *lines;                /*!< Line descriptors of both tiers */
+    int16_t *buckets;                   /*!< Hash buckets, head line of each chain */
+    uint32_t bucket_mask;               /*!< Number of buckets - 1 */
+    struct {
+        uint32_t hot_hits;
+        uint32_t cold_hits;
+        uint32_t misses;
+        uint32_t evictions;
+    } stats;
+} storage_cache_t;
+
+// The storage API has no context argument, so each cache slot gets its own set of functions
+static storage_cache_t *s_cache[CACHE_SLOTS_MAX];
+
+// ============================================================================
+// Lines, tiers and hash
+// ============================================================================
+
+static inline cache_tier_t *cache_tier_of(storage_cache_t *cache, int16_t line)
+{
+    return (line < cache->hot.count) ? &cache->hot : &cache->cold;
+}
+
+static inline uint8_t *cache_line_data(storage_cache_t *cache, int16_t line)
+{
+    cache_tier_t *tier = cache_tier_of(cache, line);
+    return tier->pool + (size_t)(line - tier->first) * cache->sector_size;
+}
+
+static void cache_list_unlink(storage_cache_t *cache, cache_tier_t *tier, int16_t line)
+{
+    cache_line_t *l = &cache->lines[line];
+    if (l->prev != CACHE_LINE_NONE) {
+        cache->lines[l->prev].next = l->next;
+    } else {
+        tier->mru = l->next;
+    }
+    if (l->next != CACHE_LINE_NONE) {
+        cache->lines[l->next].prev = l->prev;
+    } else {
+        tier->lru = l->prev;
+    }
+    l->prev = l->next = CACHE_LINE_NONE;
+}
+
+static void cache_list_push_mru(storage_cache_t *cache, cache_tier_t *tier, int16_t line)
+{
+    cache_line_t *l = &cache->lines[line];
+    l->prev = CACHE_LINE_NONE;
+    l->next = tier->mru;
+    if (tier->mru != CACHE_LINE_NONE) {
+        cache->lines[tier->mru].prev = line;
+    }
+    tier->mru = line;
+    if (tier->lru == CACHE_LINE_NONE) {
+        tier->lru = line;
+    }
+}
+
+static void cache_list_push_lru(storage_cache_t *cache, cache_tier_t *tier, int16_t line)
+{
+    cache_line_t *l = &cache->lines[line];
+    l->next = CACHE_LINE_NONE;
+    l->prev = tier->lru;
+    if (tier->lru != CACHE_LINE_NONE) {
+        cache->lines[tier->lru].next = line;
+    }
+    tier->lru = line;
+    if (tier->mru == CACHE_LINE_NONE) {
+        tier->mru = line;
+    }
+}
+
+static inline void cache_touch(storage_cache_t *cache, int16_t line)
+{
+    cache_tier_t *tier = cache_tier_of(cache, line);
+    if (tier->mru != line) {
+        cache_list_unlink(cache, tier, line);
+        cache_list_push_mru(cache, tier, line);
+    }
+}
+
+static void cache_hash_insert(storage_cache_t *cache, int16_t line)
+{
+    int16_t *head = &cache->buckets[cache->lines[line].lba & cache->bucket_mask];
+    cache->lines[line].hash_next = *head;
+    *head = line;
+}
+
+static void cache_hash_remove(storage_cache_t *cache, int16_t line)
+{
+    int16_t *link = &cache->buckets[cache->lines[line].lba & cache->bucket_mask];
+    while (*link != CACHE_LINE_NONE) {
+        if (*link == line) {
+            *link = cache->lines[line].hash_next;
+            break;
+        }
+        link = &cache->lines[*link].hash_next;
+    }
+    cache->lines[line].hash_next = CACHE_LINE_NONE;
+}
+
+static int16_t cache_lookup(storage_cache_t *cache, uint32_t lba)
+{
+    int16_t line = cache->buckets[lba & cache->bucket_mask];
+    while (line != CACHE_LINE_NONE && cache->lines[line].lba != lba) {
+        line = cache->lines[line].hash_next;
+    }
+    return line;
+}
+
+static void cache_line_drop(storage_cache_t *cache, int16_t line)
+{
+    cache_tier_t *tier = cache_tier_of(cache, line);
+    cache_hash_remove(cache, line);
+    cache->lines[line].valid = false;
+    // Free lines are reused first
+    cache_list_unlink(cache, tier, line);
+    cache_list_push_lru(cache, tier, line);
+}
+
+static void cache_line_set(storage_cache_t *cache, int16_t line, uint32_t lba)
+{
+    cache->lines[line].lba = lba;
+    cache->lines[line].valid = true;
+    cache_hash_insert(cache, line);
+    cache_touch(cache, line);
+}
+
+static void cache_invalidate(storage_cache_t *cache)
+{
+    const int16_t total = cache->hot.count + cache->cold.count;
+    for (uint32_t i = 0; i <= cache->bucket_mask; i++) {
+        cache->buckets[i] = CACHE_LINE_NONE;
+    }
+    for (int16_t i = 0; i < total; i++) {
+        cache->lines[i].valid = false;
+        cache->lines[i].hash_next = CACHE_LINE_NONE;
+    }
+}
+
+static void cache_swap_data(uint8_t *a, uint8_t *b, size_t size)
+{
+    uint32_t *wa = (uint32_t *)a;
+    uint32_t *wb = (uint32_t *)b;
+    for (size_t i = 0; i < size / sizeof(uint32_t); i++) {
+        uint32_t tmp = wa[i];
+        wa[i] = wb[i];
+        wb[i] = tmp;
+    }
+}
+
+/**
+ * @brief Move the hot line to the MRU end of the cold tier, dropping the cold LRU sector if needed
+ */
+static void cache_demote(storage_cache_t *cache, int16_t hot_line)
+{
+    const uint32_t lba = cache->lines[hot_line].lba;
+
+    if (cache->cold.count == 0) {
+        cache_line_drop(cache, hot_line);
+        cache->stats.evictions++;
+        return;
+    }
+
+    int16_t victim = cache->cold.lru;
+    if (cache->lines[victim].valid) {
+        cache_hash_remove(cache, victim);
+        cache->stats.evictions++;
+    }
+    memcpy(cache_line_data(cache, victim), cache_line_data(cache, hot_line), cache->sector_size);
+    cache_line_drop(cache, hot_line);
+    cache_line_set(cache, victim, lba);
+}
+
+/**
+ * @brief Move a cold line to the hot tier; the hot LRU sector takes its place in the cold tier
+ */
+static int16_t cache_promote(storage_cache_t *cache, int16_t cold_line)
+{
+    int16_t hot_line = cache->hot.lru;
+    const uint32_t lba = cache->lines[cold_line].lba;
+
+    cache_hash_remove(cache, cold_line);
+    if (cache->lines[hot_line].valid) {
+        const uint32_t demoted = cache->lines[hot_line].lba;
+        cache_hash_remove(cache, hot_line);
+        cache_swap_data(cache_line_data(cache, hot_line), cache_line_data(cache, cold_line), cache->sector_size);
+        cache_line_set(cache, cold_line, demoted);
+    } else {
+        memcpy(cache_line_data(cache, hot_line), cache_line_data(cache, cold_line), cache->sector_size);
+        cache->lines[cold_line].valid = false;
+        cache_list_unlink(cache, &cache->cold, cold_line);
+        cache_list_push_lru(cache, &cache->cold, cold_line);
+    }
+    cache_line_set(cache, hot_line, lba);
+    return hot_line;
+}
+
+/**
+ * @brief Get the hot line holding the sector, reading it from the backing medium on a miss
+ */
+static esp_err_t cache_get_line(storage_cache_t *cache, uint32_t lba, int16_t *out)
+{
+    int16_t line = cache_lookup(cache, lba);
+
+    if (line != CACHE_LINE_NONE) {
+        if (line < cache->hot.count) {
+            cache->stats.hot_hits++;
+            cache_touch(cache, line);
+        } else {
+            cache->stats.cold_hits++;
+            line = cache_promote(cache, line);
+        }
+        *out = line;
+        return ESP_OK;
+    }
+
+    cache->stats.misses++;
+    line = cache->hot.lru;
+    if (cache->lines[line].valid) {
+        cache_demote(cache, line);
+    }
+    ESP_RETURN_ON_ERROR(cache->backing->read(lba, 0, cache->sector_size, cache_line_data(cache, line)),
+                        TAG, "Backing read failed, lba %"PRIu32, lba);
+    cache_line_set(cache, line, lba);
+    *out = line;
+    return ESP_OK;
+}
+
+/**
+ * @brief Count the consecutive sectors from lba on that are not cached, at most max
+ */
+static uint32_t cache_miss_run(storage_cache_t *cache, uint32_t lba, uint32_t max)
+{
+    uint32_t n = 0;
+    while (n < max && cache_lookup(cache, lba + n) == CACHE_LINE_NONE) {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Store a sector read from the backing medium in the hot tier
+ */
+static void cache_fill_line(storage_cache_t *cache, uint32_t lba, const uint8_t *data)
+{
+    int16_t line = cache->hot.lru;
+    if (cache->lines[line].valid) {
+        cache_demote(cache, line);
+    }
+    memcpy(cache_line_data(cache, line), data, cache->sector_size);
+    cache_line_set(cache, line, lba);
+}
+
+// ============================================================================
+// Storage API
+// ============================================================================
+
+static esp_err_t cache_mount(storage_cache_t *cache, BYTE pdrv)
+{
+    // The application accesses the medium through diskio, bypassing the cache
+    cache_invalidate(cache);
+    return cache->backing->mount(pdrv);
+}
+
+static esp_err_t cache_unmount(storage_cache_t *cache)
+{
+    cache_invalidate(cache);
+    return cache->backing->unmount();
+}
+
+static esp_err_t cache_read(storage_cache_t *cache, uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    uint8_t *out = (uint8_t *)dest;
+
+    lba += offset / cache->sector_size;
+    offset %= cache->sector_size;
+
+    while (size > 0) {
+        // Whole sectors missing one after the other come from one backing read, straight into dest
+        const uint32_t run = (offset == 0) ? cache_miss_run(cache, lba, size / cache->sector_size) : 0;
+        if (run > 1) {
+            const size_t bytes = (size_t)run * cache->sector_size;
+            ESP_RETURN_ON_ERROR(cache->backing->read(lba, 0, bytes, out), TAG,
+                                "Backing read failed, lba %"PRIu32", %"PRIu32" sectors", lba, run);
+            cache->stats.misses += run;
+            for (uint32_t i = 0; i < run; i++) {
+                cache_fill_line(cache, lba + i, out + (size_t)i * cache->sector_size);
+            }
+            out += bytes;
+            size -= bytes;
+            lba += run;
+            continue;
+        }
+
+        const size_t chunk = MIN(size, cache->sector_size - offset);
+        int16_t line;
+        ESP_RETURN_ON_ERROR(cache_get_line(cache, lba, &line), TAG, "Failed to read sector %"PRIu32, lba);
+        memcpy(out, cache_line_data(cache, line) + offset, chunk);
+        out += chunk;
+        size -= chunk;
+        offset = 0;
+        lba++;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t cache_write(storage_cache_t *cache, uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    // Write-through without allocation: a host copying large files would otherwise flush the cache
+    esp_err_t ret = cache->backing->write(lba, offset, size, src);
+    const uint8_t *in = (const uint8_t *)src;
+
+    lba += offset / cache->sector_size;
+    offset %= cache->sector_size;
+
+    while (size > 0) {
+        const size_t chunk = MIN(size, cache->sector_size - offset);
+        int16_t line = cache_lookup(cache, lba);
+        if (line != CACHE_LINE_NONE) {
+            if (ret == ESP_OK) {
+                memcpy(cache_line_data(cache, line) + offset, in, chunk);
+                cache_touch(cache, line);
+            } else {
+                // Medium content is unknown after a failed write
+                cache_line_drop(cache, line);
+            }
+        }
+        in += chunk;
+        size -= chunk;
+        offset = 0;
+        lba++;
+    }
+    return ret;
+}
+
+// Write-through: nothing of its own to write back
+static esp_err_t cache_sync(storage_cache_t *cache)
+{
+    return storage_medium_sync(cache->backing);
+}
+
+static esp_err_t cache_get_info(storage_cache_t *cache, storage_info_t *info)
+{
+    return cache->backing->get_info(info);
+}
+
+static void cache_free(storage_cache_t *cache)
+{
+    heap_caps_free(cache->hot.pool);
+    heap_caps_free(cache->cold.pool);
+    free(cache->lines);
+    free(cache->buckets);
+    free(cache);
+}
+
+static void cache_close(storage_cache_t *cache)
+{
+    ESP_LOGD(TAG, "Hits: hot %"PRIu32", cold %"PRIu32", misses %"PRIu32", evictions %"PRIu32,
+             cache->stats.hot_hits, cache->stats.cold_hits, cache->stats.misses, cache->stats.evictions);
+    cache->backing->close();
+    for (int i = 0; i < CACHE_SLOTS_MAX; i++) {
+        if (s_cache[i] == cache) {
+            s_cache[i] = NULL;
+        }
+    }
+    cache_free(cache);
+}
+
+#define CACHE_SLOT_FUNCTIONS(n)                                                                         \
+    static esp_err_t cache_mount_##n(BYTE pdrv) { return cache_mount(s_cache[n], pdrv); }               \
+    static esp_err_t cache_unmount_##n(void) { return cache_unmount(s_cache[n]); }                      \
+    static esp_err_t cache_read_##n(uint32_t lba, uint32_t offset, size_t size, void *dest)             \
+    { return cache_read(s_cache[n], lba, offset, size, dest); }                                         \
+    static esp_err_t cache_write_##n(uint32_t lba, uint32_t offset, size_t size, const void *src)       \
+    { return cache_write(s_cache[n], lba, offset, size, src); }                                         \
+    static esp_err_t cache_sync_##n(void) { return cache_sync(s_cache[n]); }                            \
+    static esp_err_t cache_get_info_##n(storage_info_t *info) { return cache_get_info(s_cache[n], info); } \
+    static void cache_close_##n(void) { cache_close(s_cache[n]); }
+
+#define CACHE_SLOT_MEDIUM(n)            \
+    {                                   \
+        .mount = &cache_mount_##n,      \
+        .unmount = &cache_unmount_##n,  \
+        .read = &cache_read_##n,        \
+        .write = &cache_write_##n,      \
+        .sync = &cache_sync_##n,        \
+        .get_info = &cache_get_info_##n,\
+        .close = &cache_close_##n,      \
+    }
+
+CACHE_SLOT_FUNCTIONS(0)
+CACHE_SLOT_FUNCTIONS(1)
+
+// Function pointers of each slot, the medium type is taken from the backing medium
+static const storage_medium_t s_slot_medium[CACHE_SLOTS_MAX] = {
+    CACHE_SLOT_MEDIUM(0),
+    CACHE_SLOT_MEDIUM(1),
+};
+
+// ============================================================================
+// Public
+// ============================================================================
+
+esp_err_t storage_cache_open_medium(const storage_medium_t *backing, const storage_medium_t **medium)
+{
+    ESP_RETURN_ON_FALSE(backing != NULL, ESP_ERR_INVALID_ARG, TAG, "Backing medium can't be NULL");
+    ESP_RETURN_ON_FALSE(medium != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage API pointer can't be NULL");
+
+    int slot = -1;
+    for (int i = 0; i < CACHE_SLOTS_MAX; i++) {
+        if (s_cache[i] == NULL) {
+            slot = i;
+            break;
+        }
+    }
+    ESP_RETURN_ON_FALSE(slot >= 0, ESP_ERR_NO_MEM, TAG, "No free cache slot");
+
+    storage_info_t info;
+    ESP_RETURN_ON_ERROR(backing->get_info(&info), TAG, "Failed to get medium info");
+    ESP_RETURN_ON_FALSE(info.sector_size != 0 && (info.sector_size % sizeof(uint32_t)) == 0,
+                        ESP_ERR_INVALID_SIZE, TAG, "Unsupported sector size %"PRIu32, info.sector_size);
+
+    esp_err_t ret = ESP_OK;
+    storage_cache_t *cache = calloc(1, sizeof(storage_cache_t));
+    ESP_RETURN_ON_FALSE(cache != NULL, ESP_ERR_NO_MEM, TAG, "Failed to allocate cache");
+    cache->backing = backing;
+    cache->sector_size = info.sector_size;
+
+    // Hot tier: at least one sector, it is also the bounce buffer for backing reads
+    const int16_t hot_count = (int16_t)MIN(MAX(CACHE_HOT_SIZE / info.sector_size, 1), CACHE_LINES_MAX / 2);
+    cache->hot.pool = heap_caps_malloc((size_t)hot_count * info.sector_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    ESP_GOTO_ON_FALSE(cache->hot.pool != NULL, ESP_ERR_NO_MEM, fail, TAG, "Failed to allocate hot tier");
+    cache->hot.count = hot_count;
+
+    // Cold tier is optional, the cache works as a plain LRU without it
+    int16_t cold_count = (int16_t)MIN(CACHE_COLD_SIZE / info.sector_size, CACHE_LINES_MAX - hot_count);
+    if (cold_count > 0) {
+        cache->cold.pool = heap_caps_malloc((size_t)cold_count * info.sector_size, MALLOC_CAP_SPIRAM);
+        if (cache->cold.pool == NULL) {
+            ESP_LOGW(TAG, "Failed to allocate %d KiB cold tier in PSRAM, using hot tier only",
+                     (int)(cold_count * info.sector_size / 1024));
+            cold_count = 0;
+        }
+    }
+    cache->cold.count = cold_count;
+
+    const int16_t total = cache->hot.count + cache->cold.count;
+    uint32_t buckets = 1;
+    while (buckets < (uint32_t)total) {
+        buckets <<= 1;
+    }
+    cache->bucket_mask = buckets - 1;
+    cache->lines = calloc(total, sizeof(cache_line_t));
+    cache->buckets = malloc(buckets * sizeof(int16_t));
+    ESP_GOTO_ON_FALSE(cache->lines != NULL && cache->buckets != NULL, ESP_ERR_NO_MEM, fail, TAG, "Failed to allocate cache index");
+
+    cache->hot.first = 0;
+    cache->cold.first = cache->hot.count;
+    cache->hot.mru = cache->hot.lru = CACHE_LINE_NONE;
+    cache->cold.mru = cache->cold.lru = CACHE_LINE_NONE;
+    for (int16_t i = 0; i < total; i++) {
+        cache->lines[i].prev = cache->lines[i].next = CACHE_LINE_NONE;
+        cache_list_push_lru(cache, cache_tier_of(cache, i), i);
+    }
+    cache_invalidate(cache);
+
+    const storage_medium_t cached = {
+        .type = backing->type,
+        .mount = s_slot_medium[slot].mount,
+        .unmount = s_slot_medium[slot].unmount,
+        .read = s_slot_medium[slot].read,
+        .write = s_slot_medium[slot].write,
+        .sync = s_slot_medium[slot].sync,
+        .get_info = s_slot_medium[slot].get_info,
+        .close = s_slot_medium[slot].close,
+    };
+    memcpy(&cache->medium, &cached, sizeof(cached));
+    s_cache[slot] = cache;
+    *medium = &cache->medium;
+
+    ESP_LOGD(TAG, "Cache %d: %d hot + %d cold sectors of %"PRIu32" bytes",
+             slot, cache->hot.count, cache->cold.count, info.sector_size);
+    return ESP_OK;
+
+fail:
+    cache_free(cache);
+    return ret;
+}
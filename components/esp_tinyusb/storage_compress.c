@@ -0,0 +1,1003 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "sdkconfig.h"
+#include "diskio_impl.h"
+#include "msc_storage.h"
+#include "storage_compress.h"
+
+static const char *TAG = "storage_compress";
+
+#define COMPRESS_GROUP_SECTORS      CONFIG_TINYUSB_MSC_COMPRESS_GROUP_SECTORS       /*!< Logical sectors per compressed group */
+#define COMPRESS_RATIO_PCT          CONFIG_TINYUSB_MSC_COMPRESS_RATIO               /*!< Logical capacity, in percent of the backing medium */
+#define COMPRESS_COMMIT_INTERVAL    CONFIG_TINYUSB_MSC_COMPRESS_COMMIT_INTERVAL     /*!< Group writes between map commits */
+#define COMPRESS_GROUP_MAX          (32 * 1024)     /*!< LZ positions and map lengths are 16 bits */
+#define COMPRESS_DATA_SECTORS_MAX   UINT16_MAX      /*!< Map entries hold 16-bit sector indices */
+#define COMPRESS_MAP_MAGIC          0x50414D43      /*!< "CMAP" */
+#define COMPRESS_GROUP_NONE         UINT32_MAX
+
+#define LZ_HASH_BITS                12
+#define LZ_MIN_MATCH                4
+#define LZ_LAST_LITERALS            5               /*!< A block always ends with literals */
+#define LZ_MFLIMIT                  12              /*!< No match starts in the last bytes of a block */
+
+/**
+ * @brief Map header, at the start of each map copy
+ */
+typedef struct {
+    uint32_t magic;             /*!< COMPRESS_MAP_MAGIC */
+    uint32_t seq;               /*!< Commit sequence number, the copy with the higher one is current */
+    uint32_t groups;            /*!< Number of map entries */
+    uint16_t group_sectors;     /*!< COMPRESS_GROUP_SECTORS at format time */
+    uint16_t sector_size;       /*!< Backing sector size at format time */
+    uint32_t crc;               /*!< CRC32 of the map entries */
+    uint32_t reserved[3];
+} compress_map_hdr_t;
+
+/**
+ * @brief Map entry, locates one group on the backing medium
+ */
+typedef struct {
+    uint16_t len;                               /*!< Stored bytes: 0 if unmapped (reads as zeros), the group size if stored raw */
+    uint16_t sector[COMPRESS_GROUP_SECTORS];    /*!< Data area sectors holding the stored bytes, in order */
+} compress_map_entry_t;
+
+static struct {
+    const storage_medium_t *backing;    // Medium holding the map and the compressed groups
+    uint32_t sector_size;               // Backing and logical sector size
+    uint32_t group_size;                // Group size in bytes
+    uint32_t groups;                    // Number of groups, logical capacity
+    uint32_t map_sectors;               // Sectors per map copy
+    uint32_t data_base;                 // First backing sector of the data area
+    uint32_t data_sectors;              // Sectors in the data area
+    uint8_t *map_image;                 // Header and entries, as written to the medium
+    compress_map_entry_t *map;          // Entries, inside map_image
+    uint8_t map_copy;                   // Copy holding the last committed map
+    uint32_t uncommitted;               // Group writes since the last commit
+    uint32_t *used;                     // Data sectors referenced by the map in RAM
+    uint32_t *held;                     // Data sectors referenced by the committed map, not reusable until the next commit
+    uint32_t alloc_cursor;              // Next data sector to try, spreads allocations over the area
+    uint8_t *wbuf;                      // Group being written, uncompressed
+    uint32_t wgroup;                    // Group in wbuf
+    bool wdirty;                        // wbuf differs from the medium
+    bool wreserved;                     // Room to store wgroup is guaranteed, otherwise it is written through
+    uint8_t *rbuf;                      // Last group read, uncompressed
+    uint32_t rgroup;                    // Group in rbuf
+    uint8_t *cbuf;                      // Compressed group
+    uint16_t *lz_table;                 // Compressor hash table
+    BYTE pdrv;                          // FatFs drive, while mounted to the application
+} s_cz = {
+    .pdrv = 0xFF,
+};
+
+// ============================================================================
+// LZ compression, LZ4 block format
+// ============================================================================
+
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *lz_put_length(uint8_t *op, const uint8_t *oend, size_t len)
+{
+    while (len >= 255) {
+        if (op >= oend) {
+            return NULL;
+        }
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= oend) {
+        return NULL;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/**
+ * @brief Emit one sequence: literals, then a match unless match_len is 0 (last sequence)
+ */
+static uint8_t *lz_put_sequence(uint8_t *op, const uint8_t *oend, const uint8_t *lit, size_t lit_len,
+                                size_t offset, size_t match_len)
+{
+    const size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+    if (op >= oend) {
+        return NULL;
+    }
+    uint8_t *token = op++;
+    *token = (uint8_t)((MIN(lit_len, 15) << 4) | MIN(ml, 15));
+    if (lit_len >= 15 && (op = lz_put_length(op, oend, lit_len - 15)) == NULL) {
+        return NULL;
+    }
+    if ((size_t)(oend - op) < lit_len) {
+        return NULL;
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0) {
+        return op;
+    }
+    if (oend - op < 2) {
+        return NULL;
+    }
+    *op++ = (uint8_t)(offset & 0xFF);
+    *op++ = (uint8_t)(offset >> 8);
+    if (ml >= 15 && (op = lz_put_length(op, oend, ml - 15)) == NULL) {
+        return NULL;
+    }
+    return op;
+}
+
+/**
+ * @brief Greedy single-pass compressor
+ *
+ * @return Compressed size, 0 if it does not fit in cap bytes
+ */
+static size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, uint16_t *table)
+{
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + cap;
+    size_t ip = 0;
+    size_t anchor = 0;
+
+    // Positions are stored + 1, 0 marks an empty slot
+    memset(table, 0, sizeof(uint16_t) << LZ_HASH_BITS);
+
+    if (n > LZ_MFLIMIT) {
+        const size_t limit = n - LZ_MFLIMIT;
+        while (ip < limit) {
+            const uint32_t seq = lz_read32(src + ip);
+            const uint32_t h = lz_hash(seq);
+            const size_t ref = table[h];
+            table[h] = (uint16_t)(ip + 1);
+            if (ref == 0 || lz_read32(src + ref - 1) != seq) {
+                ip++;
+                continue;
+            }
+
+            size_t len = LZ_MIN_MATCH;
+            while (ip + len < n - LZ_LAST_LITERALS && src[ref - 1 + len] == src[ip + len]) {
+                len++;
+            }
+            op = lz_put_sequence(op, oend, src + anchor, ip - anchor, ip - (ref - 1), len);
+            if (op == NULL) {
+                return 0;
+            }
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    op = lz_put_sequence(op, oend, src + anchor, n - anchor, 0, 0);
+    return (op != NULL) ? (size_t)(op - dst) : 0;
+}
+
+static bool lz_get_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return false;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+/**
+ * @brief Decompress a block, every access is bounds checked
+ *
+ * @return Decompressed size, -1 if the block is malformed or does not fit in cap bytes
+ */
+static int lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + n;
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + cap;
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+        size_t len = token >> 4;
+        if (len == 15 && !lz_get_length(&ip, iend, &len)) {
+            return -1;
+        }
+        if ((size_t)(iend - ip) < len || (size_t)(oend - op) < len) {
+            return -1;
+        }
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if (ip >= iend) {
+            break; // Last sequence has no match
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        const size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+        len = token & 0x0F;
+        if (len == 15 && !lz_get_length(&ip, iend, &len)) {
+            return -1;
+        }
+        len += LZ_MIN_MATCH;
+        if ((size_t)(oend - op) < len) {
+            return -1;
+        }
+        // Byte by byte, the match may overlap the output
+        const uint8_t *match = op - offset;
+        while (len--) {
+            *op++ = *match++;
+        }
+    }
+    return (int)(op - dst);
+}
+
+// ============================================================================
+// Map and allocation
+// ============================================================================
+
+static inline bool bit_get(const uint32_t *bm, uint32_t i)
+{
+    return (bm[i / 32] >> (i % 32)) & 1;
+}
+
+static inline void bit_set(uint32_t *bm, uint32_t i)
+{
+    bm[i / 32] |= 1u << (i % 32);
+}
+
+static inline void bit_clr(uint32_t *bm, uint32_t i)
+{
+    bm[i / 32] &= ~(1u << (i % 32));
+}
+
+static inline size_t bitmap_bytes(void)
+{
+    return ((s_cz.data_sectors + 31) / 32) * sizeof(uint32_t);
+}
+
+static inline uint32_t stored_sectors(uint16_t len)
+{
+    return (len + s_cz.sector_size - 1) / s_cz.sector_size;
+}
+
+static inline compress_map_hdr_t *map_hdr(void)
+{
+    return (compress_map_hdr_t *)s_cz.map_image;
+}
+
+static esp_err_t map_alloc(uint32_t count, uint16_t *sectors)
+{
+    uint32_t found = 0;
+    uint32_t i = s_cz.alloc_cursor;
+
+    for (uint32_t n = 0; n < s_cz.data_sectors && found < count; n++) {
+        if (!bit_get(s_cz.used, i) && !bit_get(s_cz.held, i)) {
+            sectors[found++] = (uint16_t)i;
+        }
+        i = (i + 1 < s_cz.data_sectors) ? i + 1 : 0;
+    }
+    if (found < count) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        bit_set(s_cz.used, sectors[n]);
+    }
+    s_cz.alloc_cursor = i;
+    return ESP_OK;
+}
+
+/**
+ * @brief Count free data sectors, now or once the map is committed
+ */
+static uint32_t map_free_sectors(bool after_commit)
+{
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < bitmap_bytes() / sizeof(uint32_t); i++) {
+        used += __builtin_popcount(s_cz.used[i] | (after_commit ? 0 : s_cz.held[i]));
+    }
+    return s_cz.data_sectors - used;
+}
+
+static esp_err_t map_commit(void)
+{
+    compress_map_hdr_t *hdr = map_hdr();
+    const uint8_t copy = s_cz.map_copy ^ 1;
+    const uint32_t base = copy * s_cz.map_sectors;
+
+    hdr->seq++;
+    hdr->crc = esp_rom_crc32_le(0, (const uint8_t *)s_cz.map, s_cz.groups * sizeof(compress_map_entry_t));
+    for (uint32_t i = 0; i < s_cz.map_sectors; i++) {
+        esp_err_t ret = s_cz.backing->write(base + i, 0, s_cz.sector_size, s_cz.map_image + i * s_cz.sector_size);
+        if (ret != ESP_OK) {
+            hdr->seq--;
+            ESP_LOGE(TAG, "Failed to write map copy %d", copy);
+            return ret;
+        }
+    }
+
+    // Sectors released since the last commit are free from now on
+    s_cz.map_copy = copy;
+    memcpy(s_cz.held, s_cz.used, bitmap_bytes());
+    s_cz.uncommitted = 0;
+    return ESP_OK;
+}
+
+/**
+ * @brief Read one map copy into map_image and check it, rebuilding the used bitmap
+ */
+static bool map_load_copy(uint8_t copy, uint32_t *seq)
+{
+    const compress_map_hdr_t *hdr = map_hdr();
+
+    for (uint32_t i = 0; i < s_cz.map_sectors; i++) {
+        if (s_cz.backing->read(copy * s_cz.map_sectors + i, 0, s_cz.sector_size,
+                               s_cz.map_image + i * s_cz.sector_size) != ESP_OK) {
+            return false;
+        }
+    }
+    if (hdr->magic != COMPRESS_MAP_MAGIC || hdr->groups != s_cz.groups ||
+            hdr->group_sectors != COMPRESS_GROUP_SECTORS || hdr->sector_size != s_cz.sector_size) {
+        return false;
+    }
+    if (hdr->crc != esp_rom_crc32_le(0, (const uint8_t *)s_cz.map, s_cz.groups * sizeof(compress_map_entry_t))) {
+        return false;
+    }
+
+    memset(s_cz.used, 0, bitmap_bytes());
+    for (uint32_t g = 0; g < s_cz.groups; g++) {
+        const compress_map_entry_t *e = &s_cz.map[g];
+        if (e->len > s_cz.group_size) {
+            return false;
+        }
+        for (uint32_t i = 0; i < stored_sectors(e->len); i++) {
+            if (e->sector[i] >= s_cz.data_sectors || bit_get(s_cz.used, e->sector[i])) {
+                return false;
+            }
+            bit_set(s_cz.used, e->sector[i]);
+        }
+    }
+    *seq = hdr->seq;
+    return true;
+}
+
+static void map_load(void)
+{
+    uint32_t seq[2] = {0};
+    const bool valid0 = map_load_copy(0, &seq[0]);
+    const bool valid1 = map_load_copy(1, &seq[1]);
+
+    if (valid0 && (!valid1 || (int32_t)(seq[0] - seq[1]) > 0)) {
+        map_load_copy(0, &seq[0]);
+        s_cz.map_copy = 0;
+    } else if (valid1) {
+        s_cz.map_copy = 1;
+    } else {
+        // No map: blank medium, the first commit goes to copy 0
+        ESP_LOGW(TAG, "No valid map found, medium is blank");
+        memset(s_cz.map_image, 0, s_cz.map_sectors * s_cz.sector_size);
+        memset(s_cz.used, 0, bitmap_bytes());
+        compress_map_hdr_t *hdr = map_hdr();
+        hdr->magic = COMPRESS_MAP_MAGIC;
+        hdr->groups = s_cz.groups;
+        hdr->group_sectors = COMPRESS_GROUP_SECTORS;
+        hdr->sector_size = s_cz.sector_size;
+        s_cz.map_copy = 1;
+    }
+    memcpy(s_cz.held, s_cz.used, bitmap_bytes());
+    s_cz.uncommitted = 0;
+}
+
+// ============================================================================
+// Groups
+// ============================================================================
+
+static esp_err_t group_load(uint32_t g, uint8_t *dst)
+{
+    const compress_map_entry_t *e = &s_cz.map[g];
+
+    if (e->len == 0) {
+        memset(dst, 0, s_cz.group_size);
+        return ESP_OK;
+    }
+
+    const bool raw = (e->len == s_cz.group_size);
+    uint8_t *buf = raw ? dst : s_cz.cbuf;
+    for (uint32_t i = 0; i < stored_sectors(e->len); i++) {
+        ESP_RETURN_ON_ERROR(s_cz.backing->read(s_cz.data_base + e->sector[i], 0, s_cz.sector_size, buf + i * s_cz.sector_size),
+                            TAG, "Failed to read group %"PRIu32, g);
+    }
+    if (!raw && lz_decompress(s_cz.cbuf, e->len, dst, s_cz.group_size) != (int)s_cz.group_size) {
+        ESP_LOGE(TAG, "Group %"PRIu32" is corrupted", g);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+static bool group_is_zero(const uint8_t *buf)
+{
+    const uint32_t *w = (const uint32_t *)buf;
+    for (size_t i = 0; i < s_cz.group_size / sizeof(uint32_t); i++) {
+        if (w[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Unmap a group, its sectors stay held by the committed map until the next commit
+ */
+static void release_group(compress_map_entry_t *e)
+{
+    for (uint32_t i = 0; i < stored_sectors(e->len); i++) {
+        bit_clr(s_cz.used, e->sector[i]);
+    }
+    e->len = 0;
+}
+
+/**
+ * @brief Compress and store the group being written, copy-on-write
+ */
+static esp_err_t group_flush(void)
+{
+    if (!s_cz.wdirty) {
+        return ESP_OK;
+    }
+
+    compress_map_entry_t *e = &s_cz.map[s_cz.wgroup];
+    uint16_t sectors[COMPRESS_GROUP_SECTORS];
+    const uint8_t *src = NULL;
+    size_t len = 0;
+
+    if (!group_is_zero(s_cz.wbuf)) {
+        // Compression has to save at least one sector, otherwise store raw
+        len = lz_compress(s_cz.wbuf, s_cz.group_size, s_cz.cbuf, s_cz.group_size - s_cz.sector_size, s_cz.lz_table);
+        if (len == 0) {
+            len = s_cz.group_size;
+            src = s_cz.wbuf;
+        } else {
+            src = s_cz.cbuf;
+            memset(s_cz.cbuf + len, 0, stored_sectors(len) * s_cz.sector_size - len);
+        }
+    }
+
+    const uint32_t count = stored_sectors(len);
+    if (count > 0) {
+        esp_err_t ret = map_alloc(count, sectors);
+        if (ret == ESP_ERR_NO_MEM && map_free_sectors(true) + stored_sectors(e->len) >= count) {
+            // Sectors released since the last commit and the group's own sectors become available. The
+            // group reads as zeros after a power loss until the next commit, which is acceptable as it
+            // is being overwritten anyway.
+            release_group(e);
+            ESP_RETURN_ON_ERROR(map_commit(), TAG, "Failed to commit map");
+            ret = map_alloc(count, sectors);
+        }
+        // Space was reserved when the group was opened
+        ESP_RETURN_ON_ERROR(ret, TAG, "Medium is full");
+
+        for (uint32_t i = 0; i < count; i++) {
+            ret = s_cz.backing->write(s_cz.data_base + sectors[i], 0, s_cz.sector_size, src + i * s_cz.sector_size);
+            if (ret != ESP_OK) {
+                for (uint32_t j = 0; j < count; j++) {
+                    bit_clr(s_cz.used, sectors[j]);
+                }
+                ESP_LOGE(TAG, "Failed to write group %"PRIu32, s_cz.wgroup);
+                return ret;
+            }
+        }
+    }
+
+    release_group(e);
+    e->len = (uint16_t)len;
+    memcpy(e->sector, sectors, count * sizeof(uint16_t));
+    s_cz.wdirty = false;
+
+    if (++s_cz.uncommitted >= COMPRESS_COMMIT_INTERVAL) {
+        return map_commit();
+    }
+    return ESP_OK;
+}
+
+static esp_err_t group_open_for_write(uint32_t g)
+{
+    if (s_cz.wgroup == g) {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(group_flush(), TAG, "Failed to store group %"PRIu32, s_cz.wgroup);
+    s_cz.wgroup = COMPRESS_GROUP_NONE;
+
+    // With room to store the group raw, writes are kept in RAM and can't fail later. The group's own
+    // sectors count, they are reclaimed on flush if needed.
+    const uint32_t own = stored_sectors(s_cz.map[g].len);
+    if (map_free_sectors(false) + own < COMPRESS_GROUP_SECTORS && s_cz.uncommitted > 0) {
+        // Sectors released since the last commit become available
+        ESP_RETURN_ON_ERROR(map_commit(), TAG, "Failed to commit map");
+    }
+    s_cz.wreserved = (map_free_sectors(false) + own >= COMPRESS_GROUP_SECTORS);
+
+    if (s_cz.rgroup == g) {
+        memcpy(s_cz.wbuf, s_cz.rbuf, s_cz.group_size);
+        s_cz.rgroup = COMPRESS_GROUP_NONE;
+    } else {
+        ESP_RETURN_ON_ERROR(group_load(g, s_cz.wbuf), TAG, "Failed to load group %"PRIu32, g);
+    }
+    s_cz.wgroup = g;
+    return ESP_OK;
+}
+
+static esp_err_t group_get_for_read(uint32_t g, const uint8_t **data)
+{
+    if (s_cz.wgroup == g) {
+        *data = s_cz.wbuf;
+        return ESP_OK;
+    }
+    if (s_cz.rgroup != g) {
+        s_cz.rgroup = COMPRESS_GROUP_NONE;
+        ESP_RETURN_ON_ERROR(group_load(g, s_cz.rbuf), TAG, "Failed to load group %"PRIu32, g);
+        s_cz.rgroup = g;
+    }
+    *data = s_cz.rbuf;
+    return ESP_OK;
+}
+
+static esp_err_t compress_sync(void)
+{
+    ESP_RETURN_ON_ERROR(group_flush(), TAG, "Failed to store group");
+    if (s_cz.uncommitted > 0) {
+        ESP_RETURN_ON_ERROR(map_commit(), TAG, "Failed to commit map");
+    }
+    return ESP_OK;
+}
+
+static esp_err_t compress_rw(uint32_t lba, uint32_t offset, size_t size, uint8_t *dest, const uint8_t *src)
+{
+    esp_err_t ret;
+    uint64_t pos = (uint64_t)lba * s_cz.sector_size + offset;
+    ESP_RETURN_ON_FALSE(pos + size <= (uint64_t)s_cz.groups * s_cz.group_size, ESP_ERR_INVALID_SIZE, TAG,
+                        "Access beyond the medium, lba %"PRIu32, lba);
+
+    while (size > 0) {
+        const uint32_t g = (uint32_t)(pos / s_cz.group_size);
+        const uint32_t off = (uint32_t)(pos % s_cz.group_size);
+        const size_t chunk = MIN(size, s_cz.group_size - off);
+        if (src != NULL) {
+            ESP_RETURN_ON_ERROR(group_open_for_write(g), TAG, "Write failed");
+            memcpy(s_cz.wbuf + off, src, chunk);
+            s_cz.wdirty = true;
+            if (!s_cz.wreserved && (ret = group_flush()) != ESP_OK) {
+                // Nearly full: written through, so a group that doesn't fit fails this write
+                s_cz.wdirty = false;
+                s_cz.wgroup = COMPRESS_GROUP_NONE;
+                return ret;
+            }
+            src += chunk;
+        } else {
+            const uint8_t *data;
+            ESP_RETURN_ON_ERROR(group_get_for_read(g, &data), TAG, "Read failed");
+            memcpy(dest, data + off, chunk);
+            dest += chunk;
+        }
+        pos += chunk;
+        size -= chunk;
+    }
+    return ESP_OK;
+}
+
+#if FF_USE_TRIM
+/**
+ * @brief Unmap the groups lying wholly in a range of logical sectors, partial groups keep their data
+ */
+static esp_err_t compress_trim(uint32_t start, uint32_t end)
+{
+    const uint32_t first = (start + COMPRESS_GROUP_SECTORS - 1) / COMPRESS_GROUP_SECTORS;
+    const uint32_t last = MIN((end + 1) / COMPRESS_GROUP_SECTORS, s_cz.groups);
+
+    for (uint32_t g = first; g < last; g++) {
+        if (s_cz.wgroup == g) {
+            s_cz.wdirty = false;
+            s_cz.wgroup = COMPRESS_GROUP_NONE;
+        }
+        if (s_cz.rgroup == g) {
+            s_cz.rgroup = COMPRESS_GROUP_NONE;
+        }
+        if (s_cz.map[g].len != 0) {
+            release_group(&s_cz.map[g]);
+            s_cz.uncommitted++;
+        }
+    }
+    if (s_cz.uncommitted >= COMPRESS_COMMIT_INTERVAL) {
+        return map_commit();
+    }
+    return ESP_OK;
+}
+#endif // FF_USE_TRIM
+
+// ============================================================================
+// Reclaim of freed clusters
+// ============================================================================
+
+/**
+ * @brief FAT volume on the logical medium, in logical sectors
+ */
+typedef struct {
+    uint32_t fat_base;          // First sector of the first FAT
+    uint32_t data_base;         // First sector of cluster 2
+    uint32_t clusters;          // Data clusters
+    uint32_t cluster_sectors;   // Sectors per cluster
+    uint8_t fat_bits;           // 12, 16 or 32
+} compress_fat_t;
+
+static inline uint32_t le16(const uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t le32(const uint8_t *p)
+{
+    return le16(p) | (le16(p + 2) << 16);
+}
+
+/**
+ * @brief Parse the boot sector of a FAT volume starting at a logical sector
+ */
+static bool fat_parse(uint32_t base, compress_fat_t *fat)
+{
+    uint8_t bs[64];
+    uint8_t sig[2];
+
+    if (compress_rw(base, 0, sizeof(bs), bs, NULL) != ESP_OK || compress_rw(base, 510, sizeof(sig), sig, NULL) != ESP_OK) {
+        return false;
+    }
+    const uint32_t cluster_sectors = bs[13];
+    const uint32_t reserved = le16(bs + 14);
+    const uint32_t fats = bs[16];
+    const uint32_t root_sectors = (le16(bs + 17) * 32 + s_cz.sector_size - 1) / s_cz.sector_size;
+    const uint32_t total = le16(bs + 19) ? le16(bs + 19) : le32(bs + 32);
+    const uint32_t fat_size = le16(bs + 22) ? le16(bs + 22) : le32(bs + 36);
+    const uint32_t meta = reserved + fats * fat_size + root_sectors;
+    if ((bs[0] != 0xEB && bs[0] != 0xE9) || sig[0] != 0x55 || sig[1] != 0xAA || le16(bs + 11) != s_cz.sector_size ||
+            cluster_sectors == 0 || (cluster_sectors & (cluster_sectors - 1)) != 0 || reserved == 0 || fats == 0 ||
+            fat_size == 0 || total <= meta || (uint64_t)base + total > (uint64_t)s_cz.groups * COMPRESS_GROUP_SECTORS) {
+        return false;
+    }
+
+    fat->fat_base = base + reserved;
+    fat->data_base = base + meta;
+    fat->cluster_sectors = cluster_sectors;
+    fat->clusters = (total - meta) / cluster_sectors;
+    fat->fat_bits = (fat->clusters < 4085) ? 12 : (fat->clusters < 65525) ? 16 : 32;
+    return true;
+}
+
+/**
+ * @brief Find the FAT volume, on the whole medium or in the first partition
+ */
+static bool fat_find(compress_fat_t *fat)
+{
+    if (fat_parse(0, fat)) {
+        return true;
+    }
+    uint8_t mbr[66];    // First partition entry to the signature
+    if (compress_rw(0, 0x1BE, sizeof(mbr), mbr, NULL) != ESP_OK || mbr[64] != 0x55 || mbr[65] != 0xAA || mbr[4] == 0 ||
+            le32(mbr + 8) >= s_cz.groups * COMPRESS_GROUP_SECTORS) {
+        return false;
+    }
+    return fat_parse(le32(mbr + 8), fat);
+}
+
+static esp_err_t fat_entry(const compress_fat_t *fat, uint32_t cluster, uint32_t *value)
+{
+    uint8_t raw[4] = {0};
+    const uint32_t offset = (fat->fat_bits == 12) ? cluster + cluster / 2 : cluster * (fat->fat_bits / 8);
+    const size_t size = (fat->fat_bits == 32) ? 4 : 2;
+
+    ESP_RETURN_ON_ERROR(compress_rw(fat->fat_base + offset / s_cz.sector_size, offset % s_cz.sector_size, size, raw, NULL),
+                        TAG, "Failed to read FAT");
+    if (fat->fat_bits == 12) {
+        *value = (cluster & 1) ? le16(raw) >> 4 : le16(raw) & 0xFFF;
+    } else {
+        *value = (fat->fat_bits == 16) ? le16(raw) : le32(raw) & 0x0FFFFFFF;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Unmap the groups whose clusters are all free in the FAT
+ *
+ * USB hosts don't trim, space freed by deleting files is only known from the FAT. The FAT must be
+ * consistent: this runs while nobody has the medium mounted, before the application mounts it.
+ */
+static esp_err_t compress_reclaim(void)
+{
+    compress_fat_t fat;
+    uint32_t released = 0;
+
+    ESP_RETURN_ON_ERROR(group_flush(), TAG, "Failed to store group");
+    if (!fat_find(&fat)) {
+        ESP_LOGD(TAG, "No FAT volume, nothing to reclaim");
+        return ESP_OK;
+    }
+
+    for (uint32_t g = fat.data_base / COMPRESS_GROUP_SECTORS; g < s_cz.groups; g++) {
+        const uint32_t first = g * COMPRESS_GROUP_SECTORS;
+        if (s_cz.map[g].len == 0 || first < fat.data_base) {
+            continue;
+        }
+        const uint32_t c_first = (first - fat.data_base) / fat.cluster_sectors + 2;
+        const uint32_t c_last = (first + COMPRESS_GROUP_SECTORS - 1 - fat.data_base) / fat.cluster_sectors + 2;
+        if (c_last >= fat.clusters + 2) {
+            break;
+        }
+        bool free_group = true;
+        for (uint32_t c = c_first; c <= c_last && free_group; c++) {
+            uint32_t value;
+            ESP_RETURN_ON_ERROR(fat_entry(&fat, c, &value), TAG, "Failed to check cluster %"PRIu32, c);
+            free_group = (value == 0);
+        }
+        if (free_group) {
+            if (s_cz.rgroup == g) {
+                s_cz.rgroup = COMPRESS_GROUP_NONE;
+            }
+            release_group(&s_cz.map[g]);
+            released++;
+        }
+    }
+
+    if (released > 0) {
+        ESP_LOGI(TAG, "Reclaimed %"PRIu32" groups of freed clusters", released);
+        return map_commit();
+    }
+    return ESP_OK;
+}
+
+// ============================================================================
+// FatFs diskio
+// ============================================================================
+
+static DSTATUS compress_disk_initialize(BYTE pdrv)
+{
+    return (s_cz.backing != NULL) ? 0 : STA_NOINIT;
+}
+
+static DSTATUS compress_disk_status(BYTE pdrv)
+{
+    return (s_cz.backing != NULL) ? 0 : STA_NOINIT;
+}
+
+static DRESULT compress_disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    return (compress_rw(sector, 0, (size_t)count * s_cz.sector_size, buff, NULL) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT compress_disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    return (compress_rw(sector, 0, (size_t)count * s_cz.sector_size, NULL, buff) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT compress_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    switch (cmd) {
+    case CTRL_SYNC:
+        return (compress_sync() == ESP_OK) ? RES_OK : RES_ERROR;
+    case GET_SECTOR_COUNT:
+        *((DWORD *) buff) = s_cz.groups * COMPRESS_GROUP_SECTORS;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *) buff) = s_cz.sector_size;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *((DWORD *) buff) = COMPRESS_GROUP_SECTORS;
+        return RES_OK;
+#if FF_USE_TRIM
+    case CTRL_TRIM: {
+        const LBA_t *range = (const LBA_t *)buff;
+        return (compress_trim(range[0], range[1]) == ESP_OK) ? RES_OK : RES_ERROR;
+    }
+#endif // FF_USE_TRIM
+    }
+    return RES_ERROR;
+}
+
+static const ff_diskio_impl_t compress_impl = {
+    .init = &compress_disk_initialize,
+    .status = &compress_disk_status,
+    .read = &compress_disk_read,
+    .write = &compress_disk_write,
+    .ioctl = &compress_disk_ioctl,
+};
+
+// ============================================================================
+// Storage API
+// ============================================================================
+
+static esp_err_t storage_compress_mount(BYTE pdrv)
+{
+    assert(s_cz.backing != NULL);
+    ESP_RETURN_ON_ERROR(compress_sync(), TAG, "Failed to sync before mount");
+    if (compress_reclaim() != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to reclaim freed clusters");
+    }
+    ff_diskio_register(pdrv, &compress_impl);
+    s_cz.pdrv = pdrv;
+    return ESP_OK;
+}
+
+static esp_err_t storage_compress_unmount(void)
+{
+    if (s_cz.pdrv == 0xFF) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char drv[3] = {(char)('0' + s_cz.pdrv), ':', 0};
+    f_mount(0, drv, 0);
+    ff_diskio_unregister(s_cz.pdrv);
+    s_cz.pdrv = 0xFF;
+
+    return compress_sync();
+}
+
+static esp_err_t storage_compress_sector_read(uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    assert(s_cz.backing != NULL);
+    return compress_rw(lba, offset, size, (uint8_t *)dest, NULL);
+}
+
+static esp_err_t storage_compress_sector_write(uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    assert(s_cz.backing != NULL);
+    return compress_rw(lba, offset, size, NULL, (const uint8_t *)src);
+}
+
+static esp_err_t storage_compress_sync(void)
+{
+    assert(s_cz.backing != NULL);
+    ESP_RETURN_ON_ERROR(compress_sync(), TAG, "Failed to sync");
+    return storage_medium_sync(s_cz.backing);
+}
+
+static esp_err_t storage_compress_get_info(storage_info_t *info)
+{
+    ESP_RETURN_ON_FALSE(info, ESP_ERR_INVALID_ARG, TAG, "Storage info pointer can't be NULL");
+
+    info->total_sectors = s_cz.groups * COMPRESS_GROUP_SECTORS;
+    info->sector_size = s_cz.sector_size;
+    return ESP_OK;
+}
+
+static void storage_compress_free(void)
+{
+    heap_caps_free(s_cz.map_image);
+    heap_caps_free(s_cz.wbuf);
+    heap_caps_free(s_cz.rbuf);
+    heap_caps_free(s_cz.cbuf);
+    free(s_cz.used);
+    free(s_cz.held);
+    free(s_cz.lz_table);
+    memset(&s_cz, 0, sizeof(s_cz));
+    s_cz.pdrv = 0xFF;
+}
+
+static void storage_compress_close(void)
+{
+    if (compress_sync() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to sync on close, last writes are lost");
+    }
+    s_cz.backing->close();
+    storage_compress_free();
+}
+
+// Storage API, the medium type is taken from the backing medium
+static storage_medium_t compress_medium = {
+    .mount = &storage_compress_mount,
+    .unmount = &storage_compress_unmount,
+    .read = &storage_compress_sector_read,
+    .write = &storage_compress_sector_write,
+    .sync = &storage_compress_sync,
+    .get_info = &storage_compress_get_info,
+    .close = &storage_compress_close,
+};
+
+static void *compress_malloc(size_t size)
+{
+    // Large buffers go to PSRAM if there is some
+    void *p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return p ? p : heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+esp_err_t storage_compress_open_medium(const storage_medium_t *backing, const storage_medium_t **medium)
+{
+    ESP_RETURN_ON_FALSE(backing != NULL, ESP_ERR_INVALID_ARG, TAG, "Backing medium can't be NULL");
+    ESP_RETURN_ON_FALSE(medium != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage API pointer can't be NULL");
+    ESP_RETURN_ON_FALSE(s_cz.backing == NULL, ESP_ERR_INVALID_STATE, TAG, "Compressed medium is already open");
+
+    storage_info_t info;
+    ESP_RETURN_ON_ERROR(backing->get_info(&info), TAG, "Failed to get medium info");
+    const uint32_t group_size = info.sector_size * COMPRESS_GROUP_SECTORS;
+    ESP_RETURN_ON_FALSE(info.sector_size >= 512 && group_size <= COMPRESS_GROUP_MAX, ESP_ERR_INVALID_SIZE, TAG,
+                        "Unsupported group size %"PRIu32, group_size);
+
+    // Size the map for the whole medium, then take it out of the data area
+    uint32_t groups = (uint32_t)((uint64_t)info.total_sectors * COMPRESS_RATIO_PCT / 100 / COMPRESS_GROUP_SECTORS);
+    const uint32_t map_sectors = (sizeof(compress_map_hdr_t) + groups * sizeof(compress_map_entry_t) + info.sector_size - 1) / info.sector_size;
+    ESP_RETURN_ON_FALSE(info.total_sectors > 2 * map_sectors + COMPRESS_GROUP_SECTORS, ESP_ERR_INVALID_SIZE, TAG, "Medium is too small");
+    uint32_t data_sectors = info.total_sectors - 2 * map_sectors;
+    if (data_sectors > COMPRESS_DATA_SECTORS_MAX) {
+        ESP_LOGW(TAG, "Only %d of %"PRIu32" sectors are used", COMPRESS_DATA_SECTORS_MAX, data_sectors);
+        data_sectors = COMPRESS_DATA_SECTORS_MAX;
+    }
+    groups = (uint32_t)((uint64_t)data_sectors * COMPRESS_RATIO_PCT / 100 / COMPRESS_GROUP_SECTORS);
+
+    s_cz.backing = backing;
+    s_cz.sector_size = info.sector_size;
+    s_cz.group_size = group_size;
+    s_cz.groups = groups;
+    s_cz.map_sectors = map_sectors;
+    s_cz.data_base = 2 * map_sectors;
+    s_cz.data_sectors = data_sectors;
+    s_cz.wgroup = COMPRESS_GROUP_NONE;
+    s_cz.rgroup = COMPRESS_GROUP_NONE;
+
+    s_cz.map_image = compress_malloc(map_sectors * info.sector_size);
+    s_cz.map = (compress_map_entry_t *)(s_cz.map_image + sizeof(compress_map_hdr_t));
+    s_cz.used = calloc(1, bitmap_bytes());
+    s_cz.held = calloc(1, bitmap_bytes());
+    s_cz.wbuf = compress_malloc(group_size);
+    s_cz.rbuf = compress_malloc(group_size);
+    s_cz.cbuf = compress_malloc(group_size);
+    s_cz.lz_table = malloc(sizeof(uint16_t) << LZ_HASH_BITS);
+    if (!s_cz.map_image || !s_cz.used || !s_cz.held || !s_cz.wbuf || !s_cz.rbuf || !s_cz.cbuf || !s_cz.lz_table) {
+        storage_compress_free();
+        ESP_LOGE(TAG, "Failed to allocate compression buffers");
+        return ESP_ERR_NO_MEM;
+    }
+
+    map_load();
+    if (compress_reclaim() != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to reclaim freed clusters");
+    }
+
+    const storage_medium_t cm = {
+        .type = backing->type,
+        .mount = compress_medium.mount,
+        .unmount = compress_medium.unmount,
+        .read = compress_medium.read,
+        .write = compress_medium.write,
+        .sync = compress_medium.sync,
+        .get_info = compress_medium.get_info,
+        .close = compress_medium.close,
+    };
+    memcpy(&compress_medium, &cm, sizeof(cm));
+    *medium = &compress_medium;
+
+    ESP_LOGD(TAG, "%"PRIu32" groups of %"PRIu32" bytes on %"PRIu32" data sectors, map %"PRIu32" sectors",
+             groups, group_size, data_sectors, map_sectors);
+    return ESP_OK;
+}
@@ -0,0 +1,511 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "mbedtls/aes.h"
+#include "sdkconfig.h"
+#include "diskio_impl.h"
+#include "msc_storage.h"
+#include "storage_crypt.h"
+
+static const char *TAG = "storage_crypt";
+
+#define CRYPT_SLOTS_MAX     2               /*!< One encrypted medium per LUN */
+#define CRYPT_CHUNK_SIZE    4096            /*!< Pipeline granularity, size of each write buffer */
+#define CRYPT_TASK_STACK    4096
+#define CRYPT_TASK_PRIO     5               /*!< Same as the default TinyUSB task priority */
+#define CRYPT_TWEAK_SIZE    16
+
+/**
+ * @brief Crypto job, run by the worker task while the caller accesses the backing medium
+ */
+typedef struct {
+    int mode;                   /*!< MBEDTLS_AES_ENCRYPT or MBEDTLS_AES_DECRYPT, 0 stops the worker */
+    uint32_t lba;               /*!< First sector, used as the tweak */
+    size_t count;               /*!< Number of sectors */
+    const uint8_t *in;          /*!< Input sectors */
+    uint8_t *out;               /*!< Output sectors, may be the same as the input */
+    esp_err_t ret;              /*!< Job result */
+} crypt_job_t;
+
+/**
+ * @brief Encrypted medium instance, wraps one backing medium
+ */
+typedef struct {
+    storage_medium_t medium;            /*!< Storage API exposed to the MSC driver */
+    const storage_medium_t *backing;    /*!< Medium holding the ciphertext */
+    uint32_t sector_size;               /*!< Sector size of the backing medium */
+    uint32_t chunk_sectors;             /*!< Sectors per pipeline chunk */
+    mbedtls_aes_xts_context enc;        /*!< Key schedule for encryption */
+    mbedtls_aes_xts_context dec;        /*!< Key schedule for decryption */
+    uint8_t *buf[2];                    /*!< Ping-pong ciphertext buffers for writes, one chunk each */
+    crypt_job_t job;                    /*!< Current job */
+#if CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+    TaskHandle_t worker;                /*!< Worker task */
+    SemaphoreHandle_t job_sem;          /*!< Given when a job is posted */
+    SemaphoreHandle_t done_sem;         /*!< Given when the job is done */
+#endif // CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+    BYTE pdrv;                          /*!< FatFs drive, while mounted to the application */
+} storage_crypt_t;
+
+// The storage API has no context argument, so each slot gets its own set of functions
+static storage_crypt_t *s_crypt[CRYPT_SLOTS_MAX];
+// FatFs diskio has a drive argument, mounted instances are found through it
+static storage_crypt_t *s_pdrv_crypt[FF_VOLUMES];
+
+// ============================================================================
+// Crypto and pipeline
+// ============================================================================
+
+static esp_err_t crypt_sectors(storage_crypt_t *crypt, const crypt_job_t *job)
+{
+    mbedtls_aes_xts_context *ctx = (job->mode == MBEDTLS_AES_ENCRYPT) ? &crypt->enc : &crypt->dec;
+    const uint8_t *in = job->in;
+    uint8_t *out = job->out;
+
+    for (size_t i = 0; i < job->count; i++) {
+        // Tweak is the sector number, little endian
+        uint8_t tweak[CRYPT_TWEAK_SIZE] = {0};
+        const uint32_t lba = job->lba + i;
+        tweak[0] = (uint8_t)lba;
+        tweak[1] = (uint8_t)(lba >> 8);
+        tweak[2] = (uint8_t)(lba >> 16);
+        tweak[3] = (uint8_t)(lba >> 24);
+        if (mbedtls_aes_crypt_xts(ctx, job->mode, crypt->sector_size, tweak, in, out) != 0) {
+            ESP_LOGE(TAG, "AES-XTS failed, lba %"PRIu32, lba);
+            return ESP_FAIL;
+        }
+        in += crypt->sector_size;
+        out += crypt->sector_size;
+    }
+    return ESP_OK;
+}
+
+#if CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+static void crypt_worker_task(void *arg)
+{
+    storage_crypt_t *crypt = (storage_crypt_t *)arg;
+
+    while (1) {
+        xSemaphoreTake(crypt->job_sem, portMAX_DELAY);
+        if (crypt->job.mode == 0) {
+            break;
+        }
+        crypt->job.ret = crypt_sectors(crypt, &crypt->job);
+        xSemaphoreGive(crypt->done_sem);
+    }
+    xSemaphoreGive(crypt->done_sem);
+    vTaskDelete(NULL);
+}
+#endif // CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+
+/**
+ * @brief Start a job, on the worker task if pipelining is enabled, otherwise right away
+ */
+static void crypt_job_start(storage_crypt_t *crypt, int mode, uint32_t lba, size_t count, const uint8_t *in, uint8_t *out)
+{
+    crypt->job.mode = mode;
+    crypt->job.lba = lba;
+    crypt->job.count = count;
+    crypt->job.in = in;
+    crypt->job.out = out;
+#if CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+    xSemaphoreGive(crypt->job_sem);
+#else
+    crypt->job.ret = crypt_sectors(crypt, &crypt->job);
+#endif // CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+}
+
+static esp_err_t crypt_job_wait(storage_crypt_t *crypt)
+{
+#if CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+    xSemaphoreTake(crypt->done_sem, portMAX_DELAY);
+#endif // CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+    return crypt->job.ret;
+}
+
+/**
+ * @brief Read and decrypt whole sectors, decrypting chunk N in place while chunk N+1 is read
+ */
+static esp_err_t crypt_read_sectors(storage_crypt_t *crypt, uint32_t lba, size_t count, uint8_t *dest)
+{
+    const size_t ss = crypt->sector_size;
+    size_t n = MIN(count, crypt->chunk_sectors);
+    esp_err_t ret = crypt->backing->read(lba, 0, n * ss, dest);
+
+    while (ret == ESP_OK) {
+        crypt_job_start(crypt, MBEDTLS_AES_DECRYPT, lba, n, dest, dest);
+        const size_t next = MIN(count - n, crypt->chunk_sectors);
+        if (next > 0) {
+            ret = crypt->backing->read(lba + n, 0, next * ss, dest + n * ss);
+        }
+        const esp_err_t job_ret = crypt_job_wait(crypt);
+        if (ret == ESP_OK) {
+            ret = job_ret;
+        }
+        if (next == 0) {
+            break;
+        }
+        lba += n;
+        dest += n * ss;
+        count -= n;
+        n = next;
+    }
+    return ret;
+}
+
+/**
+ * @brief Encrypt and write whole sectors, encrypting chunk N+1 while chunk N is written
+ */
+static esp_err_t crypt_write_sectors(storage_crypt_t *crypt, uint32_t lba, size_t count, const uint8_t *src)
+{
+    const size_t ss = crypt->sector_size;
+    size_t n = MIN(count, crypt->chunk_sectors);
+    int cur = 0;
+
+    crypt_job_start(crypt, MBEDTLS_AES_ENCRYPT, lba, n, src, crypt->buf[cur]);
+    esp_err_t ret = crypt_job_wait(crypt);
+
+    while (ret == ESP_OK) {
+        const size_t next = MIN(count - n, crypt->chunk_sectors);
+        if (next > 0) {
+            crypt_job_start(crypt, MBEDTLS_AES_ENCRYPT, lba + n, next, src + n * ss, crypt->buf[cur ^ 1]);
+        }
+        ret = crypt->backing->write(lba, 0, n * ss, crypt->buf[cur]);
+        if (next == 0) {
+            break;
+        }
+        const esp_err_t job_ret = crypt_job_wait(crypt);
+        if (ret == ESP_OK) {
+            ret = job_ret;
+        }
+        lba += n;
+        src += n * ss;
+        count -= n;
+        n = next;
+        cur ^= 1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Read and decrypt a single sector into the first write buffer
+ */
+static esp_err_t crypt_read_sector(storage_crypt_t *crypt, uint32_t lba)
+{
+    ESP_RETURN_ON_ERROR(crypt->backing->read(lba, 0, crypt->sector_size, crypt->buf[0]), TAG, "Backing read failed, lba %"PRIu32, lba);
+    crypt_job_start(crypt, MBEDTLS_AES_DECRYPT, lba, 1, crypt->buf[0], crypt->buf[0]);
+    return crypt_job_wait(crypt);
+}
+
+// ============================================================================
+// FatFs diskio
+// ============================================================================
+
+static DSTATUS crypt_disk_initialize(BYTE pdrv)
+{
+    return (s_pdrv_crypt[pdrv] != NULL) ? 0 : STA_NOINIT;
+}
+
+static DSTATUS crypt_disk_status(BYTE pdrv)
+{
+    return (s_pdrv_crypt[pdrv] != NULL) ? 0 : STA_NOINIT;
+}
+
+static DRESULT crypt_disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    storage_crypt_t *crypt = s_pdrv_crypt[pdrv];
+    assert(crypt != NULL);
+    return (crypt_read_sectors(crypt, sector, count, buff) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT crypt_disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    storage_crypt_t *crypt = s_pdrv_crypt[pdrv];
+    assert(crypt != NULL);
+    return (crypt_write_sectors(crypt, sector, count, buff) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT crypt_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    storage_crypt_t *crypt = s_pdrv_crypt[pdrv];
+    storage_info_t info;
+    assert(crypt != NULL);
+
+    switch (cmd) {
+    case CTRL_SYNC:
+        return RES_OK;
+    case GET_SECTOR_COUNT:
+        if (crypt->backing->get_info(&info) != ESP_OK) {
+            return RES_ERROR;
+        }
+        *((DWORD *) buff) = info.total_sectors;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *) buff) = crypt->sector_size;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *((DWORD *) buff) = 1;
+        return RES_OK;
+    }
+    return RES_ERROR;
+}
+
+static const ff_diskio_impl_t crypt_impl = {
+    .init = &crypt_disk_initialize,
+    .status = &crypt_disk_status,
+    .read = &crypt_disk_read,
+    .write = &crypt_disk_write,
+    .ioctl = &crypt_disk_ioctl,
+};
+
+// ============================================================================
+// Storage API
+// ============================================================================
+
+static esp_err_t crypt_mount(storage_crypt_t *crypt, BYTE pdrv)
+{
+    ESP_RETURN_ON_FALSE(pdrv < FF_VOLUMES, ESP_ERR_INVALID_ARG, TAG, "Invalid drive %d", pdrv);
+    s_pdrv_crypt[pdrv] = crypt;
+    ff_diskio_register(pdrv, &crypt_impl);
+    crypt->pdrv = pdrv;
+    return ESP_OK;
+}
+
+static esp_err_t crypt_unmount(storage_crypt_t *crypt)
+{
+    if (crypt->pdrv == 0xFF) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char drv[3] = {(char)('0' + crypt->pdrv), ':', 0};
+    f_mount(0, drv, 0);
+    ff_diskio_unregister(crypt->pdrv);
+    s_pdrv_crypt[crypt->pdrv] = NULL;
+    crypt->pdrv = 0xFF;
+    return ESP_OK;
+}
+
+static esp_err_t crypt_read(storage_crypt_t *crypt, uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    const size_t ss = crypt->sector_size;
+    uint8_t *out = (uint8_t *)dest;
+
+    lba += offset / ss;
+    offset %= ss;
+
+    // Partial sectors go through the bounce buffer, whole sectors are decrypted in place
+    while (size > 0) {
+        if (offset == 0 && size >= ss) {
+            const size_t count = size / ss;
+            ESP_RETURN_ON_ERROR(crypt_read_sectors(crypt, lba, count, out), TAG, "Failed to read %u sectors at %"PRIu32, count, lba);
+            lba += count;
+            out += count * ss;
+            size -= count * ss;
+        } else {
+            const size_t chunk = MIN(size, ss - offset);
+            ESP_RETURN_ON_ERROR(crypt_read_sector(crypt, lba), TAG, "Failed to read sector %"PRIu32, lba);
+            memcpy(out, crypt->buf[0] + offset, chunk);
+            lba++;
+            out += chunk;
+            size -= chunk;
+            offset = 0;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t crypt_write(storage_crypt_t *crypt, uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    const size_t ss = crypt->sector_size;
+    const uint8_t *in = (const uint8_t *)src;
+
+    lba += offset / ss;
+    offset %= ss;
+
+    // Partial sectors are read, patched and written back
+    while (size > 0) {
+        if (offset == 0 && size >= ss) {
+            const size_t count = size / ss;
+            ESP_RETURN_ON_ERROR(crypt_write_sectors(crypt, lba, count, in), TAG, "Failed to write %u sectors at %"PRIu32, count, lba);
+            lba += count;
+            in += count * ss;
+            size -= count * ss;
+        } else {
+            const size_t chunk = MIN(size, ss - offset);
+            ESP_RETURN_ON_ERROR(crypt_read_sector(crypt, lba), TAG, "Failed to read sector %"PRIu32, lba);
+            memcpy(crypt->buf[0] + offset, in, chunk);
+            crypt_job_start(crypt, MBEDTLS_AES_ENCRYPT, lba, 1, crypt->buf[0], crypt->buf[0]);
+            ESP_RETURN_ON_ERROR(crypt_job_wait(crypt), TAG, "Failed to encrypt sector %"PRIu32, lba);
+            ESP_RETURN_ON_ERROR(crypt->backing->write(lba, 0, ss, crypt->buf[0]), TAG, "Backing write failed, lba %"PRIu32, lba);
+            lba++;
+            in += chunk;
+            size -= chunk;
+            offset = 0;
+        }
+    }
+    return ESP_OK;
+}
+
+// Sectors are encrypted and written at once, nothing of its own to write back
+static esp_err_t crypt_sync(storage_crypt_t *crypt)
+{
+    return storage_medium_sync(crypt->backing);
+}
+
+static esp_err_t crypt_get_info(storage_crypt_t *crypt, storage_info_t *info)
+{
+    return crypt->backing->get_info(info);
+}
+
+static void crypt_free(storage_crypt_t *crypt)
+{
+#if CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+    if (crypt->worker != NULL) {
+        crypt->job.mode = 0;
+        xSemaphoreGive(crypt->job_sem);
+        xSemaphoreTake(crypt->done_sem, portMAX_DELAY);
+    }
+    if (crypt->job_sem != NULL) {
+        vSemaphoreDelete(crypt->job_sem);
+    }
+    if (crypt->done_sem != NULL) {
+        vSemaphoreDelete(crypt->done_sem);
+    }
+#endif // CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+    mbedtls_aes_xts_free(&crypt->enc);
+    mbedtls_aes_xts_free(&crypt->dec);
+    heap_caps_free(crypt->buf[0]);
+    heap_caps_free(crypt->buf[1]);
+    free(crypt);
+}
+
+static void crypt_close(storage_crypt_t *crypt)
+{
+    crypt->backing->close();
+    for (int i = 0; i < CRYPT_SLOTS_MAX; i++) {
+        if (s_crypt[i] == crypt) {
+            s_crypt[i] = NULL;
+        }
+    }
+    crypt_free(crypt);
+}
+
+#define CRYPT_SLOT_FUNCTIONS(n)                                                                         \
+    static esp_err_t crypt_mount_##n(BYTE pdrv) { return crypt_mount(s_crypt[n], pdrv); }               \
+    static esp_err_t crypt_unmount_##n(void) { return crypt_unmount(s_crypt[n]); }                      \
+    static esp_err_t crypt_read_##n(uint32_t lba, uint32_t offset, size_t size, void *dest)             \
+    { return crypt_read(s_crypt[n], lba, offset, size, dest); }                                         \
+    static esp_err_t crypt_write_##n(uint32_t lba, uint32_t offset, size_t size, const void *src)       \
+    { return crypt_write(s_crypt[n], lba, offset, size, src); }                                         \
+    static esp_err_t crypt_sync_##n(void) { return crypt_sync(s_crypt[n]); }                            \
+    static esp_err_t crypt_get_info_##n(storage_info_t *info) { return crypt_get_info(s_crypt[n], info); } \
+    static void crypt_close_##n(void) { crypt_close(s_crypt[n]); }
+
+#define CRYPT_SLOT_MEDIUM(n)            \
+    {                                   \
+        .mount = &crypt_mount_##n,      \
+        .unmount = &crypt_unmount_##n,  \
+        .read = &crypt_read_##n,        \
+        .write = &crypt_write_##n,      \
+        .sync = &crypt_sync_##n,        \
+        .get_info = &crypt_get_info_##n,\
+        .close = &crypt_close_##n,      \
+    }
+
+CRYPT_SLOT_FUNCTIONS(0)
+CRYPT_SLOT_FUNCTIONS(1)
+
+// Function pointers of each slot, the medium type is taken from the backing medium
+static const storage_medium_t s_slot_medium[CRYPT_SLOTS_MAX] = {
+    CRYPT_SLOT_MEDIUM(0),
+    CRYPT_SLOT_MEDIUM(1),
+};
+
+// ============================================================================
+// Public
+// ============================================================================
+
+esp_err_t storage_crypt_open_medium(const storage_medium_t *backing, const uint8_t *key, const storage_medium_t **medium)
+{
+    ESP_RETURN_ON_FALSE(backing != NULL, ESP_ERR_INVALID_ARG, TAG, "Backing medium can't be NULL");
+    ESP_RETURN_ON_FALSE(key != NULL, ESP_ERR_INVALID_ARG, TAG, "Key can't be NULL");
+    ESP_RETURN_ON_FALSE(medium != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage API pointer can't be NULL");
+
+    int slot = -1;
+    for (int i = 0; i < CRYPT_SLOTS_MAX; i++) {
+        if (s_crypt[i] == NULL) {
+            slot = i;
+            break;
+        }
+    }
+    ESP_RETURN_ON_FALSE(slot >= 0, ESP_ERR_NO_MEM, TAG, "No free encryption slot");
+
+    storage_info_t info;
+    ESP_RETURN_ON_ERROR(backing->get_info(&info), TAG, "Failed to get medium info");
+    ESP_RETURN_ON_FALSE(info.sector_size != 0 && (info.sector_size % CRYPT_TWEAK_SIZE) == 0,
+                        ESP_ERR_INVALID_SIZE, TAG, "Unsupported sector size %"PRIu32, info.sector_size);
+
+    esp_err_t ret = ESP_OK;
+    storage_crypt_t *crypt = calloc(1, sizeof(storage_crypt_t));
+    ESP_RETURN_ON_FALSE(crypt != NULL, ESP_ERR_NO_MEM, TAG, "Failed to allocate encrypted medium");
+    crypt->backing = backing;
+    crypt->sector_size = info.sector_size;
+    crypt->chunk_sectors = MAX(CRYPT_CHUNK_SIZE / info.sector_size, 1);
+    crypt->pdrv = 0xFF;
+    mbedtls_aes_xts_init(&crypt->enc);
+    mbedtls_aes_xts_init(&crypt->dec);
+
+    ESP_GOTO_ON_FALSE(mbedtls_aes_xts_setkey_enc(&crypt->enc, key, STORAGE_CRYPT_KEY_SIZE * 8) == 0 &&
+                      mbedtls_aes_xts_setkey_dec(&crypt->dec, key, STORAGE_CRYPT_KEY_SIZE * 8) == 0,
+                      ESP_ERR_INVALID_ARG, fail, TAG, "Key rejected");
+
+    // DMA-capable, so neither the AES peripheral nor the medium driver needs to bounce them
+    for (int i = 0; i < 2; i++) {
+        crypt->buf[i] = heap_caps_malloc((size_t)crypt->chunk_sectors * info.sector_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        ESP_GOTO_ON_FALSE(crypt->buf[i] != NULL, ESP_ERR_NO_MEM, fail, TAG, "Failed to allocate buffers");
+    }
+
+#if CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+    crypt->job_sem = xSemaphoreCreateBinary();
+    crypt->done_sem = xSemaphoreCreateBinary();
+    ESP_GOTO_ON_FALSE(crypt->job_sem != NULL && crypt->done_sem != NULL, ESP_ERR_NO_MEM, fail, TAG, "Failed to create semaphores");
+    ESP_GOTO_ON_FALSE(xTaskCreate(crypt_worker_task, "msc_crypt", CRYPT_TASK_STACK, crypt, CRYPT_TASK_PRIO, &crypt->worker) == pdPASS,
+                      ESP_ERR_NO_MEM, fail, TAG, "Failed to create worker task");
+#endif // CONFIG_TINYUSB_MSC_CRYPT_PIPELINE
+
+    const storage_medium_t encrypted = {
+        .type = backing->type,
+        .mount = s_slot_medium[slot].mount,
+        .unmount = s_slot_medium[slot].unmount,
+        .read = s_slot_medium[slot].read,
+        .write = s_slot_medium[slot].write,
+        .sync = s_slot_medium[slot].sync,
+        .get_info = s_slot_medium[slot].get_info,
+        .close = s_slot_medium[slot].close,
+    };
+    memcpy(&crypt->medium, &encrypted, sizeof(encrypted));
+    s_crypt[slot] = crypt;
+    *medium = &crypt->medium;
+
+    ESP_LOGD(TAG, "Encrypted medium %d: %"PRIu32" byte sectors, %"PRIu32" sectors per chunk",
+             slot, info.sector_size, crypt->chunk_sectors);
+    return ESP_OK;
+
+fail:
+    crypt_free(crypt);
+    return ret;
+}
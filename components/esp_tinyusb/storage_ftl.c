@@ -0,0 +1,902 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "spi_flash_mmap.h"
+#include "sdkconfig.h"
+#include "diskio_impl.h"
+#include "checksum.h"
+#include "msc_storage.h"
+#include "storage_ftl.h"
+
+static const char *TAG = "storage_ftl";
+
+/*
+ * Partition layout:
+ *
+ *   | checkpoint slot 0 | checkpoint slot 1 | segment 0 | segment 1 | ... |
+ *
+ * A checkpoint slot holds a header followed by the map and the segment erase counts. The header is
+ * written last, a slot with a torn body fails its CRC and the other slot is used.
+ *
+ * A segment holds a header, one summary entry per data page, then the data pages:
+ *
+ *   | hdr | entry 0 | entry 1 | ... | (pad to a page) | page 0 | page 1 | ... |
+ *
+ * Pages are filled in order. A page is programmed before its entry, so a page whose entry is erased
+ * or torn was never acknowledged and is ignored. Segments are erased header block last: a segment
+ * with an erased header is erased all through, even if a power loss interrupted the erase.
+ */
+
+#define FTL_SEGMENT_SIZE            (32 * 1024)     /*!< Unit of allocation, garbage collection and erase */
+#define FTL_SEGMENT_PAGES           (FTL_SEGMENT_SIZE / STORAGE_FTL_SECTOR_SIZE)
+#define FTL_BATCH_PAGES             8               /*!< Pages programmed with one flash write */
+#define FTL_RESERVE_SEGMENTS        2               /*!< Free segments garbage collection keeps for its copies */
+#define FTL_WEAR_DELTA              64              /*!< Erase count spread that makes garbage collection move cold data */
+#define FTL_OVERPROVISION_PCT       CONFIG_TINYUSB_MSC_FTL_OVERPROVISION
+#define FTL_CHECKPOINT_INTERVAL     CONFIG_TINYUSB_MSC_FTL_CHECKPOINT_INTERVAL
+#define FTL_SEGMENT_MAGIC           0x534C5446      /*!< "FTLS" */
+#define FTL_CHECKPOINT_MAGIC        0x434C5446      /*!< "FTLC" */
+#define FTL_VERSION                 1
+#define FTL_PPN_NONE                UINT16_MAX      /*!< Map entry of a sector never written, reads as zeros */
+#define FTL_SEG_NONE                UINT32_MAX
+
+/**
+ * @brief Segment header, at the start of every segment in use
+ */
+typedef struct {
+    uint32_t magic;             /*!< FTL_SEGMENT_MAGIC */
+    uint32_t seq;               /*!< Position in the log, segments are replayed in this order. Never 0 */
+    uint32_t erase_count;       /*!< Erases of the segment, including the one before this header */
+    uint32_t crc;               /*!< CRC32 of the fields above */
+} ftl_seg_hdr_t;
+
+/**
+ * @brief Summary entry, names the logical sector held by a data page
+ */
+typedef struct {
+    uint32_t lba;               /*!< Logical sector */
+    uint32_t check;             /*!< ~lba, tells a complete entry from a torn one */
+} ftl_entry_t;
+
+/**
+ * @brief Checkpoint header, at the start of a checkpoint slot
+ */
+typedef struct {
+    uint32_t magic;             /*!< FTL_CHECKPOINT_MAGIC */
+    uint32_t version;           /*!< FTL_VERSION */
+    uint32_t seq;               /*!< Checkpoint sequence number, the slot with the higher one is current */
+    uint32_t sectors;           /*!< Map entries */
+    uint32_t segments;          /*!< Erase count entries */
+    uint32_t log_seq;           /*!< First segment not fully reflected in the map, the replay starts there */
+    uint32_t crc;               /*!< CRC32 of the map and the erase counts */
+    uint32_t reserved;
+} ftl_ckpt_hdr_t;
+
+static struct {
+    const esp_partition_t *part;        // Partition holding the medium
+    uint32_t sectors;                   // Logical sectors
+    uint32_t segments;                  // Segments after the checkpoint slots
+    uint32_t seg_pages;                 // Data pages per segment
+    uint32_t meta_size;                 // Bytes of header and summary at the start of a segment, whole pages
+    uint32_t ckpt_size;                 // Bytes per checkpoint slot, whole erase blocks
+    uint32_t seg_base;                  // Partition offset of segment 0
+    uint16_t *map;                      // Logical sector -> physical page (segment * seg_pages + page)
+    uint16_t *valid;                    // Live pages per segment
+    uint32_t *seg_seq;                  // Log position per segment, 0 if the segment is free
+    uint32_t *erase_count;              // Erases per segment
+    uint32_t seq;                       // Highest log position handed out
+    uint32_t open_seg;                  // Segment being filled, FTL_SEG_NONE if none
+    uint32_t open_used;                 // Pages of open_seg programmed or attempted
+    uint32_t free_segs;                 // Erased segments
+    uint32_t ckpt_seq;                  // Sequence number of the last checkpoint
+    uint32_t since_ckpt;                // Segments opened since the last checkpoint
+    bool dirty;                         // Map changed since the last checkpoint
+    bool in_gc;                         // Garbage collection is copying, it must not recurse
+    uint8_t *buf;                       // One page, for partial sector writes
+    uint8_t *gc_buf;                    // FTL_BATCH_PAGES pages, for garbage collection copies
+    ftl_entry_t *entries;               // Summary of one segment
+    tinyusb_msc_ftl_stats_t stats;      // Counters, erase counts are filled in on request
+    BYTE pdrv;                          // FatFs drive, while mounted to the application
+} s_ftl = {
+    .pdrv = 0xFF,
+};
+
+// ============================================================================
+// Flash layout
+// ============================================================================
+
+static inline size_t seg_addr(uint32_t seg)
+{
+    return s_ftl.seg_base + (size_t)seg * FTL_SEGMENT_SIZE;
+}
+
+static inline size_t page_addr(uint32_t ppn)
+{
+    return seg_addr(ppn / s_ftl.seg_pages) + s_ftl.meta_size + (size_t)(ppn % s_ftl.seg_pages) * STORAGE_FTL_SECTOR_SIZE;
+}
+
+static inline size_t entry_addr(uint32_t seg, uint32_t page)
+{
+    return seg_addr(seg) + sizeof(ftl_seg_hdr_t) + (size_t)page * sizeof(ftl_entry_t);
+}
+
+static inline bool entry_valid(const ftl_entry_t *e)
+{
+    return e->check == ~e->lba && e->lba < s_ftl.sectors;
+}
+
+static uint32_t seg_hdr_crc(const ftl_seg_hdr_t *hdr)
+{
+    return checksum_crc32(0, hdr, offsetof(ftl_seg_hdr_t, crc));
+}
+
+static esp_err_t ftl_flash_write(size_t addr, const void *src, size_t size)
+{
+    s_ftl.stats.flash_bytes += size;
+    return esp_partition_write(s_ftl.part, addr, src, size);
+}
+
+static esp_err_t ftl_flash_erase(size_t addr, size_t size)
+{
+    s_ftl.stats.erase_total += size / SPI_FLASH_SEC_SIZE;
+    return esp_partition_erase_range(s_ftl.part, addr, size);
+}
+
+static esp_err_t ftl_read_summary(uint32_t seg)
+{
+    return esp_partition_read(s_ftl.part, entry_addr(seg, 0), s_ftl.entries, s_ftl.seg_pages * sizeof(ftl_entry_t));
+}
+
+// ============================================================================
+// Checkpoint
+// ============================================================================
+
+static uint32_t ckpt_body_crc(void)
+{
+    uint32_t crc = checksum_crc32(0, s_ftl.map, s_ftl.sectors * sizeof(uint16_t));
+    return checksum_crc32(crc, s_ftl.erase_count, s_ftl.segments * sizeof(uint32_t));
+}
+
+static esp_err_t ftl_checkpoint(void)
+{
+    const ftl_ckpt_hdr_t hdr = {
+        .magic = FTL_CHECKPOINT_MAGIC,
+        .version = FTL_VERSION,
+        .seq = s_ftl.ckpt_seq + 1,
+        .sectors = s_ftl.sectors,
+        .segments = s_ftl.segments,
+        // Entries of the open segment may be written after the checkpoint, replay it again
+        .log_seq = (s_ftl.open_seg != FTL_SEG_NONE) ? s_ftl.seg_seq[s_ftl.open_seg] : s_ftl.seq + 1,
+        .crc = ckpt_body_crc(),
+    };
+    // The slot of the previous checkpoint is left alone until this one is complete
+    const size_t base = (size_t)(hdr.seq % 2) * s_ftl.ckpt_size;
+    const size_t map_size = s_ftl.sectors * sizeof(uint16_t);
+
+    ESP_RETURN_ON_ERROR(ftl_flash_erase(base, s_ftl.ckpt_size), TAG, "Failed to erase checkpoint slot");
+    ESP_RETURN_ON_ERROR(ftl_flash_write(base + sizeof(hdr), s_ftl.map, map_size), TAG, "Failed to write map");
+    ESP_RETURN_ON_ERROR(ftl_flash_write(base + sizeof(hdr) + map_size, s_ftl.erase_count, s_ftl.segments * sizeof(uint32_t)),
+                        TAG, "Failed to write erase counts");
+    ESP_RETURN_ON_ERROR(ftl_flash_write(base, &hdr, sizeof(hdr)), TAG, "Failed to write checkpoint header");
+
+    s_ftl.ckpt_seq = hdr.seq;
+    s_ftl.since_ckpt = 0;
+    s_ftl.dirty = false;
+    s_ftl.stats.checkpoints++;
+    ESP_LOGD(TAG, "Checkpoint %"PRIu32", replay from segment seq %"PRIu32, hdr.seq, hdr.log_seq);
+    return ESP_OK;
+}
+
+/**
+ * @brief Load the newest valid checkpoint into the map and the erase counts
+ *
+ * @param[out] log_seq First segment to replay over the checkpoint
+ *
+ * @return ESP_OK if a checkpoint was loaded, the map and the erase counts are undefined otherwise
+ */
+static esp_err_t ftl_checkpoint_load(uint32_t *log_seq)
+{
+    ftl_ckpt_hdr_t hdr[2];
+    int best = -1;
+    for (int slot = 0; slot < 2; slot++) {
+        ESP_RETURN_ON_ERROR(esp_partition_read(s_ftl.part, (size_t)slot * s_ftl.ckpt_size, &hdr[slot], sizeof(hdr[slot])),
+                            TAG, "Failed to read checkpoint header");
+        if (hdr[slot].magic == FTL_CHECKPOINT_MAGIC && hdr[slot].version == FTL_VERSION &&
+                hdr[slot].sectors == s_ftl.sectors && hdr[slot].segments == s_ftl.segments &&
+                (best < 0 || hdr[slot].seq > hdr[best].seq)) {
+            best = slot;
+        }
+    }
+
+    // Fall back to the older slot if the newer one is torn
+    for (int attempt = 0; attempt < 2 && best >= 0; attempt++) {
+        const size_t base = (size_t)best * s_ftl.ckpt_size + sizeof(ftl_ckpt_hdr_t);
+        const size_t map_size = s_ftl.sectors * sizeof(uint16_t);
+        ESP_RETURN_ON_ERROR(esp_partition_read(s_ftl.part, base, s_ftl.map, map_size), TAG, "Failed to read map");
+        ESP_RETURN_ON_ERROR(esp_partition_read(s_ftl.part, base + map_size, s_ftl.erase_count, s_ftl.segments * sizeof(uint32_t)),
+                            TAG, "Failed to read erase counts");
+        if (ckpt_body_crc() == hdr[best].crc) {
+            s_ftl.ckpt_seq = hdr[best].seq;
+            *log_seq = hdr[best].log_seq;
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "Checkpoint %"PRIu32" is corrupted", hdr[best].seq);
+        const int other = best ^ 1;
+        best = (hdr[other].magic == FTL_CHECKPOINT_MAGIC && hdr[other].version == FTL_VERSION &&
+                hdr[other].sectors == s_ftl.sectors && hdr[other].segments == s_ftl.segments &&
+                hdr[other].seq < hdr[best].seq) ? other : -1;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// ============================================================================
+// Segments and garbage collection
+// ============================================================================
+
+static esp_err_t ftl_erase_segment(uint32_t seg)
+{
+    // Header block last, see the layout above
+    for (size_t off = FTL_SEGMENT_SIZE; off > 0; off -= SPI_FLASH_SEC_SIZE) {
+        ESP_RETURN_ON_ERROR(ftl_flash_erase(seg_addr(seg) + off - SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE), TAG,
+                            "Failed to erase segment %"PRIu32, seg);
+    }
+    s_ftl.erase_count[seg]++;
+    s_ftl.seg_seq[seg] = 0;
+    s_ftl.valid[seg] = 0;
+    s_ftl.free_segs++;
+    return ESP_OK;
+}
+
+static esp_err_t ftl_open_segment(void)
+{
+    // The least worn free segment, so erases spread over the partition
+    uint32_t seg = FTL_SEG_NONE;
+    for (uint32_t s = 0; s < s_ftl.segments; s++) {
+        if (s_ftl.seg_seq[s] == 0 && (seg == FTL_SEG_NONE || s_ftl.erase_count[s] < s_ftl.erase_count[seg])) {
+            seg = s;
+        }
+    }
+    ESP_RETURN_ON_FALSE(seg != FTL_SEG_NONE, ESP_FAIL, TAG, "No free segment");
+
+    ftl_seg_hdr_t hdr = {
+        .magic = FTL_SEGMENT_MAGIC,
+        .seq = s_ftl.seq + 1,
+        .erase_count = s_ftl.erase_count[seg],
+    };
+    hdr.crc = seg_hdr_crc(&hdr);
+    ESP_RETURN_ON_ERROR(ftl_flash_write(seg_addr(seg), &hdr, sizeof(hdr)), TAG, "Failed to write segment header");
+
+    s_ftl.seq = hdr.seq;
+    s_ftl.seg_seq[seg] = hdr.seq;
+    s_ftl.open_seg = seg;
+    s_ftl.open_used = 0;
+    s_ftl.free_segs--;
+
+    if (++s_ftl.since_ckpt >= FTL_CHECKPOINT_INTERVAL) {
+        ESP_RETURN_ON_ERROR(ftl_checkpoint(), TAG, "Checkpoint failed");
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ftl_program(const uint32_t *lbas, const uint8_t *data, size_t count);
+
+/**
+ * @brief Pick the segment to reclaim next
+ *
+ * Once the erase counts of full segments drift apart by FTL_WEAR_DELTA, the least worn one is picked,
+ * once per collection, so cold data moves to a worn segment and frees a fresh one. Otherwise the policy
+ * picks among segments with dead pages: greedy takes the fewest live pages, cost-benefit weighs the
+ * space gained against the live pages copied and favours segments that have not changed for long.
+ */
+static uint32_t ftl_pick_victim(bool *wear_moved)
+{
+    uint32_t coldest = FTL_SEG_NONE;
+    uint32_t max_erase = 0;
+    uint32_t victim = FTL_SEG_NONE;
+    uint64_t best = 0;
+
+    for (uint32_t s = 0; s < s_ftl.segments; s++) {
+        if (s_ftl.seg_seq[s] == 0 || s == s_ftl.open_seg) {
+            continue;
+        }
+        max_erase = MAX(max_erase, s_ftl.erase_count[s]);
+        if (coldest == FTL_SEG_NONE || s_ftl.erase_count[s] < s_ftl.erase_count[coldest]) {
+            coldest = s;
+        }
+        const uint32_t live = s_ftl.valid[s];
+        if (live >= s_ftl.seg_pages) {
+            continue;
+        }
+#if CONFIG_TINYUSB_MSC_FTL_GC_GREEDY
+        const uint64_t score = s_ftl.seg_pages - live;
+#else
+        const uint64_t age = s_ftl.seq - s_ftl.seg_seq[s] + 1;
+        const uint64_t score = ((uint64_t)(s_ftl.seg_pages - live) << 16) * age / (s_ftl.seg_pages + live);
+#endif // CONFIG_TINYUSB_MSC_FTL_GC_GREEDY
+        if (score > best) {
+            best = score;
+            victim = s;
+        }
+    }
+
+    if (!*wear_moved && coldest != FTL_SEG_NONE && max_erase - s_ftl.erase_count[coldest] > FTL_WEAR_DELTA) {
+        *wear_moved = true;
+        return coldest;
+    }
+    return victim;
+}
+
+static esp_err_t ftl_collect(bool *wear_moved)
+{
+    const uint32_t victim = ftl_pick_victim(wear_moved);
+    ESP_RETURN_ON_FALSE(victim != FTL_SEG_NONE, ESP_ERR_NO_MEM, TAG, "No segment to reclaim");
+    ESP_RETURN_ON_ERROR(ftl_read_summary(victim), TAG, "Failed to read summary");
+
+    uint32_t lbas[FTL_BATCH_PAGES];
+    size_t n = 0;
+    s_ftl.in_gc = true;
+    esp_err_t ret = ESP_OK;
+    for (uint32_t page = 0; page < s_ftl.seg_pages && ret == ESP_OK; page++) {
+        const ftl_entry_t *e = &s_ftl.entries[page];
+        if (!entry_valid(e) || s_ftl.map[e->lba] != victim * s_ftl.seg_pages + page) {
+            continue;
+        }
+        ret = esp_partition_read(s_ftl.part, page_addr(victim * s_ftl.seg_pages + page),
+                                 s_ftl.gc_buf + n * STORAGE_FTL_SECTOR_SIZE, STORAGE_FTL_SECTOR_SIZE);
+        lbas[n++] = e->lba;
+        if (ret == ESP_OK && n == FTL_BATCH_PAGES) {
+            ret = ftl_program(lbas, s_ftl.gc_buf, n);
+            s_ftl.stats.gc_copied += n;
+            n = 0;
+        }
+    }
+    if (ret == ESP_OK && n > 0) {
+        ret = ftl_program(lbas, s_ftl.gc_buf, n);
+        s_ftl.stats.gc_copied += n;
+    }
+    s_ftl.in_gc = false;
+    ESP_RETURN_ON_ERROR(ret, TAG, "Failed to copy live pages of segment %"PRIu32, victim);
+
+    // All live pages have entries in a newer segment now
+    assert(s_ftl.valid[victim] == 0);
+    ESP_RETURN_ON_ERROR(ftl_erase_segment(victim), TAG, "Failed to reclaim segment");
+    s_ftl.stats.gc_runs++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Make sure the open segment has a free page, collecting garbage if free segments run low
+ */
+static esp_err_t ftl_make_room(void)
+{
+    if (s_ftl.open_seg != FTL_SEG_NONE && s_ftl.open_used < s_ftl.seg_pages) {
+        return ESP_OK;
+    }
+    s_ftl.open_seg = FTL_SEG_NONE;
+
+    // Copies by the collection itself take from the reserve
+    if (!s_ftl.in_gc) {
+        bool wear_moved = false;
+        while (s_ftl.free_segs <= FTL_RESERVE_SEGMENTS) {
+            ESP_RETURN_ON_ERROR(ftl_collect(&wear_moved), TAG, "Garbage collection failed");
+        }
+        if (s_ftl.open_seg != FTL_SEG_NONE && s_ftl.open_used < s_ftl.seg_pages) {
+            return ESP_OK;
+        }
+    }
+    return ftl_open_segment();
+}
+
+/**
+ * @brief Write whole pages out of place and point the map at them
+ *
+ * @param[in] lbas Logical sector of each page
+ * @param[in] data Page contents
+ * @param[in] count Number of pages, at most FTL_BATCH_PAGES
+ */
+static esp_err_t ftl_program(const uint32_t *lbas, const uint8_t *data, size_t count)
+{
+    ftl_entry_t entries[FTL_BATCH_PAGES];
+    assert(count <= FTL_BATCH_PAGES);
+
+    while (count > 0) {
+        ESP_RETURN_ON_ERROR(ftl_make_room(), TAG, "No room to write");
+        const uint32_t seg = s_ftl.open_seg;
+        const uint32_t first = s_ftl.open_used;
+        const size_t n = MIN(count, s_ftl.seg_pages - first);
+        // Pages are used up even if programming fails, they are never programmed twice
+        s_ftl.open_used += n;
+
+        const uint32_t ppn = seg * s_ftl.seg_pages + first;
+        ESP_RETURN_ON_ERROR(ftl_flash_write(page_addr(ppn), data, n * STORAGE_FTL_SECTOR_SIZE), TAG, "Failed to program pages");
+        for (size_t i = 0; i < n; i++) {
+            entries[i].lba = lbas[i];
+            entries[i].check = ~lbas[i];
+        }
+        // The entries commit the pages
+        ESP_RETURN_ON_ERROR(ftl_flash_write(entry_addr(seg, first), entries, n * sizeof(ftl_entry_t)), TAG, "Failed to write summary");
+
+        for (size_t i = 0; i < n; i++) {
+            const uint16_t old = s_ftl.map[lbas[i]];
+            if (old != FTL_PPN_NONE) {
+                s_ftl.valid[old / s_ftl.seg_pages]--;
+            }
+            s_ftl.map[lbas[i]] = (uint16_t)(ppn + i);
+        }
+        s_ftl.valid[seg] += n;
+        s_ftl.dirty = true;
+
+        lbas += n;
+        data += n * STORAGE_FTL_SECTOR_SIZE;
+        count -= n;
+    }
+    return ESP_OK;
+}
+
+// ============================================================================
+// Mount-time recovery
+// ============================================================================
+
+static int seg_seq_cmp(const void *a, const void *b)
+{
+    const uint32_t sa = s_ftl.seg_seq[*(const uint32_t *)a];
+    const uint32_t sb = s_ftl.seg_seq[*(const uint32_t *)b];
+    return (sa > sb) - (sa < sb);
+}
+
+static bool ftl_hdr_erased(const ftl_seg_hdr_t *hdr)
+{
+    const uint32_t *w = (const uint32_t *)hdr;
+    for (size_t i = 0; i < sizeof(*hdr) / sizeof(uint32_t); i++) {
+        if (w[i] != UINT32_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check that a segment with an erased header is erased all through
+ *
+ * Segments erased by this medium always are, see the layout above. A partition without a checkpoint
+ * may hold data of a previous user behind an erased first block.
+ */
+static esp_err_t ftl_seg_erased(uint32_t seg, bool *erased)
+{
+    const size_t chunk = FTL_BATCH_PAGES * STORAGE_FTL_SECTOR_SIZE;
+    *erased = true;
+    for (size_t off = 0; off < FTL_SEGMENT_SIZE && *erased; off += chunk) {
+        ESP_RETURN_ON_ERROR(esp_partition_read(s_ftl.part, seg_addr(seg) + off, s_ftl.gc_buf, chunk), TAG, "Failed to read segment");
+        const uint32_t *w = (const uint32_t *)s_ftl.gc_buf;
+        for (size_t i = 0; i < chunk / sizeof(uint32_t); i++) {
+            if (w[i] != UINT32_MAX) {
+                *erased = false;
+                break;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Rebuild the RAM state from the newest checkpoint and the segments written after it
+ */
+static esp_err_t ftl_load(void)
+{
+    uint32_t log_seq = 0;
+    const bool have_ckpt = (ftl_checkpoint_load(&log_seq) == ESP_OK);
+    if (!have_ckpt) {
+        memset(s_ftl.map, 0xFF, s_ftl.sectors * sizeof(uint16_t));
+        memset(s_ftl.erase_count, 0, s_ftl.segments * sizeof(uint32_t));
+    }
+
+    uint32_t *replay = malloc(s_ftl.segments * sizeof(uint32_t));
+    ESP_RETURN_ON_FALSE(replay != NULL, ESP_ERR_NO_MEM, TAG, "Failed to allocate replay list");
+    uint32_t replay_count = 0;
+    esp_err_t ret = ESP_OK;
+
+    for (uint32_t seg = 0; seg < s_ftl.segments && ret == ESP_OK; seg++) {
+        ftl_seg_hdr_t hdr;
+        ret = esp_partition_read(s_ftl.part, seg_addr(seg), &hdr, sizeof(hdr));
+        if (ret != ESP_OK) {
+            break;
+        }
+        s_ftl.seg_seq[seg] = 0;
+        if (ftl_hdr_erased(&hdr)) {
+            bool erased = true;
+            if (!have_ckpt) {
+                ret = ftl_seg_erased(seg, &erased);
+            }
+            if (ret == ESP_OK && !erased) {
+                ret = ftl_erase_segment(seg);
+            } else if (ret == ESP_OK) {
+                s_ftl.free_segs++;
+            }
+        } else if (hdr.magic == FTL_SEGMENT_MAGIC && hdr.seq != 0 && hdr.crc == seg_hdr_crc(&hdr)) {
+            s_ftl.seg_seq[seg] = hdr.seq;
+            s_ftl.erase_count[seg] = MAX(s_ftl.erase_count[seg], hdr.erase_count);
+            s_ftl.seq = MAX(s_ftl.seq, hdr.seq);
+            if (hdr.seq >= log_seq) {
+                replay[replay_count++] = seg;
+            }
+        } else {
+            // Torn header, or data of a previous user of the partition
+            ESP_LOGD(TAG, "Segment %"PRIu32" has no valid header, erasing it", seg);
+            ret = ftl_erase_segment(seg);
+        }
+    }
+
+    // Entries of later segments supersede earlier ones, in segment order and within a segment
+    qsort(replay, replay_count, sizeof(uint32_t), seg_seq_cmp);
+    for (uint32_t i = 0; i < replay_count && ret == ESP_OK; i++) {
+        const uint32_t seg = replay[i];
+        ret = ftl_read_summary(seg);
+        for (uint32_t page = 0; page < s_ftl.seg_pages && ret == ESP_OK; page++) {
+            if (entry_valid(&s_ftl.entries[page])) {
+                s_ftl.map[s_ftl.entries[page].lba] = (uint16_t)(seg * s_ftl.seg_pages + page);
+            }
+        }
+    }
+    free(replay);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Failed to read the log");
+
+    memset(s_ftl.valid, 0, s_ftl.segments * sizeof(uint16_t));
+    for (uint32_t lba = 0; lba < s_ftl.sectors; lba++) {
+        if (s_ftl.map[lba] != FTL_PPN_NONE) {
+            s_ftl.valid[s_ftl.map[lba] / s_ftl.seg_pages]++;
+        }
+    }
+
+    // The last open segment may have a page programmed without its entry, it is not filled any further
+    s_ftl.open_seg = FTL_SEG_NONE;
+    ESP_LOGD(TAG, "Loaded %s checkpoint, replayed %"PRIu32" segments, %"PRIu32" free",
+             have_ckpt ? "from" : "without", replay_count, s_ftl.free_segs);
+    s_ftl.dirty = (replay_count > 0);
+    // The partition is known to be clean now, spare the next open the check of the free segments
+    return have_ckpt ? ESP_OK : ftl_checkpoint();
+}
+
+// ============================================================================
+// Sector access
+// ============================================================================
+
+static esp_err_t ftl_check_range(uint32_t *lba, uint32_t *offset, size_t size)
+{
+    *lba += *offset / STORAGE_FTL_SECTOR_SIZE;
+    *offset %= STORAGE_FTL_SECTOR_SIZE;
+    ESP_RETURN_ON_FALSE((uint64_t)*lba * STORAGE_FTL_SECTOR_SIZE + *offset + size <= (uint64_t)s_ftl.sectors * STORAGE_FTL_SECTOR_SIZE,
+                        ESP_ERR_INVALID_SIZE, TAG, "Access beyond the medium, lba %"PRIu32, *lba);
+    return ESP_OK;
+}
+
+static esp_err_t ftl_read(uint32_t lba, uint32_t offset, size_t size, uint8_t *dest)
+{
+    ESP_RETURN_ON_ERROR(ftl_check_range(&lba, &offset, size), TAG, "Invalid read");
+
+    while (size > 0) {
+        const uint16_t ppn = s_ftl.map[lba];
+        size_t chunk = MIN(size, STORAGE_FTL_SECTOR_SIZE - offset);
+        uint32_t sectors = 1;
+        // Sectors written together sit in consecutive pages, read them with one access
+        while (ppn != FTL_PPN_NONE && chunk < size && s_ftl.map[lba + sectors] == ppn + sectors &&
+                (ppn + sectors) % s_ftl.seg_pages != 0) {
+            chunk += MIN(size - chunk, STORAGE_FTL_SECTOR_SIZE);
+            sectors++;
+        }
+
+        if (ppn == FTL_PPN_NONE) {
+            memset(dest, 0, chunk);
+        } else {
+            ESP_RETURN_ON_ERROR(esp_partition_read(s_ftl.part, page_addr(ppn) + offset, dest, chunk), TAG, "Failed to read pages");
+        }
+        lba += sectors;
+        offset = 0;
+        dest += chunk;
+        size -= chunk;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ftl_write(uint32_t lba, uint32_t offset, size_t size, const uint8_t *src)
+{
+    ESP_RETURN_ON_ERROR(ftl_check_range(&lba, &offset, size), TAG, "Invalid write");
+
+    while (size > 0) {
+        uint32_t lbas[FTL_BATCH_PAGES];
+        const uint8_t *data = src;
+        size_t chunk;
+        size_t count;
+        if (offset == 0 && size >= STORAGE_FTL_SECTOR_SIZE) {
+            count = MIN(size / STORAGE_FTL_SECTOR_SIZE, FTL_BATCH_PAGES);
+            chunk = count * STORAGE_FTL_SECTOR_SIZE;
+        } else {
+            // Partial sector: merge with the current contents, the page is rewritten whole
+            count = 1;
+            chunk = MIN(size, STORAGE_FTL_SECTOR_SIZE - offset);
+            ESP_RETURN_ON_ERROR(ftl_read(lba, 0, STORAGE_FTL_SECTOR_SIZE, s_ftl.buf), TAG, "Failed to read for merge");
+            memcpy(s_ftl.buf + offset, src, chunk);
+            data = s_ftl.buf;
+        }
+        for (size_t i = 0; i < count; i++) {
+            lbas[i] = lba + i;
+        }
+        ESP_RETURN_ON_ERROR(ftl_program(lbas, data, count), TAG, "Write failed");
+        s_ftl.stats.host_bytes += chunk;
+
+        lba += count;
+        offset = 0;
+        src += chunk;
+        size -= chunk;
+    }
+    return ESP_OK;
+}
+
+// ============================================================================
+// FatFs diskio
+// ============================================================================
+
+static DSTATUS ftl_disk_initialize(BYTE pdrv)
+{
+    return (s_ftl.part != NULL) ? 0 : STA_NOINIT;
+}
+
+static DSTATUS ftl_disk_status(BYTE pdrv)
+{
+    return (s_ftl.part != NULL) ? 0 : STA_NOINIT;
+}
+
+static DRESULT ftl_disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    return (ftl_read(sector, 0, (size_t)count * STORAGE_FTL_SECTOR_SIZE, buff) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT ftl_disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    return (ftl_write(sector, 0, (size_t)count * STORAGE_FTL_SECTOR_SIZE, buff) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT ftl_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    switch (cmd) {
+    case CTRL_SYNC:
+        // Writes are durable when they return, the checkpoint only shortens the next mount
+        return RES_OK;
+    case GET_SECTOR_COUNT:
+        *((DWORD *) buff) = s_ftl.sectors;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *) buff) = STORAGE_FTL_SECTOR_SIZE;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *((DWORD *) buff) = 1;
+        return RES_OK;
+    }
+    return RES_ERROR;
+}
+
+static const ff_diskio_impl_t ftl_impl = {
+    .init = &ftl_disk_initialize,
+    .status = &ftl_disk_status,
+    .read = &ftl_disk_read,
+    .write = &ftl_disk_write,
+    .ioctl = &ftl_disk_ioctl,
+};
+
+// ============================================================================
+// Storage API
+// ============================================================================
+
+static esp_err_t storage_ftl_mount(BYTE pdrv)
+{
+    assert(s_ftl.part != NULL);
+    ff_diskio_register(pdrv, &ftl_impl);
+    s_ftl.pdrv = pdrv;
+    return ESP_OK;
+}
+
+static esp_err_t storage_ftl_unmount(void)
+{
+    if (s_ftl.pdrv == 0xFF) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char drv[3] = {(char)('0' + s_ftl.pdrv), ':', 0};
+    f_mount(0, drv, 0);
+    ff_diskio_unregister(s_ftl.pdrv);
+    s_ftl.pdrv = 0xFF;
+
+    return s_ftl.dirty ? ftl_checkpoint() : ESP_OK;
+}
+
+static esp_err_t storage_ftl_sector_read(uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    assert(s_ftl.part != NULL);
+    return ftl_read(lba, offset, size, (uint8_t *)dest);
+}
+
+static esp_err_t storage_ftl_sector_write(uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    assert(s_ftl.part != NULL);
+    return ftl_write(lba, offset, size, (const uint8_t *)src);
+}
+
+// Adjacent buffers are read as one run
+static esp_err_t storage_ftl_sector_readv(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt)
+{
+    assert(s_ftl.part != NULL);
+    while (iovcnt > 0) {
+        size_t size;
+        const size_t n = storage_iov_run(iov, iovcnt, &size);
+        ESP_RETURN_ON_ERROR(ftl_read(lba, 0, size, (uint8_t *)iov[0].base), TAG, "");
+        lba += size / STORAGE_FTL_SECTOR_SIZE;
+        iov += n;
+        iovcnt -= n;
+    }
+    return ESP_OK;
+}
+
+// Adjacent buffers are written as one run, a summary write per page batch instead of per buffer
+static esp_err_t storage_ftl_sector_writev(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt)
+{
+    assert(s_ftl.part != NULL);
+    while (iovcnt > 0) {
+        size_t size;
+        const size_t n = storage_iov_run(iov, iovcnt, &size);
+        ESP_RETURN_ON_ERROR(ftl_write(lba, 0, size, (const uint8_t *)iov[0].base), TAG, "");
+        lba += size / STORAGE_FTL_SECTOR_SIZE;
+        iov += n;
+        iovcnt -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t storage_ftl_get_info(storage_info_t *info)
+{
+    ESP_RETURN_ON_FALSE(info, ESP_ERR_INVALID_ARG, TAG, "Storage info pointer can't be NULL");
+
+    info->total_sectors = s_ftl.sectors;
+    info->sector_size = STORAGE_FTL_SECTOR_SIZE;
+    return ESP_OK;
+}
+
+static void storage_ftl_free(void)
+{
+    heap_caps_free(s_ftl.map);
+    free(s_ftl.valid);
+    free(s_ftl.seg_seq);
+    free(s_ftl.erase_count);
+    free(s_ftl.buf);
+    free(s_ftl.gc_buf);
+    free(s_ftl.entries);
+    memset(&s_ftl, 0, sizeof(s_ftl));
+    s_ftl.pdrv = 0xFF;
+}
+
+static void storage_ftl_close(void)
+{
+    if (s_ftl.dirty && ftl_checkpoint() != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to checkpoint on close, the log is replayed on the next open");
+    }
+    storage_ftl_free();
+}
+
+// Constant struct of function pointers
+const storage_medium_t ftl_medium = {
+    .type = STORAGE_MEDIUM_TYPE_FTL,
+    .mount = &storage_ftl_mount,
+    .unmount = &storage_ftl_unmount,
+    .read = &storage_ftl_sector_read,
+    .write = &storage_ftl_sector_write,
+    .readv = &storage_ftl_sector_readv,
+    .writev = &storage_ftl_sector_writev,
+    .get_info = &storage_ftl_get_info,
+    .close = &storage_ftl_close,
+};
+
+/**
+ * @brief Size the segments and the checkpoint slots for a partition
+ */
+static esp_err_t ftl_geometry(size_t part_size)
+{
+    // As many data pages as leave room for their summary entries
+    uint32_t pages = FTL_SEGMENT_PAGES;
+    uint32_t meta = 0;
+    for (; pages > 0; pages--) {
+        meta = (sizeof(ftl_seg_hdr_t) + pages * sizeof(ftl_entry_t) + STORAGE_FTL_SECTOR_SIZE - 1) / STORAGE_FTL_SECTOR_SIZE;
+        if (meta + pages <= FTL_SEGMENT_PAGES) {
+            break;
+        }
+    }
+    s_ftl.seg_pages = pages;
+    s_ftl.meta_size = meta * STORAGE_FTL_SECTOR_SIZE;
+
+    // The checkpoints take space from the segments, which sets the size of the checkpoints
+    uint32_t segments = part_size / FTL_SEGMENT_SIZE;
+    for (int i = 0; i < 4; i++) {
+        const uint32_t usable = (segments > FTL_RESERVE_SEGMENTS + 2) ? segments - FTL_RESERVE_SEGMENTS - 2 : 0;
+        s_ftl.sectors = (uint32_t)((uint64_t)usable * pages * (100 - FTL_OVERPROVISION_PCT) / 100);
+        const size_t body = sizeof(ftl_ckpt_hdr_t) + s_ftl.sectors * sizeof(uint16_t) + segments * sizeof(uint32_t);
+        s_ftl.ckpt_size = (body + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+        const uint32_t fit = (part_size > 2 * s_ftl.ckpt_size) ? (part_size - 2 * s_ftl.ckpt_size) / FTL_SEGMENT_SIZE : 0;
+        if (fit >= segments) {
+            break;
+        }
+        segments = fit;
+    }
+    s_ftl.segments = segments;
+    s_ftl.seg_base = 2 * s_ftl.ckpt_size;
+
+    ESP_RETURN_ON_FALSE(segments >= FTL_RESERVE_SEGMENTS + 4 && s_ftl.sectors > 0, ESP_ERR_INVALID_SIZE, TAG,
+                        "Partition is too small, %u bytes", part_size);
+    ESP_RETURN_ON_FALSE((uint64_t)segments * pages < FTL_PPN_NONE, ESP_ERR_INVALID_SIZE, TAG,
+                        "Partition is too large, %u bytes", part_size);
+    return ESP_OK;
+}
+
+esp_err_t storage_ftl_get_stats(tinyusb_msc_ftl_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(s_ftl.part != NULL, ESP_ERR_INVALID_STATE, TAG, "Log-structured medium is not open");
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "Stats pointer can't be NULL");
+
+    *stats = s_ftl.stats;
+    stats->segments = s_ftl.segments;
+    stats->free_segments = s_ftl.free_segs;
+    stats->erase_count_min = UINT32_MAX;
+    stats->erase_count_max = 0;
+    for (uint32_t s = 0; s < s_ftl.segments; s++) {
+        stats->erase_count_min = MIN(stats->erase_count_min, s_ftl.erase_count[s]);
+        stats->erase_count_max = MAX(stats->erase_count_max, s_ftl.erase_count[s]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_ftl_open_medium(const esp_partition_t *partition, const storage_medium_t **medium)
+{
+    ESP_RETURN_ON_FALSE(partition != NULL, ESP_ERR_INVALID_ARG, TAG, "Partition can't be NULL");
+    ESP_RETURN_ON_FALSE(medium != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage API pointer can't be NULL");
+    ESP_RETURN_ON_FALSE(s_ftl.part == NULL, ESP_ERR_INVALID_STATE, TAG, "Log-structured medium is already open");
+    ESP_RETURN_ON_ERROR(ftl_geometry(partition->size), TAG, "Unsupported partition '%s'", partition->label);
+
+    s_ftl.part = partition;
+    s_ftl.open_seg = FTL_SEG_NONE;
+    // The map is the only large allocation, PSRAM is fine for it
+    s_ftl.map = heap_caps_malloc(s_ftl.sectors * sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (s_ftl.map == NULL) {
+        s_ftl.map = heap_caps_malloc(s_ftl.sectors * sizeof(uint16_t), MALLOC_CAP_8BIT);
+    }
+    s_ftl.valid = calloc(s_ftl.segments, sizeof(uint16_t));
+    s_ftl.seg_seq = calloc(s_ftl.segments, sizeof(uint32_t));
+    s_ftl.erase_count = calloc(s_ftl.segments, sizeof(uint32_t));
+    s_ftl.buf = malloc(STORAGE_FTL_SECTOR_SIZE);
+    s_ftl.gc_buf = malloc(FTL_BATCH_PAGES * STORAGE_FTL_SECTOR_SIZE);
+    s_ftl.entries = malloc(s_ftl.seg_pages * sizeof(ftl_entry_t));
+    if (!s_ftl.map || !s_ftl.valid || !s_ftl.seg_seq || !s_ftl.erase_count || !s_ftl.buf || !s_ftl.gc_buf || !s_ftl.entries) {
+        storage_ftl_free();
+        ESP_LOGE(TAG, "Failed to allocate the map");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ftl_load();
+    if (ret != ESP_OK) {
+        storage_ftl_free();
+        return ret;
+    }
+
+    *medium = &ftl_medium;
+    ESP_LOGD(TAG, "%"PRIu32" sectors on %"PRIu32" segments of %"PRIu32" pages, checkpoint %"PRIu32" bytes",
+             s_ftl.sectors, s_ftl.segments, s_ftl.seg_pages, s_ftl.ckpt_size);
+    return ESP_OK;
+}
@@ -0,0 +1,554 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#include "checksum.h"
+#include "diskio_impl.h"
+#include "msc_storage.h"
+#include "storage_integrity.h"
+
+static const char *TAG = "storage_integrity";
+
+#define INTEGRITY_TABLE_MAGIC       0x43524354      /*!< "TCRC" */
+#define INTEGRITY_SCRUB_RATE        CONFIG_TINYUSB_MSC_INTEGRITY_SCRUB_RATE         /*!< Sectors checked per second, 0 if no scrub task */
+#define INTEGRITY_FLUSH_DELAY_MS    CONFIG_TINYUSB_MSC_INTEGRITY_FLUSH_DELAY_MS     /*!< Idle time before the scrub task writes the table back */
+#define INTEGRITY_TASK_STACK        3072
+#define INTEGRITY_TASK_PRIO         2               /*!< Below the TinyUSB task, scrubbing is background work */
+#if CONFIG_TINYUSB_MSC_INTEGRITY_VERIFY_READS
+#define INTEGRITY_VERIFY_READS      true
+#else
+#define INTEGRITY_VERIFY_READS      false           /*!< Only writes and the scrub task touch the CRCs */
+#endif // CONFIG_TINYUSB_MSC_INTEGRITY_VERIFY_READS
+
+/**
+ * @brief Table header, at the start of the first table sector
+ */
+typedef struct {
+    uint32_t magic;             /*!< INTEGRITY_TABLE_MAGIC */
+    uint32_t sectors;           /*!< Number of entries */
+    uint32_t sector_size;       /*!< Sector size the entries were computed for */
+    uint32_t clean;             /*!< 1 if the entries match the medium, 0 while writes are in progress */
+    uint32_t crc;               /*!< CRC32C of the entries */
+    uint32_t reserved[3];
+} integrity_table_hdr_t;
+
+static struct {
+    const storage_medium_t *backing;    // Checked medium
+    uint32_t sector_size;               // Backing sector size
+    uint32_t data_sectors;              // Sectors covered by the table, exposed by the medium
+    uint32_t table_sectors;             // Sectors holding the table, after the data sectors
+    uint8_t *table_image;               // Header and entries, as written to the medium
+    uint32_t *crc;                      // Entries, inside table_image
+    uint8_t *sector;                    // Bounce sector for partial accesses
+    bool dirty;                         // Table in RAM differs from the medium
+    bool marked_unclean;                // Table on the medium is flagged unclean
+    TickType_t last_write;              // Tick of the last data write
+    SemaphoreHandle_t lock;             // Serialises the MSC driver, the application and the scrub task
+#if INTEGRITY_SCRUB_RATE > 0
+    TaskHandle_t scrub_task;
+    SemaphoreHandle_t scrub_exit;       // Given by the scrub task when it stops
+    volatile bool scrub_stop;
+    uint8_t *scrub_sector;              // Scrub task read buffer
+    uint32_t scrub_next;                // Next sector to scrub
+#endif // INTEGRITY_SCRUB_RATE > 0
+    tinyusb_msc_integrity_stats_t stats;
+    BYTE pdrv;                          // FatFs drive, while mounted to the application
+} s_integ = {
+    .pdrv = 0xFF,
+};
+
+// ============================================================================
+// Table
+// ============================================================================
+
+static inline integrity_table_hdr_t *table_hdr(void)
+{
+    return (integrity_table_hdr_t *)s_integ.table_image;
+}
+
+static esp_err_t table_write(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        ESP_RETURN_ON_ERROR(s_integ.backing->write(s_integ.data_sectors + i, 0, s_integ.sector_size,
+                                                   s_integ.table_image + i * s_integ.sector_size),
+                            TAG, "Failed to write table sector %"PRIu32, i);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t table_flush(void)
+{
+    if (!s_integ.dirty && !s_integ.marked_unclean) {
+        return ESP_OK;
+    }
+    integrity_table_hdr_t *hdr = table_hdr();
+    hdr->clean = 1;
+    hdr->crc = checksum_crc32c(0, (const uint8_t *)s_integ.crc, s_integ.data_sectors * sizeof(uint32_t));
+    ESP_RETURN_ON_ERROR(table_write(s_integ.table_sectors), TAG, "Failed to write table");
+    s_integ.dirty = false;
+    s_integ.marked_unclean = false;
+    return ESP_OK;
+}
+
+/**
+ * @brief Flag the table on the medium unclean before the first data write after a flush
+ */
+static esp_err_t table_mark_unclean(void)
+{
+    if (s_integ.marked_unclean) {
+        return ESP_OK;
+    }
+    table_hdr()->clean = 0;
+    ESP_RETURN_ON_ERROR(table_write(1), TAG, "Failed to mark table unclean");
+    s_integ.marked_unclean = true;
+    return ESP_OK;
+}
+
+static bool table_load(void)
+{
+    const integrity_table_hdr_t *hdr = table_hdr();
+
+    for (uint32_t i = 0; i < s_integ.table_sectors; i++) {
+        if (s_integ.backing->read(s_integ.data_sectors + i, 0, s_integ.sector_size,
+                                  s_integ.table_image + i * s_integ.sector_size) != ESP_OK) {
+            return false;
+        }
+    }
+    return hdr->magic == INTEGRITY_TABLE_MAGIC && hdr->sectors == s_integ.data_sectors &&
+           hdr->sector_size == s_integ.sector_size && hdr->clean == 1 &&
+           hdr->crc == checksum_crc32c(0, (const uint8_t *)s_integ.crc, s_integ.data_sectors * sizeof(uint32_t));
+}
+
+static esp_err_t table_rebuild(void)
+{
+    integrity_table_hdr_t *hdr = table_hdr();
+
+    memset(s_integ.table_image, 0, s_integ.table_sectors * s_integ.sector_size);
+    hdr->magic = INTEGRITY_TABLE_MAGIC;
+    hdr->sectors = s_integ.data_sectors;
+    hdr->sector_size = s_integ.sector_size;
+    for (uint32_t lba = 0; lba < s_integ.data_sectors; lba++) {
+        ESP_RETURN_ON_ERROR(s_integ.backing->read(lba, 0, s_integ.sector_size, s_integ.sector), TAG, "Failed to read sector %"PRIu32, lba);
+        s_integ.crc[lba] = checksum_crc32c(0, s_integ.sector, s_integ.sector_size);
+    }
+    s_integ.dirty = true;
+    return table_flush();
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+/**
+ * @brief Check a sector read from the medium, correcting it if possible
+ *
+ * @param[in] lba Sector number
+ * @param[inout] data Sector contents, corrected in place
+ *
+ * @return ESP_OK if the sector is good or was corrected, ESP_ERR_INVALID_CRC otherwise
+ */
+static esp_err_t integrity_check_sector(uint32_t lba, uint8_t *data)
+{
+    s_integ.stats.checked++;
+    const uint32_t crc = checksum_crc32c(0, data, s_integ.sector_size);
+    if (crc == s_integ.crc[lba]) {
+        return ESP_OK;
+    }
+
+    // Transient read error
+    if (s_integ.backing->read(lba, 0, s_integ.sector_size, data) == ESP_OK &&
+            checksum_crc32c(0, data, s_integ.sector_size) == s_integ.crc[lba]) {
+        ESP_LOGW(TAG, "Sector %"PRIu32": read error, corrected by re-reading", lba);
+        s_integ.stats.corrected++;
+        return ESP_OK;
+    }
+
+    const uint32_t syndrome = crc ^ s_integ.crc[lba];
+    if ((syndrome & (syndrome - 1)) == 0) {
+        // The stored CRC took the hit, the data is good
+        ESP_LOGW(TAG, "Sector %"PRIu32": bit flip in the CRC table, corrected", lba);
+        s_integ.crc[lba] = crc;
+        s_integ.dirty = true;
+        s_integ.stats.corrected++;
+        return ESP_OK;
+    }
+
+    const int32_t bit = checksum_crc32c_locate_bit(syndrome, s_integ.sector_size);
+    if (bit >= 0) {
+        data[bit / 8] ^= (uint8_t)(1u << (bit % 8));
+        if (s_integ.backing->write(lba, 0, s_integ.sector_size, data) != ESP_OK) {
+            ESP_LOGW(TAG, "Sector %"PRIu32": failed to write back corrected data", lba);
+        }
+        ESP_LOGW(TAG, "Sector %"PRIu32": bit flip at bit %"PRIi32", corrected", lba, bit);
+        s_integ.stats.corrected++;
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Sector %"PRIu32": uncorrectable CRC error", lba);
+    s_integ.stats.uncorrectable++;
+    return ESP_ERR_INVALID_CRC;
+}
+
+static esp_err_t integrity_read_sectors(uint32_t lba, size_t count, uint8_t *dest, bool verify)
+{
+    ESP_RETURN_ON_ERROR(s_integ.backing->read(lba, 0, count * s_integ.sector_size, dest), TAG, "Backing read failed, lba %"PRIu32, lba);
+    if (!verify) {
+        return ESP_OK;
+    }
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < count; i++) {
+        // Check every sector, so all the errors are counted and corrected
+        if (integrity_check_sector(lba + i, dest + i * s_integ.sector_size) != ESP_OK) {
+            ret = ESP_ERR_INVALID_CRC;
+        }
+    }
+    return ret;
+}
+
+static esp_err_t integrity_write_sectors(uint32_t lba, size_t count, const uint8_t *src)
+{
+    ESP_RETURN_ON_ERROR(table_mark_unclean(), TAG, "Failed to update table");
+    s_integ.last_write = xTaskGetTickCount();
+    s_integ.dirty = true;
+
+    esp_err_t ret = s_integ.backing->write(lba, 0, count * s_integ.sector_size, src);
+    for (size_t i = 0; i < count; i++) {
+        if (ret == ESP_OK) {
+            s_integ.crc[lba + i] = checksum_crc32c(0, src + i * s_integ.sector_size, s_integ.sector_size);
+        } else if (s_integ.backing->read(lba + i, 0, s_integ.sector_size, s_integ.sector) == ESP_OK) {
+            // Medium content is unknown after a failed write, follow what is there
+            s_integ.crc[lba + i] = checksum_crc32c(0, s_integ.sector, s_integ.sector_size);
+        }
+    }
+    return ret;
+}
+
+static esp_err_t integrity_rw(uint32_t lba, uint32_t offset, size_t size, uint8_t *dest, const uint8_t *src)
+{
+    const size_t ss = s_integ.sector_size;
+    esp_err_t ret = ESP_OK;
+
+    lba += offset / ss;
+    offset %= ss;
+    ESP_RETURN_ON_FALSE((uint64_t)lba * ss + offset + size <= (uint64_t)s_integ.data_sectors * ss, ESP_ERR_INVALID_SIZE, TAG,
+                        "Access beyond the medium, lba %"PRIu32, lba);
+
+    xSemaphoreTake(s_integ.lock, portMAX_DELAY);
+    while (size > 0 && ret == ESP_OK) {
+        if (offset == 0 && size >= ss) {
+            // Whole sectors, straight to or from the caller buffer
+            const size_t count = size / ss;
+            if (src != NULL) {
+                ret = integrity_write_sectors(lba, count, src);
+                src += count * ss;
+            } else {
+                ret = integrity_read_sectors(lba, count, dest, INTEGRITY_VERIFY_READS);
+                dest += count * ss;
+            }
+            lba += count;
+            size -= count * ss;
+        } else {
+            // Partial sector, a write needs the whole sector to compute its CRC
+            const size_t chunk = MIN(size, ss - offset);
+            ret = integrity_read_sectors(lba, 1, s_integ.sector, src != NULL || INTEGRITY_VERIFY_READS);
+            if (ret == ESP_OK && src != NULL) {
+                memcpy(s_integ.sector + offset, src, chunk);
+                ret = integrity_write_sectors(lba, 1, s_integ.sector);
+                src += chunk;
+            } else if (ret == ESP_OK) {
+                memcpy(dest, s_integ.sector + offset, chunk);
+                dest += chunk;
+            }
+            lba++;
+            size -= chunk;
+            offset = 0;
+        }
+    }
+    xSemaphoreGive(s_integ.lock);
+    return ret;
+}
+
+static esp_err_t integrity_sync(void)
+{
+    xSemaphoreTake(s_integ.lock, portMAX_DELAY);
+    esp_err_t ret = table_flush();
+    xSemaphoreGive(s_integ.lock);
+    return ret;
+}
+
+// ============================================================================
+// Scrub task
+// ============================================================================
+
+#if INTEGRITY_SCRUB_RATE > 0
+static void integrity_scrub_task(void *arg)
+{
+    const TickType_t period = MAX(pdMS_TO_TICKS(1000 / INTEGRITY_SCRUB_RATE), 1);
+
+    while (!s_integ.scrub_stop) {
+        ulTaskNotifyTake(pdTRUE, period);
+        if (s_integ.scrub_stop) {
+            break;
+        }
+
+        xSemaphoreTake(s_integ.lock, portMAX_DELAY);
+        const uint32_t lba = s_integ.scrub_next;
+        if (s_integ.backing->read(lba, 0, s_integ.sector_size, s_integ.scrub_sector) == ESP_OK) {
+            integrity_check_sector(lba, s_integ.scrub_sector);
+        } else {
+            ESP_LOGW(TAG, "Scrub: failed to read sector %"PRIu32, lba);
+        }
+        if (++s_integ.scrub_next >= s_integ.data_sectors) {
+            s_integ.scrub_next = 0;
+            s_integ.stats.scrub_passes++;
+            ESP_LOGD(TAG, "Scrub pass %"PRIu32" done: %"PRIu32" corrected, %"PRIu32" uncorrectable", s_integ.stats.scrub_passes,
+                     s_integ.stats.corrected, s_integ.stats.uncorrectable);
+        }
+        // Write the table back once writes have settled
+        if (s_integ.dirty && (xTaskGetTickCount() - s_integ.last_write) >= pdMS_TO_TICKS(INTEGRITY_FLUSH_DELAY_MS)) {
+            if (table_flush() != ESP_OK) {
+                ESP_LOGW(TAG, "Scrub: failed to write table");
+            }
+        }
+        xSemaphoreGive(s_integ.lock);
+    }
+    xSemaphoreGive(s_integ.scrub_exit);
+    vTaskDelete(NULL);
+}
+#endif // INTEGRITY_SCRUB_RATE > 0
+
+// ============================================================================
+// FatFs diskio
+// ============================================================================
+
+static DSTATUS integrity_disk_initialize(BYTE pdrv)
+{
+    return (s_integ.backing != NULL) ? 0 : STA_NOINIT;
+}
+
+static DSTATUS integrity_disk_status(BYTE pdrv)
+{
+    return (s_integ.backing != NULL) ? 0 : STA_NOINIT;
+}
+
+static DRESULT integrity_disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    return (integrity_rw(sector, 0, (size_t)count * s_integ.sector_size, buff, NULL) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT integrity_disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    return (integrity_rw(sector, 0, (size_t)count * s_integ.sector_size, NULL, buff) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT integrity_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    switch (cmd) {
+    case CTRL_SYNC:
+        return (integrity_sync() == ESP_OK) ? RES_OK : RES_ERROR;
+    case GET_SECTOR_COUNT:
+        *((DWORD *) buff) = s_integ.data_sectors;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *) buff) = s_integ.sector_size;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *((DWORD *) buff) = 1;
+        return RES_OK;
+    }
+    return RES_ERROR;
+}
+
+static const ff_diskio_impl_t integrity_impl = {
+    .init = &integrity_disk_initialize,
+    .status = &integrity_disk_status,
+    .read = &integrity_disk_read,
+    .write = &integrity_disk_write,
+    .ioctl = &integrity_disk_ioctl,
+};
+
+// ============================================================================
+// Storage API
+// ============================================================================
+
+static esp_err_t storage_integrity_mount(BYTE pdrv)
+{
+    assert(s_integ.backing != NULL);
+    ESP_RETURN_ON_ERROR(integrity_sync(), TAG, "Failed to sync before mount");
+    ff_diskio_register(pdrv, &integrity_impl);
+    s_integ.pdrv = pdrv;
+    return ESP_OK;
+}
+
+static esp_err_t storage_integrity_unmount(void)
+{
+    if (s_integ.pdrv == 0xFF) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char drv[3] = {(char)('0' + s_integ.pdrv), ':', 0};
+    f_mount(0, drv, 0);
+    ff_diskio_unregister(s_integ.pdrv);
+    s_integ.pdrv = 0xFF;
+
+    return integrity_sync();
+}
+
+static esp_err_t storage_integrity_sector_read(uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    assert(s_integ.backing != NULL);
+    return integrity_rw(lba, offset, size, (uint8_t *)dest, NULL);
+}
+
+static esp_err_t storage_integrity_sector_write(uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    assert(s_integ.backing != NULL);
+    return integrity_rw(lba, offset, size, NULL, (const uint8_t *)src);
+}
+
+static esp_err_t storage_integrity_sync(void)
+{
+    assert(s_integ.backing != NULL);
+    ESP_RETURN_ON_ERROR(integrity_sync(), TAG, "Failed to write table");
+    return storage_medium_sync(s_integ.backing);
+}
+
+static esp_err_t storage_integrity_get_info(storage_info_t *info)
+{
+    ESP_RETURN_ON_FALSE(info, ESP_ERR_INVALID_ARG, TAG, "Storage info pointer can't be NULL");
+
+    info->total_sectors = s_integ.data_sectors;
+    info->sector_size = s_integ.sector_size;
+    return ESP_OK;
+}
+
+static void storage_integrity_free(void)
+{
+#if INTEGRITY_SCRUB_RATE > 0
+    if (s_integ.scrub_task != NULL) {
+        s_integ.scrub_stop = true;
+        xTaskNotifyGive(s_integ.scrub_task);
+        xSemaphoreTake(s_integ.scrub_exit, portMAX_DELAY);
+    }
+    if (s_integ.scrub_exit != NULL) {
+        vSemaphoreDelete(s_integ.scrub_exit);
+    }
+    heap_caps_free(s_integ.scrub_sector);
+#endif // INTEGRITY_SCRUB_RATE > 0
+    if (s_integ.lock != NULL) {
+        vSemaphoreDelete(s_integ.lock);
+    }
+    heap_caps_free(s_integ.table_image);
+    heap_caps_free(s_integ.sector);
+    memset(&s_integ, 0, sizeof(s_integ));
+    s_integ.pdrv = 0xFF;
+}
+
+static void storage_integrity_close(void)
+{
+    if (integrity_sync() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write table on close, it is rebuilt on next open");
+    }
+    ESP_LOGD(TAG, "Checked %"PRIu32" sectors: %"PRIu32" corrected, %"PRIu32" uncorrectable",
+             s_integ.stats.checked, s_integ.stats.corrected, s_integ.stats.uncorrectable);
+    const storage_medium_t *backing = s_integ.backing;
+    storage_integrity_free();
+    backing->close();
+}
+
+// Storage API, the medium type is taken from the backing medium
+static storage_medium_t integrity_medium = {
+    .mount = &storage_integrity_mount,
+    .unmount = &storage_integrity_unmount,
+    .read = &storage_integrity_sector_read,
+    .write = &storage_integrity_sector_write,
+    .sync = &storage_integrity_sync,
+    .get_info = &storage_integrity_get_info,
+    .close = &storage_integrity_close,
+};
+
+esp_err_t storage_integrity_get_stats(tinyusb_msc_integrity_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "Stats pointer can't be NULL");
+    ESP_RETURN_ON_FALSE(s_integ.backing != NULL, ESP_ERR_INVALID_STATE, TAG, "Checked medium is not open");
+
+    xSemaphoreTake(s_integ.lock, portMAX_DELAY);
+    *stats = s_integ.stats;
+    xSemaphoreGive(s_integ.lock);
+    return ESP_OK;
+}
+
+esp_err_t storage_integrity_open_medium(const storage_medium_t *backing, const storage_medium_t **medium)
+{
+    ESP_RETURN_ON_FALSE(backing != NULL, ESP_ERR_INVALID_ARG, TAG, "Backing medium can't be NULL");
+    ESP_RETURN_ON_FALSE(medium != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage API pointer can't be NULL");
+    ESP_RETURN_ON_FALSE(s_integ.backing == NULL, ESP_ERR_INVALID_STATE, TAG, "Checked medium is already open");
+
+    storage_info_t info;
+    ESP_RETURN_ON_ERROR(backing->get_info(&info), TAG, "Failed to get medium info");
+    ESP_RETURN_ON_FALSE(info.sector_size >= sizeof(integrity_table_hdr_t) && (info.sector_size % sizeof(uint32_t)) == 0,
+                        ESP_ERR_INVALID_SIZE, TAG, "Unsupported sector size %"PRIu32, info.sector_size);
+
+    // Size the table for the whole medium, then take it out of the data sectors
+    const uint32_t table_sectors = (sizeof(integrity_table_hdr_t) + info.total_sectors * sizeof(uint32_t) + info.sector_size - 1) / info.sector_size;
+    ESP_RETURN_ON_FALSE(info.total_sectors > 2 * table_sectors, ESP_ERR_INVALID_SIZE, TAG, "Medium is too small");
+
+    esp_err_t ret = ESP_OK;
+    s_integ.backing = backing;
+    s_integ.sector_size = info.sector_size;
+    s_integ.table_sectors = table_sectors;
+    s_integ.data_sectors = info.total_sectors - table_sectors;
+
+    s_integ.table_image = heap_caps_calloc(table_sectors, info.sector_size, MALLOC_CAP_8BIT);
+    s_integ.crc = (uint32_t *)(s_integ.table_image + sizeof(integrity_table_hdr_t));
+    s_integ.sector = heap_caps_malloc(info.sector_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    s_integ.lock = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(s_integ.table_image && s_integ.sector && s_integ.lock, ESP_ERR_NO_MEM, fail, TAG, "Failed to allocate table");
+
+    if (!table_load()) {
+        ESP_LOGW(TAG, "No clean CRC table, rebuilding it from %"PRIu32" sectors", s_integ.data_sectors);
+        ESP_GOTO_ON_ERROR(table_rebuild(), fail, TAG, "Failed to rebuild table");
+    }
+
+#if INTEGRITY_SCRUB_RATE > 0
+    s_integ.scrub_sector = heap_caps_malloc(info.sector_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    s_integ.scrub_exit = xSemaphoreCreateBinary();
+    ESP_GOTO_ON_FALSE(s_integ.scrub_sector && s_integ.scrub_exit, ESP_ERR_NO_MEM, fail, TAG, "Failed to allocate scrub buffer");
+    ESP_GOTO_ON_FALSE(xTaskCreate(integrity_scrub_task, "msc_scrub", INTEGRITY_TASK_STACK, NULL, INTEGRITY_TASK_PRIO, &s_integ.scrub_task) == pdPASS,
+                      ESP_ERR_NO_MEM, fail, TAG, "Failed to create scrub task");
+#endif // INTEGRITY_SCRUB_RATE > 0
+
+    const storage_medium_t im = {
+        .type = backing->type,
+        .mount = integrity_medium.mount,
+        .unmount = integrity_medium.unmount,
+        .read = integrity_medium.read,
+        .write = integrity_medium.write,
+        .sync = integrity_medium.sync,
+        .get_info = integrity_medium.get_info,
+        .close = integrity_medium.close,
+    };
+    memcpy(&integrity_medium, &im, sizeof(im));
+    *medium = &integrity_medium;
+
+    ESP_LOGD(TAG, "%"PRIu32" sectors checked, table in %"PRIu32" sectors", s_integ.data_sectors, table_sectors);
+    return ESP_OK;
+
+fail:
+    storage_integrity_free();
+    return ret;
+}
@@ -0,0 +1,253 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "spi_flash_mmap.h"
+#include "sdkconfig.h"
+#include "diskio_impl.h"
+#include "msc_storage.h"
+#include "storage_ramdisk.h"
+
+static const char *TAG = "storage_ramdisk";
+
+#define RAMDISK_SNAPSHOT_MAGIC      0x4B534452  /*!< "RDSK" */
+#define RAMDISK_SNAPSHOT_VERSION    1
+#define RAMDISK_SNAPSHOT_DATA       SPI_FLASH_SEC_SIZE  /*!< Image offset in the partition, the header has its own erase block */
+
+/**
+ * @brief Snapshot header, written after the image so a torn snapshot is never loaded
+ */
+typedef struct {
+    uint32_t magic;         /*!< RAMDISK_SNAPSHOT_MAGIC */
+    uint32_t version;       /*!< RAMDISK_SNAPSHOT_VERSION */
+    uint32_t size;          /*!< Image size in bytes */
+    uint32_t crc;           /*!< CRC32 of the image */
+} ramdisk_snapshot_hdr_t;
+
+static uint8_t *_disk = NULL;                       // Disk contents
+static size_t _disk_size = 0;                       // Disk size in bytes
+static const esp_partition_t *_snapshot = NULL;     // Snapshot partition, may be NULL
+static BYTE _pdrv = 0xFF;                           // FatFs drive the disk is registered under, while mounted
+
+// ============================================================================
+// FatFs diskio
+// ============================================================================
+
+static DSTATUS ramdisk_disk_initialize(BYTE pdrv)
+{
+    return (_disk != NULL) ? 0 : STA_NOINIT;
+}
+
+static DSTATUS ramdisk_disk_status(BYTE pdrv)
+{
+    return (_disk != NULL) ? 0 : STA_NOINIT;
+}
+
+static DRESULT ramdisk_disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    if ((uint64_t)(sector + count) * STORAGE_RAMDISK_SECTOR_SIZE > _disk_size) {
+        return RES_PARERR;
+    }
+    memcpy(buff, _disk + (size_t)sector * STORAGE_RAMDISK_SECTOR_SIZE, (size_t)count * STORAGE_RAMDISK_SECTOR_SIZE);
+    return RES_OK;
+}
+
+static DRESULT ramdisk_disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    if ((uint64_t)(sector + count) * STORAGE_RAMDISK_SECTOR_SIZE > _disk_size) {
+        return RES_PARERR;
+    }
+    memcpy(_disk + (size_t)sector * STORAGE_RAMDISK_SECTOR_SIZE, buff, (size_t)count * STORAGE_RAMDISK_SECTOR_SIZE);
+    return RES_OK;
+}
+
+static DRESULT ramdisk_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    switch (cmd) {
+    case CTRL_SYNC:
+        return RES_OK;
+    case GET_SECTOR_COUNT:
+        *((DWORD *) buff) = _disk_size / STORAGE_RAMDISK_SECTOR_SIZE;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *) buff) = STORAGE_RAMDISK_SECTOR_SIZE;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *((DWORD *) buff) = 1;
+        return RES_OK;
+#if FF_USE_TRIM
+    case CTRL_TRIM:
+        return RES_OK;
+#endif // FF_USE_TRIM
+    }
+    return RES_ERROR;
+}
+
+static const ff_diskio_impl_t ramdisk_impl = {
+    .init = &ramdisk_disk_initialize,
+    .status = &ramdisk_disk_status,
+    .read = &ramdisk_disk_read,
+    .write = &ramdisk_disk_write,
+    .ioctl = &ramdisk_disk_ioctl,
+};
+
+// ============================================================================
+// Snapshot
+// ============================================================================
+
+static esp_err_t storage_ramdisk_restore(void)
+{
+    ramdisk_snapshot_hdr_t hdr;
+    ESP_RETURN_ON_ERROR(esp_partition_read(_snapshot, 0, &hdr, sizeof(hdr)), TAG, "Failed to read snapshot header");
+    if (hdr.magic != RAMDISK_SNAPSHOT_MAGIC || hdr.version != RAMDISK_SNAPSHOT_VERSION) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (hdr.size != _disk_size) {
+        ESP_LOGW(TAG, "Snapshot is %"PRIu32" bytes, disk is %u bytes, ignoring it", hdr.size, _disk_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ESP_RETURN_ON_ERROR(esp_partition_read(_snapshot, RAMDISK_SNAPSHOT_DATA, _disk, _disk_size), TAG, "Failed to read snapshot");
+    if (esp_rom_crc32_le(0, _disk, _disk_size) != hdr.crc) {
+        ESP_LOGW(TAG, "Snapshot is corrupted, ignoring it");
+        memset(_disk, 0, _disk_size);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_ramdisk_snapshot(void)
+{
+    ESP_RETURN_ON_FALSE(_disk != NULL, ESP_ERR_INVALID_STATE, TAG, "RAM disk is not open");
+    ESP_RETURN_ON_FALSE(_snapshot != NULL, ESP_ERR_INVALID_STATE, TAG, "No snapshot partition configured");
+
+    const size_t erase_size = RAMDISK_SNAPSHOT_DATA + ((_disk_size + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1));
+    ESP_RETURN_ON_FALSE(erase_size <= _snapshot->size, ESP_ERR_INVALID_SIZE, TAG, "Snapshot partition is too small");
+
+    const ramdisk_snapshot_hdr_t hdr = {
+        .magic = RAMDISK_SNAPSHOT_MAGIC,
+        .version = RAMDISK_SNAPSHOT_VERSION,
+        .size = _disk_size,
+        .crc = esp_rom_crc32_le(0, _disk, _disk_size),
+    };
+
+    // Erasing the header first invalidates the previous snapshot, the new one is valid once the header is written
+    ESP_RETURN_ON_ERROR(esp_partition_erase_range(_snapshot, 0, erase_size), TAG, "Failed to erase snapshot partition");
+    ESP_RETURN_ON_ERROR(esp_partition_write(_snapshot, RAMDISK_SNAPSHOT_DATA, _disk, _disk_size), TAG, "Failed to write snapshot");
+    ESP_RETURN_ON_ERROR(esp_partition_write(_snapshot, 0, &hdr, sizeof(hdr)), TAG, "Failed to write snapshot header");
+
+    ESP_LOGD(TAG, "Snapshot of %u bytes saved to '%s'", _disk_size, _snapshot->label);
+    return ESP_OK;
+}
+
+// ============================================================================
+// Storage API
+// ============================================================================
+
+static esp_err_t storage_ramdisk_mount(BYTE pdrv)
+{
+    assert(_disk != NULL);
+    ff_diskio_register(pdrv, &ramdisk_impl);
+    _pdrv = pdrv;
+    return ESP_OK;
+}
+
+static esp_err_t storage_ramdisk_unmount(void)
+{
+    if (_pdrv == 0xFF) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char drv[3] = {(char)('0' + _pdrv), ':', 0};
+    f_mount(0, drv, 0);
+    ff_diskio_unregister(_pdrv);
+    _pdrv = 0xFF;
+
+    return ESP_OK;
+}
+
+static esp_err_t storage_ramdisk_sector_read(uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    assert(_disk != NULL);
+    const uint64_t addr = (uint64_t)lba * STORAGE_RAMDISK_SECTOR_SIZE + offset;
+    ESP_RETURN_ON_FALSE(addr + size <= _disk_size, ESP_ERR_INVALID_SIZE, TAG, "Read beyond the disk, lba %"PRIu32, lba);
+    memcpy(dest, _disk + addr, size);
+    return ESP_OK;
+}
+
+static esp_err_t storage_ramdisk_sector_write(uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    assert(_disk != NULL);
+    const uint64_t addr = (uint64_t)lba * STORAGE_RAMDISK_SECTOR_SIZE + offset;
+    ESP_RETURN_ON_FALSE(addr + size <= _disk_size, ESP_ERR_INVALID_SIZE, TAG, "Write beyond the disk, lba %"PRIu32, lba);
+    memcpy(_disk + addr, src, size);
+    return ESP_OK;
+}
+
+static esp_err_t storage_ramdisk_get_info(storage_info_t *info)
+{
+    ESP_RETURN_ON_FALSE(info, ESP_ERR_INVALID_ARG, TAG, "Storage info pointer can't be NULL");
+
+    info->total_sectors = (uint32_t)(_disk_size / STORAGE_RAMDISK_SECTOR_SIZE);
+    info->sector_size = STORAGE_RAMDISK_SECTOR_SIZE;
+    return ESP_OK;
+}
+
+static void storage_ramdisk_close(void)
+{
+    heap_caps_free(_disk);
+    _disk = NULL;
+    _disk_size = 0;
+    _snapshot = NULL;
+}
+
+// Constant struct of function pointers
+const storage_medium_t ramdisk_medium = {
+    .type = STORAGE_MEDIUM_TYPE_RAMDISK,
+    .mount = &storage_ramdisk_mount,
+    .unmount = &storage_ramdisk_unmount,
+    .read = &storage_ramdisk_sector_read,
+    .write = &storage_ramdisk_sector_write,
+    .get_info = &storage_ramdisk_get_info,
+    .close = &storage_ramdisk_close,
+};
+
+esp_err_t storage_ramdisk_open_medium(size_t size, const esp_partition_t *snapshot_partition,
+                                      const storage_medium_t **medium, bool *restored)
+{
+    ESP_RETURN_ON_FALSE(size != 0 && (size % STORAGE_RAMDISK_SECTOR_SIZE) == 0, ESP_ERR_INVALID_ARG, TAG,
+                        "RAM disk size must be a non-zero multiple of %d", STORAGE_RAMDISK_SECTOR_SIZE);
+    ESP_RETURN_ON_FALSE(medium != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage API pointer can't be NULL");
+    ESP_RETURN_ON_FALSE(_disk == NULL, ESP_ERR_INVALID_STATE, TAG, "RAM disk is already open");
+
+    // Prefer PSRAM, internal RAM is usually too precious for a disk
+    _disk = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (_disk == NULL) {
+        _disk = heap_caps_calloc(1, size, MALLOC_CAP_8BIT);
+    }
+    ESP_RETURN_ON_FALSE(_disk != NULL, ESP_ERR_NO_MEM, TAG, "Failed to allocate %u bytes RAM disk", size);
+    _disk_size = size;
+    _snapshot = snapshot_partition;
+
+    bool loaded = false;
+    if (_snapshot != NULL) {
+        loaded = (storage_ramdisk_restore() == ESP_OK);
+        ESP_LOGD(TAG, "%s snapshot from '%s'", loaded ? "Loaded" : "No valid", _snapshot->label);
+    }
+    if (restored != NULL) {
+        *restored = loaded;
+    }
+
+    *medium = &ramdisk_medium;
+    return ESP_OK;
+}
@@ -70,6 +70,37 @@ static esp_err_t storage_sdmmc_sector_write(uint32_t lba, uint32_t offset, size_
     return sdmmc_write_sectors(_scard, src, lba, size / sector_size);
 }
 
+// Adjacent buffers go to the card as one multi-block transfer (CMD18/CMD25)
+static esp_err_t storage_sdmmc_sector_readv(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt)
+{
+    assert(_scard);
+    uint32_t sector_size = storage_sdmmc_get_sector_size();
+    while (iovcnt > 0) {
+        size_t size;
+        const size_t n = storage_iov_run(iov, iovcnt, &size);
+        ESP_RETURN_ON_ERROR(sdmmc_read_sectors(_scard, iov[0].base, lba, size / sector_size), TAG, "");
+        lba += size / sector_size;
+        iov += n;
+        iovcnt -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t storage_sdmmc_sector_writev(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt)
+{
+    assert(_scard);
+    uint32_t sector_size = storage_sdmmc_get_sector_size();
+    while (iovcnt > 0) {
+        size_t size;
+        const size_t n = storage_iov_run(iov, iovcnt, &size);
+        ESP_RETURN_ON_ERROR(sdmmc_write_sectors(_scard, iov[0].base, lba, size / sector_size), TAG, "");
+        lba += size / sector_size;
+        iov += n;
+        iovcnt -= n;
+    }
+    return ESP_OK;
+}
+
 static esp_err_t storage_sdmmc_get_info(storage_info_t *info)
 {
     ESP_RETURN_ON_FALSE(info, ESP_ERR_INVALID_ARG, TAG, "Storage info pointer can't be NULL");
@@ -91,6 +122,8 @@ const storage_medium_t sdmmc_storage_medium = {
     .unmount = &storage_sdmmc_unmount,
     .read = &storage_sdmmc_sector_read,
     .write = &storage_sdmmc_sector_write,
+    .readv = &storage_sdmmc_sector_readv,
+    .writev = &storage_sdmmc_sector_writev,
     .get_info = &storage_sdmmc_get_info,
     .close = &storage_sdmmc_close,
 };
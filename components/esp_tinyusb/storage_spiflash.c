@@ -5,6 +5,8 @@
  */
 
 #include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_check.h"
@@ -12,20 +14,491 @@
 #include "wear_levelling.h"
 #include "diskio_wl.h"
 #include "msc_storage.h"
+#include "storage_spiflash.h"
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "spi_flash_mmap.h"
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
 
 static const char *TAG = "storage_spiflash";
 
 static wl_handle_t _wl_handle = WL_INVALID_HANDLE; // Global variable to hold the wear-levelling handle
 
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+#define WEAR_BLOCK_SIZE         SPI_FLASH_SEC_SIZE                          /*!< Flash erase block */
+#define WEAR_HOT_LINES          CONFIG_TINYUSB_MSC_SPIFLASH_HOT_LINES
+#define WEAR_HOT_DELAY_US       (CONFIG_TINYUSB_MSC_SPIFLASH_HOT_DELAY_MS * 1000)
+#define WEAR_HEAT_STEP          16          /*!< Heat added by a write to a block */
+#define WEAR_HEAT_HOT           64          /*!< Heat from which a block is hot: 4 writes within a decay period */
+#define WEAR_HEAT_DECAY_WRITES  256         /*!< Writes between halvings of all heats */
+#define WEAR_FLUSH_TASK_STACK   3072
+#define WEAR_FLUSH_TASK_PRIO    2           /*!< Background write-back, below the MSC write worker */
+
+/**
+ * @brief Hot line, RAM image of one erase block taking the writes of a hot block
+ */
+typedef struct {
+    uint8_t *data;              /*!< Block image, WEAR_BLOCK_SIZE bytes */
+    uint32_t block;             /*!< Block held, valid only if `valid` is set */
+    uint32_t last_use;          /*!< Write sequence of the last access, for LRU eviction */
+    int64_t dirty_since;        /*!< Time of the first write not yet on flash */
+    bool valid;
+    bool dirty;
+} wear_line_t;
+
+static struct {
+    SemaphoreHandle_t lock;             // Serialises the MSC driver, the application and the flush task
+    StaticSemaphore_t lock_buf;         // Never deleted, the flush task may still take it
+    esp_timer_handle_t flush_timer;     // Wakes the flush task after WEAR_HOT_DELAY_US
+    TaskHandle_t flush_task;            // Writes hot lines back, never deleted: a late timer callback may still wake it
+    uint32_t blocks;                    // Erase blocks of the volume
+    uint16_t *erase_count;              // Erases per block, saturating
+    uint8_t *heat;                      // Recent writes per block, decayed
+    uint32_t meta_blocks;               // Blocks holding the boot sector, FATs and root directory
+    bool meta_stale;                    // Boot sector was written, meta_blocks must be re-read
+    uint32_t write_seq;                 // Block writes, drives LRU and heat decay
+    wear_line_t lines[WEAR_HOT_LINES > 0 ? WEAR_HOT_LINES : 1];
+    tinyusb_msc_wear_stats_t stats;
+    BYTE pdrv;                          // FatFs drive, while mounted to the application
+} s_wear = {
+    .pdrv = 0xFF,
+};
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+
+static size_t storage_spiflash_get_sector_count(void)
+{
+    assert(_wl_handle != WL_INVALID_HANDLE);
+    size_t result = 0;
+    size_t size = wl_sector_size(_wl_handle);
+    if (size == 0) {
+        result = 0;
+    } else {
+        result = (size_t)(wl_size(_wl_handle) / size);
+    }
+    return result;
+}
+
+static size_t storage_spiflash_get_sector_size(void)
+{
+    assert(_wl_handle != WL_INVALID_HANDLE);
+    return (size_t)wl_sector_size(_wl_handle);
+}
+
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+// ============================================================================
+// Wear tracking and hot/cold separation
+//
+// Wear levelling owns the physical placement, so hot blocks are separated on
+// the write path instead: FAT metadata and recently rewritten blocks collect
+// their writes in RAM lines and reach the flash as one erase per block, cold
+// data goes straight through.
+// ============================================================================
+
+static inline uint16_t wear_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t wear_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Copy pending hot line data over a range read from the flash
+ */
+static void wear_overlay(size_t addr, uint8_t *dest, size_t size)
+{
+    for (int i = 0; i < WEAR_HOT_LINES; i++) {
+        const wear_line_t *line = &s_wear.lines[i];
+        if (!line->valid) {
+            continue;
+        }
+        const size_t start = (size_t)line->block * WEAR_BLOCK_SIZE;
+        const size_t lo = MAX(start, addr);
+        const size_t hi = MIN(start + WEAR_BLOCK_SIZE, addr + size);
+        if (lo < hi) {
+            memcpy(dest + (lo - addr), line->data + (lo - start), hi - lo);
+        }
+    }
+}
+
+static esp_err_t wear_read(size_t addr, void *dest, size_t size)
+{
+    ESP_RETURN_ON_ERROR(wl_read(_wl_handle, addr, dest, size), TAG, "Failed to read");
+    wear_overlay(addr, dest, size);
+    return ESP_OK;
+}
+
+/**
+ * @brief Find the blocks holding the boot sector, FATs and root directory
+ *
+ * @return Number of metadata blocks from the start of the volume, 0 if the volume isn't formatted
+ */
+static uint32_t wear_meta_blocks(void)
+{
+    const size_t ss = storage_spiflash_get_sector_size();
+    uint8_t *sec = heap_caps_malloc(ss, MALLOC_CAP_8BIT);
+    uint32_t blocks = 0;
+    uint32_t base = 0;
+
+    if (sec == NULL || wear_read(0, sec, ss) != ESP_OK || sec[510] != 0x55 || sec[511] != 0xAA) {
+        goto done;
+    }
+    if (sec[0] != 0xEB && sec[0] != 0xE9) {
+        // Partitioned volume, follow the first MBR entry
+        base = wear_le32(sec + 446 + 8);
+        if (base == 0 || wear_read((size_t)base * ss, sec, ss) != ESP_OK || sec[510] != 0x55 || sec[511] != 0xAA) {
+            goto done;
+        }
+    }
+    if (wear_le16(sec + 11) != ss) {
+        goto done;
+    }
+    const uint32_t fat_size = wear_le16(sec + 22) ? wear_le16(sec + 22) : wear_le32(sec + 36);
+    const uint32_t root_sectors = ((uint32_t)wear_le16(sec + 17) * 32 + ss - 1) / ss;
+    const uint64_t end = (uint64_t)base + wear_le16(sec + 14) + (uint64_t)sec[16] * fat_size + root_sectors;
+    blocks = (uint32_t)MIN((end * ss + WEAR_BLOCK_SIZE - 1) / WEAR_BLOCK_SIZE, s_wear.blocks);
+
+done:
+    free(sec);
+    return blocks;
+}
+
+static void wear_heat(uint32_t block)
+{
+    s_wear.heat[block] = (uint8_t)MIN(s_wear.heat[block] + WEAR_HEAT_STEP, UINT8_MAX);
+    if (++s_wear.write_seq % WEAR_HEAT_DECAY_WRITES == 0) {
+        for (uint32_t b = 0; b < s_wear.blocks; b++) {
+            s_wear.heat[b] >>= 1;
+        }
+    }
+}
+
+static bool wear_is_hot(uint32_t block)
+{
+    if (s_wear.meta_stale) {
+        s_wear.meta_blocks = wear_meta_blocks();
+        s_wear.meta_stale = false;
+    }
+    return block < s_wear.meta_blocks || s_wear.heat[block] >= WEAR_HEAT_HOT;
+}
+
+static void wear_count_erases(uint32_t block, uint32_t erases, bool partial)
+{
+    s_wear.erase_count[block] = (uint16_t)MIN((uint32_t)s_wear.erase_count[block] + erases, UINT16_MAX);
+    s_wear.stats.erase_total += erases;
+    if (partial) {
+        s_wear.stats.partial_erases += erases;
+    }
+}
+
+static esp_err_t wear_line_flush(wear_line_t *line)
+{
+    if (!line->dirty) {
+        return ESP_OK;
+    }
+    const size_t addr = (size_t)line->block * WEAR_BLOCK_SIZE;
+    ESP_RETURN_ON_ERROR(wl_erase_range(_wl_handle, addr, WEAR_BLOCK_SIZE), TAG, "Failed to erase block %"PRIu32, line->block);
+    ESP_RETURN_ON_ERROR(wl_write(_wl_handle, addr, line->data, WEAR_BLOCK_SIZE), TAG, "Failed to write block %"PRIu32, line->block);
+    wear_count_erases(line->block, 1, false);
+    line->dirty = false;
+    return ESP_OK;
+}
+
+/**
+ * @brief Write hot lines back to the flash
+ *
+ * @param[in] all Write all dirty lines, otherwise only the ones older than the hot delay
+ */
+static esp_err_t wear_flush(bool all)
+{
+    const int64_t now = esp_timer_get_time();
+    esp_err_t ret = ESP_OK;
+    bool pending = false;
+
+    for (int i = 0; i < WEAR_HOT_LINES; i++) {
+        wear_line_t *line = &s_wear.lines[i];
+        if (line->dirty && (all || now - line->dirty_since >= WEAR_HOT_DELAY_US)) {
+            esp_err_t err = wear_line_flush(line);
+            ret = (ret == ESP_OK) ? err : ret;
+        }
+        pending |= line->dirty;
+    }
+    if (pending && s_wear.flush_timer != NULL && !esp_timer_is_active(s_wear.flush_timer)) {
+        esp_timer_start_once(s_wear.flush_timer, WEAR_HOT_DELAY_US);
+    }
+    return ret;
+}
+
+// An erase and program take tens of milliseconds, too long for the esp_timer task: hand them to the flush task
+static void wear_flush_timer_cb(void *arg)
+{
+    xTaskNotifyGive(s_wear.flush_task);
+}
+
+static void wear_flush_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+        // Nothing is dirty once the storage is closed
+        if (wear_flush(false) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to write hot blocks back");
+        }
+        xSemaphoreGive(s_wear.lock);
+    }
+}
+
+/**
+ * @brief Get the hot line of a block, loading the block into the least recently used line if needed
+ *
+ * @param[in] block Block to hold
+ * @param[in] overwrite The whole block is about to be written, don't read it
+ * @param[out] out Line holding the block
+ */
+static esp_err_t wear_line_get(uint32_t block, bool overwrite, wear_line_t **out)
+{
+    wear_line_t *victim = &s_wear.lines[0];
+
+    for (int i = 0; i < WEAR_HOT_LINES; i++) {
+        wear_line_t *line = &s_wear.lines[i];
+        if (line->valid && line->block == block) {
+            *out = line;
+            return ESP_OK;
+        }
+        if (!line->valid || (victim->valid && line->last_use < victim->last_use)) {
+            victim = line;
+        }
+    }
+    ESP_RETURN_ON_ERROR(wear_line_flush(victim), TAG, "Failed to evict block %"PRIu32, victim->block);
+    victim->valid = false;
+    if (!overwrite) {
+        ESP_RETURN_ON_ERROR(wl_read(_wl_handle, (size_t)block * WEAR_BLOCK_SIZE, victim->data, WEAR_BLOCK_SIZE),
+                            TAG, "Failed to load block %"PRIu32, block);
+    }
+    victim->block = block;
+    victim->valid = true;
+    *out = victim;
+    return ESP_OK;
+}
+
+static esp_err_t wear_write_through(size_t addr, const uint8_t *src, size_t size)
+{
+    const size_t ss = storage_spiflash_get_sector_size();
+
+    ESP_RETURN_ON_ERROR(wl_erase_range(_wl_handle, addr, size), TAG, "Failed to erase");
+    ESP_RETURN_ON_ERROR(wl_write(_wl_handle, addr, src, size), TAG, "Failed to write");
+    // A partially written block is erased once per sector, each erase copies the rest of the block
+    for (size_t pos = addr; pos < addr + size;) {
+        const uint32_t block = pos / WEAR_BLOCK_SIZE;
+        const size_t end = MIN((size_t)(block + 1) * WEAR_BLOCK_SIZE, addr + size);
+        const bool full = (pos % WEAR_BLOCK_SIZE) == 0 && end - pos == WEAR_BLOCK_SIZE;
+        wear_count_erases(block, full ? 1 : (uint32_t)((end - 1) / ss - pos / ss + 1), !full);
+        pos = end;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t wear_write(size_t addr, const uint8_t *src, size_t size)
+{
+    size_t cold_addr = addr;
+    size_t cold_size = 0;
+
+    while (size > 0) {
+        const uint32_t block = addr / WEAR_BLOCK_SIZE;
+        const size_t offset = addr % WEAR_BLOCK_SIZE;
+        const size_t chunk = MIN(size, WEAR_BLOCK_SIZE - offset);
+
+        if (block == 0) {
+            s_wear.meta_stale = true;
+        }
+        wear_heat(block);
+        if (WEAR_HOT_LINES > 0 && wear_is_hot(block)) {
+            // Cold run before this block goes out first, keeping the write order
+            if (cold_size > 0) {
+                ESP_RETURN_ON_ERROR(wear_write_through(cold_addr, src - cold_size, cold_size), TAG, "Failed to write cold data");
+                cold_size = 0;
+            }
+            wear_line_t *line;
+            ESP_RETURN_ON_ERROR(wear_line_get(block, chunk == WEAR_BLOCK_SIZE, &line), TAG, "No hot line");
+            memcpy(line->data + offset, src, chunk);
+            line->last_use = s_wear.write_seq;
+            if (line->dirty) {
+                s_wear.stats.coalesced_writes++;
+            } else {
+                line->dirty = true;
+                line->dirty_since = esp_timer_get_time();
+            }
+        } else {
+            // A block held by a line stays there until written back, keep the line current
+            for (int i = 0; i < WEAR_HOT_LINES; i++) {
+                if (s_wear.lines[i].valid && s_wear.lines[i].block == block) {
+                    memcpy(s_wear.lines[i].data + offset, src, chunk);
+                }
+            }
+            if (cold_size == 0) {
+                cold_addr = addr;
+            }
+            cold_size += chunk;
+        }
+        addr += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+    if (cold_size > 0) {
+        ESP_RETURN_ON_ERROR(wear_write_through(cold_addr, src - cold_size, cold_size), TAG, "Failed to write cold data");
+    }
+    return wear_flush(false);
+}
+
+// ============================================================================
+// FatFs diskio, used instead of the wear levelling one to see application writes
+// ============================================================================
+
+static DSTATUS spiflash_disk_status(BYTE pdrv)
+{
+    return (_wl_handle != WL_INVALID_HANDLE) ? 0 : STA_NOINIT;
+}
+
+static DRESULT spiflash_disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    const size_t ss = storage_spiflash_get_sector_size();
+    xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+    esp_err_t ret = wear_read((size_t)sector * ss, buff, (size_t)count * ss);
+    xSemaphoreGive(s_wear.lock);
+    return (ret == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT spiflash_disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    const size_t ss = storage_spiflash_get_sector_size();
+    xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+    esp_err_t ret = wear_write((size_t)sector * ss, buff, (size_t)count * ss);
+    xSemaphoreGive(s_wear.lock);
+    return (ret == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT spiflash_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    esp_err_t ret;
+
+    switch (cmd) {
+    case CTRL_SYNC:
+        xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+        ret = wear_flush(true);
+        xSemaphoreGive(s_wear.lock);
+        return (ret == ESP_OK) ? RES_OK : RES_ERROR;
+    case GET_SECTOR_COUNT:
+        *((DWORD *) buff) = storage_spiflash_get_sector_count();
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *) buff) = storage_spiflash_get_sector_size();
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *((DWORD *) buff) = 1;
+        return RES_OK;
+    }
+    return RES_ERROR;
+}
+
+static const ff_diskio_impl_t spiflash_disk_impl = {
+    .init = &spiflash_disk_status,
+    .status = &spiflash_disk_status,
+    .read = &spiflash_disk_read,
+    .write = &spiflash_disk_write,
+    .ioctl = &spiflash_disk_ioctl,
+};
+
+static void wear_free(void)
+{
+    if (s_wear.flush_timer != NULL) {
+        esp_timer_stop(s_wear.flush_timer);
+        esp_timer_delete(s_wear.flush_timer);
+        s_wear.flush_timer = NULL;
+    }
+    for (int i = 0; i < WEAR_HOT_LINES; i++) {
+        free(s_wear.lines[i].data);
+        s_wear.lines[i].data = NULL;
+        s_wear.lines[i].valid = false;
+        s_wear.lines[i].dirty = false;
+    }
+    free(s_wear.erase_count);
+    free(s_wear.heat);
+    s_wear.erase_count = NULL;
+    s_wear.heat = NULL;
+}
+
+static esp_err_t wear_init(void)
+{
+    esp_err_t ret = ESP_OK;
+
+    memset(&s_wear.stats, 0, sizeof(s_wear.stats));
+    s_wear.write_seq = 0;
+    s_wear.blocks = (uint32_t)((wl_size(_wl_handle) + WEAR_BLOCK_SIZE - 1) / WEAR_BLOCK_SIZE);
+    s_wear.erase_count = heap_caps_calloc(s_wear.blocks, sizeof(uint16_t), MALLOC_CAP_8BIT);
+    s_wear.heat = heap_caps_calloc(s_wear.blocks, sizeof(uint8_t), MALLOC_CAP_8BIT);
+    if (s_wear.lock == NULL) {
+        s_wear.lock = xSemaphoreCreateMutexStatic(&s_wear.lock_buf);
+    }
+    if (s_wear.flush_task == NULL) {
+        ESP_GOTO_ON_FALSE(xTaskCreate(wear_flush_task, "msc_hot_flush", WEAR_FLUSH_TASK_STACK, NULL, WEAR_FLUSH_TASK_PRIO,
+                                      &s_wear.flush_task) == pdPASS, ESP_ERR_NO_MEM, fail, TAG, "Failed to create flush task");
+    }
+    ESP_GOTO_ON_FALSE(s_wear.erase_count && s_wear.heat, ESP_ERR_NO_MEM, fail, TAG, "Failed to allocate wear counters");
+    for (int i = 0; i < WEAR_HOT_LINES; i++) {
+        s_wear.lines[i].data = heap_caps_malloc(WEAR_BLOCK_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        ESP_GOTO_ON_FALSE(s_wear.lines[i].data, ESP_ERR_NO_MEM, fail, TAG, "Failed to allocate hot lines");
+    }
+    const esp_timer_create_args_t timer_args = {
+        .callback = wear_flush_timer_cb,
+        .name = "msc_hot_flush",
+    };
+    ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &s_wear.flush_timer), fail, TAG, "Failed to create flush timer");
+    s_wear.meta_blocks = wear_meta_blocks();
+    s_wear.meta_stale = false;
+    ESP_LOGD(TAG, "%"PRIu32" erase blocks, %"PRIu32" metadata blocks", s_wear.blocks, s_wear.meta_blocks);
+    return ESP_OK;
+
+fail:
+    wear_free();
+    return ret;
+}
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+
 static esp_err_t storage_spiflash_mount(BYTE pdrv)
 {
     assert(_wl_handle != WL_INVALID_HANDLE);
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+    ff_diskio_register(pdrv, &spiflash_disk_impl);
+    s_wear.pdrv = pdrv;
+    return ESP_OK;
+#else
     return ff_diskio_register_wl_partition(pdrv, _wl_handle);
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
 }
 
 static esp_err_t storage_spiflash_unmount(void)
 {
     assert(_wl_handle != WL_INVALID_HANDLE);
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+    if (s_wear.pdrv == 0xFF) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    char drv[3] = {(char)('0' + s_wear.pdrv), ':', 0};
+    f_mount(0, drv, 0);
+    ff_diskio_unregister(s_wear.pdrv);
+    s_wear.pdrv = 0xFF;
+
+    xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+    esp_err_t ret = wear_flush(true);
+    xSemaphoreGive(s_wear.lock);
+    return ret;
+#else
     BYTE pdrv;
     pdrv = ff_diskio_get_pdrv_wl(_wl_handle);
     if (pdrv == 0xff) {
@@ -38,25 +511,7 @@ static esp_err_t storage_spiflash_unmount(void)
     ff_diskio_unregister(pdrv);
 
     return ESP_OK;
-}
-
-static size_t storage_spiflash_get_sector_count(void)
-{
-    assert(_wl_handle != WL_INVALID_HANDLE);
-    size_t result = 0;
-    size_t size = wl_sector_size(_wl_handle);
-    if (size == 0) {
-        result = 0;
-    } else {
-        result = (size_t)(wl_size(_wl_handle) / size);
-    }
-    return result;
-}
-
-static size_t storage_spiflash_get_sector_size(void)
-{
-    assert(_wl_handle != WL_INVALID_HANDLE);
-    return (size_t)wl_sector_size(_wl_handle);
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
 }
 
 static esp_err_t storage_spiflash_sector_read(uint32_t lba, uint32_t offset, size_t size, void *dest)
@@ -69,7 +524,14 @@ static esp_err_t storage_spiflash_sector_read(uint32_t lba, uint32_t offset, siz
     ESP_RETURN_ON_FALSE(!__builtin_umul_overflow(lba, sector_size, &temp), ESP_ERR_INVALID_SIZE, TAG, "overflow lba %lu sector_size %u", lba, sector_size);
     ESP_RETURN_ON_FALSE(!__builtin_uadd_overflow(temp, offset, &addr), ESP_ERR_INVALID_SIZE, TAG, "overflow addr %u offset %lu", temp, offset);
 
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+    xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+    esp_err_t ret = wear_read(addr, dest, size);
+    xSemaphoreGive(s_wear.lock);
+    return ret;
+#else
     return wl_read(_wl_handle, addr, dest, size);
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
 }
 
 static esp_err_t storage_spiflash_sector_write(uint32_t lba, uint32_t offset, size_t size, const void *src)
@@ -84,11 +546,62 @@ static esp_err_t storage_spiflash_sector_write(uint32_t lba, uint32_t offset, si
 
     ESP_RETURN_ON_FALSE(!__builtin_umul_overflow(lba, sector_size, &temp), ESP_ERR_INVALID_SIZE, TAG, "overflow lba %lu sector_size %u", lba, sector_size);
     ESP_RETURN_ON_FALSE(!__builtin_uadd_overflow(temp, offset, &addr), ESP_ERR_INVALID_SIZE, TAG, "overflow addr %u offset %lu", temp, offset);
+
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+    xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+    const int64_t start = esp_timer_get_time();
+    esp_err_t ret = wear_write(addr, src, size);
+    s_wear.stats.max_write_us = MAX(s_wear.stats.max_write_us, (uint32_t)(esp_timer_get_time() - start));
+    xSemaphoreGive(s_wear.lock);
+    return ret;
+#else
     ESP_RETURN_ON_ERROR(wl_erase_range(_wl_handle, addr, size), TAG, "Failed to erase");
 
     return wl_write(_wl_handle, addr, src, size);
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
 }
 
+// Adjacent buffers are read as one contiguous range
+static esp_err_t storage_spiflash_sector_readv(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt)
+{
+    size_t sector_size = storage_spiflash_get_sector_size();
+    while (iovcnt > 0) {
+        size_t size;
+        const size_t n = storage_iov_run(iov, iovcnt, &size);
+        ESP_RETURN_ON_ERROR(storage_spiflash_sector_read(lba, 0, size, iov[0].base), TAG, "");
+        lba += size / sector_size;
+        iov += n;
+        iovcnt -= n;
+    }
+    return ESP_OK;
+}
+
+// Adjacent buffers are erased and programmed as one contiguous range
+static esp_err_t storage_spiflash_sector_writev(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt)
+{
+    size_t sector_size = storage_spiflash_get_sector_size();
+    while (iovcnt > 0) {
+        size_t size;
+        const size_t n = storage_iov_run(iov, iovcnt, &size);
+        ESP_RETURN_ON_ERROR(storage_spiflash_sector_write(lba, 0, size, iov[0].base), TAG, "");
+        lba += size / sector_size;
+        iov += n;
+        iovcnt -= n;
+    }
+    return ESP_OK;
+}
+
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+// SYNCHRONIZE CACHE from the host: hot lines are written now instead of after the delay
+static esp_err_t storage_spiflash_sync(void)
+{
+    xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+    esp_err_t ret = wear_flush(true);
+    xSemaphoreGive(s_wear.lock);
+    return ret;
+}
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+
 static esp_err_t storage_spiflash_get_info(storage_info_t *info)
 {
     ESP_RETURN_ON_FALSE(info, ESP_ERR_INVALID_ARG, TAG, "Storage info pointer can't be NULL");
@@ -101,6 +614,14 @@ static esp_err_t storage_spiflash_get_info(storage_info_t *info)
 
 static void storage_spiflash_close(void)
 {
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+    xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+    if (wear_flush(true) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write hot blocks back on close");
+    }
+    wear_free();
+    xSemaphoreGive(s_wear.lock);
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
     _wl_handle = WL_INVALID_HANDLE; // Reset the global wear-levelling handle
 }
 
@@ -111,6 +632,11 @@ const storage_medium_t spiflash_medium = {
     .unmount = &storage_spiflash_unmount,
     .read = &storage_spiflash_sector_read,
     .write = &storage_spiflash_sector_write,
+    .readv = &storage_spiflash_sector_readv,
+    .writev = &storage_spiflash_sector_writev,
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+    .sync = &storage_spiflash_sync,
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
     .get_info = &storage_spiflash_get_info,
     .close = &storage_spiflash_close,
 };
@@ -121,7 +647,41 @@ esp_err_t storage_spiflash_open_medium(wl_handle_t wl_handle, const storage_medi
     ESP_RETURN_ON_FALSE(medium != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage API pointer can't be NULL");
 
     _wl_handle = wl_handle;
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+    esp_err_t ret = wear_init();
+    if (ret != ESP_OK) {
+        _wl_handle = WL_INVALID_HANDLE;
+        return ret;
+    }
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
     *medium = &spiflash_medium;
 
     return ESP_OK;
 }
+
+esp_err_t storage_spiflash_get_wear_stats(tinyusb_msc_wear_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "Stats pointer can't be NULL");
+#if CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+    ESP_RETURN_ON_FALSE(_wl_handle != WL_INVALID_HANDLE, ESP_ERR_INVALID_STATE, TAG, "SPI Flash medium is not open");
+
+    xSemaphoreTake(s_wear.lock, portMAX_DELAY);
+    *stats = s_wear.stats;
+    stats->erase_blocks = s_wear.blocks;
+    stats->metadata_blocks = s_wear.meta_blocks;
+    stats->erase_count_min = UINT16_MAX;
+    stats->erase_count_max = 0;
+    stats->hot_blocks = 0;
+    for (uint32_t b = 0; b < s_wear.blocks; b++) {
+        stats->erase_count_min = MIN(stats->erase_count_min, s_wear.erase_count[b]);
+        stats->erase_count_max = MAX(stats->erase_count_max, s_wear.erase_count[b]);
+        if (b < s_wear.meta_blocks || s_wear.heat[b] >= WEAR_HEAT_HOT) {
+            stats->hot_blocks++;
+        }
+    }
+    xSemaphoreGive(s_wear.lock);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif // CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+}
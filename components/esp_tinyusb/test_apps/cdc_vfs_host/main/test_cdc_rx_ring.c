@@ -0,0 +1,157 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+//
+#include "unity.h"
+//
+#include "cdc_rx_ring.h"
+
+#define TEST_RING_SIZE      1024                // Span buffer of the test cases
+#define TEST_PACKET_MAX     64                  // Full-speed bulk packet
+#define TEST_STREAM_SIZE    (16 * 1024 * 1024)  // Bytes through the ring in the threaded case
+
+static inline uint8_t test_byte(size_t i)
+{
+    return (uint8_t)(i * 131 + (i >> 11));
+}
+
+/**
+ * @brief Test case for the ring spans
+ *
+ * Scenario:
+ * 1. Write packets of random size into the free space, as the RX callback does, and consume random amounts.
+ * 2. The data must come out in order, every span must be within the storage and never exceed the used bytes.
+ * 3. A full ring must have no free space, an empty ring no data.
+ */
+TEST_CASE("CDC: RX span ring", "[cdc][ci]")
+{
+    cdc_rx_ring_t ring;
+    TEST_ASSERT_FALSE(cdc_rx_ring_init(&ring, 1000));
+    TEST_ASSERT_TRUE(cdc_rx_ring_init(&ring, TEST_RING_SIZE));
+
+    size_t written = 0;
+    size_t read = 0;
+    size_t wrapped = 0;
+    while (read < 1024 * 1024) {
+        // Producer: one packet, in up to two spans
+        size_t packet = 1 + rand() % TEST_PACKET_MAX;
+        while (packet > 0) {
+            uint8_t *span;
+            const size_t space = cdc_rx_ring_write_span(&ring, &span);
+            if (space == 0) {
+                TEST_ASSERT_EQUAL(TEST_RING_SIZE, cdc_rx_ring_used(&ring));
+                break;
+            }
+            const size_t n = (packet < space) ? packet : space;
+            for (size_t i = 0; i < n; i++) {
+                span[i] = test_byte(written + i);
+            }
+            cdc_rx_ring_commit(&ring, n);
+            written += n;
+            packet -= n;
+        }
+
+        // Consumer: a random part of the data in place
+        size_t want = rand() % (2 * TEST_PACKET_MAX);
+        const uint8_t *span;
+        size_t len;
+        while (want > 0 && (len = cdc_rx_ring_peek(&ring, &span)) > 0) {
+            TEST_ASSERT_TRUE(span >= ring.buf && span + len <= ring.buf + TEST_RING_SIZE);
+            TEST_ASSERT_LESS_OR_EQUAL(cdc_rx_ring_used(&ring), len);
+            if (len < cdc_rx_ring_used(&ring)) {
+                wrapped++;
+            }
+            len = (len < want) ? len : want;
+            for (size_t i = 0; i < len; i++) {
+                TEST_ASSERT_EQUAL_HEX8(test_byte(read + i), span[i]);
+            }
+            cdc_rx_ring_consume(&ring, len);
+            read += len;
+            want -= len;
+        }
+        TEST_ASSERT_EQUAL(written - read, cdc_rx_ring_used(&ring));
+    }
+    TEST_ASSERT_GREATER_THAN(0, wrapped);
+
+    const uint8_t *span;
+    cdc_rx_ring_consume(&ring, cdc_rx_ring_used(&ring));
+    TEST_ASSERT_EQUAL(0, cdc_rx_ring_peek(&ring, &span));
+    cdc_rx_ring_free(&ring);
+}
+
+static void *test_producer(void *arg)
+{
+    cdc_rx_ring_t *ring = arg;
+    size_t written = 0;
+    while (written < TEST_STREAM_SIZE) {
+        uint8_t *span;
+        size_t n = cdc_rx_ring_write_span(ring, &span);
+        if (n == 0) {
+            sched_yield();
+            continue;
+        }
+        if (n > TEST_PACKET_MAX) {
+            n = TEST_PACKET_MAX;
+        }
+        if (n > TEST_STREAM_SIZE - written) {
+            n = TEST_STREAM_SIZE - written;
+        }
+        for (size_t i = 0; i < n; i++) {
+            span[i] = test_byte(written + i);
+        }
+        cdc_rx_ring_commit(ring, n);
+        written += n;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Test case for the ring between two threads
+ *
+ * The producer thread writes packets as the TinyUSB task does, the consumer checks the data in place without taking
+ * a lock. Reports the throughput of the ring alone.
+ */
+TEST_CASE("CDC: RX span ring across threads", "[cdc][ci]")
+{
+    cdc_rx_ring_t ring;
+    TEST_ASSERT_TRUE(cdc_rx_ring_init(&ring, TEST_RING_SIZE));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t producer;
+    TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, test_producer, &ring));
+
+    size_t read = 0;
+    size_t errors = 0;
+    while (read < TEST_STREAM_SIZE) {
+        const uint8_t *span;
+        const size_t len = cdc_rx_ring_peek(&ring, &span);
+        if (len == 0) {
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < len; i++) {
+            errors += (span[i] != test_byte(read + i));
+        }
+        cdc_rx_ring_consume(&ring, len);
+        read += len;
+    }
+    pthread_join(producer, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    TEST_ASSERT_EQUAL(0, errors);
+    TEST_ASSERT_EQUAL(0, cdc_rx_ring_used(&ring));
+    const double s = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("RX span ring: %.1f MB/s between two threads\n", TEST_STREAM_SIZE / s / 1e6);
+    cdc_rx_ring_free(&ring);
+}
@@ -0,0 +1,331 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/param.h>
+//
+#include "unity.h"
+//
+#include "vfs_tinyusb_eol.h"
+
+#define TEST_TEXT_SIZE      (1024 * 1024)   // Console output translated by each run
+#define TEST_BENCH_ROUNDS   16              // Runs per measurement
+
+/**
+ * @brief Line endings of the CDC VFS driver
+ */
+static const struct {
+    const char *name;
+    const char *eol;
+} test_modes[] = {
+    { "CRLF", "\r\n" },
+    { "CR", "\r" },
+    { "LF", "\n" },
+};
+
+/**
+ * @brief Sink copying to a buffer, as the TX FIFO does
+ */
+typedef struct {
+    char *buf;
+    size_t len;
+} test_sink_t;
+
+static void test_sink_copy(void *ctx, const char *data, size_t size)
+{
+    test_sink_t *sink = (test_sink_t *)ctx;
+    memcpy(sink->buf + sink->len, data, size);
+    sink->len += size;
+}
+
+// Called once per character, as tinyusb_cdcacm_write_queue_char() was
+static __attribute__((noinline)) void test_sink_char(test_sink_t *sink, char c)
+{
+    sink->buf[sink->len++] = c;
+}
+
+/**
+ * @brief Translation as the CDC VFS driver did it before, one character at a time
+ */
+static size_t test_eol_tx_per_char(const char *src, size_t size, const char *eol, test_sink_t *sink)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (src[i] != '\n') {
+            test_sink_char(sink, src[i]);
+        } else {
+            for (const char *e = eol; *e; e++) {
+                test_sink_char(sink, *e);
+            }
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Console output: log lines of 8 to 120 characters, some empty lines
+ */
+static char *test_text(size_t size)
+{
+    char *text = malloc(size);
+    TEST_ASSERT_NOT_NULL(text);
+    uint32_t x = 1;
+    size_t line = 0;
+    for (size_t i = 0; i < size; i++) {
+        x = x * 1103515245 + 12345;
+        if (line == 0) {
+            line = (x >> 16) % 8 == 0 ? 1 : 8 + (x >> 16) % 113;
+        }
+        text[i] = (--line == 0) ? '\n' : (char)(' ' + (x >> 20) % 95);
+    }
+    return text;
+}
+
+static double test_elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+TEST_CASE("VFS: newline search matches memchr", "[vfs][ci]")
+{
+    char buf[80];
+    for (int round = 0; round < 2000; round++) {
+        const size_t len = rand() % 64;
+        const size_t start = rand() % 8;
+        for (size_t i = 0; i < sizeof(buf); i++) {
+            buf[i] = (rand() % 16 == 0) ? '\n' : (char)(rand() % 256);
+        }
+        const char *p = buf + start;
+        const char *end = p + len;
+        const char *expected = memchr(p, '\n', len);
+        TEST_ASSERT_EQUAL_PTR(expected ? expected : end, vfs_tusb_eol_find(p, end, '\n'));
+        // Bytes with the high bit set must not match a character without it
+        expected = memchr(p, '\r', len);
+        TEST_ASSERT_EQUAL_PTR(expected ? expected : end, vfs_tusb_eol_find(p, end, '\r'));
+    }
+}
+
+/**
+ * @brief Test case for the TX line ending translation
+ *
+ * Scenario:
+ * 1. Translate console output with the per-character reference, for each line ending.
+ * 2. Translate it with vfs_tusb_eol_tx() at once, the result must be the same.
+ * 3. Translate it into a small, random space per call, like a TX FIFO that is emptied in between.
+ *    Every call must consume as much as fits, never a part of a line ending.
+ */
+TEST_CASE("VFS: TX line ending translation", "[vfs][ci]")
+{
+    const size_t size = 64 * 1024;
+    char *text = test_text(size);
+    test_sink_t ref = { .buf = malloc(2 * size) };
+    test_sink_t out = { .buf = malloc(2 * size) };
+    TEST_ASSERT_NOT_NULL(ref.buf);
+    TEST_ASSERT_NOT_NULL(out.buf);
+
+    for (size_t m = 0; m < sizeof(test_modes) / sizeof(test_modes[0]); m++) {
+        const char *eol = test_modes[m].eol;
+        ref.len = 0;
+        test_eol_tx_per_char(text, size, eol, &ref);
+
+        out.len = 0;
+        TEST_ASSERT_EQUAL(size, vfs_tusb_eol_tx(text, size, eol, 2 * size, test_sink_copy, &out));
+        TEST_ASSERT_EQUAL(ref.len, out.len);
+        TEST_ASSERT_EQUAL_MEMORY(ref.buf, out.buf, ref.len);
+
+        out.len = 0;
+        size_t done = 0;
+        while (done < size) {
+            const size_t space = rand() % 70;
+            const size_t before = out.len;
+            const size_t n = vfs_tusb_eol_tx(text + done, size - done, eol, space, test_sink_copy, &out);
+            TEST_ASSERT_LESS_OR_EQUAL(space, out.len - before);
+            // Stops early only if a whole line ending doesn't fit
+            if (out.len - before + strlen(eol) <= space) {
+                TEST_ASSERT_EQUAL(size - done, n);
+            }
+            done += n;
+        }
+        TEST_ASSERT_EQUAL(ref.len, out.len);
+        TEST_ASSERT_EQUAL_MEMORY(ref.buf, out.buf, ref.len);
+    }
+    free(text);
+    free(ref.buf);
+    free(out.buf);
+}
+
+/**
+ * @brief Throughput of the TX line ending translation
+ *
+ * Console output goes through the per-character reference and through vfs_tusb_eol_tx(), into a buffer as large
+ * as the output. The USB transfer itself is not part of the measurement.
+ */
+TEST_CASE("VFS: TX line ending translation throughput", "[vfs][ci]")
+{
+    char *text = test_text(TEST_TEXT_SIZE);
+    test_sink_t out = { .buf = malloc(2 * TEST_TEXT_SIZE) };
+    TEST_ASSERT_NOT_NULL(out.buf);
+
+    printf("Mode   per-char MB/s   bulk MB/s\n");
+    for (size_t m = 0; m < sizeof(test_modes) / sizeof(test_modes[0]); m++) {
+        const char *eol = test_modes[m].eol;
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < TEST_BENCH_ROUNDS; r++) {
+            out.len = 0;
+            test_eol_tx_per_char(text, TEST_TEXT_SIZE, eol, &out);
+        }
+        const double per_char = TEST_BENCH_ROUNDS * (double)TEST_TEXT_SIZE / test_elapsed_s(&start) / 1e6;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < TEST_BENCH_ROUNDS; r++) {
+            out.len = 0;
+            vfs_tusb_eol_tx(text, TEST_TEXT_SIZE, eol, 2 * TEST_TEXT_SIZE, test_sink_copy, &out);
+        }
+        const double bulk = TEST_BENCH_ROUNDS * (double)TEST_TEXT_SIZE / test_elapsed_s(&start) / 1e6;
+
+        printf("%-6s %13.1f %11.1f\n", test_modes[m].name, per_char, bulk);
+    }
+    free(text);
+    free(out.buf);
+}
+
+// Called once per character, as tud_cdc_n_read_char() was
+static __attribute__((noinline)) int test_source_char(const char *src, size_t size, size_t *pos)
+{
+    return (*pos < size) ? (uint8_t)src[(*pos)++] : -1;
+}
+
+/**
+ * @brief Translation of received data as the CDC VFS driver did it before, one character at a time
+ */
+static size_t test_eol_rx_per_char(const char *src, size_t size, const char *eol, char *dst)
+{
+    size_t len = 0;
+    size_t pos = 0;
+    int c;
+    while ((c = test_source_char(src, size, &pos)) != -1) {
+        if (c == '\r' && strcmp(eol, "\r") == 0) {
+            c = '\n';
+        } else if (c == '\r' && strcmp(eol, "\r\n") == 0 && pos < size && src[pos] == '\n') {
+            c = test_source_char(src, size, &pos);
+        }
+        dst[len++] = (char)c;
+    }
+    return len;
+}
+
+/**
+ * @brief Received data: console output with the line ending and stray CRs
+ */
+static char *test_rx_text(const char *text, size_t size, const char *eol, size_t *rx_size)
+{
+    test_sink_t rx = { .buf = malloc(2 * size) };
+    TEST_ASSERT_NOT_NULL(rx.buf);
+    vfs_tusb_eol_tx(text, size, eol, 2 * size, test_sink_copy, &rx);
+    for (size_t i = 0; i < rx.len; i += 1 + rand() % 200) {
+        rx.buf[i] = '\r';
+    }
+    *rx_size = rx.len;
+    return rx.buf;
+}
+
+/**
+ * @brief Test case for the RX line ending translation
+ *
+ * Scenario:
+ * 1. Translate received data with the per-character reference, for each line ending.
+ * 2. Translate it with vfs_tusb_eol_rx() at once, the result must be the same.
+ * 3. Translate it in chunks of random size, like reads from the RX FIFO. A CR ending a chunk is completed by the
+ *    next byte as the driver does it. The chunks together must give the same result.
+ */
+TEST_CASE("VFS: RX line ending translation", "[vfs][ci]")
+{
+    const size_t size = 64 * 1024;
+    char *text = test_text(size);
+    char *ref = malloc(2 * size);
+    char *out = malloc(2 * size);
+    TEST_ASSERT_NOT_NULL(ref);
+    TEST_ASSERT_NOT_NULL(out);
+
+    for (size_t m = 0; m < sizeof(test_modes) / sizeof(test_modes[0]); m++) {
+        const char *eol = test_modes[m].eol;
+        size_t rx_size;
+        char *rx = test_rx_text(text, size, eol, &rx_size);
+        const size_t ref_len = test_eol_rx_per_char(rx, rx_size, eol, ref);
+
+        memcpy(out, rx, rx_size);
+        TEST_ASSERT_EQUAL(ref_len, vfs_tusb_eol_rx(out, rx_size, eol));
+        TEST_ASSERT_EQUAL_MEMORY(ref, out, ref_len);
+
+        size_t out_len = 0;
+        size_t done = 0;
+        while (done < rx_size) {
+            const size_t chunk = MIN(1 + (size_t)rand() % 70, rx_size - done);
+            memcpy(out + out_len, rx + done, chunk);
+            done += chunk;
+            const size_t n = vfs_tusb_eol_rx(out + out_len, chunk, eol);
+            TEST_ASSERT_GREATER_THAN(0, n);
+            out_len += n;
+            if (strcmp(eol, "\r\n") == 0 && out[out_len - 1] == '\r' && done < rx_size && rx[done] == '\n') {
+                out[out_len - 1] = '\n';
+                done++;
+            }
+        }
+        TEST_ASSERT_EQUAL(ref_len, out_len);
+        TEST_ASSERT_EQUAL_MEMORY(ref, out, ref_len);
+        free(rx);
+    }
+    free(text);
+    free(ref);
+    free(out);
+}
+
+/**
+ * @brief Throughput of the RX line ending translation
+ *
+ * Received data goes through the per-character reference and through vfs_tusb_eol_rx() in place.
+ * The USB transfer and the FIFO reads are not part of the measurement.
+ */
+TEST_CASE("VFS: RX line ending translation throughput", "[vfs][ci]")
+{
+    char *text = test_text(TEST_TEXT_SIZE);
+    char *out = malloc(2 * TEST_TEXT_SIZE);
+    TEST_ASSERT_NOT_NULL(out);
+
+    printf("Mode   per-char MB/s   bulk MB/s\n");
+    for (size_t m = 0; m < sizeof(test_modes) / sizeof(test_modes[0]); m++) {
+        const char *eol = test_modes[m].eol;
+        size_t rx_size;
+        char *rx = test_rx_text(text, TEST_TEXT_SIZE, eol, &rx_size);
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < TEST_BENCH_ROUNDS; r++) {
+            test_eol_rx_per_char(rx, rx_size, eol, out);
+        }
+        const double per_char = TEST_BENCH_ROUNDS * (double)rx_size / test_elapsed_s(&start) / 1e6;
+
+        // The copy back is part of the bulk measurement, the translation is in place
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < TEST_BENCH_ROUNDS; r++) {
+            memcpy(out, rx, rx_size);
+            vfs_tusb_eol_rx(out, rx_size, eol);
+        }
+        const double bulk = TEST_BENCH_ROUNDS * (double)rx_size / test_elapsed_s(&start) / 1e6;
+
+        printf("%-6s %13.1f %11.1f\n", test_modes[m].name, per_char, bulk);
+        free(rx);
+    }
+    free(text);
+    free(out);
+}
@@ -0,0 +1,11 @@
+# SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+# SPDX-License-Identifier: Apache-2.0
+
+import pytest
+from pytest_embedded_idf.dut import IdfDut
+
+
+@pytest.mark.linux
+@pytest.mark.host_test
+def test_cdc_vfs_host(dut: IdfDut) -> None:
+    dut.run_all_single_board_cases(group=['ci'])
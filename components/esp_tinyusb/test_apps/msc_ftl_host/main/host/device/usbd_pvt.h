@@ -0,0 +1,8 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Stand-in for the TinyUSB header included by msc_storage.h, the storage media use nothing from it
+#pragma once
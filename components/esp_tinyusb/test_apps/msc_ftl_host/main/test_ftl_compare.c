@@ -0,0 +1,524 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+//
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_private/partition_linux.h"
+#include "wear_levelling.h"
+#include "diskio_impl.h"
+#include "ff.h"
+//
+#include "unity.h"
+//
+#include "msc_storage.h"
+#include "storage_ftl.h"
+#include "storage_spiflash.h"
+
+#define TEST_CLUSTER_SIZE           4096            // Same clusters on both media
+#define TEST_IO_CHUNK               4096            // Largest single f_write()/f_read()
+#define TEST_TRACE_MAX              (256 * 1024)    // Generated trace text
+#define TEST_FLASH_ERASE_US         45000           // 4 KB sector erase, typical of the SPI NOR flash on ESP32-S3 modules
+#define TEST_FLASH_PROGRAM_US       700             // 256-byte page program, same flash
+#define TEST_FLASH_READ_BPUS        20              // Bytes read per microsecond, 80 MHz QIO with overhead
+
+/**
+ * @brief Medium under test, accessed by FatFs the way the MSC driver accesses it
+ */
+static struct {
+    const storage_medium_t *medium;
+    storage_info_t info;
+    uint64_t host_bytes;            // Bytes written by FatFs
+    BYTE pdrv;
+    FATFS fs;
+} s_test;
+
+/**
+ * @brief Flash activity of a trace replay
+ */
+typedef struct {
+    uint64_t host_bytes;
+    uint64_t flash_write_bytes;
+    uint64_t flash_read_bytes;
+    uint32_t erases;                // 4 KB sectors
+} test_flash_use_t;
+
+// ============================================================================
+// FatFs on a storage medium
+// ============================================================================
+
+static DSTATUS test_disk_initialize(BYTE pdrv)
+{
+    return 0;
+}
+
+static DSTATUS test_disk_status(BYTE pdrv)
+{
+    return 0;
+}
+
+static DRESULT test_disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    return (s_test.medium->read(sector, 0, (size_t)count * s_test.info.sector_size, buff) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT test_disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    s_test.host_bytes += (uint64_t)count * s_test.info.sector_size;
+    return (s_test.medium->write(sector, 0, (size_t)count * s_test.info.sector_size, buff) == ESP_OK) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT test_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    switch (cmd) {
+    case CTRL_SYNC:
+        return RES_OK;
+    case GET_SECTOR_COUNT:
+        *((DWORD *) buff) = s_test.info.total_sectors;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *) buff) = s_test.info.sector_size;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *((DWORD *) buff) = 1;
+        return RES_OK;
+    }
+    return RES_ERROR;
+}
+
+static const ff_diskio_impl_t test_diskio = {
+    .init = &test_disk_initialize,
+    .status = &test_disk_status,
+    .read = &test_disk_read,
+    .write = &test_disk_write,
+    .ioctl = &test_disk_ioctl,
+};
+
+static void test_path(const char *path, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%d:%s", s_test.pdrv, path);
+}
+
+static void test_fs_mount(const storage_medium_t *medium, bool format)
+{
+    s_test.medium = medium;
+    TEST_ASSERT_EQUAL(ESP_OK, medium->get_info(&s_test.info));
+    TEST_ASSERT_EQUAL(ESP_OK, ff_diskio_get_drive(&s_test.pdrv));
+    ff_diskio_register(s_test.pdrv, &test_diskio);
+
+    char drv[3] = {(char)('0' + s_test.pdrv), ':', 0};
+    if (format) {
+        const MKFS_PARM opt = {
+            .fmt = FM_ANY,
+            .au_size = TEST_CLUSTER_SIZE,
+        };
+        void *work = malloc(FF_MAX_SS);
+        TEST_ASSERT_NOT_NULL(work);
+        TEST_ASSERT_EQUAL(FR_OK, f_mkfs(drv, &opt, work, FF_MAX_SS));
+        free(work);
+    }
+    TEST_ASSERT_EQUAL(FR_OK, f_mount(&s_test.fs, drv, 1));
+}
+
+static void test_fs_unmount(void)
+{
+    char drv[3] = {(char)('0' + s_test.pdrv), ':', 0};
+    f_mount(NULL, drv, 0);
+    ff_diskio_unregister(s_test.pdrv);
+}
+
+// ============================================================================
+// Trace replay, format of tools/fs_profile/replay_trace.py
+// ============================================================================
+
+/**
+ * @brief Contents of a file at an offset, the same whatever wrote it
+ */
+static uint8_t test_pattern(const char *path, uint32_t offset)
+{
+    uint32_t h = 2166136261u;
+    for (const char *p = path; *p; p++) {
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    }
+    return (uint8_t)((h >> 8) + offset * 7 + (offset >> 9));
+}
+
+static void test_mkdirs(const char *path)
+{
+    char dir[128];
+    for (const char *p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+        char sub[96];
+        snprintf(sub, sizeof(sub), "%.*s", (int)(p - path), path);
+        test_path(sub, dir, sizeof(dir));
+        FRESULT res = f_mkdir(dir);
+        TEST_ASSERT_TRUE(res == FR_OK || res == FR_EXIST);
+    }
+}
+
+static void test_file_write(const char *path, int64_t offset, uint32_t size)
+{
+    char fpath[128];
+    uint8_t buf[TEST_IO_CHUNK];
+    FIL f;
+
+    test_mkdirs(path);
+    test_path(path, fpath, sizeof(fpath));
+    TEST_ASSERT_EQUAL(FR_OK, f_open(&f, fpath, FA_OPEN_ALWAYS | FA_WRITE));
+    const FSIZE_t pos = (offset < 0) ? f_size(&f) : (FSIZE_t)offset;
+    TEST_ASSERT_EQUAL(FR_OK, f_lseek(&f, pos));
+    for (uint32_t done = 0; done < size;) {
+        const UINT chunk = MIN(size - done, sizeof(buf));
+        for (UINT i = 0; i < chunk; i++) {
+            buf[i] = test_pattern(path, pos + done + i);
+        }
+        UINT written = 0;
+        TEST_ASSERT_EQUAL(FR_OK, f_write(&f, buf, chunk, &written));
+        TEST_ASSERT_EQUAL(chunk, written);
+        done += chunk;
+    }
+    TEST_ASSERT_EQUAL(FR_OK, f_close(&f));
+}
+
+static void test_replay_line(char *line)
+{
+    char *fields[4] = {0};
+    int n = 0;
+    for (char *tok = strtok(line, ",\r\n"); tok != NULL && n < 4; tok = strtok(NULL, ",\r\n")) {
+        fields[n++] = tok;
+    }
+    if (n < 2 || fields[0][0] == '#') {
+        return;
+    }
+
+    char fpath[128];
+    test_path(fields[1], fpath, sizeof(fpath));
+    if (strcmp(fields[0], "create") == 0) {
+        test_file_write(fields[1], 0, 0);
+    } else if (strcmp(fields[0], "write") == 0 && n == 4) {
+        test_file_write(fields[1], strtoll(fields[2], NULL, 0), strtoul(fields[3], NULL, 0));
+    } else if (strcmp(fields[0], "append") == 0 && n == 3) {
+        test_file_write(fields[1], -1, strtoul(fields[2], NULL, 0));
+    } else if (strcmp(fields[0], "truncate") == 0 && n == 3) {
+        FIL f;
+        TEST_ASSERT_EQUAL(FR_OK, f_open(&f, fpath, FA_OPEN_ALWAYS | FA_WRITE));
+        TEST_ASSERT_EQUAL(FR_OK, f_lseek(&f, strtoul(fields[2], NULL, 0)));
+        TEST_ASSERT_EQUAL(FR_OK, f_truncate(&f));
+        TEST_ASSERT_EQUAL(FR_OK, f_close(&f));
+    } else if (strcmp(fields[0], "delete") == 0) {
+        TEST_ASSERT_EQUAL(FR_OK, f_unlink(fpath));
+    } else {
+        TEST_FAIL_MESSAGE("Unknown trace operation");
+    }
+}
+
+static void test_replay(const char *trace)
+{
+    char *copy = strdup(trace);
+    TEST_ASSERT_NOT_NULL(copy);
+    char *save = NULL;
+    for (char *line = strtok_r(copy, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)) {
+        test_replay_line(line);
+    }
+    free(copy);
+}
+
+/**
+ * @brief Check every file against the pattern, the synthetic traces leave no holes
+ */
+static void test_verify_dir(const char *dir)
+{
+    char dpath[128];
+    DIR d;
+    FILINFO fi;
+    test_path(dir, dpath, sizeof(dpath));
+    TEST_ASSERT_EQUAL(FR_OK, f_opendir(&d, dpath));
+    while (f_readdir(&d, &fi) == FR_OK && fi.fname[0] != 0) {
+        char path[96];
+        snprintf(path, sizeof(path), "%s/%s", strcmp(dir, "/") ? dir : "", fi.fname);
+        if (fi.fattrib & AM_DIR) {
+            test_verify_dir(path);
+            continue;
+        }
+        char fpath[128];
+        uint8_t buf[TEST_IO_CHUNK];
+        FIL f;
+        test_path(path, fpath, sizeof(fpath));
+        TEST_ASSERT_EQUAL(FR_OK, f_open(&f, fpath, FA_READ));
+        for (FSIZE_t pos = 0; pos < f_size(&f);) {
+            UINT got = 0;
+            TEST_ASSERT_EQUAL(FR_OK, f_read(&f, buf, sizeof(buf), &got));
+            for (UINT i = 0; i < got; i++) {
+                TEST_ASSERT_EQUAL_HEX8_MESSAGE(test_pattern(path, pos + i), buf[i], path);
+            }
+            pos += got;
+        }
+        f_close(&f);
+    }
+    f_closedir(&d);
+}
+
+// ============================================================================
+// Synthetic traces
+// ============================================================================
+
+typedef struct {
+    const char *name;
+    void (*generate)(char *out, size_t size);
+} test_trace_t;
+
+#define TRACE_PRINTF(...)   do { len += snprintf(out + len, size - len, __VA_ARGS__); TEST_ASSERT_LESS_THAN(size, len); } while (0)
+
+// Data logger: short records appended to a few files, every append reaches the flash
+static void trace_log(char *out, size_t size)
+{
+    size_t len = 0;
+    for (int i = 0; i < 1500; i++) {
+        TRACE_PRINTF("append,/logs/log%d.csv,%d\n", i % 4, 32 + (i * 37) % 224);
+    }
+}
+
+// Files dropped and consumed: whole files written sequentially, half of them deleted
+static void trace_bulk(char *out, size_t size)
+{
+    size_t len = 0;
+    for (int i = 0; i < 24; i++) {
+        TRACE_PRINTF("create,/in/f%02d.bin\nwrite,/in/f%02d.bin,0,32768\n", i, i);
+        if (i % 2) {
+            TRACE_PRINTF("delete,/in/f%02d.bin\n", i - 1);
+        }
+    }
+}
+
+// Record store: 4 KB records rewritten in place in a preallocated file
+static void trace_rewrite(char *out, size_t size)
+{
+    size_t len = 0;
+    uint32_t x = 12345;
+    TRACE_PRINTF("create,/db.bin\nwrite,/db.bin,0,262144\n");
+    for (int i = 0; i < 600; i++) {
+        x = x * 1103515245 + 12345;
+        TRACE_PRINTF("write,/db.bin,%" PRIu32 ",4096\n", ((x >> 8) % 64) * 4096);
+    }
+}
+
+static const test_trace_t test_traces[] = {
+    { "log", trace_log },
+    { "bulk", trace_bulk },
+    { "rewrite", trace_rewrite },
+};
+
+// ============================================================================
+// Media
+// ============================================================================
+
+static const esp_partition_t *test_partition(const char *label)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    TEST_ASSERT_NOT_NULL_MESSAGE(part, "Partition not found, check partitions.csv");
+    return part;
+}
+
+static uint32_t test_erase_count(const esp_partition_t *part)
+{
+    uint32_t total = 0;
+    for (size_t s = 0; s < part->size / SPI_FLASH_SEC_SIZE; s++) {
+        total += esp_partition_get_sector_erase_count(part->address / SPI_FLASH_SEC_SIZE + s);
+    }
+    return total;
+}
+
+static void test_usage_begin(const esp_partition_t *part, test_flash_use_t *use)
+{
+    esp_partition_clear_stats();
+    s_test.host_bytes = 0;
+    memset(use, 0, sizeof(*use));
+    use->erases = test_erase_count(part);
+}
+
+static void test_usage_end(const esp_partition_t *part, test_flash_use_t *use)
+{
+    use->host_bytes = s_test.host_bytes;
+    use->flash_write_bytes = esp_partition_get_write_bytes();
+    use->flash_read_bytes = esp_partition_get_read_bytes();
+    use->erases = test_erase_count(part) - use->erases;
+}
+
+static void test_usage_print(const char *trace, const char *medium, const test_flash_use_t *use)
+{
+    // Flash busy time, the host and USB transfers overlap with it
+    const uint64_t us = (uint64_t)use->erases * TEST_FLASH_ERASE_US +
+                        use->flash_write_bytes * TEST_FLASH_PROGRAM_US / 256 +
+                        use->flash_read_bytes / TEST_FLASH_READ_BPUS;
+    printf("%-8s %-4s host %7" PRIu64 " KB  flash %7" PRIu64 " KB  WA %5.2f  erases %5" PRIu32 "  %7.1f KB/s\n",
+           trace, medium, use->host_bytes / 1024, use->flash_write_bytes / 1024,
+           use->host_bytes ? (double)use->flash_write_bytes / use->host_bytes : 0.0, use->erases,
+           us ? use->host_bytes * 1e6 / 1024 / us : 0.0);
+}
+
+/**
+ * @brief Replay a trace on a freshly formatted medium, then check the files after reopening it
+ *
+ * @param[in] wl True for the wear-levelled medium, false for the log-structured one
+ */
+static void test_run_trace(const test_trace_t *trace, bool wl, test_flash_use_t *use)
+{
+    const esp_partition_t *part = test_partition(wl ? "storage" : "ftl");
+    const storage_medium_t *medium = NULL;
+    wl_handle_t wl_handle = WL_INVALID_HANDLE;
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(part, 0, part->size));
+    if (wl) {
+        TEST_ASSERT_EQUAL(ESP_OK, wl_mount(part, &wl_handle));
+        TEST_ASSERT_EQUAL(ESP_OK, storage_spiflash_open_medium(wl_handle, &medium));
+    } else {
+        TEST_ASSERT_EQUAL(ESP_OK, storage_ftl_open_medium(part, &medium));
+    }
+    test_fs_mount(medium, true);
+
+    char *text = calloc(1, TEST_TRACE_MAX);
+    TEST_ASSERT_NOT_NULL(text);
+    trace->generate(text, TEST_TRACE_MAX);
+    test_usage_begin(part, use);
+    test_replay(text);
+    test_usage_end(part, use);
+    free(text);
+
+    // Closing writes the checkpoint, reopening loads it
+    test_fs_unmount();
+    medium->close();
+    if (wl) {
+        TEST_ASSERT_EQUAL(ESP_OK, storage_spiflash_open_medium(wl_handle, &medium));
+    } else {
+        TEST_ASSERT_EQUAL(ESP_OK, storage_ftl_open_medium(part, &medium));
+    }
+    test_fs_mount(medium, false);
+    test_verify_dir("/");
+    test_fs_unmount();
+    medium->close();
+    if (wl) {
+        TEST_ASSERT_EQUAL(ESP_OK, wl_unmount(wl_handle));
+    }
+}
+
+/**
+ * @brief Replay the traces on wear levelling and on the log-structured medium
+ *
+ * Both partitions are formatted with the same cluster size, in the sector size of their medium
+ * (the WL sector size, 512 bytes for the log-structured medium). Write amplification is flash bytes
+ * programmed per byte written by FatFs, the throughput is modelled from the flash operations.
+ */
+TEST_CASE("FTL: trace replay against wear levelling", "[ftl][ci]")
+{
+    for (size_t i = 0; i < sizeof(test_traces) / sizeof(test_traces[0]); i++) {
+        test_flash_use_t wl_use;
+        test_flash_use_t ftl_use;
+        test_run_trace(&test_traces[i], true, &wl_use);
+        test_run_trace(&test_traces[i], false, &ftl_use);
+        test_usage_print(test_traces[i].name, "WL", &wl_use);
+        test_usage_print(test_traces[i].name, "FTL", &ftl_use);
+        if (strcmp(test_traces[i].name, "log") == 0) {
+            // Every small append is a sector erase on wear levelling, the log packs them into pages
+            TEST_ASSERT_LESS_THAN_UINT32(wl_use.erases, ftl_use.erases);
+        }
+    }
+}
+
+/**
+ * @brief Replay a captured trace given in the FS_TRACE environment variable
+ *
+ * Record one with the record store on the device or from a Linux-target build of the application,
+ * in the format of tools/fs_profile/replay_trace.py.
+ */
+TEST_CASE("FTL: captured trace replay against wear levelling", "[ftl][trace]")
+{
+    const char *file = getenv("FS_TRACE");
+    if (file == NULL) {
+        TEST_IGNORE_MESSAGE("Set FS_TRACE to the trace file");
+    }
+    FILE *f = fopen(file, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Can't open FS_TRACE");
+    char *text = calloc(1, TEST_TRACE_MAX);
+    TEST_ASSERT_NOT_NULL(text);
+    fread(text, 1, TEST_TRACE_MAX - 1, f);
+    fclose(f);
+
+    for (int wl = 1; wl >= 0; wl--) {
+        const esp_partition_t *part = test_partition(wl ? "storage" : "ftl");
+        const storage_medium_t *medium = NULL;
+        wl_handle_t wl_handle = WL_INVALID_HANDLE;
+        test_flash_use_t use;
+
+        TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(part, 0, part->size));
+        if (wl) {
+            TEST_ASSERT_EQUAL(ESP_OK, wl_mount(part, &wl_handle));
+            TEST_ASSERT_EQUAL(ESP_OK, storage_spiflash_open_medium(wl_handle, &medium));
+        } else {
+            TEST_ASSERT_EQUAL(ESP_OK, storage_ftl_open_medium(part, &medium));
+        }
+        test_fs_mount(medium, true);
+        test_usage_begin(part, &use);
+        test_replay(text);
+        test_usage_end(part, &use);
+        test_usage_print("captured", wl ? "WL" : "FTL", &use);
+        test_fs_unmount();
+        medium->close();
+        if (wl) {
+            wl_unmount(wl_handle);
+        }
+    }
+    free(text);
+}
+
+/**
+ * @brief Test case for the map checkpoint
+ *
+ * Scenario:
+ * 1. Write a file, close the medium and reopen it: the map comes from the checkpoint, nothing is replayed.
+ * 2. Rewrite the file and reopen the medium without closing it, as after a power loss: the map is rebuilt
+ *    from the checkpoint and the segments written after it.
+ */
+TEST_CASE("FTL: reopen from checkpoint and after power loss", "[ftl][ci]")
+{
+    const esp_partition_t *part = test_partition("ftl");
+    const storage_medium_t *medium = NULL;
+    tinyusb_msc_ftl_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(part, 0, part->size));
+    TEST_ASSERT_EQUAL(ESP_OK, storage_ftl_open_medium(part, &medium));
+    test_fs_mount(medium, true);
+    test_file_write("/a.bin", 0, 96 * 1024);
+    test_fs_unmount();
+    medium->close();
+
+    TEST_ASSERT_EQUAL(ESP_OK, storage_ftl_open_medium(part, &medium));
+    TEST_ASSERT_EQUAL(ESP_OK, storage_ftl_get_stats(&stats));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.checkpoints);     // Clean, nothing to write back
+    test_fs_mount(medium, false);
+    test_verify_dir("/");
+    test_file_write("/a.bin", 0, 96 * 1024);
+    test_file_write("/b.bin", 0, 8 * 1024);
+    test_fs_unmount();
+
+    // Copy the flash as it is now, closing would write a checkpoint
+    uint8_t *image = malloc(part->size);
+    TEST_ASSERT_NOT_NULL(image);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_read(part, 0, image, part->size));
+    medium->close();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(part, 0, part->size));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_write(part, 0, image, part->size));
+    free(image);
+
+    TEST_ASSERT_EQUAL(ESP_OK, storage_ftl_open_medium(part, &medium));
+    test_fs_mount(medium, false);
+    test_verify_dir("/");
+    test_fs_unmount();
+    medium->close();
+}
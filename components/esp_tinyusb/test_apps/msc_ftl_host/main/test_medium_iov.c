@@ -0,0 +1,163 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <string.h>
+//
+#include "esp_err.h"
+//
+#include "unity.h"
+//
+#include "msc_storage.h"
+
+#define TEST_SECTOR_SIZE    512
+#define TEST_SECTORS        32
+#define TEST_CHUNK_SIZE     (4 * TEST_SECTOR_SIZE)      // One TinyUSB chunk
+#define TEST_CHUNKS         4                           // Chunks of a batch
+
+/**
+ * @brief RAM medium counting the calls it gets
+ */
+static struct {
+    uint8_t data[TEST_SECTORS * TEST_SECTOR_SIZE];
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t readvs;
+    uint32_t writevs;
+} s_medium;
+
+static esp_err_t test_medium_read(uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(s_medium.data), (size_t)lba * TEST_SECTOR_SIZE + offset + size);
+    memcpy(dest, s_medium.data + (size_t)lba * TEST_SECTOR_SIZE + offset, size);
+    s_medium.reads++;
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_write(uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(s_medium.data), (size_t)lba * TEST_SECTOR_SIZE + offset + size);
+    memcpy(s_medium.data + (size_t)lba * TEST_SECTOR_SIZE + offset, src, size);
+    s_medium.writes++;
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_readv(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt)
+{
+    s_medium.readvs++;
+    for (size_t i = 0; i < iovcnt; i++) {
+        memcpy(iov[i].base, s_medium.data + (size_t)lba * TEST_SECTOR_SIZE, iov[i].size);
+        lba += iov[i].size / TEST_SECTOR_SIZE;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_writev(uint32_t lba, const storage_iovec_t *iov, size_t iovcnt)
+{
+    s_medium.writevs++;
+    for (size_t i = 0; i < iovcnt; i++) {
+        memcpy(s_medium.data + (size_t)lba * TEST_SECTOR_SIZE, iov[i].base, iov[i].size);
+        lba += iov[i].size / TEST_SECTOR_SIZE;
+    }
+    return ESP_OK;
+}
+
+// Like the decorators (cache, compress, crypt, integrity): no vectored transfers
+static const storage_medium_t s_plain_medium = {
+    .type = STORAGE_MEDIUM_TYPE_RAMDISK,
+    .read = &test_medium_read,
+    .write = &test_medium_write,
+};
+
+// Like SPI Flash, SD/MMC and FTL
+static const storage_medium_t s_vectored_medium = {
+    .type = STORAGE_MEDIUM_TYPE_RAMDISK,
+    .read = &test_medium_read,
+    .write = &test_medium_write,
+    .readv = &test_medium_readv,
+    .writev = &test_medium_writev,
+};
+
+/**
+ * @brief Split a buffer into chunks, as the MSC batch does
+ */
+static void test_iov_chunks(uint8_t *buf, storage_iovec_t *iov)
+{
+    for (size_t i = 0; i < TEST_CHUNKS; i++) {
+        iov[i].base = buf + i * TEST_CHUNK_SIZE;
+        iov[i].size = TEST_CHUNK_SIZE;
+    }
+}
+
+static void test_fill_pattern(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)((i * 7) ^ seed);
+    }
+}
+
+/**
+ * @brief Vectored transfers on a medium without readv/writev
+ *
+ * A batch in one buffer must be a single read or write, buffers that are not adjacent one call each.
+ */
+TEST_CASE("Medium: vectored transfer without readv/writev", "[medium][ci]")
+{
+    static uint8_t batch[TEST_CHUNKS * TEST_CHUNK_SIZE];
+    static uint8_t check[TEST_CHUNKS * TEST_CHUNK_SIZE];
+    storage_iovec_t iov[TEST_CHUNKS];
+
+    memset(&s_medium, 0, sizeof(s_medium));
+    test_fill_pattern(batch, sizeof(batch), 0x3C);
+
+    // Contiguous batch buffer
+    test_iov_chunks(batch, iov);
+    TEST_ASSERT_EQUAL(ESP_OK, storage_medium_writev(&s_plain_medium, TEST_SECTOR_SIZE, 8, iov, TEST_CHUNKS));
+    TEST_ASSERT_EQUAL(1, s_medium.writes);
+    TEST_ASSERT_EQUAL_MEMORY(batch, s_medium.data + 8 * TEST_SECTOR_SIZE, sizeof(batch));
+
+    test_iov_chunks(check, iov);
+    TEST_ASSERT_EQUAL(ESP_OK, storage_medium_readv(&s_plain_medium, TEST_SECTOR_SIZE, 8, iov, TEST_CHUNKS));
+    TEST_ASSERT_EQUAL(1, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(batch, check, sizeof(check));
+
+    // Two runs: the chunks are swapped in memory
+    s_medium.writes = 0;
+    iov[0].base = batch + 2 * TEST_CHUNK_SIZE;
+    iov[1].base = batch + 3 * TEST_CHUNK_SIZE;
+    iov[2].base = batch;
+    iov[3].base = batch + TEST_CHUNK_SIZE;
+    TEST_ASSERT_EQUAL(ESP_OK, storage_medium_writev(&s_plain_medium, TEST_SECTOR_SIZE, 0, iov, TEST_CHUNKS));
+    TEST_ASSERT_EQUAL(2, s_medium.writes);
+    TEST_ASSERT_EQUAL_MEMORY(batch + 2 * TEST_CHUNK_SIZE, s_medium.data, 2 * TEST_CHUNK_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(batch, s_medium.data + 2 * TEST_CHUNK_SIZE, 2 * TEST_CHUNK_SIZE);
+}
+
+/**
+ * @brief Vectored transfers on a medium with readv/writev
+ *
+ * The whole transfer goes to the medium in one call.
+ */
+TEST_CASE("Medium: vectored transfer with readv/writev", "[medium][ci]")
+{
+    static uint8_t batch[TEST_CHUNKS * TEST_CHUNK_SIZE];
+    static uint8_t check[TEST_CHUNKS * TEST_CHUNK_SIZE];
+    storage_iovec_t iov[TEST_CHUNKS];
+
+    memset(&s_medium, 0, sizeof(s_medium));
+    test_fill_pattern(batch, sizeof(batch), 0xA5);
+
+    test_iov_chunks(batch, iov);
+    TEST_ASSERT_EQUAL(ESP_OK, storage_medium_writev(&s_vectored_medium, TEST_SECTOR_SIZE, 4, iov, TEST_CHUNKS));
+    test_iov_chunks(check, iov);
+    TEST_ASSERT_EQUAL(ESP_OK, storage_medium_readv(&s_vectored_medium, TEST_SECTOR_SIZE, 4, iov, TEST_CHUNKS));
+
+    TEST_ASSERT_EQUAL(1, s_medium.writevs);
+    TEST_ASSERT_EQUAL(1, s_medium.readvs);
+    TEST_ASSERT_EQUAL(0, s_medium.writes);
+    TEST_ASSERT_EQUAL(0, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(batch, check, sizeof(check));
+}
@@ -0,0 +1,238 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <string.h>
+//
+#include "esp_err.h"
+//
+#include "unity.h"
+//
+#include "msc_storage.h"
+#include "storage_cache.h"
+
+#define TEST_SECTOR_SIZE    512
+#define TEST_SECTORS        256
+#define TEST_HOT_SECTORS    (CONFIG_TINYUSB_MSC_CACHE_HOT_SIZE_KB * 1024 / TEST_SECTOR_SIZE)    // No cold tier without PSRAM
+
+/**
+ * @brief RAM medium counting the calls it gets
+ */
+static struct {
+    uint8_t data[TEST_SECTORS * TEST_SECTOR_SIZE];
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t mounts;
+    uint32_t unmounts;
+    uint32_t syncs;
+    uint32_t closes;
+} s_medium;
+
+static esp_err_t test_medium_mount(BYTE pdrv)
+{
+    s_medium.mounts++;
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_unmount(void)
+{
+    s_medium.unmounts++;
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_read(uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(s_medium.data), (size_t)lba * TEST_SECTOR_SIZE + offset + size);
+    memcpy(dest, s_medium.data + (size_t)lba * TEST_SECTOR_SIZE + offset, size);
+    s_medium.reads++;
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_write(uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(s_medium.data), (size_t)lba * TEST_SECTOR_SIZE + offset + size);
+    memcpy(s_medium.data + (size_t)lba * TEST_SECTOR_SIZE + offset, src, size);
+    s_medium.writes++;
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_sync(void)
+{
+    s_medium.syncs++;
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_get_info(storage_info_t *info)
+{
+    info->total_sectors = TEST_SECTORS;
+    info->sector_size = TEST_SECTOR_SIZE;
+    return ESP_OK;
+}
+
+static void test_medium_close(void)
+{
+    s_medium.closes++;
+}
+
+static const storage_medium_t s_backing = {
+    .type = STORAGE_MEDIUM_TYPE_RAMDISK,
+    .mount = &test_medium_mount,
+    .unmount = &test_medium_unmount,
+    .read = &test_medium_read,
+    .write = &test_medium_write,
+    .sync = &test_medium_sync,
+    .get_info = &test_medium_get_info,
+    .close = &test_medium_close,
+};
+
+static void test_fill_pattern(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)((i * 13) ^ seed);
+    }
+}
+
+static const storage_medium_t *test_cache_open(void)
+{
+    memset(&s_medium, 0, sizeof(s_medium));
+    test_fill_pattern(s_medium.data, sizeof(s_medium.data), 0x11);
+    const storage_medium_t *cached = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, storage_cache_open_medium(&s_backing, &cached));
+    TEST_ASSERT_NOT_NULL(cached);
+    TEST_ASSERT_EQUAL(STORAGE_MEDIUM_TYPE_RAMDISK, cached->type);
+    return cached;
+}
+
+/**
+ * @brief Hits and misses
+ *
+ * A sector is read from the medium once, later reads of it and of parts of it are served from the cache.
+ */
+TEST_CASE("Cache: hit and miss", "[cache][ci]")
+{
+    const storage_medium_t *cached = test_cache_open();
+    uint8_t sector[TEST_SECTOR_SIZE];
+
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(5, 0, TEST_SECTOR_SIZE, sector));
+    TEST_ASSERT_EQUAL(1, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data + 5 * TEST_SECTOR_SIZE, sector, TEST_SECTOR_SIZE);
+
+    // Hits, also at an offset given in bytes beyond the first sector
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(5, 0, TEST_SECTOR_SIZE, sector));
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(4, TEST_SECTOR_SIZE + 100, 64, sector));
+    TEST_ASSERT_EQUAL(1, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data + 5 * TEST_SECTOR_SIZE + 100, sector, 64);
+
+    // A read across two sectors misses the second one only
+    uint8_t two[2 * TEST_SECTOR_SIZE];
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(5, 0, sizeof(two), two));
+    TEST_ASSERT_EQUAL(2, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data + 5 * TEST_SECTOR_SIZE, two, sizeof(two));
+
+    cached->close();
+    TEST_ASSERT_EQUAL(1, s_medium.closes);
+}
+
+/**
+ * @brief Runs of misses
+ *
+ * Consecutive sectors not in the cache are read from the medium with one read and cached; cached sectors
+ * split the run.
+ */
+TEST_CASE("Cache: run of misses in one read", "[cache][ci]")
+{
+    const storage_medium_t *cached = test_cache_open();
+    uint8_t sectors[12 * TEST_SECTOR_SIZE];
+
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(20, 0, 4 * TEST_SECTOR_SIZE, sectors));
+    TEST_ASSERT_EQUAL(1, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data + 20 * TEST_SECTOR_SIZE, sectors, 4 * TEST_SECTOR_SIZE);
+
+    // Sectors 20 to 23 hit, 16 to 19 and 24 to 27 are read with one read each
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(16, 0, sizeof(sectors), sectors));
+    TEST_ASSERT_EQUAL(3, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data + 16 * TEST_SECTOR_SIZE, sectors, sizeof(sectors));
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(16, 0, sizeof(sectors), sectors));
+    TEST_ASSERT_EQUAL(3, s_medium.reads);
+
+    // A partial first sector goes through a line, the whole sectors after it are one read
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(40, 100, 3 * TEST_SECTOR_SIZE - 100, sectors));
+    TEST_ASSERT_EQUAL(5, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data + 40 * TEST_SECTOR_SIZE + 100, sectors, 3 * TEST_SECTOR_SIZE - 100);
+
+    cached->close();
+}
+
+/**
+ * @brief Writes and eviction
+ *
+ * Writes reach the medium at once and update a cached copy. A sector written while cached and then evicted
+ * reads back with the written data: the cache never holds data the medium doesn't have.
+ */
+TEST_CASE("Cache: write-through and eviction", "[cache][ci]")
+{
+    const storage_medium_t *cached = test_cache_open();
+    uint8_t sector[TEST_SECTOR_SIZE];
+    uint8_t data[TEST_SECTOR_SIZE];
+    test_fill_pattern(data, sizeof(data), 0xA7);
+
+    // Cached sector, overwritten in part
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(0, 0, TEST_SECTOR_SIZE, sector));
+    TEST_ASSERT_EQUAL(ESP_OK, cached->write(0, 16, 32, data));
+    TEST_ASSERT_EQUAL(1, s_medium.writes);
+    TEST_ASSERT_EQUAL_MEMORY(data, s_medium.data + 16, 32);
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(0, 0, TEST_SECTOR_SIZE, sector));
+    TEST_ASSERT_EQUAL(1, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data, sector, TEST_SECTOR_SIZE);
+
+    // Sector not cached: written through without taking a line
+    TEST_ASSERT_EQUAL(ESP_OK, cached->write(1, 0, TEST_SECTOR_SIZE, data));
+    TEST_ASSERT_EQUAL_MEMORY(data, s_medium.data + TEST_SECTOR_SIZE, TEST_SECTOR_SIZE);
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(1, 0, TEST_SECTOR_SIZE, sector));
+    TEST_ASSERT_EQUAL(2, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(data, sector, TEST_SECTOR_SIZE);
+
+    // Fill the cache with other sectors: sector 0 is the least recently used and goes first
+    for (uint32_t lba = 2; lba < 2 + TEST_HOT_SECTORS; lba++) {
+        TEST_ASSERT_EQUAL(ESP_OK, cached->read(lba, 0, TEST_SECTOR_SIZE, sector));
+    }
+    const uint32_t reads = s_medium.reads;
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(0, 0, TEST_SECTOR_SIZE, sector));
+    TEST_ASSERT_EQUAL(reads + 1, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(data, sector + 16, 32);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data, sector, TEST_SECTOR_SIZE);
+
+    cached->close();
+}
+
+/**
+ * @brief Mount and unmount drop the cache, sync reaches the medium
+ *
+ * While the application has the medium it writes through FatFs diskio, bypassing the cache. Sectors cached
+ * before must be read again afterwards.
+ */
+TEST_CASE("Cache: unmount and sync", "[cache][ci]")
+{
+    const storage_medium_t *cached = test_cache_open();
+    uint8_t sector[TEST_SECTOR_SIZE];
+
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(3, 0, TEST_SECTOR_SIZE, sector));
+    TEST_ASSERT_EQUAL(ESP_OK, cached->mount(0));
+    TEST_ASSERT_EQUAL(1, s_medium.mounts);
+    // The application writes the sector
+    test_fill_pattern(s_medium.data + 3 * TEST_SECTOR_SIZE, TEST_SECTOR_SIZE, 0x5C);
+    TEST_ASSERT_EQUAL(ESP_OK, cached->unmount());
+    TEST_ASSERT_EQUAL(1, s_medium.unmounts);
+
+    TEST_ASSERT_EQUAL(ESP_OK, cached->read(3, 0, TEST_SECTOR_SIZE, sector));
+    TEST_ASSERT_EQUAL(2, s_medium.reads);
+    TEST_ASSERT_EQUAL_MEMORY(s_medium.data + 3 * TEST_SECTOR_SIZE, sector, TEST_SECTOR_SIZE);
+
+    TEST_ASSERT_EQUAL(ESP_OK, storage_medium_sync(cached));
+    TEST_ASSERT_EQUAL(1, s_medium.syncs);
+
+    cached->close();
+}
@@ -0,0 +1,333 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+//
+#include "esp_err.h"
+#include "diskio_impl.h"
+#include "ff.h"
+//
+#include "unity.h"
+//
+#include "msc_storage.h"
+#include "storage_compress.h"
+
+#define TEST_SECTOR_SIZE    512
+#define TEST_SECTORS        1024                                                // Backing medium, 512 KB
+#define TEST_GROUP_SIZE     (CONFIG_TINYUSB_MSC_COMPRESS_GROUP_SECTORS * TEST_SECTOR_SIZE)
+#define TEST_FILE_SIZE      (TEST_SECTORS * TEST_SECTOR_SIZE * 3 / 5)           // Two don't fit at once
+#define TEST_BENCH_SIZE     (256 * 1024)                                        // Logical bytes per benchmark pass
+#define TEST_BENCH_PASSES   8
+
+/**
+ * @brief RAM backing medium counting the bytes written to it
+ */
+static struct {
+    uint8_t data[TEST_SECTORS * TEST_SECTOR_SIZE];
+    uint64_t write_bytes;
+    uint32_t closes;
+} s_medium;
+
+static esp_err_t test_medium_read(uint32_t lba, uint32_t offset, size_t size, void *dest)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(s_medium.data), (size_t)lba * TEST_SECTOR_SIZE + offset + size);
+    memcpy(dest, s_medium.data + (size_t)lba * TEST_SECTOR_SIZE + offset, size);
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_write(uint32_t lba, uint32_t offset, size_t size, const void *src)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(s_medium.data), (size_t)lba * TEST_SECTOR_SIZE + offset + size);
+    memcpy(s_medium.data + (size_t)lba * TEST_SECTOR_SIZE + offset, src, size);
+    s_medium.write_bytes += size;
+    return ESP_OK;
+}
+
+static esp_err_t test_medium_get_info(storage_info_t *info)
+{
+    info->total_sectors = TEST_SECTORS;
+    info->sector_size = TEST_SECTOR_SIZE;
+    return ESP_OK;
+}
+
+static void test_medium_close(void)
+{
+    s_medium.closes++;
+}
+
+static const storage_medium_t s_backing = {
+    .type = STORAGE_MEDIUM_TYPE_SPIFLASH,
+    .read = &test_medium_read,
+    .write = &test_medium_write,
+    .get_info = &test_medium_get_info,
+    .close = &test_medium_close,
+};
+
+/**
+ * @brief Data that doesn't compress
+ */
+static void test_fill_random(uint8_t *buf, size_t len, uint32_t seed)
+{
+    uint32_t x = seed | 1;
+    for (size_t i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = (uint8_t)x;
+    }
+}
+
+/**
+ * @brief Text-like data: words from a small vocabulary, in a pseudo-random order
+ */
+static void test_fill_text(uint8_t *buf, size_t len, uint32_t seed)
+{
+    static const char *const words[] = {
+        "sensor", "value", "timestamp", "temperature", "humidity", "ok", "error", "retry",
+        "0x1F", "42", "channel", "sample", "level", "warning", "info", "log",
+    };
+    uint32_t x = seed | 1;
+    size_t i = 0;
+    while (i < len) {
+        x = x * 1103515245u + 12345u;
+        const char *w = words[(x >> 16) % (sizeof(words) / sizeof(words[0]))];
+        for (; *w && i < len; w++) {
+            buf[i++] = (uint8_t)*w;
+        }
+        if (i < len) {
+            buf[i++] = ((x >> 8) & 7) ? ' ' : '\n';
+        }
+    }
+}
+
+static const storage_medium_t *test_compress_open(bool blank)
+{
+    if (blank) {
+        memset(s_medium.data, 0xFF, sizeof(s_medium.data));
+    }
+    s_medium.write_bytes = 0;
+    s_medium.closes = 0;
+    const storage_medium_t *medium = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, storage_compress_open_medium(&s_backing, &medium));
+    TEST_ASSERT_NOT_NULL(medium);
+    TEST_ASSERT_EQUAL(STORAGE_MEDIUM_TYPE_SPIFLASH, medium->type);
+    return medium;
+}
+
+static double test_elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Round trip
+ *
+ * Compressible, incompressible and all-zero groups, written at offsets that don't fall on group or
+ * sector boundaries, read back before and after the medium is closed and opened again.
+ */
+TEST_CASE("Compress: round trip", "[compress][ci]")
+{
+    const storage_medium_t *medium = test_compress_open(true);
+    storage_info_t info;
+    TEST_ASSERT_EQUAL(ESP_OK, medium->get_info(&info));
+    TEST_ASSERT_EQUAL(TEST_SECTOR_SIZE, info.sector_size);
+    TEST_ASSERT_GREATER_THAN(TEST_SECTORS, info.total_sectors);
+
+    static uint8_t data[8 * TEST_GROUP_SIZE];
+    static uint8_t check[8 * TEST_GROUP_SIZE];
+    test_fill_text(data, 4 * TEST_GROUP_SIZE, 0x1234);
+    test_fill_random(data + 4 * TEST_GROUP_SIZE, 3 * TEST_GROUP_SIZE, 0x5678);
+    memset(data + 7 * TEST_GROUP_SIZE, 0, TEST_GROUP_SIZE);
+
+    // A blank medium reads as zeros
+    TEST_ASSERT_EQUAL(ESP_OK, medium->read(10, 0, sizeof(check), check));
+    TEST_ASSERT_EACH_EQUAL_UINT8(0, check, sizeof(check));
+
+    // Starts and ends inside a group and inside a sector
+    TEST_ASSERT_EQUAL(ESP_OK, medium->write(10, 100, sizeof(data), data));
+    TEST_ASSERT_EQUAL(ESP_OK, medium->read(10, 100, sizeof(check), check));
+    TEST_ASSERT_EQUAL_MEMORY(data, check, sizeof(data));
+
+    // Partial overwrite of a stored group
+    TEST_ASSERT_EQUAL(ESP_OK, medium->write(10, 100 + TEST_GROUP_SIZE + 7, 300, data + 5 * TEST_GROUP_SIZE));
+    memcpy(data + TEST_GROUP_SIZE + 7, data + 5 * TEST_GROUP_SIZE, 300);
+    TEST_ASSERT_EQUAL(ESP_OK, storage_medium_sync(medium));
+    medium->close();
+    TEST_ASSERT_EQUAL(1, s_medium.closes);
+
+    // The committed map finds everything again
+    medium = test_compress_open(false);
+    memset(check, 0xA5, sizeof(check));
+    TEST_ASSERT_EQUAL(ESP_OK, medium->read(10, 100, sizeof(check), check));
+    TEST_ASSERT_EQUAL_MEMORY(data, check, sizeof(data));
+    TEST_ASSERT_EQUAL(ESP_OK, medium->read(9, 0, TEST_SECTOR_SIZE, check));
+    TEST_ASSERT_EACH_EQUAL_UINT8(0, check, TEST_SECTOR_SIZE);
+    medium->close();
+}
+
+/**
+ * @brief Full medium
+ *
+ * With data that doesn't compress, the logical capacity can't be filled: writes fail with
+ * ESP_ERR_NO_MEM once the backing medium is full. Data stored before stays readable, and stored
+ * groups can still be overwritten in place of their old copies.
+ */
+TEST_CASE("Compress: full medium", "[compress][ci]")
+{
+    const storage_medium_t *medium = test_compress_open(true);
+    storage_info_t info;
+    TEST_ASSERT_EQUAL(ESP_OK, medium->get_info(&info));
+    const uint32_t groups = info.total_sectors / CONFIG_TINYUSB_MSC_COMPRESS_GROUP_SECTORS;
+
+    static uint8_t group[TEST_GROUP_SIZE];
+    static uint8_t check[TEST_GROUP_SIZE];
+    uint32_t stored = 0;
+    esp_err_t ret = ESP_OK;
+    for (; stored < groups; stored++) {
+        test_fill_random(group, sizeof(group), stored + 1);
+        ret = medium->write(stored * CONFIG_TINYUSB_MSC_COMPRESS_GROUP_SECTORS, 0, sizeof(group), group);
+        if (ret != ESP_OK) {
+            break;
+        }
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, ret);
+    // Stored raw, so no more groups than the backing medium holds
+    TEST_ASSERT_LESS_THAN(groups, stored);
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_SECTORS / CONFIG_TINYUSB_MSC_COMPRESS_GROUP_SECTORS, stored);
+    TEST_ASSERT_GREATER_THAN(TEST_SECTORS / CONFIG_TINYUSB_MSC_COMPRESS_GROUP_SECTORS / 2, stored);
+
+    // Still full
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, medium->write(stored * CONFIG_TINYUSB_MSC_COMPRESS_GROUP_SECTORS, 0, sizeof(group), group));
+
+    // Overwriting a stored group reuses its space
+    test_fill_random(group, sizeof(group), 0xBEEF);
+    TEST_ASSERT_EQUAL(ESP_OK, medium->write(0, 0, sizeof(group), group));
+    TEST_ASSERT_EQUAL(ESP_OK, storage_medium_sync(medium));
+    medium->close();
+
+    medium = test_compress_open(false);
+    TEST_ASSERT_EQUAL(ESP_OK, medium->read(0, 0, sizeof(check), check));
+    TEST_ASSERT_EQUAL_MEMORY(group, check, sizeof(group));
+    for (uint32_t g = 1; g < stored; g++) {
+        test_fill_random(group, sizeof(group), g + 1);
+        TEST_ASSERT_EQUAL(ESP_OK, medium->read(g * CONFIG_TINYUSB_MSC_COMPRESS_GROUP_SECTORS, 0, sizeof(check), check));
+        TEST_ASSERT_EQUAL_MEMORY(group, check, sizeof(group));
+    }
+    medium->close();
+}
+
+static void test_fs_write_file(const char *path, uint32_t seed)
+{
+    static uint8_t chunk[4096];
+    FIL f;
+    UINT written = 0;
+
+    TEST_ASSERT_EQUAL(FR_OK, f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS));
+    for (size_t done = 0; done < TEST_FILE_SIZE; done += sizeof(chunk)) {
+        test_fill_random(chunk, sizeof(chunk), seed + done);
+        TEST_ASSERT_EQUAL(FR_OK, f_write(&f, chunk, sizeof(chunk), &written));
+        TEST_ASSERT_EQUAL(sizeof(chunk), written);
+    }
+    TEST_ASSERT_EQUAL(FR_OK, f_close(&f));
+}
+
+/**
+ * @brief Space of deleted files is reclaimed
+ *
+ * A file of data that doesn't compress, deleted, and written again: the second file only fits
+ * once the groups of the free clusters are unmapped, as done when the medium is mounted.
+ */
+TEST_CASE("Compress: freed clusters reclaimed", "[compress][ci]")
+{
+    const storage_medium_t *medium = test_compress_open(true);
+    BYTE pdrv;
+    TEST_ASSERT_EQUAL(ESP_OK, ff_diskio_get_drive(&pdrv));
+    char drv[3] = {(char)('0' + pdrv), ':', 0};
+    char path[16];
+    snprintf(path, sizeof(path), "%s/data.bin", drv);
+    FATFS *fs = calloc(1, sizeof(FATFS));
+    TEST_ASSERT_NOT_NULL(fs);
+
+    TEST_ASSERT_EQUAL(ESP_OK, medium->mount(pdrv));
+    const MKFS_PARM opt = {
+        .fmt = FM_ANY,
+    };
+    void *work = malloc(FF_MAX_SS);
+    TEST_ASSERT_NOT_NULL(work);
+    TEST_ASSERT_EQUAL(FR_OK, f_mkfs(drv, &opt, work, FF_MAX_SS));
+    free(work);
+    TEST_ASSERT_EQUAL(FR_OK, f_mount(fs, drv, 1));
+    test_fs_write_file(path, 1);
+    TEST_ASSERT_EQUAL(FR_OK, f_unlink(path));
+    TEST_ASSERT_EQUAL(ESP_OK, medium->unmount());
+
+    // As after a USB session, where the host deleted the file
+    TEST_ASSERT_EQUAL(ESP_OK, medium->mount(pdrv));
+    TEST_ASSERT_EQUAL(FR_OK, f_mount(fs, drv, 1));
+    test_fs_write_file(path, 2);
+    TEST_ASSERT_EQUAL(ESP_OK, medium->unmount());
+
+    free(fs);
+    medium->close();
+}
+
+/**
+ * @brief Throughput of the compressed medium over RAM, so only the compression and the map count
+ *
+ * Not a pass/fail test beyond the data being read back: prints MB/s and the stored size for
+ * text-like and incompressible data, with the bytes written to the backing medium map commits included.
+ */
+TEST_CASE("Compress: throughput", "[compress][ci]")
+{
+    uint8_t *data = malloc(TEST_BENCH_SIZE);
+    uint8_t *check = malloc(TEST_BENCH_SIZE);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_NOT_NULL(check);
+
+    for (int kind = 0; kind < 2; kind++) {
+        const bool text = (kind == 0);
+        const storage_medium_t *medium = test_compress_open(true);
+        // Random data is stored raw, keep it within the backing medium
+        const size_t size = text ? TEST_BENCH_SIZE : TEST_BENCH_SIZE / 2;
+        struct timespec start;
+        double write_s = 0;
+        double read_s = 0;
+
+        for (int pass = 0; pass < TEST_BENCH_PASSES; pass++) {
+            if (text) {
+                test_fill_text(data, size, pass + 1);
+            } else {
+                test_fill_random(data, size, pass + 1);
+            }
+            s_medium.write_bytes = 0;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            TEST_ASSERT_EQUAL(ESP_OK, medium->write(0, 0, size, data));
+            TEST_ASSERT_EQUAL(ESP_OK, storage_medium_sync(medium));
+            write_s += test_elapsed_s(&start);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            TEST_ASSERT_EQUAL(ESP_OK, medium->read(0, 0, size, check));
+            read_s += test_elapsed_s(&start);
+            TEST_ASSERT_EQUAL_MEMORY(data, check, size);
+        }
+
+        const double mb = (double)size * TEST_BENCH_PASSES / (1024 * 1024);
+        printf("compress %-6s write %7.1f MB/s  read %7.1f MB/s  written %3d%%\n", text ? "text" : "random",
+               mb / write_s, mb / read_s, (int)(s_medium.write_bytes * 100 / size));
+        if (text) {
+            TEST_ASSERT_LESS_THAN(size, s_medium.write_bytes);
+        }
+        medium->close();
+    }
+
+    free(check);
+    free(data);
+}
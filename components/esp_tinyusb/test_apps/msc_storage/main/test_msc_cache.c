@@ -0,0 +1,176 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "soc/soc_caps.h"
+#include "sdkconfig.h"
+
+#if SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_CACHE_ENABLED
+//
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+//
+#include "esp_err.h"
+#include "wear_levelling.h"
+//
+#include "unity.h"
+#include "tinyusb.h"
+#include "tinyusb_msc.h"
+//
+#include "device_common.h"
+#include "storage_common.h"
+#include "test_msc_common.h"
+
+#define TEST_CACHE_BASE_PATH        "/cache"                    // Mount path of the storage
+#define TEST_CACHE_FILE             TEST_CACHE_BASE_PATH "/data.bin"
+#define TEST_CACHE_FILE_NAME        "DATA    BIN"                // Short name in the directory entry
+#define TEST_CACHE_FILE_SIZE        4096                        // Contiguous clusters on a fresh volume
+
+static uint16_t test_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * @brief Find the first sector of the test file in the root directory through READ10, as a USB host does
+ *
+ * The storage is small enough to be FAT12/16, with a fixed root directory.
+ */
+static uint32_t test_find_file_lba(uint32_t sector_size)
+{
+    uint8_t *sector = malloc(sector_size);
+    TEST_ASSERT_NOT_NULL(sector);
+    test_storage_host_read(0, 0, sector_size, sector, sector_size);
+    const uint32_t per_cluster = sector[13];
+    const uint32_t reserved = test_le16(sector + 14);
+    const uint32_t fats = sector[16];
+    const uint32_t root_entries = test_le16(sector + 17);
+    const uint32_t fat_size = test_le16(sector + 22);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(0, root_entries, "FAT32 volume, expected FAT12/16");
+
+    const uint32_t root_lba = reserved + fats * fat_size;
+    const uint32_t root_sectors = (root_entries * 32 + sector_size - 1) / sector_size;
+    uint32_t cluster = 0;
+    for (uint32_t s = 0; s < root_sectors && cluster == 0; s++) {
+        test_storage_host_read(0, root_lba + s, sector_size, sector, sector_size);
+        for (uint32_t off = 0; off < sector_size; off += 32) {
+            if (memcmp(sector + off, TEST_CACHE_FILE_NAME, 11) == 0) {
+                cluster = test_le16(sector + off + 26);
+                break;
+            }
+        }
+    }
+    free(sector);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(0, cluster, "File not found in the root directory");
+
+    return root_lba + root_sectors + (cluster - 2) * per_cluster;
+}
+
+static void test_fill_pattern(uint8_t *buf, size_t len, uint8_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)(i * 7) ^ seed;
+    }
+}
+
+static void test_app_write_file(const uint8_t *data, size_t size, const char *mode)
+{
+    FILE *f = fopen(TEST_CACHE_FILE, mode);
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Failed to open file on storage");
+    TEST_ASSERT_EQUAL(size, fwrite(data, 1, size, f));
+    fclose(f);
+}
+
+static void test_app_read_file(uint8_t *data, size_t size)
+{
+    FILE *f = fopen(TEST_CACHE_FILE, "rb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Failed to open file on storage");
+    TEST_ASSERT_EQUAL(size, fread(data, 1, size, f));
+    fclose(f);
+}
+
+/**
+ * @brief Test case for the sector cache on the USB path
+ *
+ * Scenario:
+ * 1. Create a SPI Flash storage, write a file from the application and expose the storage to USB.
+ * 2. Find the sectors of the file and read them through READ10, they are now cached.
+ * 3. Overwrite them through WRITE10 and read back at once, twice: the cached copies follow the writes.
+ * 4. Switch to APP and read the file: the USB writes are on the medium.
+ * 5. Rewrite the file in place from the application, switch back to USB and read the sectors: the cache was
+ *    dropped while the application had the medium, no stale sector is returned.
+ */
+TEST_CASE("MSC: storage sector cache coherence", "[ci][storage][cache]")
+{
+    storage_erase_spiflash();
+    wl_handle_t wl_handle = WL_INVALID_HANDLE;
+    storage_init_spiflash(&wl_handle);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(WL_INVALID_HANDLE, wl_handle, "Wear leveling handle is invalid, check the partition configuration");
+
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,
+        .callback_arg = NULL,
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    tinyusb_msc_storage_config_t config = {
+        .medium.wl_handle = wl_handle,
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+        .fat_fs = {
+            .base_path = TEST_CACHE_BASE_PATH,
+            .config.max_files = 2,
+        },
+    };
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_new_storage_spiflash(&config, &storage_hdl), "Failed to create SPI Flash storage");
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+
+    uint32_t sector_size = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_sector_size(storage_hdl, &sector_size));
+    uint8_t *data = malloc(TEST_CACHE_FILE_SIZE);
+    uint8_t *check = malloc(TEST_CACHE_FILE_SIZE);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_NOT_NULL(check);
+
+    test_fill_pattern(data, TEST_CACHE_FILE_SIZE, 0x11);
+    test_app_write_file(data, TEST_CACHE_FILE_SIZE, "wb");
+    test_storage_set_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_USB);
+
+    // Cached on the first read
+    const uint32_t lba = test_find_file_lba(sector_size);
+    test_storage_host_read(0, lba, sector_size, check, TEST_CACHE_FILE_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(data, check, TEST_CACHE_FILE_SIZE);
+
+    // Read after write, twice so that the second write finds the copies of the first one
+    for (int i = 0; i < 2; i++) {
+        test_fill_pattern(data, TEST_CACHE_FILE_SIZE, (uint8_t)(0x3C + i));
+        test_storage_host_write(0, lba, sector_size, data, TEST_CACHE_FILE_SIZE);
+        test_storage_host_read(0, lba, sector_size, check, TEST_CACHE_FILE_SIZE);
+        TEST_ASSERT_EQUAL_MEMORY(data, check, TEST_CACHE_FILE_SIZE);
+    }
+
+    // USB writes seen by the application
+    test_storage_set_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_APP);
+    test_app_read_file(check, TEST_CACHE_FILE_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(data, check, TEST_CACHE_FILE_SIZE);
+
+    // Application writes seen by USB, past the cached copies
+    test_fill_pattern(data, TEST_CACHE_FILE_SIZE, 0xA5);
+    test_app_write_file(data, TEST_CACHE_FILE_SIZE, "r+b");
+    test_storage_set_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_USB);
+    TEST_ASSERT_EQUAL(lba, test_find_file_lba(sector_size));
+    test_storage_host_read(0, lba, sector_size, check, TEST_CACHE_FILE_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(data, check, TEST_CACHE_FILE_SIZE);
+
+    free(check);
+    free(data);
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_delete_storage(storage_hdl), "Failed to delete TinyUSB MSC storage");
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+    storage_deinit_spiflash(wl_handle);
+}
+
+#endif // SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_CACHE_ENABLED
@@ -8,7 +8,13 @@
 
 #if SOC_USB_OTG_SUPPORTED
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include "sdkconfig.h"
+#include "esp_timer.h"
 #include "unity.h"
+#include "class/msc/msc_device.h"
 #include "test_msc_common.h"
 
 
@@ -79,4 +85,86 @@ void test_storage_event_wait_callback(tinyusb_msc_event_id_t event_id)
     TEST_ASSERT_EQUAL_MESSAGE(event_id, msg.event_id, "Unexpected MSC storage event type received");
 }
 
+void test_storage_set_mount_point(tinyusb_msc_storage_handle_t storage_hdl, tinyusb_msc_mount_point_t mount_point)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_set_storage_mount_point(storage_hdl, mount_point));
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+void test_storage_measure_file_io(const char *path, size_t file_size, size_t chunk_size)
+{
+    uint8_t *buf = malloc(chunk_size);
+    TEST_ASSERT_NOT_NULL(buf);
+    for (size_t i = 0; i < chunk_size; i++) {
+        buf[i] = (uint8_t)((i * 31) ^ 0x5A);
+    }
+
+    int64_t start = esp_timer_get_time();
+    FILE *f = fopen(path, "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    for (size_t done = 0; done < file_size; done += chunk_size) {
+        TEST_ASSERT_EQUAL(chunk_size, fwrite(buf, 1, chunk_size, f));
+    }
+    fclose(f);
+    int64_t write_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    f = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    for (size_t done = 0; done < file_size; done += chunk_size) {
+        TEST_ASSERT_EQUAL(chunk_size, fread(buf, 1, chunk_size, f));
+    }
+    fclose(f);
+    int64_t read_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(0, remove(path));
+    int64_t delete_us = esp_timer_get_time() - start;
+    free(buf);
+
+    printf("%-24s write %6lld KiB/s, read %6lld KiB/s, delete %6lld us\n", path,
+           (long long)file_size * 1000000 / 1024 / (write_us ? write_us : 1),
+           (long long)file_size * 1000000 / 1024 / (read_us ? read_us : 1),
+           (long long)delete_us);
+}
+
+static uint32_t test_storage_chunk_size(uint32_t sector_size)
+{
+    const uint32_t chunk_size = (CONFIG_TINYUSB_MSC_BUFSIZE / sector_size) * sector_size;
+    TEST_ASSERT_NOT_EQUAL(0, chunk_size);
+    return chunk_size;
+}
+
+void test_storage_host_write(uint8_t lun, uint32_t lba, uint32_t sector_size, const uint8_t *data, size_t size)
+{
+    const uint32_t chunk_size = test_storage_chunk_size(sector_size);
+    size_t done = 0;
+    while (done < size) {
+        const uint32_t chunk = MIN(chunk_size, size - done);
+        int32_t ret = tud_msc_write10_cb(lun, lba + done / sector_size, 0, (uint8_t *)data + done, chunk);
+        if (ret == 0) {
+            continue;
+        }
+        TEST_ASSERT_EQUAL(chunk, ret);
+        done += chunk;
+    }
+    tud_msc_write10_complete_cb(lun);
+}
+
+void test_storage_host_read(uint8_t lun, uint32_t lba, uint32_t sector_size, uint8_t *data, size_t size)
+{
+    const uint32_t chunk_size = test_storage_chunk_size(sector_size);
+    size_t done = 0;
+    while (done < size) {
+        const uint32_t chunk = MIN(chunk_size, size - done);
+        int32_t ret = tud_msc_read10_cb(lun, lba + done / sector_size, 0, data + done, chunk);
+        if (ret == 0) {
+            continue;
+        }
+        TEST_ASSERT_EQUAL(chunk, ret);
+        done += chunk;
+    }
+}
+
 #endif // SOC_USB_OTG_SUPPORTED
@@ -26,3 +26,45 @@ void test_storage_event_cb(tinyusb_msc_storage_handle_t handle, tinyusb_msc_even
  * @param event_id The expected event ID to wait for
  */
 void test_storage_event_wait_callback(tinyusb_msc_event_id_t expected_event_id);
+
+/**
+ * @brief Change the mount point of a storage and wait for the mount events
+ *
+ * @param storage_hdl Storage handle
+ * @param mount_point New mount point
+ */
+void test_storage_set_mount_point(tinyusb_msc_storage_handle_t storage_hdl, tinyusb_msc_mount_point_t mount_point);
+
+/**
+ * @brief Write, read back and delete a file, printing the throughput
+ *
+ * @param path Path of the file to create, on a mounted storage
+ * @param file_size Size of the file
+ * @param chunk_size Size of each write and read
+ */
+void test_storage_measure_file_io(const char *path, size_t file_size, size_t chunk_size);
+
+/**
+ * @brief Write through the WRITE10 callbacks, as TinyUSB does for one command
+ *
+ * The data goes in chunks of the MSC FIFO size at most. A chunk handed back (0 returned) while the worker is still
+ * writing is passed again.
+ *
+ * @param lun Logical unit number
+ * @param lba First sector
+ * @param sector_size Sector size of the storage
+ * @param data Data to write
+ * @param size Size of the data, a multiple of the sector size
+ */
+void test_storage_host_write(uint8_t lun, uint32_t lba, uint32_t sector_size, const uint8_t *data, size_t size);
+
+/**
+ * @brief Read through the READ10 callback, as TinyUSB does for one command
+ *
+ * @param lun Logical unit number
+ * @param lba First sector
+ * @param sector_size Sector size of the storage
+ * @param data Buffer for the data
+ * @param size Size of the data, a multiple of the sector size
+ */
+void test_storage_host_read(uint8_t lun, uint32_t lba, uint32_t sector_size, uint8_t *data, size_t size);
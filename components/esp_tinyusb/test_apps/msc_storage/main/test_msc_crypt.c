@@ -0,0 +1,165 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "soc/soc_caps.h"
+#include "sdkconfig.h"
+
+#if SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_CRYPT_ENABLED
+//
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+//
+#include "esp_err.h"
+#include "wear_levelling.h"
+//
+#include "unity.h"
+#include "tinyusb.h"
+#include "tinyusb_msc.h"
+//
+#include "device_common.h"
+#include "storage_common.h"
+#include "test_msc_common.h"
+
+#define TEST_CRYPT_BASE_PATH        "/crypt"        // Mount path of the storage
+#define TEST_CRYPT_MARKER           "PLAINTEXT-MARKER-0123456789"
+#define TEST_FILE_SIZE              (64 * 1024)     // Size of the file written by the benchmark
+#define TEST_FILE_CHUNK             4096            // Size of a single write/read
+
+static const uint8_t test_key[64] = {
+    0x27, 0x18, 0x28, 0x18, 0x28, 0x45, 0x90, 0x45, 0x23, 0x53, 0x60, 0x28, 0x74, 0x71, 0x35, 0x26,
+    0x62, 0x49, 0x77, 0x57, 0x24, 0x70, 0x93, 0x69, 0x99, 0x59, 0x57, 0x49, 0x66, 0x96, 0x76, 0x27,
+    0x31, 0x41, 0x59, 0x26, 0x53, 0x58, 0x97, 0x93, 0x23, 0x84, 0x62, 0x64, 0x33, 0x83, 0x27, 0x95,
+    0x02, 0x88, 0x41, 0x97, 0x16, 0x93, 0x99, 0x37, 0x51, 0x05, 0x82, 0x09, 0x74, 0x94, 0x45, 0x92,
+};
+
+static void test_storage_create(wl_handle_t wl_handle, const uint8_t *key, tinyusb_msc_storage_handle_t *storage_hdl)
+{
+    tinyusb_msc_storage_config_t config = {
+        .medium.wl_handle = wl_handle,
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+        .fat_fs = {
+            .base_path = TEST_CRYPT_BASE_PATH,
+            .config.max_files = 2,
+        },
+        .crypt_key = key,
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_new_storage_spiflash(&config, storage_hdl), "Failed to create SPI Flash storage");
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+static void test_storage_delete(tinyusb_msc_storage_handle_t storage_hdl)
+{
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_delete_storage(storage_hdl), "Failed to delete TinyUSB MSC storage");
+    // Storage mounted to APP is unmounted on deletion
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+static bool test_medium_contains(wl_handle_t wl_handle, const char *marker)
+{
+    const size_t sector_size = wl_sector_size(wl_handle);
+    const size_t marker_len = strlen(marker);
+    uint8_t *sector = malloc(sector_size);
+    TEST_ASSERT_NOT_NULL(sector);
+
+    bool found = false;
+    for (size_t addr = 0; addr < wl_size(wl_handle) && !found; addr += sector_size) {
+        TEST_ASSERT_EQUAL(ESP_OK, wl_read(wl_handle, addr, sector, sector_size));
+        for (size_t i = 0; i + marker_len <= sector_size; i++) {
+            if (memcmp(sector + i, marker, marker_len) == 0) {
+                found = true;
+                break;
+            }
+        }
+    }
+    free(sector);
+    return found;
+}
+
+/**
+ * @brief Test case for encrypted SPI Flash storage
+ *
+ * Scenario:
+ * 1. Erase the partition and create an encrypted storage mounted to APP, it is formatted.
+ * 2. Write a file with a known marker and delete the storage.
+ * 3. Verify the marker is nowhere on the medium.
+ * 4. Re-create the storage with the same key and verify the file contents.
+ */
+TEST_CASE("MSC: storage encrypted SPI Flash", "[ci][storage][crypt]")
+{
+    storage_erase_spiflash();
+    wl_handle_t wl_handle = WL_INVALID_HANDLE;
+    storage_init_spiflash(&wl_handle);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(WL_INVALID_HANDLE, wl_handle, "Wear leveling handle is invalid, check the partition configuration");
+
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,                  // Register the callback for mount changed events
+        .callback_arg = NULL,                               // No additional argument for the callback
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    test_storage_create(wl_handle, test_key, &storage_hdl);
+
+    FILE *f = fopen(TEST_CRYPT_BASE_PATH "/secret.txt", "w");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Failed to create file on encrypted storage");
+    for (int i = 0; i < 32; i++) {
+        TEST_ASSERT_GREATER_THAN(0, fprintf(f, "%s\n", TEST_CRYPT_MARKER));
+    }
+    fclose(f);
+    test_storage_delete(storage_hdl);
+
+    TEST_ASSERT_FALSE_MESSAGE(test_medium_contains(wl_handle, TEST_CRYPT_MARKER), "Plaintext found on the medium");
+
+    // Re-created storage decrypts the file
+    test_storage_create(wl_handle, test_key, &storage_hdl);
+    char line[64];
+    f = fopen(TEST_CRYPT_BASE_PATH "/secret.txt", "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "File not found on re-created storage");
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+    fclose(f);
+    TEST_ASSERT_EQUAL_STRING(TEST_CRYPT_MARKER "\n", line);
+    test_storage_delete(storage_hdl);
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+    storage_deinit_spiflash(wl_handle);
+}
+
+/**
+ * @brief Benchmark encrypted SPI Flash storage against plain SPI Flash storage
+ *
+ * Writes, reads back and deletes a file on the same partition, first plain then encrypted, and prints
+ * the throughput of both.
+ */
+TEST_CASE("MSC: storage encrypted vs plain SPI Flash throughput", "[storage][crypt][bench]")
+{
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,
+        .callback_arg = NULL,
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    const uint8_t *keys[] = { NULL, test_key };
+    for (int i = 0; i < 2; i++) {
+        storage_erase_spiflash();
+        wl_handle_t wl_handle = WL_INVALID_HANDLE;
+        storage_init_spiflash(&wl_handle);
+        TEST_ASSERT_NOT_EQUAL(WL_INVALID_HANDLE, wl_handle);
+
+        tinyusb_msc_storage_handle_t storage_hdl = NULL;
+        test_storage_create(wl_handle, keys[i], &storage_hdl);
+        printf("%s: ", keys[i] ? "Encrypted" : "Plain");
+        test_storage_measure_file_io(TEST_CRYPT_BASE_PATH "/bench.bin", TEST_FILE_SIZE, TEST_FILE_CHUNK);
+        test_storage_delete(storage_hdl);
+        storage_deinit_spiflash(wl_handle);
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+}
+
+#endif // SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_CRYPT_ENABLED
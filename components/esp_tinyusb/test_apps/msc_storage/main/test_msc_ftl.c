@@ -0,0 +1,106 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "soc/soc_caps.h"
+#include "sdkconfig.h"
+
+#if SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_FTL_ENABLED
+//
+#include <stdio.h>
+#include <string.h>
+//
+#include "esp_err.h"
+#include "esp_partition.h"
+//
+#include "unity.h"
+#include "tinyusb.h"
+#include "tinyusb_msc.h"
+//
+#include "device_common.h"
+#include "storage_common.h"
+#include "test_msc_common.h"
+
+#define TEST_FTL_BASE_PATH          "/ftl"          // Mount path of the storage
+#define TEST_FTL_PARTITION_LABEL    "ftl"           // Raw partition of the storage
+#define TEST_FTL_MARKER             "FTL-MARKER-0123456789"
+
+static void test_storage_create(const esp_partition_t *part, tinyusb_msc_storage_handle_t *storage_hdl)
+{
+    tinyusb_msc_storage_config_t config = {
+        .medium.partition = part,
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+        .fat_fs = {
+            .base_path = TEST_FTL_BASE_PATH,
+            .config.max_files = 2,
+        },
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_new_storage_ftl(&config, storage_hdl), "Failed to create log-structured storage");
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+static void test_storage_delete(tinyusb_msc_storage_handle_t storage_hdl)
+{
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_delete_storage(storage_hdl), "Failed to delete TinyUSB MSC storage");
+    // Storage mounted to APP is unmounted on deletion
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+/**
+ * @brief Test case for log-structured SPI Flash storage
+ *
+ * Scenario:
+ * 1. Erase the partition and create a storage mounted to APP, it is formatted.
+ * 2. Write a file larger than a segment and delete the storage, the map is checkpointed.
+ * 3. Re-create the storage and verify the file, nothing was garbage collected on a fresh partition.
+ */
+TEST_CASE("MSC: storage log-structured SPI Flash", "[ci][storage][ftl]")
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TEST_FTL_PARTITION_LABEL);
+    TEST_ASSERT_NOT_NULL_MESSAGE(part, "Partition not found, check the partition configuration");
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(part, 0, part->size));
+
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,                  // Register the callback for mount changed events
+        .callback_arg = NULL,                               // No additional argument for the callback
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    test_storage_create(part, &storage_hdl);
+
+    FILE *f = fopen(TEST_FTL_BASE_PATH "/data.txt", "w");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Failed to create file on storage");
+    for (int i = 0; i < 2048; i++) {
+        TEST_ASSERT_GREATER_THAN(0, fprintf(f, "%s %04d\n", TEST_FTL_MARKER, i));
+    }
+    fclose(f);
+    test_storage_delete(storage_hdl);
+
+    test_storage_create(part, &storage_hdl);
+    char line[64];
+    char expected[64];
+    f = fopen(TEST_FTL_BASE_PATH "/data.txt", "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "File not found on re-created storage");
+    for (int i = 0; i < 2048; i++) {
+        snprintf(expected, sizeof(expected), "%s %04d\n", TEST_FTL_MARKER, i);
+        TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+        TEST_ASSERT_EQUAL_STRING(expected, line);
+    }
+    fclose(f);
+
+    tinyusb_msc_ftl_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_ftl_stats(storage_hdl, &stats));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.gc_runs);
+    TEST_ASSERT_LESS_THAN_UINT32(part->size / (32 * 1024), stats.segments);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, stats.free_segments);
+    test_storage_delete(storage_hdl);
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+}
+
+#endif // SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_FTL_ENABLED
@@ -0,0 +1,137 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "soc/soc_caps.h"
+#include "sdkconfig.h"
+
+#if SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED
+//
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+//
+#include "esp_err.h"
+#include "wear_levelling.h"
+//
+#include "unity.h"
+#include "tinyusb.h"
+#include "tinyusb_msc.h"
+//
+#include "device_common.h"
+#include "storage_common.h"
+#include "test_msc_common.h"
+
+#define TEST_INTEGRITY_BASE_PATH    "/integ"        // Mount path of the storage
+#define TEST_INTEGRITY_MARKER       "INTEGRITY-MARKER-0123456789"
+
+static void test_storage_create(wl_handle_t wl_handle, tinyusb_msc_storage_handle_t *storage_hdl)
+{
+    tinyusb_msc_storage_config_t config = {
+        .medium.wl_handle = wl_handle,
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+        .fat_fs = {
+            .base_path = TEST_INTEGRITY_BASE_PATH,
+            .config.max_files = 2,
+        },
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_new_storage_spiflash(&config, storage_hdl), "Failed to create SPI Flash storage");
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+static void test_storage_delete(tinyusb_msc_storage_handle_t storage_hdl)
+{
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_delete_storage(storage_hdl), "Failed to delete TinyUSB MSC storage");
+    // Storage mounted to APP is unmounted on deletion
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+/**
+ * @brief Flip one bit of the first sector holding the marker, bypassing the integrity layer
+ *
+ * @return true if the marker was found
+ */
+static bool test_medium_flip_bit(wl_handle_t wl_handle, const char *marker)
+{
+    const size_t sector_size = wl_sector_size(wl_handle);
+    const size_t marker_len = strlen(marker);
+    uint8_t *sector = malloc(sector_size);
+    TEST_ASSERT_NOT_NULL(sector);
+
+    bool found = false;
+    for (size_t addr = 0; addr < wl_size(wl_handle) && !found; addr += sector_size) {
+        TEST_ASSERT_EQUAL(ESP_OK, wl_read(wl_handle, addr, sector, sector_size));
+        for (size_t i = 0; i + marker_len <= sector_size; i++) {
+            if (memcmp(sector + i, marker, marker_len) == 0) {
+                sector[i] ^= 0x10;
+                TEST_ASSERT_EQUAL(ESP_OK, wl_erase_range(wl_handle, addr, sector_size));
+                TEST_ASSERT_EQUAL(ESP_OK, wl_write(wl_handle, addr, sector, sector_size));
+                found = true;
+                break;
+            }
+        }
+    }
+    free(sector);
+    return found;
+}
+
+/**
+ * @brief Test case for integrity checking of SPI Flash storage
+ *
+ * Scenario:
+ * 1. Erase the partition and create a storage mounted to APP, it is formatted.
+ * 2. Write a file with a known marker and delete the storage, the CRC table is written back.
+ * 3. Flip one bit of the file data directly on the medium.
+ * 4. Re-create the storage, verify the file reads back intact and the error was counted as corrected.
+ */
+TEST_CASE("MSC: storage SPI Flash single-bit error correction", "[ci][storage][integrity]")
+{
+    storage_erase_spiflash();
+    wl_handle_t wl_handle = WL_INVALID_HANDLE;
+    storage_init_spiflash(&wl_handle);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(WL_INVALID_HANDLE, wl_handle, "Wear leveling handle is invalid, check the partition configuration");
+
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,                  // Register the callback for mount changed events
+        .callback_arg = NULL,                               // No additional argument for the callback
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    test_storage_create(wl_handle, &storage_hdl);
+
+    FILE *f = fopen(TEST_INTEGRITY_BASE_PATH "/data.txt", "w");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Failed to create file on storage");
+    TEST_ASSERT_GREATER_THAN(0, fprintf(f, "%s\n", TEST_INTEGRITY_MARKER));
+    fclose(f);
+
+    tinyusb_msc_integrity_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_integrity_stats(storage_hdl, &stats));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.uncorrectable);
+    test_storage_delete(storage_hdl);
+
+    TEST_ASSERT_TRUE_MESSAGE(test_medium_flip_bit(wl_handle, TEST_INTEGRITY_MARKER), "Marker not found on the medium");
+
+    // Re-created storage corrects the flipped bit
+    test_storage_create(wl_handle, &storage_hdl);
+    char line[64];
+    f = fopen(TEST_INTEGRITY_BASE_PATH "/data.txt", "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "File not found on re-created storage");
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+    fclose(f);
+    TEST_ASSERT_EQUAL_STRING(TEST_INTEGRITY_MARKER "\n", line);
+
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_integrity_stats(storage_hdl, &stats));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.corrected);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.uncorrectable);
+    test_storage_delete(storage_hdl);
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+    storage_deinit_spiflash(wl_handle);
+}
+
+#endif // SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED
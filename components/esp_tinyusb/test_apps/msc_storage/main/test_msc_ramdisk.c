@@ -0,0 +1,174 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "soc/soc_caps.h"
+
+#if SOC_USB_OTG_SUPPORTED
+//
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+//
+#include "esp_err.h"
+#include "esp_partition.h"
+//
+#include "unity.h"
+#include "tinyusb.h"
+#include "tinyusb_msc.h"
+//
+#include "device_common.h"
+#include "storage_common.h"
+#include "test_msc_common.h"
+
+#define TEST_RAMDISK_SIZE           (128 * 1024)    // Size of the RAM disk, fits the snapshot partition
+#define TEST_RAMDISK_BASE_PATH      "/ram"          // Mount path of the RAM disk
+#define TEST_FLASH_BASE_PATH        "/flash"        // Mount path of the SPI Flash storage
+#define TEST_FILE_SIZE              (64 * 1024)     // Size of the file written by the tests
+#define TEST_FILE_CHUNK             4096            // Size of a single write/read
+
+static const esp_partition_t *test_snapshot_partition(void)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_DATA_UNDEFINED, "snapshot");
+    TEST_ASSERT_NOT_NULL_MESSAGE(part, "Snapshot partition not found, check the partition table");
+    return part;
+}
+
+static void test_ramdisk_create(const esp_partition_t *snapshot, tinyusb_msc_storage_handle_t *storage_hdl)
+{
+    tinyusb_msc_storage_config_t config = {
+        .medium.ramdisk = {
+            .size = TEST_RAMDISK_SIZE,
+            .snapshot_partition = snapshot,
+        },
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+        .fat_fs = {
+            .base_path = TEST_RAMDISK_BASE_PATH,
+            .config.max_files = 2,
+        },
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_new_storage_ramdisk(&config, storage_hdl), "Failed to create RAM disk storage");
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+static void test_storage_delete(tinyusb_msc_storage_handle_t storage_hdl)
+{
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_delete_storage(storage_hdl), "Failed to delete TinyUSB MSC storage");
+    // Storage mounted to APP is unmounted on deletion
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+static void test_fill_pattern(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)((i * 31) ^ seed);
+    }
+}
+
+/**
+ * @brief Test case for RAM disk snapshots
+ *
+ * Scenario:
+ * 1. Erase the snapshot partition and create a RAM disk storage mounted to APP, it is formatted.
+ * 2. Write a file and take a snapshot.
+ * 3. Delete and re-create the storage, it is loaded from the snapshot.
+ * 4. Verify the file contents.
+ */
+TEST_CASE("MSC: storage RAM disk snapshot", "[ci][storage][ramdisk]")
+{
+    const esp_partition_t *snapshot = test_snapshot_partition();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(snapshot, 0, snapshot->size));
+
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,                  // Register the callback for mount changed events
+        .callback_arg = NULL,                               // No additional argument for the callback
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    test_ramdisk_create(snapshot, &storage_hdl);
+
+    uint8_t *data = malloc(TEST_FILE_CHUNK);
+    uint8_t *check = malloc(TEST_FILE_CHUNK);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_NOT_NULL(check);
+    test_fill_pattern(data, TEST_FILE_CHUNK, 0xA5);
+
+    FILE *f = fopen(TEST_RAMDISK_BASE_PATH "/scratch.bin", "wb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Failed to create file on RAM disk");
+    TEST_ASSERT_EQUAL(TEST_FILE_CHUNK, fwrite(data, 1, TEST_FILE_CHUNK, f));
+    fclose(f);
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_snapshot_storage(storage_hdl), "Failed to take snapshot");
+    test_storage_delete(storage_hdl);
+
+    // Re-created storage is loaded from the snapshot
+    test_ramdisk_create(snapshot, &storage_hdl);
+    f = fopen(TEST_RAMDISK_BASE_PATH "/scratch.bin", "rb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "File was not restored from the snapshot");
+    TEST_ASSERT_EQUAL(TEST_FILE_CHUNK, fread(check, 1, TEST_FILE_CHUNK, f));
+    fclose(f);
+    TEST_ASSERT_EQUAL_MEMORY(data, check, TEST_FILE_CHUNK);
+
+    test_storage_delete(storage_hdl);
+
+    // Storage without a snapshot partition can't take snapshots
+    test_ramdisk_create(NULL, &storage_hdl);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, tinyusb_msc_snapshot_storage(storage_hdl));
+    test_storage_delete(storage_hdl);
+
+    free(check);
+    free(data);
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+}
+
+/**
+ * @brief Benchmark the RAM disk against SPI Flash storage
+ *
+ * Writes, reads back and deletes a file on both storages, mounted to APP, and prints the throughput.
+ * This is the "drop a file, process it, delete it" scratch workflow, without the USB transfer itself.
+ */
+TEST_CASE("MSC: storage RAM disk vs SPI Flash throughput", "[storage][ramdisk][bench]")
+{
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,
+        .callback_arg = NULL,
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    // SPI Flash storage
+    wl_handle_t wl_handle = WL_INVALID_HANDLE;
+    storage_init_spiflash(&wl_handle);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(WL_INVALID_HANDLE, wl_handle, "Wear leveling handle is invalid, check the partition configuration");
+    tinyusb_msc_storage_config_t flash_cfg = {
+        .medium.wl_handle = wl_handle,
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+        .fat_fs = {
+            .base_path = TEST_FLASH_BASE_PATH,
+            .config.max_files = 2,
+        },
+    };
+    tinyusb_msc_storage_handle_t flash_hdl = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_new_storage_spiflash(&flash_cfg, &flash_hdl));
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+
+    // RAM disk storage
+    tinyusb_msc_storage_handle_t ram_hdl = NULL;
+    test_ramdisk_create(NULL, &ram_hdl);
+
+    test_storage_measure_file_io(TEST_FLASH_BASE_PATH "/bench.bin", TEST_FILE_SIZE, TEST_FILE_CHUNK);
+    test_storage_measure_file_io(TEST_RAMDISK_BASE_PATH "/bench.bin", TEST_FILE_SIZE, TEST_FILE_CHUNK);
+
+    test_storage_delete(ram_hdl);
+    test_storage_delete(flash_hdl);
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+    storage_deinit_spiflash(wl_handle);
+}
+
+#endif // SOC_USB_OTG_SUPPORTED
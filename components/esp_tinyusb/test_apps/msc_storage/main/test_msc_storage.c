@@ -18,12 +18,15 @@
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "ff.h"
+#include "spi_flash_mmap.h"
 //
 #include "unity.h"
 #include "device_common.h"
 #include "tinyusb.h"
 #include "tinyusb_default_config.h"
 #include "tinyusb_msc.h"
+#include "class/msc/msc_device.h"
 #include "storage_common.h"
 //
 #include "test_msc_common.h"
@@ -46,14 +49,18 @@ TEST_CASE("MSC: Public API consistency", "[ci][driver]")
 #if (SOC_SDMMC_HOST_SUPPORTED)
     TEST_ASSERT_NOT_NULL(tinyusb_msc_new_storage_sdmmc);
 #endif // SOC_SDMMC_HOST_SUPPORTED
+    TEST_ASSERT_NOT_NULL(tinyusb_msc_new_storage_ramdisk);
     TEST_ASSERT_NOT_NULL(tinyusb_msc_delete_storage);
     TEST_ASSERT_NOT_NULL(tinyusb_msc_set_storage_callback);
     TEST_ASSERT_NOT_NULL(tinyusb_msc_set_storage_mount_point);
     TEST_ASSERT_NOT_NULL(tinyusb_msc_config_storage_fat_fs);
     TEST_ASSERT_NOT_NULL(tinyusb_msc_format_storage);
+    TEST_ASSERT_NOT_NULL(tinyusb_msc_set_storage_capacity);
+    TEST_ASSERT_NOT_NULL(tinyusb_msc_snapshot_storage);
     TEST_ASSERT_NOT_NULL(tinyusb_msc_get_storage_capacity);
     TEST_ASSERT_NOT_NULL(tinyusb_msc_get_storage_sector_size);
     TEST_ASSERT_NOT_NULL(tinyusb_msc_get_storage_mount_point);
+    TEST_ASSERT_NOT_NULL(tinyusb_msc_get_storage_drive);
 
     // Functions signatures should match the expected ones and do not fall during compilation
     // Driver
@@ -75,12 +82,15 @@ TEST_CASE("MSC: Public API consistency", "[ci][driver]")
     tinyusb_msc_set_storage_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_USB);
     tinyusb_msc_config_storage_fat_fs(storage_hdl, NULL);
     tinyusb_msc_format_storage(storage_hdl);
+    tinyusb_msc_set_storage_capacity(storage_hdl, 0);
     uint32_t sector_count = 0;
     tinyusb_msc_get_storage_capacity(storage_hdl, &sector_count);
     uint32_t sector_size = 0;
     tinyusb_msc_get_storage_sector_size(storage_hdl, &sector_size);
     tinyusb_msc_mount_point_t mount_point = TINYUSB_MSC_STORAGE_MOUNT_USB;
     tinyusb_msc_get_storage_mount_point(storage_hdl, &mount_point);
+    uint8_t pdrv = 0xFF;
+    tinyusb_msc_get_storage_drive(storage_hdl, &pdrv);
 }
 
 /**
@@ -211,6 +221,93 @@ TEST_CASE("MSC: storage SPI Flash", "[ci][storage][spiflash]")
     storage_deinit_spiflash(wl_handle);
 }
 
+// Last sense data set by the driver, tud_msc_set_sense() is wrapped at link time (see CMakeLists.txt)
+static struct {
+    uint8_t key;
+    uint8_t asc;
+    uint8_t ascq;
+} s_sense;
+
+bool __real_tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier);
+
+bool __wrap_tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier)
+{
+    s_sense.key = sense_key;
+    s_sense.asc = add_sense_code;
+    s_sense.ascq = add_sense_qualifier;
+    return __real_tud_msc_set_sense(lun, sense_key, add_sense_code, add_sense_qualifier);
+}
+
+/**
+ * @brief Test case for changing the capacity reported to the host
+ *
+ * Scenario:
+ * 1. Initialize SPIFLASH storage with wear levelling and create the MSC storage.
+ * 2. Limit the capacity to half of the medium and verify it is reported.
+ * 3. Expose the storage to USB and verify that TEST UNIT READY fails once with
+ *    UNIT ATTENTION, CAPACITY DATA HAS CHANGED, then succeeds.
+ * 4. Verify that a capacity larger than the medium is rejected.
+ * 5. Restore the full capacity.
+ * 6. Delete the storage and deinitialize SPIFLASH storage.
+ */
+TEST_CASE("MSC: storage capacity change", "[ci][storage][spiflash]")
+{
+    wl_handle_t wl_handle = WL_INVALID_HANDLE;
+    storage_init_spiflash(&wl_handle);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(WL_INVALID_HANDLE, wl_handle, "Wear leveling handle is invalid, check the partition configuration");
+
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,                  // Register the callback for mount changed events
+        .callback_arg = NULL,                               // No additional argument for the callback
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    tinyusb_msc_storage_config_t config = {
+        .medium.wl_handle = wl_handle,                      // Set the context to the wear leveling handle
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,       // Initial mount point to APP
+        .fat_fs = {
+            .base_path = NULL,                              // Use default base path
+            .config.max_files = 5,                          // Maximum number of files that can be opened simultaneously
+            .format_flags = 0,                              // No special format flags
+        },
+    };
+
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_new_storage_spiflash(&config, &storage_hdl));
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+
+    uint32_t full = 0, sector_count = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_capacity(storage_hdl, &full));
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_set_storage_capacity(storage_hdl, full / 2));
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_capacity(storage_hdl, &sector_count));
+    TEST_ASSERT_EQUAL(full / 2, sector_count);
+
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_set_storage_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_USB));
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+    memset(&s_sense, 0, sizeof(s_sense));
+    TEST_ASSERT_FALSE(tud_msc_test_unit_ready_cb(0));
+    TEST_ASSERT_EQUAL_HEX8(SCSI_SENSE_UNIT_ATTENTION, s_sense.key);
+    TEST_ASSERT_EQUAL_HEX8(0x2A, s_sense.asc);      // PARAMETERS CHANGED
+    TEST_ASSERT_EQUAL_HEX8(0x09, s_sense.ascq);     // CAPACITY DATA HAS CHANGED
+    // Reported once
+    TEST_ASSERT_TRUE(tud_msc_test_unit_ready_cb(0));
+    uint32_t block_count = 0;
+    uint16_t block_size = 0;
+    tud_msc_capacity_cb(0, &block_count, &block_size);
+    TEST_ASSERT_EQUAL(full / 2, block_count);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, tinyusb_msc_set_storage_capacity(storage_hdl, full + 1));
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_set_storage_capacity(storage_hdl, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_capacity(storage_hdl, &sector_count));
+    TEST_ASSERT_EQUAL(full, sector_count);
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_delete_storage(storage_hdl), "Failed to delete TinyUSB MSC storage");
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+    storage_deinit_spiflash(wl_handle);
+}
+
 #if (SOC_SDMMC_HOST_SUPPORTED)
 /**
  * @brief Test case for initializing TinyUSB MSC storage with SDMMC
@@ -523,12 +620,27 @@ TEST_CASE("MSC: format storage SPI Flash, mounted to APP", "[ci][storage][spifla
     TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_mount_point(storage_hdl, &mount_point));
     TEST_ASSERT_EQUAL(TINYUSB_MSC_STORAGE_MOUNT_APP, mount_point);
     TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_format_storage(storage_hdl));
+    // The application mount is on the drive reported by the storage
+    uint8_t pdrv = 0xFF;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_drive(storage_hdl, &pdrv));
+    const char drv[3] = {(char)('0' + pdrv), ':', 0};
+    // Data area must start on a cluster and flash erase block boundary
+    FATFS *fs = NULL;
+    DWORD free_clusters = 0;
+    TEST_ASSERT_EQUAL(FR_OK, f_getfree(drv, &free_clusters, &fs));
+    uint32_t sector_size = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_sector_size(storage_hdl, &sector_size));
+    const uint32_t cluster_bytes = fs->csize * sector_size;
+    const uint32_t align_bytes = cluster_bytes > SPI_FLASH_SEC_SIZE ? cluster_bytes : SPI_FLASH_SEC_SIZE;
+    TEST_ASSERT_EQUAL(0, ((fs->database - fs->volbase) * sector_size) % align_bytes);
     // Install TinyUSB driver
     tinyusb_config_t tusb_cfg = TINYUSB_DEFAULT_CONFIG(test_device_event_handler);
     TEST_ASSERT_EQUAL(ESP_OK, tinyusb_driver_install(&tusb_cfg));
     test_device_wait();
     test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
     test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+    // The host owns the storage, there is no application mount
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, tinyusb_msc_get_storage_drive(storage_hdl, &pdrv));
     vTaskDelay(pdMS_TO_TICKS(TEST_DEVICE_PRESENCE_TIMEOUT_MS)); // Allow some time for the device to be recognized
 
     TEST_ASSERT_EQUAL(ESP_OK, tinyusb_driver_uninstall());
@@ -0,0 +1,192 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "soc/soc_caps.h"
+#include "sdkconfig.h"
+
+#if SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+//
+#include "esp_err.h"
+#include "wear_levelling.h"
+//
+#include "unity.h"
+#include "tinyusb.h"
+#include "tinyusb_msc.h"
+#include "class/msc/msc_device.h"
+//
+#include "device_common.h"
+#include "storage_common.h"
+#include "test_msc_common.h"
+
+#define TEST_WEAR_BASE_PATH         "/wear"         // Mount path of the storage
+#define TEST_WEAR_RECORDS           64              // Appends, each one synced
+#define TEST_WEAR_BLOCK_SIZE        4096            // Flash erase block
+#define TEST_WEAR_REWRITES          16              // WRITE10 commands to the same hot block
+
+static void test_storage_create(wl_handle_t wl_handle, tinyusb_msc_storage_handle_t *storage_hdl)
+{
+    tinyusb_msc_storage_config_t config = {
+        .medium.wl_handle = wl_handle,
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+        .fat_fs = {
+            .base_path = TEST_WEAR_BASE_PATH,
+            .config.max_files = 2,
+        },
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_new_storage_spiflash(&config, storage_hdl), "Failed to create SPI Flash storage");
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+static int32_t test_host_sync_cache(void)
+{
+    uint8_t cmd[16] = { 0x35 }; // SYNCHRONIZE CACHE (10), whole medium
+    return tud_msc_scsi_cb(0, cmd, NULL, 0);
+}
+
+static void test_storage_delete(tinyusb_msc_storage_handle_t storage_hdl)
+{
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_delete_storage(storage_hdl), "Failed to delete TinyUSB MSC storage");
+    // Storage mounted to APP is unmounted on deletion
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+}
+
+/**
+ * @brief Test case for SPI Flash erase statistics and hot block write combining
+ *
+ * Scenario:
+ * 1. Erase the partition and create a storage mounted to APP, it is formatted.
+ * 2. Append records to a file, syncing after each one: every sync rewrites the FAT and the directory entry.
+ * 3. Verify the metadata blocks were found, erases were counted and FAT updates were combined.
+ * 4. Re-create the storage and verify the file, pending hot blocks are written on deletion.
+ */
+TEST_CASE("MSC: storage SPI Flash wear statistics", "[ci][storage][wear]")
+{
+    storage_erase_spiflash();
+    wl_handle_t wl_handle = WL_INVALID_HANDLE;
+    storage_init_spiflash(&wl_handle);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(WL_INVALID_HANDLE, wl_handle, "Wear leveling handle is invalid, check the partition configuration");
+
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,                  // Register the callback for mount changed events
+        .callback_arg = NULL,                               // No additional argument for the callback
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    test_storage_create(wl_handle, &storage_hdl);
+
+    tinyusb_msc_wear_stats_t before;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_wear_stats(storage_hdl, &before));
+    TEST_ASSERT_GREATER_THAN_UINT32(0, before.erase_blocks);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, before.metadata_blocks);
+
+    FILE *f = fopen(TEST_WEAR_BASE_PATH "/log.txt", "w");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "Failed to create file on storage");
+    for (int i = 0; i < TEST_WEAR_RECORDS; i++) {
+        TEST_ASSERT_GREATER_THAN(0, fprintf(f, "record %03d\n", i));
+        fflush(f);
+        fsync(fileno(f));
+    }
+    fclose(f);
+
+    tinyusb_msc_wear_stats_t after;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_wear_stats(storage_hdl, &after));
+    printf("Erases %"PRIu32" (%"PRIu32" partial), %"PRIu32" writes combined, %"PRIu32" hot blocks, max write %"PRIu32" us\n",
+           after.erase_total - before.erase_total, after.partial_erases, after.coalesced_writes, after.hot_blocks, after.max_write_us);
+    TEST_ASSERT_GREATER_THAN_UINT32(before.erase_total, after.erase_total);
+    // Both FAT copies and the directory entry are rewritten by every sync, some of them share a block
+    TEST_ASSERT_GREATER_THAN_UINT32(before.coalesced_writes, after.coalesced_writes);
+    test_storage_delete(storage_hdl);
+
+    // Hot blocks were written back on deletion
+    test_storage_create(wl_handle, &storage_hdl);
+    char line[32];
+    int count = 0;
+    f = fopen(TEST_WEAR_BASE_PATH "/log.txt", "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, "File not found on re-created storage");
+    while (fgets(line, sizeof(line), f) != NULL) {
+        count++;
+    }
+    fclose(f);
+    TEST_ASSERT_EQUAL(TEST_WEAR_RECORDS, count);
+    test_storage_delete(storage_hdl);
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+    storage_deinit_spiflash(wl_handle);
+}
+
+/**
+ * @brief Test case for hot block write combining on the USB path
+ *
+ * Scenario:
+ * 1. Create a formatted storage and expose it to USB, write everything back with SYNCHRONIZE CACHE.
+ * 2. Rewrite the first block (boot sector and FAT, a metadata block) with its own content, one WRITE10 command
+ *    at a time: no erase, the writes are combined in RAM.
+ * 3. Send SYNCHRONIZE CACHE: the block is written with a single erase, instead of one per command.
+ * 4. Read the block back through READ10.
+ */
+TEST_CASE("MSC: storage SPI Flash hot blocks written on SYNCHRONIZE CACHE", "[ci][storage][wear]")
+{
+    storage_erase_spiflash();
+    wl_handle_t wl_handle = WL_INVALID_HANDLE;
+    storage_init_spiflash(&wl_handle);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(WL_INVALID_HANDLE, wl_handle, "Wear leveling handle is invalid, check the partition configuration");
+
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,
+        .callback_arg = NULL,
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    test_storage_create(wl_handle, &storage_hdl);
+    test_storage_set_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_USB);
+
+    uint32_t sector_size = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_sector_size(storage_hdl, &sector_size));
+    uint8_t *block = malloc(TEST_WEAR_BLOCK_SIZE);
+    uint8_t *check = malloc(TEST_WEAR_BLOCK_SIZE);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_NOT_NULL(check);
+    test_storage_host_read(0, 0, sector_size, block, TEST_WEAR_BLOCK_SIZE);
+
+    TEST_ASSERT_EQUAL(0, test_host_sync_cache());
+    tinyusb_msc_wear_stats_t before;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_wear_stats(storage_hdl, &before));
+
+    for (int i = 0; i < TEST_WEAR_REWRITES; i++) {
+        test_storage_host_write(0, 0, sector_size, block, TEST_WEAR_BLOCK_SIZE);
+    }
+    tinyusb_msc_wear_stats_t pending;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_wear_stats(storage_hdl, &pending));
+    TEST_ASSERT_EQUAL_UINT32(before.erase_total, pending.erase_total);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(before.coalesced_writes + TEST_WEAR_REWRITES - 1, pending.coalesced_writes);
+
+    TEST_ASSERT_EQUAL(0, test_host_sync_cache());
+    tinyusb_msc_wear_stats_t after;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_wear_stats(storage_hdl, &after));
+    printf("%d rewrites of a hot block: %"PRIu32" erase(s)\n", TEST_WEAR_REWRITES, after.erase_total - before.erase_total);
+    TEST_ASSERT_EQUAL_UINT32(before.erase_total + 1, after.erase_total);
+
+    test_storage_host_read(0, 0, sector_size, check, TEST_WEAR_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(block, check, TEST_WEAR_BLOCK_SIZE);
+
+    free(check);
+    free(block);
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_delete_storage(storage_hdl), "Failed to delete TinyUSB MSC storage");
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+    storage_deinit_spiflash(wl_handle);
+}
+
+#endif // SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_SPIFLASH_WEAR_STATS
@@ -0,0 +1,105 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "soc/soc_caps.h"
+#include "sdkconfig.h"
+
+#if SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_WRITE_WORKER
+//
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+//
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+//
+#include "esp_err.h"
+//
+#include "unity.h"
+#include "tinyusb.h"
+#include "tinyusb_msc.h"
+//
+#include "device_common.h"
+#include "test_msc_common.h"
+
+#define TEST_RAMDISK_SIZE           (128 * 1024)    // Size of the RAM disk
+#define TEST_RAMDISK_BASE_PATH      "/ram"          // Mount path of the RAM disk
+#define TEST_WRITE_SIZE             (8 * 1024)      // Size of a WRITE10 command, at the end of the disk
+
+/**
+ * @brief Test case for the medium write worker
+ *
+ * Scenario:
+ * 1. Create a RAM disk storage and expose it to USB, the worker isn't started yet.
+ * 2. Write through the WRITE10 callbacks and read back at once: the read waits for the worker, started by the
+ *    write on the core of the task calling the callbacks (the TinyUSB task on a device).
+ * 3. Write and switch to APP at once, switch back and read: the mount waited for the worker.
+ * 4. Write and delete the storage at once: the deletion waits for the worker instead of failing.
+ */
+TEST_CASE("MSC: storage write worker", "[ci][storage][ramdisk]")
+{
+    tinyusb_msc_driver_config_t driver_cfg = {
+        .callback = test_storage_event_cb,
+        .callback_arg = NULL,
+    };
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_install_driver(&driver_cfg), "Failed to install TinyUSB MSC driver");
+    TEST_ASSERT_NULL_MESSAGE(xTaskGetHandle("msc_write"), "Worker task started before the first write");
+
+    tinyusb_msc_storage_config_t config = {
+        .medium.ramdisk = {
+            .size = TEST_RAMDISK_SIZE,
+        },
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+        .fat_fs = {
+            .base_path = TEST_RAMDISK_BASE_PATH,
+            .config.max_files = 2,
+        },
+    };
+    tinyusb_msc_storage_handle_t storage_hdl = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_new_storage_ramdisk(&config, &storage_hdl));
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_START);
+    test_storage_event_wait_callback(TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
+    test_storage_set_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_USB);
+
+    uint32_t sector_size = 0;
+    uint32_t sector_count = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_sector_size(storage_hdl, &sector_size));
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_get_storage_capacity(storage_hdl, &sector_count));
+    // Free clusters at the end of the disk, the filesystem doesn't use them
+    const uint32_t lba = sector_count - TEST_WRITE_SIZE / sector_size;
+
+    uint8_t *data = malloc(TEST_WRITE_SIZE);
+    uint8_t *check = malloc(TEST_WRITE_SIZE);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_NOT_NULL(check);
+
+    // Read right after the write
+    memset(data, 0x5A, TEST_WRITE_SIZE);
+    test_storage_host_write(0, lba, sector_size, data, TEST_WRITE_SIZE);
+    test_storage_host_read(0, lba, sector_size, check, TEST_WRITE_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(data, check, TEST_WRITE_SIZE);
+    TaskHandle_t worker = xTaskGetHandle("msc_write");
+    TEST_ASSERT_NOT_NULL_MESSAGE(worker, "Worker task not running");
+    TEST_ASSERT_EQUAL(xTaskGetCoreID(xTaskGetCurrentTaskHandle()), xTaskGetCoreID(worker));
+
+    // Mount to APP right after the write
+    memset(data, 0xC3, TEST_WRITE_SIZE);
+    test_storage_host_write(0, lba, sector_size, data, TEST_WRITE_SIZE);
+    test_storage_set_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_APP);
+    test_storage_set_mount_point(storage_hdl, TINYUSB_MSC_STORAGE_MOUNT_USB);
+    test_storage_host_read(0, lba, sector_size, check, TEST_WRITE_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(data, check, TEST_WRITE_SIZE);
+
+    // Delete right after the write
+    test_storage_host_write(0, lba, sector_size, data, TEST_WRITE_SIZE);
+    TEST_ASSERT_EQUAL(ESP_OK, tinyusb_msc_delete_storage(storage_hdl));
+
+    free(check);
+    free(data);
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tinyusb_msc_uninstall_driver(), "Failed to uninstall TinyUSB MSC driver");
+}
+
+#endif // SOC_USB_OTG_SUPPORTED && CONFIG_TINYUSB_MSC_WRITE_WORKER
@@ -5,14 +5,17 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include "esp_check.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "tusb.h"
 #include "tinyusb_cdc_acm.h"
 #include "cdc.h"
+#include "cdc_rx_ring.h"
 #include "sdkconfig.h"
 
 #ifndef MIN
@@ -33,6 +36,9 @@ typedef struct {
     tusb_cdcacm_callback_t callback_rx_wanted_char;
     tusb_cdcacm_callback_t callback_line_state_changed;
     tusb_cdcacm_callback_t callback_line_coding_changed;
+    void (*notify)(int itf); /*!< Driver on top of the interface, woken on RX and TX complete */
+    cdc_rx_ring_t rx_ring; /*!< RX span buffer, buf is NULL if not configured */
+    SemaphoreHandle_t rx_lock; /*!< Serializes moving data from the TinyUSB FIFO to rx_ring */
 } esp_tusb_cdcacm_t; /*!< CDC_ACM object */
 
 static const char *TAG = "tusb_cdc_acm";
@@ -46,6 +52,26 @@ static inline esp_tusb_cdcacm_t *get_acm(tinyusb_cdcacm_itf_t itf)
     return (esp_tusb_cdcacm_t *)(cdc_inst->subclass_obj);
 }
 
+/**
+ * @brief Move received data from the TinyUSB RX FIFO to the span buffer
+ *
+ * Runs on RX, and in the consumer's task when it frees space while data is left in the FIFO.
+ * Draining the FIFO on every packet lets TinyUSB re-arm the OUT endpoint right away.
+ */
+static void rx_ring_fill(int itf, esp_tusb_cdcacm_t *acm)
+{
+    xSemaphoreTake(acm->rx_lock, portMAX_DELAY);
+    uint8_t *span;
+    size_t space;
+    while (tud_cdc_n_available(itf) > 0 && (space = cdc_rx_ring_write_span(&acm->rx_ring, &span)) > 0) {
+        const uint32_t received = tud_cdc_n_read(itf, span, space);
+        if (received == 0) {
+            break;
+        }
+        cdc_rx_ring_commit(&acm->rx_ring, received);
+    }
+    xSemaphoreGive(acm->rx_lock);
+}
 
 /* TinyUSB callbacks
    ********************************************************************* */
@@ -92,7 +118,14 @@ void tud_cdc_rx_cb(uint8_t itf)
     if (acm) {
         CDC_ACM_ENTER_CRITICAL();
         tusb_cdcacm_callback_t cb = acm->callback_rx;
+        void (*notify)(int itf) = acm->notify;
         CDC_ACM_EXIT_CRITICAL();
+        if (acm->rx_ring.buf) {
+            rx_ring_fill(itf, acm);
+        }
+        if (notify) {
+            notify(itf);
+        }
         if (cb) {
             cdcacm_event_t event = {
                 .type = CDC_EVENT_RX
@@ -122,6 +155,20 @@ void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const *p_line_coding)
     }
 }
 
+// Invoked when a transfer to the host completed, there is room in the TX FIFO
+void tud_cdc_tx_complete_cb(uint8_t itf)
+{
+    esp_tusb_cdcacm_t *acm = get_acm(itf);
+    if (acm) {
+        CDC_ACM_ENTER_CRITICAL();
+        void (*notify)(int itf) = acm->notify;
+        CDC_ACM_EXIT_CRITICAL();
+        if (notify) {
+            notify(itf);
+        }
+    }
+}
+
 // Invoked when received `wanted_char`
 void tud_cdc_rx_wanted_cb(uint8_t itf, char wanted_char)
 {
@@ -214,6 +261,16 @@ esp_err_t tinyusb_cdcacm_unregister_callback(tinyusb_cdcacm_itf_t itf,
     }
 }
 
+esp_err_t tinyusb_cdcacm_set_notify(int itf, void (*notify)(int itf))
+{
+    esp_tusb_cdcacm_t *acm = get_acm(itf);
+    ESP_RETURN_ON_FALSE(acm, ESP_ERR_INVALID_STATE, TAG, "Interface is not initialized. Use `tinyusb_cdc_init` for initialization");
+    CDC_ACM_ENTER_CRITICAL();
+    acm->notify = notify;
+    CDC_ACM_EXIT_CRITICAL();
+    return ESP_OK;
+}
+
 /*********************************************************************** TinyUSB callbacks*/
 /* CDC-ACM
    ********************************************************************* */
@@ -223,7 +280,18 @@ esp_err_t tinyusb_cdcacm_read(tinyusb_cdcacm_itf_t itf, uint8_t *out_buf, size_t
     esp_tusb_cdcacm_t *acm = get_acm(itf);
     ESP_RETURN_ON_FALSE(acm, ESP_ERR_INVALID_STATE, TAG, "Interface is not initialized. Use `tinyusb_cdc_init` for initialization");
 
-    if (tud_cdc_n_available(itf) == 0) {
+    if (acm->rx_ring.buf) {
+        size_t copied = 0;
+        const uint8_t *span;
+        size_t len;
+        while (copied < out_buf_sz && (len = cdc_rx_ring_peek(&acm->rx_ring, &span)) > 0) {
+            len = MIN(len, out_buf_sz - copied);
+            memcpy(out_buf + copied, span, len);
+            tinyusb_cdcacm_rx_consume(itf, len);
+            copied += len;
+        }
+        *rx_data_size = copied;
+    } else if (tud_cdc_n_available(itf) == 0) {
         *rx_data_size = 0;
     } else {
         *rx_data_size = tud_cdc_n_read(itf, out_buf, out_buf_sz);
@@ -231,6 +299,32 @@ esp_err_t tinyusb_cdcacm_read(tinyusb_cdcacm_itf_t itf, uint8_t *out_buf, size_t
     return ESP_OK;
 }
 
+esp_err_t tinyusb_cdcacm_rx_peek(tinyusb_cdcacm_itf_t itf, const uint8_t **data, size_t *size)
+{
+    esp_tusb_cdcacm_t *acm = get_acm(itf);
+    ESP_RETURN_ON_FALSE(acm, ESP_ERR_INVALID_STATE, TAG, "Interface is not initialized. Use `tinyusb_cdc_init` for initialization");
+    ESP_RETURN_ON_FALSE(acm->rx_ring.buf, ESP_ERR_NOT_SUPPORTED, TAG, "No RX span buffer, set `rx_span_buf_size`");
+    ESP_RETURN_ON_FALSE(data && size, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    *size = cdc_rx_ring_peek(&acm->rx_ring, data);
+    return ESP_OK;
+}
+
+esp_err_t tinyusb_cdcacm_rx_consume(tinyusb_cdcacm_itf_t itf, size_t size)
+{
+    esp_tusb_cdcacm_t *acm = get_acm(itf);
+    ESP_RETURN_ON_FALSE(acm, ESP_ERR_INVALID_STATE, TAG, "Interface is not initialized. Use `tinyusb_cdc_init` for initialization");
+    ESP_RETURN_ON_FALSE(acm->rx_ring.buf, ESP_ERR_NOT_SUPPORTED, TAG, "No RX span buffer, set `rx_span_buf_size`");
+    ESP_RETURN_ON_FALSE(size <= cdc_rx_ring_used(&acm->rx_ring), ESP_ERR_INVALID_ARG, TAG, "Consuming more than received");
+
+    cdc_rx_ring_consume(&acm->rx_ring, size);
+    // Data left in the FIFO while the span buffer was full, no RX callback comes for it
+    if (tud_cdc_n_available(itf) > 0) {
+        rx_ring_fill(itf, acm);
+    }
+    return ESP_OK;
+}
+
 size_t tinyusb_cdcacm_write_queue_char(tinyusb_cdcacm_itf_t itf, char ch)
 {
     if (!get_acm(itf)) { // non-initialized
@@ -305,7 +399,13 @@ static esp_err_t obj_free(tinyusb_cdcacm_itf_t itf)
     if (cdc_inst == NULL || cdc_inst->subclass_obj == NULL) {
         return ESP_FAIL;
     }
+    esp_tusb_cdcacm_t *acm = (esp_tusb_cdcacm_t *)cdc_inst->subclass_obj;
+    if (acm->rx_lock) {
+        vSemaphoreDelete(acm->rx_lock);
+    }
+    cdc_rx_ring_free(&acm->rx_ring);
     free(cdc_inst->subclass_obj);
+    cdc_inst->subclass_obj = NULL;
     return ESP_OK;
 }
 
@@ -321,6 +421,13 @@ esp_err_t tinyusb_cdcacm_init(const tinyusb_config_cdcacm_t *cfg)
 
     ESP_RETURN_ON_ERROR(tinyusb_cdc_init(itf, &cdc_cfg), TAG, "tinyusb_cdc_init failed");
     ESP_GOTO_ON_ERROR(alloc_obj(itf), fail, TAG, "alloc_obj failed");
+    if (cfg->rx_span_buf_size) {
+        esp_tusb_cdcacm_t *acm = get_acm(itf);
+        acm->rx_lock = xSemaphoreCreateMutex();
+        ESP_GOTO_ON_FALSE(acm->rx_lock, ESP_ERR_NO_MEM, fail_obj, TAG, "RX lock allocation failed");
+        ESP_GOTO_ON_FALSE(cdc_rx_ring_init(&acm->rx_ring, cfg->rx_span_buf_size), ESP_ERR_INVALID_ARG, fail_obj, TAG,
+                          "RX span buffer of %u bytes: not a power of two or out of memory", (unsigned)cfg->rx_span_buf_size);
+    }
 
     /* Callbacks setting up*/
     if (cfg->callback_rx) {
@@ -337,6 +444,8 @@ esp_err_t tinyusb_cdcacm_init(const tinyusb_config_cdcacm_t *cfg)
     }
 
     return ESP_OK;
+fail_obj:
+    obj_free(itf);
 fail:
     tinyusb_cdc_deinit(itf);
     return ret;
@@ -5,11 +5,13 @@
  */
 
 #include <string.h>
+#include <sys/param.h>
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_check.h"
 #include "esp_vfs_fat.h"
 #include "esp_partition.h"
+#include "spi_flash_mmap.h"
 #include "esp_memory_utils.h"
 #include "soc/soc_caps.h"
 #include "sdkconfig.h"
@@ -19,8 +21,34 @@
 #include "class/msc/msc_device.h"
 
 #include "storage_spiflash.h"
+#include "storage_ramdisk.h"
 #include "msc_storage.h"
+#if CONFIG_TINYUSB_MSC_CACHE_ENABLED
+#include "storage_cache.h"
+#endif // CONFIG_TINYUSB_MSC_CACHE_ENABLED
+#if CONFIG_TINYUSB_MSC_COMPRESS_ENABLED
+#include "storage_compress.h"
+#endif // CONFIG_TINYUSB_MSC_COMPRESS_ENABLED
+#if CONFIG_TINYUSB_MSC_CRYPT_ENABLED
+#include "storage_crypt.h"
+#endif // CONFIG_TINYUSB_MSC_CRYPT_ENABLED
+#if CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED
+#include "storage_integrity.h"
+#endif // CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED
+#if CONFIG_TINYUSB_MSC_FTL_ENABLED
+#include "storage_ftl.h"
+#endif // CONFIG_TINYUSB_MSC_FTL_ENABLED
 #include "tinyusb_msc.h"
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
+#if CONFIG_TRACE
+#include "trace.h"
+#else
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+#endif // CONFIG_TRACE
 
 #if (SOC_SDMMC_HOST_SUPPORTED)
 #include "storage_sdmmc.h"
@@ -36,9 +64,18 @@ static const char *TAG = "tinyusb_msc_storage";
 #error "CONFIG_TINYUSB_MSC_BUFSIZE must be divisible by MSC_STORAGE_MEM_ALIGN. Adjust your configuration (MSC FIFO size) in menuconfig."
 #endif
 
+#define MSC_STORAGE_BATCH_SLOTS MAX(CONFIG_TINYUSB_MSC_BATCH_SIZE / MSC_STORAGE_BUFFER_SIZE, 1) /*!< TinyUSB chunks in a READ10/WRITE10 batch */
+#define MSC_STORAGE_BATCH_BYTES (MSC_STORAGE_BATCH_SLOTS * MSC_STORAGE_BUFFER_SIZE)             /*!< Size of the batch buffer */
+
 #define TINYUSB_MSC_STORAGE_MAX_LUNS    2                               /*!< Maximum number of LUNs supported by TinyUSB MSC storage. Dafult value is 2 */
 #define TINYUSB_DEFAULT_BASE_PATH       CONFIG_TINYUSB_MSC_MOUNT_PATH   /*!< Default base path for the filesystem, configured via menuconfig */
 
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+#define MSC_WORKER_TASK_STACK   4096                                    /*!< Same as the default TinyUSB task, medium writes run here */
+#define MSC_WORKER_TASK_PRIO    CONFIG_TINYUSB_MSC_WRITE_WORKER_PRIO    /*!< Below the TinyUSB task, so USB events preempt medium writes */
+#define MSC_WORKER_BUSY_TICKS   1                                       /*!< Wait of the TinyUSB task for the worker before handling other events */
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
+
 /**
  * @brief Structure representing a single write buffer for MSC operations.
  */
@@ -50,6 +87,29 @@ typedef struct {
     uint32_t bufsize;                      /*!< Number of bytes to be written in this operation. */
 } msc_storage_buffer_t;
 
+/**
+ * @brief Chunks of a READ10/WRITE10 transfer collected for a single medium call
+ *
+ * The buffer holds either write data not yet on the medium or sectors read ahead.
+ */
+typedef struct {
+    uint8_t *data;                                  /*!< Chunks one after the other, DMA capable. NULL if batching is off. */
+    storage_iovec_t iov[MSC_STORAGE_BATCH_SLOTS];   /*!< Chunks of a write, as received from TinyUSB, or the sectors assembled from smaller chunks. */
+    size_t iovcnt;                                  /*!< Number of chunks of a write. */
+    uint32_t lba;                                   /*!< First sector in the buffer. */
+    size_t size;                                    /*!< Bytes in the buffer, 0 if empty. */
+    bool dirty;                                     /*!< The buffer holds write data. */
+    uint64_t next_read_pos;                         /*!< Byte following the last read, to detect sequential reads. */
+} msc_storage_batch_t;
+
+/**
+ * @brief Medium write deferred from the TinyUSB task
+ */
+typedef struct {
+    void (*func)(void *param);                      /*!< Function doing the write. */
+    void *param;                                    /*!< Storage object. */
+} msc_storage_job_t;
+
 /**
  * @brief Handle for TinyUSB MSC storage interface.
  *
@@ -63,16 +123,20 @@ typedef struct {
     // Optimisation purpose
     uint32_t sector_count;                      /*!< Total number of sectors in the storage medium. */
     uint32_t sector_size;                       /*!< Size of a single sector in bytes. */
+    bool capacity_changed;                      /*!< Capacity changed, UNIT ATTENTION pending for the host. */
     // FS related
     struct {
         const char *base_path;                  /*!< Base path where the filesystem is mounted. */
         int max_files;                          /*!< Maximum number of files that can be open simultaneously. */
         bool do_not_format;                     /*!< If true, do not format the drive if filesystem is not present. */
         BYTE format_flags;                      /*!< Flags for formatting the filesystem, can be 0 to use default settings. */
+        size_t allocation_unit_size;            /*!< Requested cluster size used when formatting, 0 for default. */
+        BYTE pdrv;                              /*!< FatFs drive of the filesystem mounted to the application, 0xFF otherwise. */
     } fat_fs;
     // Buffer for storage operations
     msc_storage_buffer_t storage_buffer;        /*!< Buffer for storing data during write operations. */
     uint32_t deffered_writes;                   /*!< Number of deferred writes pending in the buffer. */
+    msc_storage_batch_t batch;                  /*!< Batch of multi-chunk transfers. */
     SemaphoreHandle_t mux_lock;                 /**< Mutex for storage operations */
 } tinyusb_msc_storage_s;
 
@@ -99,6 +163,14 @@ typedef struct {
             uint32_t val;                           /**< MSC Driver configuration flag value */
         } flags;
     } constant;
+
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+    struct {
+        TaskHandle_t task;              /*!< Worker task, writes to the medium. */
+        QueueHandle_t queue;            /*!< Deferred writes, msc_storage_job_t. */
+        SemaphoreHandle_t done;         /*!< Given after every deferred write. */
+    } worker;
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
 } tinyusb_msc_driver_t;
 
 static tinyusb_msc_driver_t *p_msc_driver;
@@ -223,6 +295,317 @@ static inline bool _msc_storage_unmap_from_lun(msc_storage_obj_t *storage)
     return false;
 }
 
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+/**
+ * @brief Worker task, runs the medium writes deferred from the TinyUSB task
+ *
+ * @param arg Pointer to the MSC driver
+ */
+static void msc_storage_worker_task(void *arg)
+{
+    tinyusb_msc_driver_t *driver = (tinyusb_msc_driver_t *)arg;
+    msc_storage_job_t job;
+
+    while (1) {
+        xQueueReceive(driver->worker.queue, &job, portMAX_DELAY);
+        job.func(job.param);
+        xSemaphoreGive(driver->worker.done);
+    }
+}
+
+/**
+ * @brief Start the worker task on the core of the calling task
+ *
+ * Called by the first deferred write, from the TinyUSB task: the worker follows the TinyUSB task affinity the
+ * application configured, so that the worker priority orders it against the TinyUSB task.
+ *
+ * @return true if the worker is running
+ */
+static bool msc_storage_worker_start(void)
+{
+    if (p_msc_driver->worker.task != NULL) {
+        return true;
+    }
+    const BaseType_t core = xTaskGetCoreID(xTaskGetCurrentTaskHandle());
+    if (xTaskCreatePinnedToCore(msc_storage_worker_task, "msc_write", MSC_WORKER_TASK_STACK, p_msc_driver,
+                                MSC_WORKER_TASK_PRIO, &p_msc_driver->worker.task, core) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the worker task, writing from the TinyUSB task");
+        p_msc_driver->worker.task = NULL;
+        return false;
+    }
+    return true;
+}
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
+
+/**
+ * @brief Defer a medium write
+ *
+ * The write runs in the worker task, or in the TinyUSB task before it handles the next event if the worker is disabled
+ * or could not be started. func must decrement the deferred writes counter when done.
+ *
+ * @param storage Storage object
+ * @param func Function doing the write, called with the storage object
+ */
+static void msc_storage_defer(msc_storage_obj_t *storage, void (*func)(void *param))
+{
+    MSC_ENTER_CRITICAL();
+    storage->deffered_writes++;
+    MSC_EXIT_CRITICAL();
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+    if (msc_storage_worker_start()) {
+        const msc_storage_job_t job = {
+            .func = func,
+            .param = (void *)storage,
+        };
+        // At most one write per storage is pending, the queue never fills
+        xQueueSend(p_msc_driver->worker.queue, &job, portMAX_DELAY);
+        return;
+    }
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
+    usbd_defer_func(func, (void *)storage, false);
+}
+
+/**
+ * @brief Wait until the deferred writes of a storage are done
+ *
+ * The write buffers and the medium must not be touched while a write is pending. Without the worker, deferred
+ * writes are done before the TinyUSB task handles the next event and there is nothing to wait for.
+ *
+ * The done semaphore is given once per write and any waiter may take it, the TinyUSB task or an application task
+ * switching the mount point: it only wakes the waiter early, the pending count is checked again at least every
+ * MSC_WORKER_BUSY_TICKS, so a waiter whose give was taken by another one doesn't block forever.
+ *
+ * @param storage Storage object
+ * @param ticks Time to wait in total, portMAX_DELAY to wait until the writes are done
+ *
+ * @return true if no writes are pending, false if the worker is still writing
+ */
+static bool msc_storage_wait_deferred(msc_storage_obj_t *storage, TickType_t ticks)
+{
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+    const TickType_t start = xTaskGetTickCount();
+    while (1) {
+        MSC_ENTER_CRITICAL();
+        const uint32_t pending = storage->deffered_writes;
+        MSC_EXIT_CRITICAL();
+        if (pending == 0) {
+            return true;
+        }
+        if (ticks != portMAX_DELAY && xTaskGetTickCount() - start >= ticks) {
+            return false;
+        }
+        // Given after every write, of any storage: check again
+        xSemaphoreTake(p_msc_driver->worker.done, MSC_WORKER_BUSY_TICKS);
+    }
+#else
+    (void)storage;
+    (void)ticks;
+    return true;
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
+}
+
+/**
+ * @brief Check that a LUN has no deferred writes pending, for the READ10/WRITE10 callbacks
+ *
+ * Waits for the worker for a tick at most, so that TinyUSB can handle control requests and other events
+ * in between: the callback returns 0 and TinyUSB calls it again with the same chunk.
+ *
+ * @param lun Logical unit number
+ *
+ * @return true if the command can proceed, also if the LUN has no storage (the callback reports the error)
+ */
+static bool msc_storage_lun_ready(uint8_t lun)
+{
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+    msc_storage_obj_t *storage = NULL;
+
+    MSC_ENTER_CRITICAL();
+    bool found = _msc_storage_get_by_lun(lun, &storage);
+    MSC_EXIT_CRITICAL();
+
+    return !found || storage == NULL || msc_storage_wait_deferred(storage, MSC_WORKER_BUSY_TICKS);
+#else
+    (void)lun;
+    return true;
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
+}
+
+/**
+ * @brief Check if a chunk can go through the batch
+ *
+ * The buffer exists only if the MSC FIFO size is a multiple or a divisor of the sector size. Chunks are then
+ * whole sectors, or pieces of one sector if the FIFO is smaller than a sector.
+ */
+static inline bool msc_storage_batch_fits(const msc_storage_obj_t *storage, uint32_t offset, size_t size)
+{
+    const uint32_t sector_size = storage->sector_size;
+    return storage->batch.data != NULL &&
+           ((offset == 0 && size % sector_size == 0) || (size < sector_size && offset + size <= sector_size));
+}
+
+/**
+ * @brief Check if a chunk of a write starts where the batched write data ends
+ */
+static inline bool msc_storage_batch_follows(const msc_storage_obj_t *storage, uint32_t lba, uint32_t offset)
+{
+    const msc_storage_batch_t *batch = &storage->batch;
+    return batch->dirty &&
+           lba == batch->lba + batch->size / storage->sector_size && offset == batch->size % storage->sector_size;
+}
+
+/**
+ * @brief Write the batched chunks to the medium
+ *
+ * Takes the storage lock. Does nothing if the batch holds no write data.
+ */
+static esp_err_t msc_storage_batch_flush(msc_storage_obj_t *storage)
+{
+    msc_storage_batch_t *batch = &storage->batch;
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(storage->mux_lock, portMAX_DELAY);
+    if (batch->dirty) {
+        ret = storage_medium_writev(storage->medium, storage->sector_size, batch->lba, batch->iov, batch->iovcnt);
+        batch->dirty = false;
+        batch->size = 0;
+        batch->iovcnt = 0;
+    }
+    xSemaphoreGive(storage->mux_lock);
+    return ret;
+}
+
+/**
+ * @brief Deferred write of a full batch, or of the last chunks of a WRITE10 command
+ *
+ * @param param Pointer to the storage object
+ */
+static void tusb_batch_flush_func(void *param)
+{
+    assert(param);
+    msc_storage_obj_t *storage = (msc_storage_obj_t *)param;
+
+    TRACE_BEGIN("msc_flush");
+    esp_err_t err = msc_storage_batch_flush(storage);
+    TRACE_END("msc_flush");
+
+    MSC_ENTER_CRITICAL();
+    assert(storage->deffered_writes > 0);
+    storage->deffered_writes--;
+    MSC_EXIT_CRITICAL();
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Batch write failed, error=0x%x", err);
+    }
+}
+
+/**
+ * @brief Defer the write of the batch
+ *
+ * The write runs before TinyUSB handles the next chunk, which the host is already sending.
+ */
+static void msc_storage_batch_defer_flush(msc_storage_obj_t *storage)
+{
+    msc_storage_defer(storage, tusb_batch_flush_func);
+}
+
+/**
+ * @brief Add a chunk of a WRITE10 command to the batch
+ *
+ * A chunk not starting a sector must follow the batched data, see msc_storage_batch_follows(). The batch is
+ * written when it is full or when the command ends, see tud_msc_write10_complete_cb(), always at a sector boundary.
+ */
+static esp_err_t msc_storage_batch_write(msc_storage_obj_t *storage, uint32_t lba, uint32_t offset, size_t size,
+                                         const void *src)
+{
+    msc_storage_batch_t *batch = &storage->batch;
+
+    if (offset == 0 && batch->dirty &&
+            (batch->iovcnt == MSC_STORAGE_BATCH_SLOTS || batch->size + size > MSC_STORAGE_BATCH_BYTES ||
+             !msc_storage_batch_follows(storage, lba, 0))) {
+        ESP_RETURN_ON_ERROR(msc_storage_batch_flush(storage), TAG, "Failed to write the batch");
+    }
+    if (!batch->dirty) {
+        // Read-ahead sectors are dropped, they may be overwritten
+        batch->dirty = true;
+        batch->lba = lba;
+        batch->size = 0;
+        batch->iovcnt = 0;
+    }
+
+    uint8_t *chunk = batch->data + batch->size;
+    memcpy(chunk, src, size);
+    if (offset != 0) {
+        // Rest of a sector, media get whole sectors in each buffer
+        batch->iov[batch->iovcnt - 1].size += size;
+    } else {
+        batch->iov[batch->iovcnt].base = chunk;
+        batch->iov[batch->iovcnt].size = size;
+        batch->iovcnt++;
+    }
+    batch->size += size;
+
+    if (batch->size == MSC_STORAGE_BATCH_BYTES ||
+            (batch->iovcnt == MSC_STORAGE_BATCH_SLOTS && batch->size % storage->sector_size == 0)) {
+        msc_storage_batch_defer_flush(storage);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Read a chunk of a READ10 command through the batch
+ *
+ * A chunk following the previous one starts a read-ahead of a whole batch from the start of its sector, later
+ * chunks are copied from it. Other chunks are read directly.
+ */
+static esp_err_t msc_storage_batch_read(msc_storage_obj_t *storage, uint32_t lba, uint32_t offset, size_t size,
+                                        void *dest)
+{
+    msc_storage_batch_t *batch = &storage->batch;
+    const uint32_t sector_size = storage->sector_size;
+    esp_err_t ret;
+
+    // Reads must see the batched writes
+    ESP_RETURN_ON_ERROR(msc_storage_batch_flush(storage), TAG, "Failed to write the batch");
+
+    const uint64_t pos = (uint64_t)lba * sector_size + offset;
+    const uint64_t start = (uint64_t)batch->lba * sector_size;
+    const bool sequential = (pos == batch->next_read_pos);
+    batch->next_read_pos = pos + size;
+
+    if (batch->size != 0 && pos >= start && pos + size - start <= batch->size) {
+        memcpy(dest, batch->data + (size_t)(pos - start), size);
+        return ESP_OK;
+    }
+
+    size_t ahead = 0;
+    if (sequential && lba < storage->sector_count) {
+        ahead = MIN((size_t)MSC_STORAGE_BATCH_BYTES, (size_t)(storage->sector_count - lba) * sector_size);
+        ahead -= ahead % sector_size;
+    }
+
+    xSemaphoreTake(storage->mux_lock, portMAX_DELAY);
+    if (ahead < offset + size) {
+        batch->size = 0;
+        ret = storage->medium->read(lba, offset, size, dest);
+    } else {
+        // The chunk list is free while the batch holds no write data, buffers of whole sectors
+        const size_t piece = MAX((size_t)MSC_STORAGE_BUFFER_SIZE, (size_t)sector_size);
+        size_t iovcnt = 0;
+        for (size_t done = 0; done < ahead; done += batch->iov[iovcnt++].size) {
+            batch->iov[iovcnt].base = batch->data + done;
+            batch->iov[iovcnt].size = MIN(ahead - done, piece);
+        }
+        ret = storage_medium_readv(storage->medium, sector_size, lba, batch->iov, iovcnt);
+        batch->lba = lba;
+        batch->size = (ret == ESP_OK) ? ahead : 0;
+        if (ret == ESP_OK) {
+            memcpy(dest, batch->data + offset, size);
+        }
+    }
+    xSemaphoreGive(storage->mux_lock);
+    return ret;
+}
+
 /**
  * @brief Read a sector from the storage medium
  *
@@ -251,6 +634,11 @@ static inline esp_err_t msc_storage_read_sector(uint8_t lun, uint32_t lba, uint3
         ESP_LOGE(TAG, "Storage not found for LUN %d", lun);
         return ESP_ERR_NOT_FOUND;
     }
+    if (msc_storage_batch_fits(storage, offset, size)) {
+        return msc_storage_batch_read(storage, lba, offset, size, dest);
+    }
+    // Reads must see the batched writes
+    ESP_RETURN_ON_ERROR(msc_storage_batch_flush(storage), TAG, "Failed to write the batch");
     // Otherwise, take the lock and proceed with the read
     xSemaphoreTake(storage->mux_lock, portMAX_DELAY);
     ret = storage->medium->read(lba, offset, size, dest);
@@ -296,8 +684,8 @@ static inline esp_err_t msc_storage_write_sector(uint8_t lun, uint32_t lba, uint
 /**
  * @brief Handles deferred USB MSC write operations.
  *
- * This function is invoked via TinyUSB's deferred execution mechanism to perform
- * write operations to the underlying storage. It writes data from the
+ * This function is invoked from the worker task, or via TinyUSB's deferred execution
+ * mechanism, to perform write operations to the underlying storage. It writes data from the
  * `storage_buffer` stored within the `s_storage_handle`.
  *
  * @param param Pointer to the storage object containing the write parameters.
@@ -307,6 +695,7 @@ static void tusb_write_func(void *param)
     assert(param); // Ensure storage is not NULL
     msc_storage_obj_t *storage = (msc_storage_obj_t *)param;
 
+    TRACE_BEGIN("msc_write");
     esp_err_t err = msc_storage_write_sector(
                         storage->storage_buffer.lun,
                         storage->storage_buffer.lba,
@@ -314,6 +703,7 @@ static void tusb_write_func(void *param)
                         storage->storage_buffer.bufsize,
                         (const void *)storage->storage_buffer.data_buffer
                     );
+    TRACE_END("msc_write");
 
     // Decrement the deferred writes counter
     MSC_ENTER_CRITICAL();
@@ -330,7 +720,8 @@ static void tusb_write_func(void *param)
  * @brief Write a sector to the storage medium using deferred execution.
  *
  * This function copies the data to be written into an internal buffer and
- * defers the actual write operation to be executed in the TinyUSB task context.
+ * defers the actual write operation to the worker task, or to the TinyUSB task
+ * context if the worker is disabled.
  *
  * @param[in] lun The logical unit number (LUN) to write to.
  * @param[in] lba Logical Block Address of the sector to write to.
@@ -356,7 +747,7 @@ static inline esp_err_t msc_storage_write_sector_deferred(uint8_t lun, uint32_t
         return ESP_ERR_NOT_FOUND;
     }
 
-    // As we defer the write operation to the TinyUSB task, we need to ensure that
+    // As we defer the write operation, we need to ensure that
     // the address does not overflow for SPI Flash storage medium
     if (storage->medium->type == STORAGE_MEDIUM_TYPE_SPIFLASH) {
         size_t addr = 0; // Address of the data to be read, relative to the beginning of the partition.
@@ -366,6 +757,13 @@ static inline esp_err_t msc_storage_write_sector_deferred(uint8_t lun, uint32_t
         ESP_RETURN_ON_FALSE(!__builtin_uadd_overflow(temp, offset, &addr), ESP_ERR_INVALID_SIZE, TAG, "overflow addr %u offset %lu", temp, offset);
     }
 
+    if (msc_storage_batch_fits(storage, offset, size) && (offset == 0 || msc_storage_batch_follows(storage, lba, offset))) {
+        return msc_storage_batch_write(storage, lba, offset, size, src);
+    }
+    // Keep the order of the writes
+    ESP_RETURN_ON_ERROR(msc_storage_batch_flush(storage), TAG, "Failed to write the batch");
+    storage->batch.size = 0;
+
     // Copy data to the buffer
     memcpy((void *)storage->storage_buffer.data_buffer, src, size);
     storage->storage_buffer.lun = lun;
@@ -373,33 +771,53 @@ static inline esp_err_t msc_storage_write_sector_deferred(uint8_t lun, uint32_t
     storage->storage_buffer.offset = offset;
     storage->storage_buffer.bufsize = size;
 
-    // Increment the deferred writes counter
-    MSC_ENTER_CRITICAL();
-    storage->deffered_writes++;
-    MSC_EXIT_CRITICAL();
-
-    // Defer execution of the write to the TinyUSB task
-    usbd_defer_func(tusb_write_func, (void *)storage, false);
+    // Defer execution of the write
+    msc_storage_defer(storage, tusb_write_func);
 
     return ESP_OK;
 }
 
-static esp_err_t vfs_fat_format(BYTE format_flags)
+/**
+ * @brief Alignment of the FAT data area used when formatting, in sectors
+ *
+ * The data area is aligned to the larger of the cluster size and the flash erase
+ * block (SPI Flash) so that no cluster straddles two wear-levelling sectors and
+ * rewriting a cluster never costs two erases. FatFs pads the reserved area or the
+ * FAT to reach the boundary.
+ *
+ * @param[in] storage Storage object
+ * @param[in] alloc_unit_size Cluster size in bytes
+ *
+ * @return Alignment in sectors, a power of two
+ */
+static uint32_t msc_storage_format_align(const msc_storage_obj_t *storage, size_t alloc_unit_size)
+{
+    size_t align_bytes = alloc_unit_size;
+    if (storage->medium->type == STORAGE_MEDIUM_TYPE_SPIFLASH && align_bytes < SPI_FLASH_SEC_SIZE) {
+        align_bytes = SPI_FLASH_SEC_SIZE;
+    }
+    // Both sizes are powers of two, so the quotient is one as well (as f_mkfs() requires)
+    return MAX(1, align_bytes / storage->sector_size);
+}
+
+static esp_err_t vfs_fat_format(const msc_storage_obj_t *storage)
 {
     esp_err_t ret;
     FRESULT fresult;
     // Drive does not have a filesystem, try to format it
-    const size_t workbuf_size = 4096;
+    const size_t workbuf_size = MAX(4096, storage->sector_size);
     void *workbuf = ff_memalloc(workbuf_size);
     if (workbuf == NULL) {
         return ESP_ERR_NO_MEM;
     }
 
-    size_t alloc_unit_size = esp_vfs_fat_get_allocation_unit_size(CONFIG_WL_SECTOR_SIZE, workbuf_size);
+    size_t requested_size = storage->fat_fs.allocation_unit_size ? storage->fat_fs.allocation_unit_size : 4096;
+    size_t alloc_unit_size = esp_vfs_fat_get_allocation_unit_size(storage->sector_size, requested_size);
+    uint32_t align = msc_storage_format_align(storage, alloc_unit_size);
 
-    ESP_LOGD(TAG, "Format drive, allocation unit size=%d", alloc_unit_size);
+    ESP_LOGD(TAG, "Format drive, allocation unit size=%d, align=%"PRIu32" sectors", alloc_unit_size, align);
 
-    const MKFS_PARM opt = {format_flags, 0, 0, 0, alloc_unit_size};
+    const MKFS_PARM opt = {storage->fat_fs.format_flags, 0, align, 0, alloc_unit_size};
     fresult = f_mkfs("", &opt, workbuf, workbuf_size); // Use default volume
     if (fresult != FR_OK) {
         ret = ESP_FAIL;
@@ -466,6 +884,16 @@ static esp_err_t msc_storage_mount(msc_storage_obj_t *storage)
 
     tinyusb_event_cb(storage, TINYUSB_MSC_EVENT_MOUNT_START);
 
+    // The filesystem must see the last writes of the host, and the worker must be done with the batch
+    msc_storage_wait_deferred(storage, portMAX_DELAY);
+
+    // The application writes to the medium directly, the batch must not hold any sector
+    if (msc_storage_batch_flush(storage) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write the batch");
+    }
+    storage->batch.size = 0;
+    storage->batch.next_read_pos = UINT64_MAX;
+
     // Get the vacant driver number
     BYTE pdrv = 0xFF;
     ESP_RETURN_ON_ERROR(ff_diskio_get_drive(&pdrv), TAG, "The maximum count of volumes is already mounted");
@@ -506,6 +934,7 @@ static esp_err_t msc_storage_mount(msc_storage_obj_t *storage)
     // Registering the FATFS object was done successfully; change the mount point.
     // All subsequent errors depend on the filesystem.
     storage->mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP;
+    storage->fat_fs.pdrv = pdrv;
 
     ret = vfs_fat_mount(drv, fs, true);
     if (ret == ESP_ERR_NOT_FOUND) {
@@ -518,8 +947,7 @@ static esp_err_t msc_storage_mount(msc_storage_obj_t *storage)
             goto exit;
         }
         ESP_LOGW(TAG, "Mount failed, trying to format the drive");
-        BYTE format_flags = storage->fat_fs.format_flags;
-        ESP_GOTO_ON_ERROR(vfs_fat_format(format_flags), fail, TAG, "Failed to format the drive");
+        ESP_GOTO_ON_ERROR(vfs_fat_format(storage), fail, TAG, "Failed to format the drive");
         ESP_GOTO_ON_ERROR(vfs_fat_mount(drv, fs, false), fail, TAG, "Failed to mount FAT filesystem");
         ESP_LOGD(TAG, "Format completed, FAT mounted successfully");
     } else if (ret != ESP_OK) {
@@ -534,6 +962,7 @@ fail:
     xSemaphoreGive(storage->mux_lock);
     tinyusb_event_cb(storage, TINYUSB_MSC_EVENT_FORMAT_FAILED);
 exit:
+    storage->fat_fs.pdrv = 0xFF;
     storage->medium->unmount();
     if (fs) {
         esp_vfs_fat_unregister_path(base_path);
@@ -561,6 +990,9 @@ static esp_err_t msc_storage_unmount(msc_storage_obj_t *storage)
 
     tinyusb_event_cb(storage, TINYUSB_MSC_EVENT_MOUNT_START);
 
+    // The medium is unregistered below, the worker must be done with it
+    msc_storage_wait_deferred(storage, portMAX_DELAY);
+
     xSemaphoreTake(storage->mux_lock, portMAX_DELAY);
 
     // Unregister the partition
@@ -579,6 +1011,7 @@ static esp_err_t msc_storage_unmount(msc_storage_obj_t *storage)
     }
 
     storage->mount_point = TINYUSB_MSC_STORAGE_MOUNT_USB;
+    storage->fat_fs.pdrv = 0xFF;
     xSemaphoreGive(storage->mux_lock);
 
     tinyusb_event_cb(storage, TINYUSB_MSC_EVENT_MOUNT_COMPLETE);
@@ -596,6 +1029,56 @@ static void msc_storage_event_default_cb(tinyusb_msc_storage_handle_t handle, ti
     ESP_LOGW(TAG, "Default MSC event callback called, event ID: %d, mount point: %d", event->id, event->mount_point);
 }
 
+/**
+ * @brief Encrypt a storage medium if a key is configured
+ *
+ * There is no fallback to the plain medium: data would be stored unencrypted.
+ *
+ * @param[in] key AES-256-XTS key, NULL if the storage is not encrypted
+ * @param[inout] medium Medium to be encrypted, replaced with the encrypted medium on success
+ *
+ * @return
+ *    - ESP_OK: Medium is encrypted, or no key is configured
+ *    - ESP_ERR_NOT_SUPPORTED: A key is configured but encryption is disabled in Kconfig
+ *    - Other errors from storage_crypt_open_medium()
+ */
+static esp_err_t msc_storage_crypt_medium(const uint8_t *key, const storage_medium_t **medium)
+{
+    if (key == NULL) {
+        return ESP_OK;
+    }
+#if CONFIG_TINYUSB_MSC_CRYPT_ENABLED
+    const storage_medium_t *encrypted = NULL;
+    ESP_RETURN_ON_ERROR(storage_crypt_open_medium(*medium, key, &encrypted), TAG, "Failed to open encrypted medium");
+    *medium = encrypted;
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "Storage encryption is disabled, enable CONFIG_TINYUSB_MSC_CRYPT_ENABLED");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif // CONFIG_TINYUSB_MSC_CRYPT_ENABLED
+}
+
+/**
+ * @brief Put the sector cache in front of a storage medium
+ *
+ * The cache is an optimisation only: if it can't be created, the medium is used uncached.
+ *
+ * @param[inout] medium Medium to be cached, replaced with the cached medium on success
+ */
+static void msc_storage_cache_medium(const storage_medium_t **medium)
+{
+#if CONFIG_TINYUSB_MSC_CACHE_ENABLED
+    const storage_medium_t *cached = NULL;
+    if (storage_cache_open_medium(*medium, &cached) == ESP_OK) {
+        *medium = cached;
+    } else {
+        ESP_LOGW(TAG, "Failed to create sector cache, storage is not cached");
+    }
+#else
+    (void) medium;
+#endif // CONFIG_TINYUSB_MSC_CACHE_ENABLED
+}
+
 /**
  * @brief Create a new MSC storage object
  *
@@ -632,6 +1115,7 @@ static esp_err_t msc_storage_new(const tinyusb_msc_storage_config_t *config,
     storage_obj->medium = medium;
     storage_obj->mount_point = TINYUSB_MSC_STORAGE_MOUNT_USB; // Default mount point is USB host
     storage_obj->deffered_writes = 0;
+    storage_obj->batch.next_read_pos = UINT64_MAX;
     // In case the user does not set mount_config.max_files
     // and for backward compatibility with versions <1.4.2
     // max_files is set to 2
@@ -639,6 +1123,8 @@ static esp_err_t msc_storage_new(const tinyusb_msc_storage_config_t *config,
     storage_obj->fat_fs.max_files = max_files > 0 ? max_files : 2;
     storage_obj->fat_fs.do_not_format = config->fat_fs.do_not_format;
     storage_obj->fat_fs.format_flags = config->fat_fs.format_flags;
+    storage_obj->fat_fs.allocation_unit_size = config->fat_fs.config.allocation_unit_size;
+    storage_obj->fat_fs.pdrv = 0xFF;
     if (storage_obj->fat_fs.format_flags == 0) {
         // Use default format flags if not provided
         storage_obj->fat_fs.format_flags = FM_ANY; // Auto-select FAT type based on volume size
@@ -662,6 +1148,16 @@ static esp_err_t msc_storage_new(const tinyusb_msc_storage_config_t *config,
     storage_obj->sector_count = storage_info.total_sectors;
     storage_obj->sector_size = storage_info.sector_size;
 
+    // Batches hold whole sectors, made of whole chunks or assembled from chunks that divide a sector
+    if (MSC_STORAGE_BATCH_SLOTS > 1 && MSC_STORAGE_BATCH_BYTES % storage_obj->sector_size == 0 &&
+            (MSC_STORAGE_BUFFER_SIZE % storage_obj->sector_size == 0 || storage_obj->sector_size % MSC_STORAGE_BUFFER_SIZE == 0)) {
+        // Batching is an optimisation only, chunks are written one by one without the buffer
+        storage_obj->batch.data = heap_caps_aligned_alloc(MSC_STORAGE_MEM_ALIGN, MSC_STORAGE_BATCH_BYTES, MALLOC_CAP_DMA);
+        if (storage_obj->batch.data == NULL) {
+            ESP_LOGW(TAG, "Failed to allocate the batch buffer, transfers are not batched");
+        }
+    }
+
     ESP_LOGD(TAG, "Storage type: , sectors count: %"PRIu32", sector size: %"PRIu32"",
              storage_obj->sector_count,
              storage_obj->sector_size);
@@ -670,6 +1166,7 @@ static esp_err_t msc_storage_new(const tinyusb_msc_storage_config_t *config,
     return ESP_OK;
 fail:
     if (storage_obj) {
+        heap_caps_free(storage_obj->batch.data);
         heap_caps_free(storage_obj);
     }
     if (mux_lock) {
@@ -692,9 +1189,31 @@ static void msc_storage_delete(msc_storage_obj_t *storage)
     if (storage->mux_lock) {
         vSemaphoreDelete(storage->mux_lock);
     }
+    heap_caps_free(storage->batch.data);
     heap_caps_free(storage);
 }
 
+/**
+ * @brief Free the MSC driver and its worker
+ *
+ * The worker must be idle: no storage is left, or none was created.
+ */
+static void msc_driver_delete(tinyusb_msc_driver_t *msc_driver)
+{
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+    if (msc_driver->worker.task) {
+        vTaskDelete(msc_driver->worker.task);
+    }
+    if (msc_driver->worker.queue) {
+        vQueueDelete(msc_driver->worker.queue);
+    }
+    if (msc_driver->worker.done) {
+        vSemaphoreDelete(msc_driver->worker.done);
+    }
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
+    heap_caps_free(msc_driver);
+}
+
 /**
  * @brief Install the MSC driver
  *
@@ -730,6 +1249,17 @@ static esp_err_t msc_driver_install(const tinyusb_msc_driver_config_t *config, b
     msc_driver->constant.flags.val = (uint16_t) config->user_flags.val; // Config flags for the MSC driver
     msc_driver->constant.flags.internally_installed = internally_installed;
 
+#if CONFIG_TINYUSB_MSC_WRITE_WORKER
+    msc_driver->worker.queue = xQueueCreate(TINYUSB_MSC_STORAGE_MAX_LUNS, sizeof(msc_storage_job_t));
+    msc_driver->worker.done = xSemaphoreCreateBinary();
+    if (msc_driver->worker.queue == NULL || msc_driver->worker.done == NULL) {
+        ESP_LOGE(TAG, "Failed to create the worker queue");
+        ret = ESP_ERR_NO_MEM;
+        goto fail;
+    }
+    // The worker task is started by the first deferred write, see msc_storage_worker_start()
+#endif // CONFIG_TINYUSB_MSC_WRITE_WORKER
+
     MSC_ENTER_CRITICAL();
     MSC_GOTO_ON_FALSE_CRITICAL(p_msc_driver == NULL, ESP_ERR_INVALID_STATE);
     p_msc_driver = msc_driver;
@@ -737,7 +1267,7 @@ static esp_err_t msc_driver_install(const tinyusb_msc_driver_config_t *config, b
 
     return ESP_OK;
 fail:
-    heap_caps_free(msc_driver);
+    msc_driver_delete(msc_driver);
     return ret;
 }
 
@@ -808,7 +1338,7 @@ esp_err_t tinyusb_msc_uninstall_driver(void)
     MSC_EXIT_CRITICAL();
 
     // Free the driver memory
-    heap_caps_free(msc_driver);
+    msc_driver_delete(msc_driver);
     return ESP_OK;
 }
 
@@ -853,6 +1383,35 @@ esp_err_t tinyusb_msc_new_storage_spiflash(const tinyusb_msc_storage_config_t *c
         ESP_LOGE(TAG, "Failed to open SPI Flash medium");
         goto medium_err;
     }
+#if CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED
+    // Checked right above the flash, so the CRCs cover what is actually stored.
+    // No fallback to the unchecked medium, the table takes the last sectors
+    const storage_medium_t *checked = NULL;
+    ret = storage_integrity_open_medium(medium, &checked);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open checked medium");
+        medium->close();
+        goto medium_err;
+    }
+    medium = checked;
+#endif // CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED
+    // Encryption goes under compression, ciphertext doesn't compress
+    ret = msc_storage_crypt_medium(config->crypt_key, &medium);
+    if (ret != ESP_OK) {
+        medium->close();
+        goto medium_err;
+    }
+#if CONFIG_TINYUSB_MSC_COMPRESS_ENABLED
+    // No fallback to the plain medium, the data layouts differ
+    const storage_medium_t *backing = medium;
+    ret = storage_compress_open_medium(backing, &medium);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open compressed medium");
+        backing->close();
+        goto medium_err;
+    }
+#endif // CONFIG_TINYUSB_MSC_COMPRESS_ENABLED
+    msc_storage_cache_medium(&medium);
     // Create a storage object
     ret = msc_storage_new(config, medium, &storage);
     if (ret != ESP_OK) {
@@ -933,6 +1492,12 @@ esp_err_t tinyusb_msc_new_storage_sdmmc(const tinyusb_msc_storage_config_t *conf
         ESP_LOGE(TAG, "Failed to open SD/MMC medium");
         goto medium_err;
     }
+    ret = msc_storage_crypt_medium(config->crypt_key, &medium);
+    if (ret != ESP_OK) {
+        medium->close();
+        goto medium_err;
+    }
+    msc_storage_cache_medium(&medium);
     // Create a storage object
     ret = msc_storage_new(config, medium, &storage);
     if (ret != ESP_OK) {
@@ -978,12 +1543,197 @@ driver_err:
 }
 #endif // SOC_SDMMC_HOST_SUPPORTED
 
+esp_err_t tinyusb_msc_new_storage_ramdisk(const tinyusb_msc_storage_config_t *config,
+                                          tinyusb_msc_storage_handle_t *handle)
+{
+    ESP_RETURN_ON_FALSE(config != NULL, ESP_ERR_INVALID_ARG, TAG, "Config can't be NULL");
+    ESP_RETURN_ON_FALSE(config->medium.ramdisk.size != 0, ESP_ERR_INVALID_ARG, TAG, "RAM disk size should be set");
+
+    bool need_to_install_driver = false;
+    bool restored = false;
+    const storage_medium_t *medium = NULL;
+    msc_storage_obj_t *storage = NULL;
+    esp_err_t ret;
+
+    MSC_ENTER_CRITICAL();
+    if (p_msc_driver == NULL) {
+        need_to_install_driver = true;
+    }
+    MSC_EXIT_CRITICAL();
+
+    // Driver was not installed, install it now
+    if (need_to_install_driver) {
+        tinyusb_msc_driver_config_t default_cfg = {
+            .callback = msc_storage_event_default_cb,
+        };
+        ret = msc_driver_install(&default_cfg, true);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to install MSC driver");
+            goto driver_err;
+        }
+    }
+
+    // Create a medium for storage, loaded from the snapshot if there is one
+    ret = storage_ramdisk_open_medium(config->medium.ramdisk.size, config->medium.ramdisk.snapshot_partition,
+                                      &medium, &restored);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open RAM disk medium");
+        goto medium_err;
+    }
+    // Create a storage object
+    ret = msc_storage_new(config, medium, &storage);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MSC storage object");
+        goto storage_err;
+    }
+    // Map the storage object to the MSC Lun
+    MSC_ENTER_CRITICAL();
+    if (!_msc_storage_map_to_lun(storage)) {
+        MSC_EXIT_CRITICAL();
+        ESP_LOGE(TAG, "Failed to map storage to LUN");
+        ret = ESP_FAIL;
+        goto map_err;
+    }
+    MSC_EXIT_CRITICAL();
+
+    // A new RAM disk is blank: mounting it to the application formats it, so the host never sees an unformatted drive
+    if (config->mount_point == TINYUSB_MSC_STORAGE_MOUNT_APP || (!restored && !config->fat_fs.do_not_format)) {
+        ret = msc_storage_mount(storage);
+        if (ret != ESP_OK) {
+            // Unrecoverable error
+            ESP_LOGE(TAG, "Failed to mount storage to application");
+            goto map_err;
+        }
+    }
+    if (config->mount_point == TINYUSB_MSC_STORAGE_MOUNT_USB) {
+        ret = msc_storage_unmount(storage);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to expose storage to USB");
+            goto map_err;
+        }
+    }
+
+    // Return the handle to the storage
+    if (handle != NULL) {
+        *handle = (tinyusb_msc_storage_handle_t)storage;
+    }
+    return ESP_OK;
+
+map_err:
+    msc_storage_delete(storage);
+storage_err:
+    medium->close();
+medium_err:
+    if (need_to_install_driver) {
+        tinyusb_msc_uninstall_driver();
+    }
+driver_err:
+    return ret;
+}
+
+esp_err_t tinyusb_msc_new_storage_ftl(const tinyusb_msc_storage_config_t *config,
+                                      tinyusb_msc_storage_handle_t *handle)
+{
+    ESP_RETURN_ON_FALSE(config != NULL, ESP_ERR_INVALID_ARG, TAG, "Config can't be NULL");
+    ESP_RETURN_ON_FALSE(config->medium.partition != NULL, ESP_ERR_INVALID_ARG, TAG, "Partition should be set");
+#if CONFIG_TINYUSB_MSC_FTL_ENABLED
+    ESP_RETURN_ON_FALSE(CONFIG_TINYUSB_MSC_BUFSIZE >= STORAGE_FTL_SECTOR_SIZE, ESP_ERR_NOT_SUPPORTED, TAG,
+                        "TinyUSB buffer size (%d) must be at least the sector size (%d)",
+                        (int)(CONFIG_TINYUSB_MSC_BUFSIZE), STORAGE_FTL_SECTOR_SIZE);
+
+    bool need_to_install_driver = false;
+    const storage_medium_t *medium = NULL;
+    msc_storage_obj_t *storage = NULL;
+    esp_err_t ret;
+
+    MSC_ENTER_CRITICAL();
+    if (p_msc_driver == NULL) {
+        need_to_install_driver = true;
+    }
+    MSC_EXIT_CRITICAL();
+
+    // Driver was not installed, install it now
+    if (need_to_install_driver) {
+        tinyusb_msc_driver_config_t default_cfg = {
+            .callback = msc_storage_event_default_cb,
+        };
+        ret = msc_driver_install(&default_cfg, true);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to install MSC driver");
+            goto driver_err;
+        }
+    }
+
+    // Create a medium for storage, the map is rebuilt from the partition
+    ret = storage_ftl_open_medium(config->medium.partition, &medium);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open log-structured medium");
+        goto medium_err;
+    }
+    ret = msc_storage_crypt_medium(config->crypt_key, &medium);
+    if (ret != ESP_OK) {
+        medium->close();
+        goto medium_err;
+    }
+    msc_storage_cache_medium(&medium);
+    // Create a storage object
+    ret = msc_storage_new(config, medium, &storage);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MSC storage object");
+        goto storage_err;
+    }
+    // Map the storage object to the MSC Lun
+    MSC_ENTER_CRITICAL();
+    if (!_msc_storage_map_to_lun(storage)) {
+        MSC_EXIT_CRITICAL();
+        ESP_LOGE(TAG, "Failed to map storage to LUN");
+        ret = ESP_FAIL;
+        goto map_err;
+    }
+    MSC_EXIT_CRITICAL();
+
+    // Mount the storage if it is configured to be mounted to application
+    if (config->mount_point == TINYUSB_MSC_STORAGE_MOUNT_APP) {
+        ret = msc_storage_mount(storage);
+        if (ret != ESP_OK) {
+            // Unrecoverable error
+            ESP_LOGE(TAG, "Failed to mount storage to application");
+            goto map_err;
+        }
+    }
+
+    // Return the handle to the storage
+    if (handle != NULL) {
+        *handle = (tinyusb_msc_storage_handle_t)storage;
+    }
+    return ESP_OK;
+
+map_err:
+    msc_storage_delete(storage);
+storage_err:
+    medium->close();
+medium_err:
+    if (need_to_install_driver) {
+        tinyusb_msc_uninstall_driver();
+    }
+driver_err:
+    return ret;
+#else
+    (void) handle;
+    ESP_LOGE(TAG, "Log-structured storage is disabled, enable CONFIG_TINYUSB_MSC_FTL_ENABLED");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif // CONFIG_TINYUSB_MSC_FTL_ENABLED
+}
+
 esp_err_t tinyusb_msc_delete_storage(tinyusb_msc_storage_handle_t handle)
 {
     ESP_RETURN_ON_FALSE(handle != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage handle can't be NULL");
     msc_storage_obj_t *storage = (msc_storage_obj_t *)handle;
     bool no_more_luns = false;
 
+    // Let the worker finish the last write of the host
+    msc_storage_wait_deferred(storage, portMAX_DELAY);
+
     MSC_ENTER_CRITICAL();
     MSC_CHECK_ON_CRITICAL(p_msc_driver != NULL, ESP_ERR_INVALID_STATE);
     MSC_CHECK_ON_CRITICAL(p_msc_driver->dynamic.lun_count > 0, ESP_ERR_INVALID_STATE);
@@ -1005,6 +1755,10 @@ esp_err_t tinyusb_msc_delete_storage(tinyusb_msc_storage_handle_t handle)
     no_more_luns = (p_msc_driver->dynamic.lun_count == 0);
     MSC_EXIT_CRITICAL();
 
+    // Write the chunks of an interrupted WRITE10 command
+    if (msc_storage_batch_flush(storage) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write the batch");
+    }
     // Close the storage medium
     storage->medium->close();
 
@@ -1017,6 +1771,56 @@ esp_err_t tinyusb_msc_delete_storage(tinyusb_msc_storage_handle_t handle)
     return ESP_OK;
 }
 
+esp_err_t tinyusb_msc_set_storage_capacity(tinyusb_msc_storage_handle_t handle, uint32_t sector_count)
+{
+    ESP_RETURN_ON_FALSE(handle != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC storage is not initialized");
+
+    MSC_ENTER_CRITICAL();
+    MSC_CHECK_ON_CRITICAL(p_msc_driver != NULL, ESP_ERR_INVALID_STATE);
+    MSC_EXIT_CRITICAL();
+
+    msc_storage_obj_t *storage = (msc_storage_obj_t *) handle;
+    storage_info_t storage_info;
+    ESP_RETURN_ON_ERROR(storage->medium->get_info(&storage_info), TAG, "Failed to get storage info");
+
+    if (sector_count == 0) {
+        sector_count = storage_info.total_sectors;
+    }
+    ESP_RETURN_ON_FALSE(sector_count <= storage_info.total_sectors, ESP_ERR_INVALID_ARG, TAG,
+                        "Capacity %"PRIu32" exceeds medium size %"PRIu32"", sector_count, storage_info.total_sectors);
+
+    xSemaphoreTake(storage->mux_lock, portMAX_DELAY);
+    if (storage->sector_count != sector_count) {
+        storage->sector_count = sector_count;
+        // Also under the spinlock: the TinyUSB task reads it without waiting for medium operations
+        MSC_ENTER_CRITICAL();
+        storage->capacity_changed = true;
+        MSC_EXIT_CRITICAL();
+        ESP_LOGD(TAG, "Storage capacity changed to %"PRIu32" sectors", sector_count);
+    }
+    xSemaphoreGive(storage->mux_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t tinyusb_msc_snapshot_storage(tinyusb_msc_storage_handle_t handle)
+{
+    ESP_RETURN_ON_FALSE(handle != NULL, ESP_ERR_INVALID_ARG, TAG, "Storage handle can't be NULL");
+
+    MSC_ENTER_CRITICAL();
+    MSC_CHECK_ON_CRITICAL(p_msc_driver != NULL, ESP_ERR_INVALID_STATE);
+    MSC_EXIT_CRITICAL();
+
+    msc_storage_obj_t *storage = (msc_storage_obj_t *) handle;
+    ESP_RETURN_ON_FALSE(storage->medium->type == STORAGE_MEDIUM_TYPE_RAMDISK, ESP_ERR_NOT_SUPPORTED, TAG, "Storage is not a RAM disk");
+
+    // Block USB reads and writes, so the snapshot is consistent
+    xSemaphoreTake(storage->mux_lock, portMAX_DELAY);
+    esp_err_t ret = storage_ramdisk_snapshot();
+    xSemaphoreGive(storage->mux_lock);
+    return ret;
+}
+
 esp_err_t tinyusb_msc_get_storage_capacity(tinyusb_msc_storage_handle_t handle, uint32_t *sector_count)
 {
     ESP_RETURN_ON_FALSE(handle != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC storage is not initialized");
@@ -1044,6 +1848,53 @@ esp_err_t tinyusb_msc_get_storage_sector_size(tinyusb_msc_storage_handle_t handl
     return ESP_OK;
 }
 
+esp_err_t tinyusb_msc_get_storage_integrity_stats(tinyusb_msc_storage_handle_t handle,
+                                                  tinyusb_msc_integrity_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(p_msc_driver != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC driver is not initialized");
+    ESP_RETURN_ON_FALSE(handle != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC storage is not initialized");
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "Stats pointer can't be NULL");
+
+#if CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED
+    msc_storage_obj_t *storage = (msc_storage_obj_t *) handle;
+    ESP_RETURN_ON_FALSE(storage->medium->type == STORAGE_MEDIUM_TYPE_SPIFLASH, ESP_ERR_NOT_SUPPORTED,
+                        TAG, "Integrity checking is only available for SPI Flash storage");
+    return storage_integrity_get_stats(stats);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif // CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED
+}
+
+esp_err_t tinyusb_msc_get_storage_wear_stats(tinyusb_msc_storage_handle_t handle,
+                                             tinyusb_msc_wear_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(p_msc_driver != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC driver is not initialized");
+    ESP_RETURN_ON_FALSE(handle != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC storage is not initialized");
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "Stats pointer can't be NULL");
+
+    msc_storage_obj_t *storage = (msc_storage_obj_t *) handle;
+    ESP_RETURN_ON_FALSE(storage->medium->type == STORAGE_MEDIUM_TYPE_SPIFLASH, ESP_ERR_NOT_SUPPORTED,
+                        TAG, "Wear statistics are only available for SPI Flash storage");
+    return storage_spiflash_get_wear_stats(stats);
+}
+
+esp_err_t tinyusb_msc_get_storage_ftl_stats(tinyusb_msc_storage_handle_t handle,
+                                            tinyusb_msc_ftl_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(p_msc_driver != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC driver is not initialized");
+    ESP_RETURN_ON_FALSE(handle != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC storage is not initialized");
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "Stats pointer can't be NULL");
+
+    msc_storage_obj_t *storage = (msc_storage_obj_t *) handle;
+    ESP_RETURN_ON_FALSE(storage->medium->type == STORAGE_MEDIUM_TYPE_FTL, ESP_ERR_NOT_SUPPORTED,
+                        TAG, "Storage is not log-structured SPI Flash storage");
+#if CONFIG_TINYUSB_MSC_FTL_ENABLED
+    return storage_ftl_get_stats(stats);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif // CONFIG_TINYUSB_MSC_FTL_ENABLED
+}
+
 esp_err_t tinyusb_msc_set_storage_mount_point(tinyusb_msc_storage_handle_t handle,
                                               tinyusb_msc_mount_point_t mount_point)
 {
@@ -1083,6 +1934,7 @@ esp_err_t tinyusb_msc_config_storage_fat_fs(tinyusb_msc_storage_handle_t handle,
     storage->fat_fs.max_files = max_files > 0 ? max_files : 2;
     storage->fat_fs.do_not_format = fatfs_config->do_not_format;
     storage->fat_fs.format_flags = fatfs_config->format_flags;
+    storage->fat_fs.allocation_unit_size = fatfs_config->config.allocation_unit_size;
     if (storage->fat_fs.format_flags == 0) {
         // Use default format flags if not provided
         storage->fat_fs.format_flags = FM_ANY; // Auto-select FAT type based on volume size
@@ -1113,6 +1965,23 @@ esp_err_t tinyusb_msc_get_storage_mount_point(tinyusb_msc_storage_handle_t handl
     return ESP_OK;
 }
 
+esp_err_t tinyusb_msc_get_storage_drive(tinyusb_msc_storage_handle_t handle, uint8_t *pdrv)
+{
+    ESP_RETURN_ON_FALSE(p_msc_driver != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC driver is not initialized");
+    ESP_RETURN_ON_FALSE(handle != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC storage is not initialized");
+    ESP_RETURN_ON_FALSE(pdrv != NULL, ESP_ERR_INVALID_ARG, TAG, "Drive pointer can't be NULL");
+
+    MSC_ENTER_CRITICAL();
+    msc_storage_obj_t *storage = (msc_storage_obj_t *) handle;
+    const BYTE drive = storage->fat_fs.pdrv;
+    MSC_EXIT_CRITICAL();
+
+    // The filesystem is only mounted while the application owns the storage
+    ESP_RETURN_ON_FALSE(drive != 0xFF, ESP_ERR_INVALID_STATE, TAG, "Storage is not mounted to the application");
+    *pdrv = drive;
+    return ESP_OK;
+}
+
 esp_err_t tinyusb_msc_format_storage(tinyusb_msc_storage_handle_t handle)
 {
     ESP_RETURN_ON_FALSE(p_msc_driver != NULL, ESP_ERR_INVALID_STATE, TAG, "MSC driver is not initialized");
@@ -1146,8 +2015,9 @@ esp_err_t tinyusb_msc_format_storage(tinyusb_msc_storage_handle_t handle)
     // Mount the FAT FS
     ret = vfs_fat_mount(drv, fs, true);
     ESP_RETURN_ON_FALSE(ret == ESP_ERR_NOT_FOUND, ESP_ERR_NOT_FOUND, TAG, "Unexpected filesystem found on the drive");
-    ESP_RETURN_ON_ERROR(vfs_fat_format(storage->fat_fs.format_flags), TAG, "Failed to format the drive");
+    ESP_RETURN_ON_ERROR(vfs_fat_format(storage), TAG, "Failed to format the drive");
     ESP_RETURN_ON_ERROR(vfs_fat_mount(drv, fs, false), TAG, "Failed to mount FAT filesystem");
+    storage->fat_fs.pdrv = pdrv;
 
     ESP_LOGD(TAG, "Storage formatted successfully");
     return ESP_OK;
@@ -1160,7 +2030,42 @@ esp_err_t tinyusb_msc_format_storage(tinyusb_msc_storage_handle_t handle)
 /** User can add and use more codes as per the need of the application **/
 #define SCSI_CODE_ASC_MEDIUM_NOT_PRESENT                0x3A /** SCSI ASC code for 'MEDIUM NOT PRESENT' **/
 #define SCSI_CODE_ASC_INVALID_COMMAND_OPERATION_CODE    0x20 /** SCSI ASC code for 'INVALID COMMAND OPERATION CODE' **/
+#define SCSI_CODE_ASC_PARAMETERS_CHANGED                0x2A /** SCSI ASC code for 'PARAMETERS CHANGED' **/
+#define SCSI_CODE_ASC_WRITE_ERROR                       0x0C /** SCSI ASC code for 'WRITE ERROR' **/
 #define SCSI_CODE_ASCQ                                  0x00
+#define SCSI_CODE_ASCQ_CAPACITY_DATA_HAS_CHANGED        0x09 /** SCSI ASCQ code for 'CAPACITY DATA HAS CHANGED' **/
+
+#define SCSI_CMD_SYNCHRONIZE_CACHE_10                   0x35 /** Not in the TinyUSB command list **/
+
+/**
+ * @brief Write back what the storage of a LUN holds in RAM, for SYNCHRONIZE CACHE
+ *
+ * Waits for the deferred writes, writes the batch and syncs the medium.
+ *
+ * @param lun Logical unit number
+ *
+ * @return
+ *    - ESP_OK: Everything written, also if the LUN has no storage
+ *    - Error of the medium otherwise
+ */
+static esp_err_t msc_storage_sync_lun(uint8_t lun)
+{
+    msc_storage_obj_t *storage = NULL;
+
+    MSC_ENTER_CRITICAL();
+    bool found = _msc_storage_get_by_lun(lun, &storage);
+    MSC_EXIT_CRITICAL();
+    if (!found || storage == NULL) {
+        return ESP_OK;
+    }
+
+    msc_storage_wait_deferred(storage, portMAX_DELAY);
+    ESP_RETURN_ON_ERROR(msc_storage_batch_flush(storage), TAG, "Batch write failed");
+    xSemaphoreTake(storage->mux_lock, portMAX_DELAY);
+    esp_err_t ret = storage_medium_sync(storage->medium);
+    xSemaphoreGive(storage->mux_lock);
+    return ret;
+}
 
 // Invoked when received GET_MAX_LUN request, required for multiple LUNs implementation
 uint8_t tud_msc_get_maxlun_cb(void)
@@ -1198,9 +2103,19 @@ bool tud_msc_test_unit_ready_cb(uint8_t lun)
 
     MSC_ENTER_CRITICAL();
     bool found = _msc_storage_get_by_lun(lun, &storage);
+    bool capacity_changed = false;
+    if (found && (storage != NULL) && (storage->mount_point == TINYUSB_MSC_STORAGE_MOUNT_USB)) {
+        // Report the new capacity once; the host re-issues READ CAPACITY
+        capacity_changed = storage->capacity_changed;
+        storage->capacity_changed = false;
+    }
     MSC_EXIT_CRITICAL();
 
     if (found && (storage != NULL) && (storage->mount_point == TINYUSB_MSC_STORAGE_MOUNT_USB)) {
+        if (capacity_changed) {
+            tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION, SCSI_CODE_ASC_PARAMETERS_CHANGED, SCSI_CODE_ASCQ_CAPACITY_DATA_HAS_CHANGED);
+            return false;
+        }
         // Storage media is ready for access by USB host
         return true;
     }
@@ -1252,7 +2167,12 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
 // - Application fill the buffer (up to bufsize) with address contents and return number of read byte.
 int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize)
 {
+    if (!msc_storage_lun_ready(lun)) {
+        return 0; // Reads must see the pending writes, TinyUSB calls again
+    }
+    TRACE_BEGIN("msc_read");
     esp_err_t err = msc_storage_read_sector(lun, lba, offset, bufsize, buffer);
+    TRACE_END("msc_read");
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "READ(10) command failed, %s", esp_err_to_name(err));
         tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, SCSI_CODE_ASC_INVALID_COMMAND_OPERATION_CODE, SCSI_CODE_ASCQ);
@@ -1271,6 +2191,9 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *
         ESP_LOGE(TAG, "Buffer size %"PRIu32" exceeds maximum allowed size %d", bufsize, MSC_STORAGE_BUFFER_SIZE);
         goto error;
     }
+    if (!msc_storage_lun_ready(lun)) {
+        return 0; // The write buffers are in use, TinyUSB calls again with the same chunk
+    }
     esp_err_t err = msc_storage_write_sector_deferred(lun, lba, offset, bufsize, buffer);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "WRITE(10) command failed, %s", esp_err_to_name(err));
@@ -1284,6 +2207,23 @@ error:
     return -1; // Indicate an error occurred
 }
 
+// Invoked when all the data of a SCSI WRITE10 command was received
+// - Write the batched chunks, deferred as the chunks written one by one
+void tud_msc_write10_complete_cb(uint8_t lun)
+{
+    msc_storage_obj_t *storage = NULL;
+
+    MSC_ENTER_CRITICAL();
+    bool found = _msc_storage_get_by_lun(lun, &storage);
+    // A pending write of the full batch covers the whole batch
+    bool pending = found && storage != NULL && storage->deffered_writes != 0;
+    MSC_EXIT_CRITICAL();
+
+    if (found && storage != NULL && !pending && storage->batch.dirty) {
+        msc_storage_batch_defer_flush(storage);
+    }
+}
+
 /**
  * Invoked when received an SCSI command not in built-in list below.
  * - READ_CAPACITY10, READ_FORMAT_CAPACITY, INQUIRY, TEST_UNIT_READY, START_STOP_UNIT, MODE_SENSE6, REQUEST_SENSE
@@ -1311,6 +2251,16 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, u
         the storage media/partition. */
         ret = 0;
         break;
+    case SCSI_CMD_SYNCHRONIZE_CACHE_10:
+        /* The host expects the data it wrote to be on the medium: hot blocks held in RAM
+        are written now instead of after their delay. */
+        if (msc_storage_sync_lun(lun) != ESP_OK) {
+            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, SCSI_CODE_ASC_WRITE_ERROR, SCSI_CODE_ASCQ);
+            ret = -1;
+            break;
+        }
+        ret = 0;
+        break;
     default:
         ESP_LOGW(TAG, "tud_msc_scsi_cb() invoked: %d", scsi_cmd[0]);
         tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, SCSI_CODE_ASC_INVALID_COMMAND_OPERATION_CODE, SCSI_CODE_ASCQ);
@@ -81,6 +81,7 @@ static void tinyusb_device_task(void *arg)
     xTaskNotifyGive(task_ctx->awaiting_handle);     // Notify parent task that TinyUSB stack was started successfully
 
     while (1) { // RTOS forever loop
+        // Sleeps on the event queue until the USB interrupt or a deferred call posts an event
         tud_task();
     }
 
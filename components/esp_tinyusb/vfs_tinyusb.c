@@ -8,6 +8,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdio_ext.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/errno.h>
 #include <sys/fcntl.h>
@@ -15,18 +16,20 @@
 #include <sys/param.h>
 #include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_vfs.h"
 #include "esp_vfs_dev.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "tinyusb.h"
 #include "tinyusb_cdc_acm.h"
+#include "cdc.h"
 #include "vfs_tinyusb.h"
+#include "vfs_tinyusb_eol.h"
 #include "sdkconfig.h"
 
 const static char *TAG = "tusb_vfs";
 
-// Token signifying that no character is available
-#define NONE -1
-
 #define FD_CHECK(fd, ret_val) do {                      \
                                     if ((fd) != 0) {    \
                                     errno = EBADF;      \
@@ -60,8 +63,25 @@ typedef struct {
     uint32_t flags;
     char vfs_path[VFS_TUSB_MAX_PATH];
     int cdc_intf;
+    esp_timer_handle_t flush_timer; // Flushes the last, partial packet of a write
+    SemaphoreHandle_t rx_sem;       // Given when data is received, blocking reads wait for it
+    _lock_t select_lock;
+    struct vfs_tinyusb_select *select; // The select() waiting for the interface, NULL if none
 } vfs_tinyusb_t;
 
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+/**
+ * @brief State of a select() call on the interface
+ */
+typedef struct vfs_tinyusb_select {
+    esp_vfs_select_sem_t sem;   /*!< Semaphore of the select() call */
+    fd_set *readfds;            /*!< Sets of the call, filled when the interface becomes ready */
+    fd_set *writefds;
+    fd_set readfds_orig;        /*!< Descriptors the call waits for */
+    fd_set writefds_orig;
+} vfs_tinyusb_select_t;
+#endif // CONFIG_VFS_SUPPORT_SELECT
+
 static vfs_tinyusb_t s_vfstusb;
 
 
@@ -88,13 +108,85 @@ static esp_err_t apply_path(char const *path)
  * @param path - a path where the CDC will be registered
  * @return esp_err_t ESP_OK or ESP_ERR_INVALID_ARG
  */
+static void tusb_flush_timer_cb(void *arg)
+{
+    (void) arg;
+    _lock_acquire(&(s_vfstusb.write_lock));
+    tud_cdc_n_write_flush(s_vfstusb.cdc_intf);
+    _lock_release(&(s_vfstusb.write_lock));
+}
+
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+/**
+ * @brief Mark the descriptor of the select() call ready and wake it, if it is
+ */
+static void tusb_select_check(vfs_tinyusb_select_t *sel)
+{
+    bool ready = false;
+    if (FD_ISSET(0, &sel->readfds_orig) && tud_cdc_n_available(s_vfstusb.cdc_intf) > 0) {
+        FD_SET(0, sel->readfds);
+        ready = true;
+    }
+    if (FD_ISSET(0, &sel->writefds_orig) && tud_cdc_n_write_available(s_vfstusb.cdc_intf) > 0) {
+        FD_SET(0, sel->writefds);
+        ready = true;
+    }
+    if (ready) {
+        esp_vfs_select_triggered(sel->sem);
+    }
+}
+#endif // CONFIG_VFS_SUPPORT_SELECT
+
+/**
+ * @brief Wake the readers of the interface, called by the CDC-ACM driver on RX and TX complete
+ */
+static void tusb_notify(int itf)
+{
+    if (itf != s_vfstusb.cdc_intf) {
+        return;
+    }
+    if (tud_cdc_n_available(itf) > 0) {
+        xSemaphoreGive(s_vfstusb.rx_sem);
+    }
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+    _lock_acquire(&(s_vfstusb.select_lock));
+    if (s_vfstusb.select) {
+        tusb_select_check(s_vfstusb.select);
+    }
+    _lock_release(&(s_vfstusb.select_lock));
+#endif // CONFIG_VFS_SUPPORT_SELECT
+}
+
 static esp_err_t vfstusb_init(int cdc_intf, char const *path)
 {
     s_vfstusb.cdc_intf = cdc_intf;
     s_vfstusb.tx_mode = DEFAULT_TX_MODE;
     s_vfstusb.rx_mode = DEFAULT_RX_MODE;
 
-    return apply_path(path);
+    esp_err_t ret = apply_path(path);
+    if (ret == ESP_OK) {
+        s_vfstusb.rx_sem = xSemaphoreCreateBinary();
+        if (s_vfstusb.rx_sem == NULL) {
+            ESP_LOGE(TAG, "Can't create the RX semaphore");
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = tinyusb_cdcacm_set_notify(cdc_intf, &tusb_notify);
+    }
+#if CONFIG_TINYUSB_CDC_VFS_FLUSH_DELAY_US
+    if (ret == ESP_OK) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = &tusb_flush_timer_cb,
+            .name = "tusb_vfs_flush",
+        };
+        ret = esp_timer_create(&timer_args, &s_vfstusb.flush_timer);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Can't create the flush timer");
+        }
+    }
+#endif // CONFIG_TINYUSB_CDC_VFS_FLUSH_DELAY_US
+    return ret;
 }
 
 /**
@@ -102,8 +194,17 @@ static esp_err_t vfstusb_init(int cdc_intf, char const *path)
  */
 static void vfstusb_deinit(void)
 {
+    tinyusb_cdcacm_set_notify(s_vfstusb.cdc_intf, NULL);
+    if (s_vfstusb.rx_sem) {
+        vSemaphoreDelete(s_vfstusb.rx_sem);
+    }
+    if (s_vfstusb.flush_timer) {
+        esp_timer_stop(s_vfstusb.flush_timer);
+        esp_timer_delete(s_vfstusb.flush_timer);
+    }
     _lock_close(&(s_vfstusb.write_lock));
     _lock_close(&(s_vfstusb.read_lock));
+    _lock_close(&(s_vfstusb.select_lock));
     memset(&s_vfstusb, 0, sizeof(s_vfstusb));
 }
 
@@ -111,89 +212,103 @@ static int tusb_open(const char *path, int flags, int mode)
 {
     (void) mode;
     (void) path;
-    s_vfstusb.flags = flags | O_NONBLOCK; // for now only non-blocking mode is implemented
+    s_vfstusb.flags = flags;
     return 0;
 }
 
-static ssize_t tusb_write(int fd, const void *data, size_t size)
+static void tusb_write_sink(void *ctx, const char *data, size_t size)
 {
-    FD_CHECK(fd, -1);
-    size_t written_sz = 0;
-    const char *data_c = (const char *)data;
-    _lock_acquire(&(s_vfstusb.write_lock));
-    for (size_t i = 0; i < size; i++) {
-        int c = data_c[i];
-        if (c != '\n') {
-            if (!tinyusb_cdcacm_write_queue_char(s_vfstusb.cdc_intf, c)) {
-                break; // can't write anymore
-            }
-        } else {
-            if (s_vfstusb.tx_mode == ESP_LINE_ENDINGS_CRLF || s_vfstusb.tx_mode == ESP_LINE_ENDINGS_CR) {
-                char cr = '\r';
-                if (!tinyusb_cdcacm_write_queue_char(s_vfstusb.cdc_intf, cr)) {
-                    break; // can't write anymore
-                }
-            }
-            if (s_vfstusb.tx_mode == ESP_LINE_ENDINGS_CRLF || s_vfstusb.tx_mode == ESP_LINE_ENDINGS_LF) {
-                char lf = '\n';
-                if (!tinyusb_cdcacm_write_queue_char(s_vfstusb.cdc_intf, lf)) {
-                    break; // can't write anymore
-                }
-            }
+    (void) ctx;
+    tinyusb_cdcacm_write_queue(s_vfstusb.cdc_intf, (const uint8_t *)data, size);
+}
+
+/**
+ * @brief Send the data queued in the TX FIFO
+ *
+ * TinyUSB sends full packets as soon as they are queued and the rest of the FIFO when the transfer in progress
+ * completes, only the last, partial packet of an idle channel needs a flush. Like Nagle's algorithm, the flush is
+ * delayed so the following writes fill the packet, unless the FIFO is full.
+ *
+ * @param[in] now Flush without delay
+ */
+static void tusb_write_flush(bool now)
+{
+#if CONFIG_TINYUSB_CDC_VFS_FLUSH_DELAY_US
+    if (!now) {
+        if (!esp_timer_is_active(s_vfstusb.flush_timer)) {
+            esp_timer_start_once(s_vfstusb.flush_timer, CONFIG_TINYUSB_CDC_VFS_FLUSH_DELAY_US);
         }
-        written_sz++;
+        return;
     }
+#endif // CONFIG_TINYUSB_CDC_VFS_FLUSH_DELAY_US
     tud_cdc_n_write_flush(s_vfstusb.cdc_intf);
+}
+
+static ssize_t tusb_write(int fd, const void *data, size_t size)
+{
+    FD_CHECK(fd, -1);
+    const char *eol = (s_vfstusb.tx_mode == ESP_LINE_ENDINGS_CRLF) ? "\r\n" :
+                      (s_vfstusb.tx_mode == ESP_LINE_ENDINGS_CR) ? "\r" : "\n";
+    _lock_acquire(&(s_vfstusb.write_lock));
+    const size_t space = tud_cdc_n_write_available(s_vfstusb.cdc_intf);
+    const size_t written_sz = vfs_tusb_eol_tx((const char *)data, size, eol, space, &tusb_write_sink, NULL);
+    tusb_write_flush(written_sz < size);
     _lock_release(&(s_vfstusb.write_lock));
     return written_sz;
 }
 
-static int tusb_close(int fd)
+static int tusb_fsync(int fd)
 {
     FD_CHECK(fd, -1);
+    _lock_acquire(&(s_vfstusb.write_lock));
+    tusb_write_flush(true);
+    _lock_release(&(s_vfstusb.write_lock));
     return 0;
 }
 
-static ssize_t tusb_read(int fd, void *data, size_t size)
+static int tusb_close(int fd)
 {
     FD_CHECK(fd, -1);
-    char *data_c = (char *) data;
-    size_t received = 0;
-    _lock_acquire(&(s_vfstusb.read_lock));
+    return 0;
+}
 
-    if (tud_cdc_n_available(s_vfstusb.cdc_intf) == 0) {
-        goto finish;
+/**
+ * @brief Read the data received so far and translate its line endings
+ *
+ * @return Size of the translated data, 0 if nothing was received
+ */
+static size_t tusb_read_available(char *data, size_t size)
+{
+    const int itf = s_vfstusb.cdc_intf;
+    size_t received = tud_cdc_n_read(itf, data, size);
+    if (received == 0 || s_vfstusb.rx_mode == ESP_LINE_ENDINGS_LF) {
+        return received;
     }
-    while (received < size) {
-        int c = tud_cdc_n_read_char(s_vfstusb.cdc_intf);
-        if ( c == NONE) { // if data ends
-            break;
-        }
-
-        // Handle line endings. From configured mode -> LF mode
-        if (s_vfstusb.rx_mode == ESP_LINE_ENDINGS_CR) {
-            // Change CRs to newlines
-            if (c == '\r') {
-                c = '\n';
-            }
-        } else if (s_vfstusb.rx_mode == ESP_LINE_ENDINGS_CRLF) {
-            if (c == '\r') {
-                uint8_t next_char = NONE;
-                // Check if next char is newline. If yes, we got CRLF sequence
-                tud_cdc_n_peek(s_vfstusb.cdc_intf, &next_char);
-                if (next_char == '\n') {
-                    c = tud_cdc_n_read_char(s_vfstusb.cdc_intf); // Remove '\n' from the fifo
-                }
-            }
-        }
+    if (s_vfstusb.rx_mode == ESP_LINE_ENDINGS_CR) {
+        return vfs_tusb_eol_rx(data, received, "\r");
+    }
+    received = vfs_tusb_eol_rx(data, received, "\r\n");
+    // A CR at the end of the read may be completed by the next character in the FIFO
+    uint8_t next_char;
+    if (data[received - 1] == '\r' && tud_cdc_n_peek(itf, &next_char) && next_char == '\n') {
+        tud_cdc_n_read_char(itf);
+        data[received - 1] = '\n';
+    }
+    return received;
+}
 
-        data_c[received] = (char) c;
-        ++received;
-        if (c == '\n') {
-            break;
-        }
+static ssize_t tusb_read(int fd, void *data, size_t size)
+{
+    FD_CHECK(fd, -1);
+    if (size == 0) {
+        return 0;
+    }
+    size_t received;
+    _lock_acquire(&(s_vfstusb.read_lock));
+    while ((received = tusb_read_available((char *) data, size)) == 0 && !(s_vfstusb.flags & O_NONBLOCK)) {
+        // Given by tusb_notify() when data arrives, also when it arrived after the read above
+        xSemaphoreTake(s_vfstusb.rx_sem, portMAX_DELAY);
     }
-finish:
     _lock_release(&(s_vfstusb.read_lock));
     if (received > 0) {
         return received;
@@ -202,6 +317,53 @@ finish:
     return -1;
 }
 
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+static esp_err_t tusb_start_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+                                   esp_vfs_select_sem_t sem, void **end_select_args)
+{
+    (void) nfds;
+    *end_select_args = NULL;
+    vfs_tinyusb_select_t *sel = calloc(1, sizeof(vfs_tinyusb_select_t));
+    if (sel == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    sel->sem = sem;
+    sel->readfds = readfds;
+    sel->writefds = writefds;
+    sel->readfds_orig = *readfds;
+    sel->writefds_orig = *writefds;
+    FD_ZERO(readfds);
+    FD_ZERO(writefds);
+    FD_ZERO(exceptfds);
+
+    _lock_acquire(&(s_vfstusb.select_lock));
+    if (s_vfstusb.select) {
+        _lock_release(&(s_vfstusb.select_lock));
+        free(sel);
+        ESP_LOGE(TAG, "Only one select() at a time is supported");
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_vfstusb.select = sel;
+    // Data received before the call
+    tusb_select_check(sel);
+    _lock_release(&(s_vfstusb.select_lock));
+    *end_select_args = sel;
+    return ESP_OK;
+}
+
+static esp_err_t tusb_end_select(void *end_select_args)
+{
+    vfs_tinyusb_select_t *sel = (vfs_tinyusb_select_t *) end_select_args;
+    if (sel) {
+        _lock_acquire(&(s_vfstusb.select_lock));
+        s_vfstusb.select = NULL;
+        _lock_release(&(s_vfstusb.select_lock));
+        free(sel);
+    }
+    return ESP_OK;
+}
+#endif // CONFIG_VFS_SUPPORT_SELECT
+
 static int tusb_fstat(int fd, struct stat *st)
 {
     FD_CHECK(fd, -1);
@@ -274,14 +436,20 @@ esp_err_t esp_vfs_tusb_cdc_register(int cdc_intf, char const *path)
         .close = &tusb_close,
         .fcntl = &tusb_fcntl,
         .fstat = &tusb_fstat,
+        .fsync = &tusb_fsync,
         .open = &tusb_open,
         .read = &tusb_read,
         .write = &tusb_write,
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+        .start_select = &tusb_start_select,
+        .end_select = &tusb_end_select,
+#endif // CONFIG_VFS_SUPPORT_SELECT
     };
 
     res = esp_vfs_register(s_vfstusb.vfs_path, &vfs, NULL);
     if (res != ESP_OK) {
         ESP_LOGE(TAG, "Can't register CDC-VFS driver (err: %x)", res);
+        vfstusb_deinit();
     } else {
         ESP_LOGD(TAG, "CDC-VFS registered (%s)", s_vfstusb.vfs_path);
     }
@@ -0,0 +1,105 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+#include "vfs_tinyusb_eol.h"
+
+#define EOL_ONES    0x01010101u     // One in every byte of a word
+#define EOL_HIGHS   0x80808080u     // High bit of every byte of a word
+
+const char *vfs_tusb_eol_find(const char *p, const char *end, char c)
+{
+    // Up to a word boundary byte by byte
+    while (p < end && ((uintptr_t)p & (sizeof(uint32_t) - 1)) != 0) {
+        if (*p == c) {
+            return p;
+        }
+        p++;
+    }
+    // Words: the matching bytes are zero after the XOR, a zero byte borrows in the subtraction
+    const uint32_t pattern = EOL_ONES * (uint8_t)c;
+    for (; end - p >= (ptrdiff_t)sizeof(uint32_t); p += sizeof(uint32_t)) {
+        uint32_t w;
+        memcpy(&w, __builtin_assume_aligned(p, sizeof(uint32_t)), sizeof(w));
+        w ^= pattern;
+        if (((w - EOL_ONES) & ~w & EOL_HIGHS) != 0) {
+            break;
+        }
+    }
+    // The matching word, or the tail
+    while (p < end && *p != c) {
+        p++;
+    }
+    return p;
+}
+
+size_t vfs_tusb_eol_tx(const char *src, size_t size, const char *eol, size_t space, vfs_tusb_eol_sink_t sink, void *ctx)
+{
+    const size_t eol_len = strlen(eol);
+    if (eol_len == 1 && eol[0] == '\n') {
+        const size_t len = MIN(size, space);
+        if (len > 0) {
+            sink(ctx, src, len);
+        }
+        return len;
+    }
+
+    // A CRLF line ending reuses the newline of the data: the CR is inserted and the LF starts the next run
+    const size_t keep = (eol[eol_len - 1] == '\n') ? 1 : 0;
+    const char *end = src + size;
+    const char *run = src;      // Start of the data not yet given to the sink
+    const char *p = src;        // Where the next newline is searched from
+    while (true) {
+        const char *nl = vfs_tusb_eol_find(p, end, '\n');
+        const size_t len = MIN((size_t)(nl - run), space);
+        if (len > 0) {
+            sink(ctx, run, len);
+            space -= len;
+            run += len;
+        }
+        if (run != nl || nl == end || space < eol_len) {
+            break;
+        }
+        sink(ctx, eol, eol_len - keep);
+        space -= eol_len - keep;    // The kept newline was counted in eol_len, its space stays reserved
+        run = nl + 1 - keep;
+        p = nl + 1;
+    }
+    return run - src;
+}
+
+size_t vfs_tusb_eol_rx(char *buf, size_t size, const char *eol)
+{
+    char *const end = buf + size;
+    if (eol[0] != '\r') {
+        return size;
+    }
+    if (eol[1] == '\0') {
+        for (char *p = buf; (p = (char *)vfs_tusb_eol_find(p, end, '\r')) != end; p++) {
+            *p = '\n';
+        }
+        return size;
+    }
+
+    // CRLF: the data between the dropped CRs moves down in runs
+    char *dst = (char *)vfs_tusb_eol_find(buf, end, '\r');
+    const char *src = dst;
+    while (src < end) {
+        // src is at a CR, drop it if a LF follows
+        const char *run = (src + 1 < end && src[1] == '\n') ? src + 1 : src;
+        const char *next = vfs_tusb_eol_find(src + 1, end, '\r');
+        const size_t len = next - run;
+        if (dst != run) {
+            memmove(dst, run, len);
+        }
+        dst += len;
+        src = next;
+    }
+    return dst - buf;
+}
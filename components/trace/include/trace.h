@@ -0,0 +1,194 @@
+/**
+ * @file trace.h
+ * @brief Per-core trace buffer for span and counter events
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ *
+ * @section description Description
+ * Compile-time enabled tracing (CONFIG_TRACE) of how tasks interleave on
+ * the two cores:
+ * - TRACE_BEGIN/TRACE_END mark a span of the calling task
+ * - TRACE_COUNTER records a value over time
+ *
+ * Each event is 16 bytes in a lock-free ring of the core it ran on: CPU
+ * cycle count, name address, task handle and value. A tick hook adds a
+ * sync event once per CONFIG_TRACE_SYNC_MS that pairs the cycle count
+ * with esp_timer time, so cycles of both cores map to one time line even
+ * across a CPU frequency change.
+ *
+ * trace_dump() streams the rings with the names and task names they refer
+ * to; trace_save() writes that stream to a file (e.g. on the FATFS
+ * volume). tools/trace/trace2json.py converts it to Chrome trace JSON for
+ * chrome://tracing or ui.perfetto.dev.
+ *
+ * Without CONFIG_TRACE the macros compile to nothing.
+ *
+ * @section usage Usage
+ * @code
+ * TRACE_BEGIN("flush");
+ * flush_cache();
+ * TRACE_END("flush");
+ * TRACE_COUNTER("queue_depth", uxQueueMessagesWaiting(queue));
+ *
+ * trace_save("/data/trace.bin");
+ * @endcode
+ * Names must be string literals (or otherwise never freed), only their
+ * address is recorded.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_MAGIC         "TRC1"  /**< First bytes of a dump */
+#define TRACE_CHUNK_MAX     1024    /**< Largest chunk payload of a dump */
+
+/**
+ * @brief Event types
+ */
+typedef enum {
+    TRACE_EV_BEGIN = 0,     /**< Span begins */
+    TRACE_EV_END,           /**< Span ends */
+    TRACE_EV_COUNTER,       /**< Counter value */
+    TRACE_EV_SYNC,          /**< Value is the low 32 bits of esp_timer_get_time() */
+} trace_event_type_t;
+
+/**
+ * @brief Chunk types of a dump
+ *
+ * A dump is TRACE_MAGIC followed by chunks of a 4-byte header (type,
+ * core, little-endian payload length) and the payload.
+ */
+typedef enum {
+    TRACE_CHUNK_HEADER = 1, /**< CPU clock in Hz (u32), number of cores (u32) */
+    TRACE_CHUNK_NAME,       /**< Name address (u32) and characters */
+    TRACE_CHUNK_TASK,       /**< Task handle (u32) and task name */
+    TRACE_CHUNK_EVENTS,     /**< trace_event_t array of the chunk's core */
+    TRACE_CHUNK_END,        /**< Events dropped (u32) per core */
+} trace_chunk_type_t;
+
+/**
+ * @brief Event as stored and dumped
+ */
+typedef struct {
+    uint32_t cycles;        /**< CPU cycle count of the recording core */
+    uint32_t name;          /**< Address of the name, 0 while being written */
+    uint32_t task;          /**< Task handle (0 in an ISR), type in bits 0-1 */
+    int32_t value;          /**< Counter or sync value */
+} trace_event_t;
+
+/**
+ * @brief Ring statistics of one core
+ */
+typedef struct {
+    uint32_t events;        /**< Events recorded since trace_start() */
+    uint32_t dropped;       /**< Events dropped, ring full */
+    uint32_t used;          /**< Events waiting now */
+    uint32_t capacity;      /**< Ring size in events */
+} trace_stats_t;
+
+/**
+ * @brief Dump output
+ *
+ * @return ESP_OK to continue, an error to abort the dump
+ */
+typedef esp_err_t (*trace_write_fn_t)(const void *data, size_t len, void *ctx);
+
+/** Events are recorded while true */
+extern volatile bool trace_active;
+
+/**
+ * @brief Record an Event
+ *
+ * Use the TRACE_x macros. Callable from tasks and ISRs on either core.
+ *
+ * @param[in] type Event type
+ * @param[in] name Event name, a string literal
+ * @param[in] value Counter value, 0 for spans
+ */
+void trace_event(trace_event_type_t type, const char *name, int32_t value);
+
+/**
+ * @brief Start Time Syncs and Tracing
+ *
+ * Registers the per-core tick hooks and calls trace_start().
+ *
+ * @return
+ *    - ESP_OK: Tracing started
+ *    - ESP_ERR_INVALID_STATE: Already initialized
+ *    - ESP_ERR_NO_MEM: Tick hooks could not be registered
+ */
+esp_err_t trace_init(void);
+
+/**
+ * @brief Discard Recorded Events and Record Again
+ */
+void trace_start(void);
+
+/**
+ * @brief Stop Recording, Keep the Events
+ */
+void trace_stop(void);
+
+/**
+ * @brief Stream the Recorded Events
+ *
+ * Stops recording, then writes the dump: header, task names, and each
+ * core's events preceded by the names they use. The rings are empty
+ * afterwards; call trace_start() to record again.
+ *
+ * @param[in] write Output, called with TRACE_MAGIC and whole chunks
+ * @param[in] ctx Passed to write
+ *
+ * @return
+ *    - ESP_OK: Dump written
+ *    - ESP_ERR_INVALID_STATE: Another dump is running
+ *    - ESP_ERR_NO_MEM: No memory for the task list
+ *    - The error returned by write
+ */
+esp_err_t trace_dump(trace_write_fn_t write, void *ctx);
+
+/**
+ * @brief Dump to a File
+ *
+ * @param[in] path File to create or replace
+ *
+ * @return ESP_OK, ESP_FAIL if the file can't be written, or a trace_dump() error
+ */
+esp_err_t trace_save(const char *path);
+
+/**
+ * @brief Get Ring Statistics
+ *
+ * @param[in] core Core number
+ * @param[out] stats Statistics
+ *
+ * @return true if successful, false if the core number is invalid
+ */
+bool trace_get_stats(int core, trace_stats_t *stats);
+
+#if CONFIG_TRACE
+#define TRACE_BEGIN(name) do { if (trace_active) trace_event(TRACE_EV_BEGIN, name, 0); } while (0)
+#define TRACE_END(name) do { if (trace_active) trace_event(TRACE_EV_END, name, 0); } while (0)
+#define TRACE_COUNTER(name, value) do { if (trace_active) trace_event(TRACE_EV_COUNTER, name, (int32_t)(value)); } while (0)
+#else
+#define TRACE_BEGIN(name) do { } while (0)
+#define TRACE_END(name) do { } while (0)
+#define TRACE_COUNTER(name, value) do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
@@ -0,0 +1,23 @@
+/*
+ * @file test_app_main.c
+ * @brief Unity runner for the trace component
+ *
+ * Author: A.R. Ansari <ansarirahim1@gmail.com>
+ * Date: 2026-10-18
+ */
+
+#include "unity.h"
+#include "unity_test_runner.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void app_main(void)
+{
+    unity_run_menu();
+}
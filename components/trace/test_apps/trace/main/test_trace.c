@@ -0,0 +1,234 @@
+/**
+ * @file test_trace.c
+ * @brief Unit Tests for the Trace Component
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ *
+ * @section test_cases Test Cases
+ * - Dump layout: header, task names, names before the events using them
+ * - Full ring drops and counts, trace_start() clears
+ * - Both cores record at once, each into its own ring
+ * - Cost of an event
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "trace.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define DUMP_MAX    (48 * 1024)
+
+static uint8_t s_dump[DUMP_MAX];
+static size_t s_dump_len;
+
+static esp_err_t mem_write(const void *data, size_t len, void *ctx) {
+    (void)ctx;
+    if (s_dump_len + len > DUMP_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(s_dump + s_dump_len, data, len);
+    s_dump_len += len;
+    return ESP_OK;
+}
+
+/**
+ * @brief Dump contents, as parsed back
+ */
+typedef struct {
+    uint32_t cpu_hz;
+    uint32_t cores;
+    size_t tasks;
+    size_t names;
+    size_t events[portNUM_PROCESSORS];
+    uint32_t dropped[portNUM_PROCESSORS];
+    bool names_first;                       /**< Every event's name was sent before it */
+    bool ended;
+} dump_t;
+
+static void dump_parse(dump_t *d, trace_event_t *events, size_t max) {
+    static uint32_t names[64];
+    memset(d, 0, sizeof(*d));
+    d->names_first = true;
+    TEST_ASSERT_EQUAL_MEMORY(TRACE_MAGIC, s_dump, 4);
+
+    size_t n = 0;
+    for (size_t pos = 4; pos < s_dump_len;) {
+        const uint8_t type = s_dump[pos];
+        const uint8_t core = s_dump[pos + 1];
+        const size_t len = s_dump[pos + 2] | (s_dump[pos + 3] << 8);
+        const uint8_t *p = s_dump + pos + 4;
+        TEST_ASSERT_LESS_OR_EQUAL(s_dump_len, pos + 4 + len);
+
+        switch (type) {
+        case TRACE_CHUNK_HEADER:
+            memcpy(&d->cpu_hz, p, 4);
+            memcpy(&d->cores, p + 4, 4);
+            break;
+        case TRACE_CHUNK_TASK:
+            d->tasks++;
+            break;
+        case TRACE_CHUNK_NAME:
+            if (d->names < 64) {
+                memcpy(&names[d->names++], p, 4);
+            }
+            break;
+        case TRACE_CHUNK_EVENTS:
+            for (size_t i = 0; i < len / sizeof(trace_event_t); i++) {
+                trace_event_t ev;
+                memcpy(&ev, p + i * sizeof(ev), sizeof(ev));
+                bool known = false;
+                for (size_t j = 0; j < d->names; j++) {
+                    known |= (names[j] == ev.name);
+                }
+                d->names_first &= known;
+                d->events[core]++;
+                if (events && n < max) {
+                    events[n++] = ev;
+                }
+            }
+            break;
+        case TRACE_CHUNK_END:
+            memcpy(d->dropped, p, sizeof(d->dropped));
+            d->ended = true;
+            break;
+        default:
+            TEST_FAIL_MESSAGE("unknown chunk");
+        }
+        pos += 4 + len;
+    }
+}
+
+TEST_CASE("Trace: dump layout", "[trace][ci]") {
+    trace_start();
+    TRACE_BEGIN("outer");
+    TRACE_COUNTER("depth", -7);
+    TRACE_END("outer");
+    const int core = esp_cpu_get_core_id();
+
+    s_dump_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, trace_dump(mem_write, NULL));
+    TEST_ASSERT_FALSE(trace_active);
+
+    trace_event_t ev[4];
+    dump_t d;
+    dump_parse(&d, ev, 4);
+    TEST_ASSERT_EQUAL(esp_rom_get_cpu_ticks_per_us() * 1000000u, d.cpu_hz);
+    TEST_ASSERT_EQUAL(portNUM_PROCESSORS, d.cores);
+    TEST_ASSERT_GREATER_THAN(3, d.tasks);
+    TEST_ASSERT_EQUAL(2, d.names);
+    TEST_ASSERT_EQUAL(3, d.events[core]);
+    TEST_ASSERT_TRUE(d.names_first);
+    TEST_ASSERT_TRUE(d.ended);
+
+    const uint32_t me = (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+    TEST_ASSERT_EQUAL_STRING("outer", (const char *)(uintptr_t)ev[0].name);
+    TEST_ASSERT_EQUAL_HEX32(me | TRACE_EV_BEGIN, ev[0].task);
+    TEST_ASSERT_EQUAL_HEX32(me | TRACE_EV_COUNTER, ev[1].task);
+    TEST_ASSERT_EQUAL(-7, ev[1].value);
+    TEST_ASSERT_EQUAL_HEX32(me | TRACE_EV_END, ev[2].task);
+    TEST_ASSERT_TRUE(ev[2].cycles - ev[0].cycles < 100000);
+
+    /* Nothing recorded after the dump */
+    TRACE_BEGIN("outer");
+    s_dump_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, trace_dump(mem_write, NULL));
+    dump_parse(&d, NULL, 0);
+    TEST_ASSERT_EQUAL(0, d.events[core]);
+}
+
+TEST_CASE("Trace: full ring drops", "[trace][ci]") {
+    trace_start();
+    const int core = esp_cpu_get_core_id();
+    trace_stats_t st;
+    TEST_ASSERT_TRUE(trace_get_stats(core, &st));
+
+    for (uint32_t i = 0; i < st.capacity + 10; i++) {
+        TRACE_COUNTER("n", i);
+    }
+    TEST_ASSERT_TRUE(trace_get_stats(core, &st));
+    TEST_ASSERT_EQUAL(st.capacity, st.used);
+    TEST_ASSERT_EQUAL(st.capacity, st.events);
+    TEST_ASSERT_EQUAL(10, st.dropped);
+
+    s_dump_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, trace_dump(mem_write, NULL));
+    dump_t d;
+    dump_parse(&d, NULL, 0);
+    TEST_ASSERT_EQUAL(st.capacity, d.events[core]);
+    TEST_ASSERT_EQUAL(10, d.dropped[core]);
+
+    trace_start();
+    TEST_ASSERT_TRUE(trace_get_stats(core, &st));
+    TEST_ASSERT_EQUAL(0, st.used);
+    TEST_ASSERT_EQUAL(0, st.dropped);
+    TEST_ASSERT_FALSE(trace_get_stats(portNUM_PROCESSORS, &st));
+}
+
+#define SPANS_PER_TASK  60
+
+static void span_task(void *arg) {
+    for (int i = 0; i < SPANS_PER_TASK; i++) {
+        TRACE_BEGIN("work");
+        esp_rom_delay_us(10);
+        TRACE_END("work");
+        if (i % 16 == 0) {
+            vTaskDelay(1);
+        }
+    }
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Trace: both cores record", "[trace][ci]") {
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(portNUM_PROCESSORS, 0);
+    TEST_ASSERT_NOT_NULL(done);
+
+    trace_start();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(span_task, "span", 2048, done, 5, NULL, core));
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TEST_ASSERT_TRUE(xSemaphoreTake(done, pdMS_TO_TICKS(2000)));
+    }
+    vTaskDelay(2);
+    trace_stop();
+
+    static trace_event_t ev[2 * portNUM_PROCESSORS * SPANS_PER_TASK];
+    s_dump_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, trace_dump(mem_write, NULL));
+    dump_t d;
+    dump_parse(&d, ev, sizeof(ev) / sizeof(ev[0]));
+
+    size_t begins = 0;
+    size_t ends = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TEST_ASSERT_EQUAL(2 * SPANS_PER_TASK, d.events[core]);
+        TEST_ASSERT_EQUAL(0, d.dropped[core]);
+    }
+    for (size_t i = 0; i < sizeof(ev) / sizeof(ev[0]); i++) {
+        begins += (ev[i].task & 3) == TRACE_EV_BEGIN;
+        ends += (ev[i].task & 3) == TRACE_EV_END;
+    }
+    TEST_ASSERT_EQUAL(portNUM_PROCESSORS * SPANS_PER_TASK, begins);
+    TEST_ASSERT_EQUAL(portNUM_PROCESSORS * SPANS_PER_TASK, ends);
+    vSemaphoreDelete(done);
+}
+
+TEST_CASE("Trace: event cost", "[trace][ci]") {
+    trace_start();
+    const int n = 100;
+    const uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < n; i++) {
+        TRACE_COUNTER("cost", i);
+    }
+    const uint32_t cycles = (esp_cpu_get_cycle_count() - start) / n;
+    printf("trace event: %u cycles\n", (unsigned)cycles);
+    TEST_ASSERT_LESS_THAN(400, cycles);
+    trace_stop();
+}
@@ -0,0 +1,9 @@
+# SPDX-License-Identifier: Apache-2.0
+
+import pytest
+from pytest_embedded_idf.dut import IdfDut
+
+
+@pytest.mark.esp32s3
+def test_trace(dut: IdfDut) -> None:
+    dut.run_all_single_board_cases(group=['ci'])
@@ -0,0 +1,299 @@
+/**
+ * @file trace.c
+ * @brief Per-core trace buffer
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ *
+ * @section implementation Implementation Details
+ * - One ring of trace_event_t per core, with free-running head (reserved)
+ *   and tail (consumed) event counts. A writer reserves a slot with a
+ *   compare-and-swap on head and stores the name last; a slot with name 0
+ *   is still being written and ends a drain. The reader clears the name
+ *   of every slot it takes
+ * - The core, cycle count and task are read with interrupts masked, so
+ *   they always belong together; the rest of the write is lock-free, and
+ *   a task that migrates meanwhile still writes the ring it reserved in
+ * - A full ring drops new events and counts them
+ * - The tick hook of each core records a sync event every
+ *   CONFIG_TRACE_SYNC_MS, and on the first tick after trace_start()
+ */
+
+#include "trace.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_freertos_hooks.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef CONFIG_TRACE_BUFFER_EVENTS
+#define TRACE_RING_EVENTS       CONFIG_TRACE_BUFFER_EVENTS
+#define TRACE_SYNC_MS           CONFIG_TRACE_SYNC_MS
+#else
+#define TRACE_RING_EVENTS       1024
+#define TRACE_SYNC_MS           1000
+#endif
+
+_Static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "CONFIG_TRACE_BUFFER_EVENTS must be a power of two");
+
+#define TRACE_CORES             portNUM_PROCESSORS
+#define TRACE_DUMP_EVENTS       (TRACE_CHUNK_MAX / sizeof(trace_event_t))
+#define TRACE_NAMES_MAX         64      /**< Names remembered as sent during one dump */
+
+static const char *TAG = "trace";
+
+/**
+ * @brief Event ring of one core
+ */
+typedef struct {
+    trace_event_t ev[TRACE_RING_EVENTS];
+    atomic_uint_least32_t head;         /**< Events reserved */
+    atomic_uint_least32_t tail;         /**< Events consumed */
+    atomic_uint_least32_t events;       /**< Events recorded since trace_start() */
+    atomic_uint_least32_t dropped;      /**< Events dropped since trace_start() */
+} trace_ring_t;
+
+static trace_ring_t s_rings[TRACE_CORES];
+static uint32_t s_sync_ticks[TRACE_CORES];
+static volatile bool s_sync_pending[TRACE_CORES];
+static bool s_initialized = false;
+static atomic_flag s_dumping = ATOMIC_FLAG_INIT;
+
+/* Dump state, one dump at a time */
+static uint8_t s_chunk[4 + TRACE_CHUNK_MAX];
+static uint32_t s_names_sent[TRACE_NAMES_MAX];
+
+volatile bool trace_active = false;
+
+void IRAM_ATTR trace_event(trace_event_type_t type, const char *name, int32_t value) {
+    /* No task switch between reading the core and its cycle count */
+    const UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    const int core = esp_cpu_get_core_id();
+    const uint32_t cycles = esp_cpu_get_cycle_count();
+    const uint32_t task = xPortInIsrContext() ? 0 : (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandleForCore(core);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+
+    trace_ring_t *ring = &s_rings[core];
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    do {
+        if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= TRACE_RING_EVENTS) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&ring->head, &head, head + 1, memory_order_acquire,
+                                                    memory_order_relaxed));
+
+    trace_event_t *ev = &ring->ev[head & (TRACE_RING_EVENTS - 1)];
+    ev->cycles = cycles;
+    ev->task = task | (uint32_t)type;
+    ev->value = value;
+    __atomic_store_n(&ev->name, (uint32_t)(uintptr_t)name, __ATOMIC_RELEASE);
+    atomic_fetch_add_explicit(&ring->events, 1, memory_order_relaxed);
+}
+
+static void IRAM_ATTR trace_tick_hook(void) {
+    const int core = esp_cpu_get_core_id();
+    if (++s_sync_ticks[core] < pdMS_TO_TICKS(TRACE_SYNC_MS) && !s_sync_pending[core]) {
+        return;
+    }
+    s_sync_ticks[core] = 0;
+    s_sync_pending[core] = false;
+    if (trace_active) {
+        trace_event(TRACE_EV_SYNC, "sync", (int32_t)(uint32_t)esp_timer_get_time());
+    }
+}
+
+/**
+ * @brief Take Committed Events out of a Ring
+ */
+static size_t trace_drain(trace_ring_t *ring, trace_event_t *out, size_t max) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t n = 0;
+
+    while (tail != head && n < max) {
+        trace_event_t *ev = &ring->ev[tail & (TRACE_RING_EVENTS - 1)];
+        const uint32_t name = __atomic_load_n(&ev->name, __ATOMIC_ACQUIRE);
+        if (name == 0) {
+            break;
+        }
+        if (out) {
+            out[n] = *ev;
+            out[n].name = name;
+        }
+        __atomic_store_n(&ev->name, 0, __ATOMIC_RELAXED);
+        n++;
+        tail++;
+    }
+
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return n;
+}
+
+void trace_start(void) {
+    trace_active = false;
+    for (int core = 0; core < TRACE_CORES; core++) {
+        while (trace_drain(&s_rings[core], NULL, TRACE_RING_EVENTS) > 0) {
+        }
+        atomic_store_explicit(&s_rings[core].events, 0, memory_order_relaxed);
+        atomic_store_explicit(&s_rings[core].dropped, 0, memory_order_relaxed);
+        s_sync_pending[core] = true;
+    }
+    trace_active = true;
+}
+
+void trace_stop(void) {
+    trace_active = false;
+}
+
+esp_err_t trace_init(void) {
+    if (s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int core = 0; core < TRACE_CORES; core++) {
+        if (esp_register_freertos_tick_hook_for_cpu(trace_tick_hook, core) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register tick hook on core %d", core);
+            for (int i = 0; i < core; i++) {
+                esp_deregister_freertos_tick_hook_for_cpu(trace_tick_hook, i);
+            }
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_initialized = true;
+    trace_start();
+    ESP_LOGI(TAG, "Tracing %d events per core, sync every %d ms", TRACE_RING_EVENTS, TRACE_SYNC_MS);
+    return ESP_OK;
+}
+
+static esp_err_t trace_put_chunk(trace_write_fn_t write, void *ctx, trace_chunk_type_t type, int core, size_t len) {
+    s_chunk[0] = (uint8_t)type;
+    s_chunk[1] = (uint8_t)core;
+    s_chunk[2] = (uint8_t)(len & 0xFF);
+    s_chunk[3] = (uint8_t)(len >> 8);
+    return write(s_chunk, 4 + len, ctx);
+}
+
+static esp_err_t trace_put_name(trace_write_fn_t write, void *ctx, trace_chunk_type_t type, uint32_t id,
+                                const char *name) {
+    const size_t len = strnlen(name, TRACE_CHUNK_MAX - 4);
+    memcpy(s_chunk + 4, &id, 4);
+    memcpy(s_chunk + 8, name, len);
+    return trace_put_chunk(write, ctx, type, 0, 4 + len);
+}
+
+static esp_err_t trace_put_tasks(trace_write_fn_t write, void *ctx) {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    const UBaseType_t max = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *tasks = malloc(max * sizeof(TaskStatus_t));
+    if (!tasks) {
+        return ESP_ERR_NO_MEM;
+    }
+    const UBaseType_t n = uxTaskGetSystemState(tasks, max, NULL);
+    esp_err_t err = ESP_OK;
+    for (UBaseType_t i = 0; i < n && err == ESP_OK; i++) {
+        err = trace_put_name(write, ctx, TRACE_CHUNK_TASK, (uint32_t)(uintptr_t)tasks[i].xHandle,
+                             tasks[i].pcTaskName);
+    }
+    free(tasks);
+    return err;
+#else
+    (void)write;
+    (void)ctx;
+    return ESP_OK;
+#endif
+}
+
+esp_err_t trace_dump(trace_write_fn_t write, void *ctx) {
+    if (atomic_flag_test_and_set(&s_dumping)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    trace_stop();
+
+    size_t names = 0;
+    esp_err_t err = write(TRACE_MAGIC, 4, ctx);
+    if (err == ESP_OK) {
+        const uint32_t header[2] = { esp_rom_get_cpu_ticks_per_us() * 1000000u, TRACE_CORES };
+        memcpy(s_chunk + 4, header, sizeof(header));
+        err = trace_put_chunk(write, ctx, TRACE_CHUNK_HEADER, 0, sizeof(header));
+    }
+    if (err == ESP_OK) {
+        err = trace_put_tasks(write, ctx);
+    }
+
+    static trace_event_t events[TRACE_DUMP_EVENTS];
+    for (int core = 0; core < TRACE_CORES && err == ESP_OK; core++) {
+        size_t n;
+        while (err == ESP_OK && (n = trace_drain(&s_rings[core], events, TRACE_DUMP_EVENTS)) > 0) {
+            /* Names first, each once while the table has room */
+            for (size_t i = 0; i < n && err == ESP_OK; i++) {
+                bool sent = false;
+                for (size_t j = 0; j < names && !sent; j++) {
+                    sent = (s_names_sent[j] == events[i].name);
+                }
+                if (!sent) {
+                    err = trace_put_name(write, ctx, TRACE_CHUNK_NAME, events[i].name,
+                                         (const char *)(uintptr_t)events[i].name);
+                    if (names < TRACE_NAMES_MAX) {
+                        s_names_sent[names++] = events[i].name;
+                    }
+                }
+            }
+            if (err == ESP_OK) {
+                memcpy(s_chunk + 4, events, n * sizeof(trace_event_t));
+                err = trace_put_chunk(write, ctx, TRACE_CHUNK_EVENTS, core, n * sizeof(trace_event_t));
+            }
+        }
+    }
+
+    if (err == ESP_OK) {
+        uint32_t dropped[TRACE_CORES];
+        for (int core = 0; core < TRACE_CORES; core++) {
+            dropped[core] = atomic_load_explicit(&s_rings[core].dropped, memory_order_relaxed);
+        }
+        memcpy(s_chunk + 4, dropped, sizeof(dropped));
+        err = trace_put_chunk(write, ctx, TRACE_CHUNK_END, 0, sizeof(dropped));
+    }
+
+    atomic_flag_clear(&s_dumping);
+    return err;
+}
+
+static esp_err_t trace_file_write(const void *data, size_t len, void *ctx) {
+    return (fwrite(data, 1, len, (FILE *)ctx) == len) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t trace_save(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to create %s", path);
+        return ESP_FAIL;
+    }
+    esp_err_t err = trace_dump(trace_file_write, f);
+    if (fclose(f) != 0 && err == ESP_OK) {
+        err = ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save trace to %s: %s", path, esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool trace_get_stats(int core, trace_stats_t *stats) {
+    if (core < 0 || core >= TRACE_CORES || !stats) {
+        return false;
+    }
+    const trace_ring_t *ring = &s_rings[core];
+    stats->events = atomic_load_explicit(&ring->events, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    stats->used = atomic_load_explicit(&ring->head, memory_order_relaxed) -
+                  atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    stats->capacity = TRACE_RING_EVENTS;
+    return true;
+}
@@ -0,0 +1,374 @@
+/**
+ * @file binlog.c
+ * @brief Binary Log with Deferred Formatting Implementation
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Per-core record rings and the ship task of binlog.h.
+ *
+ * @section implementation Implementation Details
+ * - Each core has a ring of BINLOG_RING_SIZE bytes with free-running head
+ *   (reserved) and tail (consumed) byte counts. Writers reserve space with
+ *   a compare-and-swap on head, so tasks, ISRs and a task that migrated to
+ *   the other core can share a ring without a lock
+ * - A record is whole words: header, site address, tag address, time
+ *   stamp, arguments. The header carries the length and, in its top byte,
+ *   a commit mark that is stored last; the reader stops at a record that
+ *   isn't committed yet
+ * - Records never wrap: if one doesn't fit before the end of the ring, the
+ *   rest of the ring is reserved with it and filled by a pad record
+ * - The reader zeroes what it consumed, so stale data is never taken for
+ *   a commit mark
+ *
+ * @section frames Frames on the Log Channel
+ * | Offset | Size | Field                                  |
+ * |--------|------|----------------------------------------|
+ * | 0      | 4    | Magic 0xB1 'B' 'L' 0x01                |
+ * | 4      | 1    | Core                                   |
+ * | 5      | 1    | Reserved, 0                            |
+ * | 6      | 2    | Payload length                         |
+ * | 8      | 4    | Records dropped on this core since boot |
+ * | 12     | n    | Records                                |
+ * | 12+n   | 4    | CRC32 of bytes 0 to 12+n               |
+ *
+ * All fields are little endian. ESP_LOG text redirected by usb_cdc.c can
+ * be interleaved between frames; the decoder passes it through.
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include "binlog.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#if CONFIG_BINLOG
+#include "checksum.h"
+#include "task_placement.h"
+#include "usb_cdc.h"
+#endif
+
+#ifdef CONFIG_BINLOG_BUFFER_SIZE
+#define BINLOG_RING_SIZE        CONFIG_BINLOG_BUFFER_SIZE
+#else
+#define BINLOG_RING_SIZE        4096
+#endif
+
+_Static_assert((BINLOG_RING_SIZE & (BINLOG_RING_SIZE - 1)) == 0, "CONFIG_BINLOG_BUFFER_SIZE must be a power of two");
+
+#define BINLOG_CORES            portNUM_PROCESSORS
+#define BINLOG_HDR_WORDS        4       /**< Header, site, tag, time stamp */
+#define BINLOG_COMMIT           0xB1u   /**< Commit mark, top byte of a header */
+#define BINLOG_KIND_PAD         0       /**< Filler up to the end of the ring */
+#define BINLOG_KIND_LOG         1       /**< Log record */
+
+/**
+ * @brief Record ring of one core
+ */
+typedef struct {
+    uint32_t buf[BINLOG_RING_SIZE / 4]; /**< Records */
+    atomic_uint_least32_t head;         /**< Bytes reserved since boot */
+    atomic_uint_least32_t tail;         /**< Bytes consumed since boot */
+    atomic_uint_least32_t records;      /**< Records written */
+    atomic_uint_least32_t dropped;      /**< Records dropped, ring full */
+    atomic_uint_least32_t high_water;   /**< Most bytes reserved and not consumed */
+    uint32_t frames;                    /**< Frames queued by the ship task */
+} binlog_ring_t;
+
+static binlog_ring_t g_rings[BINLOG_CORES];
+
+esp_log_level_t binlog_level = (esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL;
+
+static inline uint32_t binlog_header(uint32_t len, uint32_t kind) {
+    return len | (kind << 16) | (BINLOG_COMMIT << 24);
+}
+
+/**
+ * @brief Reserve a Record
+ *
+ * @return First word of the record, NULL if the ring is full
+ */
+static uint32_t *binlog_reserve(binlog_ring_t *ring, uint32_t len) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t pad;
+    for (;;) {
+        const uint32_t pos = head & (BINLOG_RING_SIZE - 1);
+        pad = (BINLOG_RING_SIZE - pos < len) ? BINLOG_RING_SIZE - pos : 0;
+        const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head + pad + len - tail > BINLOG_RING_SIZE) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+        if (atomic_compare_exchange_weak_explicit(&ring->head, &head, head + pad + len, memory_order_acquire,
+                                                  memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    if (pad) {
+        __atomic_store_n(&ring->buf[(head & (BINLOG_RING_SIZE - 1)) / 4], binlog_header(pad, BINLOG_KIND_PAD),
+                         __ATOMIC_RELEASE);
+    }
+
+    /* Peak use, as seen by this writer */
+    const uint32_t used = head + pad + len - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t peak = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+    while (used > peak &&
+           !atomic_compare_exchange_weak_explicit(&ring->high_water, &peak, used, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+
+    return &ring->buf[((head + pad) & (BINLOG_RING_SIZE - 1)) / 4];
+}
+
+static inline const char *binlog_str(const char *s, size_t *len) {
+    if (!s) {
+        s = "(null)";
+    }
+    *len = strnlen(s, BINLOG_STR_MAX);
+    return s;
+}
+
+void binlog_write(const binlog_site_t *site, const char *tag, ...) {
+    const uint32_t info = site->info;
+    const unsigned nargs = info & 0xF;
+
+    va_list ap;
+    va_start(ap, tag);
+
+    /* Size pass */
+    uint32_t len = BINLOG_HDR_WORDS * 4;
+    va_list size_ap;
+    va_copy(size_ap, ap);
+    for (unsigned i = 0; i < nargs; i++) {
+        switch ((info >> (4 + 2 * i)) & 3) {
+            case BINLOG_ARG_I32:
+                (void)va_arg(size_ap, uint32_t);
+                len += 4;
+                break;
+            case BINLOG_ARG_I64:
+                (void)va_arg(size_ap, uint64_t);
+                len += 8;
+                break;
+            case BINLOG_ARG_F64:
+                (void)va_arg(size_ap, double);
+                len += 8;
+                break;
+            default: {
+                size_t n;
+                binlog_str(va_arg(size_ap, const char *), &n);
+                len += (1 + n + 3) & ~3u;
+                break;
+            }
+        }
+    }
+    va_end(size_ap);
+
+    binlog_ring_t *ring = &g_rings[esp_cpu_get_core_id()];
+    uint32_t *rec = binlog_reserve(ring, len);
+    if (!rec) {
+        va_end(ap);
+        return;
+    }
+
+    rec[1] = (uint32_t)(uintptr_t)site;
+    rec[2] = (uint32_t)(uintptr_t)tag;
+    rec[3] = (uint32_t)esp_timer_get_time();
+    uint32_t *w = rec + BINLOG_HDR_WORDS;
+    for (unsigned i = 0; i < nargs; i++) {
+        switch ((info >> (4 + 2 * i)) & 3) {
+            case BINLOG_ARG_I32:
+                *w++ = va_arg(ap, uint32_t);
+                break;
+            case BINLOG_ARG_I64: {
+                const uint64_t v = va_arg(ap, uint64_t);
+                memcpy(w, &v, 8);
+                w += 2;
+                break;
+            }
+            case BINLOG_ARG_F64: {
+                const double v = va_arg(ap, double);
+                memcpy(w, &v, 8);
+                w += 2;
+                break;
+            }
+            default: {
+                size_t n;
+                const char *s = binlog_str(va_arg(ap, const char *), &n);
+                uint8_t *b = (uint8_t *)w;
+                b[0] = (uint8_t)n;
+                memcpy(b + 1, s, n);
+                w += (1 + n + 3) / 4;
+                break;
+            }
+        }
+    }
+    va_end(ap);
+
+    __atomic_store_n(&rec[0], binlog_header(len, BINLOG_KIND_LOG), __ATOMIC_RELEASE);
+    atomic_fetch_add_explicit(&ring->records, 1, memory_order_relaxed);
+}
+
+size_t binlog_drain(int core, uint8_t *out, size_t max) {
+    if (core < 0 || core >= BINLOG_CORES) {
+        return 0;
+    }
+
+    binlog_ring_t *ring = &g_rings[core];
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t copied = 0;
+
+    while (tail != head) {
+        uint32_t *rec = &ring->buf[(tail & (BINLOG_RING_SIZE - 1)) / 4];
+        const uint32_t hdr = __atomic_load_n(rec, __ATOMIC_ACQUIRE);
+        if ((hdr >> 24) != BINLOG_COMMIT) {
+            break;
+        }
+        const uint32_t len = hdr & 0xFFFF;
+        if (((hdr >> 16) & 0xFF) == BINLOG_KIND_LOG) {
+            if (len > max) {
+                /* Never fits out, waiting for room would stall the ring */
+                atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            } else if (copied + len > max) {
+                break;
+            } else {
+                memcpy(out + copied, rec, len);
+                copied += len;
+            }
+        }
+        memset(rec, 0, len);
+        tail += len;
+    }
+
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return copied;
+}
+
+bool binlog_get_stats(int core, binlog_stats_t *stats) {
+    if (core < 0 || core >= BINLOG_CORES || !stats) {
+        return false;
+    }
+
+    binlog_ring_t *ring = &g_rings[core];
+    stats->records = atomic_load_explicit(&ring->records, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    stats->used = atomic_load_explicit(&ring->head, memory_order_relaxed) -
+                  atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+    stats->frames = ring->frames;
+    return true;
+}
+
+#if CONFIG_BINLOG
+
+#define BINLOG_FRAME_HEADER     12      /**< Frame bytes before the records */
+/** Most record bytes per frame, a quarter of the log channel queue at most so that a frame finds room whole */
+#define BINLOG_FRAME_PAYLOAD    ((CONFIG_USB_CDC_LOG_QUEUE_SIZE / 4 < 1024) ? CONFIG_USB_CDC_LOG_QUEUE_SIZE / 4 : 1024)
+/** Largest record, BINLOG_ARGS_MAX strings of BINLOG_STR_MAX characters */
+#define BINLOG_RECORD_MAX       (BINLOG_HDR_WORDS * 4 + BINLOG_ARGS_MAX * ((1 + BINLOG_STR_MAX + 3) & ~3))
+
+_Static_assert(BINLOG_RECORD_MAX <= BINLOG_FRAME_PAYLOAD,
+               "the largest binlog record must fit a frame, raise CONFIG_USB_CDC_LOG_QUEUE_SIZE or lower BINLOG_ARGS_MAX/BINLOG_STR_MAX");
+
+static const char *TAG = "binlog";     /**< Log tag for binary log messages */
+
+static TaskHandle_t g_ship_task = NULL;
+static uint32_t g_lost_frames = 0;      /**< Frames the log channel had no room for, dropped whole */
+
+static int binlog_cmd(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "level") == 0) {
+        const int level = atoi(argv[2]);
+        if (level < ESP_LOG_NONE || level > ESP_LOG_VERBOSE) {
+            return 1;
+        }
+        binlog_level = (esp_log_level_t)level;
+        return 0;
+    }
+    if (argc != 1) {
+        return 1;
+    }
+
+    for (int core = 0; core < BINLOG_CORES; core++) {
+        binlog_stats_t s;
+        binlog_get_stats(core, &s);
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "core %d: %u records, %u dropped, %u/%u B used (max %u), %u frames\n",
+                       core, (unsigned)s.records, (unsigned)s.dropped, (unsigned)s.used, (unsigned)BINLOG_RING_SIZE,
+                       (unsigned)s.high_water, (unsigned)s.frames);
+    }
+    usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "level %d, %u frames lost\n", (int)binlog_level, (unsigned)g_lost_frames);
+    return 0;
+}
+
+static void binlog_ship_task(void *arg) {
+    (void)arg;
+    static uint8_t frame[BINLOG_FRAME_HEADER + BINLOG_FRAME_PAYLOAD + 4];
+
+    for (;;) {
+        bool more = false;
+        for (int core = 0; core < BINLOG_CORES; core++) {
+            const size_t n = binlog_drain(core, frame + BINLOG_FRAME_HEADER, BINLOG_FRAME_PAYLOAD);
+            if (n == 0) {
+                continue;
+            }
+
+            const uint16_t payload = (uint16_t)n;
+            const uint32_t dropped = atomic_load_explicit(&g_rings[core].dropped, memory_order_relaxed);
+            frame[0] = 0xB1;
+            frame[1] = 'B';
+            frame[2] = 'L';
+            frame[3] = 0x01;
+            frame[4] = (uint8_t)core;
+            frame[5] = 0;
+            memcpy(frame + 6, &payload, 2);
+            memcpy(frame + 8, &dropped, 4);
+            const uint32_t crc = checksum_crc32(0, frame, BINLOG_FRAME_HEADER + n);
+            memcpy(frame + BINLOG_FRAME_HEADER + n, &crc, 4);
+
+            const size_t len = BINLOG_FRAME_HEADER + n + 4;
+            if (!usb_cdc_write_whole(USB_CDC_CHANNEL_LOG, frame, len)) {
+                g_lost_frames++;
+            }
+            g_rings[core].frames++;
+            more |= (n > BINLOG_FRAME_PAYLOAD / 2);
+        }
+
+        if (!more) {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_BINLOG_FLUSH_MS));
+        }
+    }
+}
+
+bool binlog_init(void) {
+    if (g_ship_task) {
+        ESP_LOGW(TAG, "Binary log already started");
+        return false;
+    }
+
+    if (!task_placement_create(binlog_ship_task, "binlog", NULL, &g_ship_task)) {
+        ESP_LOGE(TAG, "Failed to create ship task");
+        g_ship_task = NULL;
+        return false;
+    }
+
+    usb_cdc_register_command("binlog", "binlog [level <0-5>]: binary log statistics or level", binlog_cmd);
+    ESP_LOGI(TAG, "Binary log on the CDC log channel, %d B per core", BINLOG_RING_SIZE);
+    return true;
+}
+
+#else /* !CONFIG_BINLOG */
+
+bool binlog_init(void) {
+    return false;
+}
+
+#endif /* CONFIG_BINLOG */
@@ -0,0 +1,206 @@
+/**
+ * @file binlog.h
+ * @brief Binary Log with Deferred Formatting
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * A log backend for hot paths. A log call stores the address of a
+ * constant call-site record (format string, argument types, level), the
+ * tag pointer, a timestamp and the raw arguments in a lock-free ring of
+ * the calling core. Nothing is formatted on the device; a ship task sends
+ * the rings over the CDC log channel in CRC-checked frames, and
+ * tools/binlog/binlog_decode.py looks the format strings up in the
+ * firmware ELF and renders the text.
+ *
+ * A record costs about as much as a few word copies, against the
+ * vsnprintf() and console write of ESP_LOGx, so logging can stay on during
+ * I/O bursts. When a ring is full, records are dropped and counted
+ * rather than blocking the caller.
+ *
+ * Without CONFIG_BINLOG the BINLOG_x macros fall back to ESP_LOGx, so call
+ * sites don't need their own #if.
+ *
+ * @section args Arguments
+ * Argument types are taken from the C types at compile time:
+ * - Integers up to 32 bits, pointers and enums: one word
+ * - long long, uint64_t and double (float is promoted): two words
+ * - char * and const char *: the string is copied, up to BINLOG_STR_MAX bytes
+ *
+ * At most BINLOG_ARGS_MAX arguments. Tags and format strings must be
+ * literals (or point into flash), because only their addresses are logged.
+ *
+ * @section usage Usage
+ * @code
+ * BINLOG_I(TAG, "Read %d bytes from %s", bytes_read, path);
+ * @endcode
+ * On the host:
+ * @code
+ * tools/binlog/binlog_decode.py build/esp32s3_dualusb_fw.elf /dev/ttyACM1
+ * @endcode
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_log.h"
+
+/** @defgroup binlog_config Binary Log Configuration
+ * @{
+ */
+#define BINLOG_ARGS_MAX         12      /**< Most arguments of one record */
+#define BINLOG_STR_MAX          64      /**< Longest string argument copied, longer ones are cut */
+/** @} */
+
+/**
+ * @brief Argument types, two bits each in binlog_site_t::info
+ */
+typedef enum {
+    BINLOG_ARG_I32 = 0,     /**< Word */
+    BINLOG_ARG_I64,         /**< Two words, low word first */
+    BINLOG_ARG_F64,         /**< double, two words, low word first */
+    BINLOG_ARG_STR,         /**< Length byte and characters, padded to a word */
+} binlog_arg_t;
+
+/**
+ * @brief Constant call-site record, one per BINLOG_x call
+ *
+ * info holds the argument count in bits 0-3, the type of argument i in
+ * bits 4+2i and 5+2i, and the esp_log_level_t in bits 28-30.
+ */
+typedef struct {
+    const char *fmt;        /**< printf() format */
+    uint32_t info;          /**< Argument count, types and level */
+} binlog_site_t;
+
+/**
+ * @brief Ring statistics of one core
+ */
+typedef struct {
+    uint32_t records;       /**< Records written */
+    uint32_t dropped;       /**< Records dropped, ring full */
+    uint32_t used;          /**< Bytes waiting now */
+    uint32_t high_water;    /**< Most bytes waiting since boot */
+    uint32_t frames;        /**< Frames queued to the log channel */
+} binlog_stats_t;
+
+/** Records above this level are skipped, ESP_LOG_INFO by default */
+extern esp_log_level_t binlog_level;
+
+/**
+ * @brief Start the Ship Task
+ *
+ * Records are kept from boot on; this starts the task that sends them
+ * over the CDC log channel and registers the "binlog" control command.
+ *
+ * @return true if successful, false otherwise
+ * @retval false Already started or out of memory
+ *
+ * @note Requires CONFIG_BINLOG; call after usb_cdc_init()
+ */
+bool binlog_init(void);
+
+/**
+ * @brief Write a Record
+ *
+ * Called by the BINLOG_x macros with arguments matching site->info.
+ * Callable from tasks and ISRs on either core.
+ *
+ * @param[in] site Call site
+ * @param[in] tag Log tag
+ */
+void binlog_write(const binlog_site_t *site, const char *tag, ...);
+
+/**
+ * @brief Take Records out of a Core's Ring
+ *
+ * Copies whole records only, in the order they were reserved, and stops
+ * at one that is still being written. A record larger than max can never
+ * be copied and is dropped and counted instead of blocking the ring.
+ *
+ * @param[in] core Core number
+ * @param[out] out Buffer for the records
+ * @param[in] max Size of out
+ *
+ * @return Bytes copied, 0 if the ring is empty
+ *
+ * @note The ship task is the only reader while it runs
+ */
+size_t binlog_drain(int core, uint8_t *out, size_t max);
+
+/**
+ * @brief Get Ring Statistics
+ *
+ * @param[in] core Core number
+ * @param[out] stats Statistics since boot
+ *
+ * @return true if successful, false if the core number is invalid
+ */
+bool binlog_get_stats(int core, binlog_stats_t *stats);
+
+/** @cond INTERNAL */
+#define BINLOG_ARG_TYPE(x) _Generic((x),                                        \
+    char *: BINLOG_ARG_STR, const char *: BINLOG_ARG_STR,                       \
+    float: BINLOG_ARG_F64, double: BINLOG_ARG_F64,                              \
+    long long: BINLOG_ARG_I64, unsigned long long: BINLOG_ARG_I64,              \
+    default: BINLOG_ARG_I32)
+#define BINLOG_TY(i, x) ((uint32_t)BINLOG_ARG_TYPE(x) << (4 + 2 * (i)))
+
+#define BINLOG_NARGS(...) BINLOG_NARGS_(0, ##__VA_ARGS__, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define BINLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, n, ...) n
+#define BINLOG_CAT(a, b) BINLOG_CAT_(a, b)
+#define BINLOG_CAT_(a, b) a##b
+
+#define BINLOG_TYPES_0() 0
+#define BINLOG_TYPES_1(a) BINLOG_TY(0, a)
+#define BINLOG_TYPES_2(a, b) BINLOG_TYPES_1(a) | BINLOG_TY(1, b)
+#define BINLOG_TYPES_3(a, b, c) BINLOG_TYPES_2(a, b) | BINLOG_TY(2, c)
+#define BINLOG_TYPES_4(a, b, c, d) BINLOG_TYPES_3(a, b, c) | BINLOG_TY(3, d)
+#define BINLOG_TYPES_5(a, b, c, d, e) BINLOG_TYPES_4(a, b, c, d) | BINLOG_TY(4, e)
+#define BINLOG_TYPES_6(a, b, c, d, e, f) BINLOG_TYPES_5(a, b, c, d, e) | BINLOG_TY(5, f)
+#define BINLOG_TYPES_7(a, b, c, d, e, f, g) BINLOG_TYPES_6(a, b, c, d, e, f) | BINLOG_TY(6, g)
+#define BINLOG_TYPES_8(a, b, c, d, e, f, g, h) BINLOG_TYPES_7(a, b, c, d, e, f, g) | BINLOG_TY(7, h)
+#define BINLOG_TYPES_9(a, b, c, d, e, f, g, h, i) BINLOG_TYPES_8(a, b, c, d, e, f, g, h) | BINLOG_TY(8, i)
+#define BINLOG_TYPES_10(a, b, c, d, e, f, g, h, i, j) BINLOG_TYPES_9(a, b, c, d, e, f, g, h, i) | BINLOG_TY(9, j)
+#define BINLOG_TYPES_11(a, b, c, d, e, f, g, h, i, j, k) \
+    BINLOG_TYPES_10(a, b, c, d, e, f, g, h, i, j) | BINLOG_TY(10, k)
+#define BINLOG_TYPES_12(a, b, c, d, e, f, g, h, i, j, k, l) \
+    BINLOG_TYPES_11(a, b, c, d, e, f, g, h, i, j, k) | BINLOG_TY(11, l)
+
+#define BINLOG_INFO(level, ...) \
+    ((uint32_t)BINLOG_NARGS(__VA_ARGS__) | (BINLOG_CAT(BINLOG_TYPES_, BINLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)) | \
+     ((uint32_t)(level) << 28))
+
+#define BINLOG_LOG(level, tag, format, ...) do {                                        \
+        _Static_assert(BINLOG_NARGS(__VA_ARGS__) <= BINLOG_ARGS_MAX, "too many binlog arguments"); \
+        static const binlog_site_t binlog_site_ = { format, BINLOG_INFO(level, ##__VA_ARGS__) }; \
+        if ((level) <= binlog_level) {                                                  \
+            binlog_write(&binlog_site_, tag, ##__VA_ARGS__);                            \
+        }                                                                               \
+        if (0) {                                                                        \
+            esp_log_write(level, tag, format, ##__VA_ARGS__); /* printf format check */ \
+        }                                                                               \
+    } while (0)
+/** @endcond */
+
+#if CONFIG_BINLOG
+#define BINLOG_E(tag, format, ...) BINLOG_LOG(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define BINLOG_W(tag, format, ...) BINLOG_LOG(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define BINLOG_I(tag, format, ...) BINLOG_LOG(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define BINLOG_D(tag, format, ...) BINLOG_LOG(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#else
+#define BINLOG_E(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#define BINLOG_W(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+#define BINLOG_I(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+#define BINLOG_D(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+#endif
+
+#endif /* BINLOG_H */
@@ -0,0 +1,202 @@
+/**
+ * @file cdc_transfer.c
+ * @brief File Transfer over USB CDC-ACM Implementation
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Connects the protocol engine of cdc_transfer_proto.c to a TinyUSB
+ * CDC-ACM port and the internal volume.
+ *
+ * @section implementation Implementation Details
+ * - The RX callback only wakes the transfer task; the task feeds the
+ *   engine straight from the CDC RX span buffer and runs its timers
+ * - Frames are queued into the CDC TX FIFO and flushed when it is full,
+ *   so a window of DATA frames goes out in full-size USB packets
+ * - File I/O is done in cluster-sized chunks (at least one frame)
+ * - Transfers are refused while the host has the volume mounted over MSC,
+ *   the two would corrupt each other's view of the FAT
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include "cdc_transfer.h"
+#include "filesystem.h"
+#include "usb_device.h"
+#include "task_placement.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "tinyusb.h"
+#include "tinyusb_cdc_acm.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#if CONFIG_CDC_TRANSFER
+
+#define CDC_XFER_RX_SPAN_SIZE   4096    /**< CDC RX span buffer, a power of two */
+#define CDC_XFER_TX_TIMEOUT_MS  100     /**< Longest wait for the host to take TX data */
+#define CDC_XFER_IDLE_MS        5000    /**< Session dropped after this long without a frame */
+
+static const char *TAG = "cdc_transfer";   /**< Log tag for CDC transfer messages */
+
+static cdc_xfer_server_t *g_server = NULL;  /**< Protocol engine, once started */
+static TaskHandle_t g_task = NULL;          /**< Transfer task */
+
+static inline uint32_t cdc_transfer_now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/**
+ * @brief Engine send callback: queue a frame on the CDC port
+ *
+ * Flushes whenever the TX FIFO is full. A frame that can't be sent within
+ * CDC_XFER_TX_TIMEOUT_MS is dropped, the protocol retransmits it.
+ */
+static void cdc_transfer_send(void *ctx, const void *data, size_t len) {
+    (void)ctx;
+    const uint8_t *p = (const uint8_t *)data;
+    while (len > 0) {
+        size_t n = tinyusb_cdcacm_write_queue(CONFIG_CDC_TRANSFER_PORT, p, len);
+        p += n;
+        len -= n;
+        if (n == 0 && tinyusb_cdcacm_write_flush(CONFIG_CDC_TRANSFER_PORT,
+                                                 pdMS_TO_TICKS(CDC_XFER_TX_TIMEOUT_MS)) != ESP_OK) {
+            ESP_LOGD(TAG, "TX timeout, %u bytes dropped", (unsigned)len);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Engine availability callback: the volume is not used over MSC
+ */
+static bool cdc_transfer_available(void *ctx) {
+    (void)ctx;
+    return !usb_device_is_mounted();
+}
+
+/**
+ * @brief CDC RX Callback
+ *
+ * Called from the TinyUSB task, hands the data over to the transfer task.
+ */
+static void cdc_transfer_rx_cb(int itf, cdcacm_event_t *event) {
+    (void)itf;
+    (void)event;
+    if (g_task) {
+        xTaskNotifyGive(g_task);
+    }
+}
+
+/**
+ * @brief Transfer Task
+ *
+ * Sleeps until data arrives or the engine's next timer, then hands the
+ * received data to the engine in place, without copying it out of the
+ * span buffer first.
+ */
+static void cdc_transfer_task(void *arg) {
+    (void)arg;
+    uint32_t wait_ms = 0;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+
+        const uint8_t *data;
+        size_t n;
+        while (tinyusb_cdcacm_rx_peek(CONFIG_CDC_TRANSFER_PORT, &data, &n) == ESP_OK && n > 0) {
+            cdc_xfer_server_input(g_server, data, n, cdc_transfer_now_ms());
+            tinyusb_cdcacm_rx_consume(CONFIG_CDC_TRANSFER_PORT, n);
+        }
+
+        wait_ms = cdc_xfer_server_poll(g_server, cdc_transfer_now_ms());
+        if (cdc_xfer_server_busy(g_server)) {
+            /* Same activity indication as MSC I/O */
+            usb_device_notify_io_start();
+        }
+        tinyusb_cdcacm_write_flush(CONFIG_CDC_TRANSFER_PORT, 0);
+    }
+}
+
+bool cdc_transfer_init(void) {
+    if (g_server) {
+        ESP_LOGW(TAG, "Already started");
+        return false;
+    }
+
+    /* Whole clusters per file write, and at least one frame */
+    const fs_volume_profile_t *profile = fs_get_volume_profile();
+    size_t io_size = profile->allocation_unit_size;
+    if (io_size < CONFIG_CDC_TRANSFER_MAX_PAYLOAD) {
+        io_size = CONFIG_CDC_TRANSFER_MAX_PAYLOAD;
+    }
+
+    const cdc_xfer_config_t cfg = {
+        .root = MOUNT_POINT,
+        .max_payload = CONFIG_CDC_TRANSFER_MAX_PAYLOAD,
+        .window = CONFIG_CDC_TRANSFER_WINDOW,
+        .io_size = io_size,
+        .rto_ms = CONFIG_CDC_TRANSFER_RTO_MS,
+        .idle_timeout_ms = CDC_XFER_IDLE_MS,
+        .send = cdc_transfer_send,
+        .available = cdc_transfer_available,
+    };
+    g_server = cdc_xfer_server_new(&cfg);
+    if (!g_server) {
+        ESP_LOGE(TAG, "Failed to create transfer server");
+        return false;
+    }
+
+    if (!task_placement_create(cdc_transfer_task, "cdc_xfer", NULL, &g_task)) {
+        ESP_LOGE(TAG, "Failed to create transfer task");
+        goto fail;
+    }
+
+    const tinyusb_config_cdcacm_t acm_cfg = {
+        .cdc_port = CONFIG_CDC_TRANSFER_PORT,
+        .callback_rx = cdc_transfer_rx_cb,
+        .rx_span_buf_size = CDC_XFER_RX_SPAN_SIZE,
+    };
+    esp_err_t ret = tinyusb_cdcacm_init(&acm_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init CDC-ACM %d: %s", CONFIG_CDC_TRANSFER_PORT, esp_err_to_name(ret));
+        goto fail;
+    }
+
+    ESP_LOGI(TAG, "File transfer on CDC-ACM %d (%d-byte frames, window %d)",
+             CONFIG_CDC_TRANSFER_PORT, CONFIG_CDC_TRANSFER_MAX_PAYLOAD, CONFIG_CDC_TRANSFER_WINDOW);
+    return true;
+
+fail:
+    if (g_task) {
+        vTaskDelete(g_task);
+        g_task = NULL;
+    }
+    cdc_xfer_server_free(g_server);
+    g_server = NULL;
+    return false;
+}
+
+bool cdc_transfer_get_stats(cdc_xfer_stats_t *stats) {
+    if (!g_server || !stats) {
+        return false;
+    }
+    cdc_xfer_server_get_stats(g_server, stats);
+    return true;
+}
+
+#else /* !CONFIG_CDC_TRANSFER */
+
+bool cdc_transfer_init(void) {
+    return false;
+}
+
+bool cdc_transfer_get_stats(cdc_xfer_stats_t *stats) {
+    (void)stats;
+    return false;
+}
+
+#endif /* CONFIG_CDC_TRANSFER */
@@ -0,0 +1,58 @@
+/**
+ * @file cdc_transfer.h
+ * @brief File Transfer over USB CDC-ACM
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Fallback for reading and writing files on the internal FATFS volume when
+ * USB MSC can't be used: the volume is ejected, or the host blocks USB
+ * storage by policy. Runs the binary protocol of cdc_transfer_proto.h on a
+ * CDC-ACM port next to the MSC interface. The host side is
+ * tools/cdc_transfer/cdc_xfer.py.
+ *
+ * @section usage Usage
+ * @code
+ * // After tinyusb_driver_install()
+ * if (!cdc_transfer_init()) {
+ *     // MSC keeps working without it
+ * }
+ * @endcode
+ * @code
+ * $ tools/cdc_transfer/cdc_xfer.py /dev/ttyACM0 put firmware.bin UPDATE.BIN
+ * @endcode
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "cdc_transfer_proto.h"
+
+/**
+ * @brief Start File Transfer on the CDC-ACM Port
+ *
+ * Initializes CONFIG_CDC_TRANSFER_PORT and starts the task serving
+ * MOUNT_POINT. Transfers are refused with a "busy" error while a USB host
+ * has the volume mounted over MSC.
+ *
+ * @return true if successful, false otherwise
+ * @retval false Already started, CDC-ACM init failed or out of memory
+ *
+ * @note Requires CONFIG_CDC_TRANSFER
+ * @note Must be called after tinyusb_driver_install()
+ */
+bool cdc_transfer_init(void);
+
+/**
+ * @brief Get File Transfer Statistics
+ *
+ * @param[out] stats Statistics since cdc_transfer_init()
+ *
+ * @return true if successful, false if not started
+ */
+bool cdc_transfer_get_stats(cdc_xfer_stats_t *stats);
@@ -0,0 +1,648 @@
+/**
+ * @file cdc_transfer_proto.c
+ * @brief CDC File Transfer Protocol Engine Implementation
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Frame assembly with resync, the write and read sessions of
+ * cdc_transfer_proto.h, and file I/O through POSIX calls so it works on
+ * the ESP-IDF VFS as well as on a Linux host.
+ *
+ * @section implementation Implementation Details
+ * - Received bytes are copied into a frame buffer; a bad magic, length or
+ *   CRC drops bytes up to the next magic already in the buffer
+ * - File data goes through one io_size buffer: writes reach the volume in
+ *   io_size chunks from the start of the file (cluster-aligned with the
+ *   cluster size as io_size), reads refill it at the frame being sent
+ * - Go-back-N: the receiver keeps only in-order frames, the sender goes
+ *   back to the last acknowledged frame on NAK or timeout
+ */
+
+#include "cdc_transfer_proto.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "checksum.h"
+
+#define XFER_ROOT_MAX       32          /**< Longest root directory */
+#define XFER_TMP_NAME       "~XFER.TMP" /**< Write session file, 8.3 so it works without LFN */
+#define XFER_IDLE_POLL_MS   1000        /**< Poll interval without a session */
+
+/**
+ * @brief Session state
+ */
+typedef enum {
+    XFER_IDLE,
+    XFER_WRITE,     /**< Receiving a file from the host */
+    XFER_READ,      /**< Sending a file to the host */
+} xfer_state_t;
+
+struct cdc_xfer_server {
+    cdc_xfer_config_t cfg;
+    cdc_xfer_stats_t stats;
+
+    uint8_t *rx;                /**< Frame being received */
+    size_t rx_len;
+    uint8_t *tx;                /**< Frame being sent */
+    uint8_t *io;                /**< File data buffer, cfg.io_size bytes */
+    size_t io_len;              /**< Bytes in io */
+    uint32_t io_off;            /**< Read: file offset of io */
+
+    xfer_state_t state;
+    int fd;
+    char path[XFER_ROOT_MAX + CDC_XFER_PATH_MAX + 2];       /**< Target of the session */
+    char tmp_path[XFER_ROOT_MAX + sizeof(XFER_TMP_NAME) + 1];
+    uint32_t size;              /**< File size */
+    uint32_t crc;               /**< CRC32 of the data so far, in order */
+    uint32_t next;              /**< Write: next expected frame. Read: next frame to send */
+    uint32_t acked;             /**< Read: frames acknowledged by the host */
+    uint32_t crc_seq;           /**< Read: frames included in crc */
+    uint32_t frames;            /**< Read: frames of the file */
+    uint32_t received;          /**< Write: bytes received in order */
+    uint32_t unacked;           /**< Write: in-order frames since the last ACK */
+    uint32_t dup_acked;         /**< Write: next when a duplicate was last answered */
+    uint32_t dup_seq;           /**< Write: last duplicate received */
+    bool nak_sent;              /**< NAK sent for the current gap */
+    bool end_sent;              /**< Read: END sent */
+    uint32_t progress_ms;       /**< Read: last ACK progress or go-back */
+    uint32_t rx_ms;             /**< Last frame received in the session */
+    uint32_t end_ms;            /**< Read: END last sent */
+
+    bool done_valid;            /**< A write session ended, its reply is kept for a retransmitted END */
+    uint32_t done_seq;
+    uint8_t done_err;           /**< 0 for OK */
+};
+
+static inline void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, (uint16_t)v);
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+static inline bool time_reached(uint32_t now_ms, uint32_t since_ms, uint32_t timeout_ms) {
+    return (uint32_t)(now_ms - since_ms) >= timeout_ms;
+}
+
+size_t cdc_xfer_frame_encode(uint8_t *out, uint8_t type, uint32_t seq, const void *payload, uint16_t len) {
+    out[0] = CDC_XFER_MAGIC0;
+    out[1] = CDC_XFER_MAGIC1;
+    out[2] = type;
+    out[3] = 0;
+    put_le32(out + 4, seq);
+    put_le16(out + 8, len);
+    put_le16(out + 10, (uint16_t)checksum_crc32(0, out, 10));
+    if (len > 0 && payload != out + CDC_XFER_HEADER_SIZE) {
+        memcpy(out + CDC_XFER_HEADER_SIZE, payload, len);
+    }
+    put_le32(out + CDC_XFER_HEADER_SIZE + len, checksum_crc32(0, out, CDC_XFER_HEADER_SIZE + len));
+    return CDC_XFER_FRAME_SIZE(len);
+}
+
+static void xfer_send(cdc_xfer_server_t *srv, uint8_t type, uint32_t seq, const void *payload, uint16_t len) {
+    size_t size = cdc_xfer_frame_encode(srv->tx, type, seq, payload, len);
+    srv->cfg.send(srv->cfg.ctx, srv->tx, size);
+}
+
+static void xfer_send_err(cdc_xfer_server_t *srv, uint32_t seq, uint8_t err, const char *msg) {
+    uint8_t payload[64];
+    size_t len = strlen(msg);
+    if (len > sizeof(payload) - 1) {
+        len = sizeof(payload) - 1;
+    }
+    payload[0] = err;
+    memcpy(payload + 1, msg, len);
+    xfer_send(srv, CDC_XFER_ERR, seq, payload, (uint16_t)(len + 1));
+}
+
+static uint8_t xfer_errno_code(int err) {
+    switch (err) {
+    case ENOENT:
+    case ENOTDIR:
+        return CDC_XFER_ERR_NOENT;
+    case ENOSPC:
+        return CDC_XFER_ERR_NOSPC;
+    case EINVAL:
+    case EISDIR:
+    case ENAMETOOLONG:
+        return CDC_XFER_ERR_INVAL;
+    default:
+        return CDC_XFER_ERR_IO;
+    }
+}
+
+/**
+ * @brief Close the file of the session and go idle
+ *
+ * @param[in] keep_tmp Leave the write session file (it was renamed)
+ */
+static void xfer_session_end(cdc_xfer_server_t *srv, bool keep_tmp) {
+    if (srv->fd >= 0) {
+        close(srv->fd);
+        srv->fd = -1;
+    }
+    if (srv->state == XFER_WRITE && !keep_tmp) {
+        unlink(srv->tmp_path);
+    }
+    srv->state = XFER_IDLE;
+}
+
+/**
+ * @brief Build the volume path of a host path
+ *
+ * @return true if the path is valid: not empty, relative to the root, no ".." component
+ */
+static bool xfer_make_path(cdc_xfer_server_t *srv, const uint8_t *name, size_t len) {
+    while (len > 0 && name[0] == '/') {
+        name++;
+        len--;
+    }
+    if (len == 0 || len >= CDC_XFER_PATH_MAX || memchr(name, '\0', len) || memchr(name, '\\', len)) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        /* ".." as a whole component */
+        if (name[i] == '.' && i + 1 < len && name[i + 1] == '.' &&
+            (i == 0 || name[i - 1] == '/') && (i + 2 == len || name[i + 2] == '/')) {
+            return false;
+        }
+    }
+    snprintf(srv->path, sizeof(srv->path), "%s/%.*s", srv->cfg.root, (int)len, (const char *)name);
+    return true;
+}
+
+static bool xfer_check_available(cdc_xfer_server_t *srv) {
+    if (srv->cfg.available && !srv->cfg.available(srv->cfg.ctx)) {
+        xfer_send_err(srv, 0, CDC_XFER_ERR_BUSY, "volume in use over USB MSC");
+        return false;
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Write session                                                            */
+/* ------------------------------------------------------------------------ */
+
+static bool xfer_write_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) {
+            if (n == 0) {
+                errno = ENOSPC;
+            }
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * @brief Fail the write session with the current errno
+ */
+static void xfer_write_fail(cdc_xfer_server_t *srv, uint32_t seq) {
+    const int saved = errno;
+    xfer_session_end(srv, false);
+    xfer_send_err(srv, seq, xfer_errno_code(saved), strerror(saved));
+}
+
+static void xfer_open_write(cdc_xfer_server_t *srv, const uint8_t *payload, uint16_t len, uint32_t now_ms) {
+    if (len < 4 || !xfer_make_path(srv, payload + 4, len - 4u)) {
+        xfer_send_err(srv, 0, CDC_XFER_ERR_INVAL, "bad path");
+        return;
+    }
+    if (!xfer_check_available(srv)) {
+        return;
+    }
+    srv->fd = open(srv->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (srv->fd < 0) {
+        xfer_send_err(srv, 0, xfer_errno_code(errno), strerror(errno));
+        return;
+    }
+    srv->state = XFER_WRITE;
+    srv->size = get_le32(payload);
+    srv->crc = 0;
+    srv->next = 0;
+    srv->received = 0;
+    srv->unacked = 0;
+    srv->dup_acked = UINT32_MAX;
+    srv->nak_sent = false;
+    srv->io_len = 0;
+    srv->rx_ms = now_ms;
+    srv->done_valid = false;
+    xfer_send(srv, CDC_XFER_OK, 0, NULL, 0);
+}
+
+static void xfer_write_data(cdc_xfer_server_t *srv, uint32_t seq, const uint8_t *data, uint16_t len) {
+    if (seq != srv->next) {
+        if (seq < srv->next) {
+            /* Retransmitted after a lost ACK: tell the host where we are, once per go-back round */
+            if (srv->dup_acked != srv->next || seq <= srv->dup_seq) {
+                srv->dup_acked = srv->next;
+                srv->unacked = 0;
+                xfer_send(srv, CDC_XFER_ACK, srv->next, NULL, 0);
+            }
+            srv->dup_seq = seq;
+        } else if (!srv->nak_sent) {
+            srv->nak_sent = true;
+            xfer_send(srv, CDC_XFER_NAK, srv->next, NULL, 0);
+        }
+        return;
+    }
+    if (len > srv->size - srv->received) {
+        xfer_session_end(srv, false);
+        xfer_send_err(srv, seq, CDC_XFER_ERR_INVAL, "more data than announced");
+        return;
+    }
+
+    srv->crc = checksum_crc32(srv->crc, data, len);
+    srv->received += len;
+    while (len > 0) {
+        size_t n = srv->cfg.io_size - srv->io_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(srv->io + srv->io_len, data, n);
+        srv->io_len += n;
+        data += n;
+        len -= (uint16_t)n;
+        if (srv->io_len == srv->cfg.io_size) {
+            if (!xfer_write_all(srv->fd, srv->io, srv->io_len)) {
+                xfer_write_fail(srv, seq);
+                return;
+            }
+            srv->io_len = 0;
+        }
+    }
+
+    srv->next++;
+    srv->nak_sent = false;
+    if (++srv->unacked >= srv->cfg.window / 2) {
+        srv->unacked = 0;
+        xfer_send(srv, CDC_XFER_ACK, srv->next, NULL, 0);
+    }
+}
+
+static void xfer_write_end(cdc_xfer_server_t *srv, uint32_t seq, const uint8_t *payload, uint16_t len) {
+    if (seq != srv->next) {
+        if (seq > srv->next && !srv->nak_sent) {
+            srv->nak_sent = true;
+            xfer_send(srv, CDC_XFER_NAK, srv->next, NULL, 0);
+        }
+        return;
+    }
+
+    uint8_t err = 0;
+    if (len < 8 || get_le32(payload) != srv->size || srv->received != srv->size ||
+        get_le32(payload + 4) != srv->crc) {
+        err = CDC_XFER_ERR_CHECK;
+    } else if (!xfer_write_all(srv->fd, srv->io, srv->io_len) || fsync(srv->fd) != 0) {
+        err = xfer_errno_code(errno);
+    } else {
+        close(srv->fd);
+        srv->fd = -1;
+        /* FAT rename does not replace */
+        unlink(srv->path);
+        if (rename(srv->tmp_path, srv->path) != 0) {
+            err = xfer_errno_code(errno);
+        }
+    }
+
+    xfer_session_end(srv, err == 0);
+    srv->done_valid = true;
+    srv->done_seq = seq;
+    srv->done_err = err;
+    if (err == 0) {
+        srv->stats.files_rx++;
+        xfer_send(srv, CDC_XFER_OK, seq, NULL, 0);
+    } else {
+        xfer_send_err(srv, seq, err, err == CDC_XFER_ERR_CHECK ? "size or CRC mismatch" : "write failed");
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Read session                                                             */
+/* ------------------------------------------------------------------------ */
+
+static void xfer_open_read(cdc_xfer_server_t *srv, const uint8_t *payload, uint16_t len, uint32_t now_ms) {
+    if (!xfer_make_path(srv, payload, len)) {
+        xfer_send_err(srv, 0, CDC_XFER_ERR_INVAL, "bad path");
+        return;
+    }
+    if (!xfer_check_available(srv)) {
+        return;
+    }
+    struct stat st;
+    srv->fd = open(srv->path, O_RDONLY);
+    if (srv->fd < 0 || fstat(srv->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > UINT32_MAX) {
+        uint8_t err = (srv->fd >= 0) ? CDC_XFER_ERR_INVAL : xfer_errno_code(errno);
+        if (srv->fd >= 0) {
+            close(srv->fd);
+            srv->fd = -1;
+        }
+        xfer_send_err(srv, 0, err, "can't open file");
+        return;
+    }
+    srv->state = XFER_READ;
+    srv->size = (uint32_t)st.st_size;
+    srv->frames = (srv->size + srv->cfg.max_payload - 1) / srv->cfg.max_payload;
+    srv->crc = 0;
+    srv->next = 0;
+    srv->acked = 0;
+    srv->crc_seq = 0;
+    srv->io_off = 0;
+    srv->io_len = 0;
+    srv->end_sent = false;
+    srv->progress_ms = now_ms;
+    srv->rx_ms = now_ms;
+    srv->done_valid = false;
+
+    uint8_t reply[4];
+    put_le32(reply, srv->size);
+    xfer_send(srv, CDC_XFER_OK, 0, reply, sizeof(reply));
+}
+
+/**
+ * @brief Send DATA frame seq, reading the file as needed
+ *
+ * @return false if the file could not be read, the session is over
+ */
+static bool xfer_read_send(cdc_xfer_server_t *srv, uint32_t seq) {
+    const uint32_t off = seq * srv->cfg.max_payload;
+    uint16_t len = srv->cfg.max_payload;
+    if (len > srv->size - off) {
+        len = (uint16_t)(srv->size - off);
+    }
+
+    if (off < srv->io_off || off + len > srv->io_off + srv->io_len) {
+        srv->io_off = off;
+        srv->io_len = 0;
+        if (lseek(srv->fd, off, SEEK_SET) != (off_t)off) {
+            goto fail;
+        }
+        while (srv->io_len < len) {
+            ssize_t n = read(srv->fd, srv->io + srv->io_len, srv->cfg.io_size - srv->io_len);
+            if (n <= 0) {
+                goto fail;
+            }
+            srv->io_len += (size_t)n;
+        }
+    }
+
+    const uint8_t *data = srv->io + (off - srv->io_off);
+    if (seq == srv->crc_seq) {
+        srv->crc = checksum_crc32(srv->crc, data, len);
+        srv->crc_seq++;
+    } else {
+        srv->stats.retransmits++;
+    }
+    xfer_send(srv, CDC_XFER_DATA, seq, data, len);
+    return true;
+
+fail:
+    xfer_session_end(srv, false);
+    xfer_send_err(srv, seq, CDC_XFER_ERR_IO, "read failed");
+    return false;
+}
+
+static void xfer_read_ack(cdc_xfer_server_t *srv, uint8_t type, uint32_t seq, uint32_t now_ms) {
+    if (seq < srv->acked || seq > srv->next) {
+        return;
+    }
+    if (seq > srv->acked) {
+        srv->acked = seq;
+        srv->progress_ms = now_ms;
+    }
+    if (type == CDC_XFER_NAK) {
+        srv->next = seq;
+        srv->progress_ms = now_ms;
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Frame dispatch                                                           */
+/* ------------------------------------------------------------------------ */
+
+static void xfer_handle(cdc_xfer_server_t *srv, uint8_t type, uint32_t seq,
+                        const uint8_t *payload, uint16_t len, uint32_t now_ms) {
+    srv->stats.frames_rx++;
+    srv->rx_ms = now_ms;
+
+    switch (type) {
+    case CDC_XFER_HELLO: {
+        xfer_session_end(srv, false);
+        uint8_t reply[6];
+        put_le16(reply, CDC_XFER_VERSION);
+        put_le16(reply + 2, srv->cfg.max_payload);
+        put_le16(reply + 4, srv->cfg.window);
+        xfer_send(srv, CDC_XFER_HELLO, 0, reply, sizeof(reply));
+        break;
+    }
+    case CDC_XFER_OPEN_WRITE:
+        xfer_session_end(srv, false);
+        xfer_open_write(srv, payload, len, now_ms);
+        break;
+    case CDC_XFER_OPEN_READ:
+        xfer_session_end(srv, false);
+        xfer_open_read(srv, payload, len, now_ms);
+        break;
+    case CDC_XFER_ABORT:
+        xfer_session_end(srv, false);
+        xfer_send(srv, CDC_XFER_OK, seq, NULL, 0);
+        break;
+    case CDC_XFER_DATA:
+        if (srv->state == XFER_WRITE) {
+            xfer_write_data(srv, seq, payload, len);
+        }
+        break;
+    case CDC_XFER_END:
+        if (srv->state == XFER_WRITE) {
+            xfer_write_end(srv, seq, payload, len);
+        } else if (srv->done_valid && seq == srv->done_seq) {
+            /* Our reply was lost */
+            if (srv->done_err == 0) {
+                xfer_send(srv, CDC_XFER_OK, seq, NULL, 0);
+            } else {
+                xfer_send_err(srv, seq, srv->done_err, "write failed");
+            }
+        } else {
+            xfer_send_err(srv, seq, CDC_XFER_ERR_STATE, "no write session");
+        }
+        break;
+    case CDC_XFER_ACK:
+    case CDC_XFER_NAK:
+        if (srv->state == XFER_READ) {
+            xfer_read_ack(srv, type, seq, now_ms);
+        }
+        break;
+    case CDC_XFER_OK:
+        if (srv->state == XFER_READ && srv->end_sent && seq == srv->frames) {
+            srv->stats.files_tx++;
+            xfer_session_end(srv, false);
+        }
+        break;
+    case CDC_XFER_ERR:
+        /* The host gave up on the file */
+        if (srv->state == XFER_READ) {
+            xfer_session_end(srv, false);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Drop bytes of the frame buffer up to the next magic
+ */
+static void xfer_resync(cdc_xfer_server_t *srv) {
+    const uint8_t *m = memchr(srv->rx + 1, CDC_XFER_MAGIC0, srv->rx_len - 1);
+    size_t skip = m ? (size_t)(m - srv->rx) : srv->rx_len;
+    memmove(srv->rx, srv->rx + skip, srv->rx_len - skip);
+    srv->rx_len -= skip;
+}
+
+void cdc_xfer_server_input(cdc_xfer_server_t *srv, const void *data, size_t len, uint32_t now_ms) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (true) {
+        /* Check what is assembled so far, before taking more bytes */
+        if ((srv->rx_len >= 1 && srv->rx[0] != CDC_XFER_MAGIC0) ||
+            (srv->rx_len >= 2 && srv->rx[1] != CDC_XFER_MAGIC1)) {
+            xfer_resync(srv);
+            continue;
+        }
+        size_t frame_size = CDC_XFER_HEADER_SIZE;
+        if (srv->rx_len >= CDC_XFER_HEADER_SIZE) {
+            const uint16_t plen = get_le16(srv->rx + 8);
+            if (get_le16(srv->rx + 10) != (uint16_t)checksum_crc32(0, srv->rx, 10) ||
+                plen > srv->cfg.max_payload || srv->rx[3] != 0) {
+                srv->stats.crc_errors++;
+                xfer_resync(srv);
+                continue;
+            }
+            frame_size = CDC_XFER_FRAME_SIZE(plen);
+            if (srv->rx_len == frame_size) {
+                const size_t body = CDC_XFER_HEADER_SIZE + plen;
+                if (checksum_crc32(0, srv->rx, body) == get_le32(srv->rx + body)) {
+                    srv->rx_len = 0;
+                    xfer_handle(srv, srv->rx[2], get_le32(srv->rx + 4), srv->rx + CDC_XFER_HEADER_SIZE, plen, now_ms);
+                } else {
+                    srv->stats.crc_errors++;
+                    xfer_resync(srv);
+                }
+                continue;
+            }
+        }
+        if (len == 0) {
+            break;
+        }
+        size_t n = frame_size - srv->rx_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(srv->rx + srv->rx_len, p, n);
+        srv->rx_len += n;
+        p += n;
+        len -= n;
+    }
+}
+
+uint32_t cdc_xfer_server_poll(cdc_xfer_server_t *srv, uint32_t now_ms) {
+    if (srv->state != XFER_IDLE && time_reached(now_ms, srv->rx_ms, srv->cfg.idle_timeout_ms)) {
+        /* The host went away */
+        xfer_session_end(srv, false);
+    }
+    if (srv->state == XFER_WRITE) {
+        return srv->cfg.idle_timeout_ms - (now_ms - srv->rx_ms);
+    }
+    if (srv->state != XFER_READ) {
+        return XFER_IDLE_POLL_MS;
+    }
+
+    if (srv->acked < srv->next && time_reached(now_ms, srv->progress_ms, srv->cfg.rto_ms)) {
+        /* No ACK progress: go back to the first unacknowledged frame */
+        srv->next = srv->acked;
+        srv->progress_ms = now_ms;
+    }
+    while (srv->next < srv->frames && srv->next - srv->acked < srv->cfg.window) {
+        if (!xfer_read_send(srv, srv->next)) {
+            return XFER_IDLE_POLL_MS;
+        }
+        srv->next++;
+    }
+    if (srv->acked == srv->frames && (!srv->end_sent || time_reached(now_ms, srv->end_ms, srv->cfg.rto_ms))) {
+        uint8_t payload[8];
+        put_le32(payload, srv->size);
+        put_le32(payload + 4, srv->crc);
+        if (srv->end_sent) {
+            srv->stats.retransmits++;
+        }
+        xfer_send(srv, CDC_XFER_END, srv->frames, payload, sizeof(payload));
+        srv->end_sent = true;
+        srv->end_ms = now_ms;
+    }
+
+    uint32_t since = srv->end_sent ? now_ms - srv->end_ms : now_ms - srv->progress_ms;
+    return (since < srv->cfg.rto_ms) ? srv->cfg.rto_ms - since : 0;
+}
+
+bool cdc_xfer_server_busy(const cdc_xfer_server_t *srv) {
+    return srv->state != XFER_IDLE;
+}
+
+void cdc_xfer_server_get_stats(const cdc_xfer_server_t *srv, cdc_xfer_stats_t *stats) {
+    *stats = srv->stats;
+}
+
+cdc_xfer_server_t *cdc_xfer_server_new(const cdc_xfer_config_t *cfg) {
+    if (!cfg || !cfg->root || strlen(cfg->root) > XFER_ROOT_MAX || !cfg->send || cfg->max_payload == 0 ||
+        cfg->window < 2 || cfg->io_size < cfg->max_payload || cfg->rto_ms == 0) {
+        return NULL;
+    }
+
+    cdc_xfer_server_t *srv = calloc(1, sizeof(*srv));
+    if (!srv) {
+        return NULL;
+    }
+    srv->cfg = *cfg;
+    srv->fd = -1;
+    srv->rx = malloc(CDC_XFER_FRAME_SIZE(cfg->max_payload));
+    srv->tx = malloc(CDC_XFER_FRAME_SIZE(cfg->max_payload));
+    srv->io = malloc(cfg->io_size);
+    if (!srv->rx || !srv->tx || !srv->io) {
+        cdc_xfer_server_free(srv);
+        return NULL;
+    }
+    snprintf(srv->tmp_path, sizeof(srv->tmp_path), "%s/" XFER_TMP_NAME, cfg->root);
+    return srv;
+}
+
+void cdc_xfer_server_free(cdc_xfer_server_t *srv) {
+    if (!srv) {
+        return;
+    }
+    xfer_session_end(srv, false);
+    free(srv->rx);
+    free(srv->tx);
+    free(srv->io);
+    free(srv);
+}
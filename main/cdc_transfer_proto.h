@@ -0,0 +1,208 @@
+/**
+ * @file cdc_transfer_proto.h
+ * @brief CDC File Transfer Protocol Engine
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Device side of a framed, windowed binary file transfer protocol. The
+ * engine only sees bytes in and bytes out, so the same code runs over
+ * TinyUSB CDC-ACM on the device (cdc_transfer.c) and over a pty on a
+ * Linux host (tools/cdc_transfer/loopback.c).
+ *
+ * @section frame Frame Format
+ * All fields little-endian:
+ * @code
+ *   0  2  magic 'X' 'F'
+ *   2  1  type (CDC_XFER_*)
+ *   3  1  flags, 0
+ *   4  4  seq
+ *   8  2  payload length
+ *  10  2  header check: low 16 bits of the CRC32 of bytes 0 .. 10
+ *  12  n  payload
+ *  12+n 4 CRC32 (zlib) of bytes 0 .. 12+n
+ * @endcode
+ * A frame with a bad check, length or CRC is dropped and the receiver
+ * resyncs on the next magic. The header check rejects a damaged length
+ * before the receiver waits for a payload that never comes, which would
+ * swallow the short ACK frames behind it.
+ *
+ * @section session Sessions
+ * - Write (host to device): OPEN_WRITE, then DATA frames 0..n-1 and END
+ *   with seq n. The device acknowledges in-order data with cumulative ACKs
+ *   (seq = next expected frame) every window/2 frames, and asks for a
+ *   retransmission from the first missing frame with NAK. The file is
+ *   written to a temporary name and renamed when END checks out.
+ * - Read (device to host): OPEN_READ, then the device streams DATA frames
+ *   with up to `window` frames unacknowledged, goes back to the last
+ *   acknowledged frame on NAK or timeout, and sends END once everything
+ *   is acknowledged. The host answers END with OK or ERR.
+ *
+ * Every DATA frame carries max_payload bytes except the last, so the file
+ * offset of a frame is seq * max_payload.
+ */
+
+#ifndef CDC_TRANSFER_PROTO_H
+#define CDC_TRANSFER_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @defgroup cdc_xfer_frame Frame Definitions
+ * @{
+ */
+#define CDC_XFER_VERSION        1       /**< Protocol version in HELLO */
+#define CDC_XFER_MAGIC0         'X'     /**< First magic byte */
+#define CDC_XFER_MAGIC1         'F'     /**< Second magic byte */
+#define CDC_XFER_HEADER_SIZE    12      /**< Bytes before the payload */
+#define CDC_XFER_CRC_SIZE       4       /**< Bytes after the payload */
+#define CDC_XFER_PATH_MAX       96      /**< Longest path in OPEN_READ/OPEN_WRITE */
+
+/** Size of a frame with a payload of @p n bytes */
+#define CDC_XFER_FRAME_SIZE(n)  (CDC_XFER_HEADER_SIZE + (n) + CDC_XFER_CRC_SIZE)
+/** @} */
+
+/**
+ * @brief Frame types
+ */
+typedef enum {
+    CDC_XFER_HELLO = 0x01,       /**< Host: start over. Device: u16 version, u16 max_payload, u16 window */
+    CDC_XFER_OPEN_READ = 0x02,   /**< Host: path */
+    CDC_XFER_OPEN_WRITE = 0x03,  /**< Host: u32 size, path */
+    CDC_XFER_DATA = 0x04,        /**< File data of frame seq */
+    CDC_XFER_ACK = 0x05,         /**< Frames before seq received */
+    CDC_XFER_NAK = 0x06,         /**< Frames before seq received, resend from seq */
+    CDC_XFER_END = 0x07,         /**< seq = frame count, u32 size, u32 CRC32 of the file */
+    CDC_XFER_OK = 0x08,          /**< Success. Reply to OPEN_READ: u32 size */
+    CDC_XFER_ERR = 0x09,         /**< Failure: u8 error (cdc_xfer_err_t), message */
+    CDC_XFER_ABORT = 0x0A,       /**< Cancel the session */
+} cdc_xfer_type_t;
+
+/**
+ * @brief Error codes in ERR frames
+ */
+typedef enum {
+    CDC_XFER_ERR_IO = 1,         /**< Filesystem error */
+    CDC_XFER_ERR_NOENT = 2,      /**< No such file */
+    CDC_XFER_ERR_NOSPC = 3,      /**< Volume full */
+    CDC_XFER_ERR_BUSY = 4,       /**< Volume in use by a USB host over MSC */
+    CDC_XFER_ERR_INVAL = 5,      /**< Bad path or request */
+    CDC_XFER_ERR_CHECK = 6,      /**< Size or CRC of the file does not match END */
+    CDC_XFER_ERR_STATE = 7,      /**< No session for this frame */
+} cdc_xfer_err_t;
+
+/**
+ * @brief Server configuration
+ */
+typedef struct {
+    const char *root;            /**< Directory the host paths are relative to */
+    uint16_t max_payload;        /**< Payload of a DATA frame */
+    uint16_t window;             /**< DATA frames in flight */
+    size_t io_size;              /**< File read/write chunk, at least max_payload */
+    uint32_t rto_ms;             /**< Retransmission timeout */
+    uint32_t idle_timeout_ms;    /**< Session dropped after this long without progress */
+    /**
+     * @brief Transmit bytes, returns when they are queued
+     * A frame is given in one call; if it can't be sent it may be dropped.
+     */
+    void (*send)(void *ctx, const void *data, size_t len);
+    /** Whether the files may be accessed now, NULL if always */
+    bool (*available)(void *ctx);
+    void *ctx;                   /**< Context for the callbacks */
+} cdc_xfer_config_t;
+
+/**
+ * @brief Server statistics
+ */
+typedef struct {
+    uint32_t frames_rx;          /**< Valid frames received */
+    uint32_t crc_errors;         /**< Frames dropped for a bad CRC or length */
+    uint32_t retransmits;        /**< DATA/END frames sent again */
+    uint32_t files_rx;           /**< Files written */
+    uint32_t files_tx;           /**< Files read */
+} cdc_xfer_stats_t;
+
+/**
+ * @brief Server handle
+ */
+typedef struct cdc_xfer_server cdc_xfer_server_t;
+
+/**
+ * @brief Encode a Frame
+ *
+ * @param[out] out Buffer of at least CDC_XFER_FRAME_SIZE(len) bytes
+ * @param[in] type Frame type
+ * @param[in] seq Sequence number
+ * @param[in] payload Payload, may be NULL if len is 0
+ * @param[in] len Payload length
+ *
+ * @return Frame size in bytes
+ */
+size_t cdc_xfer_frame_encode(uint8_t *out, uint8_t type, uint32_t seq, const void *payload, uint16_t len);
+
+/**
+ * @brief Create Server
+ *
+ * @param[in] cfg Configuration, copied
+ *
+ * @return Server handle, or NULL on bad configuration or out of memory
+ */
+cdc_xfer_server_t *cdc_xfer_server_new(const cdc_xfer_config_t *cfg);
+
+/**
+ * @brief Free Server
+ *
+ * An unfinished write session is dropped, its temporary file removed.
+ *
+ * @param[in] srv Server handle (NULL is ignored)
+ */
+void cdc_xfer_server_free(cdc_xfer_server_t *srv);
+
+/**
+ * @brief Feed Received Bytes
+ *
+ * Bytes may come in any split; complete frames are handled and answered
+ * through the send callback before the call returns.
+ *
+ * @param[in] srv Server handle
+ * @param[in] data Received bytes
+ * @param[in] len Number of bytes
+ * @param[in] now_ms Current time in milliseconds
+ */
+void cdc_xfer_server_input(cdc_xfer_server_t *srv, const void *data, size_t len, uint32_t now_ms);
+
+/**
+ * @brief Run Timers and Stream Data
+ *
+ * Sends the DATA frames the window allows, retransmits on timeout and
+ * drops stalled sessions. Call after each input and when the returned
+ * time has elapsed.
+ *
+ * @param[in] srv Server handle
+ * @param[in] now_ms Current time in milliseconds
+ *
+ * @return Milliseconds until the next call is needed
+ */
+uint32_t cdc_xfer_server_poll(cdc_xfer_server_t *srv, uint32_t now_ms);
+
+/**
+ * @brief Check for an Active Session
+ *
+ * @param[in] srv Server handle
+ *
+ * @return true while a file is being read or written
+ */
+bool cdc_xfer_server_busy(const cdc_xfer_server_t *srv);
+
+/**
+ * @brief Get Server Statistics
+ *
+ * @param[in] srv Server handle
+ * @param[out] stats Statistics since the server was created
+ */
+void cdc_xfer_server_get_stats(const cdc_xfer_server_t *srv, cdc_xfer_stats_t *stats);
+
+#endif /* CDC_TRANSFER_PROTO_H */
@@ -7,9 +7,17 @@
  *
  * Implements SPI flash FATFS mount with:
  * - Automatic format on first boot
- * - Mutex-protected concurrent access
+ * - Reader/writer locking: stat and read paths run concurrently,
+ *   writers get exclusive access to FAT metadata
  * - Write synchronization for data safety
  * - README.txt creation on first boot
+ * - Free-cluster count cached in NVS across boots and hand-overs to USB MSC
+ * - Append-only record store packing small records into segment files
+ * - Single volume profile (Kconfig) for mount and format parameters
+ * - Cluster/erase-block aligned formatting with online re-align migration
+ * - Online in-place volume growth up to the partition size
+ * - Optional file I/O trace for tools/fs_profile/replay_trace.py
+ * - Exclusive hand-over of the volume to the USB MSC storage
  */
 
 #include "filesystem.h"
@@ -17,17 +25,46 @@
 #include "esp_vfs_fat.h"
 #include "wear_levelling.h"
 #include "ff.h"
+#include "diskio_impl.h"
+#include "diskio_wl.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "esp_partition.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "checksum.h"
+#include "esp_heap_caps.h"
+#include "nvs_flash.h"
+#include "nvs.h"
 #include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
 #include <sys/stat.h>
 #include <assert.h>
 
 static const char *TAG = "fs";
 
-/* Filesystem mutex for thread-safe access */
-static SemaphoreHandle_t g_fs_mutex = NULL;
+/* Filesystem lock for thread-safe access */
+/*
+ * Reader/writer lock (writer-preferring):
+ * - g_fs_turnstile: writers hold it while waiting and working, so new
+ *   readers queue behind a pending writer instead of starving it
+ * - g_fs_room_empty: binary semaphore owned either by one writer or,
+ *   collectively, by the group of active readers
+ * - g_fs_readers_mutex: protects g_fs_readers
+ */
+static SemaphoreHandle_t g_fs_turnstile = NULL;
+static SemaphoreHandle_t g_fs_room_empty = NULL;
+static SemaphoreHandle_t g_fs_readers_mutex = NULL;
+static uint32_t g_fs_readers = 0;
+
+/* Lock statistics, updated under g_fs_stats_lock */
+static fs_lock_stats_t g_fs_lock_stats = {0};
+static portMUX_TYPE g_fs_stats_lock = portMUX_INITIALIZER_UNLOCKED;
 
 /* Wear levelling handle */
 static wl_handle_t g_wl_handle = WL_INVALID_HANDLE;
@@ -35,209 +72,2159 @@ static wl_handle_t g_wl_handle = WL_INVALID_HANDLE;
 /* Mount state */
 static bool g_fs_mounted = false;
 
+/*
+ * Volume released to the USB MSC storage (fs_release_volume()): this module
+ * keeps the WL handle only, the storage mounts FatFs for the application on
+ * g_fs_pdrv and unmounts it while the USB host owns the volume (0xFF then).
+ * g_fs_shared_fatfs is the storage's FatFs object, remounted by fs_remount().
+ */
+static bool g_fs_shared = false;
+static BYTE g_fs_pdrv = 0xFF;
+static FATFS *g_fs_shared_fatfs = NULL;
+
+/*
+ * Integrity and compression layers of the MSC storage change the sector
+ * format on flash: the volume is only ever mounted through the storage.
+ */
+#define FS_VOLUME_LAYERED (CONFIG_TINYUSB_MSC_INTEGRITY_ENABLED || CONFIG_TINYUSB_MSC_COMPRESS_ENABLED)
+
+/* Volume profile from Kconfig, shared by every mount and format path */
+#if CONFIG_FS_PROFILE_FAT_TYPE_FAT32
+#define FS_PROFILE_FMT  FM_FAT32
+#elif CONFIG_FS_PROFILE_FAT_TYPE_FAT
+#define FS_PROFILE_FMT  FM_FAT
+#else
+#define FS_PROFILE_FMT  FM_ANY
+#endif
+
+static const fs_volume_profile_t g_fs_profile = {
+    .max_files = CONFIG_FS_PROFILE_MAX_FILES,
+    .allocation_unit_size = CONFIG_FS_PROFILE_CLUSTER_SIZE,
+    .fmt = FS_PROFILE_FMT,
+    .n_fats = CONFIG_FS_PROFILE_NUM_FATS,
+    .root_entries = CONFIG_FS_PROFILE_ROOT_ENTRIES,
+    .align_sectors = CONFIG_FS_PROFILE_ALIGN_SECTORS,
+};
+
+/* Flash erase block; WL maps logical to physical sectors at this granularity */
+#define FS_FLASH_ERASE_SIZE     4096
+
+/* Cluster-count ranges of each FAT type; FatFs infers the type from the count */
+#define FS_FAT12_MAX_CLUSTERS   0xFF5
+#define FS_FAT16_MAX_CLUSTERS   0xFFF5
+#define FS_FAT32_MAX_CLUSTERS   0x0FFFFFF5
+
+/* NVS location of the persisted free-space cache */
+#define FS_CACHE_NVS_NAMESPACE  "fs_cache"
+#define FS_CACHE_NVS_KEY        "free"
+#define FS_CACHE_MAGIC          0x46534643  /* "FSFC" */
+
+/* FatFs marks free_clst/last_clst as unknown with an all-ones value */
+#define FS_CLUSTER_UNKNOWN      0xFFFFFFFF
+
+/**
+ * @brief Persisted free-space cache record
+ *
+ * Ties the free-cluster count and allocation hint FatFs maintains at run time
+ * to the volume it was taken from. The record is only trusted when it was
+ * written by a clean unmount of the same volume.
+ */
+typedef struct {
+    uint32_t magic;       /**< FS_CACHE_MAGIC */
+    uint32_t vsn;         /**< Volume serial number from the boot sector */
+    uint32_t n_fatent;    /**< Number of FAT entries (clusters + 2) */
+    uint32_t csize;       /**< Cluster size in sectors */
+    uint32_t free_clst;   /**< Free cluster count */
+    uint32_t last_clst;   /**< Last allocated cluster (allocation hint) */
+    uint32_t clean;       /**< Non-zero if written by a clean unmount */
+} fs_free_cache_t;
+
+/* Set once NVS is usable for the free-space cache */
+static bool g_fs_cache_ready = false;
+
+/* Volume modified behind FatFs since mount (USB host), its count can't be persisted */
+static bool g_fs_cache_untrusted = false;
+
+/* Mounts seeded from the persisted record, for fs_get_stats_ex() */
+static uint32_t g_fs_cache_hits = 0;
+
+/*
+ * Record store layout:
+ * - Records of one log are appended to numbered segment files
+ *   FS_LOG_DIR/<name>_NNNNN.seg, oldest first
+ * - Each record is a fs_log_rec_hdr_t followed by the payload
+ * - Appends are staged in a RAM buffer of one cluster of the volume
+ *   profile so every flush writes whole clusters instead of one
+ *   FAT/directory update per record
+ * - A torn record at the end of the newest segment (power loss during a
+ *   flush) is cut off when the log is opened, before appending resumes
+ */
+#define FS_LOG_DIR              MOUNT_POINT "/records"
+#define FS_LOG_SEGMENT_SIZE     (64 * 1024)
+#define FS_LOG_MAX_SEGMENTS     8
+#define FS_LOG_RECORD_MAGIC     0x5243  /* "CR" */
+#define FS_LOG_PATH_MAX         64
+
+/**
+ * @brief On-disk record header
+ */
+typedef struct {
+    uint16_t magic;     /**< FS_LOG_RECORD_MAGIC */
+    uint16_t len;       /**< Payload length in bytes */
+    uint32_t crc;       /**< CRC32 of the payload */
+} fs_log_rec_hdr_t;
+
 /**
- * @brief Acquire filesystem lock
+ * @brief Open record log
  */
-static void fs_lock(void) {
-    if (g_fs_mutex) {
-        xSemaphoreTake(g_fs_mutex, portMAX_DELAY);
+struct fs_log {
+    char name[FS_LOG_NAME_MAX + 1];  /**< Log name (segment file prefix) */
+    SemaphoreHandle_t mutex;         /**< Protects the staging buffer */
+    uint8_t *buf;                    /**< Staging buffer */
+    size_t buf_size;                 /**< Size of buf, one cluster */
+    size_t buf_used;                 /**< Bytes staged in buf */
+    uint32_t seg_first;              /**< Oldest segment index on disk */
+    uint32_t seg_last;               /**< Segment currently appended to */
+    uint32_t seg_bytes;              /**< Bytes of seg_last already on disk */
+    uint32_t records;                /**< Records appended since open */
+};
+
+/* Open logs, flushed on unmount */
+static fs_log_t *g_fs_logs[FS_LOG_MAX_OPEN] = {0};
+static SemaphoreHandle_t g_fs_logs_mutex = NULL;
+
+static void fs_trace_init(void);
+
+/**
+ * @brief Take a semaphore, accounting for time spent blocked
+ *
+ * @return Microseconds spent waiting (0 if uncontended)
+ */
+static uint32_t fs_take_counted(SemaphoreHandle_t sem) {
+    if (xSemaphoreTake(sem, 0) == pdTRUE) {
+        return 0;
     }
+
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(sem, portMAX_DELAY);
+    int64_t waited = esp_timer_get_time() - start;
+    return waited > 0 ? (uint32_t)waited : 1;
 }
 
 /**
- * @brief Release filesystem lock
+ * @brief Record one lock acquisition in the statistics
  */
-static void fs_unlock(void) {
-    if (g_fs_mutex) {
-        xSemaphoreGive(g_fs_mutex);
+static void fs_account_lock(bool writer, uint32_t wait_us) {
+    taskENTER_CRITICAL(&g_fs_stats_lock);
+    fs_lock_stats_t *st = &g_fs_lock_stats;
+    if (writer) {
+        st->write_locks++;
+        if (wait_us) {
+            st->write_contended++;
+            st->write_wait_us += wait_us;
+            if (wait_us > st->write_wait_max_us) {
+                st->write_wait_max_us = wait_us;
+            }
+        }
+    } else {
+        st->read_locks++;
+        if (wait_us) {
+            st->read_contended++;
+            st->read_wait_us += wait_us;
+            if (wait_us > st->read_wait_max_us) {
+                st->read_wait_max_us = wait_us;
+            }
+        }
     }
+    taskEXIT_CRITICAL(&g_fs_stats_lock);
 }
 
-bool fs_init_internal(void) {
-    ESP_LOGI(TAG, "Initializing internal FATFS at %s", MOUNT_POINT);
+/**
+ * @brief Create the filesystem reader/writer lock
+ */
+static bool fs_lock_create(void) {
+    if (g_fs_turnstile) {
+        return true;
+    }
 
-    /* Precheck: Verify 'storage' partition exists before mount */
-    const esp_partition_t *storage_part = esp_partition_find_first(
-        ESP_PARTITION_TYPE_DATA,
-        ESP_PARTITION_SUBTYPE_DATA_FAT,
-        "storage"
-    );
-    assert(storage_part && "storage partition missing — flash partition table");
-    ESP_LOGI(TAG, "WL handle acquired for 'storage' partition (offset=0x%x, size=0x%x)",
-             storage_part->address, storage_part->size);
+    g_fs_turnstile = xSemaphoreCreateMutex();
+    g_fs_room_empty = xSemaphoreCreateBinary();
+    g_fs_readers_mutex = xSemaphoreCreateMutex();
+    if (!g_fs_turnstile || !g_fs_room_empty || !g_fs_readers_mutex) {
+        if (g_fs_turnstile) vSemaphoreDelete(g_fs_turnstile);
+        if (g_fs_room_empty) vSemaphoreDelete(g_fs_room_empty);
+        if (g_fs_readers_mutex) vSemaphoreDelete(g_fs_readers_mutex);
+        g_fs_turnstile = g_fs_room_empty = g_fs_readers_mutex = NULL;
+        return false;
+    }
 
-    /* Create mutex for FS access */
-    if (!g_fs_mutex) {
-        g_fs_mutex = xSemaphoreCreateMutex();
-        if (!g_fs_mutex) {
-            ESP_LOGE(TAG, "Failed to create FS mutex");
-            return false;
-        }
+    /* Binary semaphores start empty; the room starts unoccupied */
+    xSemaphoreGive(g_fs_room_empty);
+    return true;
+}
+
+/**
+ * @brief Acquire filesystem lock for shared (read-only) access
+ *
+ * Any number of readers may hold the lock at once, from either core.
+ */
+static void fs_read_lock(void) {
+    if (!g_fs_turnstile) {
+        return;
     }
 
-    /* Mount FATFS with format_if_mount_failed */
-    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-        .format_if_mount_failed = true,
-        .max_files = 5,
-        .allocation_unit_size = 4096,
-    };
+    /* Pass through the turnstile so a waiting writer blocks new readers */
+    uint32_t wait_us = fs_take_counted(g_fs_turnstile);
+    xSemaphoreGive(g_fs_turnstile);
 
-    esp_err_t ret = esp_vfs_fat_spiflash_mount_rw_wl(
-        MOUNT_POINT,
-        "storage",
-        &mount_config,
-        &g_wl_handle
-    );
+    xSemaphoreTake(g_fs_readers_mutex, portMAX_DELAY);
+    if (++g_fs_readers == 1) {
+        /* First reader claims the room for the group */
+        wait_us += fs_take_counted(g_fs_room_empty);
+    }
+    xSemaphoreGive(g_fs_readers_mutex);
 
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to mount FATFS: %s", esp_err_to_name(ret));
-        return false;
+    fs_account_lock(false, wait_us);
+}
+
+/**
+ * @brief Release shared filesystem lock
+ */
+static void fs_read_unlock(void) {
+    if (!g_fs_turnstile) {
+        return;
     }
 
-    g_fs_mounted = true;
-    ESP_LOGI(TAG, "FATFS mounted successfully at %s", MOUNT_POINT);
+    xSemaphoreTake(g_fs_readers_mutex, portMAX_DELAY);
+    if (--g_fs_readers == 0) {
+        /* Last reader out hands the room to a writer */
+        xSemaphoreGive(g_fs_room_empty);
+    }
+    xSemaphoreGive(g_fs_readers_mutex);
+}
 
-    /* Create README.txt on first boot */
-    fs_lock();
-    FILE *f = fopen(MOUNT_POINT "/README.txt", "r");
-    if (!f) {
-        /* File doesn't exist, create it */
-        f = fopen(MOUNT_POINT "/README.txt", "w");
-        if (f) {
-            fprintf(f, "ESP32-S3 Dual USB Firmware\n");
-            fprintf(f, "Device Mode: Mass Storage Device (MSC)\n");
-            fprintf(f, "Internal FATFS Volume\n");
-            fprintf(f, "\nThis volume is managed by the ESP32-S3 firmware.\n");
-            fprintf(f, "Safe eject before power-off to prevent data loss.\n");
-            fclose(f);
-            ESP_LOGI(TAG, "Created README.txt");
-        }
-    } else {
-        fclose(f);
+/**
+ * @brief Acquire filesystem lock for exclusive (write) access
+ *
+ * Required for anything that creates, modifies or deletes files, or that
+ * touches FAT metadata held in the FATFS object.
+ */
+static void fs_write_lock(void) {
+    if (!g_fs_turnstile) {
+        return;
     }
-    fs_unlock();
 
-    return true;
+    uint32_t wait_us = fs_take_counted(g_fs_turnstile);
+    wait_us += fs_take_counted(g_fs_room_empty);
+
+    fs_account_lock(true, wait_us);
 }
 
-bool fs_exists(const char *path) {
-    if (!g_fs_mounted || !path) {
+/**
+ * @brief Release exclusive filesystem lock
+ */
+static void fs_write_unlock(void) {
+    if (!g_fs_turnstile) {
+        return;
+    }
+
+    xSemaphoreGive(g_fs_room_empty);
+    xSemaphoreGive(g_fs_turnstile);
+}
+
+/**
+ * @brief Build the FatFs logical drive path ("N:") of the mounted volume
+ */
+static bool fs_drive_path(char drv[3]) {
+    BYTE pdrv = g_fs_shared ? g_fs_pdrv : ff_diskio_get_pdrv_wl(g_wl_handle);
+    if (pdrv == 0xFF) {
         return false;
     }
+    drv[0] = (char)('0' + pdrv);
+    drv[1] = ':';
+    drv[2] = 0;
+    return true;
+}
 
-    fs_lock();
-    struct stat st;
-    bool exists = (stat(path, &st) == 0);
-    fs_unlock();
+/**
+ * @brief Get the FATFS object of the mounted volume without scanning the FAT
+ */
+static FATFS *fs_get_fatfs(void) {
+    char drv[3];
+    if (!fs_drive_path(drv)) {
+        return NULL;
+    }
 
-    return exists;
+    /* Opening the root directory only needs the mounted volume; unlike
+     * f_getfree() it never walks the FAT. */
+    FF_DIR dir;
+    if (f_opendir(&dir, drv) != FR_OK) {
+        return NULL;
+    }
+    FATFS *fs = dir.obj.fs;
+    f_closedir(&dir);
+    return fs;
 }
 
-bool fs_write_test_file(void) {
-    if (!g_fs_mounted) {
-        ESP_LOGE(TAG, "Filesystem not mounted");
+/**
+ * @brief Sector size of the mounted volume in bytes
+ */
+static uint32_t fs_sector_size(const FATFS *fs) {
+#if FF_MAX_SS != FF_MIN_SS
+    return fs->ssize;
+#else
+    (void)fs;
+    return FF_MAX_SS;
+#endif
+}
+
+/**
+ * @brief Read the volume serial number from the boot sector
+ */
+static bool fs_read_volume_serial(FATFS *fs, uint32_t *vsn) {
+    uint32_t ssize = fs_sector_size(fs);
+    uint8_t *sect = ff_memalloc(ssize);
+    if (!sect) {
         return false;
     }
 
-    fs_lock();
+    bool ok = (ff_disk_read(fs->pdrv, sect, fs->volbase, 1) == RES_OK);
+    if (ok) {
+        /* BS_VolID lives at offset 39 on FAT12/16 and 67 on FAT32 */
+        const uint8_t *p = sect + ((fs->fs_type == FS_FAT32) ? 67 : 39);
+        *vsn = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+               ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    ff_memfree(sect);
+    return ok;
+}
 
-    FILE *f = fopen(MOUNT_POINT "/test_write.txt", "w");
-    if (!f) {
-        ESP_LOGE(TAG, "Failed to open test file for writing");
-        fs_unlock();
-        return false;
+/**
+ * @brief Bring up NVS for the free-space cache
+ *
+ * The cache is an optimisation only: if NVS is unavailable the filesystem
+ * still works and f_getfree() falls back to scanning the FAT.
+ */
+static void fs_cache_init(void) {
+    if (g_fs_cache_ready) {
+        return;
     }
 
-    time_t now = time(NULL);
-    fprintf(f, "Test write at %s", ctime(&now));
-    fprintf(f, "Timestamp: %lld\n", (long long)now);
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition needs erase, reinitializing");
+        if (nvs_flash_erase() == ESP_OK) {
+            ret = nvs_flash_init();
+        }
+    }
 
-    int ret = fclose(f);
-    fs_unlock();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "NVS unavailable, free-space cache disabled: %s", esp_err_to_name(ret));
+        return;
+    }
+    g_fs_cache_ready = true;
+}
 
-    if (ret != 0) {
-        ESP_LOGE(TAG, "Failed to close test file");
-        return false;
+/**
+ * @brief Write the free-space cache record to NVS
+ */
+static void fs_cache_write(const fs_free_cache_t *rec) {
+    nvs_handle_t nvs;
+    if (nvs_open(FS_CACHE_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, FS_CACHE_NVS_KEY, rec, sizeof(*rec)) == ESP_OK) {
+        nvs_commit(nvs);
     }
+    nvs_close(nvs);
+}
 
-    ESP_LOGI(TAG, "Test file written successfully");
-    return true;
+/**
+ * @brief Seed FatFs with the persisted free-cluster count after mount
+ *
+ * Validates the cached record against the freshly mounted volume. On a hit
+ * the first f_getfree() returns immediately instead of walking the FAT.
+ * The record is then marked dirty so that a crash, or anything that
+ * modifies the volume behind FatFs' back, forces a rescan on next mount.
+ */
+static void fs_cache_load(void) {
+    g_fs_cache_untrusted = false;
+    if (!g_fs_cache_ready) {
+        return;
+    }
+
+    FATFS *fs = fs_get_fatfs();
+    uint32_t vsn = 0;
+    if (!fs || !fs_read_volume_serial(fs, &vsn)) {
+        return;
+    }
+
+    fs_free_cache_t rec = {0};
+    size_t len = sizeof(rec);
+    nvs_handle_t nvs;
+    if (nvs_open(FS_CACHE_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_blob(nvs, FS_CACHE_NVS_KEY, &rec, &len) != ESP_OK || len != sizeof(rec)) {
+            rec.magic = 0;
+        }
+        nvs_close(nvs);
+    }
+
+    bool valid = rec.magic == FS_CACHE_MAGIC &&
+                 rec.clean &&
+                 rec.vsn == vsn &&
+                 rec.n_fatent == fs->n_fatent &&
+                 rec.csize == fs->csize &&
+                 rec.free_clst <= fs->n_fatent - 2 &&
+                 rec.last_clst < fs->n_fatent;
+
+    if (valid) {
+        fs->free_clst = rec.free_clst;
+        fs->last_clst = rec.last_clst;
+        ESP_LOGI(TAG, "Free-space cache hit: %u free clusters", (unsigned)rec.free_clst);
+        g_fs_cache_hits++;
+
+        rec.clean = 0;
+        fs_cache_write(&rec);
+    } else {
+        ESP_LOGI(TAG, "Free-space cache miss, FAT will be scanned on first query");
+    }
 }
 
-bool fs_get_stats(uint64_t *total_bytes, uint64_t *free_bytes) {
-    if (!g_fs_mounted || !total_bytes || !free_bytes) {
-        return false;
+/**
+ * @brief Persist the free-cluster count FatFs maintained while mounted
+ *
+ * Must be called with the volume still mounted, right before unmount:
+ * fs_unmount() and the hand-over to the USB MSC storage.
+ */
+static void fs_cache_store(void) {
+    if (!g_fs_cache_ready || g_fs_cache_untrusted) {
+        return;
     }
 
-    fs_lock();
+    FATFS *fs = fs_get_fatfs();
+    uint32_t vsn = 0;
+    if (!fs || fs->free_clst > fs->n_fatent - 2 || !fs_read_volume_serial(fs, &vsn)) {
+        /* Count was never established (or invalidated); nothing to save */
+        return;
+    }
 
-    FATFS *fs;
-    DWORD fre_clust, fre_sect, tot_sect;
+    fs_free_cache_t rec = {
+        .magic = FS_CACHE_MAGIC,
+        .vsn = vsn,
+        .n_fatent = fs->n_fatent,
+        .csize = fs->csize,
+        .free_clst = fs->free_clst,
+        .last_clst = fs->last_clst,
+        .clean = 1,
+    };
+    fs_cache_write(&rec);
+}
 
-    FRESULT res = f_getfree(MOUNT_POINT, &fre_clust, &fs);
-    if (res != FR_OK) {
-        ESP_LOGE(TAG, "f_getfree failed: %d", res);
-        fs_unlock();
-        return false;
+/**
+ * @brief Mark the persisted free-space record as not written by a clean unmount
+ */
+static void fs_cache_mark_dirty(void) {
+    if (!g_fs_cache_ready) {
+        return;
     }
 
-    tot_sect = (fs->n_fatent - 2) * fs->csize;
-    fre_sect = fre_clust * fs->csize;
+    fs_free_cache_t rec;
+    size_t len = sizeof(rec);
+    nvs_handle_t nvs;
+    if (nvs_open(FS_CACHE_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(nvs, FS_CACHE_NVS_KEY, &rec, &len) == ESP_OK && len == sizeof(rec) && rec.clean) {
+        rec.clean = 0;
+        if (nvs_set_blob(nvs, FS_CACHE_NVS_KEY, &rec, sizeof(rec)) == ESP_OK) {
+            nvs_commit(nvs);
+        }
+    }
+    nvs_close(nvs);
+}
 
-    *total_bytes = tot_sect * 512;
-    *free_bytes = fre_sect * 512;
+const fs_volume_profile_t *fs_get_volume_profile(void) {
+    return &g_fs_profile;
+}
 
-    fs_unlock();
+/**
+ * @brief Mount the storage partition with the volume profile
+ *
+ * Never formats: a missing or unreadable filesystem is reported as ESP_FAIL
+ * so the caller can format with the full profile via fs_mkfs_profile().
+ */
+static esp_err_t fs_mount_profile(void) {
+    const esp_vfs_fat_mount_config_t mount_config = {
+        .format_if_mount_failed = false,
+        .max_files = g_fs_profile.max_files,
+        .allocation_unit_size = g_fs_profile.allocation_unit_size,
+        .use_one_fat = (g_fs_profile.n_fats == 1),
+    };
 
-    ESP_LOGI(TAG, "FS stats: total=%llu bytes, free=%llu bytes", *total_bytes, *free_bytes);
-    return true;
+    return esp_vfs_fat_spiflash_mount_rw_wl(MOUNT_POINT, "storage", &mount_config, &g_wl_handle);
 }
 
-bool fs_unmount(void) {
-    if (!g_fs_mounted) {
-        return true;
+/**
+ * @brief Data area alignment used at format time, in sectors
+ *
+ * Never less than one cluster or one flash erase block, so no cluster
+ * straddles two WL sectors and rewriting a cluster costs a single erase.
+ * All inputs are powers of two, as f_mkfs() requires of the result.
+ */
+static uint32_t fs_format_align_sectors(size_t sector_size, size_t au_size) {
+    uint32_t align = g_fs_profile.align_sectors;
+    uint32_t min_bytes = au_size > FS_FLASH_ERASE_SIZE ? au_size : FS_FLASH_ERASE_SIZE;
+    uint32_t min_sectors = min_bytes / sector_size;
+
+    if (align < min_sectors) {
+        align = min_sectors;
+    }
+    /* Round a user-supplied alignment up to a power of two */
+    while (align & (align - 1)) {
+        align = (align | (align - 1)) + 1;
     }
+    return align;
+}
 
-    fs_lock();
+/**
+ * @brief Root directory entries used at format time
+ *
+ * f_mkfs() rejects a root directory that doesn't fill whole sectors, so
+ * the profile value is rounded up to a multiple of the entries per sector.
+ */
+static uint32_t fs_format_root_entries(size_t sector_size) {
+    uint32_t per_sector = sector_size / 32;
+    uint32_t n_root = (g_fs_profile.root_entries + per_sector - 1) / per_sector * per_sector;
 
-    esp_err_t ret = esp_vfs_fat_spiflash_unmount_rw_wl(MOUNT_POINT, g_wl_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to unmount FATFS: %s", esp_err_to_name(ret));
-        fs_unlock();
-        return false;
+    if (n_root != g_fs_profile.root_entries) {
+        ESP_LOGW(TAG, "Root entries rounded up from %u to %lu (%lu per sector)",
+                 g_fs_profile.root_entries, (unsigned long)n_root, (unsigned long)per_sector);
     }
+    return n_root;
+}
 
-    g_fs_mounted = false;
-    fs_unlock();
+static inline uint32_t fs_ld16(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
 
-    ESP_LOGI(TAG, "FATFS unmounted");
-    return true;
+static inline uint32_t fs_ld32(const uint8_t *p) {
+    return fs_ld16(p) | (fs_ld16(p + 2) << 16);
 }
 
-bool fs_remount(void) {
-    if (g_fs_mounted) {
-        return true;
+static inline void fs_st16(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void fs_st32(uint8_t *p, uint32_t v) {
+    fs_st16(p, v);
+    fs_st16(p + 2, v >> 16);
+}
+
+/**
+ * @brief Resize a FAT volume in place by rewriting the BPB sector count
+ *
+ * Only the total sector count in the boot sector changes. The resulting
+ * cluster count is clamped so that it still fits in the existing FAT and
+ * stays in the range of the volume's FAT type. Clusters added by growth
+ * must be free: f_mkfs() zero-fills the whole FAT, so entries past the
+ * end of a volume that was shrunk right after formatting are.
+ *
+ * @param pdrv Physical drive holding the volume
+ * @param volbase First sector of the volume
+ * @param ssize Sector size in bytes
+ * @param disk_sectors Size of the drive in sectors
+ * @param target_sectors Requested volume size in sectors
+ * @param[out] old_sectors Volume size before the change (may be NULL)
+ * @param[out] new_sectors Volume size after the change (may be NULL)
+ */
+static esp_err_t fs_bpb_resize(BYTE pdrv, LBA_t volbase, uint32_t ssize, uint32_t disk_sectors,
+                               uint32_t target_sectors, uint32_t *old_sectors, uint32_t *new_sectors) {
+    uint8_t *bs = ff_memalloc(ssize);
+    if (!bs) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (ff_disk_read(pdrv, bs, volbase, 1) != RES_OK) {
+        ff_memfree(bs);
+        return ESP_FAIL;
     }
 
-    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-        .format_if_mount_failed = false,
-        .max_files = 5,
-        .allocation_unit_size = 4096,
-    };
+    uint32_t csize = bs[13];
+    uint32_t n_rsvd = fs_ld16(bs + 14);
+    uint32_t n_fats = bs[16];
+    uint32_t n_root = fs_ld16(bs + 17);
+    uint32_t tot = fs_ld16(bs + 19) ? fs_ld16(bs + 19) : fs_ld32(bs + 32);
+    bool fat32 = fs_ld16(bs + 22) == 0;
+    uint32_t fatsz = fat32 ? fs_ld32(bs + 36) : fs_ld16(bs + 22);
+    uint32_t data_start = n_rsvd + n_fats * fatsz + (n_root * 32 + ssize - 1) / ssize;
+
+    if (csize == 0 || tot <= data_start || disk_sectors <= volbase + data_start) {
+        ff_memfree(bs);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t cur_clst = (tot - data_start) / csize;
+    uint32_t min_clst, max_clst, fat_entries;
+    if (fat32) {
+        min_clst = FS_FAT16_MAX_CLUSTERS + 1;
+        max_clst = FS_FAT32_MAX_CLUSTERS;
+        fat_entries = fatsz * (ssize / 4);
+    } else if (cur_clst <= FS_FAT12_MAX_CLUSTERS) {
+        min_clst = 1;
+        max_clst = FS_FAT12_MAX_CLUSTERS;
+        fat_entries = fatsz * ssize * 2 / 3;
+    } else {
+        min_clst = FS_FAT12_MAX_CLUSTERS + 1;
+        max_clst = FS_FAT16_MAX_CLUSTERS;
+        fat_entries = fatsz * (ssize / 2);
+    }
+    /* Two FAT entries are reserved */
+    if (max_clst > fat_entries - 2) {
+        max_clst = fat_entries - 2;
+    }
+    uint32_t disk_clst = (disk_sectors - volbase - data_start) / csize;
+    if (max_clst > disk_clst) {
+        max_clst = disk_clst;
+    }
+
+    uint32_t want = target_sectors > data_start ? (target_sectors - data_start) / csize : 0;
+    if (want > max_clst) {
+        want = max_clst;
+    }
+    if (want < min_clst) {
+        want = min_clst;
+    }
+    uint32_t new_tot = data_start + want * csize;
+
+    esp_err_t ret = ESP_OK;
+    if (new_tot != tot) {
+        if (!fat32 && new_tot < 0x10000) {
+            fs_st16(bs + 19, new_tot);
+            fs_st32(bs + 32, 0);
+        } else {
+            fs_st16(bs + 19, 0);
+            fs_st32(bs + 32, new_tot);
+        }
+
+        if (ff_disk_write(pdrv, bs, volbase, 1) != RES_OK) {
+            ret = ESP_FAIL;
+        } else if (fat32) {
+            /* Keep the backup boot sector in step; the FSInfo free count is now stale */
+            uint32_t bk = fs_ld16(bs + 50);
+            uint32_t fsi = fs_ld16(bs + 48);
+            if (bk && ff_disk_write(pdrv, bs, volbase + bk, 1) != RES_OK) {
+                ret = ESP_FAIL;
+            }
+            if (ret == ESP_OK && fsi && ff_disk_read(pdrv, bs, volbase + fsi, 1) == RES_OK) {
+                fs_st32(bs + 488, FS_CLUSTER_UNKNOWN);
+                if (ff_disk_write(pdrv, bs, volbase + fsi, 1) != RES_OK) {
+                    ret = ESP_FAIL;
+                }
+            }
+        }
+        ff_disk_ioctl(pdrv, CTRL_SYNC, NULL);
+    }
+
+    ff_memfree(bs);
+    if (old_sectors) {
+        *old_sectors = tot;
+    }
+    if (new_sectors) {
+        *new_sectors = ret == ESP_OK ? new_tot : tot;
+    }
+    return ret;
+}
 
-    esp_err_t ret = esp_vfs_fat_spiflash_mount_rw_wl(
-        MOUNT_POINT,
-        "storage",
-        &mount_config,
-        &g_wl_handle
+/**
+ * @brief Format the unmounted storage partition with the volume profile
+ *
+ * esp_vfs_fat's own format path only takes a cluster size, so the partition
+ * is attached to a free FatFs drive directly and passed to f_mkfs() with
+ * every layout parameter of the profile.
+ */
+static esp_err_t fs_mkfs_profile(void) {
+    const esp_partition_t *part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA,
+        ESP_PARTITION_SUBTYPE_DATA_FAT,
+        "storage"
     );
+    if (!part) {
+        return ESP_ERR_NOT_FOUND;
+    }
 
+    wl_handle_t wl = WL_INVALID_HANDLE;
+    esp_err_t ret = wl_mount(part, &wl);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to remount FATFS: %s", esp_err_to_name(ret));
-        return false;
+        ESP_LOGE(TAG, "wl_mount failed: %s", esp_err_to_name(ret));
+        return ret;
     }
 
-    g_fs_mounted = true;
-    ESP_LOGI(TAG, "FATFS remounted");
-    return true;
-}
+    BYTE pdrv = 0xFF;
+    if (ff_diskio_get_drive(&pdrv) != ESP_OK || pdrv == 0xFF) {
+        wl_unmount(wl);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = ff_diskio_register_wl_partition(pdrv, wl);
+    if (ret == ESP_OK) {
+        size_t sector_size = wl_sector_size(wl);
+        size_t work_size = sector_size;
+        void *work = ff_memalloc(work_size);
+        if (!work) {
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            char drv[3] = {(char)('0' + pdrv), ':', 0};
+            size_t au_size = esp_vfs_fat_get_allocation_unit_size(sector_size,
+                                                                  g_fs_profile.allocation_unit_size);
+            const MKFS_PARM opt = {
+                .fmt = g_fs_profile.fmt | FM_SFD,
+                .n_fat = g_fs_profile.n_fats,
+                .align = fs_format_align_sectors(sector_size, au_size),
+                .n_root = fs_format_root_entries(sector_size),
+                .au_size = au_size,
+            };
+
+            ESP_LOGI(TAG, "Formatting: au=%u, fats=%u, root=%u, align=%u",
+                     (unsigned)opt.au_size, opt.n_fat, opt.n_root, (unsigned)opt.align);
+            FRESULT res = f_mkfs(drv, &opt, work, work_size);
+            if (res != FR_OK) {
+                ESP_LOGE(TAG, "f_mkfs failed: %d", res);
+                ret = ESP_FAIL;
+            }
+            ff_memfree(work);
+
+#if CONFIG_FS_PROFILE_VOLUME_SIZE_KB > 0
+            /* FAT was sized for the whole partition; start smaller and leave room to grow */
+            if (ret == ESP_OK) {
+                uint32_t disk_sectors = wl_size(wl) / sector_size;
+                uint32_t target = (uint32_t)((uint64_t)CONFIG_FS_PROFILE_VOLUME_SIZE_KB * 1024 / sector_size);
+                uint32_t sectors = 0;
+                ret = fs_bpb_resize(pdrv, 0, sector_size, disk_sectors, target, NULL, &sectors);
+                ESP_LOGI(TAG, "Initial volume size: %lu of %lu sectors",
+                         (unsigned long)sectors, (unsigned long)disk_sectors);
+            }
+#endif
+        }
+        ff_diskio_clear_pdrv_wl(wl);
+        ff_diskio_register(pdrv, NULL);
+    }
+
+    wl_unmount(wl);
+    return ret;
+}
+
+/**
+ * @brief Mount the storage partition, formatting it first if needed
+ */
+static esp_err_t fs_mount_or_format(bool format_if_needed) {
+    esp_err_t ret = fs_mount_profile();
+    if (ret == ESP_FAIL && format_if_needed) {
+        ESP_LOGW(TAG, "No valid filesystem, formatting with volume profile");
+        ret = fs_mkfs_profile();
+        if (ret == ESP_OK) {
+            ret = fs_mount_profile();
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Create README.txt on a freshly formatted volume
+ */
+static void fs_create_readme(void) {
+    fs_write_lock();
+    FILE *f = fopen(MOUNT_POINT "/README.txt", "r");
+    if (!f) {
+        /* File doesn't exist, create it */
+        f = fopen(MOUNT_POINT "/README.txt", "w");
+        if (f) {
+            fprintf(f, "ESP32-S3 Dual USB Firmware\n");
+            fprintf(f, "Device Mode: Mass Storage Device (MSC)\n");
+            fprintf(f, "Internal FATFS Volume\n");
+            fprintf(f, "\nThis volume is managed by the ESP32-S3 firmware.\n");
+            fprintf(f, "Safe eject before power-off to prevent data loss.\n");
+            fs_trace_record(FS_TRACE_APPEND, MOUNT_POINT "/README.txt", 0, (uint32_t)ftell(f));
+            fclose(f);
+            ESP_LOGI(TAG, "Created README.txt");
+        }
+    } else {
+        fclose(f);
+    }
+    fs_write_unlock();
+}
+
+/**
+ * @brief Attach wear levelling to the storage partition without mounting FatFs
+ */
+static esp_err_t fs_wl_mount(void) {
+    const esp_partition_t *part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA,
+        ESP_PARTITION_SUBTYPE_DATA_FAT,
+        "storage"
+    );
+    if (!part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return wl_mount(part, &g_wl_handle);
+}
+
+bool fs_init_internal(void) {
+    if (g_fs_shared) {
+        /* Owned by the USB MSC storage, only FatFs can be brought back */
+        return fs_remount();
+    }
+
+    ESP_LOGI(TAG, "Initializing internal FATFS at %s", MOUNT_POINT);
+
+    /* Precheck: Verify 'storage' partition exists before mount */
+    const esp_partition_t *storage_part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA,
+        ESP_PARTITION_SUBTYPE_DATA_FAT,
+        "storage"
+    );
+    assert(storage_part && "storage partition missing — flash partition table");
+    ESP_LOGI(TAG, "WL handle acquired for 'storage' partition (offset=0x%x, size=0x%x)",
+             storage_part->address, storage_part->size);
+
+    /* NVS backs the free-space cache */
+    fs_cache_init();
+
+    /* Create reader/writer lock for FS access */
+    if (!fs_lock_create()) {
+        ESP_LOGE(TAG, "Failed to create FS lock");
+        return false;
+    }
+    if (!g_fs_logs_mutex) {
+        g_fs_logs_mutex = xSemaphoreCreateMutex();
+        if (!g_fs_logs_mutex) {
+            ESP_LOGE(TAG, "Failed to create record store mutex");
+            return false;
+        }
+    }
+    fs_trace_init();
+
+#if FS_VOLUME_LAYERED
+    /* Mounted, and formatted on first boot, when the MSC storage attaches it */
+    esp_err_t ret = fs_wl_mount();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach wear levelling: %s", esp_err_to_name(ret));
+        return false;
+    }
+    g_fs_shared = true;
+    ESP_LOGI(TAG, "Layered MSC storage, FATFS is mounted by the USB device");
+    return true;
+#else
+    /* Mount FATFS, formatting with the volume profile on first boot */
+    esp_err_t ret = fs_mount_or_format(true);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount FATFS: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    g_fs_mounted = true;
+    ESP_LOGI(TAG, "FATFS mounted successfully at %s", MOUNT_POINT);
+
+    fs_write_lock();
+    fs_cache_load();
+    fs_write_unlock();
+
+    /* Volumes formatted by older firmware may not be aligned */
+    if (!fs_volume_is_aligned()) {
+#if CONFIG_FS_REALIGN_ON_BOOT
+        fs_realign_volume();
+#else
+        ESP_LOGW(TAG, "Call fs_realign_volume() or enable CONFIG_FS_REALIGN_ON_BOOT to migrate");
+#endif
+    }
+
+    /* Create README.txt on first boot */
+    fs_create_readme();
+
+    return true;
+#endif /* FS_VOLUME_LAYERED */
+}
+
+bool fs_exists(const char *path) {
+    if (!g_fs_mounted || !path) {
+        return false;
+    }
+
+    fs_read_lock();
+    struct stat st;
+    bool exists = (stat(path, &st) == 0);
+    fs_read_unlock();
+
+    return exists;
+}
+
+bool fs_write_test_file(void) {
+    if (!g_fs_mounted) {
+        ESP_LOGE(TAG, "Filesystem not mounted");
+        return false;
+    }
+
+    fs_write_lock();
+
+    FILE *f = fopen(MOUNT_POINT "/test_write.txt", "w");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open test file for writing");
+        fs_write_unlock();
+        return false;
+    }
+
+    time_t now = time(NULL);
+    fprintf(f, "Test write at %s", ctime(&now));
+    fprintf(f, "Timestamp: %lld\n", (long long)now);
+    fs_trace_record(FS_TRACE_TRUNCATE, MOUNT_POINT "/test_write.txt", 0, 0);
+    fs_trace_record(FS_TRACE_APPEND, MOUNT_POINT "/test_write.txt", 0, (uint32_t)ftell(f));
+
+    int ret = fclose(f);
+    fs_write_unlock();
+
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to close test file");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Test file written successfully");
+    return true;
+}
+
+bool fs_get_stats(uint64_t *total_bytes, uint64_t *free_bytes) {
+    if (!g_fs_mounted || !total_bytes || !free_bytes) {
+        return false;
+    }
+
+    fs_read_lock();
+
+    FATFS *fs;
+    DWORD fre_clust;
+    char drv[3];
+
+    /* O(1) once the free count is known: seeded from the cache at mount,
+     * or established by the first scan and kept current by FatFs. A scan
+     * updates FATFS state, but FatFs serialises that under its own volume
+     * lock, so a shared lock is sufficient here. */
+    FRESULT res = fs_drive_path(drv) ? f_getfree(drv, &fre_clust, &fs) : FR_INVALID_DRIVE;
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "f_getfree failed: %d", res);
+        fs_read_unlock();
+        return false;
+    }
+
+    uint64_t cluster_bytes = (uint64_t)fs->csize * fs_sector_size(fs);
+    *total_bytes = (uint64_t)(fs->n_fatent - 2) * cluster_bytes;
+    *free_bytes = (uint64_t)fre_clust * cluster_bytes;
+
+    fs_read_unlock();
+
+    ESP_LOGI(TAG, "FS stats: total=%llu bytes, free=%llu bytes", *total_bytes, *free_bytes);
+    return true;
+}
+
+bool fs_get_stats_ex(fs_stats_t *stats) {
+    if (!stats) {
+        return false;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    if (g_fs_mounted && !fs_get_stats(&stats->total_bytes, &stats->free_bytes)) {
+        return false;
+    }
+    stats->mounted = g_fs_mounted;
+    stats->free_cache_hits = g_fs_cache_hits;
+
+    taskENTER_CRITICAL(&g_fs_stats_lock);
+    stats->lock = g_fs_lock_stats;
+    taskEXIT_CRITICAL(&g_fs_stats_lock);
+
+    return true;
+}
+
+void fs_invalidate_free_cache(void) {
+    /* The host may write until the volume is mounted again: the next mount
+     * must not trust the record, and this session must not write one */
+    g_fs_cache_untrusted = true;
+    fs_cache_mark_dirty();
+
+    if (!g_fs_mounted) {
+        ESP_LOGI(TAG, "Free-space cache invalidated");
+        return;
+    }
+
+    fs_write_lock();
+    FATFS *fs = fs_get_fatfs();
+    if (fs) {
+        /* Forces FatFs to rescan on the next f_getfree() */
+        fs->free_clst = FS_CLUSTER_UNKNOWN;
+        fs->last_clst = FS_CLUSTER_UNKNOWN;
+    }
+    fs_write_unlock();
+
+    ESP_LOGI(TAG, "Free-space cache invalidated");
+}
+
+bool fs_volume_is_aligned(void) {
+    if (!g_fs_mounted) {
+        return false;
+    }
+
+    const esp_partition_t *part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA,
+        ESP_PARTITION_SUBTYPE_DATA_FAT,
+        "storage"
+    );
+
+    fs_read_lock();
+    FATFS *fs = fs_get_fatfs();
+    bool aligned = false;
+    if (fs && part) {
+        uint32_t ssize = fs_sector_size(fs);
+        uint32_t cluster_bytes = fs->csize * ssize;
+        uint32_t align_bytes = cluster_bytes > FS_FLASH_ERASE_SIZE ? cluster_bytes : FS_FLASH_ERASE_SIZE;
+        uint64_t data_offset = (uint64_t)(fs->database - fs->volbase) * ssize;
+
+        aligned = (part->address % FS_FLASH_ERASE_SIZE) == 0 && (data_offset % align_bytes) == 0;
+        if (!aligned) {
+            ESP_LOGW(TAG, "Volume misaligned: partition at 0x%lx, data area at +0x%llx, cluster %lu bytes",
+                     (unsigned long)part->address, data_offset, (unsigned long)cluster_bytes);
+        }
+    }
+    fs_read_unlock();
+
+    return aligned;
+}
+
+/* Longest path handled by the re-align migration */
+#define FS_REALIGN_PATH_MAX     (FF_MAX_LFN + 1)
+/* Heap left to the rest of the system while the volume is held in RAM */
+#define FS_REALIGN_HEAP_RESERVE (64 * 1024)
+/* Reformat attempts before the backup is handed back to the caller */
+#define FS_REALIGN_ATTEMPTS     3
+
+/**
+ * @brief One file or directory saved during the re-align migration
+ */
+typedef struct fs_backup {
+    struct fs_backup *next;     /**< Next entry, parents before children */
+    bool is_dir;                /**< Directory (no data) */
+    size_t size;                /**< File size in bytes */
+    uint8_t *data;              /**< File contents, follows the path */
+    char path[];                /**< Absolute VFS path */
+} fs_backup_t;
+
+static fs_backup_t *fs_backup_alloc(const char *path, bool is_dir, size_t size) {
+    size_t path_len = strlen(path) + 1;
+    size_t total = sizeof(fs_backup_t) + path_len + size;
+
+    /* Prefer PSRAM: the whole volume has to fit */
+    fs_backup_t *e = heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!e) {
+        e = heap_caps_malloc(total, MALLOC_CAP_8BIT);
+    }
+    if (!e) {
+        return NULL;
+    }
+
+    e->next = NULL;
+    e->is_dir = is_dir;
+    e->size = size;
+    memcpy(e->path, path, path_len);
+    e->data = (uint8_t *)e->path + path_len;
+    return e;
+}
+
+static void fs_backup_free(fs_backup_t *head) {
+    while (head) {
+        fs_backup_t *next = head->next;
+        heap_caps_free(head);
+        head = next;
+    }
+}
+
+/**
+ * @brief Copy a directory tree into RAM
+ *
+ * @param path Buffer of FS_REALIGN_PATH_MAX bytes holding the directory path
+ * @param tail Where to link the next entry
+ */
+static bool fs_backup_tree(char *path, fs_backup_t ***tail) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return false;
+    }
+
+    size_t len = strlen(path);
+    bool ok = true;
+    struct dirent *de;
+    while (ok && (de = readdir(dir)) != NULL) {
+        size_t n = strlen(de->d_name);
+        if (len + 1 + n >= FS_REALIGN_PATH_MAX) {
+            ok = false;
+            break;
+        }
+        path[len] = '/';
+        memcpy(path + len + 1, de->d_name, n + 1);
+
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            ok = false;
+            break;
+        }
+
+        bool is_dir = S_ISDIR(st.st_mode);
+        fs_backup_t *e = fs_backup_alloc(path, is_dir, is_dir ? 0 : (size_t)st.st_size);
+        if (!e) {
+            ESP_LOGE(TAG, "Re-align: out of memory backing up %s", path);
+            ok = false;
+            break;
+        }
+        **tail = e;
+        *tail = &e->next;
+
+        if (is_dir) {
+            ok = fs_backup_tree(path, tail);
+        } else if (e->size > 0) {
+            FILE *f = fopen(path, "rb");
+            ok = f && fread(e->data, 1, e->size, f) == e->size;
+            if (f) {
+                fclose(f);
+            }
+        }
+    }
+
+    path[len] = 0;
+    closedir(dir);
+    return ok;
+}
+
+static bool fs_backup_restore(const fs_backup_t *e) {
+    bool ok = true;
+    for (; e; e = e->next) {
+        if (e->is_dir) {
+            if (mkdir(e->path, 0755) != 0) {
+                ESP_LOGE(TAG, "Re-align: failed to restore %s", e->path);
+                ok = false;
+            }
+            continue;
+        }
+        FILE *f = fopen(e->path, "wb");
+        if (!f || fwrite(e->data, 1, e->size, f) != e->size) {
+            ESP_LOGE(TAG, "Re-align: failed to restore %s", e->path);
+            ok = false;
+        }
+        if (f) {
+            fclose(f);
+        }
+    }
+    return ok;
+}
+
+/* Volume contents of a re-align whose reformat failed, restored on the next call */
+static fs_backup_t *g_fs_realign_backup = NULL;
+
+/**
+ * @brief Check that the used part of the volume fits in the free heap
+ *
+ * The backup is refused up front rather than after most of the heap has
+ * been taken; the volume can't be streamed elsewhere, it is the only one.
+ */
+static bool fs_realign_fits_in_ram(void) {
+    uint64_t total = 0, free_bytes = 0;
+    if (!fs_get_stats(&total, &free_bytes)) {
+        return false;
+    }
+
+    uint64_t used = total - free_bytes;
+    size_t heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    if (heap < FS_REALIGN_HEAP_RESERVE || used > heap - FS_REALIGN_HEAP_RESERVE) {
+        ESP_LOGE(TAG, "Re-align: %llu bytes in use, only %u bytes of heap free, volume left unchanged",
+                 used, (unsigned)heap);
+        return false;
+    }
+    return true;
+}
+
+bool fs_realign_volume(void) {
+    fs_backup_t *head = g_fs_realign_backup;
+
+    if (head) {
+        /* The volume was unmounted by a failed attempt, only the reformat is left */
+        g_fs_realign_backup = NULL;
+        fs_write_lock();
+    } else {
+        if (!g_fs_mounted || g_fs_shared || !fs_realign_fits_in_ram()) {
+            return false;
+        }
+
+        fs_log_flush_all();
+
+        char *path = malloc(FS_REALIGN_PATH_MAX);
+        if (!path) {
+            return false;
+        }
+        strcpy(path, MOUNT_POINT);
+
+        fs_write_lock();
+
+        fs_backup_t **tail = &head;
+        if (!fs_backup_tree(path, &tail)) {
+            ESP_LOGE(TAG, "Re-align: backup failed, volume left unchanged");
+            fs_backup_free(head);
+            fs_write_unlock();
+            free(path);
+            return false;
+        }
+        free(path);
+
+        esp_err_t ret = esp_vfs_fat_spiflash_unmount_rw_wl(MOUNT_POINT, g_wl_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Re-align: unmount failed: %s, volume left unchanged", esp_err_to_name(ret));
+            fs_backup_free(head);
+            fs_write_unlock();
+            return false;
+        }
+        g_fs_mounted = false;
+    }
+
+    /* From here until the restore completes, power loss loses the volume */
+    ESP_LOGW(TAG, "Re-align: reformatting volume");
+    esp_err_t ret = ESP_FAIL;
+    for (int attempt = 0; attempt < FS_REALIGN_ATTEMPTS && ret != ESP_OK; attempt++) {
+        ret = fs_mkfs_profile();
+        if (ret == ESP_OK) {
+            ret = fs_mount_profile();
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Re-align: reformat attempt %d failed: %s", attempt + 1, esp_err_to_name(ret));
+        }
+    }
+    if (ret != ESP_OK) {
+        /* Keep the contents: the next call retries the reformat and restores them */
+        ESP_LOGE(TAG, "Re-align: reformat failed, volume contents kept in RAM, call again to retry");
+        g_fs_realign_backup = head;
+        fs_write_unlock();
+        return false;
+    }
+    g_fs_mounted = true;
+
+    bool ok = fs_backup_restore(head);
+    fs_backup_free(head);
+    fs_write_unlock();
+
+    ESP_LOGI(TAG, "Re-align: %s", ok ? "volume migrated" : "completed with errors");
+    return ok;
+}
+
+bool fs_get_volume_info(uint32_t *sector_count, uint32_t *sector_size) {
+    if (!g_fs_mounted || !sector_count || !sector_size) {
+        return false;
+    }
+
+    fs_read_lock();
+    FATFS *fs = fs_get_fatfs();
+    if (fs) {
+        *sector_size = fs_sector_size(fs);
+        *sector_count = (uint32_t)(fs->database - fs->volbase) + (fs->n_fatent - 2) * fs->csize;
+    }
+    fs_read_unlock();
+
+    return fs != NULL;
+}
+
+#if !FF_FS_LOCK
+#error "fs_grow_volume() finds open files with FatFs share locking, enable CONFIG_FATFS_FS_LOCK"
+#endif
+
+/**
+ * @brief Check whether a file under a directory is open, through any handle
+ *
+ * FatFs share locking refuses write access to a file open in any mode. A
+ * full lock table, which holds open directories too, counts as open files.
+ *
+ * @param path FatFs path of the directory ("N:" for the root), extended in
+ *             place while scanning, FS_REALIGN_PATH_MAX bytes
+ * @param fil Scratch file object, too large for the stack
+ */
+static bool fs_files_open(char *path, FIL *fil) {
+    FF_DIR dir;
+    FILINFO fno;
+    if (f_opendir(&dir, path) != FR_OK) {
+        return true;
+    }
+
+    size_t len = strlen(path);
+    bool open = false;
+    while (!open && f_readdir(&dir, &fno) == FR_OK && fno.fname[0]) {
+        if (len + 1 + strlen(fno.fname) >= FS_REALIGN_PATH_MAX) {
+            /* Can't be checked, assume the worst */
+            open = true;
+            break;
+        }
+        snprintf(path + len, FS_REALIGN_PATH_MAX - len, "/%s", fno.fname);
+        if (fno.fattrib & AM_DIR) {
+            open = fs_files_open(path, fil);
+        } else {
+            FRESULT res = f_open(fil, path, FA_WRITE | FA_OPEN_EXISTING);
+            if (res == FR_OK) {
+                /* Nothing written, closing doesn't touch the volume */
+                f_close(fil);
+            }
+            open = (res == FR_LOCKED || res == FR_TOO_MANY_OPEN_FILES);
+        }
+        path[len] = 0;
+    }
+    f_closedir(&dir);
+    return open;
+}
+
+wl_handle_t fs_get_wl_handle(void) {
+    return g_fs_shared ? g_wl_handle : WL_INVALID_HANDLE;
+}
+
+bool fs_grow_volume(uint64_t size_bytes) {
+    if (!g_fs_mounted) {
+        return false;
+    }
+
+    fs_log_flush_all();
+    fs_write_lock();
+
+    FATFS *fs = fs_get_fatfs();
+    if (!fs) {
+        fs_write_unlock();
+        return false;
+    }
+
+    uint32_t ssize = fs_sector_size(fs);
+    uint32_t disk_sectors = (uint32_t)(wl_size(g_wl_handle) / ssize);
+    uint32_t target = size_bytes ? (uint32_t)(size_bytes / ssize) : disk_sectors;
+    uint32_t cur = (uint32_t)(fs->database - fs->volbase) + (fs->n_fatent - 2) * fs->csize;
+    if (target < cur) {
+        ESP_LOGE(TAG, "Grow: shrinking is not supported");
+        fs_write_unlock();
+        return false;
+    }
+
+    /* The remount below invalidates every open FIL; this module's own files
+     * are closed under the write lock, other writers' may not be */
+    char *path = malloc(FS_REALIGN_PATH_MAX);
+    FIL *fil = malloc(sizeof(FIL));
+    bool files_open = !path || !fil || !fs_drive_path(path) || fs_files_open(path, fil);
+    free(fil);
+    free(path);
+    if (files_open) {
+        ESP_LOGE(TAG, "Grow: files of the volume are open, close them first");
+        fs_write_unlock();
+        return false;
+    }
+
+    uint32_t old_sectors = 0, new_sectors = 0;
+    esp_err_t ret = fs_bpb_resize(fs->pdrv, fs->volbase, ssize, disk_sectors, target,
+                                  &old_sectors, &new_sectors);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Grow: failed to update boot sector: %s", esp_err_to_name(ret));
+        fs_write_unlock();
+        return false;
+    }
+    if (new_sectors == old_sectors) {
+        ESP_LOGI(TAG, "Grow: volume already at its maximum size (%lu sectors)", (unsigned long)old_sectors);
+        fs_write_unlock();
+        return true;
+    }
+
+    /* FatFs reads the geometry at mount time only; the free-space cache
+     * no longer matches (n_fatent changed) and is rebuilt on next query.
+     * Wear levelling stays mounted, the MSC storage keeps its handle. */
+    char drv[3];
+    FRESULT res = FR_INT_ERR;
+    if (fs_drive_path(drv)) {
+        f_mount(NULL, drv, 0);
+        res = f_mount(fs, drv, 1);
+    }
+    if (res != FR_OK) {
+        g_fs_mounted = false;
+    }
+    fs_write_unlock();
+
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Grow: remount failed: %d", res);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Grow: volume extended from %lu to %lu sectors",
+             (unsigned long)old_sectors, (unsigned long)new_sectors);
+    return true;
+}
+
+bool fs_unmount(void) {
+    if (!g_fs_mounted) {
+        return true;
+    }
+
+    /* Staged records must reach the volume before it goes away */
+    fs_log_flush_all();
+    fs_trace_export(FS_TRACE_FILE);
+
+    fs_write_lock();
+
+    /* Save the free count while FatFs still holds it */
+    fs_cache_store();
+
+    if (g_fs_shared) {
+        /* The MSC storage keeps its VFS registration, FatFs lets go of the volume */
+        char drv[3];
+        g_fs_shared_fatfs = fs_get_fatfs();
+        if (!g_fs_shared_fatfs || !fs_drive_path(drv) || f_mount(NULL, drv, 0) != FR_OK) {
+            ESP_LOGE(TAG, "Failed to unmount FATFS");
+            fs_write_unlock();
+            return false;
+        }
+    } else {
+        esp_err_t ret = esp_vfs_fat_spiflash_unmount_rw_wl(MOUNT_POINT, g_wl_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to unmount FATFS: %s", esp_err_to_name(ret));
+            fs_write_unlock();
+            return false;
+        }
+    }
+
+    g_fs_mounted = false;
+    fs_write_unlock();
+
+    ESP_LOGI(TAG, "FATFS unmounted");
+    return true;
+}
+
+bool fs_remount(void) {
+    if (g_fs_mounted) {
+        return true;
+    }
+
+    if (g_fs_shared) {
+        /* Only the mount of the MSC storage can be brought back, not the host's */
+        char drv[3];
+        if (!g_fs_shared_fatfs || !fs_drive_path(drv) || f_mount(g_fs_shared_fatfs, drv, 1) != FR_OK) {
+            ESP_LOGE(TAG, "Failed to remount FATFS");
+            return false;
+        }
+    } else {
+        esp_err_t ret = fs_mount_or_format(false);
+
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to remount FATFS: %s", esp_err_to_name(ret));
+            return false;
+        }
+    }
+
+    g_fs_mounted = true;
+    ESP_LOGI(TAG, "FATFS remounted");
+
+    fs_write_lock();
+    fs_cache_load();
+    fs_write_unlock();
+    return true;
+}
+
+bool fs_release_volume(void) {
+    if (g_fs_shared) {
+        return true;
+    }
+    if (!g_fs_mounted || g_fs_realign_backup) {
+        return false;
+    }
+
+    /* The storage mounts the volume right away: with the count known, the
+     * record persisted by the unmount below seeds that mount */
+    uint64_t total_bytes, free_bytes;
+    fs_get_stats(&total_bytes, &free_bytes);
+
+    /* Flushes the record store and the trace, and persists the free count */
+    if (!fs_unmount()) {
+        return false;
+    }
+
+    esp_err_t ret = fs_wl_mount();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach wear levelling: %s", esp_err_to_name(ret));
+        fs_remount();
+        return false;
+    }
+
+    g_fs_shared = true;
+    ESP_LOGI(TAG, "Volume released to the USB MSC storage");
+    return true;
+}
+
+bool fs_attach_volume(uint8_t pdrv) {
+    if (!g_fs_shared || pdrv == 0xFF) {
+        return false;
+    }
+    if (g_fs_mounted && g_fs_pdrv == pdrv) {
+        return true;
+    }
+
+    fs_write_lock();
+    g_fs_pdrv = pdrv;
+    g_fs_shared_fatfs = NULL;
+    g_fs_mounted = true;
+    /* Misses after a host session, the record was invalidated on detach */
+    fs_cache_load();
+    fs_write_unlock();
+
+    /* A layered storage formats the volume on its first attach */
+    fs_create_readme();
+
+    ESP_LOGI(TAG, "FATFS attached at %s (drive %u)", MOUNT_POINT, pdrv);
+    return true;
+}
+
+void fs_detach_volume(void) {
+    if (!g_fs_shared) {
+        return;
+    }
+
+    if (g_fs_mounted) {
+        /* Last writes of the application, before the host sees the volume */
+        fs_log_flush_all();
+        fs_trace_export(FS_TRACE_FILE);
+    }
+
+    fs_write_lock();
+    g_fs_mounted = false;
+    g_fs_pdrv = 0xFF;
+    g_fs_shared_fatfs = NULL;
+    fs_write_unlock();
+
+    /* The host may rewrite the FAT until the volume is attached again */
+    fs_invalidate_free_cache();
+    ESP_LOGI(TAG, "FATFS detached, volume owned by the USB host");
+}
+
+/* ------------------------------------------------------------------------ */
+/* Record store                                                             */
+/* ------------------------------------------------------------------------ */
+
+static void fs_log_segment_path(const fs_log_t *log, uint32_t index, char *path, size_t len) {
+    snprintf(path, len, FS_LOG_DIR "/%s_%05lu.seg", log->name, (unsigned long)index);
+}
+
+/**
+ * @brief Parse "<name>_NNNNN.seg" into name length and segment index
+ */
+static bool fs_log_parse_segment(const char *fname, size_t *name_len, uint32_t *index) {
+    size_t len = strlen(fname);
+    if (len < 11 || strcmp(fname + len - 4, ".seg") != 0 || fname[len - 10] != '_') {
+        return false;
+    }
+    char *end;
+    unsigned long idx = strtoul(fname + len - 9, &end, 10);
+    if (end != fname + len - 4) {
+        return false;
+    }
+    *name_len = len - 10;
+    *index = (uint32_t)idx;
+    return *name_len > 0 && *name_len <= FS_LOG_NAME_MAX;
+}
+
+/**
+ * @brief Find the oldest and newest segment of a log on disk
+ *
+ * @return true if at least one segment exists
+ */
+static bool fs_log_scan_segments(fs_log_t *log) {
+    bool found = false;
+    size_t want = strlen(log->name);
+
+    DIR *dir = opendir(FS_LOG_DIR);
+    if (!dir) {
+        return false;
+    }
+
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        size_t name_len;
+        uint32_t index;
+        if (!fs_log_parse_segment(de->d_name, &name_len, &index) ||
+            name_len != want || strncmp(de->d_name, log->name, want) != 0) {
+            continue;
+        }
+        if (!found || index < log->seg_first) {
+            log->seg_first = index;
+        }
+        if (!found || index > log->seg_last) {
+            log->seg_last = index;
+        }
+        found = true;
+    }
+    closedir(dir);
+    return found;
+}
+
+/**
+ * @brief Write the staging buffer to the current segment
+ *
+ * Caller holds log->mutex.
+ */
+static bool fs_log_write_out(fs_log_t *log) {
+    if (log->buf_used == 0) {
+        return true;
+    }
+
+    char path[FS_LOG_PATH_MAX];
+    fs_log_segment_path(log, log->seg_last, path, sizeof(path));
+
+    fs_write_lock();
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    bool ok = (fd >= 0) && (write(fd, log->buf, log->buf_used) == (ssize_t)log->buf_used);
+    if (fd >= 0) {
+        ok = (close(fd) == 0) && ok;
+    }
+    fs_write_unlock();
+
+    if (!ok) {
+        ESP_LOGE(TAG, "Record store: failed to write %s", path);
+        return false;
+    }
+
+    fs_trace_record(FS_TRACE_APPEND, path, 0, log->buf_used);
+    log->seg_bytes += log->buf_used;
+    log->buf_used = 0;
+    return true;
+}
+
+/**
+ * @brief Start a new segment, dropping the oldest beyond the retention limit
+ *
+ * Caller holds log->mutex and has written out the staging buffer.
+ */
+static void fs_log_rotate(fs_log_t *log) {
+    log->seg_last++;
+    log->seg_bytes = 0;
+
+    while (log->seg_last - log->seg_first >= FS_LOG_MAX_SEGMENTS) {
+        char path[FS_LOG_PATH_MAX];
+        fs_log_segment_path(log, log->seg_first, path, sizeof(path));
+        fs_write_lock();
+        if (unlink(path) == 0) {
+            fs_trace_record(FS_TRACE_DELETE, path, 0, 0);
+        }
+        fs_write_unlock();
+        log->seg_first++;
+    }
+}
+
+/**
+ * @brief Staging buffer size: one cluster, never less than a whole record
+ */
+static size_t fs_log_buffer_size(void) {
+    size_t size = g_fs_profile.allocation_unit_size;
+    if (size < sizeof(fs_log_rec_hdr_t) + FS_LOG_RECORD_MAX) {
+        size = sizeof(fs_log_rec_hdr_t) + FS_LOG_RECORD_MAX;
+    }
+    return size;
+}
+
+/**
+ * @brief Length of the valid record prefix of a segment
+ *
+ * @param[in] scratch Buffer of at least FS_LOG_RECORD_MAX bytes
+ */
+static uint32_t fs_log_valid_length(const char *path, uint8_t *scratch) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        return 0;
+    }
+
+    uint32_t valid = 0;
+    fs_log_rec_hdr_t hdr;
+    while (fread(&hdr, sizeof(hdr), 1, in) == 1) {
+        if (hdr.magic != FS_LOG_RECORD_MAGIC || hdr.len == 0 || hdr.len > FS_LOG_RECORD_MAX ||
+            fread(scratch, 1, hdr.len, in) != hdr.len ||
+            checksum_crc32(0, scratch, hdr.len) != hdr.crc) {
+            break;
+        }
+        valid += sizeof(hdr) + hdr.len;
+    }
+
+    fclose(in);
+    return valid;
+}
+
+/**
+ * @brief Position the log after the last valid record on disk
+ *
+ * Cuts a torn tail off the newest segment so new records are not appended
+ * behind it, where export would never reach them. If the segment can't be
+ * truncated, appending continues in a fresh segment instead.
+ */
+static void fs_log_resume(fs_log_t *log) {
+    fs_read_lock();
+    bool found = fs_log_scan_segments(log);
+    fs_read_unlock();
+    if (!found) {
+        return;
+    }
+
+    char path[FS_LOG_PATH_MAX];
+    struct stat st;
+    bool rotate = false;
+    fs_log_segment_path(log, log->seg_last, path, sizeof(path));
+
+    fs_write_lock();
+    if (stat(path, &st) == 0) {
+        /* The staging buffer is still empty, use it as scratch */
+        uint32_t valid = fs_log_valid_length(path, log->buf);
+        log->seg_bytes = (uint32_t)st.st_size;
+        if (valid < (uint32_t)st.st_size) {
+            ESP_LOGW(TAG, "Record store: dropping %lu torn bytes at end of %s",
+                     (unsigned long)(st.st_size - valid), path);
+            if (truncate(path, valid) == 0) {
+                fs_trace_record(FS_TRACE_TRUNCATE, path, 0, valid);
+                log->seg_bytes = valid;
+            } else {
+                ESP_LOGW(TAG, "Record store: truncate failed, starting a new segment");
+                rotate = true;
+            }
+        }
+    }
+    fs_write_unlock();
+
+    if (rotate) {
+        fs_log_rotate(log);
+    }
+}
+
+fs_log_t *fs_log_open(const char *name) {
+    if (!g_fs_mounted || !name || !g_fs_logs_mutex) {
+        return NULL;
+    }
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > FS_LOG_NAME_MAX || strpbrk(name, "/\\:*?\"<>|") != NULL) {
+        ESP_LOGE(TAG, "Record store: invalid log name");
+        return NULL;
+    }
+
+    xSemaphoreTake(g_fs_logs_mutex, portMAX_DELAY);
+
+    int slot = -1;
+    for (int i = 0; i < FS_LOG_MAX_OPEN; i++) {
+        if (g_fs_logs[i] && strcmp(g_fs_logs[i]->name, name) == 0) {
+            xSemaphoreGive(g_fs_logs_mutex);
+            ESP_LOGE(TAG, "Record store: log '%s' already open", name);
+            return NULL;
+        }
+        if (!g_fs_logs[i] && slot < 0) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        xSemaphoreGive(g_fs_logs_mutex);
+        ESP_LOGE(TAG, "Record store: too many open logs");
+        return NULL;
+    }
+
+    fs_log_t *log = calloc(1, sizeof(*log));
+    if (log) {
+        log->buf_size = fs_log_buffer_size();
+        log->buf = malloc(log->buf_size);
+        log->mutex = xSemaphoreCreateMutex();
+    }
+    if (!log || !log->buf || !log->mutex) {
+        if (log) {
+            free(log->buf);
+            if (log->mutex) {
+                vSemaphoreDelete(log->mutex);
+            }
+            free(log);
+        }
+        xSemaphoreGive(g_fs_logs_mutex);
+        ESP_LOGE(TAG, "Record store: out of memory");
+        return NULL;
+    }
+    strcpy(log->name, name);
+
+    fs_write_lock();
+    mkdir(FS_LOG_DIR, 0755);
+    fs_write_unlock();
+
+    /* Resume appending to the newest segment left by a previous session */
+    fs_log_resume(log);
+
+    g_fs_logs[slot] = log;
+    xSemaphoreGive(g_fs_logs_mutex);
+
+    ESP_LOGI(TAG, "Record store: opened '%s' (segments %lu..%lu)", name,
+             (unsigned long)log->seg_first, (unsigned long)log->seg_last);
+    return log;
+}
+
+bool fs_log_append(fs_log_t *log, const void *data, size_t len) {
+    if (!log || !data || len == 0 || len > FS_LOG_RECORD_MAX) {
+        return false;
+    }
+
+    size_t need = sizeof(fs_log_rec_hdr_t) + len;
+    bool ok = true;
+
+    xSemaphoreTake(log->mutex, portMAX_DELAY);
+
+    /* Records never straddle the staging buffer or a segment boundary */
+    if (log->buf_used + need > log->buf_size) {
+        ok = fs_log_write_out(log);
+    }
+    if (ok && log->seg_bytes + log->buf_used + need > FS_LOG_SEGMENT_SIZE) {
+        ok = fs_log_write_out(log);
+        if (ok) {
+            fs_log_rotate(log);
+        }
+    }
+
+    if (ok) {
+        fs_log_rec_hdr_t hdr = {
+            .magic = FS_LOG_RECORD_MAGIC,
+            .len = (uint16_t)len,
+            .crc = checksum_crc32(0, data, len),
+        };
+        memcpy(log->buf + log->buf_used, &hdr, sizeof(hdr));
+        memcpy(log->buf + log->buf_used + sizeof(hdr), data, len);
+        log->buf_used += need;
+        log->records++;
+    }
+
+    xSemaphoreGive(log->mutex);
+    return ok;
+}
+
+bool fs_log_flush(fs_log_t *log) {
+    if (!log) {
+        return false;
+    }
+
+    xSemaphoreTake(log->mutex, portMAX_DELAY);
+    bool ok = fs_log_write_out(log);
+    xSemaphoreGive(log->mutex);
+    return ok;
+}
+
+void fs_log_flush_all(void) {
+    if (!g_fs_logs_mutex) {
+        return;
+    }
+
+    xSemaphoreTake(g_fs_logs_mutex, portMAX_DELAY);
+    for (int i = 0; i < FS_LOG_MAX_OPEN; i++) {
+        if (g_fs_logs[i]) {
+            fs_log_flush(g_fs_logs[i]);
+        }
+    }
+    xSemaphoreGive(g_fs_logs_mutex);
+}
+
+/**
+ * @brief Copy the valid records of one segment to an export file
+ *
+ * Stops at the first torn or corrupt record, which can only be the tail
+ * left by a power loss during a flush.
+ *
+ * @return Number of records copied, or -1 on write error
+ */
+static int fs_log_export_segment(const char *seg_path, FILE *out, uint8_t *payload) {
+    FILE *in = fopen(seg_path, "rb");
+    if (!in) {
+        return 0;
+    }
+
+    int count = 0;
+    fs_log_rec_hdr_t hdr;
+    while (fread(&hdr, sizeof(hdr), 1, in) == 1) {
+        if (hdr.magic != FS_LOG_RECORD_MAGIC || hdr.len == 0 || hdr.len > FS_LOG_RECORD_MAX ||
+            fread(payload, 1, hdr.len, in) != hdr.len ||
+            checksum_crc32(0, payload, hdr.len) != hdr.crc) {
+            ESP_LOGW(TAG, "Record store: truncated segment %s after %d records", seg_path, count);
+            break;
+        }
+
+        if (fwrite(payload, 1, hdr.len, out) != hdr.len ||
+            (payload[hdr.len - 1] != '\n' && fputc('\n', out) == EOF)) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+
+    fclose(in);
+    return count;
+}
+
+int fs_log_export(fs_log_t *log, const char *path) {
+    if (!log || !path) {
+        return -1;
+    }
+
+    uint8_t *payload = malloc(FS_LOG_RECORD_MAX);
+    if (!payload) {
+        return -1;
+    }
+
+    xSemaphoreTake(log->mutex, portMAX_DELAY);
+
+    int total = -1;
+    if (fs_log_write_out(log)) {
+        fs_write_lock();
+        FILE *out = fopen(path, "w");
+        if (out) {
+            total = 0;
+            for (uint32_t seg = log->seg_first; seg <= log->seg_last; seg++) {
+                char seg_path[FS_LOG_PATH_MAX];
+                fs_log_segment_path(log, seg, seg_path, sizeof(seg_path));
+                int n = fs_log_export_segment(seg_path, out, payload);
+                if (n < 0) {
+                    total = -1;
+                    break;
+                }
+                total += n;
+            }
+            fs_trace_record(FS_TRACE_TRUNCATE, path, 0, 0);
+            fs_trace_record(FS_TRACE_APPEND, path, 0, (uint32_t)ftell(out));
+            if (fclose(out) != 0) {
+                total = -1;
+            }
+        }
+        fs_write_unlock();
+    }
+
+    xSemaphoreGive(log->mutex);
+    free(payload);
+
+    if (total < 0) {
+        ESP_LOGE(TAG, "Record store: export of '%s' to %s failed", log->name, path);
+    } else {
+        ESP_LOGI(TAG, "Record store: exported %d records of '%s' to %s", total, log->name, path);
+    }
+    return total;
+}
+
+void fs_log_close(fs_log_t *log) {
+    if (!log) {
+        return;
+    }
+
+    fs_log_flush(log);
+
+    xSemaphoreTake(g_fs_logs_mutex, portMAX_DELAY);
+    for (int i = 0; i < FS_LOG_MAX_OPEN; i++) {
+        if (g_fs_logs[i] == log) {
+            g_fs_logs[i] = NULL;
+        }
+    }
+    xSemaphoreGive(g_fs_logs_mutex);
+
+    vSemaphoreDelete(log->mutex);
+    free(log->buf);
+    free(log);
+}
+
+int fs_log_export_all(void) {
+    if (!g_fs_mounted) {
+        return -1;
+    }
+
+    /* Collect distinct log names present on disk */
+    char names[FS_LOG_MAX_OPEN * 2][FS_LOG_NAME_MAX + 1];
+    int n_names = 0;
+
+    fs_read_lock();
+    DIR *dir = opendir(FS_LOG_DIR);
+    if (dir) {
+        struct dirent *de;
+        while ((de = readdir(dir)) != NULL && n_names < (int)(sizeof(names) / sizeof(names[0]))) {
+            size_t name_len;
+            uint32_t index;
+            if (!fs_log_parse_segment(de->d_name, &name_len, &index)) {
+                continue;
+            }
+            bool seen = false;
+            for (int i = 0; i < n_names && !seen; i++) {
+                seen = strlen(names[i]) == name_len && strncmp(names[i], de->d_name, name_len) == 0;
+            }
+            if (!seen) {
+                memcpy(names[n_names], de->d_name, name_len);
+                names[n_names][name_len] = 0;
+                n_names++;
+            }
+        }
+        closedir(dir);
+    }
+    fs_read_unlock();
+
+    int exported = 0;
+    for (int i = 0; i < n_names; i++) {
+        char path[FS_LOG_PATH_MAX];
+        snprintf(path, sizeof(path), MOUNT_POINT "/%s.log", names[i]);
+
+        /* Use the open handle if there is one, so staged records are included */
+        fs_log_t *log = NULL;
+        xSemaphoreTake(g_fs_logs_mutex, portMAX_DELAY);
+        for (int j = 0; j < FS_LOG_MAX_OPEN; j++) {
+            if (g_fs_logs[j] && strcmp(g_fs_logs[j]->name, names[i]) == 0) {
+                log = g_fs_logs[j];
+            }
+        }
+        xSemaphoreGive(g_fs_logs_mutex);
+
+        if (log) {
+            if (fs_log_export(log, path) >= 0) {
+                exported++;
+            }
+        } else if ((log = fs_log_open(names[i])) != NULL) {
+            if (fs_log_export(log, path) >= 0) {
+                exported++;
+            }
+            fs_log_close(log);
+        }
+    }
+
+    return exported;
+}
+
+/* ------------------------------------------------------------------------ */
+/* File I/O trace                                                           */
+/* ------------------------------------------------------------------------ */
+
+#if CONFIG_FS_PROFILE_TRACE
+
+/* Longest trace line: operation, path and two numbers; longer ones are dropped */
+#define FS_TRACE_LINE_MAX       160
+
+/* Operations recorded since the last export, as CSV lines */
+static char *g_fs_trace_buf = NULL;
+static size_t g_fs_trace_used = 0;
+static uint32_t g_fs_trace_ops = 0;
+static uint32_t g_fs_trace_dropped = 0;
+static SemaphoreHandle_t g_fs_trace_mutex = NULL;
+
+static const char *const g_fs_trace_names[] = {
+    [FS_TRACE_CREATE] = "create",
+    [FS_TRACE_WRITE] = "write",
+    [FS_TRACE_APPEND] = "append",
+    [FS_TRACE_TRUNCATE] = "truncate",
+    [FS_TRACE_DELETE] = "delete",
+};
+
+/**
+ * @brief Allocate the trace buffer, once
+ */
+static void fs_trace_init(void) {
+    if (g_fs_trace_mutex) {
+        return;
+    }
+    g_fs_trace_buf = malloc(CONFIG_FS_PROFILE_TRACE_BUFFER_KB * 1024);
+    g_fs_trace_mutex = xSemaphoreCreateMutex();
+    if (!g_fs_trace_buf || !g_fs_trace_mutex) {
+        free(g_fs_trace_buf);
+        g_fs_trace_buf = NULL;
+        if (g_fs_trace_mutex) {
+            vSemaphoreDelete(g_fs_trace_mutex);
+            g_fs_trace_mutex = NULL;
+        }
+        ESP_LOGW(TAG, "I/O trace: out of memory, not recording");
+    }
+}
+
+void fs_trace_record(fs_trace_op_t op, const char *path, uint32_t offset, uint32_t size) {
+    if (!g_fs_trace_mutex || !path || op > FS_TRACE_DELETE) {
+        return;
+    }
+    if (strncmp(path, MOUNT_POINT "/", sizeof(MOUNT_POINT)) == 0) {
+        path += sizeof(MOUNT_POINT) - 1;
+    }
+
+    char line[FS_TRACE_LINE_MAX];
+    int len;
+    switch (op) {
+    case FS_TRACE_WRITE:
+        len = snprintf(line, sizeof(line), "%s,%s,%lu,%lu\n", g_fs_trace_names[op], path,
+                       (unsigned long)offset, (unsigned long)size);
+        break;
+    case FS_TRACE_APPEND:
+    case FS_TRACE_TRUNCATE:
+        len = snprintf(line, sizeof(line), "%s,%s,%lu\n", g_fs_trace_names[op], path, (unsigned long)size);
+        break;
+    default:
+        len = snprintf(line, sizeof(line), "%s,%s\n", g_fs_trace_names[op], path);
+        break;
+    }
+
+    xSemaphoreTake(g_fs_trace_mutex, portMAX_DELAY);
+    if (len < 0 || len >= (int)sizeof(line) ||
+        g_fs_trace_used + len > CONFIG_FS_PROFILE_TRACE_BUFFER_KB * 1024) {
+        g_fs_trace_dropped++;
+    } else {
+        memcpy(g_fs_trace_buf + g_fs_trace_used, line, len);
+        g_fs_trace_used += len;
+        g_fs_trace_ops++;
+    }
+    xSemaphoreGive(g_fs_trace_mutex);
+}
+
+int fs_trace_export(const char *path) {
+    if (!g_fs_mounted || !path || !g_fs_trace_mutex) {
+        return -1;
+    }
+
+    /* Same order as the traced paths: volume lock, then trace */
+    fs_write_lock();
+    xSemaphoreTake(g_fs_trace_mutex, portMAX_DELAY);
+
+    if (g_fs_trace_ops == 0 && g_fs_trace_dropped == 0) {
+        xSemaphoreGive(g_fs_trace_mutex);
+        fs_write_unlock();
+        return 0;
+    }
+
+    int total = -1;
+    FILE *out = fopen(path, "a");
+    if (out) {
+        bool ok = fprintf(out, "# %lu operations, %lu dropped\n",
+                          (unsigned long)g_fs_trace_ops, (unsigned long)g_fs_trace_dropped) > 0 &&
+                  fwrite(g_fs_trace_buf, 1, g_fs_trace_used, out) == g_fs_trace_used;
+        ok = (fclose(out) == 0) && ok;
+        if (ok) {
+            total = (int)g_fs_trace_ops;
+            g_fs_trace_used = 0;
+            g_fs_trace_ops = 0;
+            g_fs_trace_dropped = 0;
+        }
+    }
+
+    xSemaphoreGive(g_fs_trace_mutex);
+    fs_write_unlock();
+
+    if (total < 0) {
+        ESP_LOGE(TAG, "I/O trace: export to %s failed", path);
+    } else {
+        ESP_LOGI(TAG, "I/O trace: exported %d operations to %s", total, path);
+    }
+    return total;
+}
+
+#else
+
+static void fs_trace_init(void) {
+}
+
+void fs_trace_record(fs_trace_op_t op, const char *path, uint32_t offset, uint32_t size) {
+    (void)op;
+    (void)path;
+    (void)offset;
+    (void)size;
+}
+
+int fs_trace_export(const char *path) {
+    (void)path;
+    return -1;
+}
+
+#endif /* CONFIG_FS_PROFILE_TRACE */
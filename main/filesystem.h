@@ -18,6 +18,7 @@
  * - Filesystem statistics (total/free space)
  * - File existence checking
  * - Mount/unmount/remount operations
+ * - Exclusive hand-over of the volume to the USB MSC storage
  *
  * @section usage Usage
  * @code
@@ -50,14 +51,93 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+#include "wear_levelling.h"
 
 /** @defgroup filesystem_config Filesystem Configuration
  * @{
  */
 /** @brief Mount point for internal FATFS volume */
 #define MOUNT_POINT "/storage"
+/** @brief Maximum length of a record log name */
+#define FS_LOG_NAME_MAX 16
+/** @brief Maximum payload of a single log record in bytes */
+#define FS_LOG_RECORD_MAX 1024
+/** @brief Maximum number of simultaneously open record logs */
+#define FS_LOG_MAX_OPEN 4
+/** @brief File the I/O trace is exported to (CONFIG_FS_PROFILE_TRACE) */
+#define FS_TRACE_FILE MOUNT_POINT "/fstrace.csv"
 /** @} */
 
+/**
+ * @brief Internal volume profile
+ *
+ * Single source of the mount and format parameters of the internal
+ * volume, taken from the "Internal Storage Volume" Kconfig menu. Every
+ * component that mounts or formats the storage partition (filesystem,
+ * USB MSC) must use this profile rather than its own constants.
+ */
+typedef struct {
+    int max_files;                  /**< Maximum simultaneously open files */
+    size_t allocation_unit_size;    /**< Cluster size in bytes */
+    uint8_t fmt;                    /**< FatFs FM_* format type (FM_ANY, FM_FAT, FM_FAT32) */
+    uint8_t n_fats;                 /**< Number of FAT copies (1 or 2) */
+    uint16_t root_entries;          /**< Root directory entries (FAT12/16), rounded up to whole sectors at format */
+    uint32_t align_sectors;         /**< FAT/data area alignment in sectors */
+} fs_volume_profile_t;
+
+/**
+ * @brief Handle of an open record log
+ *
+ * Small records appended to a log are packed into large segment files
+ * under MOUNT_POINT "/records" instead of taking one file (and one
+ * cluster) each. Use fs_log_export() to turn a log into an ordinary
+ * file readable over USB MSC.
+ */
+typedef struct fs_log fs_log_t;
+
+/**
+ * @brief File operation of the I/O trace
+ *
+ * One line of the trace read by tools/fs_profile/replay_trace.py.
+ */
+typedef enum {
+    FS_TRACE_CREATE,    /**< File created empty */
+    FS_TRACE_WRITE,     /**< Bytes written at an offset */
+    FS_TRACE_APPEND,    /**< Bytes written at the end of the file */
+    FS_TRACE_TRUNCATE,  /**< File cut or extended to a size */
+    FS_TRACE_DELETE,    /**< File deleted */
+} fs_trace_op_t;
+
+/**
+ * @brief Filesystem lock contention counters
+ *
+ * Read locks are shared (fs_exists(), fs_get_stats()); write locks are
+ * exclusive (file creation/modification, mount state changes). An
+ * acquisition is counted as contended when it had to block.
+ */
+typedef struct {
+    uint32_t read_locks;         /**< Shared lock acquisitions */
+    uint32_t read_contended;     /**< Shared acquisitions that blocked */
+    uint64_t read_wait_us;       /**< Total time readers spent blocked */
+    uint32_t read_wait_max_us;   /**< Longest single reader wait */
+    uint32_t write_locks;        /**< Exclusive lock acquisitions */
+    uint32_t write_contended;    /**< Exclusive acquisitions that blocked */
+    uint64_t write_wait_us;      /**< Total time writers spent blocked */
+    uint32_t write_wait_max_us;  /**< Longest single writer wait */
+} fs_lock_stats_t;
+
+/**
+ * @brief Extended filesystem statistics
+ */
+typedef struct {
+    bool mounted;             /**< Volume currently mounted */
+    uint64_t total_bytes;     /**< Volume capacity (0 if not mounted) */
+    uint64_t free_bytes;      /**< Free space (0 if not mounted) */
+    uint32_t free_cache_hits; /**< Mounts seeded from the persisted free-space count since boot */
+    fs_lock_stats_t lock;     /**< Lock contention counters since boot */
+} fs_stats_t;
+
 /**
  * @brief Initialize Internal FATFS Volume
  *
@@ -83,6 +163,13 @@
  */
 bool fs_init_internal(void);
 
+/**
+ * @brief Get Internal Volume Profile
+ *
+ * @return Pointer to the active volume profile (never NULL)
+ */
+const fs_volume_profile_t *fs_get_volume_profile(void);
+
 /**
  * @brief Check if File Exists
  *
@@ -131,6 +218,43 @@ bool fs_write_test_file(void);
  */
 bool fs_get_stats(uint64_t *total_bytes, uint64_t *free_bytes);
 
+/**
+ * @brief Get Extended Filesystem Statistics
+ *
+ * Returns capacity and free space together with the lock contention
+ * counters. Lock counters are reported even if the volume is unmounted.
+ *
+ * @param[out] stats Pointer to receive the statistics
+ *
+ * @return true if successful, false otherwise
+ * @retval true Statistics retrieved
+ * @retval false NULL pointer or free-space query failed
+ *
+ * @note Thread-safe operation
+ * @see fs_get_stats()
+ */
+bool fs_get_stats_ex(fs_stats_t *stats);
+
+/**
+ * @brief Invalidate Cached Free-Space Information
+ *
+ * The free-cluster count is persisted in NVS on fs_unmount() and when the
+ * volume is released to the USB MSC storage, and restored on the next
+ * mount, so the first fs_get_stats() after the hand-over does not have to
+ * scan the whole FAT. Call this whenever the volume may have been modified
+ * without going through FatFs; fs_detach_volume() calls it before a USB
+ * host gets the volume. The next fs_get_stats() then rescans the FAT.
+ *
+ * The persisted record is marked untrusted as well, and no count is
+ * persisted until the next mount, so a host writing after the call (or
+ * while the filesystem is unmounted) cannot leave a stale count behind.
+ *
+ * @note Thread-safe operation
+ * @note Also valid while the filesystem is unmounted
+ * @see fs_get_stats()
+ */
+void fs_invalidate_free_cache(void);
+
 /**
  * @brief Unmount Filesystem
  *
@@ -161,4 +285,279 @@ bool fs_unmount(void);
  */
 bool fs_remount(void);
 
+/**
+ * @brief Check Volume Alignment
+ *
+ * Checks that the FAT data area starts on a boundary of the larger of the
+ * cluster size and the 4 KiB flash erase block, i.e. that no cluster
+ * straddles two wear-levelling sectors. Volumes formatted by this firmware
+ * are always aligned; older volumes may not be.
+ *
+ * @return true if aligned, false if misaligned or not mounted
+ *
+ * @note Thread-safe operation
+ * @see fs_realign_volume()
+ */
+bool fs_volume_is_aligned(void);
+
+/**
+ * @brief Re-align Volume (Online Migration)
+ *
+ * Copies every file and directory to RAM (PSRAM when available),
+ * reformats the partition with the aligned volume profile and restores
+ * the contents. Other filesystem calls block until the migration ends.
+ *
+ * The migration is refused before anything is touched when the used part
+ * of the volume doesn't fit in the free heap. If the reformat still fails
+ * after retries, the volume is left unmounted and its contents stay in
+ * RAM; calling fs_realign_volume() again retries the reformat and
+ * restores them.
+ *
+ * @return true if successful, false otherwise
+ * @retval false Not mounted, released, not enough RAM for the backup (volume left
+ *               unchanged), reformat failed (contents kept in RAM) or
+ *               restore failed
+ *
+ * @warning Power loss between reformat and restore loses the volume
+ *          contents. Refused once the volume is released to the USB MSC
+ *          storage, call it before usb_device_init().
+ * @note Thread-safe operation
+ * @see fs_volume_is_aligned()
+ */
+bool fs_realign_volume(void);
+
+/**
+ * @brief Get Volume Geometry
+ *
+ * Returns the size of the FAT volume as seen by a USB host: everything up
+ * to the end of the last cluster, which may be less than the partition.
+ *
+ * @param[out] sector_count Volume size in sectors
+ * @param[out] sector_size Sector size in bytes
+ *
+ * @return true if successful, false if not mounted or NULL pointers
+ *
+ * @note Thread-safe operation
+ * @see fs_grow_volume()
+ */
+bool fs_get_volume_info(uint32_t *sector_count, uint32_t *sector_size);
+
+/**
+ * @brief Get Wear Levelling Handle of the Volume
+ *
+ * The USB MSC storage is created on this handle. It stays valid across
+ * fs_grow_volume() and host sessions.
+ *
+ * @return Handle, WL_INVALID_HANDLE if the volume was not released with
+ *         fs_release_volume()
+ */
+wl_handle_t fs_get_wl_handle(void);
+
+/**
+ * @brief Release Volume to the USB MSC Storage
+ *
+ * Flushes the record store and the I/O trace, persists the free-space
+ * count and unmounts FatFs, keeping only wear levelling attached for
+ * fs_get_wl_handle(). From then on the MSC storage is the only owner of
+ * the FatFs mount: it mounts the volume at MOUNT_POINT while the
+ * application has it (fs_attach_volume()) and unmounts it while the USB
+ * host has it (fs_detach_volume()), so host and firmware never write the
+ * volume at the same time. Filesystem calls fail while detached.
+ *
+ * With the integrity or compression layers of the MSC storage enabled the
+ * sectors on flash aren't plain FAT; fs_init_internal() then leaves the
+ * volume released and it is first mounted by the storage.
+ *
+ * @return true if released (or already released), false otherwise
+ *
+ * @note Not undone: fs_unmount() and fs_remount() only unmount and
+ *       remount the storage's FatFs object afterwards, fs_realign_volume()
+ *       is refused
+ * @see fs_attach_volume()
+ */
+bool fs_release_volume(void);
+
+/**
+ * @brief Attach Volume Mounted by the USB MSC Storage
+ *
+ * Call when the storage has mounted the volume for the application
+ * (TINYUSB_MSC_EVENT_MOUNT_COMPLETE with TINYUSB_MSC_STORAGE_MOUNT_APP).
+ * The free-space cache is loaded and README.txt is created if missing.
+ *
+ * @param[in] pdrv FatFs drive of the mount, from tinyusb_msc_get_storage_drive()
+ *
+ * @return true if attached, false if the volume wasn't released or the drive is invalid
+ *
+ * @note Thread-safe operation
+ * @see fs_detach_volume()
+ */
+bool fs_attach_volume(uint8_t pdrv);
+
+/**
+ * @brief Detach Volume Before the USB Host Takes It
+ *
+ * Call before the storage unmounts the volume for the host
+ * (TINYUSB_MSC_EVENT_MOUNT_START while mounted to the application).
+ * Staged records and the I/O trace are written, then filesystem calls
+ * fail until fs_attach_volume(); the free-space cache is invalidated
+ * since the host may rewrite the FAT.
+ *
+ * @note Thread-safe operation
+ * @see fs_attach_volume()
+ */
+void fs_detach_volume(void);
+
+/**
+ * @brief Grow Volume Online
+ *
+ * Extends the FAT volume in place, without reformatting, by raising the
+ * sector count in the boot sector and remounting. The FAT tables are
+ * allocated for the whole partition at format time, so growth is limited
+ * only by the partition size and the cluster-count range of the volume's
+ * FAT type.
+ *
+ * @param[in] size_bytes New volume size in bytes, 0 to grow as far as possible
+ *
+ * @return true if successful (including when already at maximum size)
+ * @retval false Not mounted, size smaller than the current volume, a file
+ *               of the volume is open (the remount would invalidate its
+ *               handle), or I/O error
+ *
+ * @note Only FatFs is remounted, wear levelling and the MSC storage on it
+ *       stay in place
+ * @note Call usb_device_notify_capacity_changed() afterwards so a
+ *       connected USB host picks up the new size
+ * @see fs_get_volume_info()
+ */
+bool fs_grow_volume(uint64_t size_bytes);
+
+/**
+ * @brief Open Record Log
+ *
+ * Opens (or creates) an append-only record log. Appending resumes after
+ * the records written in previous sessions; a torn record left at the end
+ * of the newest segment by a power loss is discarded first.
+ *
+ * @param[in] name Log name, 1..FS_LOG_NAME_MAX characters, no path separators
+ *
+ * @return Log handle, or NULL on error
+ * @retval NULL Filesystem not mounted, invalid name, log already open,
+ *              too many open logs or out of memory
+ *
+ * @note Thread-safe operation
+ * @see fs_log_close()
+ */
+fs_log_t *fs_log_open(const char *name);
+
+/**
+ * @brief Append Record to Log
+ *
+ * Stages the record in a RAM buffer of one cluster (volume profile
+ * allocation unit). The buffer is written
+ * to the volume when full, on fs_log_flush(), on fs_log_export() and on
+ * fs_unmount(). Records still staged are lost on power failure.
+ *
+ * @param[in] log Log handle
+ * @param[in] data Record payload
+ * @param[in] len Payload length, 1..FS_LOG_RECORD_MAX bytes
+ *
+ * @return true if successful, false otherwise
+ *
+ * @note Thread-safe operation
+ * @see fs_log_flush()
+ */
+bool fs_log_append(fs_log_t *log, const void *data, size_t len);
+
+/**
+ * @brief Flush Staged Records
+ *
+ * @param[in] log Log handle
+ *
+ * @return true if successful, false otherwise
+ *
+ * @note Thread-safe operation
+ */
+bool fs_log_flush(fs_log_t *log);
+
+/**
+ * @brief Flush All Open Record Logs
+ *
+ * @note Thread-safe operation
+ */
+void fs_log_flush_all(void);
+
+/**
+ * @brief Export Record Log as Ordinary File
+ *
+ * Writes every record of the log, oldest first, to @p path with one
+ * record per line (a newline is appended to records not ending in one).
+ * The file is rewritten on each export.
+ *
+ * @param[in] log Log handle
+ * @param[in] path Destination file (e.g., "/storage/events.log")
+ *
+ * @return Number of records exported, or -1 on error
+ *
+ * @note Thread-safe operation
+ * @see fs_log_export_all()
+ */
+int fs_log_export(fs_log_t *log, const char *path);
+
+/**
+ * @brief Export All Record Logs
+ *
+ * Exports every log found on the volume to MOUNT_POINT "/<name>.log".
+ * Call before presenting the volume to a USB host.
+ *
+ * @return Number of logs exported, or -1 if not mounted
+ *
+ * @note Thread-safe operation, but logs must not be closed concurrently
+ */
+int fs_log_export_all(void);
+
+/**
+ * @brief Close Record Log
+ *
+ * Flushes staged records and frees the handle.
+ *
+ * @param[in] log Log handle (NULL is ignored)
+ */
+void fs_log_close(fs_log_t *log);
+
+/**
+ * @brief Record File Operation in the I/O Trace
+ *
+ * Records one operation for tools/fs_profile/replay_trace.py when
+ * CONFIG_FS_PROFILE_TRACE is enabled, otherwise does nothing. The record
+ * store and the files of this module are traced already; call it after
+ * the application's own writes to the volume. Operations recorded while
+ * the trace buffer is full are dropped and counted.
+ *
+ * @param[in] op Operation
+ * @param[in] path File path, MOUNT_POINT is stripped
+ * @param[in] offset Offset of FS_TRACE_WRITE, ignored otherwise
+ * @param[in] size Bytes written (FS_TRACE_WRITE, FS_TRACE_APPEND) or new
+ *                 size (FS_TRACE_TRUNCATE), ignored otherwise
+ *
+ * @note Thread-safe operation, not from ISR
+ */
+void fs_trace_record(fs_trace_op_t op, const char *path, uint32_t offset, uint32_t size);
+
+/**
+ * @brief Export I/O Trace
+ *
+ * Appends the operations recorded since the last export to @p path as CSV
+ * lines, after a comment line with the count of dropped operations, and
+ * clears them. Called with FS_TRACE_FILE on fs_unmount() and before the
+ * volume is presented to a USB host.
+ *
+ * @param[in] path Destination file (e.g., FS_TRACE_FILE)
+ *
+ * @return Number of operations exported, or -1 on error or when
+ *         CONFIG_FS_PROFILE_TRACE is disabled
+ *
+ * @note Thread-safe operation
+ */
+int fs_trace_export(const char *path);
+
 #endif /* FILESYSTEM_H */
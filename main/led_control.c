@@ -17,6 +17,9 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "binlog.h"
+#include "task_profile.h"
+#include "task_placement.h"
 
 static const char *TAG = "led";
 
@@ -40,29 +43,29 @@ static void led_blink_task(void *arg) {
             case LED_STATE_IDLE:
                 /* Slow blink: 500ms ON / 1500ms OFF */
                 gpio_set_level(PIN_LED_R, 1);
-                vTaskDelay(pdMS_TO_TICKS(LED_IDLE_ON_MS));
+                TASK_PROFILE_DELAY(pdMS_TO_TICKS(LED_IDLE_ON_MS));
                 gpio_set_level(PIN_LED_R, 0);
-                vTaskDelay(pdMS_TO_TICKS(LED_IDLE_OFF_MS));
+                TASK_PROFILE_DELAY(pdMS_TO_TICKS(LED_IDLE_OFF_MS));
                 break;
 
             case LED_STATE_BUSY:
                 /* Fast blink: 200ms ON / 200ms OFF */
                 gpio_set_level(PIN_LED_R, 1);
-                vTaskDelay(pdMS_TO_TICKS(LED_BUSY_ON_MS));
+                TASK_PROFILE_DELAY(pdMS_TO_TICKS(LED_BUSY_ON_MS));
                 gpio_set_level(PIN_LED_R, 0);
-                vTaskDelay(pdMS_TO_TICKS(LED_BUSY_OFF_MS));
+                TASK_PROFILE_DELAY(pdMS_TO_TICKS(LED_BUSY_OFF_MS));
                 break;
 
             case LED_STATE_ERROR:
                 /* Error: solid 3s, then slow blink */
                 gpio_set_level(PIN_LED_R, 1);
-                vTaskDelay(pdMS_TO_TICKS(LED_ERROR_SOLID_MS));
+                TASK_PROFILE_DELAY(pdMS_TO_TICKS(LED_ERROR_SOLID_MS));
                 gpio_set_level(PIN_LED_R, 0);
-                vTaskDelay(pdMS_TO_TICKS(LED_IDLE_OFF_MS));
+                TASK_PROFILE_DELAY(pdMS_TO_TICKS(LED_IDLE_OFF_MS));
                 break;
 
             default:
-                vTaskDelay(pdMS_TO_TICKS(100));
+                TASK_PROFILE_DELAY(pdMS_TO_TICKS(100));
                 break;
         }
     }
@@ -83,13 +86,13 @@ void led_init(void) {
     gpio_set_level(PIN_LED_R, 0);
 
     /* Create LED blink task */
-    xTaskCreate(led_blink_task, "led_blink", 2048, NULL, 5, &g_led_task_handle);
+    task_placement_create(led_blink_task, "led_blink", NULL, &g_led_task_handle);
     ESP_LOGI(TAG, "LED initialized");
 }
 
 void led_set_state(led_state_t state) {
     g_led_state = state;
-    ESP_LOGI(TAG, "LED state changed to %d", state);
+    BINLOG_I(TAG, "LED state changed to %d", state);
 }
 
 led_state_t led_get_state(void) {
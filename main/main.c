@@ -43,6 +43,10 @@
 #include "usb_device.h"
 #include "usb_host.h"
 #include "usb_mode.h"
+#include "task_profile.h"
+#if CONFIG_TRACE
+#include "trace.h"
+#endif
 
 static const char *TAG = "app";  /**< Log tag for application messages */
 
@@ -69,6 +73,19 @@ static const char *TAG = "app";  /**< Log tag for application messages */
 void app_main(void) {
     ESP_LOGI(TAG, "ESP32-S3 Dual USB FW boot");
 
+#if CONFIG_TRACE
+    /* Trace from boot on, so task start-up is recorded too */
+    if (trace_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Tracing not available");
+    }
+#endif
+
+#if CONFIG_TASK_PROFILE
+    if (!task_profile_init()) {
+        ESP_LOGW(TAG, "Task profiler not available");
+    }
+#endif
+
     /* Initialize LED */
     led_init();
     led_set_state(LED_STATE_IDLE);
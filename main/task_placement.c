@@ -0,0 +1,180 @@
+/**
+ * @file task_placement.c
+ * @brief Declarative Core Placement of Firmware Tasks Implementation
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * The placement table, task creation from it and the "placement" command.
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include "task_placement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#if CONFIG_USB_CDC_CHANNELS
+#include "usb_cdc.h"
+#endif
+
+#define TASK_PLACEMENT_LOAD_PERIOD_MS   10      /**< Busy and idle once per period */
+#define TASK_PLACEMENT_LOAD_MAX         90      /**< Highest load, leaves the idle task some time */
+
+static const char *TAG = "placement";  /**< Log tag for placement messages */
+
+/**
+ * @brief Every firmware task
+ *
+ * Stack sizes and priorities live here; "tasks" (task_profile.h) shows
+ * how much of each stack is used.
+ */
+static const task_placement_t g_table[] = {
+    /* USB and storage I/O */
+    { "TinyUSB",    TASK_GROUP_IO,           4096, 5 },
+    { "cdc_xfer",   TASK_GROUP_IO,           4096, 5 },
+    { "cdc_tx",     TASK_GROUP_IO,           3072, 6 },
+    /* Housekeeping */
+    { "cdc_ctl",    TASK_GROUP_HOUSEKEEPING, 4096, 5 },
+    { "io_monitor", TASK_GROUP_HOUSEKEEPING, 2048, 4 },
+    { "led_blink",  TASK_GROUP_HOUSEKEEPING, 2048, 5 },
+    { "usb_mode",   TASK_GROUP_HOUSEKEEPING, 2048, 3 },
+    { "usb_host",   TASK_GROUP_HOUSEKEEPING, 4096, 5 },
+    { "binlog",     TASK_GROUP_HOUSEKEEPING, 3072, 2 },
+    { "task_prof",  TASK_GROUP_HOUSEKEEPING, 3072, 1 },
+    { "hk_load",    TASK_GROUP_HOUSEKEEPING, 2048, 5 },
+};
+
+#define TASK_PLACEMENT_COUNT    (sizeof(g_table) / sizeof(g_table[0]))
+
+const task_placement_t *task_placement_find(const char *name) {
+    for (size_t i = 0; i < TASK_PLACEMENT_COUNT; i++) {
+        if (strcmp(g_table[i].name, name) == 0) {
+            return &g_table[i];
+        }
+    }
+    return NULL;
+}
+
+BaseType_t task_placement_core(task_group_t group) {
+#if CONFIG_TASK_PLACEMENT_SPLIT
+    return (group == TASK_GROUP_IO) ? CONFIG_TASK_PLACEMENT_IO_CORE : 1 - CONFIG_TASK_PLACEMENT_IO_CORE;
+#elif CONFIG_TASK_PLACEMENT_SHARED
+    (void)group;
+    return CONFIG_TASK_PLACEMENT_IO_CORE;
+#else
+    (void)group;
+    return tskNO_AFFINITY;
+#endif
+}
+
+const char *task_placement_mode(void) {
+#if CONFIG_TASK_PLACEMENT_SPLIT
+    return "split";
+#elif CONFIG_TASK_PLACEMENT_SHARED
+    return "shared";
+#else
+    return "floating";
+#endif
+}
+
+bool task_placement_create(TaskFunction_t fn, const char *name, void *arg, TaskHandle_t *handle) {
+    const task_placement_t *p = task_placement_find(name);
+    if (!p) {
+        ESP_LOGE(TAG, "Task %s is not in the placement table", name);
+        return false;
+    }
+    return xTaskCreatePinnedToCore(fn, name, p->stack_size, arg, p->priority, handle,
+                                   task_placement_core(p->group)) == pdPASS;
+}
+
+#if CONFIG_USB_CDC_CHANNELS
+
+static volatile uint32_t g_load_percent;   /**< Busy share of the load task */
+static TaskHandle_t g_load_task;            /**< Load task, created on first use */
+
+/** Busy for g_load_percent of every period, sleeps while the load is 0 */
+static void task_placement_load_task(void *arg) {
+    (void)arg;
+    for (;;) {
+        const uint32_t percent = g_load_percent;
+        if (percent == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        const int64_t until = esp_timer_get_time() + (int64_t)percent * TASK_PLACEMENT_LOAD_PERIOD_MS * 10;
+        while (esp_timer_get_time() < until) {
+        }
+        vTaskDelay(pdMS_TO_TICKS((100 - percent) * TASK_PLACEMENT_LOAD_PERIOD_MS / 100));
+    }
+}
+
+static void task_placement_print_core(char *buf, size_t len, BaseType_t core) {
+    if (core == tskNO_AFFINITY) {
+        strlcpy(buf, "any", len);
+    } else {
+        snprintf(buf, len, "%d", (int)core);
+    }
+}
+
+static int task_placement_cmd(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "load") == 0) {
+        const int percent = atoi(argv[2]);
+        if (percent < 0 || percent > TASK_PLACEMENT_LOAD_MAX) {
+            return 1;
+        }
+        if (!g_load_task && !task_placement_create(task_placement_load_task, "hk_load", NULL, &g_load_task)) {
+            g_load_task = NULL;
+            return 2;
+        }
+        g_load_percent = (uint32_t)percent;
+        xTaskNotifyGive(g_load_task);
+        return 0;
+    }
+    if (argc != 1) {
+        return 1;
+    }
+
+    char io[4];
+    char hk[4];
+    task_placement_print_core(io, sizeof(io), task_placement_core(TASK_GROUP_IO));
+    task_placement_print_core(hk, sizeof(hk), task_placement_core(TASK_GROUP_HOUSEKEEPING));
+    usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "placement %s, I/O on core %s, housekeeping on core %s, load %u%%\n",
+                   task_placement_mode(), io, hk, (unsigned)g_load_percent);
+    for (size_t i = 0; i < TASK_PLACEMENT_COUNT; i++) {
+        const task_placement_t *p = &g_table[i];
+        const TaskHandle_t task = xTaskGetHandle(p->name);
+        /* Affinity of the running task, "-" if it isn't running */
+        char want[4];
+        char now[4] = "-";
+        task_placement_print_core(want, sizeof(want), task_placement_core(p->group));
+        if (task) {
+            task_placement_print_core(now, sizeof(now), xTaskGetCoreID(task));
+        }
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%-12s %-12s core %-3s pinned %-3s stack %5u prio %u\n", p->name,
+                       (p->group == TASK_GROUP_IO) ? "io" : "housekeeping", want, now, (unsigned)p->stack_size,
+                       (unsigned)p->priority);
+    }
+    return 0;
+}
+
+bool task_placement_init(void) {
+    ESP_LOGI(TAG, "Task placement: %s", task_placement_mode());
+    return usb_cdc_register_command("placement", "placement [load <0-90>]: task cores, or busy housekeeping load",
+                                    task_placement_cmd);
+}
+
+#else /* !CONFIG_USB_CDC_CHANNELS */
+
+bool task_placement_init(void) {
+    ESP_LOGI(TAG, "Task placement: %s", task_placement_mode());
+    return false;
+}
+
+#endif /* CONFIG_USB_CDC_CHANNELS */
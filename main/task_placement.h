@@ -0,0 +1,108 @@
+/**
+ * @file task_placement.h
+ * @brief Declarative Core Placement of Firmware Tasks
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * One table in task_placement.c lists every firmware task with its group,
+ * stack size and priority, and the tasks are created from it. The groups:
+ * - I/O: the TinyUSB task (which runs the MSC callbacks, the deferred
+ *   flash writes and, since the stack is started from it, the USB
+ *   interrupt), the CDC file transfer task and the CDC TX scheduler
+ * - Housekeeping: LED, mode control, USB host polling, I/O monitor,
+ *   command handling, binary log shipping and the task profiler
+ *
+ * The placement is chosen in menuconfig (Task Placement):
+ * - Split: the I/O group pinned to CONFIG_TASK_PLACEMENT_IO_CORE and
+ *   housekeeping to the other core
+ * - Shared: both groups pinned to the I/O core, the comparison point for
+ *   benchmarks
+ * - Floating: nothing pinned, the scheduler picks a core (the TinyUSB task
+ *   keeps its default core, esp_tinyusb needs one)
+ *
+ * The "placement" control command shows the table with the affinity each
+ * running task actually has, and "placement load <percent>" runs a busy
+ * housekeeping task to see how a placement holds up when housekeeping is
+ * heavy; tools/placement_bench/msc_bench.py measures MSC throughput and
+ * latency jitter against it.
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#ifndef TASK_PLACEMENT_H
+#define TASK_PLACEMENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Task groups
+ */
+typedef enum {
+    TASK_GROUP_IO = 0,              /**< USB and storage I/O */
+    TASK_GROUP_HOUSEKEEPING,        /**< Everything else */
+} task_group_t;
+
+/**
+ * @brief Placement of one task
+ */
+typedef struct {
+    const char *name;               /**< Task name, the key of the table */
+    task_group_t group;             /**< Group, decides the core */
+    uint32_t stack_size;            /**< Stack size in bytes */
+    UBaseType_t priority;           /**< Priority */
+} task_placement_t;
+
+/**
+ * @brief Register the "placement" Command
+ *
+ * @return true if successful, false otherwise
+ * @retval false CDC channels not enabled, or the command table is full
+ */
+bool task_placement_init(void);
+
+/**
+ * @brief Look up a Task
+ *
+ * @param[in] name Task name
+ *
+ * @return Placement, NULL if the task isn't in the table
+ */
+const task_placement_t *task_placement_find(const char *name);
+
+/**
+ * @brief Core of a Group
+ *
+ * @param[in] group Task group
+ *
+ * @return Core number, tskNO_AFFINITY with the floating placement
+ */
+BaseType_t task_placement_core(task_group_t group);
+
+/**
+ * @brief Name of the Configured Placement
+ *
+ * @return "split", "shared" or "floating"
+ */
+const char *task_placement_mode(void);
+
+/**
+ * @brief Create a Task from the Table
+ *
+ * @param[in] fn Task function
+ * @param[in] name Task name, must be in the table
+ * @param[in] arg Task argument
+ * @param[out] handle Task handle, may be NULL
+ *
+ * @return true if successful, false otherwise
+ * @retval false Task not in the table, or out of memory
+ */
+bool task_placement_create(TaskFunction_t fn, const char *name, void *arg, TaskHandle_t *handle);
+
+#endif /* TASK_PLACEMENT_H */
@@ -0,0 +1,413 @@
+/**
+ * @file task_profile.c
+ * @brief CPU and Stack Budget Profiler Implementation
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Sampler task, wait bookkeeping and the "tasks" command of task_profile.h.
+ *
+ * @section implementation Implementation Details
+ * - CPU share comes from uxTaskGetSystemState(): the run-time counter
+ *   difference of a task over the esp_timer time of the window. A task's
+ *   counter starts at 0 when it is created, so a task first seen mid-run
+ *   is measured from its creation
+ * - The stack size isn't in TaskStatus_t; it is the distance from the
+ *   stack base to the end of stack of the task snapshot (so it needs
+ *   CONFIG_FREERTOS_ENABLE_TASK_SNAPSHOT, on by default). Sizes that
+ *   aren't a multiple of 16 come out rounded up
+ * - Wait bookkeeping runs in the calling task under a spinlock, with a
+ *   linear search of the small task and semaphore tables; a take that
+ *   succeeds at once costs one lookup and no time stamps
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include "task_profile.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+
+#ifdef CONFIG_TASK_PROFILE_STACK_MARGIN
+#define TASK_PROFILE_MARGIN     CONFIG_TASK_PROFILE_STACK_MARGIN
+#else
+#define TASK_PROFILE_MARGIN     25
+#endif
+
+uint32_t task_profile_recommend_stack(uint32_t stack_size, uint32_t min_free) {
+    const uint32_t used = (min_free < stack_size) ? stack_size - min_free : 0;
+    uint32_t size = (uint32_t)(((uint64_t)used * (100 + TASK_PROFILE_MARGIN) + 99) / 100);
+    if (size < configMINIMAL_STACK_SIZE) {
+        size = configMINIMAL_STACK_SIZE;
+    }
+    return (size + TASK_PROFILE_STACK_ALIGN - 1) / TASK_PROFILE_STACK_ALIGN * TASK_PROFILE_STACK_ALIGN;
+}
+
+#if CONFIG_TASK_PROFILE
+
+#include "esp_timer.h"
+#include "task_placement.h"
+#if CONFIG_FREERTOS_ENABLE_TASK_SNAPSHOT
+#include "esp_private/freertos_debug.h"
+#endif
+#if CONFIG_USB_CDC_CHANNELS
+#include "usb_cdc.h"
+#endif
+
+static const char *TAG = "task_profile";   /**< Log tag for profiler messages */
+
+/**
+ * @brief Sampler state of one task
+ */
+typedef struct {
+    task_profile_task_t prof;                       /**< Published profile */
+    configRUN_TIME_COUNTER_TYPE last_runtime;       /**< Run-time counter at the last sample */
+    uint32_t wakeups;                               /**< Wake-ups since the last sample */
+    bool seen;                                      /**< In the current sample */
+} task_profile_slot_t;
+
+/** @defgroup task_profile_state Profiler State
+ * @{
+ */
+static task_profile_slot_t g_tasks[TASK_PROFILE_MAX_TASKS];    /**< Task slots, g_task_count used */
+static size_t g_task_count;
+static task_profile_sem_t g_sems[TASK_PROFILE_MAX_SEMS];       /**< Semaphore slots, g_sem_count used */
+static size_t g_sem_count;
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;     /**< Guards both tables */
+static TaskHandle_t g_sampler;                                  /**< Sampler task */
+static TaskStatus_t g_status[TASK_PROFILE_MAX_TASKS];          /**< uxTaskGetSystemState() output, sampler only */
+static configRUN_TIME_COUNTER_TYPE g_last_total;                /**< Total run time at the last sample */
+/** @} */
+
+/** Slot of a task, added if add is set and there is room; call with g_lock held */
+static task_profile_slot_t *task_profile_task_slot(TaskHandle_t task, bool add) {
+    for (size_t i = 0; i < g_task_count; i++) {
+        if (g_tasks[i].prof.handle == task) {
+            return &g_tasks[i];
+        }
+    }
+    if (!add || g_task_count == TASK_PROFILE_MAX_TASKS) {
+        return NULL;
+    }
+    task_profile_slot_t *slot = &g_tasks[g_task_count++];
+    memset(slot, 0, sizeof(*slot));
+    slot->prof.handle = task;
+    slot->prof.core = tskNO_AFFINITY;
+    return slot;
+}
+
+/** Slot of a semaphore, added if there is room; call with g_lock held */
+static task_profile_sem_t *task_profile_sem_slot(SemaphoreHandle_t sem) {
+    for (size_t i = 0; i < g_sem_count; i++) {
+        if (g_sems[i].handle == sem) {
+            return &g_sems[i];
+        }
+    }
+    if (g_sem_count == TASK_PROFILE_MAX_SEMS) {
+        return NULL;
+    }
+    task_profile_sem_t *slot = &g_sems[g_sem_count++];
+    memset(slot, 0, sizeof(*slot));
+    slot->handle = sem;
+    return slot;
+}
+
+static void task_profile_count(SemaphoreHandle_t sem, bool waited, uint32_t us, bool got) {
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    taskENTER_CRITICAL(&g_lock);
+    task_profile_sem_t *s = task_profile_sem_slot(sem);
+    if (s) {
+        s->takes++;
+        s->timeouts += got ? 0 : 1;
+        if (waited) {
+            s->waits++;
+            s->blocked_us += us;
+            if (us > s->max_blocked_us) {
+                s->max_blocked_us = us;
+            }
+        }
+    }
+    if (waited) {
+        task_profile_slot_t *t = task_profile_task_slot(self, true);
+        if (t) {
+            t->wakeups++;
+        }
+    }
+    taskEXIT_CRITICAL(&g_lock);
+}
+
+BaseType_t task_profile_take(SemaphoreHandle_t sem, TickType_t ticks) {
+    if (xSemaphoreTake(sem, 0) == pdTRUE) {
+        task_profile_count(sem, false, 0, true);
+        return pdTRUE;
+    }
+    if (ticks == 0) {
+        task_profile_count(sem, false, 0, false);
+        return pdFALSE;
+    }
+
+    const int64_t start = esp_timer_get_time();
+    const BaseType_t got = xSemaphoreTake(sem, ticks);
+    task_profile_count(sem, true, (uint32_t)(esp_timer_get_time() - start), got == pdTRUE);
+    return got;
+}
+
+void task_profile_delay(TickType_t ticks) {
+    vTaskDelay(ticks);
+
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    taskENTER_CRITICAL(&g_lock);
+    task_profile_slot_t *t = task_profile_task_slot(self, true);
+    if (t) {
+        t->wakeups++;
+    }
+    taskEXIT_CRITICAL(&g_lock);
+}
+
+void task_profile_name(SemaphoreHandle_t sem, const char *name) {
+    taskENTER_CRITICAL(&g_lock);
+    task_profile_sem_t *s = task_profile_sem_slot(sem);
+    if (s) {
+        s->name = name;
+    }
+    taskEXIT_CRITICAL(&g_lock);
+}
+
+/** Stack size of a task in bytes, 0 if unknown */
+static uint32_t task_profile_stack_size(const TaskStatus_t *st) {
+#if CONFIG_FREERTOS_ENABLE_TASK_SNAPSHOT
+    TaskSnapshot_t snap;
+    if (vTaskGetSnapshot(st->xHandle, &snap) == pdTRUE && (uintptr_t)snap.pxEndOfStack > (uintptr_t)st->pxStackBase) {
+        /* pxEndOfStack is the last usable byte of the descending stack, aligned down */
+        const uint32_t size = (uint32_t)((uintptr_t)snap.pxEndOfStack - (uintptr_t)st->pxStackBase) + 1;
+        return (size + 15) & ~15u;
+    }
+#endif
+    return 0;
+}
+
+/** One sample: CPU shares of the window since the last one, stacks, wake-up rates */
+static void task_profile_sample(void) {
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    const UBaseType_t n = uxTaskGetSystemState(g_status, TASK_PROFILE_MAX_TASKS, &total);
+    if (n == 0) {
+        /* More tasks than TASK_PROFILE_MAX_TASKS, nothing is filled in */
+        ESP_LOGW(TAG, "%u tasks, only %d tracked", (unsigned)uxTaskGetNumberOfTasks(), TASK_PROFILE_MAX_TASKS);
+        return;
+    }
+    const configRUN_TIME_COUNTER_TYPE window = total - g_last_total;
+    g_last_total = total;
+    if (window == 0) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&g_lock);
+    for (size_t i = 0; i < g_task_count; i++) {
+        g_tasks[i].seen = false;
+    }
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *st = &g_status[i];
+        task_profile_slot_t *slot = task_profile_task_slot(st->xHandle, true);
+        if (!slot) {
+            continue;
+        }
+        task_profile_task_t *p = &slot->prof;
+
+        strlcpy(p->name, st->pcTaskName, sizeof(p->name));
+        p->priority = st->uxBasePriority;
+        p->core = st->xCoreID;
+
+        const uint64_t ran = (configRUN_TIME_COUNTER_TYPE)(st->ulRunTimeCounter - slot->last_runtime);
+        slot->last_runtime = st->ulRunTimeCounter;
+        uint64_t permille = ran * 1000 / window;
+        p->cpu_permille = (uint16_t)(permille > 1000 ? 1000 : permille);
+        if (p->cpu_permille > p->cpu_peak_permille) {
+            p->cpu_peak_permille = p->cpu_permille;
+        }
+
+        p->wakeups_per_s = (uint32_t)((uint64_t)slot->wakeups * 1000000 / window);
+        slot->wakeups = 0;
+
+        /* The stack doesn't change size, so read it once per task */
+        if (!p->stack_size) {
+            p->stack_size = task_profile_stack_size(st);
+        }
+        p->stack_min_free = st->usStackHighWaterMark;
+        p->stack_recommended = p->stack_size ? task_profile_recommend_stack(p->stack_size, p->stack_min_free) : 0;
+        slot->seen = true;
+    }
+
+    /* Forget deleted tasks, keeping the order of the others */
+    size_t kept = 0;
+    for (size_t i = 0; i < g_task_count; i++) {
+        if (g_tasks[i].seen) {
+            g_tasks[kept++] = g_tasks[i];
+        }
+    }
+    g_task_count = kept;
+    taskEXIT_CRITICAL(&g_lock);
+}
+
+static void task_profile_task(void *arg) {
+    (void)arg;
+    for (;;) {
+        task_profile_sample();
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_TASK_PROFILE_PERIOD_MS));
+    }
+}
+
+size_t task_profile_get_tasks(task_profile_task_t *out, size_t max) {
+    size_t n = 0;
+    taskENTER_CRITICAL(&g_lock);
+    for (size_t i = 0; i < g_task_count && n < max; i++) {
+        /* Tasks the sampler hasn't seen yet have no name */
+        if (g_tasks[i].prof.name[0]) {
+            out[n++] = g_tasks[i].prof;
+        }
+    }
+    taskEXIT_CRITICAL(&g_lock);
+    return n;
+}
+
+size_t task_profile_get_sems(task_profile_sem_t *out, size_t max) {
+    taskENTER_CRITICAL(&g_lock);
+    const size_t n = (g_sem_count < max) ? g_sem_count : max;
+    memcpy(out, g_sems, n * sizeof(*out));
+    taskEXIT_CRITICAL(&g_lock);
+    return n;
+}
+
+void task_profile_reset(void) {
+    taskENTER_CRITICAL(&g_lock);
+    for (size_t i = 0; i < g_task_count; i++) {
+        g_tasks[i].prof.cpu_peak_permille = g_tasks[i].prof.cpu_permille;
+    }
+    for (size_t i = 0; i < g_sem_count; i++) {
+        const SemaphoreHandle_t handle = g_sems[i].handle;
+        const char *name = g_sems[i].name;
+        memset(&g_sems[i], 0, sizeof(g_sems[i]));
+        g_sems[i].handle = handle;
+        g_sems[i].name = name;
+    }
+    taskEXIT_CRITICAL(&g_lock);
+}
+
+#if CONFIG_USB_CDC_CHANNELS
+static void task_profile_print_tasks(void) {
+    static task_profile_task_t tasks[TASK_PROFILE_MAX_TASKS];
+    const size_t n = task_profile_get_tasks(tasks, TASK_PROFILE_MAX_TASKS);
+
+    uint32_t allocated = 0;
+    uint32_t reclaimable = 0;
+    usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%-16s core prio   cpu%%  peak%%  stack   free    rec wake/s\n", "task");
+    for (size_t i = 0; i < n; i++) {
+        const task_profile_task_t *t = &tasks[i];
+        char core[4] = "-";
+        if (t->core != tskNO_AFFINITY) {
+            core[0] = (char)('0' + t->core);
+        }
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%-16s %4s %4u %4u.%u %4u.%u %6u %6u %6u %6u\n", t->name, core,
+                       (unsigned)t->priority, t->cpu_permille / 10, t->cpu_permille % 10, t->cpu_peak_permille / 10,
+                       t->cpu_peak_permille % 10, (unsigned)t->stack_size, (unsigned)t->stack_min_free,
+                       (unsigned)t->stack_recommended, (unsigned)t->wakeups_per_s);
+        allocated += t->stack_size;
+        if (t->stack_recommended < t->stack_size) {
+            reclaimable += t->stack_size - t->stack_recommended;
+        }
+    }
+    usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%u tasks, %u B of stacks, %u B reclaimable with %d%% headroom\n",
+                   (unsigned)n, (unsigned)allocated, (unsigned)reclaimable, TASK_PROFILE_MARGIN);
+}
+
+static void task_profile_print_sems(void) {
+    static task_profile_sem_t sems[TASK_PROFILE_MAX_SEMS];
+    const size_t n = task_profile_get_sems(sems, TASK_PROFILE_MAX_SEMS);
+
+    usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%-16s    takes    waits timeouts  blocked_us   max_us\n", "semaphore");
+    for (size_t i = 0; i < n; i++) {
+        const task_profile_sem_t *s = &sems[i];
+        char name[20];
+        if (s->name) {
+            strlcpy(name, s->name, sizeof(name));
+        } else {
+            snprintf(name, sizeof(name), "%p", (void *)s->handle);
+        }
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%-16s %8u %8u %8u %11llu %8u\n", name, (unsigned)s->takes,
+                       (unsigned)s->waits, (unsigned)s->timeouts, (unsigned long long)s->blocked_us,
+                       (unsigned)s->max_blocked_us);
+    }
+}
+
+static int task_profile_cmd(int argc, char **argv) {
+    if (argc == 1) {
+        task_profile_print_tasks();
+    } else if (argc == 2 && strcmp(argv[1], "sems") == 0) {
+        task_profile_print_sems();
+    } else if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        task_profile_reset();
+    } else {
+        return 1;
+    }
+    return 0;
+}
+#endif /* CONFIG_USB_CDC_CHANNELS */
+
+bool task_profile_init(void) {
+    if (g_sampler) {
+        ESP_LOGW(TAG, "Task profiler already started");
+        return false;
+    }
+
+    if (!task_placement_create(task_profile_task, "task_prof", NULL, &g_sampler)) {
+        ESP_LOGE(TAG, "Failed to create sampler task");
+        g_sampler = NULL;
+        return false;
+    }
+
+#if CONFIG_USB_CDC_CHANNELS
+    usb_cdc_register_command("tasks", "tasks [sems|reset]: CPU, stack and wait profile", task_profile_cmd);
+#endif
+    ESP_LOGI(TAG, "Task profiler sampling every %d ms", CONFIG_TASK_PROFILE_PERIOD_MS);
+    return true;
+}
+
+#else /* !CONFIG_TASK_PROFILE */
+
+bool task_profile_init(void) {
+    return false;
+}
+
+size_t task_profile_get_tasks(task_profile_task_t *out, size_t max) {
+    (void)out;
+    (void)max;
+    return 0;
+}
+
+size_t task_profile_get_sems(task_profile_sem_t *out, size_t max) {
+    (void)out;
+    (void)max;
+    return 0;
+}
+
+void task_profile_reset(void) {
+}
+
+BaseType_t task_profile_take(SemaphoreHandle_t sem, TickType_t ticks) {
+    return xSemaphoreTake(sem, ticks);
+}
+
+void task_profile_delay(TickType_t ticks) {
+    vTaskDelay(ticks);
+}
+
+void task_profile_name(SemaphoreHandle_t sem, const char *name) {
+    (void)sem;
+    (void)name;
+}
+
+#endif /* CONFIG_TASK_PROFILE */
@@ -0,0 +1,184 @@
+/**
+ * @file task_profile.h
+ * @brief CPU and Stack Budget Profiler for Firmware Tasks
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * A low-priority sampler task reads the FreeRTOS run-time counters every
+ * CONFIG_TASK_PROFILE_PERIOD_MS and keeps, per task:
+ * - CPU share of the last window and the highest window since boot (or
+ *   the last reset), in permille of one core
+ * - Stack size, smallest free stack seen (high-water mark) and a
+ *   recommended size: the used part plus CONFIG_TASK_PROFILE_STACK_MARGIN
+ *   percent, rounded up to 256 bytes
+ * - Wake-ups per second, counted when the task comes back from a
+ *   TASK_PROFILE_TAKE() that had to block or from TASK_PROFILE_DELAY()
+ *
+ * TASK_PROFILE_TAKE() also keeps, per semaphore, how often it was taken,
+ * how often the taker had to wait, for how long in total and at most,
+ * and how many waits timed out. TASK_PROFILE_NAME() gives a semaphore a
+ * name for the report.
+ *
+ * FreeRTOS only counts switches in the kernel, so wake-ups are the
+ * voluntary context switches of instrumented waits; preemptions by
+ * higher-priority tasks are not in them.
+ *
+ * High-water marks only cover code paths that have run, so run the
+ * heaviest workload (MSC writes, CDC transfers, host file copies) before
+ * applying a recommendation.
+ *
+ * Without CONFIG_TASK_PROFILE the macros are the plain FreeRTOS calls.
+ *
+ * @section usage Usage
+ * @code
+ * g_lock = xSemaphoreCreateMutex();
+ * TASK_PROFILE_NAME(g_lock, "state");
+ * ...
+ * if (TASK_PROFILE_TAKE(g_lock, pdMS_TO_TICKS(100))) {
+ * @endcode
+ * The "tasks" control command prints the table; "tasks sems" the
+ * semaphores and "tasks reset" clears peaks and semaphore counts.
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#ifndef TASK_PROFILE_H
+#define TASK_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/** @defgroup task_profile_config Task Profiler Configuration
+ * @{
+ */
+#define TASK_PROFILE_MAX_TASKS  32      /**< Most tasks tracked */
+#define TASK_PROFILE_MAX_SEMS   24      /**< Most semaphores tracked */
+#define TASK_PROFILE_STACK_ALIGN 256    /**< Recommended stack sizes are multiples of this */
+/** @} */
+
+/**
+ * @brief Profile of one task
+ */
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];     /**< Task name */
+    TaskHandle_t handle;                    /**< Task handle */
+    UBaseType_t priority;                   /**< Base priority */
+    BaseType_t core;                        /**< Pinned core, tskNO_AFFINITY if not pinned */
+    uint16_t cpu_permille;                  /**< CPU share of the last window, of one core */
+    uint16_t cpu_peak_permille;             /**< Highest window CPU share */
+    uint32_t stack_size;                    /**< Stack size in bytes, 0 if unknown */
+    uint32_t stack_min_free;                /**< Least free stack seen, bytes */
+    uint32_t stack_recommended;             /**< Recommended stack size, 0 if unknown */
+    uint32_t wakeups_per_s;                 /**< Wake-ups from blocking waits in the last window */
+} task_profile_task_t;
+
+/**
+ * @brief Wait statistics of one semaphore
+ */
+typedef struct {
+    SemaphoreHandle_t handle;               /**< Semaphore handle */
+    const char *name;                       /**< Name from TASK_PROFILE_NAME(), NULL if none */
+    uint32_t takes;                         /**< Takes attempted */
+    uint32_t waits;                         /**< Takes that had to block */
+    uint32_t timeouts;                      /**< Waits that ended without the semaphore */
+    uint64_t blocked_us;                    /**< Time blocked, total */
+    uint32_t max_blocked_us;                /**< Longest single wait */
+} task_profile_sem_t;
+
+/**
+ * @brief Start the Sampler Task
+ *
+ * Also registers the "tasks" control command when the CDC channels are
+ * enabled.
+ *
+ * @return true if successful, false otherwise
+ * @retval false Already started, out of memory, or CONFIG_TASK_PROFILE not enabled
+ */
+bool task_profile_init(void);
+
+/**
+ * @brief Get the Task Profiles
+ *
+ * @param[out] out Profiles, in the order tasks were first seen
+ * @param[in] max Entries in out
+ *
+ * @return Number of profiles copied
+ */
+size_t task_profile_get_tasks(task_profile_task_t *out, size_t max);
+
+/**
+ * @brief Get the Semaphore Wait Statistics
+ *
+ * @param[out] out Statistics, in the order semaphores were first taken or named
+ * @param[in] max Entries in out
+ *
+ * @return Number of entries copied
+ */
+size_t task_profile_get_sems(task_profile_sem_t *out, size_t max);
+
+/**
+ * @brief Clear CPU Peaks and Semaphore Counts
+ */
+void task_profile_reset(void);
+
+/**
+ * @brief Recommended Stack Size
+ *
+ * @param[in] stack_size Current stack size in bytes
+ * @param[in] min_free Least free stack seen, bytes
+ *
+ * @return Used bytes plus CONFIG_TASK_PROFILE_STACK_MARGIN percent, rounded
+ *         up to TASK_PROFILE_STACK_ALIGN and at least configMINIMAL_STACK_SIZE
+ */
+uint32_t task_profile_recommend_stack(uint32_t stack_size, uint32_t min_free);
+
+/**
+ * @brief Take a Semaphore and Record the Wait
+ *
+ * Same as xSemaphoreTake(); called by TASK_PROFILE_TAKE().
+ *
+ * @param[in] sem Semaphore or mutex
+ * @param[in] ticks Longest wait
+ *
+ * @return pdTRUE if taken, pdFALSE on timeout
+ */
+BaseType_t task_profile_take(SemaphoreHandle_t sem, TickType_t ticks);
+
+/**
+ * @brief Delay and Count the Wake-up
+ *
+ * Same as vTaskDelay(); called by TASK_PROFILE_DELAY().
+ *
+ * @param[in] ticks Ticks to wait
+ */
+void task_profile_delay(TickType_t ticks);
+
+/**
+ * @brief Name a Semaphore for the Report
+ *
+ * Called by TASK_PROFILE_NAME().
+ *
+ * @param[in] sem Semaphore or mutex
+ * @param[in] name Literal name, only the pointer is kept
+ */
+void task_profile_name(SemaphoreHandle_t sem, const char *name);
+
+#if CONFIG_TASK_PROFILE
+#define TASK_PROFILE_TAKE(sem, ticks) task_profile_take(sem, ticks)
+#define TASK_PROFILE_DELAY(ticks) task_profile_delay(ticks)
+#define TASK_PROFILE_NAME(sem, name) task_profile_name(sem, name)
+#else
+#define TASK_PROFILE_TAKE(sem, ticks) xSemaphoreTake(sem, ticks)
+#define TASK_PROFILE_DELAY(ticks) vTaskDelay(ticks)
+#define TASK_PROFILE_NAME(sem, name) do { } while (0)
+#endif
+
+#endif /* TASK_PROFILE_H */
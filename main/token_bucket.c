@@ -0,0 +1,64 @@
+/**
+ * @file token_bucket.c
+ * @brief Byte Rate Limiter Implementation
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include "token_bucket.h"
+
+#define TB_SCALE    1000000ULL  /**< Token units per byte */
+
+void token_bucket_init(token_bucket_t *tb, uint32_t rate, uint32_t burst, int64_t now_us) {
+    tb->rate = rate;
+    tb->burst = (burst > 0) ? burst : 1;
+    tb->tokens = (uint64_t)tb->burst * TB_SCALE;
+    tb->last_us = now_us;
+}
+
+size_t token_bucket_available(token_bucket_t *tb, int64_t now_us) {
+    if (tb->rate == 0) {
+        return SIZE_MAX;
+    }
+
+    const uint64_t full = (uint64_t)tb->burst * TB_SCALE;
+    if (now_us > tb->last_us) {
+        /* Bytes/s times microseconds is millionths of a byte; a full bucket stops accruing */
+        const uint64_t elapsed = (uint64_t)(now_us - tb->last_us);
+        const uint64_t missing = full - tb->tokens;
+        tb->tokens = (elapsed >= missing / tb->rate + 1) ? full : tb->tokens + elapsed * tb->rate;
+        if (tb->tokens > full) {
+            tb->tokens = full;
+        }
+    }
+    tb->last_us = now_us;
+    return (size_t)(tb->tokens / TB_SCALE);
+}
+
+void token_bucket_consume(token_bucket_t *tb, size_t bytes) {
+    if (tb->rate == 0) {
+        return;
+    }
+    const uint64_t used = (uint64_t)bytes * TB_SCALE;
+    tb->tokens = (used < tb->tokens) ? tb->tokens - used : 0;
+}
+
+uint32_t token_bucket_wait_us(const token_bucket_t *tb, size_t bytes) {
+    if (tb->rate == 0) {
+        return 0;
+    }
+    if (bytes > tb->burst) {
+        bytes = tb->burst;
+    }
+    const uint64_t need = (uint64_t)bytes * TB_SCALE;
+    if (tb->tokens >= need) {
+        return 0;
+    }
+    const uint64_t wait = (need - tb->tokens + tb->rate - 1) / tb->rate;
+    return (wait > UINT32_MAX) ? UINT32_MAX : (uint32_t)wait;
+}
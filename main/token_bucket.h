@@ -0,0 +1,91 @@
+/**
+ * @file token_bucket.h
+ * @brief Byte Rate Limiter
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Token bucket for limiting a byte stream to an average rate with bounded
+ * bursts. Tokens accrue at `rate` bytes per second up to `burst` bytes;
+ * sending n bytes takes n tokens. Time is passed in by the caller, so the
+ * bucket has no dependencies and can be tested off target.
+ *
+ * @section usage Usage
+ * @code
+ * token_bucket_t tb;
+ * token_bucket_init(&tb, 64 * 1024, 4096, esp_timer_get_time());
+ *
+ * size_t allowed = token_bucket_available(&tb, esp_timer_get_time());
+ * size_t sent = send(data, MIN(len, allowed));
+ * token_bucket_consume(&tb, sent);
+ * if (sent < len) {
+ *     wait_us(token_bucket_wait_us(&tb, len - sent));
+ * }
+ * @endcode
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Token bucket state
+ *
+ * Tokens are kept in millionths of a byte so any rate accrues exactly at
+ * microsecond resolution.
+ */
+typedef struct {
+    uint32_t rate;          /**< Bytes per second, 0 for no limit */
+    uint32_t burst;         /**< Bucket depth in bytes */
+    uint64_t tokens;        /**< Bytes available, in millionths */
+    int64_t last_us;        /**< Time of the last refill */
+} token_bucket_t;
+
+/**
+ * @brief Initialize a Token Bucket
+ *
+ * The bucket starts full.
+ *
+ * @param[out] tb Bucket
+ * @param[in] rate Average rate in bytes per second, 0 for no limit
+ * @param[in] burst Most bytes sent back to back, at least 1
+ * @param[in] now_us Current time in microseconds
+ */
+void token_bucket_init(token_bucket_t *tb, uint32_t rate, uint32_t burst, int64_t now_us);
+
+/**
+ * @brief Bytes That May Be Sent Now
+ *
+ * @param[inout] tb Bucket, refilled up to now_us
+ * @param[in] now_us Current time in microseconds, not earlier than the last call
+ *
+ * @return Whole bytes available, SIZE_MAX without a limit
+ */
+size_t token_bucket_available(token_bucket_t *tb, int64_t now_us);
+
+/**
+ * @brief Take Tokens for Sent Bytes
+ *
+ * @param[inout] tb Bucket
+ * @param[in] bytes Bytes sent, at most token_bucket_available()
+ */
+void token_bucket_consume(token_bucket_t *tb, size_t bytes);
+
+/**
+ * @brief Time Until Bytes Are Available
+ *
+ * @param[in] tb Bucket, as of the last token_bucket_available()
+ * @param[in] bytes Bytes wanted, capped at the burst size
+ *
+ * @return Microseconds to wait, 0 if available now
+ */
+uint32_t token_bucket_wait_us(const token_bucket_t *tb, size_t bytes);
+
+#endif /* TOKEN_BUCKET_H */
@@ -0,0 +1,114 @@
+/**
+ * @file trace_cmd.c
+ * @brief Trace Control over the CDC Control Channel Implementation
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include "trace_cmd.h"
+#include <string.h>
+#include "esp_log.h"
+
+#if CONFIG_TRACE && CONFIG_USB_CDC_CHANNELS
+
+#include "trace.h"
+#include "usb_cdc.h"
+#include "filesystem.h"
+#include "checksum.h"
+#include "freertos/FreeRTOS.h"
+
+#define TRACE_FRAME_HEADER      8       /**< Frame bytes before the payload */
+#define TRACE_SEND_TIMEOUT_MS   1000    /**< Wait for log channel queue space */
+
+static const char *TAG = "trace_cmd";  /**< Log tag for trace command messages */
+
+/**
+ * @brief Frame output state of "trace dump"
+ */
+typedef struct {
+    uint16_t seq;               /**< Next sequence number */
+    uint32_t bytes;             /**< Dump bytes sent */
+} trace_cmd_stream_t;
+
+static esp_err_t trace_cmd_send(const void *data, size_t len, void *ctx) {
+    trace_cmd_stream_t *stream = (trace_cmd_stream_t *)ctx;
+    static uint8_t frame[TRACE_FRAME_HEADER + 4 + TRACE_CHUNK_MAX + 4];
+
+    if (len > sizeof(frame) - TRACE_FRAME_HEADER - 4) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint16_t plen = (uint16_t)len;
+    frame[0] = 0xB1;
+    frame[1] = 'T';
+    frame[2] = 'R';
+    frame[3] = 0x01;
+    memcpy(frame + 4, &stream->seq, 2);
+    memcpy(frame + 6, &plen, 2);
+    memcpy(frame + TRACE_FRAME_HEADER, data, len);
+    const uint32_t crc = checksum_crc32(0, frame, TRACE_FRAME_HEADER + len);
+    memcpy(frame + TRACE_FRAME_HEADER + len, &crc, 4);
+
+    const size_t total = TRACE_FRAME_HEADER + len + 4;
+    if (usb_cdc_write(USB_CDC_CHANNEL_LOG, frame, total, TRACE_SEND_TIMEOUT_MS) != total) {
+        return ESP_ERR_TIMEOUT;
+    }
+    stream->seq++;
+    stream->bytes += len;
+    return ESP_OK;
+}
+
+static int trace_cmd(int argc, char **argv) {
+    if (argc < 2) {
+        return 1;
+    }
+
+    if (strcmp(argv[1], "start") == 0) {
+        trace_start();
+    } else if (strcmp(argv[1], "stop") == 0) {
+        trace_stop();
+    } else if (strcmp(argv[1], "stats") == 0) {
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            trace_stats_t s;
+            trace_get_stats(core, &s);
+            usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "core %d: %u events, %u dropped, %u/%u used\n", core,
+                           (unsigned)s.events, (unsigned)s.dropped, (unsigned)s.used, (unsigned)s.capacity);
+        }
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%s\n", trace_active ? "recording" : "stopped");
+    } else if (strcmp(argv[1], "save") == 0) {
+        const char *path = (argc > 2) ? argv[2] : MOUNT_POINT "/trace.bin";
+        if (trace_save(path) != ESP_OK) {
+            return 2;
+        }
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "saved to %s\n", path);
+    } else if (strcmp(argv[1], "dump") == 0) {
+        trace_cmd_stream_t stream = { 0 };
+        const esp_err_t err = trace_dump(trace_cmd_send, &stream);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Dump stopped after %u frames: %s", (unsigned)stream.seq, esp_err_to_name(err));
+            return 2;
+        }
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%u bytes in %u frames on the log channel\n",
+                       (unsigned)stream.bytes, (unsigned)stream.seq);
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+bool trace_cmd_init(void) {
+    return usb_cdc_register_command("trace", "trace start|stop|stats|save [path]|dump: span and counter trace",
+                                    trace_cmd);
+}
+
+#else /* !(CONFIG_TRACE && CONFIG_USB_CDC_CHANNELS) */
+
+bool trace_cmd_init(void) {
+    return false;
+}
+
+#endif /* CONFIG_TRACE && CONFIG_USB_CDC_CHANNELS */
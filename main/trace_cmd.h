@@ -0,0 +1,50 @@
+/**
+ * @file trace_cmd.h
+ * @brief Trace Control over the CDC Control Channel
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Registers the "trace" control command for the trace component:
+ * - trace start: discard recorded events and record again
+ * - trace stop: stop recording
+ * - trace stats: per-core ring use and drops
+ * - trace save [path]: write the dump to a file, by default
+ *   MOUNT_POINT "/trace.bin" on the FATFS volume
+ * - trace dump: send the dump over the CDC log channel
+ *
+ * Over the log channel the dump goes in frames, so it survives between
+ * other log output:
+ * | Offset | Size | Field                         |
+ * |--------|------|-------------------------------|
+ * | 0      | 4    | Magic 0xB1 'T' 'R' 0x01       |
+ * | 4      | 2    | Sequence number, from 0       |
+ * | 6      | 2    | Payload length                |
+ * | 8      | n    | Dump bytes                    |
+ * | 8+n    | 4    | CRC32 of bytes 0 to 8+n       |
+ *
+ * tools/trace/trace2json.py takes either the saved file or a capture of
+ * the log channel.
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#ifndef TRACE_CMD_H
+#define TRACE_CMD_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Register the "trace" Command
+ *
+ * @return true if successful, false otherwise
+ * @retval false Tracing or the CDC channels not enabled, or the command table is full
+ *
+ * @note Requires CONFIG_TRACE and CONFIG_USB_CDC_CHANNELS; call after usb_cdc_init()
+ */
+bool trace_cmd_init(void);
+
+#endif /* TRACE_CMD_H */
@@ -0,0 +1,619 @@
+/**
+ * @file usb_cdc.c
+ * @brief Control and Log Channels over USB CDC-ACM Implementation
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Channel queues, the prioritised TX scheduler, the command registry and
+ * the ESP_LOG redirection of usb_cdc.h.
+ *
+ * @section implementation Implementation Details
+ * - Each channel has a FreeRTOS message buffer; a message carries its
+ *   enqueue time for the latency statistics
+ * - The TX task takes one message per channel at a time and queues it to
+ *   the TinyUSB TX FIFO as space (and, for logs, tokens) allow. Control
+ *   messages are served first; log data is only queued while the control
+ *   channel has nothing waiting
+ * - The TX task sleeps until a writer notifies it, the log bucket has
+ *   tokens again, or (with a full TX FIFO) the next tick
+ * - Commands are read, split and run in a separate control task, so a
+ *   handler that writes a long reply never waits on itself
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include "usb_cdc.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "token_bucket.h"
+#include "task_profile.h"
+#include "task_placement.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "tinyusb.h"
+#include "tinyusb_cdc_acm.h"
+#include "tusb.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/message_buffer.h"
+
+/** @defgroup usb_cdc_commands Command Registry
+ * @{
+ */
+static int usb_cdc_cmd_help(int argc, char **argv);
+static int usb_cdc_cmd_stats(int argc, char **argv);
+
+/**
+ * @brief Registered command
+ */
+typedef struct {
+    const char *name;
+    const char *help;
+    usb_cdc_cmd_handler_t handler;
+} usb_cdc_cmd_t;
+
+static usb_cdc_cmd_t g_commands[USB_CDC_CMD_MAX] = {
+    { "help", "help: list commands", usb_cdc_cmd_help },
+    { "stats", "stats: channel queue and latency statistics", usb_cdc_cmd_stats },
+};
+static size_t g_command_count = 2;                              /**< Entries in g_commands */
+static portMUX_TYPE g_command_lock = portMUX_INITIALIZER_UNLOCKED;
+/** @} */
+
+bool usb_cdc_register_command(const char *name, const char *help, usb_cdc_cmd_handler_t handler) {
+    if (!name || !name[0] || strchr(name, ' ') || !handler) {
+        return false;
+    }
+
+    bool ok = false;
+    portENTER_CRITICAL(&g_command_lock);
+    bool taken = false;
+    for (size_t i = 0; i < g_command_count; i++) {
+        taken |= (strcmp(g_commands[i].name, name) == 0);
+    }
+    if (!taken && g_command_count < USB_CDC_CMD_MAX) {
+        g_commands[g_command_count] = (usb_cdc_cmd_t){ name, help, handler };
+        g_command_count++;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&g_command_lock);
+    return ok;
+}
+
+static int usb_cdc_cmd_help(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    for (size_t i = 0; i < g_command_count; i++) {
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "%s\n", g_commands[i].help ? g_commands[i].help : g_commands[i].name);
+    }
+    return 0;
+}
+
+static int usb_cdc_cmd_stats(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    static const char *const names[USB_CDC_CHANNEL_COUNT] = { "control", "log" };
+    for (int c = 0; c < USB_CDC_CHANNEL_COUNT; c++) {
+        usb_cdc_stats_t s;
+        usb_cdc_get_stats((usb_cdc_channel_t)c, &s);
+        usb_cdc_printf(USB_CDC_CHANNEL_CONTROL,
+                       "%s: queue %u B (max %u), %u msgs, %llu B, %u dropped, latency avg %u us max %u us\n",
+                       names[c], (unsigned)s.queue_bytes, (unsigned)s.queue_high_water, (unsigned)s.messages,
+                       (unsigned long long)s.bytes, (unsigned)s.dropped, (unsigned)s.latency_avg_us,
+                       (unsigned)s.latency_max_us);
+    }
+    return 0;
+}
+
+#if CONFIG_USB_CDC_CHANNELS
+
+#if CONFIG_TINYUSB_CDC_COUNT < 2
+#error "USB CDC channels need two CDC-ACM ports, set CONFIG_TINYUSB_CDC_COUNT to 2"
+#endif
+
+#define USB_CDC_MSG_MAX         256     /**< Largest message, longer writes are split */
+#define USB_CDC_PRINTF_MAX      256     /**< Longest usb_cdc_printf() output */
+#define USB_CDC_LOG_LINE_MAX    192     /**< Longest ESP_LOG line copied to the log channel */
+#define USB_CDC_REPLY_TIMEOUT_MS 100    /**< Wait for queue space for OK/ERR */
+#define USB_CDC_LOCK_WAIT_MS    10      /**< Least wait for another writer of the channel */
+#define USB_CDC_IDLE_POLL_MS    50      /**< TX FIFO retry interval while no terminal is open */
+
+static const char *TAG = "usb_cdc";    /**< Log tag for CDC channel messages */
+
+/**
+ * @brief Message header in the channel queue
+ */
+typedef struct {
+    int64_t enqueue_us;         /**< Time of usb_cdc_write() */
+} usb_cdc_msg_hdr_t;
+
+/**
+ * @brief Channel state
+ */
+typedef struct {
+    tinyusb_cdcacm_itf_t port;
+    size_t queue_size;
+    MessageBufferHandle_t queue;
+    SemaphoreHandle_t write_lock;               /**< Serializes writers, guards stage */
+    uint8_t stage[sizeof(usb_cdc_msg_hdr_t) + USB_CDC_MSG_MAX];    /**< Message being queued */
+
+    /* TX task only */
+    uint8_t msg[sizeof(usb_cdc_msg_hdr_t) + USB_CDC_MSG_MAX];      /**< Message being sent */
+    size_t msg_len;             /**< 0 if none */
+    size_t msg_off;
+
+    usb_cdc_stats_t stats;      /**< Guarded by g_stats_lock */
+    uint64_t latency_sum_us;
+} usb_cdc_chan_t;
+
+static usb_cdc_chan_t g_chan[USB_CDC_CHANNEL_COUNT] = {
+    [USB_CDC_CHANNEL_CONTROL] = { .port = TINYUSB_CDC_ACM_0, .queue_size = CONFIG_USB_CDC_CONTROL_QUEUE_SIZE },
+    [USB_CDC_CHANNEL_LOG] = { .port = TINYUSB_CDC_ACM_1, .queue_size = CONFIG_USB_CDC_LOG_QUEUE_SIZE },
+};
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static token_bucket_t g_log_bucket;             /**< Log channel rate limit, TX task only */
+static TaskHandle_t g_tx_task = NULL;           /**< TX scheduler task */
+static TaskHandle_t g_ctl_task = NULL;          /**< Control task */
+static bool g_started = false;
+#if CONFIG_USB_CDC_LOG_REDIRECT
+static vprintf_like_t g_log_prev = NULL;        /**< ESP_LOG output before the redirection */
+#endif
+
+/* ------------------------------------------------------------------------ */
+/* TX scheduler                                                             */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * @brief Queue a channel's messages to its TX FIFO
+ *
+ * @param[in] ch Channel
+ * @param[in] bucket Rate limit, NULL for none
+ * @param[in] now_us Current time
+ *
+ * @return Bytes of the current message still to send, 0 if the channel is idle
+ */
+static size_t usb_cdc_tx_channel(usb_cdc_chan_t *ch, token_bucket_t *bucket, int64_t now_us) {
+    while (true) {
+        if (ch->msg_len == 0) {
+            size_t n = xMessageBufferReceive(ch->queue, ch->msg, sizeof(ch->msg), 0);
+            if (n <= sizeof(usb_cdc_msg_hdr_t)) {
+                return 0;
+            }
+            ch->msg_len = n;
+            ch->msg_off = sizeof(usb_cdc_msg_hdr_t);
+        }
+
+        size_t left = ch->msg_len - ch->msg_off;
+        size_t allowed = left;
+        if (bucket) {
+            size_t tokens = token_bucket_available(bucket, now_us);
+            allowed = (tokens < left) ? tokens : left;
+        }
+        size_t n = (allowed > 0) ? tinyusb_cdcacm_write_queue(ch->port, ch->msg + ch->msg_off, allowed) : 0;
+        if (bucket) {
+            token_bucket_consume(bucket, n);
+        }
+        ch->msg_off += n;
+        if (ch->msg_off < ch->msg_len) {
+            /* TX FIFO full or out of tokens */
+            return ch->msg_len - ch->msg_off;
+        }
+
+        usb_cdc_msg_hdr_t hdr;
+        memcpy(&hdr, ch->msg, sizeof(hdr));
+        const size_t payload = ch->msg_len - sizeof(hdr);
+        const uint32_t latency = (uint32_t)(esp_timer_get_time() - hdr.enqueue_us);
+        ch->msg_len = 0;
+
+        portENTER_CRITICAL(&g_stats_lock);
+        ch->stats.queue_bytes -= payload;
+        ch->stats.messages++;
+        ch->stats.bytes += payload;
+        ch->latency_sum_us += latency;
+        if (latency > ch->stats.latency_max_us) {
+            ch->stats.latency_max_us = latency;
+        }
+        portEXIT_CRITICAL(&g_stats_lock);
+    }
+}
+
+/**
+ * @brief Wait Before Retrying a Full TX FIFO
+ *
+ * Without a terminal on the port the FIFO doesn't drain; poll it slowly.
+ */
+static TickType_t usb_cdc_fifo_wait(const usb_cdc_chan_t *ch) {
+    return tud_cdc_n_connected(ch->port) ? 1 : pdMS_TO_TICKS(USB_CDC_IDLE_POLL_MS);
+}
+
+/**
+ * @brief TX Scheduler Task
+ *
+ * Strict priority for the control channel, token bucket for the log
+ * channel.
+ */
+static void usb_cdc_tx_task(void *arg) {
+    (void)arg;
+    usb_cdc_chan_t *ctl = &g_chan[USB_CDC_CHANNEL_CONTROL];
+    usb_cdc_chan_t *log = &g_chan[USB_CDC_CHANNEL_LOG];
+
+    while (true) {
+        const int64_t now_us = esp_timer_get_time();
+        TickType_t wait = portMAX_DELAY;
+
+        const size_t ctl_left = usb_cdc_tx_channel(ctl, NULL, now_us);
+        tinyusb_cdcacm_write_flush(ctl->port, 0);
+        if (ctl_left > 0) {
+            /* Control FIFO full: logs wait */
+            wait = usb_cdc_fifo_wait(ctl);
+        } else if (xMessageBufferIsEmpty(ctl->queue)) {
+            const size_t log_left = usb_cdc_tx_channel(log, &g_log_bucket, now_us);
+            tinyusb_cdcacm_write_flush(log->port, 0);
+            if (log_left > 0) {
+                const uint32_t wait_us = token_bucket_wait_us(&g_log_bucket, log_left);
+                if (wait_us == 0) {
+                    wait = usb_cdc_fifo_wait(log);
+                } else {
+                    wait = pdMS_TO_TICKS((wait_us + 999) / 1000);
+                    wait = (wait > 0) ? wait : 1;
+                }
+            }
+        } else {
+            /* A control message came in meanwhile */
+            wait = 0;
+        }
+
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Writers                                                                  */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * @brief Queue Data on a Channel
+ *
+ * @param[in] channel Channel
+ * @param[in] data Data to send
+ * @param[in] len Number of bytes
+ * @param[in] lock_wait Longest wait for another writer of the channel
+ * @param[in] wait Longest wait for queue space, per message
+ * @param[in] whole Queue all messages or none, without waiting for space
+ *
+ * @return Bytes queued
+ */
+static size_t usb_cdc_enqueue(usb_cdc_channel_t channel, const void *data, size_t len, TickType_t lock_wait,
+                              TickType_t wait, bool whole) {
+    if (!g_started || channel >= USB_CDC_CHANNEL_COUNT || !data) {
+        return 0;
+    }
+
+    usb_cdc_chan_t *ch = &g_chan[channel];
+    if (TASK_PROFILE_TAKE(ch->write_lock, lock_wait) != pdTRUE) {
+        portENTER_CRITICAL(&g_stats_lock);
+        ch->stats.dropped++;
+        portEXIT_CRITICAL(&g_stats_lock);
+        return 0;
+    }
+
+    if (whole) {
+        /* Only the TX task takes messages out: space found under the lock stays available */
+        const size_t msgs = (len + USB_CDC_MSG_MAX - 1) / USB_CDC_MSG_MAX;
+        const size_t need = len + msgs * (sizeof(usb_cdc_msg_hdr_t) + sizeof(size_t));
+        if (xMessageBufferSpacesAvailable(ch->queue) < need) {
+            xSemaphoreGive(ch->write_lock);
+            portENTER_CRITICAL(&g_stats_lock);
+            ch->stats.dropped++;
+            portEXIT_CRITICAL(&g_stats_lock);
+            return 0;
+        }
+        wait = 0;
+    }
+
+    const uint8_t *p = (const uint8_t *)data;
+    size_t done = 0;
+    while (done < len) {
+        const size_t n = (len - done < USB_CDC_MSG_MAX) ? len - done : USB_CDC_MSG_MAX;
+        const usb_cdc_msg_hdr_t hdr = { .enqueue_us = esp_timer_get_time() };
+        memcpy(ch->stage, &hdr, sizeof(hdr));
+        memcpy(ch->stage + sizeof(hdr), p + done, n);
+
+        /* Counted before the send: the TX task may take the message and subtract it first */
+        portENTER_CRITICAL(&g_stats_lock);
+        ch->stats.queue_bytes += n;
+        portEXIT_CRITICAL(&g_stats_lock);
+        const bool queued = xMessageBufferSend(ch->queue, ch->stage, sizeof(hdr) + n, wait) > 0;
+
+        portENTER_CRITICAL(&g_stats_lock);
+        if (queued) {
+            if (ch->stats.queue_bytes > ch->stats.queue_high_water) {
+                ch->stats.queue_high_water = ch->stats.queue_bytes;
+            }
+        } else {
+            ch->stats.queue_bytes -= n;
+            ch->stats.dropped++;
+        }
+        portEXIT_CRITICAL(&g_stats_lock);
+        if (!queued) {
+            break;
+        }
+        done += n;
+    }
+    xSemaphoreGive(ch->write_lock);
+
+    if (done > 0) {
+        xTaskNotifyGive(g_tx_task);
+    }
+    return done;
+}
+
+size_t usb_cdc_write(usb_cdc_channel_t channel, const void *data, size_t len, uint32_t timeout_ms) {
+    const TickType_t wait = pdMS_TO_TICKS(timeout_ms);
+    /* Writers hold the lock for a copy unless they wait for space themselves, so even timeout 0 waits for them */
+    const TickType_t lock_wait = pdMS_TO_TICKS(USB_CDC_LOCK_WAIT_MS);
+    return usb_cdc_enqueue(channel, data, len, (wait > lock_wait) ? wait : lock_wait, wait, false);
+}
+
+bool usb_cdc_write_whole(usb_cdc_channel_t channel, const void *data, size_t len) {
+    return len > 0 && usb_cdc_enqueue(channel, data, len, pdMS_TO_TICKS(USB_CDC_LOCK_WAIT_MS), 0, true) == len;
+}
+
+size_t usb_cdc_printf(usb_cdc_channel_t channel, const char *fmt, ...) {
+    char buf[USB_CDC_PRINTF_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n <= 0) {
+        return 0;
+    }
+    return usb_cdc_write(channel, buf, ((size_t)n < sizeof(buf)) ? (size_t)n : sizeof(buf) - 1, 0);
+}
+
+#if CONFIG_USB_CDC_LOG_REDIRECT
+/**
+ * @brief ESP_LOG Output Hook
+ *
+ * Copies each log line to the log channel without waiting, not even for
+ * another writer of the channel: the line is dropped instead. Passes it on
+ * to the previous output (the console UART).
+ */
+static int usb_cdc_log_vprintf(const char *fmt, va_list args) {
+    char buf[USB_CDC_LOG_LINE_MAX];
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(buf, sizeof(buf), fmt, copy);
+    va_end(copy);
+    if (n > 0) {
+        usb_cdc_enqueue(USB_CDC_CHANNEL_LOG, buf, ((size_t)n < sizeof(buf)) ? (size_t)n : sizeof(buf) - 1, 0, 0, false);
+    }
+    return g_log_prev ? g_log_prev(fmt, args) : n;
+}
+#endif
+
+/* ------------------------------------------------------------------------ */
+/* Control channel                                                          */
+/* ------------------------------------------------------------------------ */
+
+static void usb_cdc_reply(const char *text) {
+    usb_cdc_write(USB_CDC_CHANNEL_CONTROL, text, strlen(text), USB_CDC_REPLY_TIMEOUT_MS);
+}
+
+/**
+ * @brief Split a command line and run its handler
+ */
+static void usb_cdc_execute(char *line) {
+    char *argv[USB_CDC_ARGS_MAX];
+    int argc = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(line, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        if (argc == USB_CDC_ARGS_MAX) {
+            usb_cdc_reply("ERR too many arguments\n");
+            return;
+        }
+        argv[argc++] = tok;
+    }
+    if (argc == 0) {
+        return;
+    }
+
+    usb_cdc_cmd_handler_t handler = NULL;
+    portENTER_CRITICAL(&g_command_lock);
+    for (size_t i = 0; i < g_command_count && !handler; i++) {
+        if (strcmp(g_commands[i].name, argv[0]) == 0) {
+            handler = g_commands[i].handler;
+        }
+    }
+    portEXIT_CRITICAL(&g_command_lock);
+
+    if (!handler) {
+        usb_cdc_reply("ERR unknown command\n");
+        return;
+    }
+    int ret = handler(argc, argv);
+    if (ret == 0) {
+        usb_cdc_reply("OK\n");
+    } else {
+        char reply[24];
+        snprintf(reply, sizeof(reply), "ERR %d\n", ret);
+        usb_cdc_reply(reply);
+    }
+}
+
+/**
+ * @brief Control Task
+ *
+ * Collects lines from the control port and runs them as commands.
+ */
+static void usb_cdc_ctl_task(void *arg) {
+    (void)arg;
+    char line[USB_CDC_LINE_MAX];
+    size_t len = 0;
+    bool overflow = false;
+    uint8_t buf[64];
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        size_t n = 0;
+        while (tinyusb_cdcacm_read(TINYUSB_CDC_ACM_0, buf, sizeof(buf), &n) == ESP_OK && n > 0) {
+            for (size_t i = 0; i < n; i++) {
+                const char c = (char)buf[i];
+                if (c == '\r' || c == '\n') {
+                    if (overflow) {
+                        usb_cdc_reply("ERR line too long\n");
+                    } else if (len > 0) {
+                        line[len] = '\0';
+                        usb_cdc_execute(line);
+                    }
+                    len = 0;
+                    overflow = false;
+                } else if (len < sizeof(line) - 1) {
+                    line[len++] = c;
+                } else {
+                    overflow = true;
+                }
+            }
+        }
+    }
+}
+
+static void usb_cdc_rx_cb(int itf, cdcacm_event_t *event) {
+    (void)itf;
+    (void)event;
+    if (g_ctl_task) {
+        xTaskNotifyGive(g_ctl_task);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Public API                                                               */
+/* ------------------------------------------------------------------------ */
+
+bool usb_cdc_init(void) {
+    if (g_started) {
+        ESP_LOGW(TAG, "Already started");
+        return false;
+    }
+
+    for (int c = 0; c < USB_CDC_CHANNEL_COUNT; c++) {
+        usb_cdc_chan_t *ch = &g_chan[c];
+        ch->queue = xMessageBufferCreate(ch->queue_size);
+        ch->write_lock = xSemaphoreCreateMutex();
+        if (!ch->queue || !ch->write_lock) {
+            ESP_LOGE(TAG, "Failed to allocate channel %d", c);
+            goto fail;
+        }
+        TASK_PROFILE_NAME(ch->write_lock, (c == USB_CDC_CHANNEL_CONTROL) ? "cdc_ctl_write" : "cdc_log_write");
+    }
+    token_bucket_init(&g_log_bucket, CONFIG_USB_CDC_LOG_RATE, CONFIG_USB_CDC_LOG_BURST, esp_timer_get_time());
+
+    if (!task_placement_create(usb_cdc_tx_task, "cdc_tx", NULL, &g_tx_task) ||
+        !task_placement_create(usb_cdc_ctl_task, "cdc_ctl", NULL, &g_ctl_task)) {
+        ESP_LOGE(TAG, "Failed to create tasks");
+        goto fail;
+    }
+
+    const tinyusb_config_cdcacm_t ctl_cfg = {
+        .cdc_port = TINYUSB_CDC_ACM_0,
+        .callback_rx = usb_cdc_rx_cb,
+    };
+    const tinyusb_config_cdcacm_t log_cfg = {
+        .cdc_port = TINYUSB_CDC_ACM_1,
+    };
+    esp_err_t ret = tinyusb_cdcacm_init(&ctl_cfg);
+    if (ret == ESP_OK) {
+        ret = tinyusb_cdcacm_init(&log_cfg);
+        if (ret != ESP_OK) {
+            tinyusb_cdcacm_deinit(TINYUSB_CDC_ACM_0);
+        }
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init CDC-ACM: %s", esp_err_to_name(ret));
+        goto fail;
+    }
+
+    g_started = true;
+#if CONFIG_USB_CDC_LOG_REDIRECT
+    g_log_prev = esp_log_set_vprintf(usb_cdc_log_vprintf);
+#endif
+    ESP_LOGI(TAG, "Control on CDC-ACM 0, log on CDC-ACM 1 (%d B/s)", CONFIG_USB_CDC_LOG_RATE);
+    return true;
+
+fail:
+    if (g_tx_task) {
+        vTaskDelete(g_tx_task);
+        g_tx_task = NULL;
+    }
+    if (g_ctl_task) {
+        vTaskDelete(g_ctl_task);
+        g_ctl_task = NULL;
+    }
+    for (int c = 0; c < USB_CDC_CHANNEL_COUNT; c++) {
+        usb_cdc_chan_t *ch = &g_chan[c];
+        if (ch->queue) {
+            vMessageBufferDelete(ch->queue);
+            ch->queue = NULL;
+        }
+        if (ch->write_lock) {
+            vSemaphoreDelete(ch->write_lock);
+            ch->write_lock = NULL;
+        }
+    }
+    return false;
+}
+
+bool usb_cdc_get_stats(usb_cdc_channel_t channel, usb_cdc_stats_t *stats) {
+    if (!g_started || channel >= USB_CDC_CHANNEL_COUNT || !stats) {
+        return false;
+    }
+
+    usb_cdc_chan_t *ch = &g_chan[channel];
+    portENTER_CRITICAL(&g_stats_lock);
+    *stats = ch->stats;
+    stats->latency_avg_us = ch->stats.messages ? (uint32_t)(ch->latency_sum_us / ch->stats.messages) : 0;
+    portEXIT_CRITICAL(&g_stats_lock);
+    return true;
+}
+
+#else /* !CONFIG_USB_CDC_CHANNELS */
+
+bool usb_cdc_init(void) {
+    return false;
+}
+
+size_t usb_cdc_write(usb_cdc_channel_t channel, const void *data, size_t len, uint32_t timeout_ms) {
+    (void)channel;
+    (void)data;
+    (void)len;
+    (void)timeout_ms;
+    return 0;
+}
+
+bool usb_cdc_write_whole(usb_cdc_channel_t channel, const void *data, size_t len) {
+    (void)channel;
+    (void)data;
+    (void)len;
+    return false;
+}
+
+size_t usb_cdc_printf(usb_cdc_channel_t channel, const char *fmt, ...) {
+    (void)channel;
+    (void)fmt;
+    return 0;
+}
+
+bool usb_cdc_get_stats(usb_cdc_channel_t channel, usb_cdc_stats_t *stats) {
+    (void)channel;
+    (void)stats;
+    return false;
+}
+
+#endif /* CONFIG_USB_CDC_CHANNELS */
@@ -0,0 +1,176 @@
+/**
+ * @file usb_cdc.h
+ * @brief Control and Log Channels over USB CDC-ACM
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Two CDC-ACM ports next to the MSC interface: a control channel for
+ * line-based commands and their replies, and a log channel carrying the
+ * ESP_LOG output. One TX scheduler task feeds both ports:
+ * - The control channel has strict priority, log data is only queued
+ *   to TinyUSB while no reply is waiting
+ * - The log channel is limited to CONFIG_USB_CDC_LOG_RATE bytes per second
+ *   by a token bucket, so a log flood can't take the bus from replies
+ *
+ * Writers never block on USB: messages go to a per-channel queue, and are
+ * dropped (and counted) when it is full.
+ *
+ * @section usage Usage
+ * @code
+ * static int cmd_led(int argc, char **argv) {
+ *     usb_cdc_printf(USB_CDC_CHANNEL_CONTROL, "led %s\n", argc > 1 ? argv[1] : "?");
+ *     return 0;
+ * }
+ *
+ * // After tinyusb_driver_install()
+ * usb_cdc_init();
+ * usb_cdc_register_command("led", "led <on|off>", cmd_led);
+ * @endcode
+ * On the host, commands go to the first port (e.g. /dev/ttyACM0) and are
+ * answered with their output and "OK" or "ERR <n>"; logs come out of the
+ * second one.
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#ifndef USB_CDC_H
+#define USB_CDC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @defgroup usb_cdc_config CDC Channel Configuration
+ * @{
+ */
+#define USB_CDC_CMD_MAX         16      /**< Maximum registered commands */
+#define USB_CDC_LINE_MAX        128     /**< Longest command line */
+#define USB_CDC_ARGS_MAX        8       /**< Most arguments of a command, including its name */
+/** @} */
+
+/**
+ * @brief CDC channels
+ */
+typedef enum {
+    USB_CDC_CHANNEL_CONTROL = 0,    /**< Commands and replies, CDC-ACM port 0 */
+    USB_CDC_CHANNEL_LOG,            /**< Log output, CDC-ACM port 1 */
+    USB_CDC_CHANNEL_COUNT
+} usb_cdc_channel_t;
+
+/**
+ * @brief Channel statistics
+ *
+ * Latency is measured from usb_cdc_write() until the last byte of the
+ * message is in the TinyUSB TX FIFO, i.e. the time spent in the channel
+ * queue and the scheduler.
+ */
+typedef struct {
+    uint32_t queue_bytes;           /**< Bytes waiting now */
+    uint32_t queue_high_water;      /**< Most bytes waiting since init */
+    uint32_t messages;              /**< Messages handed to TinyUSB */
+    uint64_t bytes;                 /**< Bytes handed to TinyUSB */
+    uint32_t dropped;               /**< Messages dropped, queue full or channel busy for a log line */
+    uint32_t latency_avg_us;        /**< Mean latency */
+    uint32_t latency_max_us;        /**< Worst latency */
+} usb_cdc_stats_t;
+
+/**
+ * @brief Command handler
+ *
+ * Runs in the control task. Output goes to the control channel with
+ * usb_cdc_write() or usb_cdc_printf().
+ *
+ * @param[in] argc Number of arguments, including the command name
+ * @param[in] argv Arguments, split at spaces
+ *
+ * @return 0 on success, an error code for the "ERR <n>" reply otherwise
+ */
+typedef int (*usb_cdc_cmd_handler_t)(int argc, char **argv);
+
+/**
+ * @brief Start the Control and Log Channels
+ *
+ * Initializes CDC-ACM ports 0 and 1, starts the TX scheduler and control
+ * tasks, registers the built-in "help" and "stats" commands and, with
+ * CONFIG_USB_CDC_LOG_REDIRECT, copies ESP_LOG output to the log channel.
+ *
+ * @return true if successful, false otherwise
+ * @retval false Already started, CDC-ACM init failed or out of memory
+ *
+ * @note Requires CONFIG_USB_CDC_CHANNELS and CONFIG_TINYUSB_CDC_COUNT=2
+ * @note Must be called after tinyusb_driver_install()
+ */
+bool usb_cdc_init(void);
+
+/**
+ * @brief Queue Data on a Channel
+ *
+ * Data longer than one message is split; each part is queued whole or
+ * dropped.
+ *
+ * @param[in] channel Channel
+ * @param[in] data Data to send
+ * @param[in] len Number of bytes
+ * @param[in] timeout_ms Longest wait for queue space, 0 to drop at once
+ *
+ * @return Bytes queued
+ *
+ * @note Not callable from an ISR
+ */
+size_t usb_cdc_write(usb_cdc_channel_t channel, const void *data, size_t len, uint32_t timeout_ms);
+
+/**
+ * @brief Queue Data on a Channel Whole or Not at All
+ *
+ * For framed data that a reader can't resynchronize on when cut: the
+ * data is split like with usb_cdc_write(), but dropped up front if the
+ * queue can't take all parts. Never waits for queue space.
+ *
+ * @param[in] channel Channel
+ * @param[in] data Data to send
+ * @param[in] len Number of bytes
+ *
+ * @return true if all data was queued
+ *
+ * @note Not callable from an ISR
+ */
+bool usb_cdc_write_whole(usb_cdc_channel_t channel, const void *data, size_t len);
+
+/**
+ * @brief Queue Formatted Text on a Channel
+ *
+ * Without waiting for queue space; output beyond 256 bytes is truncated.
+ *
+ * @param[in] channel Channel
+ * @param[in] fmt printf() format
+ *
+ * @return Bytes queued
+ */
+size_t usb_cdc_printf(usb_cdc_channel_t channel, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Register a Control Command
+ *
+ * @param[in] name Command name, kept by reference
+ * @param[in] help One-line usage for "help", kept by reference, may be NULL
+ * @param[in] handler Handler
+ *
+ * @return true if registered, false if the name is taken or the table is full
+ */
+bool usb_cdc_register_command(const char *name, const char *help, usb_cdc_cmd_handler_t handler);
+
+/**
+ * @brief Get Channel Statistics
+ *
+ * @param[in] channel Channel
+ * @param[out] stats Statistics since usb_cdc_init()
+ *
+ * @return true if successful, false if not started
+ */
+bool usb_cdc_get_stats(usb_cdc_channel_t channel, usb_cdc_stats_t *stats);
+
+#endif /* USB_CDC_H */
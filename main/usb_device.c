@@ -14,6 +14,7 @@
  * - Block device backed by internal FATFS
  * - Sector-level read/write operations (512-byte sectors)
  * - SCSI START/STOP UNIT handling for safe eject
+ * - Volume mounted either for the application or for the host, never both
  * - I/O activity monitoring and LED state updates
  * - Write synchronization for data safety
  * - Thread-safe operations with semaphores
@@ -37,22 +38,37 @@
 #include "usb_device.h"
 #include "filesystem.h"
 #include "led_control.h"
+#include "cdc_transfer.h"
+#include "usb_cdc.h"
+#include "binlog.h"
+#include "trace_cmd.h"
+#include "trace.h"
+#include "task_profile.h"
+#include "task_placement.h"
 #include "esp_log.h"
 #include "tinyusb.h"
 #include "tinyusb_msc.h"
+#include "tinyusb_default_config.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "ff.h"
 
+/* tinyusb_msc_new_storage_spiflash() refuses a FIFO smaller than a WL sector, catch it at build time */
+#if CONFIG_TINYUSB_MSC_BUFSIZE < CONFIG_WL_SECTOR_SIZE
+#error "CONFIG_TINYUSB_MSC_BUFSIZE must be at least CONFIG_WL_SECTOR_SIZE for the internal storage LUN"
+#endif
+
 static const char *TAG = "usb_device";  /**< Log tag for USB device messages */
 
 /** @defgroup usb_device_state USB Device State Variables
  * @{
  */
 static bool g_usb_connected = false;        /**< USB connection status */
-static bool g_usb_mounted = false;          /**< USB mount status on host */
+static bool g_usb_mounted = false;          /**< Internal volume owned by the host, from MSC storage events */
 static uint32_t g_io_activity_timeout = 0;  /**< I/O activity timeout counter */
+static tinyusb_msc_storage_handle_t g_msc_storage = NULL;  /**< MSC storage exposed to the host, once created */
+static tinyusb_msc_storage_handle_t g_scratch_storage = NULL;  /**< RAM disk LUN (CONFIG_USB_SCRATCH_DISK) */
 /** @} */
 
 /** @defgroup usb_device_sync Synchronization Primitives
@@ -198,41 +214,51 @@ static int32_t msc_write_sectors(uint32_t lba, uint32_t offset, uint8_t *buffer,
 }
 
 /**
- * @brief MSC callback: get capacity
+ * @brief Attach the internal volume the MSC storage mounted for the application
  */
-static bool msc_capacity_cb(uint32_t *block_count, uint16_t *block_size) {
-    uint64_t total_bytes, free_bytes;
-    if (!fs_get_stats(&total_bytes, &free_bytes)) {
-        ESP_LOGE(TAG, "Failed to get FS stats");
-        return false;
+static void usb_device_attach_volume(void) {
+    uint8_t pdrv = 0xFF;
+    if (tinyusb_msc_get_storage_drive(g_msc_storage, &pdrv) != ESP_OK || !fs_attach_volume(pdrv)) {
+        ESP_LOGE(TAG, "Failed to attach the internal volume");
     }
-
-    *block_count = total_bytes / 512;
-    *block_size = 512;
-
-    ESP_LOGI(TAG, "MSC capacity: %u blocks of %u bytes", *block_count, *block_size);
-    return true;
 }
 
 /**
- * @brief MSC callback: start/stop unit
+ * @brief MSC storage event callback
+ *
+ * The storage unmounts the internal volume when a host is attached and
+ * mounts it back for the application on eject or detach; filesystem.c
+ * follows, so the host and the firmware never write the volume together.
  */
-static bool msc_start_stop_cb(uint8_t power_condition, bool start, bool load_eject) {
-    ESP_LOGI(TAG, "MSC start_stop: power=%d, start=%d, eject=%d", power_condition, start, load_eject);
+static void usb_device_msc_event_cb(tinyusb_msc_storage_handle_t handle, tinyusb_msc_event_t *event, void *arg) {
+    (void)arg;
+    if (handle == NULL || handle != g_msc_storage) {
+        /* Scratch disk, or the internal storage while it is being created */
+        return;
+    }
 
-    if (load_eject) {
-        if (start) {
-            /* Load media */
+    switch (event->id) {
+    case TINYUSB_MSC_EVENT_MOUNT_START:
+        if (event->mount_point == TINYUSB_MSC_STORAGE_MOUNT_APP) {
+            /* Application writers back off from here, not only once the host has it */
             g_usb_mounted = true;
-            led_set_state(LED_STATE_IDLE);
-        } else {
-            /* Eject media */
+            fs_detach_volume();
+        }
+        break;
+    case TINYUSB_MSC_EVENT_MOUNT_COMPLETE:
+        if (event->mount_point == TINYUSB_MSC_STORAGE_MOUNT_APP) {
+            usb_device_attach_volume();
             g_usb_mounted = false;
-            led_set_state(LED_STATE_IDLE);
         }
+        led_set_state(LED_STATE_IDLE);
+        break;
+    case TINYUSB_MSC_EVENT_MOUNT_FAILED:
+    case TINYUSB_MSC_EVENT_FORMAT_FAILED:
+        ESP_LOGE(TAG, "Internal volume not available to the application");
+        break;
+    default:
+        break;
     }
-
-    return true;
 }
 
 /**
@@ -240,7 +266,10 @@ static bool msc_start_stop_cb(uint8_t power_condition, bool start, bool load_eje
  */
 static void io_monitor_task(void *arg) {
     while (1) {
-        if (xSemaphoreTake(g_io_semaphore, pdMS_TO_TICKS(100)) == pdTRUE) {
+        const bool active = TASK_PROFILE_TAKE(g_io_semaphore, pdMS_TO_TICKS(100)) == pdTRUE;
+
+        TRACE_BEGIN("io_monitor");
+        if (active) {
             /* I/O activity detected, set busy state */
             led_set_state(LED_STATE_BUSY);
             g_io_activity_timeout = 500; /* 500ms timeout */
@@ -253,11 +282,53 @@ static void io_monitor_task(void *arg) {
                 led_set_state(LED_STATE_IDLE);
             }
         }
+        TRACE_END("io_monitor");
 
-        vTaskDelay(pdMS_TO_TICKS(100));
+        TASK_PROFILE_DELAY(pdMS_TO_TICKS(100));
     }
 }
 
+#if CONFIG_USB_SCRATCH_DISK
+/**
+ * @brief Create the RAM disk LUN, loading its snapshot if there is one
+ */
+static bool usb_device_scratch_init(void) {
+    const esp_partition_t *snapshot = NULL;
+    if (CONFIG_USB_SCRATCH_DISK_SNAPSHOT_PARTITION[0] != '\0') {
+        snapshot = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                            CONFIG_USB_SCRATCH_DISK_SNAPSHOT_PARTITION);
+        if (!snapshot) {
+            ESP_LOGW(TAG, "Snapshot partition '%s' not found", CONFIG_USB_SCRATCH_DISK_SNAPSHOT_PARTITION);
+        }
+    }
+
+    tinyusb_msc_storage_config_t scratch_cfg = {
+        .medium.ramdisk = {
+            .size = CONFIG_USB_SCRATCH_DISK_SIZE_KB * 1024,
+            .snapshot_partition = snapshot,
+        },
+        .fat_fs = {
+            .base_path = SCRATCH_MOUNT_POINT,
+            .config = {
+                .max_files = 2,
+            },
+            .do_not_format = false,
+            .format_flags = 0,
+        },
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_USB,
+    };
+
+    esp_err_t ret = tinyusb_msc_new_storage_ramdisk(&scratch_cfg, &g_scratch_storage);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create scratch disk: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Scratch disk: %d KiB%s", CONFIG_USB_SCRATCH_DISK_SIZE_KB, snapshot ? ", snapshots enabled" : "");
+    return true;
+}
+#endif
+
 bool usb_device_init(void) {
     ESP_LOGI(TAG, "Initializing USB Device (MSC)");
 
@@ -267,59 +338,116 @@ bool usb_device_init(void) {
         ESP_LOGE(TAG, "Failed to create I/O semaphore");
         return false;
     }
+    TASK_PROFILE_NAME(g_io_semaphore, "io_activity");
 
     /* Create I/O monitor task */
-    xTaskCreate(io_monitor_task, "io_monitor", 2048, NULL, 4, &g_io_monitor_task);
-
-    /* Initialize TinyUSB */
-    const tinyusb_config_t tusb_cfg = {
-        .port = TINYUSB_PORT_FULL_SPEED_0,
-        .phy = {
-            .skip_setup = false,
-            .self_powered = false,
-        },
-    };
+    task_placement_create(io_monitor_task, "io_monitor", NULL, &g_io_monitor_task);
 
-    esp_err_t ret = tinyusb_driver_install(&tusb_cfg);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to install TinyUSB driver: %s", esp_err_to_name(ret));
+    /* From here the MSC storage is the only one mounting the volume; the I/O trace is exported on release */
+    if (!fs_release_volume()) {
+        ESP_LOGE(TAG, "Failed to release the internal volume");
         return false;
     }
 
-    /* Install MSC driver */
+    /* Install MSC driver; the storage moves to the host on attach and back on eject or detach */
     const tinyusb_msc_driver_config_t msc_driver_cfg = {
         .user_flags = {
             .auto_mount_off = 0,
         },
-        .callback = NULL,
+        .callback = usb_device_msc_event_cb,
         .callback_arg = NULL,
     };
 
-    ret = tinyusb_msc_install_driver(&msc_driver_cfg);
+    esp_err_t ret = tinyusb_msc_install_driver(&msc_driver_cfg);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to install MSC driver: %s", esp_err_to_name(ret));
         return false;
     }
 
-    /* Create MSC storage with SPI Flash */
+    /* Create MSC storage with SPI Flash, LUN 0, mounted for the application until a host is attached */
+    const fs_volume_profile_t *profile = fs_get_volume_profile();
     tinyusb_msc_storage_config_t msc_cfg = {
-        .medium.wl_handle = WL_INVALID_HANDLE,  // Will be initialized by filesystem
+        .medium.wl_handle = fs_get_wl_handle(),
         .fat_fs = {
             .base_path = MOUNT_POINT,
             .config = {
                 .format_if_mount_failed = true,
-                .max_files = 5,
-                .allocation_unit_size = 4096,
+                .max_files = profile->max_files,
+                .allocation_unit_size = profile->allocation_unit_size,
+                .use_one_fat = (profile->n_fats == 1),
             },
             .do_not_format = false,
-            .format_flags = 0,
+            .format_flags = profile->fmt,
         },
-        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_USB,
+        .mount_point = TINYUSB_MSC_STORAGE_MOUNT_APP,
+    };
+
+    ret = tinyusb_msc_new_storage_spiflash(&msc_cfg, &g_msc_storage);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MSC storage: %s", esp_err_to_name(ret));
+        return false;
+    }
+    /* Mounted during creation, before the handle was known to the event callback */
+    usb_device_attach_volume();
+
+    /* Make packed record logs visible as plain files before the host sees the volume */
+    fs_log_export_all();
+
+    /* Initialize TinyUSB; its task (and the USB interrupt, allocated from it) goes where the table says */
+    const task_placement_t *usb_task = task_placement_find("TinyUSB");
+    const BaseType_t usb_core = task_placement_core(usb_task->group);
+    const tinyusb_config_t tusb_cfg = {
+        .port = TINYUSB_PORT_FULL_SPEED_0,
+        .phy = {
+            .skip_setup = false,
+            .self_powered = false,
+        },
+        /* esp_tinyusb needs a core, floating placement keeps its default */
+        .task = TINYUSB_TASK_CUSTOM(usb_task->stack_size, usb_task->priority,
+                                    (usb_core == tskNO_AFFINITY) ? TINYUSB_DEFAULT_TASK_AFFINITY : usb_core),
     };
 
-    // Note: In the new API, storage initialization is handled differently
-    // The storage is created and managed through the new API
-    // For now, we'll skip the explicit storage creation as it's handled by the driver
+    ret = tinyusb_driver_install(&tusb_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install TinyUSB driver: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+#if CONFIG_USB_SCRATCH_DISK
+    if (!usb_device_scratch_init()) {
+        /* The internal volume is still usable, carry on without the scratch LUN */
+        ESP_LOGW(TAG, "Scratch disk not available");
+    }
+#endif
+
+#if CONFIG_CDC_TRANSFER
+    if (!cdc_transfer_init()) {
+        /* MSC works without it */
+        ESP_LOGW(TAG, "CDC file transfer not available");
+    }
+#endif
+
+#if CONFIG_USB_CDC_CHANNELS
+    if (!usb_cdc_init()) {
+        ESP_LOGW(TAG, "CDC control and log channels not available");
+    }
+    if (!task_placement_init()) {
+        ESP_LOGW(TAG, "Placement command not available");
+    }
+#endif
+
+#if CONFIG_BINLOG
+    if (!binlog_init()) {
+        /* Records stay in the rings until the ring is full */
+        ESP_LOGW(TAG, "Binary log not shipped");
+    }
+#endif
+
+#if CONFIG_TRACE && CONFIG_USB_CDC_CHANNELS
+    if (!trace_cmd_init()) {
+        ESP_LOGW(TAG, "Trace command not available");
+    }
+#endif
 
     g_usb_connected = true;
     ESP_LOGI(TAG, "USB Device (MSC) initialized");
@@ -334,6 +462,52 @@ bool usb_device_is_mounted(void) {
     return g_usb_mounted;
 }
 
+bool usb_device_notify_capacity_changed(void) {
+    uint32_t sector_count, sector_size;
+    if (!fs_get_volume_info(&sector_count, &sector_size)) {
+        return false;
+    }
+
+    if (!g_msc_storage) {
+        /* Nothing exposed yet; the host reads the current size on enumeration */
+        return true;
+    }
+
+    uint32_t msc_sector_size = 0;
+    if (tinyusb_msc_get_storage_sector_size(g_msc_storage, &msc_sector_size) != ESP_OK || msc_sector_size == 0) {
+        return false;
+    }
+
+    uint32_t blocks = (uint32_t)((uint64_t)sector_count * sector_size / msc_sector_size);
+    esp_err_t ret = tinyusb_msc_set_storage_capacity(g_msc_storage, blocks);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to update MSC capacity: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    ESP_LOGI(TAG, "MSC capacity changed to %u blocks", blocks);
+    return true;
+}
+
+bool usb_device_scratch_snapshot(void) {
+#if CONFIG_USB_SCRATCH_DISK
+    if (!g_scratch_storage) {
+        return false;
+    }
+
+    esp_err_t ret = tinyusb_msc_snapshot_storage(g_scratch_storage);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Scratch disk snapshot failed: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Scratch disk snapshot saved");
+    return true;
+#else
+    return false;
+#endif
+}
+
 void usb_device_notify_io_start(void) {
     if (g_io_semaphore) {
         xSemaphoreGive(g_io_semaphore);
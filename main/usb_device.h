@@ -45,6 +45,8 @@
 
 #include <stdbool.h>
 
+#define SCRATCH_MOUNT_POINT "/scratch"  /**< Application path of the scratch disk (CONFIG_USB_SCRATCH_DISK) */
+
 /**
  * @brief Initialize USB Device Mode (MSC)
  *
@@ -89,18 +91,47 @@ bool usb_device_is_connected(void);
 /**
  * @brief Check if USB device is mounted on host
  *
- * Queries the current USB mount status. Returns true if the host computer
- * has successfully mounted the USB Mass Storage Device and can access files.
+ * Queries who owns the internal volume. Returns true from the moment the
+ * MSC storage starts handing the volume to an attached host until it is
+ * mounted back for the application on eject or detach. Application
+ * writers to MOUNT_POINT must back off while it returns true.
  *
  * @return true if USB device is mounted on host, false otherwise
- * @retval true Device is mounted and accessible
- * @retval false Device is not mounted
+ * @retval true Volume owned by the host
+ * @retval false Volume mounted for the application
  *
  * @note Device must be connected before it can be mounted
  * @see usb_device_is_connected()
  */
 bool usb_device_is_mounted(void);
 
+/**
+ * @brief Notify USB device that the volume size changed
+ *
+ * Updates the capacity exposed over MSC to the current volume size. A
+ * connected host receives a UNIT ATTENTION (capacity data has changed)
+ * on its next TEST UNIT READY and re-reads the capacity without being
+ * re-plugged.
+ *
+ * @return true if successful, false otherwise
+ *
+ * @see fs_grow_volume()
+ */
+bool usb_device_notify_capacity_changed(void);
+
+/**
+ * @brief Save the scratch disk to its snapshot partition
+ *
+ * The snapshot is loaded back into the scratch disk at the next boot.
+ * Host access to the scratch disk is blocked while it is taken.
+ *
+ * @return true if successful, false if the scratch disk or its snapshot
+ *         partition is not configured, or the flash write failed
+ *
+ * @note Requires CONFIG_USB_SCRATCH_DISK and CONFIG_USB_SCRATCH_DISK_SNAPSHOT_PARTITION
+ */
+bool usb_device_scratch_snapshot(void);
+
 /**
  * @brief Notify USB device of I/O activity start
  *
@@ -24,6 +24,10 @@
 #include "usb_host.h"
 #include "led_control.h"
 #include "esp_log.h"
+#include "binlog.h"
+#include "trace.h"
+#include "task_profile.h"
+#include "task_placement.h"
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -46,12 +50,6 @@ static const char *TAG = "usb_host";
 /** USB Host mount point */
 #define USB_HOST_MOUNT_POINT "/usb"
 
-/** USB Host task stack size */
-#define USB_HOST_TASK_STACK_SIZE 4096
-
-/** USB Host task priority */
-#define USB_HOST_TASK_PRIORITY 5
-
 /** USB Host device detection timeout (ms) */
 #define USB_HOST_DEVICE_TIMEOUT 5000
 
@@ -92,12 +90,14 @@ static void usb_host_task(void *arg) {
     ESP_LOGI(TAG, "USB Host task started");
 
     while (1) {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        TASK_PROFILE_DELAY(pdMS_TO_TICKS(1000));
 
         // Check device connection status
-        if (xSemaphoreTake(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+        if (TASK_PROFILE_TAKE(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+            TRACE_BEGIN("usb_host");
             // Simulate device detection (in real implementation, would use USB stack)
             // For now, just maintain state
+            TRACE_END("usb_host");
             xSemaphoreGive(g_usb_host_ctx.state_mutex);
         }
     }
@@ -143,9 +143,10 @@ bool usb_host_init(void) {
         ESP_LOGE(TAG, "Failed to create state mutex");
         return false;
     }
+    TASK_PROFILE_NAME(g_usb_host_ctx.state_mutex, "usb_host_state");
 
     // Initialize state
-    if (xSemaphoreTake(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         g_usb_host_ctx.state = USB_HOST_STATE_IDLE;
         g_usb_host_ctx.device_connected = false;
         memset(&g_usb_host_ctx.device_info, 0, sizeof(usb_host_device_info_t));
@@ -153,8 +154,7 @@ bool usb_host_init(void) {
     }
 
     // Create USB Host detection task
-    if (xTaskCreate(usb_host_task, "usb_host", USB_HOST_TASK_STACK_SIZE,
-                    NULL, USB_HOST_TASK_PRIORITY, &g_usb_host_ctx.host_task) != pdPASS) {
+    if (!task_placement_create(usb_host_task, "usb_host", NULL, &g_usb_host_ctx.host_task)) {
         ESP_LOGE(TAG, "Failed to create USB Host task");
         vSemaphoreDelete(g_usb_host_ctx.state_mutex);
         return false;
@@ -198,7 +198,7 @@ bool usb_host_deinit(void) {
 bool usb_host_is_device_connected(void) {
     bool connected = false;
 
-    if (xSemaphoreTake(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         connected = g_usb_host_ctx.device_connected;
         xSemaphoreGive(g_usb_host_ctx.state_mutex);
     }
@@ -209,7 +209,7 @@ bool usb_host_is_device_connected(void) {
 usb_host_state_t usb_host_get_state(void) {
     usb_host_state_t state = USB_HOST_STATE_IDLE;
 
-    if (xSemaphoreTake(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         state = g_usb_host_ctx.state;
         xSemaphoreGive(g_usb_host_ctx.state_mutex);
     }
@@ -228,7 +228,7 @@ bool usb_host_get_device_info(usb_host_device_info_t *info) {
         return false;
     }
 
-    if (xSemaphoreTake(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         memcpy(info, &g_usb_host_ctx.device_info, sizeof(usb_host_device_info_t));
         xSemaphoreGive(g_usb_host_ctx.state_mutex);
         return true;
@@ -239,59 +239,59 @@ bool usb_host_get_device_info(usb_host_device_info_t *info) {
 
 int usb_host_read_file(const char *path, uint8_t *buffer, size_t max_size) {
     if (!path || !buffer || max_size == 0) {
-        ESP_LOGE(TAG, "Invalid parameters for read_file");
+        BINLOG_E(TAG, "Invalid parameters for read_file");
         return -1;
     }
 
     if (!g_usb_host_ctx.device_connected) {
-        ESP_LOGW(TAG, "No device connected");
+        BINLOG_W(TAG, "No device connected");
         return -1;
     }
 
     FILE *file = fopen(path, "rb");
     if (!file) {
-        ESP_LOGE(TAG, "Failed to open file: %s", path);
+        BINLOG_E(TAG, "Failed to open file: %s", path);
         return -1;
     }
 
     int bytes_read = fread(buffer, 1, max_size, file);
     if (bytes_read < 0) {
-        ESP_LOGE(TAG, "Failed to read file: %s", path);
+        BINLOG_E(TAG, "Failed to read file: %s", path);
         fclose(file);
         return -1;
     }
 
     fclose(file);
-    ESP_LOGI(TAG, "Read %d bytes from %s", bytes_read, path);
+    BINLOG_I(TAG, "Read %d bytes from %s", bytes_read, path);
     return bytes_read;
 }
 
 int usb_host_write_file(const char *path, const uint8_t *buffer, size_t size) {
     if (!path || !buffer || size == 0) {
-        ESP_LOGE(TAG, "Invalid parameters for write_file");
+        BINLOG_E(TAG, "Invalid parameters for write_file");
         return -1;
     }
 
     if (!g_usb_host_ctx.device_connected) {
-        ESP_LOGW(TAG, "No device connected");
+        BINLOG_W(TAG, "No device connected");
         return -1;
     }
 
     FILE *file = fopen(path, "wb");
     if (!file) {
-        ESP_LOGE(TAG, "Failed to open file for writing: %s", path);
+        BINLOG_E(TAG, "Failed to open file for writing: %s", path);
         return -1;
     }
 
     int bytes_written = fwrite(buffer, 1, size, file);
     if (bytes_written < 0) {
-        ESP_LOGE(TAG, "Failed to write file: %s", path);
+        BINLOG_E(TAG, "Failed to write file: %s", path);
         fclose(file);
         return -1;
     }
 
     fclose(file);
-    ESP_LOGI(TAG, "Wrote %d bytes to %s", bytes_written, path);
+    BINLOG_I(TAG, "Wrote %d bytes to %s", bytes_written, path);
     return bytes_written;
 }
 
@@ -315,7 +315,7 @@ int usb_host_list_files(const char *path, char **files, int max_files) {
 bool usb_host_eject_device(void) {
     ESP_LOGI(TAG, "Ejecting USB device");
 
-    if (xSemaphoreTake(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_host_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         g_usb_host_ctx.device_connected = false;
         g_usb_host_ctx.state = USB_HOST_STATE_IDLE;
         usb_host_update_led(USB_HOST_STATE_IDLE);
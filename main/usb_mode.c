@@ -14,6 +14,10 @@
 #include "usb_host.h"
 #include "led_control.h"
 #include "esp_log.h"
+#include "binlog.h"
+#include "trace.h"
+#include "task_profile.h"
+#include "task_placement.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -80,9 +84,10 @@ static void usb_mode_task(void *arg) {
     ESP_LOGI(TAG, "USB Mode control task started");
     
     while (1) {
-        vTaskDelay(pdMS_TO_TICKS(500));
+        TASK_PROFILE_DELAY(pdMS_TO_TICKS(500));
         
-        if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+        if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+            TRACE_BEGIN("usb_mode");
             // Handle automatic mode switching
             if (g_usb_mode_ctx.mode == USB_MODE_DUAL_AUTO) {
                 // Auto-switch logic would go here
@@ -90,6 +95,7 @@ static void usb_mode_task(void *arg) {
             }
             
             usb_mode_update_led();
+            TRACE_END("usb_mode");
             xSemaphoreGive(g_usb_mode_ctx.state_mutex);
         }
     }
@@ -109,6 +115,7 @@ bool usb_mode_init(void) {
         ESP_LOGE(TAG, "Failed to create state mutex");
         return false;
     }
+    TASK_PROFILE_NAME(g_usb_mode_ctx.state_mutex, "usb_mode_state");
     
     // Create ready semaphore
     g_usb_mode_ctx.ready_semaphore = xSemaphoreCreateBinary();
@@ -117,9 +124,10 @@ bool usb_mode_init(void) {
         vSemaphoreDelete(g_usb_mode_ctx.state_mutex);
         return false;
     }
+    TASK_PROFILE_NAME(g_usb_mode_ctx.ready_semaphore, "usb_mode_ready");
     
     // Initialize state
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         g_usb_mode_ctx.state = USB_MODE_STATE_DEVICE;
         g_usb_mode_ctx.mode = USB_MODE_DEVICE_ONLY;
         g_usb_mode_ctx.device_connected = false;
@@ -128,7 +136,7 @@ bool usb_mode_init(void) {
     }
     
     // Create mode control task
-    if (xTaskCreate(usb_mode_task, "usb_mode", 2048, NULL, 3, &g_usb_mode_ctx.mode_task) != pdPASS) {
+    if (!task_placement_create(usb_mode_task, "usb_mode", NULL, &g_usb_mode_ctx.mode_task)) {
         ESP_LOGE(TAG, "Failed to create USB Mode task");
         vSemaphoreDelete(g_usb_mode_ctx.state_mutex);
         vSemaphoreDelete(g_usb_mode_ctx.ready_semaphore);
@@ -173,9 +181,9 @@ bool usb_mode_deinit(void) {
 }
 
 bool usb_mode_set(usb_mode_t mode) {
-    ESP_LOGI(TAG, "Setting USB mode to %d", mode);
+    BINLOG_I(TAG, "Setting USB mode to %d", mode);
     
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         g_usb_mode_ctx.mode = mode;
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
     }
@@ -186,7 +194,7 @@ bool usb_mode_set(usb_mode_t mode) {
 usb_mode_t usb_mode_get(void) {
     usb_mode_t mode = USB_MODE_DEVICE_ONLY;
     
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         mode = g_usb_mode_ctx.mode;
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
     }
@@ -197,7 +205,7 @@ usb_mode_t usb_mode_get(void) {
 usb_mode_state_t usb_mode_get_state(void) {
     usb_mode_state_t state = USB_MODE_STATE_IDLE;
     
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         state = g_usb_mode_ctx.state;
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
     }
@@ -208,7 +216,7 @@ usb_mode_state_t usb_mode_get_state(void) {
 bool usb_mode_is_switching(void) {
     bool switching = false;
     
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         switching = (g_usb_mode_ctx.state == USB_MODE_STATE_SWITCHING);
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
     }
@@ -222,13 +230,13 @@ bool usb_mode_wait_ready(uint32_t timeout_ms) {
     }
     
     TickType_t ticks = (timeout_ms == 0) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
-    return xSemaphoreTake(g_usb_mode_ctx.ready_semaphore, ticks) == pdTRUE;
+    return TASK_PROFILE_TAKE(g_usb_mode_ctx.ready_semaphore, ticks) == pdTRUE;
 }
 
 bool usb_mode_is_device_active(void) {
     bool active = false;
     
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         active = (g_usb_mode_ctx.state == USB_MODE_STATE_DEVICE);
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
     }
@@ -239,7 +247,7 @@ bool usb_mode_is_device_active(void) {
 bool usb_mode_is_host_active(void) {
     bool active = false;
     
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         active = (g_usb_mode_ctx.state == USB_MODE_STATE_HOST);
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
     }
@@ -252,7 +260,7 @@ bool usb_mode_get_status(usb_mode_status_t *status) {
         return false;
     }
     
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         status->mode = g_usb_mode_ctx.mode;
         status->state = g_usb_mode_ctx.state;
         status->device_connected = g_usb_mode_ctx.device_connected;
@@ -286,7 +294,7 @@ const char* usb_mode_get_status_string(void) {
 }
 
 void usb_mode_notify_device_connected(void) {
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         g_usb_mode_ctx.device_connected = true;
         usb_mode_update_led();
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
@@ -294,7 +302,7 @@ void usb_mode_notify_device_connected(void) {
 }
 
 void usb_mode_notify_device_disconnected(void) {
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         g_usb_mode_ctx.device_connected = false;
         usb_mode_update_led();
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
@@ -302,7 +310,7 @@ void usb_mode_notify_device_disconnected(void) {
 }
 
 void usb_mode_notify_host_device_connected(void) {
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         g_usb_mode_ctx.host_connected = true;
         usb_mode_update_led();
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
@@ -310,7 +318,7 @@ void usb_mode_notify_host_device_connected(void) {
 }
 
 void usb_mode_notify_host_device_disconnected(void) {
-    if (xSemaphoreTake(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
+    if (TASK_PROFILE_TAKE(g_usb_mode_ctx.state_mutex, pdMS_TO_TICKS(100))) {
         g_usb_mode_ctx.host_connected = false;
         usb_mode_update_led();
         xSemaphoreGive(g_usb_mode_ctx.state_mutex);
@@ -0,0 +1,222 @@
+/**
+ * @file test_binlog.c
+ * @brief Unit Tests for the Binary Log
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Writes records through the BINLOG macros and checks what binlog_drain()
+ * returns: record layout, argument encoding, wrap-around and drops on a
+ * full ring. Also compares the cost of a record with an ESP_LOGI line.
+ *
+ * @section test_cases Test Cases
+ * - Record layout and argument types
+ * - Wrap-around keeps every record in order
+ * - Full ring drops and counts
+ * - Cost against ESP_LOGI
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "binlog.h"
+#include "esp_cpu.h"
+
+static const char *TAG = "test";
+
+static uint8_t g_out[2048];
+
+/** Empties the ring of the current core, returns the core */
+static int binlog_test_core(void) {
+    const int core = esp_cpu_get_core_id();
+    while (binlog_drain(core, g_out, sizeof(g_out)) > 0) {
+    }
+    return core;
+}
+
+static uint32_t word_at(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/**
+ * @test Record Layout
+ *
+ * Verifies the header, site, tag and argument encoding of one record,
+ * and that the site holds the format and the argument types.
+ */
+TEST_CASE("Binlog: Record Layout", "[binlog]") {
+    const int core = binlog_test_core();
+    binlog_level = ESP_LOG_INFO;
+
+    const char *name = "file.bin";
+    BINLOG_LOG(ESP_LOG_INFO, TAG, "n=%d s=%s ll=%lld f=%f", 42, name, -3LL, 1.5);
+    BINLOG_LOG(ESP_LOG_DEBUG, TAG, "filtered %d", 1);
+
+    const size_t n = binlog_drain(core, g_out, sizeof(g_out));
+    /* Header, site, tag, time, 42, "file.bin" (1 + 8 padded to 12), -3 and 1.5 */
+    TEST_ASSERT_EQUAL(16 + 4 + 12 + 8 + 8, n);
+
+    const uint32_t hdr = word_at(g_out);
+    TEST_ASSERT_EQUAL(n, hdr & 0xFFFF);
+    TEST_ASSERT_EQUAL_HEX8(0xB1, hdr >> 24);
+
+    const binlog_site_t *site = (const binlog_site_t *)(uintptr_t)word_at(g_out + 4);
+    TEST_ASSERT_EQUAL_STRING("n=%d s=%s ll=%lld f=%f", site->fmt);
+    TEST_ASSERT_EQUAL(4, site->info & 0xF);
+    TEST_ASSERT_EQUAL(BINLOG_ARG_I32, (site->info >> 4) & 3);
+    TEST_ASSERT_EQUAL(BINLOG_ARG_STR, (site->info >> 6) & 3);
+    TEST_ASSERT_EQUAL(BINLOG_ARG_I64, (site->info >> 8) & 3);
+    TEST_ASSERT_EQUAL(BINLOG_ARG_F64, (site->info >> 10) & 3);
+    TEST_ASSERT_EQUAL(ESP_LOG_INFO, site->info >> 28);
+    TEST_ASSERT_TRUE((const char *)(uintptr_t)word_at(g_out + 8) == TAG);
+
+    const uint8_t *arg = g_out + 16;
+    TEST_ASSERT_EQUAL(42, word_at(arg));
+    TEST_ASSERT_EQUAL(8, arg[4]);
+    TEST_ASSERT_EQUAL(0, memcmp(arg + 5, "file.bin", 8));
+    int64_t ll;
+    double f;
+    memcpy(&ll, arg + 16, 8);
+    memcpy(&f, arg + 24, 8);
+    TEST_ASSERT_TRUE(ll == -3);
+    TEST_ASSERT_TRUE(f == 1.5);
+
+    /* Nothing left */
+    TEST_ASSERT_EQUAL(0, binlog_drain(core, g_out, sizeof(g_out)));
+}
+
+/**
+ * @test Wrap-Around
+ *
+ * Writes and drains many times the ring size in uneven records and checks
+ * every sequence number comes back once, in order.
+ */
+TEST_CASE("Binlog: Wrap-Around", "[binlog]") {
+    const int core = binlog_test_core();
+    binlog_level = ESP_LOG_INFO;
+
+    uint32_t next = 0;
+    uint32_t expect = 0;
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; i < 7; i++, next++) {
+            /* 20 to 36 bytes */
+            const char *pad = "abcdefghijklmnop" + (next % 17);
+            BINLOG_LOG(ESP_LOG_INFO, TAG, "%u %s", (unsigned)next, pad);
+        }
+        const size_t n = binlog_drain(core, g_out, sizeof(g_out));
+        for (size_t off = 0; off < n;) {
+            const uint32_t len = word_at(g_out + off) & 0xFFFF;
+            TEST_ASSERT_EQUAL(expect, word_at(g_out + off + 16));
+            expect++;
+            off += len;
+        }
+    }
+    TEST_ASSERT_EQUAL(next, expect);
+}
+
+/**
+ * @test Full Ring
+ *
+ * Verifies that records are dropped and counted when the ring is full,
+ * and that the ring takes records again once drained.
+ */
+TEST_CASE("Binlog: Full Ring Drops", "[binlog]") {
+    const int core = binlog_test_core();
+    binlog_level = ESP_LOG_INFO;
+
+    binlog_stats_t before;
+    TEST_ASSERT_TRUE(binlog_get_stats(core, &before));
+
+    /* 24-byte records, far more than fit */
+    for (int i = 0; i < 4096; i++) {
+        BINLOG_LOG(ESP_LOG_INFO, TAG, "%d %d", i, i);
+    }
+
+    binlog_stats_t full;
+    binlog_get_stats(core, &full);
+    TEST_ASSERT_GREATER_THAN(before.dropped, full.dropped);
+    TEST_ASSERT_EQUAL(4096, (full.records - before.records) + (full.dropped - before.dropped));
+    TEST_ASSERT_GREATER_OR_EQUAL(full.used, full.high_water);
+
+    /* The kept records are the oldest ones */
+    binlog_drain(core, g_out, sizeof(g_out));
+    TEST_ASSERT_EQUAL(0, word_at(g_out + 16));
+    binlog_test_core();
+
+    BINLOG_LOG(ESP_LOG_INFO, TAG, "%d", 7);
+    TEST_ASSERT_EQUAL(20, binlog_drain(core, g_out, sizeof(g_out)));
+    TEST_ASSERT_FALSE(binlog_get_stats(-1, &full));
+}
+
+/**
+ * @test Record Larger Than the Drain Buffer
+ *
+ * Verifies that a record too large for the drain buffer is dropped and
+ * counted, and that the records behind it still come out.
+ */
+TEST_CASE("Binlog: Oversized Record Dropped", "[binlog]") {
+    const int core = binlog_test_core();
+    binlog_level = ESP_LOG_INFO;
+
+    static const char s[] = "0123456789012345678901234567890123456789";
+    BINLOG_LOG(ESP_LOG_INFO, TAG, "%s", s);
+    BINLOG_LOG(ESP_LOG_INFO, TAG, "%d", 7);
+
+    binlog_stats_t before;
+    binlog_get_stats(core, &before);
+
+    /* 16 + 44 bytes against a 32-byte buffer */
+    TEST_ASSERT_EQUAL(20, binlog_drain(core, g_out, 32));
+    TEST_ASSERT_EQUAL(7, word_at(g_out + 16));
+
+    binlog_stats_t after;
+    binlog_get_stats(core, &after);
+    TEST_ASSERT_EQUAL(before.dropped + 1, after.dropped);
+    TEST_ASSERT_EQUAL(0, after.used);
+}
+
+static int format_sink(const char *fmt, va_list ap) {
+    static char line[256];
+    return vsnprintf(line, sizeof(line), fmt, ap);
+}
+
+/**
+ * @test Cost Against ESP_LOGI
+ *
+ * Compares cycles per log call of a binary record and of an ESP_LOGI
+ * line formatted into a buffer (the console write itself not counted).
+ * The binary record must be at least ten times cheaper.
+ */
+TEST_CASE("Binlog: Cost Against ESP_LOGI", "[binlog]") {
+    const int core = binlog_test_core();
+    binlog_level = ESP_LOG_INFO;
+    const int calls = 64;
+    const char *path = "/data/log.bin";
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < calls; i++) {
+        BINLOG_LOG(ESP_LOG_INFO, TAG, "Read %d bytes from %s", i, path);
+    }
+    const uint32_t bin_cycles = (esp_cpu_get_cycle_count() - start) / calls;
+    binlog_drain(core, g_out, sizeof(g_out));
+
+    vprintf_like_t prev = esp_log_set_vprintf(format_sink);
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < calls; i++) {
+        ESP_LOGI(TAG, "Read %d bytes from %s", i, path);
+    }
+    const uint32_t text_cycles = (esp_cpu_get_cycle_count() - start) / calls;
+    esp_log_set_vprintf(prev);
+
+    printf("binlog %u cycles, ESP_LOGI %u cycles per call, %u times cheaper\n", (unsigned)bin_cycles,
+           (unsigned)text_cycles, (unsigned)(text_cycles / (bin_cycles ? bin_cycles : 1)));
+    TEST_ASSERT_LESS_THAN(text_cycles / 10, bin_cycles);
+}
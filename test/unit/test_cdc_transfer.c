@@ -0,0 +1,275 @@
+/**
+ * @file test_cdc_transfer.c
+ * @brief Unit Tests for the CDC File Transfer Protocol Engine
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Drives the protocol engine with hand-built frames on the internal volume
+ * and checks the frames it answers with. The host client and lossy-link
+ * runs are covered by tools/cdc_transfer/test_loopback.py.
+ *
+ * @section test_cases Test Cases
+ * - Write session, frames fed in small pieces
+ * - Corrupted frame dropped, gap answered with NAK
+ * - Read session with window and END
+ * - Paths outside the volume rejected
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "unity.h"
+#include "filesystem.h"
+#include "checksum.h"
+#include "cdc_transfer_proto.h"
+
+#define TEST_PAYLOAD    512
+#define TEST_WINDOW     4
+#define TEST_FILE_SIZE  (5 * TEST_PAYLOAD + 100)
+#define TEST_MAX_SENT   32
+
+/**
+ * @brief Frame sent by the engine
+ */
+typedef struct {
+    uint8_t type;
+    uint32_t seq;
+    uint16_t len;
+    uint8_t payload[TEST_PAYLOAD];
+} test_frame_t;
+
+static test_frame_t s_sent[TEST_MAX_SENT];
+static size_t s_sent_count;
+static uint8_t s_file[TEST_FILE_SIZE];
+
+static void test_send(void *ctx, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    (void)ctx;
+    TEST_ASSERT_LESS_THAN(TEST_MAX_SENT, s_sent_count);
+    TEST_ASSERT_EQUAL(CDC_XFER_FRAME_SIZE(p[8] | (p[9] << 8)), len);
+    test_frame_t *f = &s_sent[s_sent_count++];
+    f->type = p[2];
+    f->seq = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+    f->len = p[8] | (p[9] << 8);
+    memcpy(f->payload, p + CDC_XFER_HEADER_SIZE, f->len);
+}
+
+static cdc_xfer_server_t *test_server(void) {
+    TEST_ASSERT_TRUE(fs_init_internal());
+    const cdc_xfer_config_t cfg = {
+        .root = MOUNT_POINT,
+        .max_payload = TEST_PAYLOAD,
+        .window = TEST_WINDOW,
+        .io_size = 4096,
+        .rto_ms = 100,
+        .idle_timeout_ms = 5000,
+        .send = test_send,
+    };
+    s_sent_count = 0;
+    for (size_t i = 0; i < sizeof(s_file); i++) {
+        s_file[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    cdc_xfer_server_t *srv = cdc_xfer_server_new(&cfg);
+    TEST_ASSERT_NOT_NULL(srv);
+    return srv;
+}
+
+/**
+ * @brief Feed one frame, @p chunk bytes at a time
+ */
+static void test_feed(cdc_xfer_server_t *srv, uint8_t type, uint32_t seq, const void *payload, uint16_t len,
+                      size_t chunk) {
+    static uint8_t frame[CDC_XFER_FRAME_SIZE(TEST_PAYLOAD)];
+    size_t size = cdc_xfer_frame_encode(frame, type, seq, payload, len);
+    for (size_t off = 0; off < size; off += chunk) {
+        cdc_xfer_server_input(srv, frame + off, (size - off < chunk) ? size - off : chunk, 0);
+    }
+}
+
+static void test_feed_data(cdc_xfer_server_t *srv, uint32_t seq, size_t chunk) {
+    size_t off = seq * TEST_PAYLOAD;
+    size_t len = (TEST_FILE_SIZE - off < TEST_PAYLOAD) ? TEST_FILE_SIZE - off : TEST_PAYLOAD;
+    test_feed(srv, CDC_XFER_DATA, seq, s_file + off, (uint16_t)len, chunk);
+}
+
+static void test_open_write(cdc_xfer_server_t *srv, const char *path) {
+    uint8_t open[4 + 32];
+    uint32_t size = TEST_FILE_SIZE;
+    memcpy(open, &size, 4);
+    memcpy(open + 4, path, strlen(path));
+    test_feed(srv, CDC_XFER_OPEN_WRITE, 0, open, (uint16_t)(4 + strlen(path)), 64);
+}
+
+/**
+ * @test Write Session
+ *
+ * Verifies that a file sent in DATA frames split into 7-byte pieces is
+ * acknowledged every window/2 frames and renamed into place on END.
+ */
+TEST_CASE("CDC Transfer: Write Session", "[cdc_transfer]") {
+    cdc_xfer_server_t *srv = test_server();
+    const uint32_t frames = (TEST_FILE_SIZE + TEST_PAYLOAD - 1) / TEST_PAYLOAD;
+    unlink(MOUNT_POINT "/XFER.BIN");
+
+    test_feed(srv, CDC_XFER_HELLO, 0, NULL, 0, 7);
+    TEST_ASSERT_EQUAL(CDC_XFER_HELLO, s_sent[0].type);
+    TEST_ASSERT_EQUAL(TEST_PAYLOAD, s_sent[0].payload[2] | (s_sent[0].payload[3] << 8));
+
+    test_open_write(srv, "XFER.BIN");
+    TEST_ASSERT_EQUAL(CDC_XFER_OK, s_sent[1].type);
+    TEST_ASSERT_TRUE(cdc_xfer_server_busy(srv));
+
+    for (uint32_t seq = 0; seq < frames; seq++) {
+        test_feed_data(srv, seq, 7);
+    }
+    /* Cumulative ACK every window/2 frames */
+    TEST_ASSERT_EQUAL(2 + frames / 2, s_sent_count);
+    for (uint32_t i = 0; i < frames / 2; i++) {
+        TEST_ASSERT_EQUAL(CDC_XFER_ACK, s_sent[2 + i].type);
+        TEST_ASSERT_EQUAL(2 * (i + 1), s_sent[2 + i].seq);
+    }
+
+    uint32_t end[2] = { TEST_FILE_SIZE, checksum_crc32(0, s_file, TEST_FILE_SIZE) };
+    test_feed(srv, CDC_XFER_END, frames, end, sizeof(end), 7);
+    TEST_ASSERT_EQUAL(CDC_XFER_OK, s_sent[s_sent_count - 1].type);
+    TEST_ASSERT_EQUAL(frames, s_sent[s_sent_count - 1].seq);
+    TEST_ASSERT_FALSE(cdc_xfer_server_busy(srv));
+
+    static uint8_t back[TEST_FILE_SIZE + 1];
+    FILE *f = fopen(MOUNT_POINT "/XFER.BIN", "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(TEST_FILE_SIZE, fread(back, 1, sizeof(back), f));
+    fclose(f);
+    TEST_ASSERT_EQUAL_MEMORY(s_file, back, TEST_FILE_SIZE);
+    TEST_ASSERT_FALSE(fs_exists(MOUNT_POINT "/~XFER.TMP"));
+
+    cdc_xfer_stats_t stats;
+    cdc_xfer_server_get_stats(srv, &stats);
+    TEST_ASSERT_EQUAL(1, stats.files_rx);
+    TEST_ASSERT_EQUAL(0, stats.crc_errors);
+    cdc_xfer_server_free(srv);
+}
+
+/**
+ * @test Corrupted Frame and Gap
+ *
+ * Verifies that a frame with a flipped bit is dropped without losing the
+ * frame after it, that a gap is answered with one NAK, and that an END
+ * with the wrong CRC fails the session.
+ */
+TEST_CASE("CDC Transfer: Corrupted Frame and Gap", "[cdc_transfer]") {
+    cdc_xfer_server_t *srv = test_server();
+    test_open_write(srv, "GAP.BIN");
+    TEST_ASSERT_EQUAL(CDC_XFER_OK, s_sent[0].type);
+
+    /* Frame 0 damaged in transit, immediately followed by frame 1 */
+    static uint8_t stream[2 * CDC_XFER_FRAME_SIZE(TEST_PAYLOAD)];
+    size_t size = cdc_xfer_frame_encode(stream, CDC_XFER_DATA, 0, s_file, TEST_PAYLOAD);
+    stream[100] ^= 0x10;
+    size += cdc_xfer_frame_encode(stream + size, CDC_XFER_DATA, 1, s_file + TEST_PAYLOAD, TEST_PAYLOAD);
+    cdc_xfer_server_input(srv, stream, size, 0);
+    test_feed_data(srv, 2, 64);
+
+    TEST_ASSERT_EQUAL(2, s_sent_count);
+    TEST_ASSERT_EQUAL(CDC_XFER_NAK, s_sent[1].type);
+    TEST_ASSERT_EQUAL(0, s_sent[1].seq);
+
+    /* Go back: frames 0.. are accepted again */
+    test_feed_data(srv, 0, 64);
+    test_feed_data(srv, 1, 64);
+    TEST_ASSERT_EQUAL(CDC_XFER_ACK, s_sent[2].type);
+    TEST_ASSERT_EQUAL(2, s_sent[2].seq);
+
+    uint32_t end[2] = { 2 * TEST_PAYLOAD, 0 };
+    test_feed(srv, CDC_XFER_END, 2, end, sizeof(end), 64);
+    TEST_ASSERT_EQUAL(CDC_XFER_ERR, s_sent[3].type);
+    TEST_ASSERT_EQUAL(CDC_XFER_ERR_CHECK, s_sent[3].payload[0]);
+    TEST_ASSERT_FALSE(fs_exists(MOUNT_POINT "/GAP.BIN"));
+
+    cdc_xfer_stats_t stats;
+    cdc_xfer_server_get_stats(srv, &stats);
+    TEST_ASSERT_EQUAL(1, stats.crc_errors);
+    cdc_xfer_server_free(srv);
+}
+
+/**
+ * @test Read Session
+ *
+ * Verifies that the engine keeps at most a window of DATA frames
+ * unacknowledged, goes back on NAK and ends with the CRC of the file.
+ */
+TEST_CASE("CDC Transfer: Read Session", "[cdc_transfer]") {
+    cdc_xfer_server_t *srv = test_server();
+    const uint32_t frames = (TEST_FILE_SIZE + TEST_PAYLOAD - 1) / TEST_PAYLOAD;
+    FILE *f = fopen(MOUNT_POINT "/READ.BIN", "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(TEST_FILE_SIZE, fwrite(s_file, 1, TEST_FILE_SIZE, f));
+    fclose(f);
+
+    test_feed(srv, CDC_XFER_OPEN_READ, 0, "READ.BIN", 8, 64);
+    TEST_ASSERT_EQUAL(CDC_XFER_OK, s_sent[0].type);
+    TEST_ASSERT_EQUAL(TEST_FILE_SIZE, s_sent[0].payload[0] | (s_sent[0].payload[1] << 8));
+
+    cdc_xfer_server_poll(srv, 0);
+    TEST_ASSERT_EQUAL(1 + TEST_WINDOW, s_sent_count);
+    for (uint32_t i = 0; i < TEST_WINDOW; i++) {
+        TEST_ASSERT_EQUAL(CDC_XFER_DATA, s_sent[1 + i].type);
+        TEST_ASSERT_EQUAL(i, s_sent[1 + i].seq);
+        TEST_ASSERT_EQUAL_MEMORY(s_file + i * TEST_PAYLOAD, s_sent[1 + i].payload, TEST_PAYLOAD);
+    }
+
+    /* Frame 3 lost: NAK(3) sends 3, 4 and the last frame */
+    test_feed(srv, CDC_XFER_NAK, 3, NULL, 0, 64);
+    s_sent_count = 0;
+    cdc_xfer_server_poll(srv, 10);
+    TEST_ASSERT_EQUAL(frames - 3, s_sent_count);
+    TEST_ASSERT_EQUAL(3, s_sent[0].seq);
+    TEST_ASSERT_EQUAL(frames - 1, s_sent[frames - 4].seq);
+    TEST_ASSERT_EQUAL(100, s_sent[frames - 4].len);
+
+    test_feed(srv, CDC_XFER_ACK, frames, NULL, 0, 64);
+    s_sent_count = 0;
+    cdc_xfer_server_poll(srv, 20);
+    TEST_ASSERT_EQUAL(1, s_sent_count);
+    TEST_ASSERT_EQUAL(CDC_XFER_END, s_sent[0].type);
+    TEST_ASSERT_EQUAL(frames, s_sent[0].seq);
+    uint32_t end[2];
+    memcpy(end, s_sent[0].payload, sizeof(end));
+    TEST_ASSERT_EQUAL(TEST_FILE_SIZE, end[0]);
+    TEST_ASSERT_EQUAL_HEX32(checksum_crc32(0, s_file, TEST_FILE_SIZE), end[1]);
+
+    test_feed(srv, CDC_XFER_OK, frames, NULL, 0, 64);
+    TEST_ASSERT_FALSE(cdc_xfer_server_busy(srv));
+
+    cdc_xfer_stats_t stats;
+    cdc_xfer_server_get_stats(srv, &stats);
+    TEST_ASSERT_EQUAL(1, stats.files_tx);
+    TEST_ASSERT_EQUAL(1, stats.retransmits);
+    cdc_xfer_server_free(srv);
+    unlink(MOUNT_POINT "/READ.BIN");
+}
+
+/**
+ * @test Paths Outside the Volume
+ *
+ * Verifies that ".." components and empty paths are rejected.
+ */
+TEST_CASE("CDC Transfer: Paths Outside the Volume Rejected", "[cdc_transfer]") {
+    cdc_xfer_server_t *srv = test_server();
+    const char *paths[] = { "../X.BIN", "A/../../X.BIN", "/", ".." };
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        test_feed(srv, CDC_XFER_OPEN_READ, 0, paths[i], (uint16_t)strlen(paths[i]), 64);
+        TEST_ASSERT_EQUAL(i + 1, s_sent_count);
+        TEST_ASSERT_EQUAL(CDC_XFER_ERR, s_sent[i].type);
+        TEST_ASSERT_EQUAL(CDC_XFER_ERR_INVAL, s_sent[i].payload[0]);
+    }
+    TEST_ASSERT_FALSE(cdc_xfer_server_busy(srv));
+    cdc_xfer_server_free(srv);
+}
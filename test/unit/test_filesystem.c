@@ -17,6 +17,12 @@
  * - Filesystem statistics
  * - Filesystem mount/unmount
  * - Filesystem remount
+ * - Free-space cache across remounts and host writes
+ * - Concurrent readers and lock statistics
+ * - Record store append/export, torn-tail recovery and records/sec benchmark
+ * - Volume profile
+ * - Volume alignment and re-align migration, refused without RAM
+ * - Online volume growth
  *
  * @section contact Contact
  * - Email: ansarirahim1@gmail.com
@@ -27,10 +33,20 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include "unity.h"
 #include "filesystem.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <dirent.h>
 
 /**
  * @brief Setup function called before each test
@@ -242,3 +258,458 @@ TEST_CASE("FS: Multiple File Operations", "[filesystem]") {
     TEST_ASSERT_TRUE(exists);
 }
 
+
+/**
+ * @test Free-Space Cache - Survives Remount
+ *
+ * Verifies that the remount after a clean unmount is seeded from the NVS
+ * cache, and that the restored free-space figures match the ones FatFs
+ * computed before it.
+ */
+TEST_CASE("FS: Free-Space Cache - Survives Remount", "[filesystem]") {
+    fs_stats_t stats1, stats2;
+
+    TEST_ASSERT_TRUE(fs_write_test_file());
+    TEST_ASSERT_TRUE(fs_get_stats_ex(&stats1));
+
+    TEST_ASSERT_TRUE(fs_unmount());
+    TEST_ASSERT_TRUE(fs_remount());
+
+    TEST_ASSERT_TRUE(fs_get_stats_ex(&stats2));
+    TEST_ASSERT_EQUAL_UINT32(stats1.free_cache_hits + 1, stats2.free_cache_hits);
+    TEST_ASSERT_EQUAL(stats1.total_bytes, stats2.total_bytes);
+    TEST_ASSERT_EQUAL(stats1.free_bytes, stats2.free_bytes);
+}
+
+/**
+ * @test Free-Space Cache - Invalidate Rescans
+ *
+ * Verifies that invalidating the cache forces a rescan that yields the
+ * same free-space figures.
+ */
+TEST_CASE("FS: Free-Space Cache - Invalidate Rescans", "[filesystem]") {
+    uint64_t total1 = 0, free1 = 0;
+    uint64_t total2 = 0, free2 = 0;
+
+    TEST_ASSERT_TRUE(fs_get_stats(&total1, &free1));
+    fs_invalidate_free_cache();
+    TEST_ASSERT_TRUE(fs_get_stats(&total2, &free2));
+
+    TEST_ASSERT_EQUAL(total1, total2);
+    TEST_ASSERT_EQUAL(free1, free2);
+}
+
+/**
+ * @test Free-Space Cache - Host Write While Unmounted
+ *
+ * Hands the unmounted volume to a simulated USB host, which mounts it on
+ * its own and allocates a file behind the module's back. The next mount
+ * must rescan instead of trusting the count saved by the clean unmount.
+ */
+TEST_CASE("FS: Free-Space Cache - Host Write While Unmounted", "[filesystem]") {
+    uint64_t total = 0, free_before = 0, free_after = 0, free_rescan = 0;
+    fs_stats_t stats1, stats2;
+
+    TEST_ASSERT_TRUE(fs_get_stats_ex(&stats1));
+    TEST_ASSERT_TRUE(fs_get_stats(&total, &free_before));
+    TEST_ASSERT_TRUE(fs_unmount());
+
+    /* Handed to USB, as fs_detach_volume() does before a host gets the volume */
+    fs_invalidate_free_cache();
+
+    /* The host writes 64 KiB through its own FAT driver */
+    wl_handle_t wl = WL_INVALID_HANDLE;
+    const esp_vfs_fat_mount_config_t host_cfg = {
+        .format_if_mount_failed = false,
+        .max_files = 1,
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, esp_vfs_fat_spiflash_mount_rw_wl("/host", "storage", &host_cfg, &wl));
+    FILE *f = fopen("/host/host.bin", "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    static uint8_t chunk[4096];
+    memset(chunk, 0x5a, sizeof(chunk));
+    for (int i = 0; i < 16; i++) {
+        TEST_ASSERT_EQUAL(sizeof(chunk), fwrite(chunk, 1, sizeof(chunk), f));
+    }
+    fclose(f);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_vfs_fat_spiflash_unmount_rw_wl("/host", wl));
+
+    TEST_ASSERT_TRUE(fs_remount());
+    TEST_ASSERT_TRUE(fs_get_stats_ex(&stats2));
+    TEST_ASSERT_EQUAL_UINT32(stats1.free_cache_hits, stats2.free_cache_hits);
+    TEST_ASSERT_TRUE(fs_get_stats(&total, &free_after));
+    fs_invalidate_free_cache();
+    TEST_ASSERT_TRUE(fs_get_stats(&total, &free_rescan));
+
+    TEST_ASSERT_EQUAL(free_rescan, free_after);
+    TEST_ASSERT_LESS_OR_EQUAL(free_before - 16 * sizeof(chunk), free_after);
+
+    unlink(MOUNT_POINT "/host.bin");
+}
+
+/**
+ * @test Lock Statistics - Counters Advance
+ *
+ * Verifies that read and write lock acquisitions are reported through the
+ * extended statistics API.
+ */
+TEST_CASE("FS: Lock Statistics - Counters Advance", "[filesystem]") {
+    fs_stats_t before, after;
+
+    TEST_ASSERT_TRUE(fs_get_stats_ex(&before));
+    TEST_ASSERT_TRUE(before.mounted);
+
+    fs_exists("/storage/README.txt");
+    TEST_ASSERT_TRUE(fs_write_test_file());
+
+    TEST_ASSERT_TRUE(fs_get_stats_ex(&after));
+    /* fs_exists() and the nested fs_get_stats() of the first call */
+    TEST_ASSERT_GREATER_OR_EQUAL(before.lock.read_locks + 2, after.lock.read_locks);
+    TEST_ASSERT_GREATER_OR_EQUAL(before.lock.write_locks + 1, after.lock.write_locks);
+    TEST_ASSERT_GREATER_THAN(0, after.total_bytes);
+}
+
+/**
+ * @test Lock Statistics - NULL Pointer
+ *
+ * Verifies that fs_get_stats_ex handles a NULL pointer.
+ */
+TEST_CASE("FS: Lock Statistics - NULL Pointer", "[filesystem]") {
+    TEST_ASSERT_FALSE(fs_get_stats_ex(NULL));
+}
+
+#define READER_ITERATIONS 200
+
+static SemaphoreHandle_t s_reader_done;
+
+static void reader_task(void *arg) {
+    int *hits = (int *)arg;
+    for (int i = 0; i < READER_ITERATIONS; i++) {
+        if (fs_exists("/storage/README.txt")) {
+            (*hits)++;
+        }
+    }
+    xSemaphoreGive(s_reader_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @test Concurrent Readers Across Cores
+ *
+ * Verifies that stat operations from both cores, interleaved with writes,
+ * all complete and see the file.
+ */
+TEST_CASE("FS: Concurrent Readers Across Cores", "[filesystem]") {
+    int hits[2] = {0, 0};
+
+    s_reader_done = xSemaphoreCreateCounting(2, 0);
+    TEST_ASSERT_NOT_NULL(s_reader_done);
+
+    xTaskCreatePinnedToCore(reader_task, "fs_rd0", 4096, &hits[0], 5, NULL, 0);
+    xTaskCreatePinnedToCore(reader_task, "fs_rd1", 4096, &hits[1], 5, NULL, 1);
+
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(fs_write_test_file());
+    }
+
+    TEST_ASSERT_TRUE(xSemaphoreTake(s_reader_done, pdMS_TO_TICKS(10000)));
+    TEST_ASSERT_TRUE(xSemaphoreTake(s_reader_done, pdMS_TO_TICKS(10000)));
+    vSemaphoreDelete(s_reader_done);
+
+    TEST_ASSERT_EQUAL(READER_ITERATIONS, hits[0]);
+    TEST_ASSERT_EQUAL(READER_ITERATIONS, hits[1]);
+}
+
+/**
+ * @test Record Store - Append and Export
+ *
+ * Verifies that appended records are exported one per line, in order.
+ */
+TEST_CASE("FS: Record Store - Append and Export", "[filesystem]") {
+    fs_log_t *log = fs_log_open("unittest");
+    TEST_ASSERT_NOT_NULL(log);
+
+    /* Start from a known state: export what is already there */
+    int existing = fs_log_export(log, "/storage/unittest.log");
+    TEST_ASSERT_GREATER_OR_EQUAL(0, existing);
+
+    TEST_ASSERT_TRUE(fs_log_append(log, "first", 5));
+    TEST_ASSERT_TRUE(fs_log_append(log, "second\n", 7));
+
+    int exported = fs_log_export(log, "/storage/unittest.log");
+    TEST_ASSERT_EQUAL(existing + 2, exported);
+
+    FILE *f = fopen("/storage/unittest.log", "r");
+    TEST_ASSERT_NOT_NULL(f);
+    char line[64], last[64] = "", prev[64] = "";
+    while (fgets(line, sizeof(line), f)) {
+        strcpy(prev, last);
+        strcpy(last, line);
+    }
+    fclose(f);
+    TEST_ASSERT_EQUAL_STRING("first\n", prev);
+    TEST_ASSERT_EQUAL_STRING("second\n", last);
+
+    fs_log_close(log);
+}
+
+/**
+ * @test Record Store - Invalid Arguments
+ *
+ * Verifies that the record store rejects bad names, duplicate opens and
+ * oversized records.
+ */
+TEST_CASE("FS: Record Store - Invalid Arguments", "[filesystem]") {
+    static uint8_t big[FS_LOG_RECORD_MAX + 1];
+
+    TEST_ASSERT_NULL(fs_log_open(NULL));
+    TEST_ASSERT_NULL(fs_log_open(""));
+    TEST_ASSERT_NULL(fs_log_open("a/b"));
+
+    fs_log_t *log = fs_log_open("unittest");
+    TEST_ASSERT_NOT_NULL(log);
+    TEST_ASSERT_NULL(fs_log_open("unittest"));
+
+    TEST_ASSERT_FALSE(fs_log_append(log, big, sizeof(big)));
+    TEST_ASSERT_FALSE(fs_log_append(log, big, 0));
+    TEST_ASSERT_FALSE(fs_log_append(NULL, big, 1));
+
+    fs_log_close(log);
+}
+
+/**
+ * @brief Remove all segments of a record log
+ */
+static void remove_log_segments(const char *prefix) {
+    DIR *dir = opendir("/storage/records");
+    if (!dir) {
+        return;
+    }
+    struct dirent *de;
+    char path[64];
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, prefix, strlen(prefix)) == 0) {
+            snprintf(path, sizeof(path), "/storage/records/%s", de->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+/**
+ * @test Record Store - Torn Tail Recovery
+ *
+ * Simulates a power loss during a flush by appending a partial record to
+ * the segment, and verifies that records appended after reopening are
+ * still exported.
+ */
+TEST_CASE("FS: Record Store - Torn Tail Recovery", "[filesystem]") {
+    remove_log_segments("torn_");
+
+    fs_log_t *log = fs_log_open("torn");
+    TEST_ASSERT_NOT_NULL(log);
+    TEST_ASSERT_TRUE(fs_log_append(log, "before\n", 7));
+    fs_log_close(log);
+
+    /* Header of a 100-byte record followed by only part of its payload */
+    FILE *f = fopen("/storage/records/torn_00000.seg", "ab");
+    TEST_ASSERT_NOT_NULL(f);
+    const uint8_t torn[] = {0x43, 0x52, 100, 0, 0xde, 0xad, 0xbe, 0xef, 'x', 'x'};
+    TEST_ASSERT_EQUAL(sizeof(torn), fwrite(torn, 1, sizeof(torn), f));
+    fclose(f);
+
+    log = fs_log_open("torn");
+    TEST_ASSERT_NOT_NULL(log);
+    TEST_ASSERT_TRUE(fs_log_append(log, "after\n", 6));
+    TEST_ASSERT_EQUAL(2, fs_log_export(log, "/storage/torn.log"));
+    fs_log_close(log);
+
+    f = fopen("/storage/torn.log", "r");
+    TEST_ASSERT_NOT_NULL(f);
+    char line[32];
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+    TEST_ASSERT_EQUAL_STRING("before\n", line);
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+    TEST_ASSERT_EQUAL_STRING("after\n", line);
+    fclose(f);
+
+    unlink("/storage/torn.log");
+    remove_log_segments("torn_");
+}
+
+#define BENCH_RECORDS       200
+#define BENCH_RECORD_SIZE   48
+
+/**
+ * @test Record Store - Benchmark vs One File per Record
+ *
+ * Measures records/sec of the packed record store against writing every
+ * record to its own file. Not part of the default run.
+ */
+TEST_CASE("FS: Record Store - Benchmark vs One File per Record", "[filesystem][bench]") {
+    char rec[BENCH_RECORD_SIZE];
+    memset(rec, 'x', sizeof(rec));
+    rec[sizeof(rec) - 1] = '\n';
+
+    /* Packed record store */
+    fs_log_t *log = fs_log_open("bench");
+    TEST_ASSERT_NOT_NULL(log);
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_RECORDS; i++) {
+        TEST_ASSERT_TRUE(fs_log_append(log, rec, sizeof(rec)));
+    }
+    TEST_ASSERT_TRUE(fs_log_flush(log));
+    int64_t packed_us = esp_timer_get_time() - start;
+    fs_log_close(log);
+
+    /* One file per record */
+    mkdir("/storage/bench", 0755);
+    start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_RECORDS; i++) {
+        char path[48];
+        snprintf(path, sizeof(path), "/storage/bench/r%04d.txt", i);
+        FILE *f = fopen(path, "w");
+        TEST_ASSERT_NOT_NULL(f);
+        fwrite(rec, 1, sizeof(rec), f);
+        fclose(f);
+    }
+    int64_t files_us = esp_timer_get_time() - start;
+
+    for (int i = 0; i < BENCH_RECORDS; i++) {
+        char path[48];
+        snprintf(path, sizeof(path), "/storage/bench/r%04d.txt", i);
+        unlink(path);
+    }
+    rmdir("/storage/bench");
+
+    uint32_t packed_rps = (uint32_t)((int64_t)BENCH_RECORDS * 1000000 / (packed_us ? packed_us : 1));
+    uint32_t files_rps = (uint32_t)((int64_t)BENCH_RECORDS * 1000000 / (files_us ? files_us : 1));
+    printf("Record store: %u records/sec, one file per record: %u records/sec\n",
+           (unsigned)packed_rps, (unsigned)files_rps);
+
+    TEST_ASSERT_GREATER_THAN(files_rps, packed_rps);
+}
+
+/**
+ * @test Volume Profile - Matches Mounted Volume
+ *
+ * Verifies that the profile is sane and that the mounted volume uses the
+ * profile's cluster size.
+ */
+TEST_CASE("FS: Volume Profile - Matches Mounted Volume", "[filesystem]") {
+    const fs_volume_profile_t *profile = fs_get_volume_profile();
+    TEST_ASSERT_NOT_NULL(profile);
+    TEST_ASSERT_GREATER_THAN(0, profile->max_files);
+    TEST_ASSERT_TRUE(profile->n_fats == 1 || profile->n_fats == 2);
+
+    struct statvfs vfs;
+    TEST_ASSERT_EQUAL(0, statvfs("/storage", &vfs));
+    TEST_ASSERT_EQUAL(profile->allocation_unit_size, vfs.f_bsize);
+}
+
+/**
+ * @test Volume Alignment - Formatted Volume Is Aligned
+ *
+ * Verifies that a volume formatted by the firmware has its data area on a
+ * cluster and erase block boundary.
+ */
+TEST_CASE("FS: Volume Alignment - Formatted Volume Is Aligned", "[filesystem]") {
+    TEST_ASSERT_TRUE(fs_volume_is_aligned());
+}
+
+/**
+ * @test Volume Alignment - Re-align Preserves Files
+ *
+ * Verifies that the re-align migration keeps file contents and leaves an
+ * aligned volume.
+ */
+TEST_CASE("FS: Volume Alignment - Re-align Preserves Files", "[filesystem]") {
+    TEST_ASSERT_TRUE(fs_write_test_file());
+
+    TEST_ASSERT_TRUE(fs_realign_volume());
+
+    TEST_ASSERT_TRUE(fs_exists("/storage/README.txt"));
+    TEST_ASSERT_TRUE(fs_exists("/storage/test_write.txt"));
+    TEST_ASSERT_TRUE(fs_volume_is_aligned());
+}
+
+/**
+ * @test Volume Alignment - Re-align Refused Without RAM
+ *
+ * Verifies that the migration is refused before the volume is touched when
+ * its contents don't fit in the free heap.
+ */
+TEST_CASE("FS: Volume Alignment - Re-align Refused Without RAM", "[filesystem]") {
+    TEST_ASSERT_TRUE(fs_write_test_file());
+
+    /* Take the heap in 16 KiB blocks, each block links to the previous one */
+    void *hog = NULL;
+    void *block;
+    while ((block = malloc(16 * 1024)) != NULL) {
+        *(void **)block = hog;
+        hog = block;
+    }
+
+    bool ok = fs_realign_volume();
+
+    while (hog) {
+        block = hog;
+        hog = *(void **)block;
+        free(block);
+    }
+
+    TEST_ASSERT_FALSE(ok);
+    TEST_ASSERT_TRUE(fs_exists("/storage/test_write.txt"));
+    TEST_ASSERT_TRUE(fs_write_test_file());
+}
+
+/**
+ * @test Volume Growth - Grow to Maximum
+ *
+ * Verifies that growing the volume never shrinks it, keeps files and that
+ * a second grow to maximum is a no-op.
+ */
+TEST_CASE("FS: Volume Growth - Grow to Maximum", "[filesystem]") {
+    uint32_t before = 0, after = 0, again = 0, ssize = 0;
+
+    TEST_ASSERT_TRUE(fs_get_volume_info(&before, &ssize));
+    TEST_ASSERT_TRUE(fs_grow_volume(0));
+    TEST_ASSERT_TRUE(fs_get_volume_info(&after, &ssize));
+    TEST_ASSERT_GREATER_OR_EQUAL(before, after);
+    TEST_ASSERT_TRUE(fs_exists("/storage/README.txt"));
+
+    TEST_ASSERT_TRUE(fs_grow_volume(0));
+    TEST_ASSERT_TRUE(fs_get_volume_info(&again, &ssize));
+    TEST_ASSERT_EQUAL(after, again);
+}
+
+/**
+ * @test Volume Growth - Shrink Rejected
+ *
+ * Verifies that a size smaller than the current volume is rejected.
+ */
+TEST_CASE("FS: Volume Growth - Shrink Rejected", "[filesystem]") {
+    uint32_t sectors = 0, ssize = 0;
+
+    TEST_ASSERT_TRUE(fs_get_volume_info(&sectors, &ssize));
+    TEST_ASSERT_FALSE(fs_grow_volume((uint64_t)ssize));
+}
+
+/**
+ * @test Volume Growth - Refused With Open File
+ *
+ * Verifies that the volume isn't remounted under an open file handle, and
+ * that growth succeeds once the file is closed.
+ */
+TEST_CASE("FS: Volume Growth - Refused With Open File", "[filesystem]") {
+    FILE *f = fopen("/storage/README.txt", "r");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_FALSE(fs_grow_volume(0));
+
+    /* The handle must still be usable */
+    char c;
+    TEST_ASSERT_EQUAL(1, fread(&c, 1, 1, f));
+    fclose(f);
+
+    TEST_ASSERT_TRUE(fs_grow_volume(0));
+}
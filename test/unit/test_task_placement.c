@@ -0,0 +1,88 @@
+/**
+ * @file test_task_placement.c
+ * @brief Unit Tests for Task Placement
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Checks the placement table lookups, the group to core mapping of the
+ * configured placement, and that a task created from the table runs on
+ * its group's core.
+ *
+ * @section test_cases Test Cases
+ * - Table lookups and core mapping
+ * - Created task runs on its core
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include "unity.h"
+#include "task_placement.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static volatile int g_ran_on;
+
+/**
+ * @test Table Lookups
+ *
+ * Verifies the groups of I/O and housekeeping tasks, unknown names and
+ * the core of each group under the configured placement.
+ */
+TEST_CASE("Task Placement: Table Lookups", "[task_placement]") {
+    const task_placement_t *usb = task_placement_find("TinyUSB");
+    TEST_ASSERT_NOT_NULL(usb);
+    TEST_ASSERT_EQUAL(TASK_GROUP_IO, usb->group);
+    TEST_ASSERT_GREATER_THAN(0, usb->stack_size);
+
+    const task_placement_t *led = task_placement_find("led_blink");
+    TEST_ASSERT_NOT_NULL(led);
+    TEST_ASSERT_EQUAL(TASK_GROUP_HOUSEKEEPING, led->group);
+    TEST_ASSERT_NULL(task_placement_find("no_such_task"));
+
+    const BaseType_t io = task_placement_core(TASK_GROUP_IO);
+    const BaseType_t hk = task_placement_core(TASK_GROUP_HOUSEKEEPING);
+#if CONFIG_TASK_PLACEMENT_SPLIT
+    TEST_ASSERT_EQUAL(CONFIG_TASK_PLACEMENT_IO_CORE, io);
+    TEST_ASSERT_EQUAL(1 - CONFIG_TASK_PLACEMENT_IO_CORE, hk);
+    TEST_ASSERT_EQUAL_STRING("split", task_placement_mode());
+#elif CONFIG_TASK_PLACEMENT_SHARED
+    TEST_ASSERT_EQUAL(io, hk);
+    TEST_ASSERT_EQUAL_STRING("shared", task_placement_mode());
+#else
+    TEST_ASSERT_EQUAL(tskNO_AFFINITY, io);
+    TEST_ASSERT_EQUAL(tskNO_AFFINITY, hk);
+#endif
+}
+
+static void record_core(void *arg) {
+    (void)arg;
+    g_ran_on = xPortGetCoreID();
+    vTaskDelete(NULL);
+}
+
+/**
+ * @test Created Task Core
+ *
+ * Creates a task from the table and checks where it ran and that names
+ * outside the table are refused.
+ */
+TEST_CASE("Task Placement: Created Task Core", "[task_placement]") {
+    g_ran_on = -1;
+    TaskHandle_t task = NULL;
+    TEST_ASSERT_TRUE(task_placement_create(record_core, "hk_load", NULL, &task));
+    for (int i = 0; i < 50 && g_ran_on < 0; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(0, g_ran_on);
+
+    const BaseType_t core = task_placement_core(TASK_GROUP_HOUSEKEEPING);
+    if (core != tskNO_AFFINITY) {
+        TEST_ASSERT_EQUAL(core, g_ran_on);
+    }
+
+    TEST_ASSERT_FALSE(task_placement_create(record_core, "no_such_task", NULL, NULL));
+}
@@ -0,0 +1,149 @@
+/**
+ * @file test_task_profile.c
+ * @brief Unit Tests for the Task Profiler
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Checks the stack recommendation rule, the semaphore wait bookkeeping of
+ * TASK_PROFILE_TAKE() and what the sampler reports for a busy task with
+ * a known stack size.
+ *
+ * @section test_cases Test Cases
+ * - Stack recommendation rounding and floor
+ * - Semaphore waits, blocked time and timeouts
+ * - CPU share, stack size and wake-ups of a busy task
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include <string.h>
+#include "unity.h"
+#include "task_profile.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define TEST_SPIN_STACK     4096
+
+static volatile bool g_spin;
+
+/** Finds a semaphore's statistics, false if it isn't tracked */
+static bool find_sem(SemaphoreHandle_t sem, task_profile_sem_t *out) {
+    static task_profile_sem_t sems[TASK_PROFILE_MAX_SEMS];
+    const size_t n = task_profile_get_sems(sems, TASK_PROFILE_MAX_SEMS);
+    for (size_t i = 0; i < n; i++) {
+        if (sems[i].handle == sem) {
+            *out = sems[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @test Stack Recommendation
+ *
+ * Verifies the headroom, the 256-byte rounding and the minimum size.
+ */
+TEST_CASE("Task Profile: Stack Recommendation", "[task_profile]") {
+    /* 1048 B used, plus 25 %, rounded up */
+    TEST_ASSERT_EQUAL(1536, task_profile_recommend_stack(2048, 1000));
+    TEST_ASSERT_EQUAL(4096, task_profile_recommend_stack(4096, 900));
+    /* Nearly unused stacks don't go below the FreeRTOS minimum */
+    TEST_ASSERT_GREATER_OR_EQUAL(configMINIMAL_STACK_SIZE, task_profile_recommend_stack(2048, 2000));
+    TEST_ASSERT_EQUAL(0, task_profile_recommend_stack(2048, 2000) % TASK_PROFILE_STACK_ALIGN);
+}
+
+static void give_later(void *arg) {
+    vTaskDelay(pdMS_TO_TICKS(20));
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @test Semaphore Waits
+ *
+ * Takes a semaphore once without waiting, once after another task gives
+ * it 20 ms later, and once until timeout.
+ */
+TEST_CASE("Task Profile: Semaphore Waits", "[task_profile]") {
+    SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(sem);
+    TASK_PROFILE_NAME(sem, "test_sem");
+
+    xSemaphoreGive(sem);
+    TEST_ASSERT_TRUE(TASK_PROFILE_TAKE(sem, pdMS_TO_TICKS(100)));
+
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(give_later, "give_later", 2048, sem, 5, NULL));
+    TEST_ASSERT_TRUE(TASK_PROFILE_TAKE(sem, pdMS_TO_TICKS(1000)));
+    TEST_ASSERT_FALSE(TASK_PROFILE_TAKE(sem, pdMS_TO_TICKS(10)));
+
+    task_profile_sem_t s;
+    TEST_ASSERT_TRUE(find_sem(sem, &s));
+    TEST_ASSERT_EQUAL_STRING("test_sem", s.name);
+    TEST_ASSERT_EQUAL(3, s.takes);
+    TEST_ASSERT_EQUAL(2, s.waits);
+    TEST_ASSERT_EQUAL(1, s.timeouts);
+    TEST_ASSERT_GREATER_OR_EQUAL(15000, s.max_blocked_us);
+    TEST_ASSERT_GREATER_OR_EQUAL(s.max_blocked_us + 5000, s.blocked_us);
+
+    vSemaphoreDelete(sem);
+}
+
+static void spin_task(void *arg) {
+    (void)arg;
+    volatile uint8_t frame[1024];
+    memset((void *)frame, 0xA5, sizeof(frame));
+    while (g_spin) {
+        /* Busy for 9 ms, then one counted wake-up */
+        const TickType_t until = xTaskGetTickCount() + pdMS_TO_TICKS(9);
+        while ((int32_t)(xTaskGetTickCount() - until) < 0) {
+            frame[xTaskGetTickCount() % sizeof(frame)]++;
+        }
+        TASK_PROFILE_DELAY(1);
+    }
+    vTaskDelete(NULL);
+}
+
+/**
+ * @test Busy Task
+ *
+ * Runs a task pinned to core 1 that is busy about 90 % of the time and
+ * checks the sampled CPU share, stack size, high-water mark and wake-up
+ * rate.
+ */
+TEST_CASE("Task Profile: Busy Task", "[task_profile]") {
+    task_profile_init();
+
+    g_spin = true;
+    TaskHandle_t spin = NULL;
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(spin_task, "prof_spin", TEST_SPIN_STACK, NULL, 2, &spin, 1));
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_TASK_PROFILE_PERIOD_MS * 2 + 200));
+
+    static task_profile_task_t tasks[TASK_PROFILE_MAX_TASKS];
+    const size_t n = task_profile_get_tasks(tasks, TASK_PROFILE_MAX_TASKS);
+    const task_profile_task_t *t = NULL;
+    for (size_t i = 0; i < n; i++) {
+        if (tasks[i].handle == spin) {
+            t = &tasks[i];
+        }
+    }
+    g_spin = false;
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_STRING("prof_spin", t->name);
+    TEST_ASSERT_EQUAL(1, t->core);
+    TEST_ASSERT_EQUAL(2, t->priority);
+    TEST_ASSERT_GREATER_THAN(700, t->cpu_permille);
+    TEST_ASSERT_EQUAL(TEST_SPIN_STACK, t->stack_size);
+    /* The 1 KiB frame is in use */
+    TEST_ASSERT_LESS_THAN(TEST_SPIN_STACK - 1024, t->stack_min_free);
+    TEST_ASSERT_GREATER_OR_EQUAL(TEST_SPIN_STACK - t->stack_min_free, t->stack_recommended);
+    /* About 100 wake-ups per second */
+    TEST_ASSERT_INT_WITHIN(30, 100, t->wakeups_per_s);
+}
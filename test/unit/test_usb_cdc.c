@@ -0,0 +1,128 @@
+/**
+ * @file test_usb_cdc.c
+ * @brief Unit Tests for the CDC Channels and Their Rate Limiter
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ * @version 1.0.0
+ *
+ * @section description Description
+ * Tests the token bucket that limits the log channel, with explicit time
+ * stamps, and the command registry of the control channel.
+ *
+ * @section test_cases Test Cases
+ * - Token bucket starts full and caps bursts
+ * - Token bucket refill rate and wait time
+ * - Unlimited token bucket
+ * - Command registration
+ *
+ * @section license License
+ * Copyright (c) 2025 A.R. Ansari. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "unity.h"
+#include "token_bucket.h"
+#include "usb_cdc.h"
+
+/**
+ * @test Token Bucket Burst
+ *
+ * Verifies that a new bucket allows one burst, and that idle time never
+ * adds more than a burst.
+ */
+TEST_CASE("CDC: Token Bucket Burst", "[usb_cdc]") {
+    token_bucket_t tb;
+    token_bucket_init(&tb, 1000, 400, 0);
+
+    TEST_ASSERT_EQUAL(400, token_bucket_available(&tb, 0));
+    token_bucket_consume(&tb, 400);
+    TEST_ASSERT_EQUAL(0, token_bucket_available(&tb, 0));
+
+    /* An hour idle still gives one burst */
+    TEST_ASSERT_EQUAL(400, token_bucket_available(&tb, 3600LL * 1000000));
+    token_bucket_consume(&tb, 1000);
+    TEST_ASSERT_EQUAL(0, token_bucket_available(&tb, 3600LL * 1000000));
+}
+
+/**
+ * @test Token Bucket Rate
+ *
+ * Verifies that tokens accrue at the configured rate, including rates
+ * that are not a whole number of bytes per microsecond or millisecond,
+ * and that the wait time matches.
+ */
+TEST_CASE("CDC: Token Bucket Rate", "[usb_cdc]") {
+    token_bucket_t tb;
+    token_bucket_init(&tb, 3000, 4096, 0);
+    token_bucket_consume(&tb, token_bucket_available(&tb, 0));
+
+    /* 3000 B/s: one byte every 333.3 us */
+    TEST_ASSERT_EQUAL(0, token_bucket_available(&tb, 333));
+    TEST_ASSERT_EQUAL(1, token_bucket_available(&tb, 334));
+    TEST_ASSERT_EQUAL(3, token_bucket_available(&tb, 1000));
+    TEST_ASSERT_EQUAL(3000, token_bucket_available(&tb, 1000000));
+
+    /* Sending at the limit for ten seconds in 1 ms steps */
+    token_bucket_consume(&tb, 3000);
+    size_t sent = 0;
+    for (int64_t t = 1000000; t <= 11000000; t += 1000) {
+        size_t n = token_bucket_available(&tb, t);
+        token_bucket_consume(&tb, n);
+        sent += n;
+    }
+    TEST_ASSERT_INT_WITHIN(1, 30000, sent);
+
+    /* Wait time for 100 bytes from empty: 33.34 ms */
+    const int64_t now = 11000000;
+    token_bucket_consume(&tb, token_bucket_available(&tb, now));
+    uint32_t wait = token_bucket_wait_us(&tb, 100);
+    TEST_ASSERT_UINT32_WITHIN(334, 33334, wait);
+    TEST_ASSERT_GREATER_OR_EQUAL(100, token_bucket_available(&tb, now + wait));
+    /* Never more than a burst is waited for */
+    TEST_ASSERT_EQUAL(token_bucket_wait_us(&tb, 4096), token_bucket_wait_us(&tb, 100000));
+}
+
+/**
+ * @test Unlimited Token Bucket
+ *
+ * Verifies that rate 0 never limits.
+ */
+TEST_CASE("CDC: Token Bucket Unlimited", "[usb_cdc]") {
+    token_bucket_t tb;
+    token_bucket_init(&tb, 0, 64, 0);
+    TEST_ASSERT_EQUAL(SIZE_MAX, token_bucket_available(&tb, 0));
+    token_bucket_consume(&tb, 1 << 20);
+    TEST_ASSERT_EQUAL(SIZE_MAX, token_bucket_available(&tb, 0));
+    TEST_ASSERT_EQUAL(0, token_bucket_wait_us(&tb, 1 << 20));
+}
+
+static int test_cmd(int argc, char **argv) {
+    (void)argv;
+    return argc;
+}
+
+/**
+ * @test Command Registration
+ *
+ * Verifies that names are unique, the built-in commands can't be
+ * replaced and the table size is enforced.
+ */
+TEST_CASE("CDC: Command Registration", "[usb_cdc]") {
+    TEST_ASSERT_FALSE(usb_cdc_register_command("help", NULL, test_cmd));
+    TEST_ASSERT_FALSE(usb_cdc_register_command("two words", NULL, test_cmd));
+    TEST_ASSERT_FALSE(usb_cdc_register_command("", NULL, test_cmd));
+    TEST_ASSERT_FALSE(usb_cdc_register_command("nohandler", NULL, NULL));
+
+    static char names[USB_CDC_CMD_MAX][8];
+    int registered = 0;
+    for (int i = 0; i < USB_CDC_CMD_MAX; i++) {
+        snprintf(names[i], sizeof(names[i]), "t%d", i);
+        registered += usb_cdc_register_command(names[i], NULL, test_cmd);
+    }
+    /* Two slots are taken by "help" and "stats" */
+    TEST_ASSERT_EQUAL(USB_CDC_CMD_MAX - 2, registered);
+    TEST_ASSERT_FALSE(usb_cdc_register_command("t0", NULL, test_cmd));
+}
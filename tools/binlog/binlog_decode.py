@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+"""
+Decoder of the binary log (main/binlog.h).
+
+Reads the CDC log channel (or a capture of it), finds the binary log
+frames, looks the format strings and tags up in the firmware ELF and
+prints the records as ESP_LOG-style text lines. Text between frames (the
+ESP_LOG output copied by usb_cdc.c) is passed through unchanged.
+
+The frame and record layout is described in main/binlog.c. The ELF must
+be the one running on the device, records carry addresses into it.
+
+Needs nothing beyond the standard library.
+
+Usage:
+    binlog_decode.py build/esp32s3_dualusb_fw.elf /dev/ttyACM1
+    binlog_decode.py build/esp32s3_dualusb_fw.elf capture.bin > log.txt
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import termios
+import tty
+import zlib
+
+MAGIC = b"\xb1BL\x01"
+FRAME = struct.Struct("<4sBBHI")
+CRC = struct.Struct("<I")
+RECORD = struct.Struct("<IIII")
+COMMIT = 0xB1
+KIND_LOG = 1
+ARG_I32, ARG_I64, ARG_F64, ARG_STR = range(4)
+LEVELS = "NEWIDV"
+
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXeEfFgGcsp%])")
+
+
+class Elf:
+    """Loadable sections of an ELF32 file, read by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[4] != 1:
+            raise ValueError("%s: not an ELF32 file" % path)
+        shoff, = struct.unpack_from("<I", data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, stype, flags, addr, offset, size = struct.unpack_from("<IIIIII", data, shoff + i * shentsize)
+            # SHF_ALLOC, not SHT_NOBITS
+            if flags & 0x2 and stype != 8 and size:
+                self.sections.append((addr, data[offset:offset + size]))
+
+    def read(self, addr, size):
+        for base, content in self.sections:
+            if base <= addr and addr + size <= base + len(content):
+                return content[addr - base:addr - base + size]
+        raise KeyError("address 0x%08x not in the ELF" % addr)
+
+    def string(self, addr):
+        for base, content in self.sections:
+            if base <= addr < base + len(content):
+                end = content.find(b"\0", addr - base)
+                return content[addr - base:end if end >= 0 else None].decode(errors="replace")
+        raise KeyError("address 0x%08x not in the ELF" % addr)
+
+
+def render(fmt, args):
+    """printf() of a C format with decoded arguments."""
+    args = list(args)
+
+    def convert(m):
+        flags, width, prec, _, conv = m.groups()
+        if conv == "%":
+            return "%"
+        if width == "*":
+            width = str(args.pop(0))
+        if prec == "*":
+            prec = str(args.pop(0))
+        spec = "%" + flags + (width or "") + ("." + prec if prec else "")
+        value = args.pop(0) if args else None
+        if value is None:
+            return "<missing>"
+        if conv == "p":
+            return (spec + "s") % ("0x%08x" % value)
+        if conv == "c" and isinstance(value, int):
+            value = chr(value & 0xFF)
+            conv = "s"
+        try:
+            return (spec + conv) % value
+        except (TypeError, ValueError):
+            return "<%r>" % (value,)
+
+    return SPEC.sub(convert, fmt)
+
+
+class Decoder:
+    """Splits a byte stream into text and frames, and renders records."""
+
+    def __init__(self, elf, out):
+        self.elf = elf
+        self.out = out
+        self.rx = bytearray()
+        self.sites = {}
+        self.last_ts = {}
+        self.epoch = {}
+        self.dropped = {}
+        self.crc_errors = 0
+
+    def feed(self, data):
+        self.rx += data
+        rx = self.rx
+        pos = 0
+        while True:
+            i = rx.find(MAGIC, pos)
+            if i < 0:
+                # Keep what could be the start of a magic
+                keep = max(pos, len(rx) - len(MAGIC) + 1)
+                self._text(rx[pos:keep])
+                pos = keep
+                break
+            self._text(rx[pos:i])
+            pos = i
+            if len(rx) - pos < FRAME.size:
+                break
+            _, core, _, plen, dropped = FRAME.unpack_from(rx, pos)
+            end = pos + FRAME.size + plen
+            if len(rx) < end + CRC.size:
+                break
+            if zlib.crc32(memoryview(rx)[pos:end]) != CRC.unpack_from(rx, end)[0]:
+                self.crc_errors += 1
+                self._text(rx[pos:pos + 1])
+                pos += 1
+                continue
+            self._frame(core, dropped, bytes(rx[pos + FRAME.size:end]))
+            pos = end + CRC.size
+        del rx[:pos]
+
+    def _text(self, data):
+        if data:
+            self.out.write(bytes(data).decode(errors="replace"))
+
+    def _site(self, addr):
+        site = self.sites.get(addr)
+        if site is None:
+            fmt_addr, info = struct.unpack("<II", self.elf.read(addr, 8))
+            fmt = self.elf.string(fmt_addr)
+            types = [(info >> (4 + 2 * i)) & 3 for i in range(info & 0xF)]
+            site = self.sites[addr] = (fmt, types, (info >> 28) & 7)
+        return site
+
+    def _frame(self, core, dropped, payload):
+        lost = dropped - self.dropped.get(core, 0)
+        if lost > 0:
+            self.out.write("--- core %d: %d records dropped ---\n" % (core, lost))
+        self.dropped[core] = dropped
+
+        pos = 0
+        while pos + RECORD.size <= len(payload):
+            hdr, site_addr, tag_addr, ts = RECORD.unpack_from(payload, pos)
+            length = hdr & 0xFFFF
+            if hdr >> 24 != COMMIT or length < RECORD.size or pos + length > len(payload):
+                self.out.write("--- core %d: bad record ---\n" % core)
+                return
+            if (hdr >> 16) & 0xFF == KIND_LOG:
+                self._record(core, site_addr, tag_addr, ts, payload[pos + RECORD.size:pos + length])
+            pos += length
+
+    def _record(self, core, site_addr, tag_addr, ts, data):
+        # 32-bit microseconds, unwrapped per core
+        if ts < self.last_ts.get(core, 0):
+            self.epoch[core] = self.epoch.get(core, 0) + (1 << 32)
+        self.last_ts[core] = ts
+        us = self.epoch.get(core, 0) + ts
+
+        try:
+            fmt, types, level = self._site(site_addr)
+            tag = self.elf.string(tag_addr)
+        except KeyError as e:
+            self.out.write("--- core %d: %s, wrong ELF? ---\n" % (core, e))
+            return
+
+        args = []
+        pos = 0
+        for t, conv in zip(types, self._convs(fmt, len(types))):
+            if t == ARG_I32:
+                args.append(struct.unpack_from("<i" if conv in "di" else "<I", data, pos)[0])
+                pos += 4
+            elif t == ARG_I64:
+                args.append(struct.unpack_from("<q" if conv in "di" else "<Q", data, pos)[0])
+                pos += 8
+            elif t == ARG_F64:
+                args.append(struct.unpack_from("<d", data, pos)[0])
+                pos += 8
+            else:
+                n = data[pos]
+                args.append(data[pos + 1:pos + 1 + n].decode(errors="replace"))
+                pos += (1 + n + 3) & ~3
+        self.out.write("%s (%d.%03d) [%d] %s: %s\n" % (LEVELS[level] if level < len(LEVELS) else "?",
+                                                         us // 1000000, us // 1000 % 1000, core, tag,
+                                                         render(fmt, args)))
+
+    @staticmethod
+    def _convs(fmt, count):
+        """Conversion character of each argument, for the signedness of integers."""
+        convs = []
+        for m in SPEC.finditer(fmt):
+            _, width, prec, _, conv = m.groups()
+            if conv == "%":
+                continue
+            convs += ["d"] * ((width == "*") + (prec == "*")) + [conv]
+        return (convs + ["u"] * count)[:count]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("elf", help="firmware ELF running on the device")
+    parser.add_argument("input", help="CDC-ACM log tty of the device (e.g. /dev/ttyACM1), a capture file or -")
+    args = parser.parse_args()
+
+    decoder = Decoder(Elf(args.elf), sys.stdout)
+    if args.input == "-":
+        fd = sys.stdin.fileno()
+    else:
+        fd = os.open(args.input, os.O_RDONLY | os.O_NOCTTY)
+        if os.isatty(fd):
+            tty.setraw(fd)
+            termios.tcflush(fd, termios.TCIFLUSH)
+    try:
+        while True:
+            data = os.read(fd, 65536)
+            if not data:
+                break
+            decoder.feed(data)
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    if decoder.crc_errors:
+        print("%d frames with CRC errors" % decoder.crc_errors, file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
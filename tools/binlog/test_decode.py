@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""
+Tests of the binary log decoder.
+
+Builds a small ELF32 image holding format strings, tags and call-site
+records at flash addresses, encodes records and frames the way
+main/binlog.c lays them out, and checks the rendered text: argument types,
+text passthrough between frames, split reads, CRC errors, drop reports
+and time stamp wrap-around.
+
+Usage:
+    python3 tools/binlog/test_decode.py [-v]
+"""
+
+import io
+import os
+import struct
+import sys
+import tempfile
+import unittest
+import zlib
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, HERE)
+
+import binlog_decode  # noqa: E402
+
+BASE = 0x3C000000
+
+
+class Image:
+    """Flash rodata with strings and call sites, written out as an ELF32."""
+
+    def __init__(self):
+        self.data = bytearray()
+
+    def string(self, s):
+        addr = BASE + len(self.data)
+        self.data += s.encode() + b"\0"
+        self.data += b"\0" * (-len(self.data) % 4)
+        return addr
+
+    def site(self, fmt, level, types):
+        info = len(types) | (level << 28)
+        for i, t in enumerate(types):
+            info |= t << (4 + 2 * i)
+        fmt_addr = self.string(fmt)
+        addr = BASE + len(self.data)
+        self.data += struct.pack("<II", fmt_addr, info)
+        return addr
+
+    def write(self, path):
+        shoff = 52 + len(self.data)
+        shoff += -shoff % 4
+        header = b"\x7fELF\x01\x01\x01" + b"\0" * 9
+        header += struct.pack("<HHIIIIIHHHHHH", 2, 94, 1, BASE, 0, shoff, 0, 52, 0, 0, 40, 2, 0)
+        body = header + self.data
+        body += b"\0" * (shoff - len(body))
+        body += b"\0" * 40
+        # .flash.rodata: PROGBITS, SHF_ALLOC
+        body += struct.pack("<IIIIIIIIII", 0, 1, 0x2, BASE, 52, len(self.data), 0, 0, 4, 0)
+        with open(path, "wb") as f:
+            f.write(body)
+
+
+def record(site, tag, ts, args):
+    body = b""
+    for kind, value in args:
+        if kind == binlog_decode.ARG_I32:
+            body += struct.pack("<I", value & 0xFFFFFFFF)
+        elif kind == binlog_decode.ARG_I64:
+            body += struct.pack("<Q", value & 0xFFFFFFFFFFFFFFFF)
+        elif kind == binlog_decode.ARG_F64:
+            body += struct.pack("<d", value)
+        else:
+            s = value.encode()
+            body += bytes([len(s)]) + s + b"\0" * (-(1 + len(s)) % 4)
+    length = 16 + len(body)
+    return struct.pack("<IIII", length | (1 << 16) | (0xB1 << 24), site, tag, ts) + body
+
+
+def frame(core, dropped, records):
+    payload = b"".join(records)
+    head = binlog_decode.MAGIC + struct.pack("<BBHI", core, 0, len(payload), dropped)
+    return head + payload + struct.pack("<I", zlib.crc32(head + payload))
+
+
+class DecodeTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        I32, I64, F64, STR = range(4)
+        img = Image()
+        cls.tag = img.string("usb_host")
+        cls.read = img.site("Read %d bytes from %s", 3, [I32, STR])
+        cls.mixed = img.site("%u %x %lld %llu %.2f %c %p %5s|%%", 4, [I32, I32, I64, I64, F64, I32, I32, STR])
+        cls.err = img.site("Failed: %d", 1, [I32])
+        cls.I32, cls.I64, cls.F64, cls.STR = I32, I64, F64, STR
+        cls.tmp = tempfile.TemporaryDirectory()
+        path = os.path.join(cls.tmp.name, "fw.elf")
+        img.write(path)
+        cls.elf = binlog_decode.Elf(path)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tmp.cleanup()
+
+    def decode(self, chunks):
+        out = io.StringIO()
+        dec = binlog_decode.Decoder(self.elf, out)
+        for c in chunks:
+            dec.feed(c)
+        return out.getvalue(), dec
+
+    def test_arguments(self):
+        recs = [
+            record(self.read, self.tag, 1500000, [(self.I32, -2), (self.STR, "/usb/a.bin")]),
+            record(self.mixed, self.tag, 1500001, [(self.I32, 0xFFFFFFFF), (self.I32, 255), (self.I64, -5),
+                                                   (self.I64, 1 << 40), (self.F64, 3.14159), (self.I32, ord("z")),
+                                                   (self.I32, 0x3FC90000), (self.STR, "ab")]),
+        ]
+        text, _ = self.decode([frame(1, 0, recs)])
+        self.assertEqual(text.splitlines(), [
+            "I (1.500) [1] usb_host: Read -2 bytes from /usb/a.bin",
+            "D (1.500) [1] usb_host: 4294967295 ff -5 1099511627776 3.14 z 0x3fc90000    ab|%",
+        ])
+
+    def test_text_and_split_reads(self):
+        rec = record(self.err, self.tag, 10, [(self.I32, 7)])
+        stream = b"I (5) usb_cdc: hello\n" + frame(0, 0, [rec]) + b"tail \xb1B text\n" + frame(0, 0, [rec])
+        text, _ = self.decode([stream[i:i + 3] for i in range(0, len(stream), 3)])
+        self.assertEqual(text, "I (5) usb_cdc: hello\nE (0.000) [0] usb_host: Failed: 7\n"
+                               "tail �B text\nE (0.000) [0] usb_host: Failed: 7\n")
+
+    def test_crc_error_and_drops(self):
+        rec = record(self.err, self.tag, 10, [(self.I32, 1)])
+        bad = bytearray(frame(0, 0, [rec]))
+        bad[20] ^= 0x01
+        text, dec = self.decode([bytes(bad) + frame(0, 3, [rec])])
+        self.assertEqual(dec.crc_errors, 1)
+        self.assertIn("--- core 0: 3 records dropped ---\nE (0.000) [0] usb_host: Failed: 1\n", text)
+        self.assertEqual(text.count("Failed"), 1)
+
+    def test_timestamp_wrap(self):
+        a = record(self.err, self.tag, 0xFFFFFF00, [(self.I32, 1)])
+        b = record(self.err, self.tag, 0x100, [(self.I32, 2)])
+        text, _ = self.decode([frame(0, 0, [a]), frame(0, 0, [b])])
+        # 2^32 us is 4294.967296 s
+        self.assertEqual(text.splitlines()[1], "E (4294.967) [0] usb_host: Failed: 2")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+"""
+Reference client of the CDC file transfer protocol.
+
+Copies files to and from the internal FATFS volume over the CDC-ACM port
+when USB MSC is not available (volume ejected, USB storage blocked by
+policy). The frame format and sessions are described in
+main/cdc_transfer_proto.h: CRC32-checked frames, a window of DATA frames
+in flight, cumulative ACKs and go-back-N retransmission on NAK or timeout.
+
+Works on any tty (the firmware's /dev/ttyACMx, or the pty of loopback.c)
+and needs nothing beyond the standard library.
+
+Usage:
+    cdc_xfer.py /dev/ttyACM0 put local.bin [remote/path.bin]
+    cdc_xfer.py /dev/ttyACM0 get remote/path.bin [local.bin]
+"""
+
+import argparse
+import collections
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+import zlib
+
+MAGIC = b"XF"
+HEADER = struct.Struct("<2sBBIHH")
+CRC = struct.Struct("<I")
+
+HELLO, OPEN_READ, OPEN_WRITE, DATA, ACK, NAK, END, OK, ERR, ABORT = range(1, 11)
+
+ERRORS = {
+    1: "I/O error",
+    2: "no such file",
+    3: "volume full",
+    4: "volume in use over USB MSC",
+    5: "invalid request",
+    6: "size or CRC mismatch",
+    7: "no session",
+}
+
+
+class TransferError(Exception):
+    pass
+
+
+class Link:
+    """Frames over a tty in raw mode."""
+
+    def __init__(self, path):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        if os.isatty(self.fd):
+            tty.setraw(self.fd)
+            termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.rx = bytearray()
+        self.frames = collections.deque()
+        self.max_payload = 0xFFFF
+        self.crc_errors = 0
+
+    def close(self):
+        os.close(self.fd)
+
+    def send(self, ftype, seq, payload=b""):
+        header = HEADER.pack(MAGIC, ftype, 0, seq, len(payload), 0)[:-2]
+        frame = header + struct.pack("<H", zlib.crc32(header) & 0xFFFF) + payload
+        frame += CRC.pack(zlib.crc32(frame))
+        view = memoryview(frame)
+        while view:
+            # Keep reading while writing, the device may be blocked sending to us
+            readable, writable, _ = select.select([self.fd], [self.fd], [])
+            if readable:
+                self._read()
+            if writable:
+                try:
+                    view = view[os.write(self.fd, view):]
+                except BlockingIOError:
+                    pass
+
+    def recv(self, timeout):
+        """Next frame as (type, seq, payload), None on timeout."""
+        deadline = time.monotonic() + timeout
+        while not self.frames:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            if select.select([self.fd], [], [], left)[0]:
+                self._read()
+        return self.frames.popleft()
+
+    def _read(self):
+        try:
+            self.rx += os.read(self.fd, 65536)
+        except BlockingIOError:
+            return
+        self._parse()
+
+    def _parse(self):
+        rx = self.rx
+        pos = 0
+        while len(rx) - pos >= len(MAGIC):
+            if rx[pos:pos + 2] != MAGIC:
+                pos = self._resync(pos)
+                continue
+            if len(rx) - pos < HEADER.size:
+                break
+            _, ftype, flags, seq, plen, check = HEADER.unpack_from(rx, pos)
+            if check != zlib.crc32(memoryview(rx)[pos:pos + HEADER.size - 2]) & 0xFFFF \
+                    or flags or plen > self.max_payload:
+                self.crc_errors += 1
+                pos = self._resync(pos)
+                continue
+            end = pos + HEADER.size + plen
+            if len(rx) < end + CRC.size:
+                break
+            if zlib.crc32(memoryview(rx)[pos:end]) != CRC.unpack_from(rx, end)[0]:
+                self.crc_errors += 1
+                pos = self._resync(pos)
+                continue
+            self.frames.append((ftype, seq, bytes(rx[pos + HEADER.size:end])))
+            pos = end + CRC.size
+        if len(rx) - pos == 1 and rx[pos] != MAGIC[0]:
+            pos += 1
+        del rx[:pos]
+
+    def _resync(self, pos):
+        i = self.rx.find(MAGIC[:1], pos + 1)
+        return i if i >= 0 else len(self.rx)
+
+
+class Client:
+    def __init__(self, link, rto=0.2, timeout=5.0):
+        self.link = link
+        self.rto = rto
+        self.timeout = timeout
+        self.max_payload = 0
+        self.window = 0
+
+    def _request(self, ftype, payload=b"", reply=OK):
+        """Send a request until it is answered, frames of an old session are ignored."""
+        deadline = time.monotonic() + self.timeout
+        while time.monotonic() < deadline:
+            self.link.send(ftype, 0, payload)
+            retry = time.monotonic() + max(self.rto, 0.5)
+            while time.monotonic() < retry:
+                frame = self.link.recv(retry - time.monotonic())
+                if frame is None:
+                    break
+                if frame[0] == reply and frame[1] == 0:
+                    return frame[2]
+                if frame[0] == ERR and frame[1] == 0:
+                    raise TransferError(describe(frame[2]))
+        raise TransferError("no response from device")
+
+    def hello(self):
+        payload = self._request(HELLO, reply=HELLO)
+        version, self.max_payload, self.window = struct.unpack_from("<HHH", payload)
+        if version != 1:
+            raise TransferError("unsupported protocol version %d" % version)
+        self.link.max_payload = self.max_payload
+
+    def put(self, data, remote):
+        size = len(data)
+        self._request(OPEN_WRITE, struct.pack("<I", size) + remote.encode())
+        step = self.max_payload
+        frames = (size + step - 1) // step
+        end = struct.pack("<II", size, zlib.crc32(data))
+        acked = nxt = 0
+        progress = last_rx = time.monotonic()
+        while True:
+            # Frame `frames` is END, it takes a slot of the window like DATA
+            while nxt <= frames and nxt - acked < self.window:
+                if nxt < frames:
+                    self.link.send(DATA, nxt, data[nxt * step:(nxt + 1) * step])
+                else:
+                    self.link.send(END, frames, end)
+                nxt += 1
+            frame = self.link.recv(max(0.0, progress + self.rto - time.monotonic()))
+            now = time.monotonic()
+            if frame is None:
+                if now - last_rx >= self.timeout:
+                    raise TransferError("device stopped responding")
+                if now - progress >= self.rto:
+                    nxt = acked
+                    progress = now
+                continue
+            last_rx = now
+            ftype, seq, payload = frame
+            if ftype == ACK and acked < seq <= nxt:
+                acked = seq
+                progress = now
+            elif ftype == NAK and acked <= seq <= nxt:
+                acked = nxt = seq
+                progress = now
+            elif ftype == OK and seq == frames:
+                return
+            elif ftype == ERR and seq <= frames:
+                raise TransferError(describe(payload))
+
+    def get(self, remote):
+        payload = self._request(OPEN_READ, remote.encode())
+        size, = struct.unpack_from("<I", payload)
+        frames = (size + self.max_payload - 1) // self.max_payload
+        chunks = []
+        crc = 0
+        expected = unacked = 0
+        dup_acked = dup_seq = -1
+        nak_sent = False
+        while True:
+            frame = self.link.recv(self.timeout)
+            if frame is None:
+                raise TransferError("device stopped sending")
+            ftype, seq, payload = frame
+            if ftype == DATA:
+                if seq == expected:
+                    chunks.append(payload)
+                    crc = zlib.crc32(payload, crc)
+                    expected += 1
+                    unacked += 1
+                    nak_sent = False
+                    if unacked >= self.window // 2 or expected == frames:
+                        self.link.send(ACK, expected)
+                        unacked = 0
+                elif seq < expected:
+                    # Our ACK was lost and the device went back: answer once per go-back round
+                    if dup_acked != expected or seq <= dup_seq:
+                        self.link.send(ACK, expected)
+                        dup_acked = expected
+                    dup_seq = seq
+                elif not nak_sent:
+                    self.link.send(NAK, expected)
+                    nak_sent = True
+            elif ftype == END and seq == expected == frames:
+                data = b"".join(chunks)
+                if struct.unpack_from("<II", payload) != (len(data), crc) or len(data) != size:
+                    self.link.send(ERR, seq, bytes([6]) + b"size or CRC mismatch")
+                    raise TransferError(ERRORS[6])
+                self.link.send(OK, seq)
+                return data
+            elif ftype == ERR:
+                raise TransferError(describe(payload))
+
+
+def describe(payload):
+    if not payload:
+        return "device error"
+    text = payload[1:].decode(errors="replace")
+    return "%s (%s)" % (ERRORS.get(payload[0], "error %d" % payload[0]), text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("port", help="CDC-ACM tty of the device, e.g. /dev/ttyACM0")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    put = sub.add_parser("put", help="copy a local file to the device")
+    put.add_argument("local")
+    put.add_argument("remote", nargs="?", help="path on the device (default: local file name)")
+    get = sub.add_parser("get", help="copy a file from the device")
+    get.add_argument("remote")
+    get.add_argument("local", nargs="?", help="local path (default: remote file name)")
+    parser.add_argument("--rto", type=float, default=0.2, help="retransmission timeout in s (default: 0.2)")
+    parser.add_argument("--timeout", type=float, default=5.0, help="give up after this many s (default: 5)")
+    args = parser.parse_args()
+
+    link = Link(args.port)
+    client = Client(link, args.rto, args.timeout)
+    try:
+        client.hello()
+        start = time.monotonic()
+        if args.cmd == "put":
+            with open(args.local, "rb") as f:
+                data = f.read()
+            client.put(data, args.remote or os.path.basename(args.local))
+        else:
+            data = client.get(args.remote)
+            with open(args.local or os.path.basename(args.remote), "wb") as f:
+                f.write(data)
+        elapsed = time.monotonic() - start
+    except TransferError as e:
+        sys.exit("error: %s" % e)
+    finally:
+        link.close()
+
+    print("%d bytes in %.2f s (%.1f KiB/s)" % (len(data), elapsed, len(data) / 1024 / max(elapsed, 1e-6)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
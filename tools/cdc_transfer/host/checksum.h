@@ -0,0 +1,14 @@
+/**
+ * @file checksum.h
+ * @brief Host stand-in for components/checksum/include/checksum.h
+ *
+ * Only what the CDC transfer engine uses; loopback.c implements it with
+ * zlib, whose crc32() is the same CRC as checksum_crc32().
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t checksum_crc32(uint32_t crc, const void *data, size_t len);
@@ -0,0 +1,181 @@
+/**
+ * @file loopback.c
+ * @brief CDC File Transfer Engine on a Linux pty
+ *
+ * @author A.R. Ansari <ansarirahim1@gmail.com>
+ * @date 2026-10-18
+ *
+ * @section description Description
+ * Runs the device side of the protocol (main/cdc_transfer_proto.c) on the
+ * master of a pseudo-terminal, serving files from a host directory, so
+ * cdc_xfer.py can be tested against the firmware code without a board.
+ * Frames can be dropped or corrupted in both directions to exercise
+ * retransmission and resync.
+ *
+ * Prints "PTY <slave path>" once ready. When stdin is closed it prints
+ * the engine statistics and exits.
+ *
+ * @section usage Usage
+ * @code
+ * cc -O2 -I host -I ../../main loopback.c ../../main/cdc_transfer_proto.c -lz -o loopback
+ * ./loopback ROOT [-p payload] [-w window] [-d drop_permille] [-c corrupt_permille] [-s seed]
+ * @endcode
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "checksum.h"
+#include "cdc_transfer_proto.h"
+
+static int g_master = -1;
+static unsigned g_drop_permille;
+static unsigned g_corrupt_permille;
+
+uint32_t checksum_crc32(uint32_t crc, const void *data, size_t len) {
+    return (uint32_t)crc32(crc, data, (uInt)len);
+}
+
+static uint32_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000u + ts.tv_nsec / 1000000u);
+}
+
+/**
+ * @brief Damage a chunk in transit
+ *
+ * @return false if the chunk is dropped
+ */
+static bool inject_faults(uint8_t *data, size_t len) {
+    if ((unsigned)rand() % 1000 < g_drop_permille) {
+        return false;
+    }
+    if (len > 0 && (unsigned)rand() % 1000 < g_corrupt_permille) {
+        data[rand() % len] ^= (uint8_t)(1 + rand() % 255);
+    }
+    return true;
+}
+
+static void pty_send(void *ctx, const void *data, size_t len) {
+    static uint8_t copy[CDC_XFER_FRAME_SIZE(UINT16_MAX)];
+    (void)ctx;
+    memcpy(copy, data, len);
+    if (!inject_faults(copy, len)) {
+        return;
+    }
+    const uint8_t *p = copy;
+    while (len > 0) {
+        ssize_t n = write(g_master, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            exit(1);
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+int main(int argc, char **argv) {
+    cdc_xfer_config_t cfg = {
+        .max_payload = 2048,
+        .window = 16,
+        .io_size = 4096,
+        .rto_ms = 100,
+        .idle_timeout_ms = 5000,
+        .send = pty_send,
+    };
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:w:d:c:s:")) != -1) {
+        switch (opt) {
+        case 'p': cfg.max_payload = (uint16_t)atoi(optarg); break;
+        case 'w': cfg.window = (uint16_t)atoi(optarg); break;
+        case 'd': g_drop_permille = (unsigned)atoi(optarg); break;
+        case 'c': g_corrupt_permille = (unsigned)atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s ROOT [-p payload] [-w window] [-d drop] [-c corrupt] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "missing ROOT\n");
+        return 2;
+    }
+    cfg.root = argv[optind];
+    if (cfg.io_size < cfg.max_payload) {
+        cfg.io_size = cfg.max_payload;
+    }
+    srand(seed);
+
+    g_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (g_master < 0 || grantpt(g_master) != 0 || unlockpt(g_master) != 0) {
+        perror("pty");
+        return 1;
+    }
+    /* Keep the slave open and raw: no echo of our frames, no EIO when the client closes it */
+    const char *slave_path = ptsname(g_master);
+    int slave = open(slave_path, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+        perror("slave");
+        return 1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    cdc_xfer_server_t *srv = cdc_xfer_server_new(&cfg);
+    if (!srv) {
+        fprintf(stderr, "bad configuration\n");
+        return 1;
+    }
+    printf("PTY %s\n", slave_path);
+    fflush(stdout);
+
+    static uint8_t buf[16384];
+    uint32_t wait_ms = 0;
+    struct pollfd fds[2] = {
+        { .fd = g_master, .events = POLLIN },
+        { .fd = STDIN_FILENO, .events = POLLIN },
+    };
+    while (true) {
+        if (poll(fds, 2, (int)wait_ms) < 0 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+        if (fds[1].revents) {
+            if (read(STDIN_FILENO, buf, sizeof(buf)) <= 0) {
+                break;
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            ssize_t n = read(g_master, buf, sizeof(buf));
+            if (n > 0 && inject_faults(buf, (size_t)n)) {
+                cdc_xfer_server_input(srv, buf, (size_t)n, now_ms());
+            }
+        }
+        wait_ms = cdc_xfer_server_poll(srv, now_ms());
+    }
+
+    cdc_xfer_stats_t stats;
+    cdc_xfer_server_get_stats(srv, &stats);
+    printf("STATS frames_rx=%u crc_errors=%u retransmits=%u files_rx=%u files_tx=%u\n",
+           stats.frames_rx, stats.crc_errors, stats.retransmits, stats.files_rx, stats.files_tx);
+    cdc_xfer_server_free(srv);
+    close(slave);
+    close(g_master);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""
+Loopback tests of the CDC file transfer protocol.
+
+Builds loopback.c with the firmware's protocol engine
+(main/cdc_transfer_proto.c), serves a temporary directory on a pty and runs
+cdc_xfer.py against it: round trips of edge-case sizes, transfers over a
+link that drops and corrupts frames, error replies, and the throughput of
+a clean link.
+
+Needs a C compiler and zlib headers.
+
+Usage:
+    python3 tools/cdc_transfer/test_loopback.py [-v]
+"""
+
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+MAIN = os.path.join(HERE, "..", "..", "main")
+sys.path.insert(0, HERE)
+
+import cdc_xfer  # noqa: E402
+
+PAYLOAD = 2048
+WINDOW = 16
+
+
+def build(outdir):
+    exe = os.path.join(outdir, "loopback")
+    subprocess.run([os.environ.get("CC", "cc"), "-O2", "-Wall", "-Werror",
+                    "-I", os.path.join(HERE, "host"), "-I", MAIN,
+                    os.path.join(HERE, "loopback.c"), os.path.join(MAIN, "cdc_transfer_proto.c"),
+                    "-lz", "-o", exe], check=True)
+    return exe
+
+
+class Loopback:
+    """loopback.c serving a directory, with a connected client."""
+
+    def __init__(self, exe, root, drop=0, corrupt=0, seed=1):
+        self.proc = subprocess.Popen([exe, root, "-p", str(PAYLOAD), "-w", str(WINDOW),
+                                      "-d", str(drop), "-c", str(corrupt), "-s", str(seed)],
+                                     stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True)
+        line = self.proc.stdout.readline().split()
+        assert line[0] == "PTY", line
+        self.link = cdc_xfer.Link(line[1])
+        self.client = cdc_xfer.Client(self.link, rto=0.05, timeout=5.0)
+        self.client.hello()
+
+    def close(self):
+        """Stop the server, returns its statistics."""
+        self.link.close()
+        out, _ = self.proc.communicate(timeout=10)
+        stats = {}
+        for line in out.splitlines():
+            if line.startswith("STATS"):
+                stats = {k: int(v) for k, v in (f.split("=") for f in line.split()[1:])}
+        return stats
+
+
+class LoopbackTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.build_dir = tempfile.mkdtemp()
+        cls.exe = build(cls.build_dir)
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.build_dir)
+
+    def setUp(self):
+        self.root = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.root)
+
+    def roundtrip(self, lb, data, name):
+        lb.client.put(data, name)
+        with open(os.path.join(self.root, name), "rb") as f:
+            self.assertEqual(data, f.read())
+        self.assertEqual(data, lb.client.get(name))
+
+    def test_sizes(self):
+        lb = Loopback(self.exe, self.root)
+        rng = random.Random(1)
+        sizes = [0, 1, PAYLOAD - 1, PAYLOAD, PAYLOAD + 1, WINDOW * PAYLOAD, WINDOW * PAYLOAD + 7, 300 * 1024]
+        for i, size in enumerate(sizes):
+            with self.subTest(size=size):
+                self.roundtrip(lb, rng.randbytes(size), "F%d.BIN" % i)
+        # Rewrite with a smaller file
+        self.roundtrip(lb, b"short", "F7.BIN")
+        stats = lb.close()
+        self.assertEqual(len(sizes) + 1, stats["files_rx"])
+        self.assertEqual(0, stats["crc_errors"])
+        self.assertFalse(os.path.exists(os.path.join(self.root, "~XFER.TMP")))
+
+    def test_lossy_link(self):
+        # 2% of the chunks dropped and 2% corrupted, in both directions
+        lb = Loopback(self.exe, self.root, drop=20, corrupt=20, seed=7)
+        rng = random.Random(2)
+        for i in range(3):
+            self.roundtrip(lb, rng.randbytes(200 * 1024 + i), "LOSSY%d.BIN" % i)
+        stats = lb.close()
+        self.assertGreater(stats["retransmits"] + stats["crc_errors"], 0)
+
+    def test_errors(self):
+        lb = Loopback(self.exe, self.root)
+        with self.assertRaisesRegex(cdc_xfer.TransferError, "no such file"):
+            lb.client.get("MISSING.BIN")
+        for path in ("../ESCAPE.BIN", "A/../../B", ""):
+            with self.subTest(path=path):
+                with self.assertRaisesRegex(cdc_xfer.TransferError, "invalid request"):
+                    lb.client.put(b"x", path)
+        with self.assertRaisesRegex(cdc_xfer.TransferError, "no such file"):
+            lb.client.put(b"x", "NODIR/X.BIN")
+        # The session is usable after errors
+        self.roundtrip(lb, b"after errors", "OK.BIN")
+        lb.close()
+        self.assertEqual(["OK.BIN"], os.listdir(self.root))
+
+    def test_throughput(self):
+        lb = Loopback(self.exe, self.root)
+        data = random.Random(3).randbytes(8 * 1024 * 1024)
+        start = time.monotonic()
+        lb.client.put(data, "BIG.BIN")
+        put_s = time.monotonic() - start
+        start = time.monotonic()
+        self.assertEqual(data, lb.client.get("BIG.BIN"))
+        get_s = time.monotonic() - start
+        lb.close()
+        mib = len(data) / (1024 * 1024)
+        print("\npty loopback: put %.1f MiB/s, get %.1f MiB/s (full-speed USB: about 1 MiB/s)"
+              % (mib / put_s, mib / get_s))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,315 @@
+#!/usr/bin/env python3
+"""
+Replay a captured file I/O trace against candidate FAT volume layouts.
+
+Models how FatFs on the wear-levelled `storage` partition would lay out and
+update the volume for every candidate (cluster size, FAT copies, root
+directory size), replays the trace and scores each layout by the number of
+flash sectors it would rewrite. With CONFIG_WL_SECTOR_SIZE=4096 every FatFs
+sector is one WL sector, so sector writes map directly to erase cycles. The
+data area is aligned the way the firmware formats it, to at least one
+cluster and one erase block. Layouts that run out of space or root
+directory entries during the replay are disqualified.
+
+The best layout is printed as sdkconfig lines for the "Internal Storage
+Volume" menu (main/Kconfig.projbuild), ready to paste into sdkconfig.defaults.
+
+Trace format (CSV, one operation per line, '#' starts a comment):
+
+    create,<path>
+    write,<path>,<offset>,<size>
+    append,<path>,<size>
+    truncate,<path>,<size>
+    delete,<path>
+
+Paths are absolute within the volume ("/logs/a.txt"); parent directories are
+created implicitly. The firmware records this format when built with
+CONFIG_FS_PROFILE_TRACE: the operations of the volume's own writers are
+kept in RAM and appended to /storage/fstrace.csv on unmount and before the
+volume is handed to the USB host, so the file can be copied off the drive.
+
+Usage:
+    replay_trace.py trace.csv [--partition-size 0xEF0000] [--top 10]
+"""
+
+import argparse
+import csv
+import itertools
+import math
+import sys
+
+SECTOR_SIZE = 4096
+DIR_ENTRY_SIZE = 32
+FAT12_MAX_CLUSTERS = 4085
+FAT16_MAX_CLUSTERS = 65525
+
+FLASH_ERASE_SIZE = 4096
+CLUSTER_SIZES = (4096, 8192, 16384, 32768)
+ROOT_ENTRIES = (128, 256, 512, 1024)
+NUM_FATS = (1, 2)
+
+
+def format_align(cluster_size, align=1):
+    """Data alignment the firmware formats with, see fs_format_align_sectors().
+
+    Never smaller than one cluster or one flash erase block, rounded up to a
+    power of two, so layouts with clusters straddling WL sectors can't occur.
+    """
+    align = max(align, max(cluster_size, FLASH_ERASE_SIZE) // SECTOR_SIZE)
+    return 1 << (align - 1).bit_length()
+
+
+class Geometry:
+    """Volume geometry as f_mkfs() would create it for FAT12/16."""
+
+    def __init__(self, sectors, cluster_size, n_fats, n_root, align):
+        self.cluster_size = cluster_size
+        self.n_fats = n_fats
+        self.n_root = n_root
+        self.align = align
+        self.csize = cluster_size // SECTOR_SIZE
+        self.sz_dir = n_root * DIR_ENTRY_SIZE // SECTOR_SIZE
+        self.sz_rsv = 1
+        self.valid = False
+
+        sz_fat = 1
+        for _ in range(8):
+            b_data = self.sz_rsv + sz_fat * n_fats + self.sz_dir
+            pad = (-b_data) % align
+            n_clst = (sectors - b_data - pad) // self.csize
+            if n_clst < 1:
+                return
+            self.fat16 = n_clst > FAT12_MAX_CLUSTERS
+            fat_bytes = (n_clst + 2) * 2 if self.fat16 else ((n_clst + 2) * 3 + 1) // 2
+            need = math.ceil(fat_bytes / SECTOR_SIZE)
+            if need == sz_fat:
+                break
+            sz_fat = need
+
+        if n_clst > FAT16_MAX_CLUSTERS:
+            return
+        self.sz_fat = sz_fat
+        self.n_clst = n_clst
+        self.valid = True
+
+    def fat_sector(self, cluster):
+        offset = cluster * 2 if self.fat16 else cluster * 3 // 2
+        return offset // SECTOR_SIZE
+
+    @property
+    def fat_type(self):
+        return "FAT16" if self.fat16 else "FAT12"
+
+
+class Volume:
+    """Replays trace operations and counts sector writes."""
+
+    def __init__(self, geo):
+        self.geo = geo
+        self.free = list(range(geo.n_clst + 1, 1, -1))  # pop() yields lowest
+        self.files = {}          # path -> [size, [clusters]]
+        self.dirs = {"/": []}    # path -> [clusters]; "/" is the fixed root
+        self.entries = {"/": 0}  # path -> used directory entries
+        self.writes = 0
+        self.failures = 0
+        self.peak_used = 0
+
+    @staticmethod
+    def _entries_for(name):
+        # 8.3 names take one entry; long names add one per 13 characters
+        base, _, ext = name.partition(".")
+        if len(base) <= 8 and len(ext) <= 3 and name.upper() == name:
+            return 1
+        return 1 + math.ceil(len(name) / 13)
+
+    def _touch_fat(self, clusters):
+        sectors = {self.geo.fat_sector(c) for c in clusters}
+        self.writes += len(sectors) * self.geo.n_fats
+
+    def _alloc(self, count):
+        if count > len(self.free):
+            return None
+        got = [self.free.pop() for _ in range(count)]
+        used = self.geo.n_clst - len(self.free)
+        self.peak_used = max(self.peak_used, used)
+        return got
+
+    def _add_entry(self, path):
+        parent, _, name = path.rstrip("/").rpartition("/")
+        parent = parent or "/"
+        if parent not in self.dirs and not self._mkdir(parent):
+            return False
+        need = self._entries_for(name)
+        used = self.entries[parent] + need
+        if parent == "/":
+            if used > self.geo.n_root:
+                return False
+        else:
+            per_cluster = self.geo.cluster_size // DIR_ENTRY_SIZE
+            clusters = self.dirs[parent]
+            grow = math.ceil(used / per_cluster) - len(clusters)
+            if grow > 0:
+                new = self._alloc(grow)
+                if new is None:
+                    return False
+                clusters.extend(new)
+                self._touch_fat(new)
+        self.entries[parent] = used
+        self.writes += 1
+        return True
+
+    def _mkdir(self, path):
+        if path in self.dirs:
+            return True
+        if not self._add_entry(path):
+            return False
+        cl = self._alloc(1)
+        if cl is None:
+            return False
+        self._touch_fat(cl)
+        self.dirs[path] = cl
+        self.entries[path] = 2  # "." and ".."
+        self.writes += 1
+        return True
+
+    def _resize(self, path, size):
+        f = self.files[path]
+        need = math.ceil(size / self.geo.cluster_size)
+        have = len(f[1])
+        if need > have:
+            new = self._alloc(need - have)
+            if new is None:
+                return False
+            f[1].extend(new)
+            self._touch_fat(f[1][max(have - 1, 0):])
+        elif need < have:
+            dropped = f[1][need:]
+            del f[1][need:]
+            self.free.extend(reversed(dropped))
+            self._touch_fat(dropped + f[1][-1:])
+        f[0] = size
+        return True
+
+    def create(self, path):
+        if path in self.files:
+            return
+        if not self._add_entry(path):
+            self.failures += 1
+            return
+        self.files[path] = [0, []]
+
+    def write(self, path, offset, size):
+        if path not in self.files:
+            self.create(path)
+            if path not in self.files:
+                return
+        end = offset + size
+        if end > self.files[path][0] and not self._resize(path, end):
+            self.failures += 1
+            return
+        if size:
+            first = offset // SECTOR_SIZE
+            last = (end - 1) // SECTOR_SIZE
+            self.writes += last - first + 1
+        self.writes += 1  # directory entry (size/mtime)
+
+    def append(self, path, size):
+        cur = self.files.get(path, [0])[0]
+        self.write(path, cur, size)
+
+    def truncate(self, path, size):
+        if path in self.files:
+            self._resize(path, size)
+            self.writes += 1
+
+    def delete(self, path):
+        f = self.files.pop(path, None)
+        if f is None:
+            return
+        self.free.extend(reversed(f[1]))
+        self._touch_fat(f[1])
+        self.writes += 1
+
+    def slack(self):
+        return sum(len(c) * self.geo.cluster_size - s for s, c in self.files.values())
+
+
+def load_trace(path):
+    ops = []
+    with open(path, newline="") as fh:
+        for lineno, row in enumerate(csv.reader(fh), 1):
+            if not row or row[0].strip().startswith("#"):
+                continue
+            op = row[0].strip().lower()
+            args = [a.strip() for a in row[1:]]
+            try:
+                if op == "create" or op == "delete":
+                    ops.append((op, args[0]))
+                elif op == "write":
+                    ops.append((op, args[0], int(args[1], 0), int(args[2], 0)))
+                elif op in ("append", "truncate"):
+                    ops.append((op, args[0], int(args[1], 0)))
+                else:
+                    raise ValueError("unknown operation '%s'" % op)
+            except (IndexError, ValueError) as e:
+                sys.exit("%s:%d: %s" % (path, lineno, e))
+    return ops
+
+
+def replay(geo, ops):
+    vol = Volume(geo)
+    for op in ops:
+        getattr(vol, op[0])(*op[1:])
+    return vol
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("trace", help="CSV trace file")
+    parser.add_argument("--partition-size", type=lambda v: int(v, 0), default=0xEF0000,
+                        help="storage partition size in bytes (default: 0xEF0000, see partitions.csv)")
+    parser.add_argument("--wl-overhead", type=int, default=8,
+                        help="sectors reserved by wear levelling (default: 8, approximate)")
+    parser.add_argument("--top", type=int, default=10, help="number of layouts to list")
+    args = parser.parse_args()
+
+    ops = load_trace(args.trace)
+    sectors = args.partition_size // SECTOR_SIZE - args.wl_overhead
+
+    results = []
+    for cs, n_root, n_fats in itertools.product(CLUSTER_SIZES, ROOT_ENTRIES, NUM_FATS):
+        # Larger alignments only add padding, the smallest one the firmware uses is the best
+        geo = Geometry(sectors, cs, n_fats, n_root, format_align(cs))
+        if not geo.valid:
+            continue
+        vol = replay(geo, ops)
+        results.append((vol.failures, vol.writes, vol.slack(), geo, vol))
+
+    if not results:
+        sys.exit("no valid layout for a %d-sector volume" % sectors)
+
+    results.sort(key=lambda r: r[:3])
+
+    print("%d operations, %d-sector volume" % (len(ops), sectors))
+    print("%-6s %8s %5s %5s %6s %8s %9s %10s %8s" % (
+        "type", "cluster", "fats", "root", "align", "clusters", "failures", "writes", "slack"))
+    for failures, writes, slack, geo, _ in results[:args.top]:
+        print("%-6s %8d %5d %5d %6d %8d %9d %10d %8d" % (
+            geo.fat_type, geo.cluster_size, geo.n_fats, geo.n_root, geo.align,
+            geo.n_clst, failures, writes, slack))
+
+    failures, _, _, best, _ = results[0]
+    if failures:
+        print("\nwarning: every layout failed part of the trace", file=sys.stderr)
+
+    print("\n# Best layout for this trace")
+    print("CONFIG_FS_PROFILE_CLUSTER_SIZE_%dK=y" % (best.cluster_size // 1024))
+    print("CONFIG_FS_PROFILE_FAT_TYPE_FAT=y")
+    print("CONFIG_FS_PROFILE_ROOT_ENTRIES=%d" % best.n_root)
+    print("CONFIG_FS_PROFILE_NUM_FATS=%d" % best.n_fats)
+    print("CONFIG_FS_PROFILE_ALIGN_SECTORS=%d" % best.align)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
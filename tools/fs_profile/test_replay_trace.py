@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""
+Tests of the FAT layout trace replay.
+
+Checks the volume geometry against what f_mkfs() creates, the write
+accounting and the failures of the model volume, the trace parser, and runs
+the tool on a trace in the format the firmware records with
+CONFIG_FS_PROFILE_TRACE: the suggested root directory size must be one the
+firmware formats as is, a whole number of 4 KiB sectors.
+
+Usage:
+    python3 tools/fs_profile/test_replay_trace.py [-v]
+"""
+
+import contextlib
+import io
+import os
+import re
+import sys
+import tempfile
+import unittest
+from unittest import mock
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, HERE)
+
+import replay_trace  # noqa: E402
+
+
+def write_trace(text):
+    fd, path = tempfile.mkstemp(suffix=".csv")
+    with os.fdopen(fd, "w") as fh:
+        fh.write(text)
+    return path
+
+
+class FormatAlignTest(unittest.TestCase):
+    def test_at_least_cluster_and_erase_block(self):
+        self.assertEqual(replay_trace.format_align(4096), 1)
+        self.assertEqual(replay_trace.format_align(16384), 4)
+        self.assertEqual(replay_trace.format_align(32768), 8)
+
+    def test_rounded_to_power_of_two(self):
+        self.assertEqual(replay_trace.format_align(8192, align=3), 4)
+        self.assertEqual(replay_trace.format_align(4096, align=16), 16)
+
+
+class GeometryTest(unittest.TestCase):
+    def test_fat12(self):
+        geo = replay_trace.Geometry(248, 4096, 2, 128, 1)
+        self.assertTrue(geo.valid)
+        self.assertEqual(geo.fat_type, "FAT12")
+        self.assertEqual(geo.sz_dir, 1)
+        self.assertEqual(geo.sz_fat, 1)
+        self.assertEqual(geo.n_clst, 248 - 1 - 2 - 1)
+
+    def test_data_area_aligned(self):
+        # 3 sectors of system area, padded to 4, then 4-sector clusters
+        geo = replay_trace.Geometry(248, 16384, 1, 128, 4)
+        self.assertTrue(geo.valid)
+        self.assertEqual(geo.n_clst, (248 - 4) // 4)
+
+    def test_fat16(self):
+        geo = replay_trace.Geometry(10000, 4096, 1, 512, 1)
+        self.assertTrue(geo.valid)
+        self.assertEqual(geo.fat_type, "FAT16")
+        self.assertEqual(geo.sz_dir, 4)
+        self.assertEqual(geo.fat_sector(2047), 0)
+        self.assertEqual(geo.fat_sector(2048), 1)
+
+    def test_too_many_clusters_for_fat16(self):
+        self.assertFalse(replay_trace.Geometry(70000, 4096, 1, 128, 1).valid)
+
+
+class VolumeTest(unittest.TestCase):
+    def volume(self, sectors=248, n_fats=2):
+        return replay_trace.Volume(replay_trace.Geometry(sectors, 4096, n_fats, 128, 1))
+
+    def test_entries_for(self):
+        entries = replay_trace.Volume._entries_for
+        self.assertEqual(entries("README.TXT"), 1)
+        self.assertEqual(entries("readme.txt"), 2)
+        self.assertEqual(entries("LONGFILENAME.TXT"), 3)
+
+    def test_write_accounting(self):
+        vol = self.volume()
+        vol.create("/A.BIN")
+        self.assertEqual(vol.writes, 1)
+        # One FAT sector per copy, one data sector, the directory entry
+        vol.append("/A.BIN", 4096)
+        self.assertEqual(vol.writes, 1 + 2 + 1 + 1)
+        vol.truncate("/A.BIN", 0)
+        self.assertEqual(vol.writes, 5 + 2 + 1)
+        vol.delete("/A.BIN")
+        self.assertEqual(vol.writes, 9)
+        self.assertEqual(len(vol.free), vol.geo.n_clst)
+        self.assertEqual(vol.peak_used, 1)
+        self.assertEqual(vol.failures, 0)
+
+    def test_subdirectory_created_implicitly(self):
+        vol = self.volume()
+        vol.append("/records/ev_00001.seg", 100)
+        self.assertIn("/records", vol.dirs)
+        self.assertEqual(vol.geo.n_clst - len(vol.free), 2)
+        self.assertEqual(vol.slack(), 4096 - 100)
+
+    def test_root_directory_full(self):
+        vol = self.volume()
+        for i in range(129):
+            vol.create("/F%03d" % i)
+        self.assertEqual(len(vol.files), 128)
+        self.assertEqual(vol.failures, 1)
+
+    def test_out_of_space(self):
+        vol = self.volume(sectors=20, n_fats=1)
+        vol.write("/A.BIN", 0, (vol.geo.n_clst + 1) * 4096)
+        self.assertEqual(vol.failures, 1)
+        self.assertEqual(vol.files["/A.BIN"][0], 0)
+        self.assertEqual(len(vol.free), vol.geo.n_clst)
+
+
+class LoadTraceTest(unittest.TestCase):
+    def load(self, text):
+        path = write_trace(text)
+        self.addCleanup(os.unlink, path)
+        return replay_trace.load_trace(path)
+
+    def test_parse(self):
+        ops = self.load("# 4 operations, 0 dropped\n"
+                        "create,/a.txt\n"
+                        "WRITE, /a.txt, 0x10, 32\n"
+                        "\n"
+                        "append,/a.txt,0x1000\n"
+                        "truncate,/a.txt,0\n"
+                        "delete,/a.txt\n")
+        self.assertEqual(ops, [
+            ("create", "/a.txt"),
+            ("write", "/a.txt", 16, 32),
+            ("append", "/a.txt", 4096),
+            ("truncate", "/a.txt", 0),
+            ("delete", "/a.txt"),
+        ])
+
+    def test_unknown_operation(self):
+        with self.assertRaises(SystemExit) as cm:
+            self.load("rename,/a,/b\n")
+        self.assertIn(":1: unknown operation 'rename'", str(cm.exception.code))
+
+    def test_missing_argument(self):
+        with self.assertRaises(SystemExit) as cm:
+            self.load("create,/a\nappend,/a\n")
+        self.assertIn(":2:", str(cm.exception.code))
+
+
+class MainTest(unittest.TestCase):
+    def run_main(self, text):
+        path = write_trace(text)
+        self.addCleanup(os.unlink, path)
+        out = io.StringIO()
+        argv = ["replay_trace.py", path, "--partition-size", "0x100000", "--top", "3"]
+        with mock.patch.object(sys, "argv", argv), contextlib.redirect_stdout(out):
+            self.assertEqual(replay_trace.main(), 0)
+        return dict(re.findall(r"^(CONFIG_\w+)=(\w+)$", out.getvalue(), re.M))
+
+    def test_firmware_trace(self):
+        # Record store segments and their export, as fs_trace_record() writes them
+        lines = ["# 0 operations, 0 dropped"]
+        for seg in range(4):
+            for _ in range(8):
+                lines.append("append,/records/ev_%05d.seg,512" % seg)
+        lines.append("delete,/records/ev_00000.seg")
+        lines.append("truncate,/export/events.txt,0")
+        lines.append("append,/export/events.txt,12000")
+        config = self.run_main("\n".join(lines) + "\n")
+
+        self.assertEqual(config["CONFIG_FS_PROFILE_FAT_TYPE_FAT"], "y")
+        self.assertEqual(int(config["CONFIG_FS_PROFILE_ROOT_ENTRIES"]) % 128, 0)
+        cluster = [k for k in config if k.startswith("CONFIG_FS_PROFILE_CLUSTER_SIZE_")]
+        self.assertEqual(len(cluster), 1)
+        cluster_size = int(cluster[0].rsplit("_", 1)[1].rstrip("K")) * 1024
+        self.assertEqual(int(config["CONFIG_FS_PROFILE_ALIGN_SECTORS"]),
+                         replay_trace.format_align(cluster_size))
+
+    def test_root_directory_sized_for_trace(self):
+        config = self.run_main("".join("create,/F%03d.TXT\n" % i for i in range(200)))
+        self.assertEqual(config["CONFIG_FS_PROFILE_ROOT_ENTRIES"], "256")
+
+
+if __name__ == "__main__":
+    unittest.main()
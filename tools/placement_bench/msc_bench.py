@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+"""
+MSC throughput and latency jitter benchmark for task placements.
+
+Times sequential block writes and reads on the firmware's USB drive, one
+request at a time with O_DIRECT so every request goes to the device, and
+reports throughput and the latency distribution per request: median,
+99th percentile, maximum and standard deviation (the jitter).
+
+With --control, the "placement" command names the placement of the
+firmware under test and "placement load <percent>" runs a busy
+housekeeping task during each pass, so placements can be compared with
+housekeeping idle and loaded. Flash one build per placement (menuconfig,
+Task Placement), run the same command against each with --json, then
+compare them with --report.
+
+With --probe, a thread toggles RTS on the control tty during each pass.
+Every toggle is a SET_CONTROL_LINE_STATE control request the host driver
+waits for, so its latency shows how long the firmware leaves control
+requests waiting while it writes the medium: compare builds with and
+without the MSC write worker (menuconfig, TinyUSB Stack, MSC) with
+--label.
+
+The target is a file on the mounted volume (created and filled before
+timing starts, so later writes don't allocate clusters) or, with
+--destructive, the raw block device, which overwrites the filesystem.
+
+Needs nothing beyond the standard library.
+
+Usage:
+    msc_bench.py /media/$USER/ESP32S3/bench.bin --control /dev/ttyACM0 --load 0,50,80 --json runs.jsonl
+    msc_bench.py /media/$USER/ESP32S3/bench.bin --control /dev/ttyACM0 --probe --label worker --json runs.jsonl
+    msc_bench.py --report runs.jsonl
+"""
+
+import argparse
+import fcntl
+import json
+import math
+import mmap
+import os
+import select
+import stat
+import struct
+import sys
+import termios
+import threading
+import time
+import tty
+
+UNITS = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+PROBE_INTERVAL = 0.01   # seconds between control requests
+
+
+class BenchError(Exception):
+    pass
+
+
+def parse_size(text):
+    text = text.strip().upper().rstrip("B").rstrip("I")
+    scale = UNITS.get(text[-1:], 1)
+    return int(text[:-1] if scale > 1 else text) * scale
+
+
+def latency_stats(latencies, nbytes, elapsed):
+    """Throughput and latency distribution of one pass, latencies in seconds."""
+    ordered = sorted(latencies)
+    n = len(ordered)
+    if n == 0:
+        raise BenchError("no requests timed")
+    mean = sum(ordered) / n
+    var = sum((x - mean) ** 2 for x in ordered) / n
+
+    def pct(p):
+        return ordered[min(n - 1, max(0, math.ceil(p / 100.0 * n) - 1))]
+
+    return {
+        "requests": n,
+        "mb_s": nbytes / elapsed / 1e6 if elapsed > 0 else 0.0,
+        "mean_ms": mean * 1e3,
+        "p50_ms": pct(50) * 1e3,
+        "p99_ms": pct(99) * 1e3,
+        "max_ms": ordered[-1] * 1e3,
+        "stdev_ms": math.sqrt(var) * 1e3,
+    }
+
+
+class Control:
+    """Line commands on the control channel, answered by output and OK or ERR <n>."""
+
+    def __init__(self, path, timeout=2.0):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        if os.isatty(self.fd):
+            tty.setraw(self.fd)
+            termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.timeout = timeout
+        self.rx = b""
+
+    def close(self):
+        os.close(self.fd)
+
+    def command(self, line):
+        os.write(self.fd, line.encode() + b"\n")
+        out = []
+        deadline = time.monotonic() + self.timeout
+        while True:
+            while b"\n" in self.rx:
+                raw, self.rx = self.rx.split(b"\n", 1)
+                text = raw.decode(errors="replace").strip()
+                if text == "OK":
+                    return out
+                if text.startswith("ERR"):
+                    raise BenchError("%r failed: %s" % (line, text))
+                if text:
+                    out.append(text)
+            left = deadline - time.monotonic()
+            if left <= 0:
+                raise BenchError("no answer to %r" % line)
+            if select.select([self.fd], [], [], left)[0]:
+                self.rx += os.read(self.fd, 4096)
+
+
+def toggle_rts(fd, on):
+    """Set or clear RTS, answered when the device acknowledged the control request."""
+    fcntl.ioctl(fd, termios.TIOCMBIS if on else termios.TIOCMBIC, struct.pack("I", termios.TIOCM_RTS))
+
+
+class ControlProbe(threading.Thread):
+    """Times control requests on the control tty until stopped."""
+
+    def __init__(self, fd):
+        super().__init__(daemon=True)
+        self.fd = fd
+        self.latencies = []
+        self.error = None
+        self.stopping = threading.Event()
+
+    def run(self):
+        on = False
+        while not self.stopping.is_set():
+            on = not on
+            t0 = time.perf_counter()
+            try:
+                toggle_rts(self.fd, on)
+            except OSError as e:
+                self.error = e
+                return
+            self.latencies.append(time.perf_counter() - t0)
+            self.stopping.wait(PROBE_INTERVAL)
+
+    def stop(self):
+        """Latency statistics of the requests, prefixed with ctl_."""
+        self.stopping.set()
+        self.join()
+        if self.error:
+            raise BenchError("control request failed: %s" % self.error)
+        if not self.latencies:
+            return {"ctl_requests": 0}
+        s = latency_stats(self.latencies, 0, 0)
+        return {"ctl_" + k: s[k] for k in ("requests", "p50_ms", "p99_ms", "max_ms")}
+
+
+def open_target(path, size, direct, destructive):
+    """File descriptor of the target, with size bytes ready to overwrite."""
+    is_block = os.path.exists(path) and stat.S_ISBLK(os.stat(path).st_mode)
+    if is_block and not destructive:
+        raise BenchError("%s is a block device, writing to it destroys the filesystem (--destructive)" % path)
+
+    if not is_block:
+        # Allocate the clusters first, the timed writes then only overwrite
+        buf = b"\xa5" * (1 << 20)
+        with open(path, "wb") as f:
+            left = size
+            while left > 0:
+                left -= f.write(buf[:min(left, len(buf))])
+            f.flush()
+            os.fsync(f.fileno())
+
+    flags = os.O_RDWR | (getattr(os, "O_DIRECT", 0) if direct else 0)
+    return os.open(path, flags)
+
+
+def run_pass(fd, kind, size, block):
+    buf = mmap.mmap(-1, block)      # page aligned, as O_DIRECT needs
+    buf.write(os.urandom(block))
+    latencies = []
+    start = time.perf_counter()
+    for offset in range(0, size - block + 1, block):
+        t0 = time.perf_counter()
+        n = os.pwritev(fd, [buf], offset) if kind == "write" else os.preadv(fd, [buf], offset)
+        latencies.append(time.perf_counter() - t0)
+        if n != block:
+            raise BenchError("short %s at %d: %d of %d bytes" % (kind, offset, n, block))
+    if kind == "write":
+        os.fsync(fd)
+    elapsed = time.perf_counter() - start
+    buf.close()
+    return latency_stats(latencies, len(latencies) * block, elapsed)
+
+
+def bench(path, size, block, passes, loads, control=None, label=None, direct=True, destructive=False, probe=False):
+    """Result rows, one per load level and pass."""
+    if control:
+        status = control.command("placement")
+        label = label or (status[0].split()[1].rstrip(",") if status else None)
+    rows = []
+    fd = open_target(path, size, direct, destructive)
+    try:
+        for load in loads:
+            if control:
+                control.command("placement load %d" % load)
+            for kind in passes:
+                row = {"placement": label or "unknown", "load": load, "pass": kind, "block": block, "size": size}
+                prober = ControlProbe(control.fd) if probe else None
+                if prober:
+                    prober.start()
+                try:
+                    row.update(run_pass(fd, kind, size, block))
+                finally:
+                    if prober:
+                        row.update(prober.stop())
+                rows.append(row)
+    finally:
+        os.close(fd)
+        if control:
+            control.command("placement load 0")
+    return rows
+
+
+COLUMNS = ("placement", "load", "pass", "mb_s", "p50_ms", "p99_ms", "max_ms", "stdev_ms")
+CTL_COLUMNS = ("ctl_p50_ms", "ctl_p99_ms", "ctl_max_ms")
+
+
+def format_rows(rows):
+    probed = any("ctl_p50_ms" in r for r in rows)
+    header = "%-10s %5s %-6s %8s %8s %8s %8s %9s" % COLUMNS
+    if probed:
+        header += " %10s %10s %10s" % CTL_COLUMNS
+    lines = [header]
+    for r in sorted(rows, key=lambda r: (r["pass"], r["load"], r["placement"])):
+        line = "%-10s %4d%% %-6s %8.2f %8.2f %8.2f %8.2f %9.3f" % tuple(r[c] for c in COLUMNS)
+        if probed:
+            line += "".join(" %10.2f" % r[c] if c in r else " %10s" % "-" for c in CTL_COLUMNS)
+        lines.append(line)
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("target", nargs="?", help="file on the mounted volume, or block device with --destructive")
+    parser.add_argument("--size", default="8M", help="bytes per pass (default 8M)")
+    parser.add_argument("--block", default="64K", help="bytes per request (default 64K)")
+    parser.add_argument("--passes", default="write,read", help="passes in order (default write,read)")
+    parser.add_argument("--control", help="control channel tty, for the placement name and --load")
+    parser.add_argument("--load", default="0", help="housekeeping load levels in percent (default 0)")
+    parser.add_argument("--probe", action="store_true", help="time control requests on the control tty during each pass")
+    parser.add_argument("--label", help="placement name, instead of asking the firmware")
+    parser.add_argument("--json", help="append result rows to this JSON lines file")
+    parser.add_argument("--report", nargs="+", metavar="JSONL", help="print the rows of earlier runs side by side")
+    parser.add_argument("--no-direct", action="store_true", help="don't use O_DIRECT (page cache hides the device)")
+    parser.add_argument("--destructive", action="store_true", help="allow writing to a raw block device")
+    args = parser.parse_args()
+
+    if args.report:
+        rows = []
+        for name in args.report:
+            with open(name) as f:
+                rows.extend(json.loads(line) for line in f if line.strip())
+        print(format_rows(rows))
+        return 0
+    if not args.target:
+        parser.error("target or --report required")
+
+    loads = [int(x) for x in args.load.split(",")]
+    if any(x != 0 for x in loads) and not args.control:
+        parser.error("--load needs --control")
+    if args.probe and not args.control:
+        parser.error("--probe needs --control")
+    control = Control(args.control) if args.control else None
+    try:
+        rows = bench(args.target, parse_size(args.size), parse_size(args.block), args.passes.split(","), loads,
+                     control, args.label, not args.no_direct, args.destructive, args.probe)
+    except (BenchError, OSError) as e:
+        sys.exit("error: %s" % e)
+    finally:
+        if control:
+            control.close()
+
+    print(format_rows(rows))
+    if args.json:
+        with open(args.json, "a") as f:
+            for r in rows:
+                f.write(json.dumps(r) + "\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+Tests of the MSC placement benchmark.
+
+Checks the latency statistics, and runs the benchmark on a temporary file
+with a pty standing in for the firmware's control channel: the placement
+name comes from the "placement" reply, each load level is set before its
+passes and the load is cleared at the end. The control request probe runs
+with RTS toggles replaced, a pty has no modem lines.
+
+Usage:
+    python3 tools/placement_bench/test_msc_bench.py [-v]
+"""
+
+import json
+import os
+import sys
+import tempfile
+import threading
+import time
+import unittest
+from unittest import mock
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, HERE)
+
+import msc_bench  # noqa: E402
+
+
+class FakeFirmware(threading.Thread):
+    """Answers control commands on the master side of a pty."""
+
+    def __init__(self, fd):
+        super().__init__(daemon=True)
+        self.fd = fd
+        self.commands = []
+
+    def run(self):
+        rx = b""
+        while True:
+            try:
+                data = os.read(self.fd, 1024)
+            except OSError:
+                return
+            if not data:
+                return
+            rx += data
+            while b"\n" in rx:
+                line, rx = rx.split(b"\n", 1)
+                cmd = line.decode().strip()
+                self.commands.append(cmd)
+                if cmd == "placement":
+                    reply = "placement shared, I/O on core 1, housekeeping on core 1, load 0%\nTinyUSB io ...\nOK\n"
+                elif cmd == "placement load 95":
+                    reply = "ERR 1\n"
+                else:
+                    reply = "OK\n"
+                os.write(self.fd, reply.encode())
+
+
+class BenchTest(unittest.TestCase):
+    def test_stats(self):
+        lat = [0.001] * 98 + [0.010, 0.050]
+        s = msc_bench.latency_stats(lat, 100 * 65536, 0.5)
+        self.assertEqual(s["requests"], 100)
+        self.assertAlmostEqual(s["mb_s"], 100 * 65536 / 0.5 / 1e6)
+        self.assertAlmostEqual(s["p50_ms"], 1.0)
+        self.assertAlmostEqual(s["p99_ms"], 10.0)
+        self.assertAlmostEqual(s["max_ms"], 50.0)
+        self.assertGreater(s["stdev_ms"], 4.0)
+        self.assertEqual(msc_bench.parse_size("64K"), 65536)
+        self.assertEqual(msc_bench.parse_size("8MiB"), 8 << 20)
+        self.assertEqual(msc_bench.parse_size("4096"), 4096)
+
+    def test_bench_with_control(self):
+        master, slave = os.openpty()
+        fw = FakeFirmware(master)
+        fw.start()
+        control = msc_bench.Control(os.ttyname(slave))
+        with tempfile.TemporaryDirectory() as tmp:
+            target = os.path.join(tmp, "bench.bin")
+            rows = msc_bench.bench(target, 1 << 20, 64 << 10, ["write", "read"], [0, 50], control, direct=False)
+            self.assertEqual(os.path.getsize(target), 1 << 20)
+
+            with self.assertRaises(msc_bench.BenchError):
+                control.command("placement load 95")
+
+            out = os.path.join(tmp, "runs.jsonl")
+            with open(out, "w") as f:
+                for r in rows:
+                    f.write(json.dumps(r) + "\n")
+            with open(out) as f:
+                report = msc_bench.format_rows([json.loads(line) for line in f])
+        control.close()
+        os.close(slave)
+
+        self.assertEqual([(r["load"], r["pass"]) for r in rows], [(0, "write"), (0, "read"), (50, "write"), (50, "read")])
+        self.assertTrue(all(r["placement"] == "shared" and r["requests"] == 16 for r in rows))
+        self.assertEqual(fw.commands[:3], ["placement", "placement load 0", "placement load 50"])
+        self.assertEqual(fw.commands[3], "placement load 0")
+        self.assertEqual(len(report.splitlines()), 5)
+
+    def test_control_probe(self):
+        toggles = []
+
+        def fake_toggle(fd, on):
+            toggles.append(on)
+            time.sleep(0.002)
+
+        master, slave = os.openpty()
+        FakeFirmware(master).start()
+        control = msc_bench.Control(os.ttyname(slave))
+        with tempfile.TemporaryDirectory() as tmp, mock.patch.object(msc_bench, "toggle_rts", fake_toggle):
+            target = os.path.join(tmp, "bench.bin")
+            rows = msc_bench.bench(target, 4 << 20, 4 << 10, ["write"], [0], control, label="worker", direct=False,
+                                   probe=True)
+        control.close()
+        os.close(slave)
+
+        self.assertEqual(rows[0]["placement"], "worker")
+        self.assertEqual(rows[0]["ctl_requests"], len(toggles))
+        self.assertGreater(len(toggles), 0)
+        self.assertEqual(toggles[0], True)
+        self.assertTrue(all(a != b for a, b in zip(toggles, toggles[1:])))
+        self.assertGreaterEqual(rows[0]["ctl_p50_ms"], 2.0)
+        self.assertLessEqual(rows[0]["ctl_p50_ms"], rows[0]["ctl_max_ms"])
+
+        report = msc_bench.format_rows(rows + [{k: v for k, v in rows[0].items() if not k.startswith("ctl_")}])
+        self.assertIn("ctl_p99_ms", report.splitlines()[0])
+        self.assertTrue(report.splitlines()[-1].endswith("-"))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+Tests of the trace dump converter.
+
+Builds dumps the way components/trace/trace.c writes them and checks the
+Chrome trace events: span pairing per task (also across cores and when
+nested), counters, the mapping of cycles to microseconds through sync
+events with cycle counter wrap-around, and dumps carried in log channel
+frames.
+
+Usage:
+    python3 tools/trace/test_trace2json.py [-v]
+"""
+
+import os
+import struct
+import sys
+import unittest
+import zlib
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, HERE)
+
+import trace2json  # noqa: E402
+
+HZ = 160000000
+T1, T2 = 0x3FC90010, 0x3FC90400
+WORK, IO, DEPTH = 0x3C001000, 0x3C001010, 0x3C001020
+
+
+def chunk(ctype, core, body):
+    return struct.pack("<BBH", ctype, core, len(body)) + body
+
+
+def event(cycles, name, task, etype, value=0):
+    return struct.pack("<IIIi", cycles & 0xFFFFFFFF, name, task | etype, value)
+
+
+def dump(events_by_core, dropped=(0, 0)):
+    out = trace2json.MAGIC + chunk(trace2json.HEADER, 0, struct.pack("<II", HZ, 2))
+    out += chunk(trace2json.TASK, 0, struct.pack("<I", T1) + b"tinyusb")
+    out += chunk(trace2json.TASK, 0, struct.pack("<I", T2) + b"io_monitor")
+    for addr, name in ((WORK, b"work"), (IO, b"io"), (DEPTH, b"depth"), (0x3C0000F0, b"sync")):
+        out += chunk(trace2json.NAME, 0, struct.pack("<I", addr) + name)
+    for core, events in events_by_core.items():
+        out += chunk(trace2json.EVENTS, core, b"".join(events))
+    return out + chunk(trace2json.END, 0, struct.pack("<2I", *dropped))
+
+
+def sync(cycles, us):
+    return event(cycles, 0x3C0000F0, 0, trace2json.SYNC, us & 0xFFFFFFFF)
+
+
+def spans(events):
+    return sorted((e["name"], e["tid"], e["pid"], e["ts"], e["dur"]) for e in events if e["ph"] == "X")
+
+
+class ConvertTest(unittest.TestCase):
+    def test_spans_and_counters(self):
+        # 160 cycles per microsecond
+        core0 = [sync(0, 1000), event(1600, WORK, T1, trace2json.BEGIN), event(3200, IO, T1, trace2json.BEGIN),
+                 event(4800, IO, T1, trace2json.FINISH), event(8000, WORK, T1, trace2json.FINISH),
+                 event(9600, DEPTH, T1, trace2json.COUNTER, -3), sync(160000, 2000)]
+        events = trace2json.convert(trace2json.parse(dump({0: core0})))
+        self.assertEqual(spans(events), [("io", T1, 0, 10.0, 10.0), ("work", T1, 0, 0.0, 40.0)])
+        counters = [e for e in events if e["ph"] == "C"]
+        self.assertEqual(counters, [{"name": "depth", "ph": "C", "ts": 50.0, "pid": trace2json.COUNTER_PID,
+                                     "args": {"depth": -3}}])
+        names = {(e["pid"], e.get("tid")): e["args"]["name"] for e in events if e["ph"] == "M"}
+        self.assertEqual(names[(0, T1)], "tinyusb")
+        self.assertEqual(names[(0, None)], "Core 0")
+
+    def test_cores_aligned_by_sync(self):
+        # Core 1's cycle counter is far off core 0's, and wraps
+        base1 = 0xFFFFF000
+        core0 = [sync(0, 5000), event(16000, WORK, T1, trace2json.BEGIN), sync(160000, 6000)]
+        core1 = [sync(base1, 5000), event(base1 + 32000, WORK, T1, trace2json.FINISH),
+                 event(base1 + 48000, IO, T2, trace2json.BEGIN), event(base1 + 64000, IO, T2, trace2json.FINISH),
+                 sync(base1 + 160000, 6000)]
+        events = trace2json.convert(trace2json.parse(dump({0: core0, 1: core1})))
+        # Span moved from core 0 to core 1 with its task
+        self.assertEqual(spans(events), [("io", T2, 1, 200.0, 100.0), ("work", T1, 0, 0.0, 100.0)])
+        work = [e for e in events if e["ph"] == "X" and e["name"] == "work"][0]
+        self.assertEqual(work["args"], {"ended_on_core": 1})
+
+    def test_unfinished_and_isr(self):
+        core0 = [event(0, WORK, T1, trace2json.BEGIN), event(800, IO, 0, trace2json.BEGIN),
+                 event(1600, IO, 0, trace2json.FINISH), event(3200, DEPTH, T2, trace2json.COUNTER, 1)]
+        events = trace2json.convert(trace2json.parse(dump({0: core0})))
+        # Without syncs the header clock is used
+        self.assertEqual(spans(events), [("io", 0, 0, 5.0, 5.0), ("work", T1, 0, 0.0, 20.0)])
+        names = {(e["pid"], e.get("tid")): e["args"]["name"] for e in events if e["ph"] == "M"}
+        self.assertEqual(names[(0, 0)], "ISR")
+
+    def test_framed_dump(self):
+        data = dump({0: [event(0, WORK, T1, trace2json.BEGIN), event(160, WORK, T1, trace2json.FINISH)]}, (4, 1))
+        stream = b"I (100) usb_cdc: log text\n"
+        for seq, i in enumerate(range(0, len(data), 40)):
+            part = data[i:i + 40]
+            frame = trace2json.FRAME_MAGIC + struct.pack("<HH", seq, len(part)) + part
+            stream += frame + struct.pack("<I", zlib.crc32(frame)) + b"more text\n"
+        parsed = trace2json.parse(stream)
+        self.assertEqual(parsed["dropped"], [4, 1])
+        self.assertEqual(spans(trace2json.convert(parsed)), [("work", T1, 0, 0.0, 1.0)])
+
+        # A lost frame is reported, not silently skipped
+        broken = stream.replace(trace2json.FRAME_MAGIC + struct.pack("<H", 1), b"xxxxxx", 1)
+        with self.assertRaises(trace2json.DumpError):
+            trace2json.parse(broken)
+
+
+if __name__ == "__main__":
+    unittest.main()
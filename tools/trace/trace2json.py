@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""
+Converts a trace dump (components/trace) to Chrome trace JSON.
+
+The input is either a file written by trace_save() (e.g. copied off the
+FATFS volume), or a capture of the CDC log channel after the "trace dump"
+command, where the dump is carried in CRC-checked frames between other
+log output. The JSON opens in chrome://tracing and ui.perfetto.dev:
+one process per core, one thread per task, spans as complete events and
+counters as counter tracks.
+
+Cycle counts of each core are mapped to microseconds through the sync
+events the firmware records once a second, which also aligns the cores;
+before the first and after the last sync the CPU clock of the dump header
+is used.
+
+Needs nothing beyond the standard library.
+
+Usage:
+    trace2json.py trace.bin trace.json
+    trace2json.py capture_of_ttyACM1.bin trace.json
+"""
+
+import argparse
+import bisect
+import json
+import struct
+import sys
+import zlib
+
+MAGIC = b"TRC1"
+FRAME_MAGIC = b"\xb1TR\x01"
+FRAME = struct.Struct("<4sHH")
+CRC = struct.Struct("<I")
+CHUNK = struct.Struct("<BBH")
+EVENT = struct.Struct("<IIIi")
+
+HEADER, NAME, TASK, EVENTS, END = range(1, 6)
+BEGIN, FINISH, COUNTER, SYNC = range(4)
+COUNTER_PID = 100
+
+
+class DumpError(Exception):
+    pass
+
+
+def unframe(data):
+    """Dump bytes carried in log channel frames, in sequence order."""
+    parts = {}
+    pos = 0
+    while True:
+        i = data.find(FRAME_MAGIC, pos)
+        if i < 0 or len(data) - i < FRAME.size:
+            break
+        _, seq, plen = FRAME.unpack_from(data, i)
+        end = i + FRAME.size + plen
+        if end + CRC.size <= len(data) and zlib.crc32(data[i:end]) == CRC.unpack_from(data, end)[0]:
+            parts[seq] = data[i + FRAME.size:end]
+            pos = end + CRC.size
+        else:
+            pos = i + 1
+    if not parts:
+        raise DumpError("no trace frames found")
+    missing = [s for s in range(max(parts) + 1) if s not in parts]
+    if missing:
+        raise DumpError("%d of %d frames missing or corrupt, first is %d" % (len(missing), max(parts) + 1, missing[0]))
+    return b"".join(parts[s] for s in sorted(parts))
+
+
+def parse(data):
+    """Header values, names, task names, events per core and drops."""
+    if data[:4] != MAGIC:
+        data = unframe(data)
+    if data[:4] != MAGIC:
+        raise DumpError("not a trace dump")
+
+    dump = {"cpu_hz": 0, "names": {}, "tasks": {}, "events": {}, "dropped": []}
+    pos = 4
+    while pos + CHUNK.size <= len(data):
+        ctype, core, length = CHUNK.unpack_from(data, pos)
+        body = data[pos + CHUNK.size:pos + CHUNK.size + length]
+        if len(body) < length:
+            raise DumpError("dump cut short at byte %d" % pos)
+        if ctype == HEADER:
+            dump["cpu_hz"], dump["cores"] = struct.unpack_from("<II", body)
+        elif ctype in (NAME, TASK):
+            key, = struct.unpack_from("<I", body)
+            dump["names" if ctype == NAME else "tasks"][key] = body[4:].decode(errors="replace")
+        elif ctype == EVENTS:
+            dump["events"].setdefault(core, []).extend(EVENT.iter_unpack(body))
+        elif ctype == END:
+            dump["dropped"] = list(struct.unpack("<%dI" % (length // 4), body))
+        pos += CHUNK.size + length
+    if not dump["cpu_hz"]:
+        raise DumpError("dump has no header")
+    return dump
+
+
+def unwrap(values, bits=32):
+    """Extends wrapping counters, assuming neighbours are less than half a wrap apart."""
+    out = []
+    mod = 1 << bits
+    last = None
+    for v in values:
+        if last is None:
+            last = v
+        else:
+            last += (v - last + mod // 2) % mod - mod // 2
+        out.append(last)
+    return out
+
+
+class Clock:
+    """Cycle count of one core to microseconds."""
+
+    def __init__(self, syncs, cpu_hz):
+        self.cycles = [c for c, _ in syncs]
+        self.us = [u for _, u in syncs]
+        self.mhz = cpu_hz / 1e6
+
+    def __call__(self, cycles):
+        if not self.cycles:
+            return cycles / self.mhz
+        i = bisect.bisect_right(self.cycles, cycles)
+        if 0 < i < len(self.cycles):
+            c0, c1 = self.cycles[i - 1], self.cycles[i]
+            u0, u1 = self.us[i - 1], self.us[i]
+            return u0 + (cycles - c0) * (u1 - u0) / (c1 - c0) if c1 != c0 else u0
+        j = 0 if i == 0 else len(self.cycles) - 1
+        return self.us[j] + (cycles - self.cycles[j]) / self.mhz
+
+
+def convert(dump):
+    """Chrome trace events of a parsed dump."""
+    names = dump["names"]
+    tasks = dump["tasks"]
+    timeline = []
+    for core, events in sorted(dump["events"].items()):
+        cycles = unwrap([e[0] for e in events])
+        sync_us = unwrap([e[3] & 0xFFFFFFFF for e in events if e[2] & 3 == SYNC])
+        syncs = sorted(zip([c for c, e in zip(cycles, events) if e[2] & 3 == SYNC], sync_us))
+        clock = Clock(syncs, dump["cpu_hz"])
+        for c, (_, name, task, value) in zip(cycles, events):
+            if task & 3 != SYNC:
+                timeline.append((clock(c), core, task & ~3, task & 3, names.get(name, "0x%08x" % name), value))
+    timeline.sort(key=lambda e: e[0])
+
+    out = []
+    if timeline:
+        t0 = timeline[0][0]
+        # Spans are matched per task, so a task that moves to the other core keeps its span
+        open_spans = {}
+        for ts, core, task, etype, name, value in timeline:
+            ts -= t0
+            if etype == BEGIN:
+                open_spans.setdefault(task, []).append((name, ts, core))
+            elif etype == FINISH:
+                stack = open_spans.get(task, [])
+                for i in range(len(stack) - 1, -1, -1):
+                    if stack[i][0] == name:
+                        _, start, start_core = stack.pop(i)
+                        out.append({"name": name, "ph": "X", "ts": round(start, 3), "dur": round(ts - start, 3),
+                                    "pid": start_core, "tid": task,
+                                    "args": {} if start_core == core else {"ended_on_core": core}})
+                        break
+            else:
+                out.append({"name": name, "ph": "C", "ts": round(ts, 3), "pid": COUNTER_PID, "args": {name: value}})
+        end = timeline[-1][0] - t0
+        for task, stack in open_spans.items():
+            for name, start, core in stack:
+                out.append({"name": name, "ph": "X", "ts": round(start, 3), "dur": round(end - start, 3),
+                            "pid": core, "tid": task, "args": {"unfinished": True}})
+
+    threads = sorted({(e["pid"], e["tid"]) for e in out if e["ph"] == "X"})
+    meta = [{"name": "process_name", "ph": "M", "pid": core, "args": {"name": "Core %d" % core}}
+            for core in sorted(dump["events"])]
+    meta.append({"name": "process_name", "ph": "M", "pid": COUNTER_PID, "args": {"name": "Counters"}})
+    for pid, tid in threads:
+        label = "ISR" if tid == 0 else tasks.get(tid, "task 0x%08x" % tid)
+        meta.append({"name": "thread_name", "ph": "M", "pid": pid, "tid": tid, "args": {"name": label}})
+    return meta + out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("input", help="trace_save() file, or a capture of the CDC log channel")
+    parser.add_argument("output", help="Chrome trace JSON to write")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+    try:
+        dump = parse(data)
+    except DumpError as e:
+        sys.exit("error: %s" % e)
+
+    events = convert(dump)
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, f)
+
+    counts = ", ".join("core %d: %d" % (c, len(e)) for c, e in sorted(dump["events"].items()))
+    print("%s (%s events), %d dropped" % (args.output, counts or "no", sum(dump["dropped"])))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())